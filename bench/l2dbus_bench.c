@@ -0,0 +1,557 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_bench.c
+ * @author         Glenn Schmottlach
+ * @brief          Micro-benchmarks for the transcode, message and dispatch paths.
+ *===========================================================================
+ */
+/*
+ * Usage: l2dbus_bench [iterations] [filter]
+ *
+ * Each benchmark is executed in-process against an embedded Lua state
+ * that has the l2dbus core module loaded. No bus connection is required.
+ * Results are written to stdout as a JSON document. The allocation counts
+ * reflect allocations made through the Lua state allocator (e.g. strings,
+ * tables, userdata) and not those made internally by libdbus.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "dbus/dbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_types.h"
+#include "l2dbus_callback.h"
+#include "l2dbus_object.h"
+#include "l2dbus_message.h"
+#include "l2dbus_transcode.h"
+#include "l2dbus_match.h"
+
+#define L2DBUS_BENCH_DEFAULT_ITERATIONS     (100000)
+#define L2DBUS_BENCH_MAX_WARMUP             (1000)
+#define L2DBUS_BENCH_SIGNAL_PATH            "/com/xs/l2dbus/Bench"
+#define L2DBUS_BENCH_SIGNAL_INTF            "com.xs.l2dbus.Bench"
+#define L2DBUS_BENCH_SIGNAL_MEMBER          "Payload"
+
+extern int luaopen_l2dbus_core(lua_State* L);
+
+/* Counters maintained by the instrumented Lua allocator */
+typedef struct l2dbus_BenchAllocStats
+{
+    unsigned long   allocs;
+    unsigned long   bytes;
+} l2dbus_BenchAllocStats;
+
+/* A payload used to exercise the transcoder */
+typedef struct l2dbus_BenchPayload
+{
+    const char*     name;
+    const char*     signature;
+    int             argsRef;
+    int             nArgs;
+    DBusMessage*    msg;
+} l2dbus_BenchPayload;
+
+struct l2dbus_BenchCtx;
+typedef void (*l2dbus_BenchFunc)(lua_State* L, struct l2dbus_BenchCtx* ctx,
+                                unsigned long iterations);
+
+typedef struct l2dbus_BenchCtx
+{
+    l2dbus_BenchPayload*    payload;
+    l2dbus_Match            match;
+    int                     callbackRef;
+} l2dbus_BenchCtx;
+
+static l2dbus_BenchAllocStats gAllocStats;
+
+/* Defines the Lua values for each payload. The Lua table is indexed
+ * by the payload name and holds the arguments as an array.
+ */
+static const char gPayloadChunk[] =
+    "local dict = {}\n"
+    "for i = 1, 16 do\n"
+    "  dict['key' .. i] = (i % 2 == 0) and ('value' .. i) or i\n"
+    "end\n"
+    "local aay = {}\n"
+    "for i = 1, 16 do\n"
+    "  local ay = {}\n"
+    "  for j = 1, 32 do ay[j] = (i + j) % 256 end\n"
+    "  aay[i] = ay\n"
+    "end\n"
+    "local deep = {1, {'two', {3.5, {true, {'five', {6, {'seven'}}}}}}}\n"
+    "return {\n"
+    "  scalars = {42, 'hello', true, 3.25, 7},\n"
+    "  asv = {dict},\n"
+    "  aay = {aay},\n"
+    "  deep = {deep},\n"
+    "}\n";
+
+static l2dbus_BenchPayload gPayloads[] =
+{
+    { "scalars", "isbdu", LUA_NOREF, 0, NULL },
+    { "asv", "a{sv}", LUA_NOREF, 0, NULL },
+    { "aay", "aay", LUA_NOREF, 0, NULL },
+    { "deep", "(i(s(d(b(s(i(s)))))))", LUA_NOREF, 0, NULL }
+};
+
+
+static void*
+l2dbus_benchAlloc
+    (
+    void*   ud,
+    void*   ptr,
+    size_t  osize,
+    size_t  nsize
+    )
+{
+    l2dbus_BenchAllocStats* stats = (l2dbus_BenchAllocStats*)ud;
+
+    /* Lua 5.2 passes the type of the object in 'osize' for new blocks */
+    if ( NULL == ptr )
+    {
+        osize = 0;
+    }
+
+    if ( 0 == nsize )
+    {
+        free(ptr);
+        return NULL;
+    }
+
+    if ( nsize > osize )
+    {
+        stats->allocs++;
+        stats->bytes += (unsigned long)(nsize - osize);
+    }
+
+    return realloc(ptr, nsize);
+}
+
+
+static double
+l2dbus_benchNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1.0e9 + (double)ts.tv_nsec;
+}
+
+
+static DBusMessage*
+l2dbus_benchNewSignal(void)
+{
+    DBusMessage* msg = dbus_message_new_signal(L2DBUS_BENCH_SIGNAL_PATH,
+                                            L2DBUS_BENCH_SIGNAL_INTF,
+                                            L2DBUS_BENCH_SIGNAL_MEMBER);
+    if ( NULL == msg )
+    {
+        fprintf(stderr, "Failed to allocate a D-Bus message\n");
+        exit(EXIT_FAILURE);
+    }
+    return msg;
+}
+
+
+static int
+l2dbus_benchPushArgs
+    (
+    lua_State*              L,
+    l2dbus_BenchPayload*    payload
+    )
+{
+    int argIdx;
+    int i;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, payload->argsRef);
+    argIdx = lua_gettop(L);
+    for ( i = 1; i <= payload->nArgs; ++i )
+    {
+        lua_rawgeti(L, argIdx, i);
+    }
+    lua_remove(L, argIdx);
+    return argIdx;
+}
+
+
+static void
+l2dbus_benchMarshall
+    (
+    lua_State*          L,
+    l2dbus_BenchCtx*    ctx,
+    unsigned long       iterations
+    )
+{
+    int argIdx = l2dbus_benchPushArgs(L, ctx->payload);
+    DBusMessage* msg;
+
+    while ( iterations-- > 0 )
+    {
+        msg = l2dbus_benchNewSignal();
+        l2dbus_transcodeLuaArgsToDbus(L, msg, argIdx, ctx->payload->nArgs);
+        dbus_message_unref(msg);
+    }
+    lua_settop(L, argIdx - 1);
+}
+
+
+static void
+l2dbus_benchMarshallBySignature
+    (
+    lua_State*          L,
+    l2dbus_BenchCtx*    ctx,
+    unsigned long       iterations
+    )
+{
+    int argIdx = l2dbus_benchPushArgs(L, ctx->payload);
+    DBusMessage* msg;
+
+    while ( iterations-- > 0 )
+    {
+        msg = l2dbus_benchNewSignal();
+        l2dbus_transcodeLuaArgsToDbusBySignature(L, msg, argIdx,
+                                    ctx->payload->nArgs,
+                                    ctx->payload->signature);
+        dbus_message_unref(msg);
+    }
+    lua_settop(L, argIdx - 1);
+}
+
+
+static void
+l2dbus_benchUnmarshall
+    (
+    lua_State*          L,
+    l2dbus_BenchCtx*    ctx,
+    unsigned long       iterations
+    )
+{
+    l2dbus_TranscodeOpts opts;
+    int top = lua_gettop(L);
+
+    memset(&opts, 0, sizeof(opts));
+    while ( iterations-- > 0 )
+    {
+        l2dbus_transcodeDbusArgsToLua(L, ctx->payload->msg, &opts);
+        lua_settop(L, top);
+    }
+}
+
+
+static void
+l2dbus_benchMessageWrap
+    (
+    lua_State*          L,
+    l2dbus_BenchCtx*    ctx,
+    unsigned long       iterations
+    )
+{
+    while ( iterations-- > 0 )
+    {
+        l2dbus_messageWrap(L, ctx->payload->msg, L2DBUS_TRUE);
+        lua_pop(L, 1);
+    }
+}
+
+
+static void
+l2dbus_benchMatchDispatch
+    (
+    lua_State*          L,
+    l2dbus_BenchCtx*    ctx,
+    unsigned long       iterations
+    )
+{
+    while ( iterations-- > 0 )
+    {
+        l2dbus_matchDeliver(&ctx->match, ctx->payload->msg);
+    }
+}
+
+
+static void
+l2dbus_benchTimeoutDispatch
+    (
+    lua_State*          L,
+    l2dbus_BenchCtx*    ctx,
+    unsigned long       iterations
+    )
+{
+    lua_State* thread = l2dbus_callbackGetThread();
+    void* ud;
+
+    /* Mirrors the timeout handler: the object is resolved through the
+     * object registry and the Lua handler called with the object and the
+     * user value. Driving a real timeout requires a dispatcher and main
+     * loop which would dominate the measurement.
+     */
+    while ( iterations-- > 0 )
+    {
+        ud = l2dbus_objectRegistryGet(thread, ctx);
+        if ( NULL != ud )
+        {
+            lua_rawgeti(thread, LUA_REGISTRYINDEX, ctx->match.cbCtx.funcRef);
+            lua_pushvalue(thread, -2);
+            lua_rawgeti(thread, LUA_REGISTRYINDEX, ctx->match.cbCtx.userRef);
+            lua_pcall(thread, 2, 0, 0);
+        }
+        lua_settop(thread, 0);
+    }
+}
+
+
+/* A benchmark is run from a protected call so that a transcoding error
+ * is reported rather than aborting the benchmark program.
+ */
+static int
+l2dbus_benchTrampoline
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_BenchFunc func = (l2dbus_BenchFunc)(size_t)lua_touserdata(L, 1);
+    l2dbus_BenchCtx* ctx = (l2dbus_BenchCtx*)lua_touserdata(L, 2);
+    unsigned long iterations = (unsigned long)lua_tonumber(L, 3);
+
+    lua_settop(L, 0);
+    func(L, ctx, iterations);
+    return 0;
+}
+
+
+static int
+l2dbus_benchRun
+    (
+    lua_State*          L,
+    const char*         name,
+    const char*         filter,
+    l2dbus_BenchFunc    func,
+    l2dbus_BenchCtx*    ctx,
+    unsigned long       iterations,
+    l2dbus_Bool         first
+    )
+{
+    unsigned long warmup = iterations / 10;
+    l2dbus_BenchAllocStats before;
+    double start;
+    double elapsed;
+    int status;
+
+    if ( (NULL != filter) && (NULL == strstr(name, filter)) )
+    {
+        return first;
+    }
+
+    if ( warmup > L2DBUS_BENCH_MAX_WARMUP )
+    {
+        warmup = L2DBUS_BENCH_MAX_WARMUP;
+    }
+
+    lua_pushcfunction(L, l2dbus_benchTrampoline);
+    lua_pushlightuserdata(L, (void*)(size_t)func);
+    lua_pushlightuserdata(L, ctx);
+    lua_pushnumber(L, (lua_Number)warmup);
+    status = lua_pcall(L, 3, 0, 0);
+
+    if ( 0 == status )
+    {
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        before = gAllocStats;
+        lua_pushcfunction(L, l2dbus_benchTrampoline);
+        lua_pushlightuserdata(L, (void*)(size_t)func);
+        lua_pushlightuserdata(L, ctx);
+        lua_pushnumber(L, (lua_Number)iterations);
+        start = l2dbus_benchNow();
+        status = lua_pcall(L, 3, 0, 0);
+        elapsed = l2dbus_benchNow() - start;
+    }
+
+    printf("%s\n    {\"name\": \"%s\", ", first ? "" : ",", name);
+    if ( 0 != status )
+    {
+        printf("\"error\": \"%s\"}", lua_isstring(L, -1) ?
+                lua_tostring(L, -1) : "unknown error");
+        lua_pop(L, 1);
+    }
+    else
+    {
+        printf("\"ns_per_op\": %.1f, \"allocs_per_op\": %.2f, "
+                "\"gc_bytes_per_op\": %.1f}",
+                elapsed / (double)iterations,
+                (double)(gAllocStats.allocs - before.allocs) / (double)iterations,
+                (double)(gAllocStats.bytes - before.bytes) / (double)iterations);
+    }
+
+    return L2DBUS_FALSE;
+}
+
+
+static void
+l2dbus_benchLoadPayloads
+    (
+    lua_State*  L
+    )
+{
+    unsigned idx;
+    int argIdx;
+
+    if ( 0 != luaL_loadstring(L, gPayloadChunk) ||
+        0 != lua_pcall(L, 0, 1, 0) )
+    {
+        fprintf(stderr, "Failed to load payloads: %s\n", lua_tostring(L, -1));
+        exit(EXIT_FAILURE);
+    }
+
+    for ( idx = 0; idx < sizeof(gPayloads) / sizeof(gPayloads[0]); ++idx )
+    {
+        lua_getfield(L, -1, gPayloads[idx].name);
+        gPayloads[idx].nArgs = (int)lua_rawlen(L, -1);
+        gPayloads[idx].argsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+        /* Pre-built message used for the decoding benchmarks */
+        gPayloads[idx].msg = l2dbus_benchNewSignal();
+        argIdx = l2dbus_benchPushArgs(L, &gPayloads[idx]);
+        l2dbus_transcodeLuaArgsToDbusBySignature(L, gPayloads[idx].msg,
+                                    argIdx, gPayloads[idx].nArgs,
+                                    gPayloads[idx].signature);
+        lua_settop(L, argIdx - 1);
+    }
+    lua_pop(L, 1);
+}
+
+
+int
+main
+    (
+    int     argc,
+    char*   argv[]
+    )
+{
+    unsigned long iterations = L2DBUS_BENCH_DEFAULT_ITERATIONS;
+    const char* filter = NULL;
+    l2dbus_Bool first = L2DBUS_TRUE;
+    l2dbus_BenchCtx ctx;
+    char name[64];
+    lua_State* L;
+    unsigned idx;
+
+    if ( argc > 1 )
+    {
+        iterations = strtoul(argv[1], NULL, 10);
+        if ( 0 == iterations )
+        {
+            iterations = L2DBUS_BENCH_DEFAULT_ITERATIONS;
+        }
+    }
+
+    if ( argc > 2 )
+    {
+        filter = argv[2];
+    }
+
+    memset(&gAllocStats, 0, sizeof(gAllocStats));
+    L = lua_newstate(l2dbus_benchAlloc, &gAllocStats);
+    if ( NULL == L )
+    {
+        /* 64-bit LuaJIT does not support custom allocators */
+        L = luaL_newstate();
+    }
+
+    if ( NULL == L )
+    {
+        fprintf(stderr, "Failed to create a Lua state\n");
+        return EXIT_FAILURE;
+    }
+
+    luaL_openlibs(L);
+    lua_pushcfunction(L, luaopen_l2dbus_core);
+    lua_call(L, 0, 0);
+    l2dbus_benchLoadPayloads(L);
+
+    /* A no-op Lua handler used by the dispatch benchmarks */
+    memset(&ctx, 0, sizeof(ctx));
+    luaL_loadstring(L, "return function() end");
+    lua_call(L, 0, 1);
+    lua_newuserdata(L, sizeof(int));
+    l2dbus_callbackRef(L, -2, -1, &ctx.match.cbCtx);
+    l2dbus_objectRegistryAdd(L, &ctx, -1);
+    lua_settop(L, 0);
+
+    printf("{\n  \"benchmark\": \"l2dbus\",\n  \"iterations\": %lu,\n"
+            "  \"results\": [", iterations);
+
+    for ( idx = 0; idx < sizeof(gPayloads) / sizeof(gPayloads[0]); ++idx )
+    {
+        ctx.payload = &gPayloads[idx];
+
+        snprintf(name, sizeof(name), "marshall/%s", gPayloads[idx].name);
+        first = l2dbus_benchRun(L, name, filter, l2dbus_benchMarshall,
+                                &ctx, iterations, first);
+
+        snprintf(name, sizeof(name), "marshall_sig/%s", gPayloads[idx].name);
+        first = l2dbus_benchRun(L, name, filter,
+                                l2dbus_benchMarshallBySignature,
+                                &ctx, iterations, first);
+
+        snprintf(name, sizeof(name), "unmarshall/%s", gPayloads[idx].name);
+        first = l2dbus_benchRun(L, name, filter, l2dbus_benchUnmarshall,
+                                &ctx, iterations, first);
+    }
+
+    ctx.payload = &gPayloads[0];
+    first = l2dbus_benchRun(L, "message/wrap", filter,
+                            l2dbus_benchMessageWrap, &ctx, iterations, first);
+
+    ctx.match.borrowMsg = L2DBUS_FALSE;
+    first = l2dbus_benchRun(L, "dispatch/match", filter,
+                            l2dbus_benchMatchDispatch, &ctx, iterations, first);
+
+    ctx.match.borrowMsg = L2DBUS_TRUE;
+    first = l2dbus_benchRun(L, "dispatch/match_borrowed", filter,
+                            l2dbus_benchMatchDispatch, &ctx, iterations, first);
+
+    first = l2dbus_benchRun(L, "dispatch/timeout", filter,
+                            l2dbus_benchTimeoutDispatch, &ctx, iterations, first);
+
+    printf("\n  ]\n}\n");
+
+    l2dbus_objectRegistryRemove(L, &ctx);
+    l2dbus_callbackUnref(L, &ctx.match.cbCtx);
+    for ( idx = 0; idx < sizeof(gPayloads) / sizeof(gPayloads[0]); ++idx )
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, gPayloads[idx].argsRef);
+        dbus_message_unref(gPayloads[idx].msg);
+    }
+    lua_close(L);
+
+    return EXIT_SUCCESS;
+}
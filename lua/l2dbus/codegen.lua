@@ -0,0 +1,379 @@
+--[[
+*****************************************************************************
+Project         l2dbus
+
+Released under the MIT License (MIT)
+Copyright (c) 2013 XS-Embedded LLC
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*****************************************************************************
+*****************************************************************************
+@file           codegen.lua
+@author         Glenn Schmottlach
+@brief          Generates typed proxies and service stubs from introspection.
+*****************************************************************************
+--]]
+
+--- Code Generator Module.
+-- This module generates Lua source code for typed proxies and service stubs
+-- from D-Bus XML introspection data (or the equivalent Lua introspection
+-- table described by ProxyController:bindNoIntrospect). The
+-- @{l2dbus.proxyctrl|ProxyController} and @{l2dbus.service|Service} classes
+-- interpret the interface metadata at runtime. The generated code instead
+-- hard-codes the signature and arity of every method and signal so a call
+-- goes straight to a prebuilt @{l2dbus.CallTemplate|CallTemplate} (or a
+-- compiled signature) without any metadata lookups.
+-- </br></br>
+-- The generated module returns a table indexed by interface name. Every
+-- interface entry provides:
+-- <ul>
+-- <li>*interface* - The D-Bus interface name.</li>
+-- <li>*metadata* - The interface @{l2dbus.service.DbusInterfaceMetadata|metadata}
+-- suitable for @{l2dbus.service.Service:addInterface|Service:addInterface}.</li>
+-- <li>*newProxy(ctrl)* - Returns a table of method functions bound to the
+-- (bound or unbound) ProxyController *ctrl*. The functions take exactly the
+-- input arguments of the method and return the same values as the methods
+-- of a @{l2dbus.proxyctrl.ProxyController:getProxy|ProxyController proxy}.</li>
+-- <li>*register(svc, impl)* - Adds the interface to the Service *svc* and
+-- registers the handlers found in the *impl* table (indexed by method
+-- name).</li>
+-- <li>*newEmitter(svc, conn)* - Returns a table of functions which emit the
+-- signals of the interface from the Service *svc* on the connection
+-- *conn*.</li>
+-- </ul>
+-- A generator can be run from the command line as well:
+--
+--    lua codegen.lua service.xml [output.lua]
+--
+-- @module l2dbus.codegen
+-- @alias M
+
+
+local l2dbus = require("l2dbus")
+local validate = require("l2dbus.validate")
+
+local verifyTypesWithMsg	=	validate.verifyTypesWithMsg
+
+local M = { }
+
+local LUA_KEYWORDS = {
+	["and"] = true, ["break"] = true, ["do"] = true, ["else"] = true,
+	["elseif"] = true, ["end"] = true, ["false"] = true, ["for"] = true,
+	["function"] = true, ["goto"] = true, ["if"] = true, ["in"] = true,
+	["local"] = true, ["nil"] = true, ["not"] = true, ["or"] = true,
+	["repeat"] = true, ["return"] = true, ["then"] = true, ["true"] = true,
+	["until"] = true, ["while"] = true
+}
+
+-- The code shared by every generated module
+local PRELUDE = [[
+-- Generated by l2dbus.codegen from D-Bus introspection data. Do not edit.
+local l2dbus = require("l2dbus")
+local unpack = unpack or table.unpack
+
+-- Sends a method call the way a ProxyController method proxy does
+local function call(ctrl, msg, method)
+	if not msg then
+		error("unable to create D-Bus method call message")
+	end
+	if ctrl:getProxyNoReplyNeeded() then
+		local status, serNum = ctrl:sendMessageNoReply(msg)
+		msg:dispose()
+		if status then
+			return true, serNum
+		end
+		return false, l2dbus.Dbus.ERROR_FAILED,
+				string.format("Unable to call method %s", method)
+	end
+	local reply, errName, errMsg = ctrl:sendMessage(msg)
+	msg:dispose()
+	if not reply then
+		return false, errName, errMsg
+	elseif "l2dbus.message" == reply.__type then
+		return true, reply:takeArgs()
+	end
+	return true, reply
+end
+
+-- Emits a signal with a compiled signature
+local function emit(conn, path, intf, name, plan, ...)
+	local msg = l2dbus.Message.newSignal(path, intf, name)
+	msg:addArgsBySignature(plan, ...)
+	local result = conn:send(msg)
+	msg:dispose()
+	return result
+end
+
+local M = {}
+]]
+
+
+--
+-- Returns the members of a (name indexed) introspection table sorted by
+-- name so the generated code is stable.
+--
+local function sortedNames(members)
+	local names = {}
+	for name in pairs(members or {}) do
+		names[#names + 1] = name
+	end
+	table.sort(names)
+	return names
+end
+
+
+--
+-- Returns the Lua parameter names for the arguments with the given
+-- direction. Names which cannot be used as Lua identifiers are replaced.
+--
+local function paramNames(args, dir)
+	local names = {}
+	local used = {}
+	local signature = ""
+	for idx = 1, #args do
+		local arg = args[idx]
+		if (arg.dir or "in") == dir then
+			local name = arg.name
+			if (type(name) ~= "string") or LUA_KEYWORDS[name] or
+				(not name:match("^[%a_][%w_]*$")) or used[name] or
+				name:match("^arg%d+$") then
+				name = "arg" .. (#names + 1)
+			end
+			used[name] = true
+			names[#names + 1] = name
+			signature = signature .. arg.sig
+		end
+	end
+	return names, signature
+end
+
+
+--
+-- Converts a table to a Lua constructor (strings, numbers and tables only)
+--
+local function serialize(value, indent)
+	if type(value) == "string" then
+		return string.format("%q", value)
+	elseif type(value) ~= "table" then
+		return tostring(value)
+	end
+	
+	local pad = indent .. "\t"
+	local parts = {}
+	for idx = 1, #value do
+		parts[#parts + 1] = pad .. serialize(value[idx], pad)
+	end
+	for _, key in ipairs(sortedNames(value)) do
+		if type(key) == "string" then
+			parts[#parts + 1] = string.format("%s[%q] = %s", pad, key,
+											serialize(value[key], pad))
+		end
+	end
+	if #parts == 0 then
+		return "{}"
+	end
+	return "{\n" .. table.concat(parts, ",\n") .. "\n" .. indent .. "}"
+end
+
+
+--
+-- Converts the interface of a Lua introspection table into the metadata
+-- expected by Service:addInterface.
+--
+local function toServiceMetadata(intf)
+	local metadata = {interface = intf.interface, methods = {}, signals = {},
+					properties = {}}
+	for _, kind in ipairs({"methods", "signals"}) do
+		for _, name in ipairs(sortedNames(intf[kind])) do
+			local args = {}
+			for idx, arg in ipairs(intf[kind][name]) do
+				args[idx] = {name = arg.name, sig = arg.sig,
+							dir = (kind == "methods") and (arg.dir or "in") or nil}
+			end
+			table.insert(metadata[kind], {name = name, args = args})
+		end
+	end
+	for _, name in ipairs(sortedNames(intf.properties)) do
+		table.insert(metadata.properties, {name = name,
+									sig = intf.properties[name].sig,
+									access = intf.properties[name].access})
+	end
+	return metadata
+end
+
+
+--
+-- Generates the code for one interface
+--
+local function generateInterface(out, intfIdx, intf)
+	local var = "I" .. intfIdx
+	local line = function(fmt, ...)
+		out[#out + 1] = string.format(fmt, ...)
+	end
+	
+	line("")
+	line("local %s = {interface = %q}", var, intf.interface)
+	line("%s.metadata = %s", var, serialize(toServiceMetadata(intf), ""))
+	line("M[%q] = %s", intf.interface, var)
+	
+	-- Proxy methods with a fixed arity and a prebuilt call template
+	line("")
+	line("function %s.newProxy(ctrl)", var)
+	line("\tlocal proxy = {}")
+	for _, method in ipairs(sortedNames(intf.methods)) do
+		local params, inSig = paramNames(intf.methods[method], "in")
+		local paramList = table.concat(params, ", ")
+		line("\tlocal tmpl%s = l2dbus.Message.newCallTemplate(ctrl.busName, " ..
+			"ctrl.objPath, %q, %q, %q)", method, intf.interface, method, inSig)
+		line("\tproxy[%q] = function(%s)", method, paramList)
+		line("\t\treturn call(ctrl, tmpl%s:newCall(%s), %q)", method,
+			paramList, method)
+		line("\tend")
+	end
+	line("\treturn proxy")
+	line("end")
+	
+	-- Service registration
+	line("")
+	line("function %s.register(svc, impl)", var)
+	line("\tif not svc:addInterface(%s.interface, %s.metadata) then", var, var)
+	line("\t\treturn false")
+	line("\tend")
+	for _, method in ipairs(sortedNames(intf.methods)) do
+		line("\tif impl and impl[%q] then", method)
+		line("\t\tsvc:registerMethodHandler(%s.interface, %q, impl[%q])", var,
+			method, method)
+		line("\tend")
+	end
+	line("\treturn true")
+	line("end")
+	
+	-- Signal emitters with compiled signatures
+	line("")
+	line("function %s.newEmitter(svc, conn)", var)
+	line("\tlocal path = svc.objInst:path()")
+	line("\tlocal emitter = {}")
+	for _, signal in ipairs(sortedNames(intf.signals)) do
+		local params, sig = paramNames(intf.signals[signal], "out")
+		local paramList = table.concat(params, ", ")
+		line("\tlocal plan%s = l2dbus.Message.compileSignature(%q)", signal, sig)
+		line("\temitter[%q] = function(%s)", signal, paramList)
+		line("\t\treturn emit(conn, path, %s.interface, %q, plan%s%s)", var,
+			signal, signal, (#params > 0) and (", " .. paramList) or "")
+		line("\tend")
+	end
+	line("\treturn emitter")
+	line("end")
+end
+
+
+--- Generates Lua source code for typed proxies and service stubs.
+-- 
+-- The introspection data is either the D-Bus XML introspection string or
+-- a Lua introspection table (as described by
+-- ProxyController:bindNoIntrospect). The standard D-Bus interfaces
+-- (org.freedesktop.DBus.*) are skipped unless explicitly requested.
+-- A Lua error is thrown if the introspection data cannot be parsed.
+-- 
+-- @tparam string|table introspectData The introspection data.
+-- @tparam ?table interfaces An optional array of the interface names to
+-- generate code for. By default code is generated for every interface.
+-- @treturn string The Lua source code of the generated module.
+function M.generate(introspectData, interfaces)
+	verifyTypesWithMsg("string|table", "unexpected type for arg #1",
+						introspectData)
+	verifyTypesWithMsg("nil|table", "unexpected type for arg #2", interfaces)
+
+	if type(introspectData) == "string" then
+		introspectData = l2dbus.Introspection.parseXml(introspectData)
+	end
+	
+	local selected = nil
+	if interfaces then
+		selected = {}
+		for idx = 1, #interfaces do
+			if not introspectData[interfaces[idx]] then
+				error("unknown interface: " .. tostring(interfaces[idx]))
+			end
+			selected[interfaces[idx]] = true
+		end
+	end
+	
+	local out = { PRELUDE }
+	local intfIdx = 0
+	for _, name in ipairs(sortedNames(introspectData)) do
+		if (selected and selected[name]) or
+			((not selected) and (not name:match("^org%.freedesktop%.DBus%."))) then
+			intfIdx = intfIdx + 1
+			generateInterface(out, intfIdx, introspectData[name])
+		end
+	end
+	out[#out + 1] = "\nreturn M\n"
+	
+	return table.concat(out, "\n")
+end
+
+
+--- Generates and loads the typed proxies and service stubs.
+-- 
+-- This is a convenience function which @{generate|generates} the module
+-- and loads it without writing it to a file first.
+-- 
+-- @tparam string|table introspectData The introspection data.
+-- @tparam ?table interfaces An optional array of interface names.
+-- @treturn table The generated module indexed by interface name.
+function M.load(introspectData, interfaces)
+	local source = M.generate(introspectData, interfaces)
+	local chunk, errMsg = (loadstring or load)(source, "=l2dbus.codegen")
+	if not chunk then
+		error("generated code failed to load: " .. tostring(errMsg))
+	end
+	return chunk()
+end
+
+
+-- Called when this module is run as a program
+local function main(arg)
+	if not arg[1] then
+		print("Usage: " .. tostring(arg[0]) .. " <introspection.xml> [output.lua]")
+		return
+	end
+	
+	local inFile = assert(io.open(arg[1], "r"))
+	local source = M.generate(inFile:read("*a"))
+	inFile:close()
+	
+	if arg[2] then
+		local outFile = assert(io.open(arg[2], "w"))
+		outFile:write(source)
+		outFile:close()
+	else
+		io.write(source)
+	end
+end
+
+-- Determine the context in which the module is used
+if l2dbus.isMain() then
+	-- The module is being run as a program
+	main(arg)
+else
+	-- The module is being loaded rather than run
+	return M
+end
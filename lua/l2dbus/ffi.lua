@@ -0,0 +1,240 @@
+--[[
+*****************************************************************************
+Project         l2dbus
+
+Released under the MIT License (MIT)
+Copyright (c) 2013 XS-Embedded LLC
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*****************************************************************************
+*****************************************************************************
+@file           ffi.lua
+@author         Glenn Schmottlach
+@brief          LuaJIT FFI bindings for the hottest message operations.
+*****************************************************************************
+--]]
+
+--- LuaJIT FFI Module.
+-- This module is only available with LuaJIT. It binds the C ABI declared
+-- in *l2dbus_ffi.h* with the LuaJIT FFI so message creation, header
+-- access, appending arguments, iterating arguments and sending can be
+-- called from code that LuaJIT keeps compiling. Calls through the classic
+-- Lua C API (used by the rest of l2dbus) cannot be compiled.
+-- </br></br>
+-- Messages are plain *DBusMessage* pointers. Those created here are
+-- released by the garbage collector. Existing @{l2dbus.Message|Messages}
+-- and @{l2dbus.Connection|Connections} are converted with
+-- @{message} and @{connection}:
+--
+--    local lfi = require("l2dbus.ffi")
+--    local C = lfi.C
+--    local conn = lfi.connection(l2dbusConn)
+--    for i = 1, 100000 do
+--        local sig = lfi.newSignal("/com/acme", "com.acme.Meter", "Level")
+--        C.l2dbus_ffiAppendDouble(sig, i * 0.5)
+--        C.l2dbus_ffiSend(conn, sig, nil)
+--    end
+--
+-- @module l2dbus.ffi
+-- @alias M
+
+local ffi = require("ffi")
+local l2dbus = require("l2dbus")
+
+local M = { }
+
+-- Keep in step with src/l2dbus_ffi.h
+local ABI_VERSION = 1
+
+ffi.cdef[[
+typedef struct DBusMessage DBusMessage;
+typedef struct l2dbus_Connection l2dbus_Connection;
+typedef struct l2dbus_FfiIter l2dbus_FfiIter;
+
+int l2dbus_ffiAbiVersion(void);
+
+DBusMessage* l2dbus_ffiNewMethodCall(const char* destination,
+                                    const char* path,
+                                    const char* interface,
+                                    const char* member);
+DBusMessage* l2dbus_ffiNewMethodReturn(DBusMessage* call);
+DBusMessage* l2dbus_ffiNewSignal(const char* path, const char* interface,
+                                const char* member);
+DBusMessage* l2dbus_ffiNewError(DBusMessage* replyTo, const char* name,
+                                const char* text);
+void l2dbus_ffiMessageRef(DBusMessage* msg);
+void l2dbus_ffiMessageUnref(DBusMessage* msg);
+
+int l2dbus_ffiGetType(DBusMessage* msg);
+uint32_t l2dbus_ffiGetSerial(DBusMessage* msg);
+uint32_t l2dbus_ffiGetReplySerial(DBusMessage* msg);
+const char* l2dbus_ffiGetPath(DBusMessage* msg);
+const char* l2dbus_ffiGetInterface(DBusMessage* msg);
+const char* l2dbus_ffiGetMember(DBusMessage* msg);
+const char* l2dbus_ffiGetErrorName(DBusMessage* msg);
+const char* l2dbus_ffiGetSignature(DBusMessage* msg);
+const char* l2dbus_ffiGetSender(DBusMessage* msg);
+const char* l2dbus_ffiGetDestination(DBusMessage* msg);
+
+int l2dbus_ffiAppendBoolean(DBusMessage* msg, int value);
+int l2dbus_ffiAppendInt32(DBusMessage* msg, int32_t value);
+int l2dbus_ffiAppendUint32(DBusMessage* msg, uint32_t value);
+int l2dbus_ffiAppendInt64(DBusMessage* msg, int64_t value);
+int l2dbus_ffiAppendUint64(DBusMessage* msg, uint64_t value);
+int l2dbus_ffiAppendDouble(DBusMessage* msg, double value);
+int l2dbus_ffiAppendString(DBusMessage* msg, int type, const char* value);
+int l2dbus_ffiAppendBasic(DBusMessage* msg, int type, const void* value);
+int l2dbus_ffiAppendFixedArray(DBusMessage* msg, int elemType,
+                            const void* elems, int nElems);
+
+l2dbus_FfiIter* l2dbus_ffiIterNew(DBusMessage* msg);
+l2dbus_FfiIter* l2dbus_ffiIterRecurse(l2dbus_FfiIter* iter);
+void l2dbus_ffiIterFree(l2dbus_FfiIter* iter);
+int l2dbus_ffiIterArgType(l2dbus_FfiIter* iter);
+int l2dbus_ffiIterElementType(l2dbus_FfiIter* iter);
+int l2dbus_ffiIterNext(l2dbus_FfiIter* iter);
+int64_t l2dbus_ffiIterGetInt64(l2dbus_FfiIter* iter);
+uint64_t l2dbus_ffiIterGetUint64(l2dbus_FfiIter* iter);
+double l2dbus_ffiIterGetDouble(l2dbus_FfiIter* iter);
+const char* l2dbus_ffiIterGetString(l2dbus_FfiIter* iter);
+int l2dbus_ffiIterGetFixedArray(l2dbus_FfiIter* iter, const void** elems);
+
+int l2dbus_ffiSend(l2dbus_Connection* conn, DBusMessage* msg,
+                    uint32_t* serial);
+]]
+
+-- The functions are exported by the (already loaded) core module
+local C = ffi.load(assert(package.searchpath("l2dbus_core", package.cpath),
+						"cannot locate the l2dbus_core module"))
+assert(C.l2dbus_ffiAbiVersion() == ABI_VERSION,
+		"l2dbus_core FFI ABI version mismatch")
+
+--- The FFI namespace of the core module (e.g. C.l2dbus_ffiAppendInt32).
+M.C = C
+
+--- D-Bus type codes accepted by the append and iterator functions.
+M.TYPE_INVALID		= 0
+M.TYPE_BYTE			= string.byte("y")
+M.TYPE_BOOLEAN		= string.byte("b")
+M.TYPE_INT16		= string.byte("n")
+M.TYPE_UINT16		= string.byte("q")
+M.TYPE_INT32		= string.byte("i")
+M.TYPE_UINT32		= string.byte("u")
+M.TYPE_INT64		= string.byte("x")
+M.TYPE_UINT64		= string.byte("t")
+M.TYPE_DOUBLE		= string.byte("d")
+M.TYPE_STRING		= string.byte("s")
+M.TYPE_OBJECT_PATH	= string.byte("o")
+M.TYPE_SIGNATURE	= string.byte("g")
+M.TYPE_ARRAY		= string.byte("a")
+M.TYPE_VARIANT		= string.byte("v")
+M.TYPE_STRUCT		= string.byte("r")
+M.TYPE_DICT_ENTRY	= string.byte("e")
+
+local unref = C.l2dbus_ffiMessageUnref
+
+local function owned(msg)
+	if msg == nil then
+		return nil
+	end
+	return ffi.gc(msg, unref)
+end
+
+
+--- Creates a method call released by the garbage collector.
+-- @tparam ?string destination The destination bus name or **nil**.
+-- @tparam string path The object path.
+-- @tparam ?string interface The interface or **nil**.
+-- @tparam string member The method name.
+-- @treturn cdata|nil The *DBusMessage* pointer or **nil** on failure.
+function M.newMethodCall(destination, path, interface, member)
+	return owned(C.l2dbus_ffiNewMethodCall(destination, path, interface, member))
+end
+
+
+--- Creates a signal released by the garbage collector.
+-- @tparam string path The object path.
+-- @tparam string interface The interface.
+-- @tparam string member The signal name.
+-- @treturn cdata|nil The *DBusMessage* pointer or **nil** on failure.
+function M.newSignal(path, interface, member)
+	return owned(C.l2dbus_ffiNewSignal(path, interface, member))
+end
+
+
+--- Creates a method return released by the garbage collector.
+-- @tparam cdata call The method call being answered.
+-- @treturn cdata|nil The *DBusMessage* pointer or **nil** on failure.
+function M.newMethodReturn(call)
+	return owned(C.l2dbus_ffiNewMethodReturn(call))
+end
+
+
+--- Creates an iterator over the arguments released by the garbage collector.
+-- @tparam cdata msg The *DBusMessage* pointer.
+-- @treturn cdata|nil The iterator or **nil** on failure.
+function M.iterArgs(msg)
+	local iter = C.l2dbus_ffiIterNew(msg)
+	if iter == nil then
+		return nil
+	end
+	return ffi.gc(iter, C.l2dbus_ffiIterFree)
+end
+
+
+--- Returns the *DBusMessage* pointer of a Message.
+-- The pointer is only valid while the Message is alive.
+-- @tparam userdata msg The @{l2dbus.Message|Message}.
+-- @treturn cdata The *DBusMessage* pointer.
+function M.message(msg)
+	return ffi.cast("DBusMessage*", msg:ffiHandle())
+end
+
+
+--- Returns the handle of a Connection to pass to l2dbus_ffiSend.
+-- The handle is only valid while the Connection is alive.
+-- @tparam userdata conn The @{l2dbus.Connection|Connection}.
+-- @treturn cdata The connection handle.
+function M.connection(conn)
+	return ffi.cast("l2dbus_Connection*", conn:ffiHandle())
+end
+
+
+--- Wraps a *DBusMessage* pointer in a Message.
+-- The Message holds its own reference to the D-Bus message.
+-- @tparam cdata msg The *DBusMessage* pointer.
+-- @treturn userdata The @{l2dbus.Message|Message}.
+function M.wrap(msg)
+	return l2dbus.Message.fromFfiHandle(tonumber(ffi.cast("uintptr_t", msg)))
+end
+
+
+--- Converts a string returned by the FFI to a Lua string.
+-- @tparam cdata str The *const char* pointer.
+-- @treturn ?string The string or **nil** for a NULL pointer.
+function M.string(str)
+	if str == nil then
+		return nil
+	end
+	return ffi.string(str)
+end
+
+
+return M
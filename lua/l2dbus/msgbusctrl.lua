@@ -55,6 +55,11 @@ local M = { }
 local MsgBusController = { __type = "l2dbus.msg_bus_controller" }
 MsgBusController.__index = MsgBusController
 
+--
+-- Forward method declarations
+--
+local stopNameCache
+
 local MSGBUS_INTROSPECT_AS_XML =
 [[
 <!DOCTYPE node PUBLIC "-//freedesktop//DTD D-BUS Object Introspection 1.0//EN"
@@ -158,7 +163,8 @@ local MSGBUS_INTROSPECT_AS_XML =
 function M.new(conn)
 	verify(type(conn) == "userdata", "invalid connection")
 	local msgBusCtrl = {
-		ctrl = proxyCtrl.new(conn, l2dbus.Dbus.SERVICE_DBUS, l2dbus.Dbus.PATH_DBUS)
+		ctrl = proxyCtrl.new(conn, l2dbus.Dbus.SERVICE_DBUS, l2dbus.Dbus.PATH_DBUS),
+		nameCache = nil
 		}
 					
 	return setmetatable(msgBusCtrl, MsgBusController)
@@ -409,10 +415,286 @@ end
 -- @within MsgBusController
 -- @function disconnectAllSignals
 function MsgBusController:disconnectAllSignals()
+	stopNameCache(self)
 	self.ctrl:disconnectAllSignals()
 end
 
 
+--
+-- Makes a blocking call to the Message Bus (regardless of the proxy mode)
+-- and returns the reply arguments or nil, errName, errMsg.
+--
+local function callMsgBus(self, method, signature, ...)
+	local msg = l2dbus.Message.newMethodCall({
+							destination=l2dbus.Dbus.SERVICE_DBUS,
+							path=l2dbus.Dbus.PATH_DBUS,
+							interface=l2dbus.Dbus.INTERFACE_DBUS,
+							method=method})
+	if signature then
+		msg:addArgsBySignature(signature, ...)
+	end
+	local reply, errName, errMsg = self.ctrl.conn:sendWithReplyAndBlock(msg,
+													self.ctrl:getTimeout())
+	msg:dispose()
+	if not reply then
+		return nil, errName, errMsg
+	end
+	return reply:takeArgs()
+end
+
+
+--
+-- Calls the handler of a name watcher (if there is one)
+--
+local function notifyWatcher(handler, name, owner)
+	if handler then
+		handler(name, owner)
+	end
+end
+
+
+--
+-- Keeps the name-owner cache current and notifies the name watchers
+--
+local function onNameOwnerChanged(self, name, oldOwner, newOwner)
+	local cache = self.nameCache
+	if not cache then
+		return
+	end
+	
+	cache.owners[name] = (newOwner ~= "") and newOwner or nil
+	local watchers = cache.watchers[name]
+	if watchers then
+		for watcher in pairs(watchers) do
+			if oldOwner ~= "" then
+				notifyWatcher(watcher.onVanished, name, oldOwner)
+			end
+			if newOwner ~= "" then
+				notifyWatcher(watcher.onAppeared, name, newOwner)
+			end
+		end
+	end
+end
+
+
+--
+-- Stops tracking name owners and releases the NameOwnerChanged match rule
+--
+stopNameCache = function(self)
+	if self.nameCache then
+		self.ctrl:disconnectSignal(self.nameCache.sigHnd)
+		proxyCtrl.setNameResolver(self.ctrl.conn, nil)
+		self.nameCache = nil
+	end
+end
+
+
+--- Enables or disables the local name-owner cache.
+-- 
+-- When enabled the controller keeps a map of the names on the bus and their
+-- (unique name) owners. The map is primed by a single *ListNames* call and
+-- kept current by one *NameOwnerChanged* match. @{getNameOwner} and
+-- @{nameHasOwner} are then answered locally, name @{watchName|watchers}
+-- are notified as owners appear and vanish, and the
+-- @{l2dbus.proxyctrl|ProxyControllers} on the connection resolve the unique
+-- owner of their bus name from the cache. The owner of a well-known name
+-- listed by *ListNames* is only asked for (once) when it's first needed.
+-- 
+-- @within MsgBusController
+-- @tparam userdata ctrl Message Bus controller instance.
+-- @tparam bool enable Set to **true** to enable the cache or **false** to
+-- disable (and discard) it.
+-- @treturn true|nil Returns **true** on success or **nil** if the cache
+-- could not be primed.
+-- @treturn ?string|nil Returns an error name if the cache could not be
+-- enabled.
+-- @treturn ?string|nil Returns an error message if the cache could not be
+-- enabled.
+-- @function setNameCaching
+function MsgBusController:setNameCaching(enable)
+	verifyTypesWithMsg("boolean", "unexpected type for arg #2", enable)
+	if not enable then
+		stopNameCache(self)
+		return true
+	elseif self.nameCache then
+		return true
+	end
+	
+	-- Subscribe first so no change is missed while priming the cache
+	local cache = {owners = {}, watchers = {}}
+	self.nameCache = cache
+	cache.sigHnd = self.ctrl:connectSignal(l2dbus.Dbus.INTERFACE_DBUS,
+						"NameOwnerChanged", function(name, oldOwner, newOwner)
+							onNameOwnerChanged(self, name, oldOwner, newOwner)
+						end)
+	if not cache.sigHnd then
+		self.nameCache = nil
+		return nil, l2dbus.Dbus.ERROR_FAILED,
+				"unable to subscribe to NameOwnerChanged"
+	end
+	
+	local names, errName, errMsg = callMsgBus(self, "ListNames")
+	if not names then
+		stopNameCache(self)
+		return nil, errName, errMsg
+	end
+	for idx = 1, #names do
+		local name = names[idx]
+		-- A well-known name is owned but who owns it is not known yet
+		if cache.owners[name] == nil then
+			cache.owners[name] = (name:sub(1, 1) == ":") and name or true
+		end
+	end
+	
+	proxyCtrl.setNameResolver(self.ctrl.conn, function(name)
+		return (self:getNameOwner(name))
+	end)
+	
+	return true
+end
+
+
+--- Indicates whether the local name-owner cache is enabled.
+-- 
+-- @within MsgBusController
+-- @tparam userdata ctrl Message Bus controller instance.
+-- @treturn bool Returns **true** if the cache is enabled.
+-- @function getNameCaching
+function MsgBusController:getNameCaching()
+	return self.nameCache ~= nil
+end
+
+
+--- Returns the unique name of the owner of a bus name.
+-- 
+-- If the name-owner @{setNameCaching|cache} is enabled the owner is
+-- usually returned without a round trip to the Message Bus. Otherwise
+-- (and for a well-known name whose owner hasn't been asked for yet) a
+-- blocking *GetNameOwner* call is made.
+-- 
+-- @within MsgBusController
+-- @tparam userdata ctrl Message Bus controller instance.
+-- @tparam string name The bus name.
+-- @treturn string|nil The unique name of the owner or **nil** if the name
+-- has no owner or an error occurs.
+-- @treturn ?string|nil The D-Bus error name if no owner is returned.
+-- @treturn ?string|nil The error message if no owner is returned.
+-- @function getNameOwner
+function MsgBusController:getNameOwner(name)
+	verify(validate.isValidBusName(name), "invalid D-Bus bus name")
+	local cache = self.nameCache
+	if not cache then
+		return callMsgBus(self, "GetNameOwner", "s", name)
+	end
+	
+	local owner = cache.owners[name]
+	if owner == nil then
+		return nil, l2dbus.Dbus.ERROR_NAME_HAS_NO_OWNER,
+				"Could not get owner of name '" .. name .. "': no such name"
+	elseif owner == true then
+		local errName, errMsg
+		owner, errName, errMsg = callMsgBus(self, "GetNameOwner", "s", name)
+		-- The owner may have changed while waiting for the reply
+		if cache.owners[name] == true then
+			cache.owners[name] = owner
+		end
+		if not owner then
+			return nil, errName, errMsg
+		end
+	end
+	
+	return owner
+end
+
+
+--- Indicates whether a bus name has an owner.
+-- 
+-- If the name-owner @{setNameCaching|cache} is enabled this is answered
+-- locally. Otherwise a blocking *NameHasOwner* call is made.
+-- 
+-- @within MsgBusController
+-- @tparam userdata ctrl Message Bus controller instance.
+-- @tparam string name The bus name.
+-- @treturn bool|nil Returns **true** if the name has an owner, **false**
+-- if it does not or **nil** on error.
+-- @treturn ?string|nil The D-Bus error name on error.
+-- @treturn ?string|nil The error message on error.
+-- @function nameHasOwner
+function MsgBusController:nameHasOwner(name)
+	verify(validate.isValidBusName(name), "invalid D-Bus bus name")
+	if self.nameCache then
+		return self.nameCache.owners[name] ~= nil
+	end
+	return callMsgBus(self, "NameHasOwner", "s", name)
+end
+
+
+--- Watches a bus name for its owner appearing and vanishing.
+-- 
+-- The handlers are called with the bus name and the unique name of the
+-- owner. If the owner changes the *vanished* handler is called for the
+-- old owner followed by the *appeared* handler for the new one. If the
+-- name already has an owner the *appeared* handler is called before this
+-- method returns. Watching a name enables the name-owner
+-- @{setNameCaching|cache}.
+-- 
+-- @within MsgBusController
+-- @tparam userdata ctrl Message Bus controller instance.
+-- @tparam string name The bus name to watch.
+-- @tparam ?func onAppeared Called when the name gains an owner.
+-- @tparam ?func onVanished Called when the name loses its owner.
+-- @treturn table|nil An opaque handle used to @{unwatchName|stop}
+-- watching the name or **nil** if the cache cannot be enabled.
+-- @treturn ?string|nil The D-Bus error name on error.
+-- @treturn ?string|nil The error message on error.
+-- @function watchName
+function MsgBusController:watchName(name, onAppeared, onVanished)
+	verify(validate.isValidBusName(name), "invalid D-Bus bus name")
+	verifyTypesWithMsg("nil|function", "unexpected type for arg #3", onAppeared)
+	verifyTypesWithMsg("nil|function", "unexpected type for arg #4", onVanished)
+	
+	local status, errName, errMsg = self:setNameCaching(true)
+	if not status then
+		return nil, errName, errMsg
+	end
+	
+	local watchers = self.nameCache.watchers
+	local watcher = {name = name, onAppeared = onAppeared, onVanished = onVanished}
+	watchers[name] = watchers[name] or {}
+	watchers[name][watcher] = true
+	
+	if self.nameCache.owners[name] ~= nil then
+		local owner = self:getNameOwner(name)
+		if owner then
+			notifyWatcher(onAppeared, name, owner)
+		end
+	end
+	
+	return watcher
+end
+
+
+--- Stops watching a bus name.
+-- 
+-- @within MsgBusController
+-- @tparam userdata ctrl Message Bus controller instance.
+-- @tparam table hnd The handle returned by @{watchName}.
+-- @treturn bool Returns **true** if the watcher was removed.
+-- @function unwatchName
+function MsgBusController:unwatchName(hnd)
+	local cache = self.nameCache
+	local watchers = cache and (type(hnd) == "table") and cache.watchers[hnd.name]
+	if not (watchers and watchers[hnd]) then
+		return false
+	end
+	watchers[hnd] = nil
+	if next(watchers) == nil then
+		cache.watchers[hnd.name] = nil
+	end
+	return true
+end
+
+
 -- Called when this module is run as a program
 local function main(arg)
     print("Module: " .. string.match(arg[0], "^(.+)%.lua"))
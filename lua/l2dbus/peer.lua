@@ -0,0 +1,232 @@
+--[[
+*****************************************************************************
+Project         l2dbus
+
+Released under the MIT License (MIT)
+Copyright (c) 2013 XS-Embedded LLC
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*****************************************************************************
+@file           peer.lua
+@author         Glenn Schmottlach
+@brief          Negotiates direct peer-to-peer connections over the bus.
+*****************************************************************************
+--]]
+
+--- Peer Module.
+-- This module sets up direct (peer-to-peer) connections between two
+-- processes that already share a message bus. Once connected the messages
+-- no longer pass through the bus daemon, which saves a hop (a context
+-- switch and a copy) per message for high-rate traffic between two
+-- well-known endpoints.
+-- </br></br>
+-- The side offering the peer connection calls @{listen} to start an
+-- @{l2dbus.Server|Server} and to publish its address on the bus as the
+-- *GetAddress* method of the @{INTERFACE} interface. The other side calls
+-- @{connect} with the bus name and object path of that service. Both sides
+-- end up with a regular @{l2dbus.Connection|Connection} that can be used by
+-- @{l2dbus.proxyctrl|ProxyController} and @{l2dbus.service|Service}
+-- objects (for instance by attaching the same Service to the bus connection
+-- and to the peer connections). A ProxyController on a peer connection
+-- ignores the bus name except to identify the introspection cache entry.
+--
+-- @module l2dbus.peer
+-- @alias M
+
+local l2dbus = require("l2dbus")
+local service = require("l2dbus.service")
+local validate = require("l2dbus.validate")
+
+local verify				=	validate.verify
+
+local M = { }
+local Listener = { __type = "l2dbus.lua.peer_listener" }
+Listener.__index = Listener
+
+--- The interface used to publish the address of a peer Server.
+M.INTERFACE = "org.l2dbus.Peer"
+--- The default address a peer Server listens on.
+M.DEFAULT_ADDRESS = "unix:tmpdir=/tmp"
+
+local PEER_INTERFACE_METADATA = {
+	methods = {
+		{
+			name = "GetAddress",
+			args = {
+				{
+					sig = "s",
+					name = "address",
+					dir = "out",
+				},
+			},
+		},
+	},
+}
+
+
+--- Listens for peer connections and publishes the address on the bus.
+-- The listener anchors every connection it accepts until it is
+-- @{Listener:release|released} or the listener is @{Listener:close|closed}.
+-- The handler is called for each accepted connection with a signature of
+-- the form:
+--
+--    function onNewConnection(conn, listener)
+--
+-- @tparam userdata disp The @{l2dbus.Dispatcher|Dispatcher} driving the
+-- Server and accepted connections.
+-- @tparam userdata busConn The bus @{l2dbus.Connection|Connection} on
+-- which the address is published.
+-- @tparam string objPath The object path of the published address.
+-- @tparam func onNewConnection The handler for accepted connections.
+-- @tparam ?table opts Optional settings:
+-- <ul>
+-- <li>*address* - The address to listen on (default @{DEFAULT_ADDRESS}).</li>
+-- </ul>
+-- @treturn table The @{Listener} instance.
+function M.listen(disp, busConn, objPath, onNewConnection, opts)
+	verify(validate.isValidObjectPath(objPath), "invalid D-Bus object path")
+	verify(type(onNewConnection) == "function", "invalid handler type")
+	opts = opts or {}
+
+	local listener = setmetatable({}, Listener)
+	listener.busConn = busConn
+	listener.conns = {}
+	listener.server = l2dbus.Server.new(disp, opts.address or M.DEFAULT_ADDRESS,
+		function(server, conn)
+			listener.conns[conn] = true
+			onNewConnection(conn, listener)
+		end)
+
+	listener.svc = service.new(objPath, true)
+	listener.svc:addInterface(M.INTERFACE, PEER_INTERFACE_METADATA)
+	listener.svc:registerMethodHandler(M.INTERFACE, "GetAddress",
+		function(ctx)
+			ctx:reply(listener.server:getAddress())
+		end)
+	if not listener.svc:attach(busConn) then
+		listener.server:disconnect()
+		error("failed to publish the peer address on " .. objPath)
+	end
+
+	return listener
+end
+
+
+--- Opens a peer connection to a service published with @{listen}.
+-- The address is requested over the bus with a blocking call.
+-- @tparam userdata disp The @{l2dbus.Dispatcher|Dispatcher} driving the
+-- peer connection.
+-- @tparam userdata busConn The bus @{l2dbus.Connection|Connection} used to
+-- look up the address.
+-- @tparam string busName The bus name of the listening service.
+-- @tparam string objPath The object path passed to @{listen}.
+-- @tparam ?number timeout The time (in milliseconds) to wait for the
+-- address (default @{l2dbus.Dbus.TIMEOUT_USE_DEFAULT}).
+-- @treturn ?userdata|nil The peer @{l2dbus.Connection|Connection} or
+-- **nil** on failure.
+-- @treturn ?string|nil The D-Bus error name on failure.
+-- @treturn ?string|nil The error message on failure.
+function M.connect(disp, busConn, busName, objPath, timeout)
+	verify(validate.isValidBusName(busName), "invalid D-Bus bus name")
+	verify(validate.isValidObjectPath(objPath), "invalid D-Bus object path")
+
+	local msg = l2dbus.Message.newMethodCall({destination=busName,
+							path=objPath,
+							interface=M.INTERFACE,
+							method="GetAddress"})
+	local reply, errName, errMsg = busConn:sendWithReplyAndBlock(msg,
+							timeout or l2dbus.Dbus.TIMEOUT_USE_DEFAULT)
+	msg:dispose()
+	if not reply then
+		return nil, errName, errMsg
+	end
+
+	local address = reply:takeArgs()
+	if type(address) ~= "string" then
+		return nil, l2dbus.Dbus.ERROR_INVALID_ARGS, "no peer address"
+	end
+
+	local status, conn = pcall(l2dbus.Connection.openPeer, disp, address)
+	if not status then
+		return nil, l2dbus.Dbus.ERROR_FAILED, conn
+	end
+	return conn
+end
+
+
+--- A peer listener class.
+-- @type Listener
+
+
+--- Returns the address peers connect to.
+-- @treturn ?string|nil The address or **nil** once closed.
+function Listener:getAddress()
+	return self.server:getAddress()
+end
+
+
+--- Returns the peer connections the listener still anchors.
+-- @treturn table An array of peer @{l2dbus.Connection|Connections}.
+function Listener:getConnections()
+	local conns = {}
+	for conn in pairs(self.conns) do
+		conns[#conns + 1] = conn
+	end
+	return conns
+end
+
+
+--- Stops anchoring an accepted connection.
+-- The connection is closed once the client no longer references it.
+-- @tparam userdata conn The peer connection to release.
+function Listener:release(conn)
+	self.conns[conn] = nil
+end
+
+
+--- Stops listening and withdraws the address from the bus.
+-- The connections that were accepted are released.
+function Listener:close()
+	self.svc:detach(self.busConn)
+	self.server:disconnect()
+	self.conns = {}
+end
+
+
+-- Called when this module is run as a program
+local function main(arg)
+    print("Module: " .. string.match(arg[0], "^(.+)%.lua"))
+    local info = l2dbus.getVersion()
+    print("L2DBUS Version: " .. info.l2dbusVerStr)
+    print("CDBUS Version: " .. info.cdbusVerStr)
+    print(string.format("D-Bus Version: %d.%d.%d",
+    		info.dbusMajor, info.dbusMinor, info.dbusRelease))
+    print("Author: " .. info.author)
+    print(info.copyright)
+end
+
+-- Determine the context in which the module is used
+if l2dbus.isMain() then
+    -- The module is being run as a program
+    main(arg)
+else
+    -- The module is being loaded rather than run
+    return M
+end
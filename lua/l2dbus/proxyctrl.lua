@@ -47,7 +47,6 @@ USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 
 local l2dbus = require("l2dbus")
-local xml = require("l2dbus.xml")
 local validate = require("l2dbus.validate")
 
 local verifyTypes			=	validate.verifyTypes
@@ -64,6 +63,176 @@ ProxyController.__index = ProxyController
 local newMethodProxy
 local newPropertyProxy
 
+--
+-- Parsed introspection data shared between controllers. The cache is
+-- indexed by connection and then by the bus name, unique owner and object
+-- path so a restarted service (with a new unique name) is introspected
+-- again.
+--
+local introspectCache = setmetatable({}, {__mode = "k"})
+local introspectCacheEnabled = true
+
+--
+-- Request windows limiting the calls in flight on a connection
+-- (indexed by connection).
+--
+local requestWindows = setmetatable({}, {__mode = "k"})
+
+--
+-- Functions resolving bus names to their unique owner without a round
+-- trip to the bus (indexed by connection).
+--
+local nameResolvers = setmetatable({}, {__mode = "k"})
+
+--
+-- Coroutines awaiting a reply whose deadline is tracked by a timer wheel
+-- (indexed by pending call).
+--
+local deadlineWaiters = setmetatable({}, {__mode = "k"})
+
+-- The timeout libdbus uses for TIMEOUT_USE_DEFAULT (in milliseconds)
+local DEFAULT_REPLY_TIMEOUT = 25000
+
+
+--
+-- Returns the running coroutine if it's able to yield or nil if
+-- called from the "main" Lua thread (accounts for the Lua 5.2
+-- *coroutine.running* semantics).
+--
+local function getYieldableCoroutine()
+	local co, isMain = coroutine.running()
+	if isMain then
+		co = nil
+	end
+	return co
+end
+
+
+--
+-- Releases the request window slots held by completed pending calls that
+-- were handed back to the caller (and so are not awaited by us).
+--
+local function sweepRequestWindow(win)
+	for pending, awaited in pairs(win.inFlight) do
+		if (not awaited) and pending:isCompleted() then
+			win.inFlight[pending] = nil
+			win.nInFlight = win.nInFlight - 1
+		end
+	end
+end
+
+
+--
+-- Returns true if no further requests may be sent until a slot is released.
+--
+local function isRequestWindowFull(ctrl, win)
+	return (win.nInFlight >= win.size) or
+		((win.maxOutgoingSize ~= nil) and
+		(ctrl.conn:getOutgoingSize() >= win.maxOutgoingSize))
+end
+
+
+--
+-- Waits (if necessary) for a free slot in the request window. A coroutine
+-- queues itself and yields if an awaited reply will release a slot later.
+-- Otherwise, since nothing will resume it, the caller blocks on an
+-- outstanding call or flushes the outgoing queue.
+--
+local function acquireRequestWindow(ctrl, win)
+	sweepRequestWindow(win)
+	if not isRequestWindowFull(ctrl, win) then
+		return
+	end
+
+	local startTime = l2dbus.monotonicTime()
+	win.totalQueued = win.totalQueued + 1
+	local co = getYieldableCoroutine()
+	repeat
+		local awaited = nil
+		local detached = nil
+		for pending, isAwaited in pairs(win.inFlight) do
+			if isAwaited then
+				awaited = pending
+			else
+				detached = detached or pending
+			end
+		end
+
+		if co and awaited then
+			win.waiters[#win.waiters + 1] = co
+			if #win.waiters > win.maxQueued then
+				win.maxQueued = #win.waiters
+			end
+			-- Resumed by releaseRequestWindow()
+			coroutine.yield()
+		elseif detached and (win.nInFlight >= win.size) then
+			detached:block()
+		else
+			-- Only the outgoing queue is over the limit
+			ctrl.conn:flush()
+		end
+		sweepRequestWindow(win)
+	-- Don't wait forever on an outgoing queue that won't drain
+	until not isRequestWindowFull(ctrl, win) or (win.nInFlight == 0)
+
+	local waitTime = l2dbus.monotonicTime() - startTime
+	win.totalWaitTime = win.totalWaitTime + waitTime
+	if waitTime > win.maxWaitTime then
+		win.maxWaitTime = waitTime
+	end
+end
+
+
+--
+-- Releases the slot held by a pending call and resumes the next queued
+-- caller (if any).
+--
+local function releaseRequestWindow(ctrl, win, pending)
+	if win.inFlight[pending] ~= nil then
+		win.inFlight[pending] = nil
+		win.nInFlight = win.nInFlight - 1
+	end
+
+	if (#win.waiters > 0) and not isRequestWindowFull(ctrl, win) then
+		local co = table.remove(win.waiters, 1)
+		local status, errMsg = coroutine.resume(co)
+		if not status then
+			error(errMsg, 0)
+		end
+	end
+end
+
+
+--
+-- Called by the timer wheel when an awaited reply is overdue. The call is
+-- cancelled and the waiting coroutine resumed without a reply.
+--
+local function onRequestDeadline(wheel, pending)
+	local co = deadlineWaiters[pending]
+	deadlineWaiters[pending] = nil
+	if co then
+		pending:cancel()
+		local status, errMsg = coroutine.resume(co, nil,
+				l2dbus.Dbus.ERROR_NO_REPLY, "request timed out")
+		if not status then
+			error(errMsg, 0)
+		end
+	end
+end
+
+
+--
+-- Resumes the coroutine waiting on a pending call with the reply. The
+-- coroutine is passed as the user value of the notification so a single
+-- handler is shared by every pending call.
+--
+local function onNotifyReply(pending, co)
+	local status, errMsg = coroutine.resume(co, pending:stealReply())
+	if not status then
+		error(errMsg, 0)
+	end
+end
+
 
 --- Constructs a new ProxyController instance.
 -- 
@@ -95,15 +264,308 @@ function M.new(conn, busName, objPath)
 				signalHnds = {},
 				introspectData = nil,
 				blockingMode = false,
+				awaitMode = false,
+				timerWheel = nil,
 				timeout = l2dbus.Dbus.TIMEOUT_USE_DEFAULT,
 				proxyCache = {},
-				proxyNoReplyNeeded = false
+				proxyNoReplyNeeded = false,
+				propCacheEnabled = false,
+				propCache = nil,
+				propCacheHnd = nil,
+				propChangedHandler = nil,
+				replyRoute = nil
 				}
 					
 	return setmetatable(proxyController, ProxyController)
 end
 
 
+--- Limits the number of requests proxy calls have in flight on a connection.
+-- 
+-- The window is shared by every ProxyController on the connection. Once
+-- *size* non-blocking requests are outstanding further proxy calls are
+-- held back until a reply frees a slot. A call made from a coroutine that
+-- is waiting for a slot yields and is resumed, in order, as awaited replies
+-- (see @{setAwaitMode} and @{waitForReply}) arrive. A call that cannot yield
+-- (or for which no awaited reply is outstanding) blocks until the oldest
+-- outstanding request completes. Slots held by a
+-- @{l2dbus.PendingCall|PendingCall} returned to the caller are released when
+-- it's passed to @{waitForReply} or once it's found to be complete. Blocking
+-- calls do not use the window.
+-- 
+-- @tparam userdata conn The @{l2dbus.Connection|Connection} to limit.
+-- @tparam ?number size The maximum number of requests in flight or **nil**
+-- (or zero) to remove the limit.
+-- @tparam ?table opts Optional backpressure settings:
+-- <ul>
+-- <li>**maxOutgoingSize** (number) Also hold back requests while the
+-- connection's @{l2dbus.Connection.getOutgoingSize|outgoing queue} holds at
+-- least this many bytes.</li>
+-- <li>**maxReceivedSize** (number) Sets the
+-- @{l2dbus.Connection.setMaxReceivedSize|maximum received size} of the
+-- connection so reading stops while unprocessed replies accumulate.</li>
+-- <li>**maxMessageSize** (number) Sets the
+-- @{l2dbus.Connection.setMaxMessageSize|maximum message size} of the
+-- connection.</li>
+-- </ul>
+function M.setRequestWindow(conn, size, opts)
+	verifyTypesWithMsg("userdata", "unexpected type for arg #1", conn)
+	verifyTypesWithMsg("number|nil", "unexpected type for arg #2", size)
+	verifyTypesWithMsg("table|nil", "unexpected type for arg #3", opts)
+	opts = opts or {}
+	verifyTypesWithMsg("number|nil", "unexpected type for maxOutgoingSize",
+						opts.maxOutgoingSize)
+
+	local oldWindow = requestWindows[conn]
+	if (size == nil) or (size <= 0) then
+		requestWindows[conn] = nil
+	else
+		requestWindows[conn] = {
+			size = size,
+			maxOutgoingSize = opts.maxOutgoingSize,
+			inFlight = oldWindow and oldWindow.inFlight or {},
+			nInFlight = oldWindow and oldWindow.nInFlight or 0,
+			waiters = oldWindow and oldWindow.waiters or {},
+			maxQueued = 0,
+			totalQueued = 0,
+			totalWaitTime = 0,
+			maxWaitTime = 0
+		}
+	end
+
+	if opts.maxReceivedSize then
+		conn:setMaxReceivedSize(opts.maxReceivedSize)
+	end
+
+	if opts.maxMessageSize then
+		conn:setMaxMessageSize(opts.maxMessageSize)
+	end
+
+	-- Let anyone still queued on the old window proceed
+	if oldWindow and (requestWindows[conn] == nil) then
+		oldWindow.size = math.huge
+		oldWindow.maxOutgoingSize = nil
+		while #oldWindow.waiters > 0 do
+			coroutine.resume(table.remove(oldWindow.waiters, 1))
+		end
+	end
+end
+
+
+--- Returns statistics for the request window of a connection.
+-- 
+-- @tparam userdata conn The @{l2dbus.Connection|Connection}.
+-- @treturn table|nil Returns **nil** if there is no request window
+-- otherwise a table with the fields:
+-- <ul>
+-- <li>**size** (number) The size of the window.</li>
+-- <li>**inFlight** (number) The number of outstanding requests.</li>
+-- <li>**queued** (number) The number of coroutines waiting for a slot.</li>
+-- <li>**maxQueued** (number) The maximum number of waiting coroutines.</li>
+-- <li>**totalQueued** (number) The number of requests that had to wait.</li>
+-- <li>**totalWaitTime** (number) The total time (in seconds) requests spent
+-- waiting for a slot.</li>
+-- <li>**maxWaitTime** (number) The longest time (in seconds) a request
+-- waited for a slot.</li>
+-- <li>**outgoingSize** (number) The current size (in bytes) of the
+-- connection's outgoing queue.</li>
+-- </ul>
+function M.getRequestWindowStats(conn)
+	local win = requestWindows[conn]
+	if not win then
+		return nil
+	end
+
+	sweepRequestWindow(win)
+	return { size = win.size,
+			inFlight = win.nInFlight,
+			queued = #win.waiters,
+			maxQueued = win.maxQueued,
+			totalQueued = win.totalQueued,
+			totalWaitTime = win.totalWaitTime,
+			maxWaitTime = win.maxWaitTime,
+			outgoingSize = conn:getOutgoingSize() }
+end
+
+
+--- Enables or disables caching of introspection data.
+-- 
+-- When caching is enabled (the default) the introspection data parsed by
+-- @{ProxyController:bind|bind} is shared by all controllers bound to the same
+-- bus name, unique owner, and object path on the same connection. A
+-- subsequent bind skips both the *Introspect* call and the parsing of the
+-- reply. The cached introspection table is shared and so must **not** be
+-- modified.
+-- 
+-- @tparam bool enable Set to **true** to enable caching or **false** to
+-- disable it. Disabling the cache also clears it.
+function M.setIntrospectionCaching(enable)
+	verifyTypesWithMsg("boolean", "unexpected type for arg #1", enable)
+	introspectCacheEnabled = enable
+	if not enable then
+		M.clearIntrospectionCache()
+	end
+end
+
+
+--- Discards all cached introspection data.
+-- 
+-- Controllers that are already bound are unaffected. The next call to
+-- @{ProxyController:bind|bind} will introspect the remote service again.
+function M.clearIntrospectionCache()
+	introspectCache = setmetatable({}, {__mode = "k"})
+end
+
+
+--- Sets the function used to resolve bus names on a connection.
+-- 
+-- Controllers normally ask the bus for the unique owner of their bus name
+-- (e.g. to look up cached introspection data). A resolver answers this
+-- locally instead. It is called with a bus name and returns the unique
+-- name of its owner or **nil** if the name has no owner.
+-- @{l2dbus.msgbusctrl.MsgBusController:setNameCaching|MsgBusController:setNameCaching}
+-- installs a resolver backed by its name-owner cache.
+-- 
+-- @tparam userdata conn The @{l2dbus.Connection|Connection}.
+-- @tparam ?func|nil resolver The resolver or **nil** to remove it.
+function M.setNameResolver(conn, resolver)
+	verify(type(conn) == "userdata", "invalid connection")
+	verifyTypesWithMsg("nil|function", "unexpected type for arg #2", resolver)
+	nameResolvers[conn] = resolver
+end
+
+
+--
+-- Returns the cache key for the controller or nil if the unique owner
+-- of the bus name cannot be determined.
+--
+local function getIntrospectCacheKey(ctrl)
+	local owner = ctrl.busName
+	local resolver = nameResolvers[ctrl.conn]
+	if ctrl.conn:isPeer() then
+		-- There is only the one peer (and no bus daemon to ask)
+		owner = ""
+	elseif resolver and (owner:sub(1, 1) ~= ":") then
+		owner = resolver(owner)
+		if type(owner) ~= "string" then
+			return nil
+		end
+	elseif owner:sub(1, 1) ~= ":" then
+		local msg = l2dbus.Message.newMethodCall({
+								destination=l2dbus.Dbus.SERVICE_DBUS,
+								path=l2dbus.Dbus.PATH_DBUS,
+								interface=l2dbus.Dbus.INTERFACE_DBUS,
+								method="GetNameOwner"})
+		msg:addArgsBySignature("s", ctrl.busName)
+		local reply = ctrl.conn:sendWithReplyAndBlock(msg, ctrl.timeout)
+		msg:dispose()
+		if not reply then
+			return nil
+		end
+		owner = reply:takeArgs()
+		if type(owner) ~= "string" then
+			return nil
+		end
+	end
+	return ctrl.busName .. "\0" .. owner .. "\0" .. ctrl.objPath
+end
+
+
+--
+-- Stops caching the properties of the remote object and releases the
+-- PropertiesChanged match rule.
+--
+local function stopPropertyCache(ctrl)
+	if ctrl.propCacheHnd then
+		ctrl.conn:unregisterMatch(ctrl.propCacheHnd)
+		ctrl.propCacheHnd = nil
+	end
+	ctrl.propCache = nil
+end
+
+
+--
+-- Applies a PropertiesChanged signal to the property cache and notifies
+-- the changed handler (if any).
+--
+local function onPropertiesChanged(match, msg, ctrl)
+	local intfName, changed, invalidated = msg:getArgs()
+	local propCache = ctrl.propCache
+	if (type(intfName) ~= "string") or (propCache == nil) then
+		return
+	end
+	
+	changed = changed or {}
+	invalidated = invalidated or {}
+	local intfCache = propCache[intfName]
+	if not intfCache then
+		intfCache = {}
+		propCache[intfName] = intfCache
+	end
+	for propName, value in pairs(changed) do
+		intfCache[propName] = value
+	end
+	-- Invalidated properties are fetched from the service on the next read
+	for _, propName in ipairs(invalidated) do
+		intfCache[propName] = nil
+	end
+	
+	if ctrl.propChangedHandler then
+		ctrl.propChangedHandler(intfName, changed, invalidated)
+	end
+end
+
+
+--
+-- Primes the property cache with GetAll for every interface of the
+-- remote object that has properties and subscribes (once) to the
+-- PropertiesChanged signal of the object.
+--
+local function startPropertyCache(ctrl)
+	if not ctrl.introspectData[l2dbus.Dbus.INTERFACE_PROPERTIES] then
+		stopPropertyCache(ctrl)
+		return
+	end
+	
+	-- Subscribe before priming so no change is missed in between
+	if not ctrl.propCacheHnd then
+		ctrl.propCacheHnd = ctrl.conn:registerMatch({
+								msgType=l2dbus.Dbus.MESSAGE_TYPE_SIGNAL,
+								interface=l2dbus.Dbus.INTERFACE_PROPERTIES,
+								member="PropertiesChanged",
+								sender=ctrl.busName,
+								path=ctrl.objPath},
+								onPropertiesChanged, ctrl)
+	end
+	
+	ctrl.propCache = {}
+	for intfName, metadata in pairs(ctrl.introspectData) do
+		if next(metadata.properties or {}) ~= nil then
+			local msg = l2dbus.Message.newMethodCall({destination=ctrl.busName,
+							path=ctrl.objPath,
+							interface=l2dbus.Dbus.INTERFACE_PROPERTIES,
+							method="GetAll"})
+			msg:addArgsBySignature("s", intfName)
+			local reply = ctrl.conn:sendWithReplyAndBlock(msg, ctrl.timeout)
+			msg:dispose()
+			local intfCache = ctrl.propCache[intfName] or {}
+			if reply then
+				local props = reply:takeArgs()
+				if type(props) == "table" then
+					for propName, value in pairs(props) do
+						-- Values from a signal that raced the reply win
+						if intfCache[propName] == nil then
+							intfCache[propName] = value
+						end
+					end
+				end
+			end
+			ctrl.propCache[intfName] = intfCache
+		end
+	end
+end
+
+
 --- ProxyController
 -- @type ProxyController
 
@@ -113,7 +575,9 @@ end
 -- this ProxyController. This implies that the @{l2dbus.Connection|Connection}
 -- associated with the controller must be connected and the remote service
 -- must support introspection. The method may throw a Lua error if an
--- exceptional (unexpected) error occurs.
+-- exceptional (unexpected) error occurs. Unless disabled with
+-- @{setIntrospectionCaching} the parsed introspection data is cached and
+-- re-used by later binds to the same object of the same service instance.
 -- 
 -- @within ProxyController
 -- @tparam table ctrl The ProxyController instance.
@@ -127,18 +591,34 @@ end
 function ProxyController:bind()
 	if not self.introspectData then
 		verify(self.conn:isConnected(), "not connected to the D-Bus bus")
+		
+		local cacheKey
+		if introspectCacheEnabled then
+			cacheKey = getIntrospectCacheKey(self)
+			local connCache = introspectCache[self.conn]
+			if cacheKey and connCache and connCache[cacheKey] then
+				self.introspectData = connCache[cacheKey]
+				self.proxyCache = {}
+				if self.propCacheEnabled then
+					startPropertyCache(self)
+				end
+				return true
+			end
+		end
+		
 		local msg = l2dbus.Message.newMethodCall({destination=self.busName,
 								path=self.objPath,
 								interface=l2dbus.Dbus.INTERFACE_INTROSPECTABLE,
 								method="Introspect"})
 		local reply, errName, errMsg = self:sendMessage(msg)
+		msg:dispose()
 		if not reply then
 			return nil, errName, errMsg
 		end
 		
 		local result
 		if self:getBlockingMode() then
-			result = reply:getArgs()
+			result = reply:takeArgs()
 			if type(result) ~= "string" then
 				errName = l2dbus.Dbus.ERROR_FAILED 
 				errMsg = "Failed to get introspection data"
@@ -149,10 +629,10 @@ function ProxyController:bind()
 			if msg:getType() == l2dbus.Dbus.MESSAGE_TYPE_ERROR then
 				result = nil
 				errName = msg:getErrorName()
-				errMsg = msg:getArgs()
+				errMsg = msg:takeArgs()
 			else
 				-- Assume it's a reply message
-				result = msg:getArgs()
+				result = msg:takeArgs()
 				if type(result) ~= "string" then
 					errName = l2dbus.Dbus.ERROR_FAILED 
 					errMsg = "Failed to get introspection data"
@@ -162,6 +642,14 @@ function ProxyController:bind()
 		
 		if type(result) == "string" then
 			self.introspectData = self:parseXml(result)
+			if cacheKey then
+				local connCache = introspectCache[self.conn]
+				if not connCache then
+					connCache = {}
+					introspectCache[self.conn] = connCache
+				end
+				connCache[cacheKey] = self.introspectData
+			end
 		else
 			return nil, errName, errMsg
 		end
@@ -169,6 +657,9 @@ function ProxyController:bind()
 		-- Clear the proxy cache so it will be re-generated when
 		-- the client requests a new proxy again.
 		self.proxyCache = {}
+		if self.propCacheEnabled then
+			startPropertyCache(self)
+		end
 	end
 	return true
 end
@@ -303,6 +794,9 @@ function ProxyController:bindNoIntrospect(introspectData)
 	-- Clear the proxy reference so it will be re-generated the next
 	-- time the client asks for it
 	self.proxyCache = {}
+	if self.propCacheEnabled then
+		startPropertyCache(self)
+	end
 		
 	return true
 end
@@ -321,6 +815,68 @@ end
 function ProxyController:unbind()
 	self.introspectionData = nil
 	self.proxyCache = {}
+	stopPropertyCache(self)
+end
+
+
+--- Enables or disables caching of the remote object's properties.
+-- 
+-- Property caching is disabled by default. When enabled the controller
+-- primes a local snapshot of all the properties with *GetAll* when it is
+-- bound and keeps it current by subscribing once to the
+-- org.freedesktop.DBus.Properties.PropertiesChanged signal of the object.
+-- Property reads from the @{getProxy|proxy} are then answered from the
+-- snapshot without any bus traffic. Invalidated properties (and
+-- properties missing from the snapshot) are fetched from the service on
+-- the next read. Priming is always done with blocking calls. The changes
+-- are only seen while the connection is being dispatched.
+-- 
+-- @within ProxyController
+-- @tparam table ctrl The ProxyController instance.
+-- @tparam bool enable Set to **true** to enable the property cache or
+-- **false** to disable (and discard) it.
+-- @function setPropertyCaching
+function ProxyController:setPropertyCaching(enable)
+	verifyTypesWithMsg("boolean", "unexpected type for arg #1", enable)
+	self.propCacheEnabled = enable
+	if not enable then
+		stopPropertyCache(self)
+	elseif self.introspectData then
+		startPropertyCache(self)
+	end
+end
+
+
+--- Returns whether the property cache is enabled.
+-- 
+-- @within ProxyController
+-- @tparam table ctrl The ProxyController instance.
+-- @treturn bool Returns **true** if property caching is enabled.
+-- @function getPropertyCaching
+function ProxyController:getPropertyCaching()
+	return self.propCacheEnabled
+end
+
+
+--- Sets the handler called when cached properties change.
+-- 
+-- The handler is called after the property cache has been updated from a
+-- PropertiesChanged signal. It allows consumers to react to changes
+-- rather than polling the properties. The signature of the handler is:
+-- 		function onChanged(interface, changed, invalidated)
+-- 			...
+-- 		end
+-- Where **changed** is a table of property name/value pairs and
+-- **invalidated** is an array of property names whose values were not
+-- sent. The handler is only called when property caching is enabled.
+-- 
+-- @within ProxyController
+-- @tparam table ctrl The ProxyController instance.
+-- @tparam ?func|nil handler The handler or **nil** to remove it.
+-- @function setPropertyChangedHandler
+function ProxyController:setPropertyChangedHandler(handler)
+	verifyTypesWithMsg("function|nil", "unexpected type for arg #1", handler)
+	self.propChangedHandler = handler
 end
 
 
@@ -539,6 +1095,63 @@ function ProxyController:getBlockingMode()
 end
 
 
+--- Sets whether proxy calls made from a coroutine *await* their reply.
+-- 
+-- In *await* mode a non-blocking proxy call made from a coroutine (other than
+-- the "main" one) sends the request, yields the coroutine, and is resumed by
+-- the notification of the @{l2dbus.PendingCall|PendingCall} when the reply
+-- arrives. The proxy call then returns the decoded reply exactly as it would
+-- in *blocking* mode but without stalling the dispatcher, so many concurrent
+-- requests can be written sequentially, each in its own coroutine. Calls made
+-- from the "main" coroutine (which cannot yield) block instead. Blocking mode
+-- takes precedence over await mode. Under Lua 5.1 an awaiting proxy call
+-- **MUST NOT** be made via a Lua *pcall* since yielding across a protected
+-- call is not allowed.
+-- 
+-- @within ProxyController
+-- @tparam table ctrl The ProxyController instance.
+-- @tparam bool mode Set to **true** to enable await mode, **false** (the
+-- default) to disable it.
+-- @function setAwaitMode
+function ProxyController:setAwaitMode(mode)
+	self.awaitMode = mode and true or false
+end
+
+
+--- Routes the reply timeouts of awaited proxy calls onto a timer wheel.
+-- 
+-- By default every request has its own D-Bus timeout. When a
+-- @{l2dbus.TimerWheel|TimerWheel} is set the requests made in
+-- @{setAwaitMode|await} mode are instead sent without a D-Bus timeout and
+-- their deadline is scheduled on the wheel, which is much cheaper when many
+-- requests are outstanding. An overdue request is cancelled and the proxy
+-- call returns **false** with the error @{l2dbus.Dbus.ERROR_NO_REPLY|ERROR_NO_REPLY}.
+-- Requests that return a @{l2dbus.PendingCall|PendingCall} to the caller
+-- keep their D-Bus timeout.
+-- 
+-- @within ProxyController
+-- @tparam table ctrl The ProxyController instance.
+-- @tparam ?userdata wheel The TimerWheel to use or **nil** to use D-Bus
+-- timeouts.
+-- @function setTimerWheel
+function ProxyController:setTimerWheel(wheel)
+	verifyTypesWithMsg("userdata|nil", "unexpected type for arg #1", wheel)
+	self.timerWheel = wheel
+end
+
+
+--- Gets whether proxy calls made from a coroutine *await* their reply.
+-- 
+-- @within ProxyController
+-- @tparam table ctrl The ProxyController instance.
+-- @treturn bool Returns **true** if await mode is enabled, **false**
+-- otherwise.
+-- @function getAwaitMode
+function ProxyController:getAwaitMode()
+	return self.awaitMode
+end
+
+
 --- Sets whether proxy method calls expect/need a reply from the far-end.
 -- 
 -- This method determines whether proxy calls to the far-end need a response.
@@ -583,8 +1196,10 @@ end
 
 --- Connects a handler to an interface's signal.
 -- 
--- This method registers a D-Bus *Match* handler for a signal on a specific
--- interface.
+-- This method subscribes a handler to a signal on a specific interface.
+-- Handlers connected to the same signal (by this or any other controller
+-- using the connection) share a single D-Bus match rule and the signal
+-- arguments are only decoded once for all of them.
 -- 
 -- @within ProxyController
 -- @tparam table ctrl The ProxyController instance.
@@ -606,16 +1221,16 @@ function ProxyController:connectSignal(interface, sigName, handler)
 	verify(validate.isValidMember(sigName), "invalid D-Bus signal name")
 	verify("function" == type(handler))
 	
-	local signalFilter = {msgType=l2dbus.Dbus.MESSAGE_TYPE_SIGNAL,
-							interface=interface,
+	local signalFilter = {interface=interface,
 							path=self.objPath,
-							member=sigName}
+							member=sigName,
+							decodeArgs=true}
 
-	local function onSignal(match, msg, handleSig)
-		handleSig(msg:getArgs())
+	local function onSignal(hnd, msg, handleSig, ...)
+		handleSig(...)
 	end
 	
-	local hnd = self.conn:registerMatch(signalFilter, onSignal, handler)
+	local hnd = self.conn:subscribeSignal(signalFilter, onSignal, handler)
 	if hnd then
 		self.signalHnds[hnd] = true
 	end
@@ -636,7 +1251,7 @@ end
 -- otherwise.
 -- @function disconnectSignal
 function ProxyController:disconnectSignal(hnd)
-	local disconnected = self.conn:unregisterMatch(hnd)
+	local disconnected = self.conn:unsubscribeSignal(hnd)
 	if disconnected then
 		self.signalHnds[hnd] = nil
 	end
@@ -656,7 +1271,7 @@ end
 -- @function disconnectAllSignals
 function ProxyController:disconnectAllSignals()
 	for hnd,_ in pairs(self.signalHnds) do
-		if not self.conn:unregisterMatch(hnd) then
+		if not self.conn:unsubscribeSignal(hnd) then
 			error("failed to disconnect signal (hnd=" .. tostring(hnd) .. ")")
 		end
 	end
@@ -673,7 +1288,9 @@ end
 -- D-Bus message of type @{l2dbus.Message.METHOD_RETURN|METHOD_RETURN} is
 -- returned. *Non-blocking* calls (on success) will return a
 -- @{l2dbus.PendingCall|PendingCsendMessageNoReplyall} object that the caller can use to
--- @{waitForReply|wait} on or be notified of the reply. Proxy calls,
+-- @{waitForReply|wait} on or be notified of the reply. In
+-- @{setAwaitMode|await} mode a call made from a coroutine yields until the
+-- reply arrives and then returns it as a *blocking* call would. Proxy calls,
 -- internally use this method to execute calls to remote services.
 -- 
 -- @within ProxyController
@@ -701,17 +1318,54 @@ function ProxyController:sendMessage(msg)
 	
 	-- If we're making a blocking call (no matter which coroutine
 	-- thread) then ...
-	if self.blockingMode then
+	if self.blockingMode or
+		(self.awaitMode and not getYieldableCoroutine()) then
 		-- We completely block the Lua VM making this call
 		reply, errName, errMsg = self.conn:sendWithReplyAndBlock(msg, self.timeout)
-	-- Else this is a non-blocking call
+	-- Else if the calling coroutine should wait for the reply then ...
 	else
-		local status, pending = self.conn:sendWithReply(msg, self.timeout)
+		local win = requestWindows[self.conn]
+		if win then
+			acquireRequestWindow(self, win)
+		end
+
+		-- Deadlines of awaited calls may be tracked by the timer wheel
+		local co = self.awaitMode and getYieldableCoroutine()
+		local wheel = co and (self.timeout ~= l2dbus.Dbus.TIMEOUT_INFINITE) and
+						self.timerWheel
+		local timeout = wheel and l2dbus.Dbus.TIMEOUT_INFINITE or self.timeout
+		local status, pending = self.conn:sendWithReply(msg, timeout)
 		if not status then
 			reply, errName, errMsg = nil, l2dbus.Dbus.ERROR_FAILED,
 									"failed to send message"
+			if win then
+				releaseRequestWindow(self, win, nil)
+			end
 		else
-			reply, errName, errMsg = pending, nil, nil
+			if win then
+				win.inFlight[pending] = self.awaitMode
+				win.nInFlight = win.nInFlight + 1
+			end
+
+			-- If the calling coroutine should wait for the reply then ...
+			if self.awaitMode then
+				local deadlineId
+				if wheel then
+					deadlineWaiters[pending] = co
+					deadlineId = wheel:schedule((self.timeout >= 0) and
+						self.timeout or DEFAULT_REPLY_TIMEOUT,
+						onRequestDeadline, pending)
+				end
+				-- Yields until the reply (or timeout) resumes us
+				reply, errName, errMsg = self:waitForReply(pending)
+				if deadlineId then
+					deadlineWaiters[pending] = nil
+					wheel:cancel(deadlineId)
+				end
+			-- Else this is a non-blocking call
+			else
+				reply, errName, errMsg = pending, nil, nil
+			end
 		end
 	end
 	
@@ -742,6 +1396,58 @@ function ProxyController:sendMessageNoReply(msg)
 end
 
 
+--- Sets the handler that receives the replies of routed messages.
+-- 
+-- Replies to messages sent with @{sendMessageRouted} are matched to their
+-- request by serial number on the connection and delivered to this one
+-- handler rather than through a @{l2dbus.PendingCall|PendingCall} per
+-- request. The handler is called as:
+-- 
+--     function onReply(serial, reply)
+-- 
+-- Where *serial* is the number returned by @{sendMessageRouted} and *reply*
+-- is the method return or error message (a request that times out receives
+-- an @{l2dbus.Dbus.ERROR_NO_REPLY|ERROR_NO_REPLY} error). Replacing the
+-- handler discards the replies of requests sent through the previous one.
+-- 
+-- @within ProxyController
+-- @tparam table ctrl The ProxyController instance.
+-- @tparam ?func handler The reply handler or **nil** to remove it.
+-- @function setReplyHandler
+function ProxyController:setReplyHandler(handler)
+	verifyTypesWithMsg("function|nil", "unexpected type for arg #1", handler)
+	if self.replyRoute ~= nil then
+		self.conn:removeReplyHandler(self.replyRoute)
+		self.replyRoute = nil
+	end
+	if handler ~= nil then
+		self.replyRoute = self.conn:addReplyHandler(function(conn, serial, reply)
+			handler(serial, reply)
+		end)
+	end
+end
+
+
+--- Sends a D-Bus message whose reply goes to the reply handler.
+-- 
+-- The message is sent with the timeout of the controller and its reply
+-- is delivered to the handler set by @{setReplyHandler}.
+-- 
+-- @within ProxyController
+-- @tparam table ctrl The ProxyController instance.
+-- @tparam userdata msg The D-Bus method call to send.
+-- @treturn number|nil The serial number identifying the request or **nil**
+-- if it could not be sent.
+-- @function sendMessageRouted
+function ProxyController:sendMessageRouted(msg)
+	verifyTypesWithMsg("userdata", "unexpected type for arg #1", msg)
+	verify(self.replyRoute ~= nil, "no reply handler is set")
+	local status, serial = self.conn:sendRouted(msg, self.replyRoute,
+												self.timeout)
+	return status and serial or nil
+end
+
+
 --- Waits for a reply from a pending call.
 -- 
 -- This method is called with a @{l2dbus.PendingCall|PendingCall} object
@@ -773,10 +1479,6 @@ end
 function ProxyController:waitForReply(pendingCall)
 	verify("userdata" == type(pendingCall))
 	
-	local function onNotifyReply(pending, co)
-		coroutine.resume(co, pending:stealReply())
-	end
-	
 	local reply = nil
 	local errName = nil
 	local errMsg = nil
@@ -785,22 +1487,34 @@ function ProxyController:waitForReply(pendingCall)
 		reply = pendingCall:stealReply()
 	else
 		-- See if we're calling from the main thread
-		local co = coroutine.running()
+		local co = getYieldableCoroutine()
 		if not co then
 			-- The main thread cannot yield so we must explicity block
 			pendingCall:block()
 			reply = pendingCall:stealReply()
 		else
+			-- Our reply will free the slot so others can queue on it
+			local win = requestWindows[self.conn]
+			if win and (win.inFlight[pendingCall] ~= nil) then
+				win.inFlight[pendingCall] = true
+			end
 			pendingCall:setNotify(onNotifyReply, co)
-			reply = coroutine.yield()
+			reply, errName, errMsg = coroutine.yield()
 		end
-		assert( pendingCall:isCompleted() )
+		-- A call cancelled because its deadline expired never completes
+		assert( pendingCall:isCompleted() or (errName ~= nil) )
+	end
+
+	local win = requestWindows[self.conn]
+	if win then
+		releaseRequestWindow(self, win, pendingCall)
 	end
 	
 	if not reply then
-		reply, errName, errMsg = nil, l2dbus.Dbus.ERROR_FAILED, "no reply received"
+		reply, errName, errMsg = nil, errName or l2dbus.Dbus.ERROR_FAILED,
+								errMsg or "no reply received"
 	elseif l2dbus.Message.ERROR == reply:getType() then
-		reply, errName, errMsg = nil, reply:getErrorName(), reply:getArgs()
+		reply, errName, errMsg = nil, reply:getErrorName(), reply:takeArgs()
 	end
 	
 	return reply, errName, errMsg 
@@ -811,9 +1525,10 @@ end
 -- 
 -- This method parses D-Bus introspection data and converts it to an internal
 -- Lua table representation which is used to generate the necessary proxy
--- objects. The XML parser used to parse this data is **not** a full-blown,
--- fully validating parser and has known limitations. See the @{l2dbus.xml}
--- module for more details.
+-- objects. The data is parsed natively by
+-- @{l2dbus.Introspection.parseXml|Introspection.parseXml} which is **not** a
+-- fully validating XML parser. Only the interfaces of the root node are
+-- included in the result.
 -- 
 -- @within ProxyController
 -- @tparam table ctrl The ProxyController instance.
@@ -824,51 +1539,8 @@ end
 -- of this table.
 -- @function parseXml
 function ProxyController:parseXml(xmlStr)
-	verifyTypes("string", xmlStr)	
-	local doc = xml.parse(xmlStr)
-	local interfaces = {}
-	for interface in doc:childtags() do
-	    local methods = {}
-	    local signals = {}
-	    local properties = {}
-	    for item in interface:childtags() do
-	        if (item.tag == "method") or (item.tag == "signal") then
-	            local args = {}
-	            for arg in item:childtags() do
-	                if item.tag == "method" then
-	                    table.insert(args, {name = arg.attr.name,
-	                    					sig=arg.attr.type,
-	                    					dir=arg.attr.direction})
-	                else
-	                    table.insert(args, {name = arg.attr.name,
-	                    					sig=arg.attr.type,
-	                    					dir="out"})
-	                end
-	            end
-	            if item.tag == "method" then
-					methods[item.attr.name] = args
-	            else
-					signals[item.attr.name] = args
-	            end
-	        elseif item.tag == "property" then
-	            local access = nil
-	            if "read" == item.attr.access then
-	                access = "r"
-	            elseif "write" == item.attr.access then
-	                access = "w"
-	            else
-	                access = "rw"
-	            end
-				properties[item.attr.name] = {sig=item.attr.type, access=access}
-	        end
-	    end
-		interfaces[interface.attr.name] = { interface = interface.attr.name,
-										   methods = methods,
-			                               signals = signals,
-			                               properties = properties}
-	end
-	
-    return interfaces	
+	verifyTypes("string", xmlStr)
+	return l2dbus.Introspection.parseXml(xmlStr)
 end
 
 
@@ -882,32 +1554,25 @@ newMethodProxy = function (proxyCtrl, metadata)
 	local methodProxy = {}
 
 	local function methodFunc(ctrl, metadata, method, methodInfo)		
+		-- The destination, path, interface, member and input signature are
+		-- fixed for the method so build a call template once rather than
+		-- re-creating the header and re-parsing the signature on every call
+		local inSig = ""
+		for idx = 1,#methodInfo do
+			if methodInfo[idx].dir == "in" then
+				inSig = inSig .. methodInfo[idx].sig
+			end
+		end
+		local callTemplate = l2dbus.Message.newCallTemplate(ctrl.busName,
+							ctrl.objPath, metadata.interface, method, inSig)
+		
 		local innerFunc = function(...)
-			local msg = l2dbus.Message.newMethodCall({destination=ctrl.busName,
-							path=ctrl.objPath,
-							interface=metadata.interface,
-							method=method})
+			-- Copies the header and packs in all the arguments at once
+			local msg = callTemplate:newCall(...)
 			if not msg then
 				error("unable to create D-Bus method call message")
 			end
 			
-			-- Pack in the arguments
-			local callingArgs = {...}
-			local inArgs = {}
-			for idx = 1,#methodInfo do
-				if methodInfo[idx].dir == "in" then
-					table.insert(inArgs, methodInfo[idx])
-				end
-			end
-			if #callingArgs ~= #inArgs then
-				error(string.format("method argument mis-match for %s: provided=%d needed=%d",
-						method, #callingArgs, #inArgs))
-			else
-				for idx=1,#inArgs do
-					msg:addArgsBySignature(inArgs[idx].sig, callingArgs[idx])
-				end
-			end
-			
 			-- Determine if the proxy method call needs to wait around
 			-- for a response.
 			if ctrl:getProxyNoReplyNeeded() then
@@ -929,10 +1594,8 @@ newMethodProxy = function (proxyCtrl, metadata)
 					-- in response
 					return false, errName, errMsg
 				elseif "l2dbus.message" == reply.__type then
-					local replyArgs = {reply:getArgs()}
-					-- Let go of the reference since the D-Bus message is no
-					-- longer needed
-					reply:dispose()
+					-- Decodes the reply and releases it (no need to wait for the GC)
+					local replyArgs = {reply:takeArgs()}
 					return true, unpack(replyArgs)
 				-- Else return the pending call
 				else
@@ -952,6 +1615,24 @@ newMethodProxy = function (proxyCtrl, metadata)
 	return methodProxy 
 end
 
+--
+-- Returns the (cached) call template of a method of the standard
+-- org.freedesktop.DBus.Properties interface of the remote object.
+--
+local function getPropertiesTemplate(ctrl, method, signature)
+	if ctrl.propTemplates == nil then
+		ctrl.propTemplates = {}
+	end
+	local template = ctrl.propTemplates[method]
+	if template == nil then
+		template = l2dbus.Message.newCallTemplate(ctrl.busName, ctrl.objPath,
+						l2dbus.Dbus.INTERFACE_PROPERTIES, method, signature)
+		ctrl.propTemplates[method] = template
+	end
+	return template
+end
+
+
 --
 -- Constructor for the property (p) proxy.
 --
@@ -972,26 +1653,29 @@ newPropertyProxy = function(proxyCtrl, metadata)
 						ctrl.objPath, l2dbus.Dbus.INTERFACE_PROPERTIES))
 			end
 			
-			local msg = l2dbus.Message.newMethodCall({destination=ctrl.busName,
-							path=ctrl.objPath,
-							interface=l2dbus.Dbus.INTERFACE_PROPERTIES,
-							method="Get"})
+			local intfCache = ctrl.propCache and
+								ctrl.propCache[metadata.interface]
+			if intfCache and (intfCache[propName] ~= nil) then
+				return true, intfCache[propName]
+			end
+			
+			local msg = getPropertiesTemplate(ctrl, "Get", "ss"):newCall(
+							metadata.interface, propName)
 			if not msg then
 				error("unable to create D-Bus method call message")
 			end
 			
-			msg:addArgsBySignature("s", metadata.interface)
-			msg:addArgsBySignature("s", propName)
 			local reply, errName, errMsg = ctrl:sendMessage(msg)
 			-- Let go of the reference since D-Bus now owns it
 			msg:dispose()
 			if not reply then
 				return false, errName, errMsg
 			elseif "l2dbus.message" == reply.__type then
-				local replyArgs = {reply:getArgs()}
-				-- Let go of the reference since the D-Bus message is no
-				-- longer needed
-				reply:dispose()
+				-- Decodes the reply and releases it (no need to wait for the GC)
+				local replyArgs = {reply:takeArgs()}
+				if intfCache then
+					intfCache[propName] = replyArgs[1]
+				end
 				return true, unpack(replyArgs)
 			-- Else return the pending call
 			else
@@ -1003,6 +1687,17 @@ newPropertyProxy = function(proxyCtrl, metadata)
 	end
 	
 	local function propSetFunc(ctrl, metadata, propName, propInfo)
+		
+		-- The service needn't signal the change (e.g. if it doesn't emit
+		-- PropertiesChanged for this property) so the cached value can't
+		-- be trusted once the property has been set.
+		local function forgetCachedValue()
+			local intfCache = ctrl.propCache and
+								ctrl.propCache[metadata.interface]
+			if intfCache then
+				intfCache[propName] = nil
+			end
+		end
 			
 		local innerSetFunc = function(value, noReplyNeeded)
 			local propInfo = metadata.properties[propName]
@@ -1019,17 +1714,13 @@ newPropertyProxy = function(proxyCtrl, metadata)
 						ctrl.objPath, l2dbus.Dbus.INTERFACE_PROPERTIES))
 			end
 			
-			local msg = l2dbus.Message.newMethodCall({destination=ctrl.busName,
-							path=ctrl.objPath,
-							interface=l2dbus.Dbus.INTERFACE_PROPERTIES,
-							method="Set"})
+			local msg = getPropertiesTemplate(ctrl, "Set", "ssv"):newCall(
+							metadata.interface, propName,
+							l2dbus.DbusTypes.Variant.new(value))
 			if not msg then
 				error("unable to create D-Bus method call message")
 			end
 			
-			msg:addArgsBySignature("s", metadata.interface)
-			msg:addArgsBySignature("s", propName)
-			msg:addArgs(l2dbus.DbusTypes.Variant.new(value))
 			local reply = nil
 			local errName = nil
 			local errMsg = nil
@@ -1037,6 +1728,9 @@ newPropertyProxy = function(proxyCtrl, metadata)
 				reply = {ctrl:sendMessageNoReply(msg)}
 				-- Dispose of the message since it's no longer needed
 				msg:dispose()
+				if reply[1] then
+					forgetCachedValue()
+				end
 				return unpack(reply)
 			else
 				reply, errName, errMsg = ctrl:sendMessage(msg)
@@ -1045,12 +1739,13 @@ newPropertyProxy = function(proxyCtrl, metadata)
 				if not reply then
 					return false, errName, errMsg
 				elseif "l2dbus.message" == reply.__type then
-					local replyArgs = {reply:getArgs()}
-					-- Dispose of the reply since it's no longer needed
-					reply:dispose()
+					forgetCachedValue()
+					-- Decodes the reply and releases it (no need to wait for the GC)
+					local replyArgs = {reply:takeArgs()}
 					return true, unpack(replyArgs)
-				-- Else return the pending call
+				-- Else return the pending call (the outcome isn't known yet)
 				else
+					forgetCachedValue()
 					return true, reply	-- PendingCall object
 				end
 			end
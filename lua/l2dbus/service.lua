@@ -53,7 +53,19 @@ local Service = { __type = "l2dbus.lua.service" }
 Service.__index = Service
 
 local L2DBUS_ERROR_PROCESSING_REQUEST = "org.l2dbus.error.ProcessingRequest"
+-- Default cap (in bytes) on the size of a coalesced PropertiesChanged signal
+local DEFAULT_PROPS_CHANGED_MAX_SIZE = 64 * 1024
+-- Allowance for the header of a PropertiesChanged signal
+local PROPS_CHANGED_HEADER_SIZE = 256
 local DBUS_PROPERTIES_INTERFACE_NAME = "org.freedesktop.DBus.Properties"
+
+-- Re-used by the request handler to receive message headers
+local gHeader = { }
+-- Data derived from interface metadata, shared by every service that
+-- implements an interface with the same (immutable) metadata table
+local gSharedIntf = setmetatable({ }, { __mode = "k" })
+-- Metadata decoded from introspection XML keyed by interface name and XML
+local gXmlMetadata = setmetatable({ }, { __mode = "v" })
 local DBUS_PROPERTIES_INTERFACE_METADATA =
 {
 	properties = {
@@ -171,9 +183,34 @@ end
 --
 -- Dispatches D-Bus requests to the appropriate handler.
 --
-local function globalHandler(lowLevelObj, conn, msg, svcObj)	
-	local intfName = msg:getInterface()
-	local member = msg:getMember()
+--
+-- Returns the data derived from interface metadata. It's computed once
+-- and shared by all the services implementing the interface.
+--
+local function getSharedIntf(metadata)
+	local shared = gSharedIntf[metadata]
+	if shared == nil then
+		-- Pre-compute the reply signatures of every method
+		local outSigs = {}
+		if metadata.methods then
+			for idx = 1, #metadata.methods do
+				local methName = metadata.methods[idx].name
+				outSigs[methName] = calcSignatureFromMetadata(methName,
+													"out", metadata)
+			end
+		end
+		shared = { outSigs = outSigs }
+		gSharedIntf[metadata] = shared
+	end
+	return shared
+end
+
+
+local function globalHandler(lowLevelObj, conn, msg, svcObj, method)
+	-- Fetch the routing fields in one call into a re-used table
+	local header = msg:getHeader(gHeader)
+	local intfName = header.interface
+	local member = header.member
 	local handler = nil
 	local dbusResult = l2dbus.Dbus.HANDLER_RESULT_HANDLED
 	local context = nil
@@ -181,36 +218,16 @@ local function globalHandler(lowLevelObj, conn, msg, svcObj)
 	local result = nil
 	local outSig = nil
 	
-	-- Search for a suitable handler
-	if intfName and svcObj.interfaces[intfName] then
-		if svcObj.interfaces[intfName].methods[member] then
-			handler = svcObj.interfaces[intfName].methods[member].handler
-			outSig = svcObj.interfaces[intfName].methods[member].outSig
-		end
-	-- Else an interface wasn't provided so find the first interface
-	-- with a matching name and method signature
-	else
-		for intfKey, intfItem in pairs(svcObj.interfaces) do
-			for methName, methItem in pairs(intfItem.methods) do
-				if (methName == member) then
-					if intfItem.methods[member].inSig == msg:getSignature() then
-						handler = intfItem.methods[member].handler
-						outSig = intfItem.methods[member].outSig
-						break
-					end
-				end
-			end
-			if handler ~= nil then
-				break
-			end
-		end
+	-- The low-level service object has already looked up the handler
+	-- in its dispatch index (by interface/member or member/signature)
+	if method ~= nil then
+		handler = method.handler
+		outSig = method.outSig
+	elseif intfName and svcObj.interfaces[intfName] then
+		outSig = svcObj.interfaces[intfName].outSigs[member]
 	end
 	
 	if (handler ~= nil) or (svcObj.defHandler ~= nil ) then
-		if (outSig == nil) and intfName and svcObj.interfaces[intfName] then
-			outSig = calcSignatureFromMetadata(member, "out",
-								svcObj.interfaces[intfName].metadata)
-		end
 		context = newReplyContext(outSig, conn, msg)
 		if handler ~= nil then
 			status, result = pcall(handler, context, msg:getArgs())
@@ -463,7 +480,9 @@ end
 -- object path. The metadata can be in one of two formats: D-Bus 
 -- introspection XML or a Lua table equivalent. The function
 -- @{convertXmlToIntfMeta} can be used to convert XML to the Lua equivalent
--- but is typically unnecessary for this method.
+-- but is typically unnecessary for this method. Services given the same
+-- metadata table (or XML) share the data derived from it, so the metadata
+-- must not be modified once it has been added.
 -- </br>
 -- If the interface that is being added contains D-Bus properties then
 -- the D-Bus property interface <a href="http://dbus.freedesktop.org/doc/dbus-specification.html#standard-interfaces-properties">
@@ -489,8 +508,15 @@ function Service:addInterface(name, metadata)
 	verify(validate.isValidInterface(name), "invalid D-Bus interface name")
 	-- If the metadata is a string then we'll assume it's D-Bus XML formatted
 	-- data that can be converted to an equivalent Lua table.
+	-- Services given the same XML share the decoded metadata.
 	if "string" == type(metadata) then
-		metadata = M.convertXmlToIntfMeta(name, metadata)
+		local key = name .. "\0" .. metadata
+		local decoded = gXmlMetadata[key]
+		if decoded == nil then
+			decoded = M.convertXmlToIntfMeta(name, metadata)
+			gXmlMetadata[key] = decoded
+		end
+		metadata = decoded
 	end
 	verify("table" == type(metadata),
 	       string.format("invalid metadata type (%s)", type(metadata)))
@@ -512,9 +538,12 @@ function Service:addInterface(name, metadata)
 		
 		-- Add it to the lower-level service object
 		if status and self.objInst:addInterface(intfInst) then
+			local shared = getSharedIntf(metadata)
 			self.interfaces[name] = { intfInst = intfInst,
 									metadata = metadata,
-									methods = {}}
+									methods = {},
+									shared = shared,
+									outSigs = shared.outSigs}
 			isAdded = true
 		end
 		
@@ -566,6 +595,7 @@ function Service:removeInterface(name)
 	local isRemoved = false
 	if self.interfaces[name] then
 		if self.objInst:removeInterface(self.interfaces[name].intfInst) then
+			self.objInst:clearMethodDispatch(name)
 			self.interfaces[name] = nil
 			isRemoved = true
 		end
@@ -626,16 +656,15 @@ function Service:registerMethodHandler(intfName, methodName, handler)
 	
 	-- This will replace any previous handler that might have
 	-- already been assigned
-	self.interfaces[intfName].methods[methodName] =
-				{
+	local method = {
 				handler = handler,
 				inSig = calcSignatureFromMetadata(methodName,
 								"in",
 								self.interfaces[intfName].metadata),
-				outSig = calcSignatureFromMetadata(methodName,
-								"out",
-								self.interfaces[intfName].metadata)
+				outSig = self.interfaces[intfName].outSigs[methodName]
 				}
+	self.interfaces[intfName].methods[methodName] = method
+	self.objInst:setMethodDispatch(intfName, methodName, method.inSig, method)
 end
 
 
@@ -664,6 +693,7 @@ function Service:unregisterMethodHandler(intfName, methodName)
 	
 	if self.interfaces[intfName].methods[methodName] then
 		self.interfaces[intfName].methods[methodName] = nil
+		self.objInst:clearMethodDispatch(intfName, methodName)
 		return true
 	else
 		return false
@@ -671,6 +701,28 @@ function Service:unregisterMethodHandler(intfName, methodName)
 end
 
 
+--
+-- Returns the signal signatures of an interface, compiled once per
+-- interface metadata.
+--
+local function getSignalPlans(intf)
+	local shared = intf.shared
+	if shared.signalPlans == nil then
+		local plans = {}
+		for sigIdx = 1, #(intf.metadata.signals or {}) do
+			local sigItem = intf.metadata.signals[sigIdx]
+			local signature = ""
+			for argIdx = 1, #sigItem.args do
+				signature = signature .. sigItem.args[argIdx].sig
+			end
+			plans[sigItem.name] = l2dbus.Message.compileSignature(signature)
+		end
+		shared.signalPlans = plans
+	end
+	return shared.signalPlans
+end
+
+
 --- Provides a method to emit a signal on a specific connection.
 -- 
 -- This method provides a means to send a D-Bus signal with the given
@@ -709,26 +761,31 @@ function Service:emit(conn, intfName, signalName, ...)
 		error("interface '" .. intfName .. "' is unknown to this service object")
 	end
 
-	local nSignals = 0
-	if self.interfaces[intfName].metadata.signals then
-		nSignals = #self.interfaces[intfName].metadata.signals
-	end
-	local signature = ""
-	for sigIdx = 1, nSignals do
-		local sigItem = self.interfaces[intfName].metadata.signals[sigIdx]
-		if sigItem.name == signalName then
-			local nArgs = #sigItem.args
-			for argIdx = 1, nArgs do
-				signature = signature .. sigItem.args[argIdx].sig
-			end
-			break			
+	-- The header of a declared signal never changes so it's stamped out of
+	-- a template and only the arguments are marshalled for every emit
+	local intf = self.interfaces[intfName]
+	local plan = getSignalPlans(intf)[signalName]
+	local msg
+	if plan == nil then
+		msg = l2dbus.Message.newSignal(self.objInst:path(), intfName,
+										signalName)
+		plan = ""
+	else
+		if intf.signalTemplates == nil then
+			intf.signalTemplates = {}
+		end
+		local template = intf.signalTemplates[signalName]
+		if template == nil then
+			local header = l2dbus.Message.newSignal(self.objInst:path(),
+												intfName, signalName)
+			template = l2dbus.Message.newTemplate(header)
+			header:dispose()
+			intf.signalTemplates[signalName] = template
 		end
+		msg = template:newMessage()
 	end
-		
-	local msg = l2dbus.Message.newSignal(self.objInst:path(), intfName,
-										signalName)
 	-- Add the arguments to the message
-	msg:addArgsBySignature(signature, ...)
+	msg:addArgsBySignature(plan, ...)
 	
 	local result = conn:send(msg)
 	-- Dispose of the message since now D-Bus owns it
@@ -738,6 +795,333 @@ function Service:emit(conn, intfName, signalName, ...)
 end
 
 
+--- Emits a batch of signals on a specific connection.
+-- 
+-- This method emits many signals of this service with a single call into
+-- the connection's @{l2dbus.Connection.sendBatch|sendBatch} method. The
+-- signals are marshalled, queued and flushed together which is considerably
+-- cheaper than calling @{emit} for each signal. A failure to encode or queue
+-- one signal does not prevent the others from being sent. A Lua error is
+-- thrown if a signal names an interface unknown to the service.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @tparam userdata conn The D-Bus connection on which to emit the signals.
+-- @tparam table signals An array of signals. Each signal is a table with the
+-- fields *interface* (the D-Bus interface name), *member* (the signal name)
+-- and *args* (an optional array of the signal arguments).
+-- @tparam ?table options The options passed to
+-- @{l2dbus.Connection.sendBatch|sendBatch}. Set *coalesce* to **true** so a
+-- newer signal with the same interface and name replaces an older one
+-- from the same batch.
+-- @treturn number The number of signals queued to be sent.
+-- @treturn table The per-signal results as described by
+-- @{l2dbus.Connection.sendBatch|sendBatch}.
+-- @function emitBatch
+function Service:emitBatch(conn, signals, options)
+	verifyTypesWithMsg("table", "unexpected type for arg #2", signals)
+	
+	local path = self.objInst:path()
+	local items = {}
+	for idx = 1, #signals do
+		local intfName = signals[idx].interface
+		local signalName = signals[idx].member
+		local intf = self.interfaces[intfName]
+		if intf == nil then
+			error("interface '" .. tostring(intfName) ..
+					"' is unknown to this service object")
+		end
+		
+		items[idx] = {path = path,
+					interface = intfName,
+					member = signalName,
+					signature = getSignalPlans(intf)[signalName] or "",
+					args = signals[idx].args}
+	end
+	
+	return conn:sendBatch(items, options)
+end
+
+
+--
+-- Returns a (conservative) estimate of the marshalled size of a Lua value
+-- inside a variant.
+--
+local function estimateMarshalledSize(value)
+	local valueType = type(value)
+	if valueType == "string" then
+		return 5 + #value
+	elseif valueType == "number" then
+		return 8
+	elseif valueType == "boolean" then
+		return 4
+	elseif valueType == "table" then
+		local size = 8
+		for k, v in pairs(value) do
+			size = size + 8 + estimateMarshalledSize(k) +
+					estimateMarshalledSize(v)
+		end
+		return size
+	else
+		-- D-Bus type wrappers and anything else
+		return 16
+	end
+end
+
+
+--
+-- Sends one PropertiesChanged signal per chunk of the pending changes of an
+-- interface so no signal exceeds the maximum size.
+--
+local function sendPropertiesChanged(svc, conn, intfName, pending, maxSize)
+	local path = svc.objInst:path()
+	local nSent = 0
+	local changed = {}
+	local invalidated = {}
+	local size = PROPS_CHANGED_HEADER_SIZE + estimateMarshalledSize(intfName)
+	local isEmpty = true
+	
+	local function send()
+		if svc.propsChangedTemplate == nil then
+			local header = l2dbus.Message.newSignal(path,
+									DBUS_PROPERTIES_INTERFACE_NAME,
+									"PropertiesChanged")
+			svc.propsChangedTemplate = l2dbus.Message.newTemplate(header,
+																"sa{sv}as")
+			header:dispose()
+		end
+		local msg = svc.propsChangedTemplate:newMessage(intfName, changed,
+														invalidated)
+		if conn:send(msg) then
+			nSent = nSent + 1
+		end
+		msg:dispose()
+		changed = {}
+		invalidated = {}
+		size = PROPS_CHANGED_HEADER_SIZE + estimateMarshalledSize(intfName)
+		isEmpty = true
+	end
+	
+	for propName, value in pairs(pending.changed) do
+		local entrySize = 12 + estimateMarshalledSize(propName) +
+							estimateMarshalledSize(value)
+		if not isEmpty and (size + entrySize > maxSize) then
+			send()
+		end
+		changed[propName] = value
+		size = size + entrySize
+		isEmpty = false
+	end
+	
+	for propName, _ in pairs(pending.invalidated) do
+		local entrySize = 4 + estimateMarshalledSize(propName)
+		if not isEmpty and (size + entrySize > maxSize) then
+			send()
+		end
+		invalidated[#invalidated + 1] = propName
+		size = size + entrySize
+		isEmpty = false
+	end
+	
+	if not isEmpty then
+		send()
+	end
+	
+	return nSent
+end
+
+
+--- Enables or disables coalescing of property change notifications.
+-- 
+-- When enabled, changes queued with @{queuePropertyChange} and
+-- @{invalidateProperty} are accumulated per connection and interface and
+-- emitted as a single org.freedesktop.DBus.Properties.PropertiesChanged
+-- signal per interface once the interval expires (an
+-- @{l2dbus.Timeout|Timeout} on the dispatcher). A newer value for the same
+-- property replaces the older one. A signal whose (estimated) size would
+-- exceed the maximum size is split into several signals. When coalescing
+-- is disabled any pending changes are flushed and later changes are emitted
+-- immediately.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @tparam ?userdata|nil dispatcher The @{l2dbus.Dispatcher|Dispatcher} that
+-- runs the flush timer or **nil** to disable coalescing.
+-- @tparam ?table options Optional settings: *interval* is the delay (in
+-- milliseconds) before pending changes are emitted (default 0, e.g. the
+-- next iteration of the dispatch loop) and *maxSize* caps the size (in
+-- bytes) of each signal (default 64 KiB).
+-- @function setPropertyCoalescing
+function Service:setPropertyCoalescing(dispatcher, options)
+	verifyTypesWithMsg("nil|userdata", "unexpected type for arg #1", dispatcher)
+	verifyTypesWithMsg("nil|table", "unexpected type for arg #2", options)
+	options = options or {}
+	
+	if self.propAccum then
+		self:flushPropertyChanges()
+		self.propAccum.timer:setEnable(false)
+		self.propAccum = nil
+	end
+	
+	if dispatcher then
+		local interval = options.interval or 0
+		local maxSize = options.maxSize or DEFAULT_PROPS_CHANGED_MAX_SIZE
+		verify((type(interval) == "number") and (interval >= 0),
+				"invalid coalescing interval")
+		verify((type(maxSize) == "number") and (maxSize > 0),
+				"invalid maximum signal size")
+		local accum = {
+					maxSize = maxSize,
+					pending = {},
+					hasPending = false
+					}
+		accum.timer = l2dbus.Timeout.new(dispatcher, interval, false,
+										function(timeout, svc)
+											svc:flushPropertyChanges()
+										end, self)
+		self.propAccum = accum
+	end
+end
+
+
+--
+-- Records a pending property change and arms the flush timer.
+--
+local function queuePropertyUpdate(svc, conn, intfName, propName, value)
+	local accum = svc.propAccum
+	local connPending = accum.pending[conn]
+	if not connPending then
+		connPending = {}
+		accum.pending[conn] = connPending
+	end
+	local pending = connPending[intfName]
+	if not pending then
+		pending = {changed = {}, invalidated = {}}
+		connPending[intfName] = pending
+	end
+	
+	if value == nil then
+		pending.changed[propName] = nil
+		pending.invalidated[propName] = true
+	else
+		pending.invalidated[propName] = nil
+		pending.changed[propName] = value
+	end
+	
+	if not accum.hasPending then
+		accum.hasPending = true
+		accum.timer:setEnable(true)
+	end
+end
+
+
+--- Stores the value of a property so it is served without calling Lua.
+--
+-- The first call enables the native @{l2dbus.Interface.enablePropertyStore|property store}
+-- of the interface. Once every readable property of the interface has a
+-- value, **Get** and **GetAll** requests for the interface are answered
+-- in C from the stored values rather than by the registered Properties
+-- method handlers. Clients are not notified of the change: use
+-- @{queuePropertyChange} for that.
+--
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @tparam string intfName The D-Bus interface name owning the property.
+-- @tparam string propName The name of the property.
+-- @tparam any value The new value of the property or **nil** to remove it.
+-- @function setProperty
+function Service:setProperty(intfName, propName, value)
+	verify(validate.isValidInterface(intfName), "invalid D-Bus interface name")
+	verify(validate.isValidMember(propName), "invalid D-Bus property name")
+	local intf = self.interfaces[intfName]
+	verify(intf ~= nil, "interface is not implemented by the service")
+
+	intf.intfInst:enablePropertyStore(true)
+	intf.intfInst:setProperty(propName, value)
+end
+
+
+--- Queues a changed property value to be emitted with PropertiesChanged.
+-- 
+-- If property coalescing is @{setPropertyCoalescing|enabled} the change is
+-- accumulated and emitted later otherwise a PropertiesChanged signal is
+-- sent immediately.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @tparam userdata conn The D-Bus connection on which to emit the change.
+-- @tparam string intfName The D-Bus interface name owning the property.
+-- @tparam string propName The name of the property.
+-- @tparam any value The new value of the property.
+-- @function queuePropertyChange
+function Service:queuePropertyChange(conn, intfName, propName, value)
+	verify("userdata" == type(conn), "invalid connection")
+	verify(validate.isValidInterface(intfName), "invalid D-Bus interface name")
+	verify(validate.isValidMember(propName), "invalid D-Bus property name")
+	verify(value ~= nil, "property value expected")
+	
+	if self.propAccum then
+		queuePropertyUpdate(self, conn, intfName, propName, value)
+	else
+		sendPropertiesChanged(self, conn, intfName,
+							{changed = {[propName] = value}, invalidated = {}},
+							DEFAULT_PROPS_CHANGED_MAX_SIZE)
+	end
+end
+
+
+--- Queues the invalidation of a property to be emitted with PropertiesChanged.
+-- 
+-- The property is reported in the list of invalidated properties (i.e.
+-- without its value). Coalescing is applied as for @{queuePropertyChange}.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @tparam userdata conn The D-Bus connection on which to emit the change.
+-- @tparam string intfName The D-Bus interface name owning the property.
+-- @tparam string propName The name of the property.
+-- @function invalidateProperty
+function Service:invalidateProperty(conn, intfName, propName)
+	verify("userdata" == type(conn), "invalid connection")
+	verify(validate.isValidInterface(intfName), "invalid D-Bus interface name")
+	verify(validate.isValidMember(propName), "invalid D-Bus property name")
+	
+	if self.propAccum then
+		queuePropertyUpdate(self, conn, intfName, propName, nil)
+	else
+		sendPropertiesChanged(self, conn, intfName,
+							{changed = {}, invalidated = {[propName] = true}},
+							DEFAULT_PROPS_CHANGED_MAX_SIZE)
+	end
+end
+
+
+--- Immediately emits all the pending property changes.
+-- 
+-- @within Service
+-- @tparam userdata svc The Service instance.
+-- @treturn number The number of PropertiesChanged signals queued to be sent.
+-- @function flushPropertyChanges
+function Service:flushPropertyChanges()
+	local accum = self.propAccum
+	local nSent = 0
+	if accum and accum.hasPending then
+		local pending = accum.pending
+		accum.pending = {}
+		accum.hasPending = false
+		accum.timer:setEnable(false)
+		for conn, connPending in pairs(pending) do
+			for intfName, intfPending in pairs(connPending) do
+				nSent = nSent + sendPropertiesChanged(self, conn, intfName,
+												intfPending, accum.maxSize)
+			end
+		end
+	end
+	
+	return nSent
+end
+
+
 --- ReplyContext
 -- @type ReplyContext
 
@@ -38,7 +38,14 @@ USE OR OTHER DEALINGS IN THE SOFTWARE.
 -- @module l2dbus.validate
 -- @alias M
 
-local MAX_DBUS_NAME_LEN = 255
+local l2dbus = require("l2dbus")
+
+-- Native validators implemented by the L2DBUS core
+local nativeIsValidUtf8 = l2dbus.Dbus.isValidUtf8
+local nativeIsValidBusName = l2dbus.Dbus.isValidBusName
+local nativeIsValidObjectPath = l2dbus.Dbus.isValidObjectPath
+local nativeIsValidMember = l2dbus.Dbus.isValidMember
+local nativeIsValidInterface = l2dbus.Dbus.isValidInterface
 
 
 local M = { }
@@ -60,6 +67,25 @@ local function strip(text)
 end
 
 
+-- Runs a native name validator. Names have historically been validated
+-- after stripping leading/trailing whitespace so that is retried (only)
+-- when the name is rejected as is.
+local function validateName(nativeValidator, name)
+	if nativeValidator(name) then
+		return true
+	elseif type(name) ~= "string" then
+		return false
+	else
+		local stripped = strip(name)
+		return (#stripped ~= #name) and nativeValidator(stripped)
+	end
+end
+
+
+-- The original pure Lua UTF-8 validator (used to describe invalid text)
+local luaIsValidUtf8
+
+
 -- Extracts the tokens from a string separated by '|'.
 -- Looks for words separated by the delimiter '|' and returns these
 -- words in a Lua table structured as a "Set" container (e.g. words are the
@@ -179,14 +205,27 @@ local function doVerifyTypesWithMsg(pattern, msg, ...)
 end
 
 
---- A simple UTF-8 validator in Lua.
--- Tested only with texlua. </br>
--- Manuel Pégourié-Gonnard, 2009, WTFPL v2.</br>
--- See <a href="http://www.wtfpl.net/about/">license</a> for details on WTFPL v2.
+--- Verifies a string is valid UTF-8 text.
+-- The check is done natively by @{l2dbus.Dbus.isValidUtf8}. Only
+-- rejected text is re-checked by the Lua validator in order to describe
+-- the error.
 -- @tparam string str The string to check to see if it's valid UTF-8 text.
 -- @treturn bool Returns true if *str* is a valid utf-8 sequence according
 -- to RFC 3629.
+-- @treturn ?string If *str* is invalid then a description of the error.
 function M.isValidUtf8(str)
+	if nativeIsValidUtf8(str) then
+		return true
+	end
+	return luaIsValidUtf8(str)
+end
+
+
+-- A simple UTF-8 validator in Lua.
+-- Tested only with texlua. </br>
+-- Manuel Pégourié-Gonnard, 2009, WTFPL v2.</br>
+-- See <a href="http://www.wtfpl.net/about/">license</a> for details on WTFPL v2.
+luaIsValidUtf8 = function(str)
 	local len = string.len(str)
 	local not_cont = function(b) return b == nil or b < 128 or b >= 192 end
 	local i = 0
@@ -252,42 +291,8 @@ end
 -- @tparam string name D-Bus bus name to validate.
 -- @treturn bool Returns **true** if bus name is valid, **false** otherwise.
 function M.isValidBusName(name)
-    local isValid = true
-    if type(name) ~= "string" then
-        isValid = false
-    else
-        local busName = strip(name)
-        if #busName > MAX_DBUS_NAME_LEN then
-            isValid = false
-        elseif #busName < 2 then
-            isValid = false
-        elseif not M.isValidUtf8(busName) then
-        	isValid = false
-        end
-        
-        -- If this is a "unique" bus name then ...
-        if ":" == string.sub(busName, 1, 1) then
-        	-- Skip the leading ":"
-        	busName = busName:sub(2)
-        -- Well-known names *cannot* start with a digit
-        elseif string.find(busName, "^%d") ~= nil then
-        	isValid = false
-        end
-        
-        if isValid then
-	        if string.find(busName, "[^A-Za-z0-9_%-.]") ~= nil then
-	            isValid = false
-	        elseif string.find(busName, "^.*%.%..*") ~= nil then
-	            isValid = false -- prevent "com..example.foo"
-	        elseif string.find(busName, "^[A-Za-z0-9_%-]+%.[A-Za-z0-9_%-]+") == nil then
-	            isValid = false
-	        end
-	    end
-    end
-
-    return isValid
-
-end -- isValidWellKnownBusName
+	return validateName(nativeIsValidBusName, name)
+end
 
 
 --- Verifies the given name is a valid D-Bus object path.
@@ -299,29 +304,8 @@ end -- isValidWellKnownBusName
 -- @tparam string name D-Bus object path to validate.
 -- @treturn bool Returns **true** if object path is valid, **false** otherwise.
 function M.isValidObjectPath(name)
-    local isValid = true
-    if type(name) ~= "string" then
-        isValid = false
-    else
-        local objPath = strip(name)
-        if #objPath == 0 then
-            isValid = false
-        elseif string.find(objPath, "[^A-Za-z0-9_/]") ~= nil then
-            isValid = false
-        elseif string.find(objPath, "^/[A-Za-z0-9_]*") == nil then
-            isValid = false
-        elseif string.sub(objPath,1,1) ~= '/' then
-            isValid = false
-        elseif (string.sub(objPath,#objPath,#objPath)) == '/' and
-        	(#objPath ~= 1) then
-            isValid = false
-        elseif string.find(objPath, "//") ~= nil then
-            isValid = false
-        end
-    end
-
-    return isValid
-end -- isValidObjectPath
+	return validateName(nativeIsValidObjectPath, name)
+end
 
 
 --- Verifies the given name is a valid D-Bus member name.
@@ -335,24 +319,7 @@ end -- isValidObjectPath
 -- @treturn bool Returns **true** if the member name is valid,
 -- **false** otherwise.
 function M.isValidMember(name)
-    local isValid = true
-    if type(name) ~= "string" then
-        isValid = false
-    else
-        local member = strip(name)
-        if #member > MAX_DBUS_NAME_LEN then
-            isValid = false
-        elseif #member == 0 then
-            isValid = false
-        elseif not M.isValidUtf8(member) then
-        	isValid = false
-        elseif string.find(member, "^%d") ~= nil then
-        	isValid = false
-        elseif string.find(member, "[^A-Za-z0-9_]") ~= nil then
-            isValid = false
-        end
-    end
-    return isValid
+	return validateName(nativeIsValidMember, name)
 end
 
 
@@ -366,30 +333,7 @@ end
 -- @treturn bool Returns **true** if the interface name is valid,
 -- **false** otherwise.
 function M.isValidInterface(name)
-    local isValid = true
-    if type(name) ~= "string" then
-        isValid = false
-    else
-        local infName = strip(name)
-        if #infName > MAX_DBUS_NAME_LEN then
-            isValid = false
-        elseif #infName < 2 then
-            isValid = false
-        elseif not M.isValidUtf8(infName) then
-        	isValid = false
-        elseif string.find(infName, "^%d") ~= nil then
-        	isValid = false
-        elseif string.find(infName, "[^A-Za-z0-9_.]") ~= nil then
-            isValid = false
-        elseif string.find(infName, "^.*%.%..*") ~= nil then
-            isValid = false -- prevent "com..example.foo"
-        elseif string.find(infName, "^[A-Za-z0-9_]+%.[A-Za-z0-9_]+") == nil then
-            isValid = false
-        end
-
-    end
-
-    return isValid
+	return validateName(nativeIsValidInterface, name)
 end
 
 
@@ -449,7 +393,7 @@ local function main(arg)
 end
 
 -- Determine the context in which the module is used
-if require("l2dbus").isMain() then
+if l2dbus.isMain() then
     -- The module is being run as a program
     main(arg)
 else
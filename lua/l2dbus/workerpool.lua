@@ -0,0 +1,242 @@
+--[[
+*****************************************************************************
+Project         l2dbus
+
+Released under the MIT License (MIT)
+Copyright (c) 2013 XS-Embedded LLC
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*****************************************************************************
+*****************************************************************************
+@file           workerpool.lua
+@author         Glenn Schmottlach
+@brief          Fans messages out to a pool of worker Lua states.
+*****************************************************************************
+--]]
+
+--- Worker Pool Module.
+-- This module runs a set of worker scripts, each in its own Lua state and
+-- thread, and hands D-Bus messages to them over
+-- @{l2dbus.Channel|Channels}. A typical gateway receives (or matches)
+-- messages on one connection and @{WorkerPool:dispatch|dispatches} them to
+-- the workers which handle them, and send any replies, on their own
+-- @{l2dbus.Dispatcher|Dispatcher} and private
+-- @{l2dbus.Connection|Connection}.
+-- </br></br>
+-- A worker script is started with the name of its Channel as *arg[1]*, its
+-- (one-based) index in the pool as *arg[2]* and any additional arguments
+-- given to @{new} after that. It usually looks like this:
+--
+--    local l2dbus = require("l2dbus")
+--    local workerpool = require("l2dbus.workerpool")
+--    local mainLoop = require("l2dbus_ev").MainLoop.new()
+--    local disp = l2dbus.Dispatcher.new(mainLoop)
+--    local conn = l2dbus.Connection.openStandard(disp, l2dbus.Dbus.BUS_SESSION, true)
+--    workerpool.attach(disp, arg[1], function(msg)
+--        -- handle the message
+--    end)
+--    disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+--
+-- @module l2dbus.workerpool
+-- @alias M
+
+
+local l2dbus = require("l2dbus")
+local validate = require("l2dbus.validate")
+
+local verify				=	validate.verify
+
+local M = { }
+local WorkerPool = { __type = "l2dbus.lua.worker_pool" }
+WorkerPool.__index = WorkerPool
+
+--- The object path of the message that tells a worker to stop.
+M.STOP_PATH = "/org/l2dbus/WorkerPool"
+--- The interface of the message that tells a worker to stop.
+M.STOP_INTERFACE = "org.l2dbus.WorkerPool"
+--- The member of the message that tells a worker to stop.
+M.STOP_MEMBER = "Stop"
+
+
+local function isStopMessage(msg)
+	return (msg:getType() == l2dbus.Message.SIGNAL) and
+		(msg:getMember() == M.STOP_MEMBER) and
+		(msg:getInterface() == M.STOP_INTERFACE) and
+		(msg:getObjectPath() == M.STOP_PATH)
+end
+
+
+--- Creates a pool of workers.
+-- One @{l2dbus.Channel|Channel} is opened per worker and the worker script
+-- is @{l2dbus.Channel.spawn|spawned} with the name of that Channel.
+-- @tparam number nWorkers The number of workers (usually one per core).
+-- @tparam string script The path to the worker script.
+-- @tparam ?table opts Optional settings:
+-- <ul>
+-- <li>*name* - The prefix of the Channel names (must be unique in the
+-- process). A unique prefix is generated by default.</li>
+-- <li>*capacity* - The capacity of each Channel (default 1024).</li>
+-- <li>*args* - An array of additional string arguments for the script.</li>
+-- </ul>
+-- @treturn table The @{WorkerPool} instance.
+function M.new(nWorkers, script, opts)
+	verify((type(nWorkers) == "number") and (nWorkers >= 1),
+		"the number of workers must be at least one")
+	verify(type(script) == "string", "a worker script must be specified")
+	opts = opts or {}
+
+	local pool = setmetatable({}, WorkerPool)
+	pool.name = opts.name or ("l2dbus.workerpool." ..
+								tostring(pool):match("0?x?%x+$"))
+	pool.channels = {}
+	pool.next = 1
+	pool.rejected = 0
+
+	local args = opts.args or {}
+	for i = 1, nWorkers do
+		local chanName = pool.name .. "." .. tostring(i)
+		pool.channels[i] = l2dbus.Channel.open(chanName, opts.capacity)
+		l2dbus.Channel.spawn(script, chanName, tostring(i), unpack(args))
+	end
+
+	return pool
+end
+
+
+--- A worker pool class.
+-- @type WorkerPool
+
+
+--- Hands a message to the next worker.
+-- Workers are chosen in round-robin order. A worker whose Channel is full
+-- is skipped.
+-- @tparam userdata msg The @{l2dbus.Message|Message} to dispatch.
+-- @treturn bool Returns **true** if a worker accepted the message or
+-- **false** if the Channel of every worker is full.
+function WorkerPool:dispatch(msg)
+	local n = #self.channels
+	for i = 0, n - 1 do
+		local idx = ((self.next + i - 1) % n) + 1
+		if self.channels[idx]:push(msg) then
+			self.next = (idx % n) + 1
+			return true
+		end
+	end
+
+	self.rejected = self.rejected + 1
+	return false
+end
+
+
+--- Hands a message to a specific worker.
+-- This is useful when messages from the same sender must be handled in order
+-- by the same worker.
+-- @tparam number idx The (one-based) index of the worker.
+-- @tparam userdata msg The @{l2dbus.Message|Message} to dispatch.
+-- @treturn bool Returns **true** if the message was queued or **false** if
+-- the Channel of the worker is full.
+function WorkerPool:dispatchTo(idx, msg)
+	local chan = self.channels[idx]
+	verify(chan ~= nil, "invalid worker index")
+	if chan:push(msg) then
+		return true
+	end
+
+	self.rejected = self.rejected + 1
+	return false
+end
+
+
+--- Returns the number of workers in the pool.
+-- @treturn number The number of workers.
+function WorkerPool:getWorkerCount()
+	return #self.channels
+end
+
+
+--- Returns statistics about the pool.
+-- @treturn table A table with the number of *queued* messages per worker
+-- (array) and the number of messages *rejected* because Channels were full.
+function WorkerPool:getStats()
+	local queued = {}
+	for i = 1, #self.channels do
+		queued[i] = self.channels[i]:count()
+	end
+	return { queued = queued, rejected = self.rejected }
+end
+
+
+--- Asks every worker to stop.
+-- A stop message is queued behind any messages already dispatched to each
+-- worker. Workers that called @{attach} stop their dispatcher when it
+-- arrives.
+-- @treturn bool Returns **true** if every worker was sent a stop message.
+function WorkerPool:stop()
+	local allSent = true
+	for i = 1, #self.channels do
+		-- Each worker gets its own message since they are not copied
+		local stopMsg = l2dbus.Message.newSignal(M.STOP_PATH,
+									M.STOP_INTERFACE, M.STOP_MEMBER)
+		allSent = self.channels[i]:push(stopMsg) and allSent
+	end
+	return allSent
+end
+
+
+--- Attaches a worker to its Channel.
+-- This is called by a worker script. It opens the Channel by name and
+-- creates an enabled @{l2dbus.Watch|Watch} on the given dispatcher that
+-- calls the handler for each message handed over. When the stop message
+-- sent by @{WorkerPool:stop} arrives the *onStop* function (if any) is called
+-- and the dispatcher is stopped.
+-- @tparam userdata disp The @{l2dbus.Dispatcher|Dispatcher} of the worker.
+-- @tparam string chanName The name of the Channel (*arg[1]* of the script).
+-- @tparam func handler The function called as *handler(msg, userToken)*.
+-- @tparam ?any userToken A value passed to the handler.
+-- @tparam ?func onStop An optional function called before the dispatcher is
+-- stopped.
+-- @treturn userdata The @{l2dbus.Channel|Channel}.
+-- @treturn userdata The @{l2dbus.Watch|Watch}.
+function M.attach(disp, chanName, handler, userToken, onStop)
+	verify(type(handler) == "function", "a message handler must be specified")
+	local chan = l2dbus.Channel.open(chanName)
+	local watch = l2dbus.Watch.new(disp, chan:getFd(), l2dbus.Watch.READ,
+		function(w, evTable, token)
+			local msg = chan:pop()
+			while msg ~= nil do
+				if isStopMessage(msg) then
+					w:setEnable(false)
+					if onStop then
+						onStop(token)
+					end
+					disp:stop()
+					return
+				end
+				handler(msg, token)
+				msg = chan:pop()
+			end
+		end, userToken)
+	watch:setEnable(true)
+
+	return chan, watch
+end
+
+
+return M
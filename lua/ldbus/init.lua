@@ -231,9 +231,9 @@ local function newProxy(bus, busName, objPath)
                 pending:block()
                 local msg = pending:stealReply()
                 if msg:getType() == l2dbus.Dbus.MESSAGE_TYPE_ERROR then
-                    return nil, {errCode = M.ERR_DBUS, errMsg = tostring(msg:getArgs()) }
+                    return nil, {errCode = M.ERR_DBUS, errMsg = tostring(msg:takeArgs()) }
                 else
-                    return msg:getArgs(), {errCode = M.ERR_OK, errMsg = ""}
+                    return msg:takeArgs(), {errCode = M.ERR_OK, errMsg = ""}
                 end
             -- Else we're running in a coroutine already
             else
@@ -241,9 +241,9 @@ local function newProxy(bus, busName, objPath)
                     local msg = p:stealReply()
                     if msg:getType() == l2dbus.Dbus.MESSAGE_TYPE_ERROR then
                         coroutine.resume(token, nil, {errCode = M.ERR_DBUS,
-                                        errMsg = tostring(msg:getArgs())})
+                                        errMsg = tostring(msg:takeArgs())})
                     else
-                        coroutine.resume(token, msg:getArgs(),
+                        coroutine.resume(token, msg:takeArgs(),
                                         {errCode = M.ERR_OK, errMsg = "" })
                     end
                 end, co)
@@ -256,6 +256,76 @@ local function newProxy(bus, busName, objPath)
     end
 
 
+    --- Call a method of an arbitrary D-Bus interface using JSON arguments.
+    -- The JSON arguments are transcoded natively to (and the reply from)
+    -- D-Bus so no intermediate Lua tables are created. The arguments
+    -- are a JSON array with one element per complete type in the signature.
+    -- <li><B>NOTE:</B> Cannot be invoked within a protected call (pcall)
+    -- @tparam string interface The D-Bus interface of the method
+    -- @tparam string method The name of the method to call
+    -- @tparam string signature The D-Bus signature of the arguments
+    -- @tparam string param The JSON array of arguments
+    -- @tparam boolean ignoreReply Set to 'true' if function is not
+    -- interested in a reply (and hence does not block waiting for one).
+    -- If 'false' or nil the function should block waiting for a reply.
+    -- @treturn nil (on failure) or the reply arguments encoded as a JSON array.
+    -- If the response is being ignored then 'true' is returned on
+    -- successful submission of request or nil on failure.
+    -- @return @{ErrorInfo} which is a table: {errCode, errMsg}
+    local call = function(interface, method, signature, param, ignoreReply)
+        local ctrl = self.proxyCtrl
+        local msg = l2dbus.Message.newMethodCall({destination=ctrl.busName,
+                                    path=ctrl.objPath, interface=interface,
+                                    method=method})
+        local status, errMsg = pcall(msg.addArgsFromJson, msg, signature, param)
+        if not status then
+            msg:dispose()
+            return nil, {errCode = M.ERR_LUA_ERROR, errMsg = errMsg}
+        end
+
+        -- Converts the reply message and lets go of it
+        local toResult = function(reply)
+            if reply:getType() == l2dbus.Dbus.MESSAGE_TYPE_ERROR then
+                return nil, {errCode = M.ERR_DBUS,
+                            errMsg = tostring(reply:takeArgs())}
+            end
+            local json = reply:getArgsAsJson()
+            reply:dispose()
+            return json, {errCode = M.ERR_OK, errMsg = ""}
+        end
+
+        if ignoreReply then
+            status = ctrl:sendMessageNoReply(msg)
+            msg:dispose()
+            if status then
+                return true, {errCode = M.ERR_OK, errMsg = ""}
+            end
+            return nil, {errCode = M.ERR_DBUS, errMsg = "failed to send message"}
+        end
+
+        local pending, errName
+        pending, errName, errMsg = ctrl:sendMessage(msg)
+        msg:dispose()
+        if not pending then
+            return nil, {errCode = M.ERR_DBUS, errMsg = errMsg or errName }
+        end
+
+        local co = coroutine.running()
+        if co == nil then
+            -- We're in the main thread - the only thing we can do
+            -- is block and wait for a response.
+            pending:block()
+            return toResult(pending:stealReply())
+        else
+            pending:setNotify(function(p, token)
+                coroutine.resume(token, toResult(p:stealReply()))
+            end, co)
+            -- Yield the coroutine until we get an answer
+            return coroutine.yield()
+        end
+    end
+
+
     --- Subscribe to the named signal.
     -- @tparam string sigName The name of the signal to subscribe. If 'nil' then
     -- the handler specifies a global handler that will receive all signals
@@ -346,6 +416,7 @@ local function newProxy(bus, busName, objPath)
         return {
             id = id,
             request = request,
+            call = call,
             subscribe = subscribe,
             unsubscribe = unsubscribe,
 
@@ -611,14 +682,14 @@ local function newBus(b)
         local errInfo = {errCode = M.ERR_LUA_ERROR,
                         errMsg = "Invalid well-known D-Bus bus name"}
         if M.isValidWellKnownBusName(name) then
-            local msgBus = self.msgBusCtrl:getProxy()
-            local status, value, errMsg = msgBus.m.NameHasOwner(name)
-            if status then
+            -- Answered from the name-owner cache when it's enabled
+            local value, errName, errMsg = self.msgBusCtrl:nameHasOwner(name)
+            if value ~= nil then
                 result = {owner = value}
                 errInfo = {errCode = M.ERR_OK, errMsg = ""}
             else
                 errInfo = {errCode = M.ERR_DBUS,
-                            errMsg = string.format("%s : %s", value, errMsg)}
+                            errMsg = string.format("%s : %s", errName, errMsg)}
             end
         end
 
@@ -855,6 +926,8 @@ local function newBus(b)
     self.msgBusCtrl:setBlockingMode(true)
     self.sigHnd = self.msgBusCtrl:connectSignal("NameOwnerChanged",
                                             busObj.handleSignal)
+    -- Track name owners locally (best effort) so hasName needn't ask the bus
+    self.msgBusCtrl:setNameCaching(true)
     return busObj
 end
 
@@ -949,7 +1022,7 @@ end
 -- If this routine is not called prior to loop() libev
 -- will be intialized for backward compatibility.
 -- @param sLoopType the type of loop to init
--- ("l2dbus_ev", "l2dbus_glib", ...)
+-- ("l2dbus_ev", "l2dbus_glib", "l2dbus_epoll", ...)
 -- @return None
 function M.init( sLoopType )
 
@@ -965,7 +1038,7 @@ function M.init( sLoopType )
         evLoop:now()
         initLoop = evLoop
 
-    elseif sLoopType == "l2dbus_glib" then
+    elseif (sLoopType == "l2dbus_glib") or (sLoopType == "l2dbus_epoll") then
 
         -- NOP, ensures sLoopType is supported
         --      uses the generic init below
@@ -33,6 +33,38 @@
 #include <string.h>
 #include "dbus/dbus.h"
 #include "l2dbus_alloc.h"
+#include "l2dbus_defs.h"
+
+/* The size of the data area of a regular arena block */
+#define L2DBUS_ARENA_BLOCK_SIZE     (4096)
+
+/* All arena allocations are rounded up to this alignment */
+typedef union l2dbus_ArenaAlign
+{
+    void*       p;
+    double      d;
+    long long   ll;
+} l2dbus_ArenaAlign;
+
+#define L2DBUS_ARENA_ROUND(n)   ((((n) + sizeof(l2dbus_ArenaAlign) - 1) / \
+                                sizeof(l2dbus_ArenaAlign)) * \
+                                sizeof(l2dbus_ArenaAlign))
+
+typedef struct l2dbus_ArenaBlock
+{
+    struct l2dbus_ArenaBlock*   prev;
+    size_t                      size;
+    size_t                      used;
+} l2dbus_ArenaBlock;
+
+#define L2DBUS_ARENA_HDR_SIZE   L2DBUS_ARENA_ROUND(sizeof(l2dbus_ArenaBlock))
+#define L2DBUS_ARENA_DATA(blk)  ((char*)(blk) + L2DBUS_ARENA_HDR_SIZE)
+
+/* The most recently allocated block. The first (base) block is kept for
+ * reuse whereas larger overflow blocks are freed when released. Each
+ * thread (and so each Lua state running on it) has its own arena.
+ */
+static L2DBUS_THREAD_LOCAL l2dbus_ArenaBlock* gArenaTop = NULL;
 
 void*
 l2dbus_malloc
@@ -91,6 +123,7 @@ void l2dbus_freeStringArray
         while ( NULL != strArray[idx] )
         {
             l2dbus_free(strArray[idx]);
+            ++idx;
         }
         l2dbus_free(strArray);
     }
@@ -117,3 +150,131 @@ l2dbus_strDup
     return p;
 }
 
+
+
+static l2dbus_ArenaBlock*
+l2dbus_arenaNewBlock
+    (
+    size_t  size
+    )
+{
+    l2dbus_ArenaBlock* blk = l2dbus_malloc(L2DBUS_ARENA_HDR_SIZE + size);
+
+    if ( NULL != blk )
+    {
+        blk->prev = gArenaTop;
+        blk->size = size;
+        blk->used = 0;
+        gArenaTop = blk;
+    }
+    return blk;
+}
+
+
+void
+l2dbus_arenaMark
+    (
+    l2dbus_ArenaMark*   mark
+    )
+{
+    if ( NULL != mark )
+    {
+        mark->block = gArenaTop;
+        mark->used = (NULL != gArenaTop) ? gArenaTop->used : 0;
+    }
+}
+
+
+void
+l2dbus_arenaRelease
+    (
+    const l2dbus_ArenaMark* mark
+    )
+{
+    l2dbus_ArenaBlock* blk;
+
+    if ( NULL != mark )
+    {
+        /* Free the overflow blocks allocated after the mark */
+        while ( (NULL != gArenaTop) && (gArenaTop != mark->block) &&
+            (NULL != gArenaTop->prev) )
+        {
+            blk = gArenaTop;
+            gArenaTop = blk->prev;
+            l2dbus_free(blk);
+        }
+
+        if ( NULL != gArenaTop )
+        {
+            gArenaTop->used = (gArenaTop == mark->block) ? mark->used : 0;
+        }
+    }
+}
+
+
+void
+l2dbus_arenaReset(void)
+{
+    l2dbus_ArenaMark mark = { NULL, 0 };
+    l2dbus_arenaRelease(&mark);
+}
+
+
+void
+l2dbus_arenaShutdown(void)
+{
+    l2dbus_arenaReset();
+    l2dbus_free(gArenaTop);
+    gArenaTop = NULL;
+}
+
+
+void*
+l2dbus_arenaAlloc
+    (
+    size_t  size
+    )
+{
+    void* p = NULL;
+
+    size = L2DBUS_ARENA_ROUND(size);
+
+    /* The base block is always a regular sized block */
+    if ( (NULL != gArenaTop) ||
+        (NULL != l2dbus_arenaNewBlock(L2DBUS_ARENA_BLOCK_SIZE)) )
+    {
+        if ( (size > (gArenaTop->size - gArenaTop->used)) &&
+            (NULL == l2dbus_arenaNewBlock((size > L2DBUS_ARENA_BLOCK_SIZE) ?
+                                    size : L2DBUS_ARENA_BLOCK_SIZE)) )
+        {
+            return NULL;
+        }
+
+        p = L2DBUS_ARENA_DATA(gArenaTop) + gArenaTop->used;
+        gArenaTop->used += size;
+    }
+
+    return p;
+}
+
+
+char*
+l2dbus_arenaStrDup
+    (
+    const char*   s
+    )
+{
+    char* p = NULL;
+    size_t len;
+
+    if ( NULL != s )
+    {
+        len = strlen(s) + sizeof(*p);
+        p = l2dbus_arenaAlloc(len);
+        if ( NULL != p )
+        {
+            memcpy(p, s, len);
+        }
+    }
+    return p;
+}
@@ -43,4 +43,28 @@ void l2dbus_free(void* p);
 void l2dbus_freeStringArray(char** strArray);
 char* l2dbus_strDup(const char* s);
 
+/*
+ * The arena is a bump allocator for short-lived (transient) allocations made
+ * while marshalling/unmarshalling messages or servicing a callback. Memory
+ * is never freed individually. Instead a mark is taken before the allocations
+ * are made and the arena is released back to the mark when they are no longer
+ * needed. The arena is also reset after every callback so memory abandoned by
+ * a Lua error (long jump) is reclaimed. Arena memory must therefore never be
+ * held across a call that can dispatch a Lua callback.
+ */
+struct l2dbus_ArenaBlock;
+
+typedef struct l2dbus_ArenaMark
+{
+    struct l2dbus_ArenaBlock*   block;
+    size_t                      used;
+} l2dbus_ArenaMark;
+
+void l2dbus_arenaMark(l2dbus_ArenaMark* mark);
+void l2dbus_arenaRelease(const l2dbus_ArenaMark* mark);
+void l2dbus_arenaReset(void);
+void l2dbus_arenaShutdown(void);
+void* l2dbus_arenaAlloc(size_t size);
+char* l2dbus_arenaStrDup(const char* s);
+
 #endif /* Guard for L2DBUS_ALLOC_H_ */
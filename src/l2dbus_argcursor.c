@@ -0,0 +1,365 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_argcursor.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the message argument cursor.
+ *===========================================================================
+ */
+#include "l2dbus_compat.h"
+#include "l2dbus_argcursor.h"
+#include "l2dbus_object.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "lauxlib.h"
+
+/**
+ L2DBUS ArgCursor
+
+ This section describes the Lua ArgCursor class.
+
+ An ArgCursor is returned by @{l2dbus.Message.iterArgs|iterArgs} and walks
+ the arguments of a message one at a time. Only the arguments that are
+ explicitly decoded are converted to Lua values so a handler can inspect
+ the first argument (or its type) and reject a message without decoding
+ the rest of it. The cursor can also descend into a container argument
+ with @{recurse}. The message must not be modified while a cursor
+ references it.
+
+ @namespace l2dbus.ArgCursor
+ */
+
+
+/**
+ * @brief Creates a new ArgCursor at the iterator position.
+ *
+ * The new cursor is left on the top of the Lua stack and holds a reference
+ * to the message.
+ *
+ * @param [in] L    The Lua state.
+ * @param [in] msg  The message to iterate.
+ * @param [in] iter The initial position of the cursor.
+ * @param [in] opts The options used to decode arguments (may be NULL).
+ */
+void
+l2dbus_argCursorNew
+    (
+    lua_State*                  L,
+    DBusMessage*                msg,
+    DBusMessageIter*            iter,
+    const l2dbus_TranscodeOpts* opts
+    )
+{
+    l2dbus_ArgCursor* ud;
+
+    ud = (l2dbus_ArgCursor*)l2dbus_objectNew(L, sizeof(*ud),
+                                            L2DBUS_ARG_CURSOR_TYPE_ID);
+    ud->msg = dbus_message_ref(msg);
+    ud->iter = *iter;
+    if ( NULL != opts )
+    {
+        ud->opts = *opts;
+    }
+}
+
+
+static l2dbus_ArgCursor*
+l2dbus_argCursorCheck
+    (
+    lua_State*  L,
+    int         idx
+    )
+{
+    return (l2dbus_ArgCursor*)l2dbus_checkUserData(L, idx,
+                                            L2DBUS_ARG_CURSOR_TYPE_ID);
+}
+
+
+/**
+ @function next
+ @within l2dbus.ArgCursor
+
+ Decodes the current argument and advances the cursor.
+
+ @tparam userdata cursor The ArgCursor.
+ @treturn any The decoded argument or **nil** if there are no more
+ arguments.
+ */
+static int
+l2dbus_argCursorNext
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ArgCursor* ud = l2dbus_argCursorCheck(L, 1);
+
+    l2dbus_transcodeDbusIterToLua(L, ud->msg, &ud->iter, &ud->opts);
+    dbus_message_iter_next(&ud->iter);
+
+    return 1;
+}
+
+
+/**
+ @function decode
+ @within l2dbus.ArgCursor
+
+ Decodes the current argument (and everything it contains) without
+ advancing the cursor.
+
+ @tparam userdata cursor The ArgCursor.
+ @treturn any The decoded argument or **nil** if there are no more
+ arguments.
+ */
+static int
+l2dbus_argCursorDecode
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ArgCursor* ud = l2dbus_argCursorCheck(L, 1);
+    DBusMessageIter iter = ud->iter;
+
+    l2dbus_transcodeDbusIterToLua(L, ud->msg, &iter, &ud->opts);
+
+    return 1;
+}
+
+
+/**
+ @function skip
+ @within l2dbus.ArgCursor
+
+ Advances the cursor without decoding the skipped arguments.
+
+ @tparam userdata cursor The ArgCursor.
+ @tparam ?number count The number of arguments to skip (default 1).
+ @treturn bool Returns **true** if the cursor is positioned at an argument
+ afterwards or **false** if the end has been reached.
+ */
+static int
+l2dbus_argCursorSkip
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ArgCursor* ud = l2dbus_argCursorCheck(L, 1);
+    int count = luaL_optint(L, 2, 1);
+
+    while ( (count-- > 0) && dbus_message_iter_next(&ud->iter) )
+    {
+    }
+
+    lua_pushboolean(L, DBUS_TYPE_INVALID !=
+                        dbus_message_iter_get_arg_type(&ud->iter));
+    return 1;
+}
+
+
+/**
+ @function peekType
+ @within l2dbus.ArgCursor
+
+ Returns the D-Bus type code of the current argument.
+
+ @tparam userdata cursor The ArgCursor.
+ @treturn ?string|nil The type code (e.g. "s", "a", "r" for a structure or
+ "v" for a variant) or **nil** if there are no more arguments.
+ */
+static int
+l2dbus_argCursorPeekType
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ArgCursor* ud = l2dbus_argCursorCheck(L, 1);
+    char typeCode = (char)dbus_message_iter_get_arg_type(&ud->iter);
+
+    if ( DBUS_TYPE_INVALID == typeCode )
+    {
+        lua_pushnil(L);
+    }
+    else
+    {
+        lua_pushlstring(L, &typeCode, 1);
+    }
+    return 1;
+}
+
+
+/**
+ @function peekSignature
+ @within l2dbus.ArgCursor
+
+ Returns the complete D-Bus signature of the current argument.
+
+ @tparam userdata cursor The ArgCursor.
+ @treturn ?string|nil The signature (e.g. "a{sv}") or **nil** if there are
+ no more arguments.
+ */
+static int
+l2dbus_argCursorPeekSignature
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ArgCursor* ud = l2dbus_argCursorCheck(L, 1);
+    char* signature;
+
+    if ( DBUS_TYPE_INVALID == dbus_message_iter_get_arg_type(&ud->iter) )
+    {
+        lua_pushnil(L);
+    }
+    else
+    {
+        signature = dbus_message_iter_get_signature(&ud->iter);
+        if ( NULL == signature )
+        {
+            luaL_error(L, "failed to get the argument signature");
+        }
+        lua_pushstring(L, signature);
+        dbus_free(signature);
+    }
+    return 1;
+}
+
+
+/**
+ @function recurse
+ @within l2dbus.ArgCursor
+
+ Returns a new cursor over the contents of the current (container)
+ argument.
+
+ Arrays, structures, dictionary entries and variants can be recursed. The
+ current cursor is not advanced.
+
+ @tparam userdata cursor The ArgCursor.
+ @treturn userdata A new ArgCursor positioned at the first contained value.
+ */
+static int
+l2dbus_argCursorRecurse
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ArgCursor* ud = l2dbus_argCursorCheck(L, 1);
+    DBusMessageIter subIter;
+
+    if ( !dbus_type_is_container(dbus_message_iter_get_arg_type(&ud->iter)) )
+    {
+        luaL_error(L, "current argument is not a container");
+    }
+
+    dbus_message_iter_recurse(&ud->iter, &subIter);
+    l2dbus_argCursorNew(L, ud->msg, &subIter, &ud->opts);
+
+    return 1;
+}
+
+
+/**
+ @function atEnd
+ @within l2dbus.ArgCursor
+
+ Returns whether there are no more arguments.
+
+ @tparam userdata cursor The ArgCursor.
+ @treturn bool Returns **true** if the cursor is past the last argument.
+ */
+static int
+l2dbus_argCursorAtEnd
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ArgCursor* ud = l2dbus_argCursorCheck(L, 1);
+
+    lua_pushboolean(L, DBUS_TYPE_INVALID ==
+                        dbus_message_iter_get_arg_type(&ud->iter));
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the ArgCursor userdata.
+ *
+ * @return nil
+ */
+static int
+l2dbus_argCursorDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ArgCursor* ud = l2dbus_argCursorCheck(L, 1);
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: ArgCursor (userdata=%p)", ud));
+
+    if ( NULL != ud->msg )
+    {
+        dbus_message_unref(ud->msg);
+        ud->msg = NULL;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Define the methods of the ArgCursor class
+ */
+static const luaL_Reg l2dbus_argCursorMetaTable[] = {
+    {"next", l2dbus_argCursorNext},
+    {"decode", l2dbus_argCursorDecode},
+    {"skip", l2dbus_argCursorSkip},
+    {"peekType", l2dbus_argCursorPeekType},
+    {"peekSignature", l2dbus_argCursorPeekSignature},
+    {"recurse", l2dbus_argCursorRecurse},
+    {"atEnd", l2dbus_argCursorAtEnd},
+    {"__gc", l2dbus_argCursorDispose},
+    {NULL, NULL},
+};
+
+
+/**
+ * @brief Creates the ArgCursor sub-module.
+ *
+ * This function creates a metatable entry for the ArgCursor userdata.
+ * Cursors are only created by @{l2dbus.Message.iterArgs} so no table is
+ * registered.
+ */
+void
+l2dbus_openArgCursor
+    (
+    lua_State*  L
+    )
+{
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_ARG_CURSOR_TYPE_ID,
+            l2dbus_argCursorMetaTable));
+}
@@ -0,0 +1,55 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_argcursor.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the message argument cursor.
+ *===========================================================================
+ */
+#ifndef L2DBUS_ARGCURSOR_H_
+#define L2DBUS_ARGCURSOR_H_
+
+#include "lua.h"
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
+#include "l2dbus_transcode.h"
+
+typedef struct l2dbus_ArgCursor
+{
+    /* A reference to the message being iterated */
+    DBusMessage*            msg;
+    /* The current position within the message */
+    DBusMessageIter         iter;
+    /* The options used to decode the arguments */
+    l2dbus_TranscodeOpts    opts;
+} l2dbus_ArgCursor;
+
+void l2dbus_argCursorNew(lua_State* L, DBusMessage* msg, DBusMessageIter* iter,
+                        const l2dbus_TranscodeOpts* opts);
+void l2dbus_openArgCursor(lua_State* L);
+
+#endif /* Guard for L2DBUS_ARGCURSOR_H_ */
@@ -0,0 +1,476 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_batch.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of batched message transmission.
+ *===========================================================================
+ */
+#include <string.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_batch.h"
+#include "l2dbus_cork.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_message.h"
+#include "l2dbus_transcode.h"
+#include "l2dbus_sigplan.h"
+#include "l2dbus_core.h"
+#include "l2dbus_util.h"
+#include "l2dbus_object.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_dbuscompat.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_tracering.h"
+#include "lauxlib.h"
+
+/* Book-keeping for each message queued in a batch */
+typedef struct l2dbus_BatchSlot
+{
+    DBusMessage*    msg;
+    /* The (1-based) index of the batch item that produced the message */
+    int             itemIdx;
+    unsigned        hash;
+} l2dbus_BatchSlot;
+
+
+/**
+ * @brief Hashes (FNV-1a) a string into an existing hash value.
+ */
+static unsigned
+l2dbus_batchHashStr
+    (
+    unsigned    hash,
+    const char* str
+    )
+{
+    if ( NULL != str )
+    {
+        while ( '\0' != *str )
+        {
+            hash ^= (unsigned char)*str++;
+            hash *= 16777619U;
+        }
+    }
+    /* Separate the fields */
+    hash *= 16777619U;
+    return hash;
+}
+
+
+static l2dbus_Bool
+l2dbus_batchStrEqual
+    (
+    const char* a,
+    const char* b
+    )
+{
+    if ( (NULL == a) || (NULL == b) )
+    {
+        return a == b;
+    }
+    return 0 == strcmp(a, b);
+}
+
+
+/**
+ * @brief Determines whether two signals have the same coalescing key.
+ *
+ * The key consists of the destination, object path, interface and member.
+ */
+static l2dbus_Bool
+l2dbus_batchSameKey
+    (
+    DBusMessage*    a,
+    DBusMessage*    b
+    )
+{
+    return l2dbus_batchStrEqual(dbus_message_get_member(a),
+                                dbus_message_get_member(b)) &&
+        l2dbus_batchStrEqual(dbus_message_get_path(a),
+                                dbus_message_get_path(b)) &&
+        l2dbus_batchStrEqual(dbus_message_get_interface(a),
+                                dbus_message_get_interface(b)) &&
+        l2dbus_batchStrEqual(dbus_message_get_destination(a),
+                                dbus_message_get_destination(b));
+}
+
+
+/**
+ * @brief Builds a signal message from a batch item table.
+ *
+ * This function is called in protected mode. On the stack is the item
+ * table. A Message userdata (owning the new signal) is returned.
+ */
+static int
+l2dbus_batchNewSignal
+    (
+    lua_State*  L
+    )
+{
+    const char* path;
+    const char* interface;
+    const char* member;
+    DBusMessage* dbusMsg;
+    l2dbus_SigPlan* plan = NULL;
+    int argsIdx;
+    int nArgs = 0;
+    int idx;
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+
+    lua_getfield(L, 1, "path");
+    lua_getfield(L, 1, "interface");
+    lua_getfield(L, 1, "member");
+    path = lua_tostring(L, 2);
+    interface = lua_tostring(L, 3);
+    member = lua_tostring(L, 4);
+
+    if ( (NULL == path) || !l2dbus_validatePath(path) )
+    {
+        luaL_error(L, "invalid or missing D-Bus object path");
+    }
+    if ( (NULL == interface) || !l2dbus_validateInterface(interface) )
+    {
+        luaL_error(L, "invalid or missing D-Bus interface name");
+    }
+    if ( (NULL == member) || !l2dbus_validateMember(member) )
+    {
+        luaL_error(L, "invalid or missing D-Bus member name");
+    }
+
+    lua_getfield(L, 1, "signature");
+    if ( !lua_isnil(L, -1) )
+    {
+        plan = l2dbus_sigPlanCheck(L, -1);
+    }
+
+    lua_getfield(L, 1, "args");
+    argsIdx = lua_gettop(L);
+    if ( !lua_isnil(L, argsIdx) )
+    {
+        luaL_checktype(L, argsIdx, LUA_TTABLE);
+        nArgs = (int)lua_rawlen(L, argsIdx);
+    }
+
+    dbusMsg = dbus_message_new_signal(path, interface, member);
+    if ( NULL == dbusMsg )
+    {
+        luaL_error(L, "failed to allocate D-Bus signal message");
+    }
+
+    /* The wrapper owns the message so it is released even on error */
+    l2dbus_messageWrap(L, dbusMsg, L2DBUS_FALSE);
+
+    if ( 0 < nArgs )
+    {
+        luaL_checkstack(L, nArgs, "cannot grow Lua stack to hold arguments");
+        for ( idx = 1; idx <= nArgs; ++idx )
+        {
+            lua_rawgeti(L, argsIdx, idx);
+        }
+
+        if ( NULL != plan )
+        {
+            l2dbus_transcodeLuaArgsToDbusByPlan(L, dbusMsg, -nArgs, nArgs,
+                                                plan);
+        }
+        else
+        {
+            l2dbus_transcodeLuaArgsToDbus(L, dbusMsg, -nArgs, nArgs);
+        }
+        lua_pop(L, nArgs);
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Finds the slot holding a pending signal with the same key.
+ *
+ * @return The index of the matching slot or -1 if there is none.
+ */
+static int
+l2dbus_batchFindPending
+    (
+    const l2dbus_BatchSlot* slots,
+    const int*              table,
+    unsigned                tableSize,
+    DBusMessage*            msg,
+    unsigned                hash,
+    unsigned*               freePos
+    )
+{
+    unsigned pos = hash & (tableSize - 1);
+    int slotIdx;
+
+    while ( 0 <= (slotIdx = table[pos]) )
+    {
+        if ( (slots[slotIdx].hash == hash) &&
+            l2dbus_batchSameKey(slots[slotIdx].msg, msg) )
+        {
+            return slotIdx;
+        }
+        pos = (pos + 1) & (tableSize - 1);
+    }
+
+    *freePos = pos;
+    return -1;
+}
+
+
+/**
+ @function sendBatch
+ @within Connection
+
+ Queues a batch of messages to be sent in a single call.
+
+ Each item of the batch is either a prebuilt @{l2dbus.Message|Message} or a
+ table describing a signal to emit with the following fields:
+
+ <ul>
+ <li>*path*      - The D-Bus object path emitting the signal</li>
+ <li>*interface* - The D-Bus interface of the signal</li>
+ <li>*member*    - The name of the signal</li>
+ <li>*signature* - [Opt] The signature (string or @{l2dbus.Message.compileSignature|compiled}
+ handle) of the arguments. If not specified the D-Bus types are inferred
+ from the Lua types.</li>
+ <li>*args*      - [Opt] An array of the signal arguments</li>
+ </ul>
+
+ All the signals are marshalled in C, queued, and (optionally) flushed
+ once. A failure marshalling or queueing one item does not prevent the
+ remaining items from being sent. The optional *options* table can
+ contain the following fields:
+
+ <ul>
+ <li>*coalesce* - If **true** a signal in the batch replaces an earlier
+ signal in the same batch with the same destination, path, interface and
+ member. The earlier signal is never sent. The default is **false**.</li>
+ <li>*flush*    - If **true** (the default) block until the outgoing queue
+ is written once all the messages are queued.</li>
+ </ul>
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam table items An array of messages and/or signal descriptions.
+ @tparam ?table options Options controlling how the batch is sent.
+ @treturn number The number of messages queued to be sent.
+ @treturn table An array with the result for each item. The result is the
+ serial number of the queued message, zero (0) if the signal was
+ replaced by a newer one, or a string describing why the item failed.
+ */
+int
+l2dbus_connectionSendBatch
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_Message* msgUd;
+    DBusConnection* dbusConn;
+    DBusMessage* msg;
+    l2dbus_BatchSlot* slots = NULL;
+    int* table = NULL;
+    unsigned tableSize = 1;
+    unsigned freePos = 0;
+    l2dbus_Bool coalesce = L2DBUS_FALSE;
+    l2dbus_Bool flush = L2DBUS_TRUE;
+    l2dbus_Bool queued;
+    dbus_uint32_t serialNum;
+    int nItems;
+    int nSlots = 0;
+    int nQueued = 0;
+    int resultsIdx;
+    int itemIdx;
+    int slotIdx;
+    unsigned hash;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    if ( !lua_isnoneornil(L, 3) )
+    {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        lua_getfield(L, 3, "coalesce");
+        coalesce = lua_toboolean(L, -1) ? L2DBUS_TRUE : L2DBUS_FALSE;
+        lua_getfield(L, 3, "flush");
+        flush = lua_isnil(L, -1) || lua_toboolean(L, -1);
+        lua_pop(L, 2);
+    }
+    lua_settop(L, 2);
+
+    dbusConn = cdbus_connectionGetDBus(connUd->conn);
+    nItems = (int)lua_rawlen(L, 2);
+    lua_createtable(L, nItems, 0);
+    resultsIdx = lua_gettop(L);
+
+    if ( 0 == nItems )
+    {
+        lua_pushinteger(L, 0);
+        lua_insert(L, -2);
+        return 2;
+    }
+
+    /* Size the coalescing table to keep the load factor below 1/2 */
+    while ( tableSize < (unsigned)nItems * 2 )
+    {
+        tableSize <<= 1;
+    }
+
+    slots = (l2dbus_BatchSlot*)l2dbus_calloc(nItems, sizeof(*slots));
+    if ( coalesce )
+    {
+        table = (int*)l2dbus_malloc(tableSize * sizeof(*table));
+        if ( NULL != table )
+        {
+            memset(table, 0xFF, tableSize * sizeof(*table));
+        }
+    }
+    if ( (NULL == slots) || (coalesce && (NULL == table)) )
+    {
+        l2dbus_free(slots);
+        l2dbus_free(table);
+        luaL_error(L, "failed to allocate memory for message batch");
+    }
+
+    /* Build (or collect) every message in the batch */
+    for ( itemIdx = 1; itemIdx <= nItems; ++itemIdx )
+    {
+        msg = NULL;
+        lua_rawgeti(L, 2, itemIdx);
+        msgUd = (l2dbus_Message*)l2dbus_isUserData(L, -1,
+                                                L2DBUS_MESSAGE_TYPE_ID);
+        if ( NULL != msgUd )
+        {
+            if ( NULL == msgUd->msg )
+            {
+                lua_pop(L, 1);
+                lua_pushstring(L, "reference to D-Bus message no longer exists");
+            }
+            else
+            {
+                msg = msgUd->msg;
+            }
+        }
+        else
+        {
+            lua_pushcfunction(L, l2dbus_batchNewSignal);
+            lua_insert(L, -2);
+            if ( 0 == lua_pcall(L, 1, 1, 0) )
+            {
+                msg = ((l2dbus_Message*)lua_touserdata(L, -1))->msg;
+            }
+            else if ( !lua_isstring(L, -1) )
+            {
+                lua_pop(L, 1);
+                lua_pushstring(L, "failed to build signal");
+            }
+        }
+
+        if ( NULL == msg )
+        {
+            /* The failure reason is on the top of the stack */
+            lua_rawseti(L, resultsIdx, itemIdx);
+            continue;
+        }
+
+        dbus_message_ref(msg);
+        lua_pop(L, 1);
+
+        if ( coalesce && (DBUS_MESSAGE_TYPE_SIGNAL == dbus_message_get_type(msg)) )
+        {
+            hash = l2dbus_batchHashStr(2166136261U, dbus_message_get_member(msg));
+            hash = l2dbus_batchHashStr(hash, dbus_message_get_path(msg));
+            hash = l2dbus_batchHashStr(hash, dbus_message_get_interface(msg));
+            hash = l2dbus_batchHashStr(hash, dbus_message_get_destination(msg));
+
+            slotIdx = l2dbus_batchFindPending(slots, table, tableSize, msg,
+                                            hash, &freePos);
+            if ( 0 <= slotIdx )
+            {
+                /* The newer signal takes the place of the older one */
+                dbus_message_unref(slots[slotIdx].msg);
+                lua_pushinteger(L, 0);
+                lua_rawseti(L, resultsIdx, slots[slotIdx].itemIdx);
+                slots[slotIdx].msg = msg;
+                slots[slotIdx].itemIdx = itemIdx;
+                continue;
+            }
+
+            table[freePos] = nSlots;
+            slots[nSlots].hash = hash;
+        }
+
+        slots[nSlots].msg = msg;
+        slots[nSlots].itemIdx = itemIdx;
+        ++nSlots;
+    }
+
+    /* Queue all the messages (after any held by a cork) */
+    l2dbus_corkRelease(connUd, L2DBUS_FALSE);
+    for ( slotIdx = 0; slotIdx < nSlots; ++slotIdx )
+    {
+        serialNum = 0;
+        queued = dbus_connection_send(dbusConn, slots[slotIdx].msg,
+                                    &serialNum);
+        l2dbus_statsCountSent(&connUd->stats, slots[slotIdx].msg, queued);
+        if ( queued )
+        {
+            l2dbus_traceRingRecord(connUd, slots[slotIdx].msg,
+                                L2DBUS_TRACE_RING_SENT);
+            L2DBUS_TRACE_MSG((L2DBUS_TRC_TRACE, slots[slotIdx].msg));
+            lua_pushnumber(L, serialNum);
+            ++nQueued;
+        }
+        else
+        {
+            lua_pushstring(L, "failed to queue message");
+        }
+        lua_rawseti(L, resultsIdx, slots[slotIdx].itemIdx);
+        dbus_message_unref(slots[slotIdx].msg);
+    }
+
+    l2dbus_free(slots);
+    l2dbus_free(table);
+
+    if ( flush && (0 < nQueued) )
+    {
+        dbus_connection_flush(dbusConn);
+    }
+
+    lua_pushinteger(L, nQueued);
+    lua_insert(L, -2);
+
+    return 2;
+}
@@ -0,0 +1,661 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_buffer.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of a reference counted byte buffer
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "dbus/dbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_buffer.h"
+#include "l2dbus_core.h"
+#include "l2dbus_object.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_transcode.h"
+#include "l2dbus_int64.h"
+#include "l2dbus_uint64.h"
+#include "lauxlib.h"
+
+/**
+ L2DBUS Buffer
+
+ This section describes a L2DBUS Buffer class which holds binary data
+ without copying it into Lua strings or tables.
+
+ A Buffer refers to a reference counted block of bytes. Slices of a Buffer
+ refer to the same bytes so slicing is cheap and the bytes are released
+ once the last Buffer referring to them is collected. A Buffer can be
+ marshalled directly as a byte array ("ay") and byte arrays can be decoded
+ into a (read-only) Buffer by passing the *byteArrayAsBuffer* option to
+ @{l2dbus.Message.getArgs|Message:getArgs} (and related methods). A decoded
+ Buffer keeps the received D-Bus message alive instead of copying its
+ bytes. Integers and doubles can be read (and written) at any offset and
+ the bytes are only converted to a Lua string if @{toString} is called.
+
+ All offsets are zero-based.
+
+ @namespace l2dbus.Buffer
+ */
+
+
+/*
+ * Pushes a new Buffer userdata referring to (part of) the bytes of a store.
+ */
+static l2dbus_Buffer*
+l2dbus_bufferPush
+    (
+    lua_State*          L,
+    l2dbus_BufferStore* store,
+    unsigned char*      data,
+    size_t              len,
+    l2dbus_Bool         readOnly
+    )
+{
+    l2dbus_Buffer* ud;
+
+    ud = (l2dbus_Buffer*)l2dbus_objectNew(L, sizeof(*ud),
+                                        L2DBUS_BUFFER_TYPE_ID);
+    if ( NULL == ud )
+    {
+        luaL_error(L, "Failed to create buffer userdata!");
+    }
+
+    ud->store = store;
+    ud->data = data;
+    ud->len = len;
+    ud->readOnly = readOnly;
+    store->refCount++;
+
+    return ud;
+}
+
+
+/* Drops a reference to the store and frees it with the last one */
+static void
+l2dbus_bufferStoreRelease
+    (
+    l2dbus_BufferStore* store
+    )
+{
+    if ( 0 == --store->refCount )
+    {
+        if ( NULL != store->msg )
+        {
+            dbus_message_unref(store->msg);
+        }
+        l2dbus_free(store);
+    }
+}
+
+
+/**
+ * @brief Creates a Buffer owning a copy of some bytes.
+ *
+ * The Buffer is left on the top of the Lua stack. If no bytes are
+ * provided the buffer is filled with zeros.
+ *
+ * @param [in] L    Lua state.
+ * @param [in] data The bytes to copy (may be NULL).
+ * @param [in] len  The number of bytes.
+ * @return The Buffer userdata.
+ */
+l2dbus_Buffer*
+l2dbus_bufferNew
+    (
+    lua_State*  L,
+    const void* data,
+    size_t      len
+    )
+{
+    l2dbus_BufferStore* store;
+    unsigned char* bytes;
+
+    /* The bytes immediately follow the store */
+    store = (l2dbus_BufferStore*)l2dbus_malloc(sizeof(*store) + len);
+    if ( NULL == store )
+    {
+        luaL_error(L, "Failed to allocate a buffer of %d bytes", (int)len);
+    }
+
+    store->refCount = 0;
+    store->msg = NULL;
+    bytes = (unsigned char*)(store + 1);
+    if ( NULL == data )
+    {
+        memset(bytes, 0, len);
+    }
+    else
+    {
+        memcpy(bytes, data, len);
+    }
+
+    return l2dbus_bufferPush(L, store, bytes, len, L2DBUS_FALSE);
+}
+
+
+/**
+ * @brief Creates a read-only Buffer referring to bytes of a D-Bus message.
+ *
+ * The Buffer holds a reference to the message so the bytes remain valid
+ * as long as the Buffer (or a slice of it) exists. The bytes of a message
+ * that has not been sent (or received) can still move as arguments are
+ * appended so they are copied instead.
+ *
+ * @param [in] L    Lua state.
+ * @param [in] msg  The message containing the bytes.
+ * @param [in] data The bytes within the message.
+ * @param [in] len  The number of bytes.
+ * @return The Buffer userdata.
+ */
+l2dbus_Buffer*
+l2dbus_bufferNewFromMessage
+    (
+    lua_State*          L,
+    struct DBusMessage* msg,
+    const void*         data,
+    size_t              len
+    )
+{
+    l2dbus_BufferStore* store;
+    l2dbus_Buffer* ud;
+
+    if ( 0 == dbus_message_get_serial(msg) )
+    {
+        ud = l2dbus_bufferNew(L, data, len);
+        ud->readOnly = L2DBUS_TRUE;
+        return ud;
+    }
+
+    store = (l2dbus_BufferStore*)l2dbus_malloc(sizeof(*store));
+    if ( NULL == store )
+    {
+        luaL_error(L, "Failed to allocate a buffer");
+    }
+
+    store->refCount = 0;
+    store->msg = dbus_message_ref(msg);
+
+    return l2dbus_bufferPush(L, store, (unsigned char*)data, len,
+                            L2DBUS_TRUE);
+}
+
+
+/**
+ * @brief Checks the (optional) offset and length of a range of the Buffer.
+ *
+ * @param [in]  L       Lua state.
+ * @param [in]  ud      The Buffer.
+ * @param [in]  idx     The stack index of the offset (followed by the length).
+ * @param [out] offset  The offset of the range.
+ * @return The length of the range.
+ */
+static size_t
+l2dbus_bufferCheckRange
+    (
+    lua_State*      L,
+    l2dbus_Buffer*  ud,
+    int             idx,
+    size_t*         offset
+    )
+{
+    lua_Number off = luaL_optnumber(L, idx, 0);
+    lua_Number len;
+
+    luaL_argcheck(L, (off >= 0) && (off <= (lua_Number)ud->len), idx,
+                "offset is out of range");
+    len = luaL_optnumber(L, idx + 1, (lua_Number)ud->len - off);
+    luaL_argcheck(L, (len >= 0) && (off + len <= (lua_Number)ud->len),
+                idx + 1, "length is out of range");
+
+    *offset = (size_t)off;
+
+    return (size_t)len;
+}
+
+
+/**
+ * @brief Checks the D-Bus type code and offset of a typed access.
+ *
+ * @param [in]  L       Lua state.
+ * @param [in]  ud      The Buffer.
+ * @param [in]  idx     The stack index of the offset (followed by the type).
+ * @param [out] dbusType The D-Bus type of the value.
+ * @return A pointer to the bytes of the value.
+ */
+static unsigned char*
+l2dbus_bufferCheckValue
+    (
+    lua_State*      L,
+    l2dbus_Buffer*  ud,
+    int             idx,
+    int*            dbusType
+    )
+{
+    lua_Number off = luaL_checknumber(L, idx);
+    const char* type = luaL_checkstring(L, idx + 1);
+    size_t size;
+
+    *dbusType = type[0];
+    size = (('\0' == type[0]) || ('\0' != type[1])) ? 0 :
+            l2dbus_transcodeFixedTypeSize(*dbusType);
+    luaL_argcheck(L, 0 != size, idx + 1, "expected a fixed-size D-Bus type");
+    luaL_argcheck(L, (off >= 0) &&
+                (off + (lua_Number)size <= (lua_Number)ud->len), idx,
+                "offset is out of range");
+
+    return ud->data + (size_t)off;
+}
+
+
+/**
+ * @brief Converts between host byte order and the requested byte order.
+ *
+ * @param [in]  L       Lua state.
+ * @param [in]  idx     The stack index of the (optional) byte order.
+ * @param [in]  dst     The destination of the bytes.
+ * @param [in]  src     The source of the bytes.
+ * @param [in]  size    The number of bytes.
+ */
+static void
+l2dbus_bufferCopyOrdered
+    (
+    lua_State*      L,
+    int             idx,
+    unsigned char*  dst,
+    const unsigned char* src,
+    size_t          size
+    )
+{
+    const uint16_t probe = 1U;
+    l2dbus_Bool hostLittle = (1U == *(const uint8_t*)&probe);
+    const char* order = luaL_optstring(L, idx, "=");
+    l2dbus_Bool swap;
+    size_t n;
+
+    luaL_argcheck(L, ('\0' != order[0]) && ('\0' == order[1]) &&
+                (NULL != strchr("<>=", order[0])), idx,
+                "expected '<', '>' or '='");
+    swap = (('<' == order[0]) && !hostLittle) ||
+            (('>' == order[0]) && hostLittle);
+
+    for ( n = 0; n < size; ++n )
+    {
+        dst[n] = swap ? src[size - n - 1] : src[n];
+    }
+}
+
+
+/**
+ @function new
+
+ Creates a new Buffer.
+
+ @tparam number|string init The size of a zero filled Buffer or a Lua
+ string to copy into the Buffer.
+ @treturn userdata The (writable) Buffer.
+ */
+static int
+l2dbus_newBuffer
+    (
+    lua_State*  L
+    )
+{
+    const char* data;
+    size_t len;
+    lua_Number size;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( LUA_TSTRING == lua_type(L, 1) )
+    {
+        data = lua_tolstring(L, 1, &len);
+        l2dbus_bufferNew(L, data, len);
+    }
+    else
+    {
+        size = luaL_checknumber(L, 1);
+        luaL_argcheck(L, size >= 0, 1, "size must not be negative");
+        l2dbus_bufferNew(L, NULL, (size_t)size);
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the Buffer userdata.
+ *
+ * This method is called by the Lua VM to reclaim the Buffer userdata.
+ *
+ * @return nil
+ *
+ */
+static int
+l2dbus_bufferDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Buffer* ud = (l2dbus_Buffer*)l2dbus_checkUserData(L, -1,
+                                        L2DBUS_BUFFER_TYPE_ID);
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: buffer (userdata=%p)", ud));
+
+    if ( NULL != ud->store )
+    {
+        l2dbus_bufferStoreRelease(ud->store);
+        ud->store = NULL;
+    }
+
+    return 0;
+}
+
+
+/**
+ * The L2DBUS Buffer class.
+ * @type Buffer
+ */
+
+/**
+ @function len
+ @within Buffer
+
+ Returns the length of the Buffer. The length operator (#) can be used
+ as well.
+
+ @tparam userdata buf The Buffer.
+ @treturn number The length (in bytes).
+ */
+static int
+l2dbus_bufferLen
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Buffer* ud = (l2dbus_Buffer*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_BUFFER_TYPE_ID);
+
+    lua_pushnumber(L, (lua_Number)ud->len);
+
+    return 1;
+}
+
+
+/**
+ @function slice
+ @within Buffer
+
+ Returns a Buffer referring to a range of this Buffer.
+
+ The bytes are not copied: the slice refers to the same bytes (and keeps
+ them alive) so a change made through one is visible through the other.
+
+ @tparam userdata buf The Buffer.
+ @tparam ?number offset The offset of the range. Defaults to zero.
+ @tparam ?number length The length of the range. Defaults to the rest of
+ the Buffer.
+ @treturn userdata The slice.
+ */
+static int
+l2dbus_bufferSlice
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Buffer* ud = (l2dbus_Buffer*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_BUFFER_TYPE_ID);
+    size_t offset;
+    size_t len = l2dbus_bufferCheckRange(L, ud, 2, &offset);
+
+    l2dbus_bufferPush(L, ud->store, ud->data + offset, len, ud->readOnly);
+
+    return 1;
+}
+
+
+/**
+ @function toString
+ @within Buffer
+
+ Copies (a range of) the Buffer into a Lua string.
+
+ @tparam userdata buf The Buffer.
+ @tparam ?number offset The offset of the range. Defaults to zero.
+ @tparam ?number length The length of the range. Defaults to the rest of
+ the Buffer.
+ @treturn string The bytes of the range.
+ */
+static int
+l2dbus_bufferToString
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Buffer* ud = (l2dbus_Buffer*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_BUFFER_TYPE_ID);
+    size_t offset;
+    size_t len = l2dbus_bufferCheckRange(L, ud, 2, &offset);
+
+    lua_pushlstring(L, (const char*)ud->data + offset, len);
+
+    return 1;
+}
+
+
+/**
+ @function get
+ @within Buffer
+
+ Reads a fixed-size value at an offset.
+
+ The type of the value is given by its D-Bus type code: *y* (byte),
+ *b* (boolean), *n* (int16), *q* (uint16), *i* (int32), *u* (uint32),
+ *x* (int64), *t* (uint64) or *d* (double). 64-bit integers are returned
+ as @{l2dbus.Int64|Int64} or @{l2dbus.Uint64|Uint64} values. The offset
+ does not have to be aligned.
+
+ @tparam userdata buf The Buffer.
+ @tparam number offset The offset of the value.
+ @tparam string type The D-Bus type code of the value.
+ @tparam ?string order The byte order: "<" (little-endian), ">"
+ (big-endian) or "=" (host order, the default).
+ @treturn number|bool|userdata The value.
+ */
+static int
+l2dbus_bufferGet
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Buffer* ud = (l2dbus_Buffer*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_BUFFER_TYPE_ID);
+    int dbusType;
+    unsigned char* src = l2dbus_bufferCheckValue(L, ud, 2, &dbusType);
+    union
+    {
+        uint8_t     y;
+        dbus_bool_t b;
+        int16_t     n;
+        uint16_t    q;
+        int32_t     i;
+        uint32_t    u;
+        int64_t     x;
+        uint64_t    t;
+        double      d;
+    } value;
+
+    l2dbus_bufferCopyOrdered(L, 4, (unsigned char*)&value, src,
+                            l2dbus_transcodeFixedTypeSize(dbusType));
+
+    switch ( dbusType )
+    {
+        case DBUS_TYPE_BYTE:
+            lua_pushnumber(L, value.y);
+            break;
+        case DBUS_TYPE_BOOLEAN:
+            lua_pushboolean(L, value.b);
+            break;
+        case DBUS_TYPE_INT16:
+            lua_pushnumber(L, value.n);
+            break;
+        case DBUS_TYPE_UINT16:
+            lua_pushnumber(L, value.q);
+            break;
+        case DBUS_TYPE_INT32:
+            lua_pushnumber(L, value.i);
+            break;
+        case DBUS_TYPE_UINT32:
+            lua_pushnumber(L, value.u);
+            break;
+        case DBUS_TYPE_INT64:
+            l2dbus_int64Push(L, value.x, L2DBUS_FALSE);
+            break;
+        case DBUS_TYPE_UINT64:
+            l2dbus_uint64Push(L, value.t, L2DBUS_FALSE);
+            break;
+        default:
+            lua_pushnumber(L, value.d);
+            break;
+    }
+
+    return 1;
+}
+
+
+/**
+ @function set
+ @within Buffer
+
+ Writes a fixed-size value at an offset.
+
+ The type codes are the same as for @{get}. 64-bit integers may be given
+ as Lua numbers or as @{l2dbus.Int64|Int64}/@{l2dbus.Uint64|Uint64}
+ values. A Lua error is thrown if the Buffer is read-only.
+
+ @tparam userdata buf The Buffer.
+ @tparam number offset The offset of the value.
+ @tparam string type The D-Bus type code of the value.
+ @tparam number|bool|userdata value The value to write.
+ @tparam ?string order The byte order: "<" (little-endian), ">"
+ (big-endian) or "=" (host order, the default).
+ */
+static int
+l2dbus_bufferSet
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Buffer* ud = (l2dbus_Buffer*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_BUFFER_TYPE_ID);
+    int dbusType;
+    unsigned char* dst = l2dbus_bufferCheckValue(L, ud, 2, &dbusType);
+    unsigned char value[8];
+
+    if ( ud->readOnly )
+    {
+        luaL_error(L, "buffer is read-only");
+    }
+
+    luaL_argcheck(L, l2dbus_transcodeToFixedValue(L, 4, dbusType, value), 4,
+                "cannot convert value to the D-Bus type");
+    l2dbus_bufferCopyOrdered(L, 5, dst, value,
+                            l2dbus_transcodeFixedTypeSize(dbusType));
+
+    return 0;
+}
+
+
+/**
+ @function isReadOnly
+ @within Buffer
+
+ Tests whether the Buffer is read-only. Buffers decoded from a message
+ (and their slices) are read-only.
+
+ @tparam userdata buf The Buffer.
+ @treturn bool Returns **true** if read-only, **false** otherwise.
+ */
+static int
+l2dbus_bufferIsReadOnly
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Buffer* ud = (l2dbus_Buffer*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_BUFFER_TYPE_ID);
+
+    lua_pushboolean(L, ud->readOnly);
+
+    return 1;
+}
+
+
+/*
+ * Define the methods of the Buffer class
+ */
+static const luaL_Reg l2dbus_bufferMetaTable[] = {
+    {"len", l2dbus_bufferLen},
+    {"slice", l2dbus_bufferSlice},
+    {"toString", l2dbus_bufferToString},
+    {"get", l2dbus_bufferGet},
+    {"set", l2dbus_bufferSet},
+    {"isReadOnly", l2dbus_bufferIsReadOnly},
+    {"__len", l2dbus_bufferLen},
+    {"__gc", l2dbus_bufferDispose},
+    {NULL, NULL},
+};
+
+
+/**
+ * @brief Creates the Buffer sub-module.
+ *
+ * This function creates a metatable entry for the Buffer userdata
+ * and simulates opening the Buffer sub-module.
+ *
+ * @return A table defining the Buffer sub-module.
+ */
+void
+l2dbus_openBuffer
+    (
+    lua_State*  L
+    )
+{
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_BUFFER_TYPE_ID,
+            l2dbus_bufferMetaTable));
+    lua_newtable(L);
+    lua_pushcfunction(L, l2dbus_newBuffer);
+    lua_setfield(L, -2, "new");
+}
@@ -0,0 +1,70 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_buffer.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of a reference counted byte buffer.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_BUFFER_H_
+#define L2DBUS_BUFFER_H_
+
+#include <stddef.h>
+#include "lua.h"
+#include "l2dbus_types.h"
+
+/* Forward declarations */
+struct DBusMessage;
+
+/*
+ * The bytes shared by a Buffer and all of its slices. The bytes are either
+ * owned by the store or belong to a D-Bus message held by the store.
+ */
+typedef struct l2dbus_BufferStore
+{
+    unsigned            refCount;
+    /* The message holding the bytes (NULL if owned by the store) */
+    struct DBusMessage* msg;
+} l2dbus_BufferStore;
+
+typedef struct l2dbus_Buffer
+{
+    l2dbus_BufferStore* store;
+    unsigned char*      data;
+    size_t              len;
+    l2dbus_Bool         readOnly;
+} l2dbus_Buffer;
+
+l2dbus_Buffer* l2dbus_bufferNew(lua_State* L, const void* data, size_t len);
+l2dbus_Buffer* l2dbus_bufferNewFromMessage(lua_State* L,
+                                            struct DBusMessage* msg,
+                                            const void* data, size_t len);
+void l2dbus_openBuffer(lua_State* L);
+
+
+#endif /* Guard for L2DBUS_BUFFER_H_ */
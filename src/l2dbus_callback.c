@@ -35,23 +35,23 @@
 #include "l2dbus_compat.h"
 #include "l2dbus_callback.h"
 #include "l2dbus_debug.h"
+#include "l2dbus_context.h"
 #include "lauxlib.h"
 
-/* The Lua thread used to run all callbacks */
-static lua_State*  gCallbackThread = NULL;
-static int gCallbackRef = LUA_NOREF;
-
-
+/* The Lua thread used to run all callbacks is kept in the module context */
 void
 l2dbus_callbackConfigure
     (
     lua_State*   L
     )
 {
-    if ( NULL == gCallbackThread )
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
+    assert( NULL != ctx );
+    if ( NULL == ctx->callbackThread )
     {
-        gCallbackThread = lua_newthread(L);
-        gCallbackRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        ctx->callbackThread = lua_newthread(L);
+        ctx->callbackRef = luaL_ref(L, LUA_REGISTRYINDEX);
     }
 }
 
@@ -62,10 +62,13 @@ l2dbus_callbackShutdown
     lua_State*   L
     )
 {
-    if ( LUA_NOREF != gCallbackRef )
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
+    if ( (NULL != ctx) && (LUA_NOREF != ctx->callbackRef) )
     {
-        luaL_unref(L, LUA_REGISTRYINDEX, gCallbackRef);
-        gCallbackRef = LUA_NOREF;
+        luaL_unref(L, LUA_REGISTRYINDEX, ctx->callbackRef);
+        ctx->callbackRef = LUA_NOREF;
+        ctx->callbackThread = NULL;
     }
 }
 
@@ -73,7 +76,9 @@ l2dbus_callbackShutdown
 lua_State*
 l2dbus_callbackGetThread(void)
 {
-    return gCallbackThread;
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+
+    return (NULL != ctx) ? ctx->callbackThread : NULL;
 }
 
 
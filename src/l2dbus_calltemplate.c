@@ -0,0 +1,363 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_calltemplate.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of precompiled D-Bus method call templates.
+ *===========================================================================
+ */
+#include <string.h>
+#include "dbus/dbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_calltemplate.h"
+#include "l2dbus_sigplan.h"
+#include "l2dbus_message.h"
+#include "l2dbus_transcode.h"
+#include "l2dbus_core.h"
+#include "l2dbus_object.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_dbuscompat.h"
+#include "lauxlib.h"
+
+
+/*
+ * Creates the template userdata (left on the top of the stack) which takes
+ * ownership of the header. The optional signature is at sigIdx.
+ */
+static void
+l2dbus_callTemplateCreate
+    (
+    lua_State*      L,
+    DBusMessage*    header,
+    int             sigIdx
+    )
+{
+    l2dbus_CallTemplate* ud;
+    l2dbus_SigPlan* plan = NULL;
+    int opIdx;
+
+    ud = (l2dbus_CallTemplate*)l2dbus_objectNew(L, sizeof(*ud),
+                                            L2DBUS_CALL_TEMPLATE_TYPE_ID);
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Call template userdata=%p", ud));
+
+    /* The userdata owns the header so it is released even on error */
+    ud->header = header;
+
+    if ( !lua_isnoneornil(L, sigIdx) )
+    {
+        plan = l2dbus_sigPlanCheck(L, sigIdx);
+    }
+
+    if ( (NULL != plan) && (0 < plan->nOps) )
+    {
+        ud->plan = l2dbus_sigPlanRef(plan);
+
+        /* Count the complete types at the top level of the signature */
+        for ( opIdx = 0; opIdx < plan->nOps; opIdx = plan->ops[opIdx].next )
+        {
+            ud->nArgs++;
+        }
+    }
+}
+
+
+/**
+ @function newCallTemplate
+ @within l2dbus.Message
+
+ Creates a reusable template for D-Bus method call messages.
+
+ The message header (destination, path, interface and method) is built
+ and validated once and the input signature is compiled once. Messages
+ created from the template with @{l2dbus.CallTemplate.newCall|newCall} copy
+ the prebuilt header and append all their arguments in a single call.
+
+ @tparam ?string|nil destination The bus name that the message should be
+ sent to. May be **nil**.
+ @tparam string path The D-Bus object path the message should be sent to.
+ @tparam ?string|nil interface The interface to invoke the method on. May
+ be **nil**.
+ @tparam string member The member name to call.
+ @tparam ?string|userdata signature The input signature of the method as a
+ string or a handle returned by @{compileSignature}. If omitted the method
+ takes no arguments.
+ @treturn userdata A method call template.
+ */
+int
+l2dbus_callTemplateNew
+    (
+    lua_State*  L
+    )
+{
+    const char* destination = NULL;
+    const char* path;
+    const char* interface = NULL;
+    const char* member;
+    DBusMessage* header;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( !lua_isnoneornil(L, 1) )
+    {
+        destination = luaL_checkstring(L, 1);
+    }
+    path = luaL_checkstring(L, 2);
+    if ( !lua_isnoneornil(L, 3) )
+    {
+        interface = luaL_checkstring(L, 3);
+    }
+    member = luaL_checkstring(L, 4);
+
+    if ( (NULL != destination) && !l2dbus_validateBusName(destination) )
+    {
+        luaL_error(L, "invalid D-Bus bus name (%s)", destination);
+    }
+    if ( !l2dbus_validatePath(path) )
+    {
+        luaL_error(L, "invalid D-Bus object path (%s)", path);
+    }
+    if ( (NULL != interface) && !l2dbus_validateInterface(interface) )
+    {
+        luaL_error(L, "invalid D-Bus interface name (%s)", interface);
+    }
+    if ( !l2dbus_validateMember(member) )
+    {
+        luaL_error(L, "invalid D-Bus member name (%s)", member);
+    }
+
+    header = dbus_message_new_method_call(destination, path, interface,
+                                        member);
+    if ( NULL == header )
+    {
+        luaL_error(L, "failed to allocate D-Bus method call message");
+    }
+
+    l2dbus_callTemplateCreate(L, header, 5);
+    return 1;
+}
+
+
+/**
+ @function newTemplate
+ @within l2dbus.Message
+
+ Creates a reusable template from the header of an existing message.
+
+ Any type of message may serve as the template (e.g. a signal built with
+ @{newSignal}) so the same header can be stamped out for every send. Only
+ the header of *msg* is copied (see @{l2dbus.Message.clone|clone}) and
+ later changes to *msg* do not affect the template. Messages are created
+ from the template with @{l2dbus.CallTemplate.newMessage|newMessage}.
+
+ @tparam userdata msg The message whose header is used by the template.
+ @tparam ?string|userdata signature The signature of the arguments of the
+ messages as a string or a handle returned by @{compileSignature}. If
+ omitted the messages carry no arguments.
+ @treturn userdata A message template.
+ */
+int
+l2dbus_callTemplateFromMessage
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd;
+    DBusMessage* header;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = (l2dbus_Message*)l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+    luaL_argcheck(L, NULL != msgUd->msg, 1,
+                "reference to D-Bus message no longer exists");
+
+    header = l2dbus_messageCopyHeader(msgUd->msg);
+    if ( NULL == header )
+    {
+        luaL_error(L, "failed to copy D-Bus message header");
+    }
+
+    l2dbus_callTemplateCreate(L, header, 2);
+    return 1;
+}
+
+
+/**
+ * The L2DBUS CallTemplate class.
+ * @type CallTemplate
+ */
+
+/**
+ @function newCall
+ @within l2dbus.CallTemplate
+
+ Creates a method call message from the template.
+
+ @tparam userdata template The method call template.
+ @param ... The method arguments. There must be exactly one argument for
+ every complete type in the template's input signature.
+ @treturn userdata Message userdata object for a method call.
+ */
+static int
+l2dbus_callTemplateNewCall
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_CallTemplate* ud;
+    DBusMessage* dbusMsg;
+    int nArgs;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    ud = (l2dbus_CallTemplate*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_CALL_TEMPLATE_TYPE_ID);
+    nArgs = lua_gettop(L) - 1;
+    if ( nArgs != ud->nArgs )
+    {
+        luaL_error(L, "method argument mis-match for %s: provided=%d needed=%d",
+                    dbus_message_get_member(ud->header), nArgs, ud->nArgs);
+    }
+
+    dbusMsg = dbus_message_copy(ud->header);
+    if ( NULL == dbusMsg )
+    {
+        luaL_error(L, "failed to allocate D-Bus method call message");
+    }
+
+    /* The wrapper owns the message so it is released even on error */
+    l2dbus_messageWrap(L, dbusMsg, L2DBUS_FALSE);
+
+    if ( 0 < nArgs )
+    {
+        l2dbus_transcodeLuaArgsToDbusByPlan(L, dbusMsg, 2, nArgs, ud->plan);
+    }
+
+    return 1;
+}
+
+
+/**
+ @function newMessage
+ @within l2dbus.CallTemplate
+
+ Creates a message from the template.
+
+ An alias of @{newCall} which reads better for templates of signals and
+ other messages created by @{l2dbus.Message.newTemplate|newTemplate}.
+
+ @tparam userdata template The message template.
+ @param ... The message arguments (see @{newCall}).
+ @treturn userdata Message userdata object with the template's header.
+ */
+
+
+/**
+ @function signature
+ @within l2dbus.CallTemplate
+
+ Returns the input signature of the template.
+
+ @tparam userdata template The method call template.
+ @treturn string The input signature (the empty string if the method takes
+ no arguments).
+ */
+static int
+l2dbus_callTemplateGetSignature
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_CallTemplate* ud = (l2dbus_CallTemplate*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_CALL_TEMPLATE_TYPE_ID);
+    lua_pushstring(L, (NULL != ud->plan) ? ud->plan->signature : "");
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the call template userdata.
+ *
+ * @return nil
+ */
+static int
+l2dbus_callTemplateDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_CallTemplate* ud = (l2dbus_CallTemplate*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_CALL_TEMPLATE_TYPE_ID);
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: call template (userdata=%p)", ud));
+
+    if ( NULL != ud->header )
+    {
+        dbus_message_unref(ud->header);
+        ud->header = NULL;
+    }
+
+    if ( NULL != ud->plan )
+    {
+        l2dbus_sigPlanUnref(ud->plan);
+        ud->plan = NULL;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Define the methods of the call template
+ */
+static const luaL_Reg l2dbus_callTemplateMetaTable[] = {
+    {"newCall", l2dbus_callTemplateNewCall},
+    {"newMessage", l2dbus_callTemplateNewCall},
+    {"signature", l2dbus_callTemplateGetSignature},
+    {"__gc", l2dbus_callTemplateDispose},
+    {NULL, NULL},
+};
+
+
+/**
+ * @brief Creates the metatable for method call templates.
+ *
+ * Templates are created via l2dbus.Message.newCallTemplate (or
+ * l2dbus.Message.newTemplate) so there is no separate sub-module table.
+ */
+void
+l2dbus_openCallTemplate
+    (
+    lua_State*  L
+    )
+{
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_CALL_TEMPLATE_TYPE_ID,
+            l2dbus_callTemplateMetaTable));
+}
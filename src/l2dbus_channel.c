@@ -0,0 +1,839 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_channel.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the inter-state message Channel.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <assert.h>
+#include "l2dbus_compat.h"
+#include "l2dbus_channel.h"
+#include "l2dbus_core.h"
+#include "l2dbus_object.h"
+#include "l2dbus_message.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "lualib.h"
+#include "lauxlib.h"
+
+/**
+ L2DBUS Channel
+
+ This section describes a Lua Channel class.
+
+ A Channel hands D-Bus messages from one Lua state to another, typically
+ running in a different thread. It is the building block of a worker pool
+ where one state receives messages on its connection and fans them out to
+ a set of worker states, each with its own @{l2dbus.Dispatcher|Dispatcher}
+ and private @{l2dbus.Connection|Connection}, so handlers can use more than
+ one core.
+
+ Channels are identified by name and every Lua state that opens the same
+ name is attached to the same queue. The queue itself is a lock-free,
+ fixed capacity ring that supports a **single** producer and a **single**
+ consumer. Fanning out to several workers is therefore done with one
+ Channel per worker. The consumer is woken up through a pollable
+ descriptor (see @{getFd}) that is meant to be monitored by a
+ @{l2dbus.Watch|Watch} on its Dispatcher.
+
+ Messages are passed by reference and are **not** copied. Once a message
+ has been pushed onto a Channel the producer must not use it any further
+ and a message must not be pushed onto more than one Channel.
+
+ @namespace l2dbus.Channel
+ */
+
+/* Owner of the table of named channels */
+static pthread_mutex_t gChannelLock = PTHREAD_MUTEX_INITIALIZER;
+static l2dbus_ChannelShared* gChannels = NULL;
+
+/* The arguments handed to a worker thread */
+typedef struct l2dbus_WorkerArgs
+{
+    char*   script;
+    char*   path;
+    char*   cpath;
+    int     nArgs;
+    char**  args;
+} l2dbus_WorkerArgs;
+
+
+/**
+ * @brief Signals the consumer that the channel has (new) messages.
+ *
+ * @param [in] shared The shared channel state.
+ */
+static void
+l2dbus_channelSignal
+    (
+    l2dbus_ChannelShared*   shared
+    )
+{
+    const char token = 1;
+    ssize_t n;
+
+    do
+    {
+        n = write(shared->sigFd[1], &token, sizeof(token));
+    }
+    while ( (n < 0) && (EINTR == errno) );
+
+    /* A full pipe means the consumer has already been signaled */
+}
+
+
+/**
+ * @brief Clears any pending signal of the channel.
+ *
+ * @param [in] shared The shared channel state.
+ */
+static void
+l2dbus_channelClearSignal
+    (
+    l2dbus_ChannelShared*   shared
+    )
+{
+    char buf[64];
+    ssize_t n;
+
+    do
+    {
+        n = read(shared->sigFd[0], buf, sizeof(buf));
+    }
+    while ( (n > 0) || ((n < 0) && (EINTR == errno)) );
+}
+
+
+/**
+ * @brief Frees the shared state of a channel.
+ *
+ * Any messages still queued on the channel are unreferenced.
+ *
+ * @param [in] shared The shared channel state.
+ */
+static void
+l2dbus_channelFreeShared
+    (
+    l2dbus_ChannelShared*   shared
+    )
+{
+    unsigned idx;
+
+    if ( NULL != shared )
+    {
+        if ( NULL != shared->ring )
+        {
+            for ( idx = shared->head; idx != shared->tail; ++idx )
+            {
+                dbus_message_unref(shared->ring[idx & shared->mask]);
+            }
+            l2dbus_free(shared->ring);
+        }
+
+        if ( shared->sigFd[0] >= 0 )
+        {
+            close(shared->sigFd[0]);
+        }
+
+        if ( shared->sigFd[1] >= 0 )
+        {
+            close(shared->sigFd[1]);
+        }
+
+        l2dbus_free(shared->name);
+        l2dbus_free(shared);
+    }
+}
+
+
+/**
+ * @brief Allocates the shared state of a new channel.
+ *
+ * @param [in] name     The name of the channel.
+ * @param [in] capacity The capacity of the channel (a power of two).
+ * @return The shared state or NULL if it could not be allocated.
+ */
+static l2dbus_ChannelShared*
+l2dbus_channelNewShared
+    (
+    const char* name,
+    unsigned    capacity
+    )
+{
+    l2dbus_ChannelShared* shared;
+    l2dbus_Bool failed = L2DBUS_FALSE;
+    int idx;
+
+    shared = (l2dbus_ChannelShared*)l2dbus_calloc(1, sizeof(*shared));
+    if ( NULL != shared )
+    {
+        shared->sigFd[0] = -1;
+        shared->sigFd[1] = -1;
+        shared->mask = capacity - 1U;
+        shared->name = l2dbus_strDup(name);
+        shared->ring = (DBusMessage**)l2dbus_calloc(capacity,
+                                                sizeof(*shared->ring));
+        failed = (NULL == shared->name) || (NULL == shared->ring) ||
+                (0 != pipe(shared->sigFd));
+
+        for ( idx = 0; !failed && (idx < 2); ++idx )
+        {
+            failed = (0 != fcntl(shared->sigFd[idx], F_SETFL,
+                            fcntl(shared->sigFd[idx], F_GETFL) | O_NONBLOCK)) ||
+                    (0 != fcntl(shared->sigFd[idx], F_SETFD, FD_CLOEXEC));
+        }
+
+        if ( failed )
+        {
+            l2dbus_channelFreeShared(shared);
+            shared = NULL;
+        }
+    }
+
+    return shared;
+}
+
+
+/**
+ * @brief Drops a reference to the shared state of a channel.
+ *
+ * The shared state is freed when the last Lua state detaches from it.
+ *
+ * @param [in] shared The shared channel state.
+ */
+static void
+l2dbus_channelRelease
+    (
+    l2dbus_ChannelShared*   shared
+    )
+{
+    l2dbus_ChannelShared** cur;
+    l2dbus_Bool lastRef = L2DBUS_FALSE;
+
+    pthread_mutex_lock(&gChannelLock);
+    if ( 0U == --shared->refCount )
+    {
+        lastRef = L2DBUS_TRUE;
+        for ( cur = &gChannels; NULL != *cur; cur = &(*cur)->next )
+        {
+            if ( *cur == shared )
+            {
+                *cur = shared->next;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&gChannelLock);
+
+    if ( lastRef )
+    {
+        l2dbus_channelFreeShared(shared);
+    }
+}
+
+
+/**
+ @function open
+
+ Opens (or attaches to) a named Channel.
+
+ The first Lua state to open a name creates the Channel with the given
+ capacity. Later calls with the same name, from any Lua state in the
+ process, attach to the existing Channel and ignore the capacity.
+
+ @tparam string name The name of the Channel.
+ @tparam ?number capacity The maximum number of messages the Channel can
+ hold. It is rounded up to a power of two. Defaults to 1024.
+ @treturn userdata The Channel userdata object.
+ */
+int
+l2dbus_openChannelByName
+    (
+    lua_State*  L
+    )
+{
+    const char* name = luaL_checkstring(L, 1);
+    lua_Number reqCapacity = luaL_optnumber(L, 2,
+                                    L2DBUS_CHANNEL_DEFAULT_CAPACITY);
+    unsigned capacity = 1U;
+    l2dbus_ChannelShared* shared;
+    l2dbus_Channel* chanUd;
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Open: channel (%s)", name));
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( (reqCapacity < 1) || (reqCapacity > L2DBUS_CHANNEL_MAX_CAPACITY) )
+    {
+        luaL_error(L, "Channel capacity must be in the range [1, %d]",
+                    (int)L2DBUS_CHANNEL_MAX_CAPACITY);
+    }
+
+    while ( capacity < (unsigned)reqCapacity )
+    {
+        capacity <<= 1;
+    }
+
+    /* Messages will be referenced from more than one thread */
+    if ( !dbus_threads_init_default() )
+    {
+        luaL_error(L, "Failed to initialize D-Bus thread support");
+    }
+
+    chanUd = (l2dbus_Channel*)l2dbus_objectNew(L, sizeof(*chanUd),
+                                                L2DBUS_CHANNEL_TYPE_ID);
+    if ( NULL == chanUd )
+    {
+        luaL_error(L, "Failed to create Channel userdata!");
+    }
+
+    pthread_mutex_lock(&gChannelLock);
+    for ( shared = gChannels; NULL != shared; shared = shared->next )
+    {
+        if ( 0 == strcmp(shared->name, name) )
+        {
+            break;
+        }
+    }
+
+    if ( NULL == shared )
+    {
+        shared = l2dbus_channelNewShared(name, capacity);
+        if ( NULL != shared )
+        {
+            shared->next = gChannels;
+            gChannels = shared;
+        }
+    }
+
+    if ( NULL != shared )
+    {
+        shared->refCount++;
+    }
+    pthread_mutex_unlock(&gChannelLock);
+
+    if ( NULL == shared )
+    {
+        luaL_error(L, "Failed to allocate Channel '%s'", name);
+    }
+
+    chanUd->shared = shared;
+
+    return 1;
+}
+
+
+/**
+ * @brief Returns the Channel userdata at the given index.
+ *
+ * A Lua error is thrown if the Channel has already been closed.
+ */
+static l2dbus_Channel*
+l2dbus_channelCheck
+    (
+    lua_State*  L,
+    int         idx
+    )
+{
+    l2dbus_Channel* chanUd = (l2dbus_Channel*)l2dbus_checkUserData(L, idx,
+                                                L2DBUS_CHANNEL_TYPE_ID);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( NULL == chanUd->shared )
+    {
+        luaL_error(L, "Channel has been closed");
+    }
+
+    return chanUd;
+}
+
+
+/**
+ * A Channel class.
+ * @type Channel
+ */
+
+
+/**
+ @function push
+ @within Channel
+
+ Pushes a message onto the Channel.
+
+ Only a single Lua state may push messages onto a given Channel.
+
+ @tparam userdata chan The Channel instance.
+ @tparam userdata msg The @{l2dbus.Message|Message} to hand off.
+ @treturn bool Returns **true** if the message was queued or **false** if
+ the Channel is full.
+ */
+static int
+l2dbus_channelPush
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Channel* chanUd = l2dbus_channelCheck(L, 1);
+    l2dbus_Message* msgUd = (l2dbus_Message*)l2dbus_checkUserData(L, 2,
+                                                L2DBUS_MESSAGE_TYPE_ID);
+    l2dbus_ChannelShared* shared = chanUd->shared;
+    unsigned head;
+    unsigned tail;
+
+    if ( NULL == msgUd->msg )
+    {
+        luaL_error(L, "Cannot push an invalid message");
+    }
+
+    tail = __atomic_load_n(&shared->tail, __ATOMIC_RELAXED);
+    head = __atomic_load_n(&shared->head, __ATOMIC_SEQ_CST);
+    if ( (tail - head) > shared->mask )
+    {
+        lua_pushboolean(L, L2DBUS_FALSE);
+    }
+    else
+    {
+        shared->ring[tail & shared->mask] = dbus_message_ref(msgUd->msg);
+        __atomic_store_n(&shared->tail, tail + 1U, __ATOMIC_SEQ_CST);
+
+        /* If the consumer has caught up it may be waiting for a signal */
+        if ( __atomic_load_n(&shared->head, __ATOMIC_SEQ_CST) == tail )
+        {
+            l2dbus_channelSignal(shared);
+        }
+        lua_pushboolean(L, L2DBUS_TRUE);
+    }
+
+    return 1;
+}
+
+
+/**
+ @function pop
+ @within Channel
+
+ Pops the oldest message off the Channel.
+
+ Only a single Lua state may pop messages from a given Channel. The
+ consumer should pop messages until **nil** is returned each time its
+ @{getFd|descriptor} becomes readable.
+
+ @tparam userdata chan The Channel instance.
+ @treturn ?userdata|nil The next @{l2dbus.Message|Message} or **nil** if the
+ Channel is empty.
+ */
+static int
+l2dbus_channelPop
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Channel* chanUd = l2dbus_channelCheck(L, 1);
+    l2dbus_ChannelShared* shared = chanUd->shared;
+    DBusMessage* msg;
+    unsigned head;
+    unsigned tail;
+
+    head = __atomic_load_n(&shared->head, __ATOMIC_RELAXED);
+    tail = __atomic_load_n(&shared->tail, __ATOMIC_SEQ_CST);
+    if ( head == tail )
+    {
+        /* Clear the signal before checking one last time so a message
+         * pushed in between is either seen now or signaled again.
+         */
+        l2dbus_channelClearSignal(shared);
+        tail = __atomic_load_n(&shared->tail, __ATOMIC_SEQ_CST);
+    }
+
+    if ( head == tail )
+    {
+        lua_pushnil(L);
+    }
+    else
+    {
+        msg = shared->ring[head & shared->mask];
+        shared->ring[head & shared->mask] = NULL;
+        __atomic_store_n(&shared->head, head + 1U, __ATOMIC_SEQ_CST);
+
+        /* The reference taken by the producer is handed to the wrapper */
+        if ( NULL == l2dbus_messageWrap(L, msg, L2DBUS_FALSE) )
+        {
+            dbus_message_unref(msg);
+            luaL_error(L, "Failed to create Message userdata!");
+        }
+    }
+
+    return 1;
+}
+
+
+/**
+ @function count
+ @within Channel
+
+ Returns the number of messages queued on the Channel.
+
+ @tparam userdata chan The Channel instance.
+ @treturn number The number of queued messages.
+ */
+static int
+l2dbus_channelCount
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Channel* chanUd = l2dbus_channelCheck(L, 1);
+    l2dbus_ChannelShared* shared = chanUd->shared;
+
+    lua_pushnumber(L, (lua_Number)(
+                    __atomic_load_n(&shared->tail, __ATOMIC_SEQ_CST) -
+                    __atomic_load_n(&shared->head, __ATOMIC_SEQ_CST)));
+
+    return 1;
+}
+
+
+/**
+ @function capacity
+ @within Channel
+
+ Returns the maximum number of messages the Channel can hold.
+
+ @tparam userdata chan The Channel instance.
+ @treturn number The capacity of the Channel.
+ */
+static int
+l2dbus_channelCapacity
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Channel* chanUd = l2dbus_channelCheck(L, 1);
+
+    lua_pushnumber(L, (lua_Number)chanUd->shared->mask + 1);
+
+    return 1;
+}
+
+
+/**
+ @function getName
+ @within Channel
+
+ Returns the name of the Channel.
+
+ @tparam userdata chan The Channel instance.
+ @treturn string The name of the Channel.
+ */
+static int
+l2dbus_channelGetName
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Channel* chanUd = l2dbus_channelCheck(L, 1);
+
+    lua_pushstring(L, chanUd->shared->name);
+
+    return 1;
+}
+
+
+/**
+ @function getFd
+ @within Channel
+
+ Returns the descriptor used to signal the consumer.
+
+ The descriptor becomes readable when messages are pushed onto an empty
+ Channel. It should be monitored by a @{l2dbus.Watch|Watch} for
+ @{l2dbus.Watch.READ|READ} events whose handler @{pop|pops} messages until
+ the Channel is empty. The descriptor is owned by the Channel and must not
+ be closed.
+
+ @tparam userdata chan The Channel instance.
+ @treturn number The (pollable) file descriptor.
+ */
+static int
+l2dbus_channelGetFd
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Channel* chanUd = l2dbus_channelCheck(L, 1);
+
+    lua_pushinteger(L, chanUd->shared->sigFd[0]);
+
+    return 1;
+}
+
+
+/**
+ * @brief The entry point of a worker thread.
+ *
+ * Runs the worker script in a new Lua state and closes the state once the
+ * script returns.
+ *
+ * @param [in] data The worker arguments (which are freed on exit).
+ * @return Always NULL.
+ */
+static void*
+l2dbus_channelWorkerMain
+    (
+    void*   data
+    )
+{
+    l2dbus_WorkerArgs* args = (l2dbus_WorkerArgs*)data;
+    lua_State* L = luaL_newstate();
+    int idx;
+
+    if ( NULL == L )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Failed to create worker Lua state"));
+    }
+    else
+    {
+        luaL_openlibs(L);
+
+        /* Workers search for modules in the same places as their parent */
+        lua_getglobal(L, "package");
+        lua_pushstring(L, args->path);
+        lua_setfield(L, -2, "path");
+        lua_pushstring(L, args->cpath);
+        lua_setfield(L, -2, "cpath");
+        lua_pop(L, 1);
+
+        lua_createtable(L, args->nArgs, 1);
+        lua_pushstring(L, args->script);
+        lua_rawseti(L, -2, 0);
+        for ( idx = 0; idx < args->nArgs; ++idx )
+        {
+            lua_pushstring(L, args->args[idx]);
+            lua_rawseti(L, -2, idx + 1);
+        }
+        lua_setglobal(L, "arg");
+
+        if ( (0 != luaL_loadfile(L, args->script)) ||
+            (0 != lua_pcall(L, 0, 0, 0)) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Worker (%s) failed: %s",
+                        args->script, lua_tostring(L, -1)));
+        }
+        lua_close(L);
+    }
+
+    for ( idx = 0; idx < args->nArgs; ++idx )
+    {
+        l2dbus_free(args->args[idx]);
+    }
+    l2dbus_free(args->args);
+    l2dbus_free(args->script);
+    l2dbus_free(args->path);
+    l2dbus_free(args->cpath);
+    l2dbus_free(args);
+
+    return NULL;
+}
+
+
+/**
+ @function spawn
+
+ Runs a Lua script in a new Lua state on its own thread.
+
+ The script is started in a fresh Lua state (with the standard libraries
+ opened and the *package.path* and *package.cpath* of the caller) on a
+ detached thread. The string arguments are available to the script in the
+ global *arg* table, with the script name at index zero. A worker would
+ usually @{open} the Channel(s) it was given by name, create its own
+ Dispatcher and private Connection and run until it is told to stop. The
+ thread exits when the script returns.
+
+ @tparam string script The path of the Lua script to run.
+ @tparam ?string ... Optional string (or number) arguments for the script.
+ @treturn bool Returns **true** if the worker thread was started.
+ */
+static int
+l2dbus_channelSpawn
+    (
+    lua_State*  L
+    )
+{
+    const char* script = luaL_checkstring(L, 1);
+    int nArgs = lua_gettop(L) - 1;
+    l2dbus_WorkerArgs* args;
+    l2dbus_Bool failed;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int idx;
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    for ( idx = 0; idx < nArgs; ++idx )
+    {
+        luaL_checkstring(L, idx + 2);
+    }
+
+    /* Messages will be referenced from more than one thread */
+    if ( !dbus_threads_init_default() )
+    {
+        luaL_error(L, "Failed to initialize D-Bus thread support");
+    }
+
+    args = (l2dbus_WorkerArgs*)l2dbus_calloc(1, sizeof(*args));
+    if ( NULL == args )
+    {
+        luaL_error(L, "Failed to allocate worker arguments");
+    }
+
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "path");
+    args->path = l2dbus_strDup(luaL_optstring(L, -1, ""));
+    lua_getfield(L, -2, "cpath");
+    args->cpath = l2dbus_strDup(luaL_optstring(L, -1, ""));
+    lua_pop(L, 3);
+
+    args->script = l2dbus_strDup(script);
+    args->args = (char**)l2dbus_calloc(nArgs + 1, sizeof(*args->args));
+    failed = (NULL == args->path) || (NULL == args->cpath) ||
+            (NULL == args->script) || (NULL == args->args);
+    for ( idx = 0; !failed && (idx < nArgs); ++idx )
+    {
+        args->args[idx] = l2dbus_strDup(lua_tostring(L, idx + 2));
+        failed = (NULL == args->args[idx]);
+        args->nArgs += failed ? 0 : 1;
+    }
+
+    if ( !failed )
+    {
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        failed = (0 != pthread_create(&thread, &attr,
+                                    l2dbus_channelWorkerMain, args));
+        pthread_attr_destroy(&attr);
+    }
+
+    if ( failed )
+    {
+        for ( idx = 0; idx < args->nArgs; ++idx )
+        {
+            l2dbus_free(args->args[idx]);
+        }
+        l2dbus_free(args->args);
+        l2dbus_free(args->script);
+        l2dbus_free(args->path);
+        l2dbus_free(args->cpath);
+        l2dbus_free(args);
+        luaL_error(L, "Failed to start worker (%s)", script);
+    }
+
+    lua_pushboolean(L, L2DBUS_TRUE);
+
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the Channel userdata.
+ *
+ * This method is called by the Lua VM to detach from the Channel. The
+ * Channel itself is freed once the last attached Lua state has detached.
+ *
+ * @return nil
+ */
+static int
+l2dbus_channelDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Channel* chanUd = (l2dbus_Channel*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CHANNEL_TYPE_ID);
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: channel (userdata=%p)", chanUd));
+
+    if ( NULL != chanUd->shared )
+    {
+        l2dbus_channelRelease(chanUd->shared);
+        chanUd->shared = NULL;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Define the methods of the Channel
+ */
+static const luaL_Reg l2dbus_channelMetaTable[] = {
+    {"push", l2dbus_channelPush},
+    {"pop", l2dbus_channelPop},
+    {"count", l2dbus_channelCount},
+    {"capacity", l2dbus_channelCapacity},
+    {"getName", l2dbus_channelGetName},
+    {"getFd", l2dbus_channelGetFd},
+    {"__gc", l2dbus_channelDispose},
+    {NULL, NULL},
+};
+
+
+/**
+ * @brief Creates the Channel sub-module.
+ *
+ * This function creates a metatable entry for the Channel userdata
+ * and simulates opening the Channel sub-module.
+ *
+ * @return A table defining the Channel sub-module.
+ */
+void
+l2dbus_openChannel
+    (
+    lua_State*  L
+    )
+{
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_CHANNEL_TYPE_ID,
+            l2dbus_channelMetaTable));
+    lua_createtable(L, 0, 2);
+    lua_pushcfunction(L, l2dbus_openChannelByName);
+    lua_setfield(L, -2, "open");
+    lua_pushcfunction(L, l2dbus_channelSpawn);
+    lua_setfield(L, -2, "spawn");
+}
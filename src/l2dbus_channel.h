@@ -0,0 +1,70 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_channel.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the inter-state message Channel.
+ *===========================================================================
+ */
+#ifndef L2DBUS_CHANNEL_H_
+#define L2DBUS_CHANNEL_H_
+
+#include "lua.h"
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
+
+/* The default number of messages a Channel can hold */
+#define L2DBUS_CHANNEL_DEFAULT_CAPACITY    (1024U)
+
+/* The largest number of messages a Channel can hold */
+#define L2DBUS_CHANNEL_MAX_CAPACITY        (1U << 20)
+
+/* State shared by every Lua state attached to the same (named) Channel */
+typedef struct l2dbus_ChannelShared
+{
+    char*                           name;
+    /* Protected by the global channel lock */
+    unsigned                        refCount;
+    struct l2dbus_ChannelShared*    next;
+    /* Single-producer/single-consumer ring of referenced messages */
+    DBusMessage**                   ring;
+    unsigned                        mask;
+    unsigned                        head;
+    unsigned                        tail;
+    /* Self-pipe used to signal the consumer */
+    int                             sigFd[2];
+} l2dbus_ChannelShared;
+
+typedef struct l2dbus_Channel
+{
+    l2dbus_ChannelShared*   shared;
+} l2dbus_Channel;
+
+int l2dbus_openChannelByName(lua_State* L);
+void l2dbus_openChannel(lua_State* L);
+
+#endif /* Guard for L2DBUS_CHANNEL_H_ */
@@ -38,7 +38,16 @@
 #include "l2dbus_message.h"
 #include "l2dbus_pendingcall.h"
 #include "l2dbus_match.h"
+#include "l2dbus_sigrouter.h"
 #include "l2dbus_serviceobject.h"
+#include "l2dbus_batch.h"
+#include "l2dbus_cork.h"
+#include "l2dbus_replyrouter.h"
+#include "l2dbus_subtree.h"
+#include "l2dbus_reconnect.h"
+#include "l2dbus_ffi.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_tracering.h"
 
 /**
  L2DBUS Connection
@@ -50,6 +59,46 @@
  */
 
 
+/*
+ * Counts (and traces) the messages received by the connection. It never
+ * handles a message so the message continues on to the regular handlers.
+ */
+static DBusHandlerResult
+l2dbus_connectionStatsFilter
+    (
+    DBusConnection* dbusConn,
+    DBusMessage*    msg,
+    void*           user
+    )
+{
+    l2dbus_Connection* connUd = (l2dbus_Connection*)user;
+
+    l2dbus_statsCountReceived(&connUd->stats, msg);
+    l2dbus_traceRingRecord(connUd, msg, L2DBUS_TRACE_RING_RECEIVED);
+
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+
+/* Installs the filter counting the messages received by the connection */
+static void
+l2dbus_connectionAddStatsFilter
+    (
+    l2dbus_Connection*  connUd
+    )
+{
+    connUd->statsFilterAdded = dbus_connection_add_filter(
+                                    cdbus_connectionGetDBus(connUd->conn),
+                                    l2dbus_connectionStatsFilter, connUd,
+                                    NULL) ? L2DBUS_TRUE : L2DBUS_FALSE;
+    if ( !connUd->statsFilterAdded )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN,
+                    "Failed to add the connection statistics filter"));
+    }
+}
+
+
 /**
  @function open
 
@@ -101,8 +150,8 @@ l2dbus_openConnection
         luaL_error(L, "Insufficient number of parameters");
     }
 
-    dispUd = (l2dbus_Dispatcher*)luaL_checkudata(L, 1,
-                                L2DBUS_DISPATCHER_MTBL_NAME);
+    dispUd = (l2dbus_Dispatcher*)l2dbus_checkUserData(L, 1,
+                                L2DBUS_DISPATCHER_TYPE_ID);
 
     address = luaL_checkstring(L, 2);
 
@@ -131,7 +180,11 @@ l2dbus_openConnection
     {
         /* Reset the userdata structure */
         LIST_INIT(&connUd->matches);
+        l2dbus_dispatcherInitConnection(connUd);
+        l2dbus_reconnectInit(connUd);
         connUd->dispUdRef = LUA_NOREF;
+        connUd->traceId = l2dbus_traceRingNextConnId();
+        connUd->traced = L2DBUS_TRUE;
 
         connUd->conn = cdbus_connectionOpen(dispUd->disp, address,
                                             privConn, exitOnDisconnect);
@@ -145,11 +198,16 @@ l2dbus_openConnection
             /* Add a reference to the Dispatcher userdata */
             lua_pushvalue(L, 1 /* dispUd */);
             connUd->dispUdRef = luaL_ref(L, LUA_REGISTRYINDEX);
+            connUd->dispUd = dispUd;
 
             /* Add a (weak) mapping between the CDBUS connection and
              * the associated Lua userdata wrapper
              */
             l2dbus_objectRegistryAdd(L, connUd->conn, -1);
+
+            l2dbus_connectionAddStatsFilter(connUd);
+            l2dbus_reconnectRecordOpen(connUd, address, 0, privConn,
+                                    exitOnDisconnect);
         }
     }
 
@@ -210,8 +268,8 @@ l2dbus_openStandardConnection
         luaL_error(L, "Insufficient number of parameters");
     }
 
-    dispUd = (l2dbus_Dispatcher*)luaL_checkudata(L, 1,
-                                L2DBUS_DISPATCHER_MTBL_NAME);
+    dispUd = (l2dbus_Dispatcher*)l2dbus_checkUserData(L, 1,
+                                L2DBUS_DISPATCHER_TYPE_ID);
 
     busType = (DBusBusType)luaL_checkint(L, 2);
 
@@ -240,7 +298,11 @@ l2dbus_openStandardConnection
     {
         /* Reset the userdata structure */
         LIST_INIT(&connUd->matches);
+        l2dbus_dispatcherInitConnection(connUd);
+        l2dbus_reconnectInit(connUd);
         connUd->dispUdRef = LUA_NOREF;
+        connUd->traceId = l2dbus_traceRingNextConnId();
+        connUd->traced = L2DBUS_TRUE;
 
         connUd->conn = cdbus_connectionOpenStandard(dispUd->disp, busType,
                                             privConn, exitOnDisconnect);
@@ -254,17 +316,172 @@ l2dbus_openStandardConnection
             /* Add a reference to the Dispatcher userdata */
             lua_pushvalue(L, 1 /* dispUd */);
             connUd->dispUdRef = luaL_ref(L, LUA_REGISTRYINDEX);
+            connUd->dispUd = dispUd;
 
             /* Add a (weak) mapping between the CDBUS connection and
              * the associated Lua userdata wrapper
              */
             l2dbus_objectRegistryAdd(L, connUd->conn, -1);
+
+            l2dbus_connectionAddStatsFilter(connUd);
+            l2dbus_reconnectRecordOpen(connUd, NULL, busType, privConn,
+                                    exitOnDisconnect);
         }
     }
 
     return 1;
 }
 
+/**
+ * @brief Wraps a direct (peer-to-peer) D-Bus connection.
+ *
+ * The new Connection userdata is left on the top of the Lua stack. The
+ * connection is attached to the Dispatcher and is closed when the userdata
+ * is collected. The caller keeps its own reference to the D-Bus connection.
+ * A Lua error is thrown if the connection cannot be wrapped.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] dispIdx  The stack index of the Dispatcher userdata.
+ * @param [in] dbusConn The D-Bus peer connection.
+ * @return The Connection userdata.
+ */
+l2dbus_Connection*
+l2dbus_connectionNewPeer
+    (
+    lua_State*              L,
+    int                     dispIdx,
+    struct DBusConnection*  dbusConn
+    )
+{
+    l2dbus_Dispatcher* dispUd;
+    l2dbus_Connection* connUd;
+
+    dispIdx = lua_absindex(L, dispIdx);
+    dispUd = (l2dbus_Dispatcher*)l2dbus_checkUserData(L, dispIdx,
+                                L2DBUS_DISPATCHER_TYPE_ID);
+
+    connUd = (l2dbus_Connection*)l2dbus_objectNew(L, sizeof(*connUd),
+                                             L2DBUS_CONNECTION_TYPE_ID);
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Peer connection userdata=%p", connUd));
+
+    if ( NULL == connUd )
+    {
+        luaL_error(L, "Failed to create connection userdata!");
+    }
+
+    /* Reset the userdata structure */
+    LIST_INIT(&connUd->matches);
+    l2dbus_dispatcherInitConnection(connUd);
+    l2dbus_reconnectInit(connUd);
+    connUd->dispUdRef = LUA_NOREF;
+    connUd->traceId = l2dbus_traceRingNextConnId();
+    connUd->traced = L2DBUS_TRUE;
+    connUd->peer = L2DBUS_TRUE;
+
+    /* Peer connections are never shared and must be closed explicitly */
+    dbus_connection_set_exit_on_disconnect(dbusConn, FALSE);
+    connUd->conn = cdbus_connectionNew(dispUd->disp, dbusConn, CDBUS_TRUE);
+    if ( NULL == connUd->conn )
+    {
+        luaL_error(L, "Failed to allocate Connection");
+    }
+
+    /* Add a reference to the Dispatcher userdata */
+    lua_pushvalue(L, dispIdx);
+    connUd->dispUdRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    connUd->dispUd = dispUd;
+
+    /* Add a (weak) mapping between the CDBUS connection and
+     * the associated Lua userdata wrapper
+     */
+    l2dbus_objectRegistryAdd(L, connUd->conn, -1);
+
+    l2dbus_connectionAddStatsFilter(connUd);
+
+    return connUd;
+}
+
+
+/*
+ * Protected wrapper of l2dbus_connectionNewPeer() for a connection the
+ * caller still has to close if it cannot be wrapped.
+ */
+static int
+l2dbus_openPeerShim
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_connectionNewPeer(L, 1, (DBusConnection*)lua_touserdata(L, 2));
+    return 1;
+}
+
+
+/**
+ @function openPeer
+
+ Opens a direct (peer-to-peer) connection to a remote address.
+
+ This function connects directly to a peer listening on the address
+ (typically an @{l2dbus.Server|Server}) rather than to a message bus so
+ messages no longer pass through the bus daemon. The connection is always
+ private and no bus names can be owned or resolved on it, but otherwise it
+ can be used like any other Connection (e.g. by a
+ @{l2dbus.proxyctrl|ProxyController} or @{l2dbus.service|Service}). The
+ connection is closed when it's garbage collected. A Lua error is thrown
+ if the connection cannot be opened.
+
+ @tparam userdata dispatcher The @{l2dbus.Dispatcher|Dispatcher} to associate with the
+ connection.
+ @tparam string address The D-Bus address of the peer (e.g.
+ "unix:abstract=/tmp/dbus-XXXXXXXX").
+ @treturn userdata Connection userdata object
+ */
+static int
+l2dbus_openPeerConnection
+    (
+    lua_State*  L
+    )
+{
+    DBusConnection* dbusConn;
+    DBusError dbusError;
+    const char* address;
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Create: peer connection"));
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    l2dbus_checkUserData(L, 1, L2DBUS_DISPATCHER_TYPE_ID);
+    address = luaL_checkstring(L, 2);
+
+    dbus_error_init(&dbusError);
+    dbusConn = dbus_connection_open_private(address, &dbusError);
+    if ( NULL == dbusConn )
+    {
+        lua_pushfstring(L, "Failed to open peer connection (%s)",
+                        dbus_error_is_set(&dbusError) ?
+                        dbusError.message : address);
+        dbus_error_free(&dbusError);
+        lua_error(L);
+    }
+
+    /* The wrapper holds its own reference to the D-Bus connection */
+    lua_pushcfunction(L, l2dbus_openPeerShim);
+    lua_pushvalue(L, 1 /* dispUd */);
+    lua_pushlightuserdata(L, dbusConn);
+    if ( 0 != lua_pcall(L, 2, 1, 0) )
+    {
+        dbus_connection_close(dbusConn);
+        dbus_connection_unref(dbusConn);
+        lua_error(L);
+    }
+    dbus_connection_unref(dbusConn);
+
+    return 1;
+}
+
+
 /**
  * A D-Bus Connection class.
  * @type Connection
@@ -294,8 +511,8 @@ l2dbus_connectionIsConnected
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
 
     lua_pushboolean(L, dbus_connection_get_is_connected(
                     cdbus_connectionGetDBus(connUd->conn)));
@@ -330,8 +547,8 @@ l2dbus_connectionIsAuthenticated
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
 
     lua_pushboolean(L, dbus_connection_get_is_authenticated(
                     cdbus_connectionGetDBus(connUd->conn)));
@@ -368,8 +585,8 @@ l2dbus_connectionIsAnonymous
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
 
     lua_pushboolean(L, dbus_connection_get_is_anonymous(
                     cdbus_connectionGetDBus(connUd->conn)));
@@ -378,6 +595,39 @@ l2dbus_connectionIsAnonymous
 }
 
 
+/**
+ @function isPeer
+ @within Connection
+
+ Tests whether the connection is a direct (peer-to-peer) connection.
+
+ Peer connections are opened with @{openPeer} or accepted by an
+ @{l2dbus.Server|Server}. They are not attached to a message bus so
+ there is no bus daemon to own or resolve bus names.
+
+ @tparam userdata conn The D-Bus connection object
+ @treturn bool Returns **true** if a peer connection, **false** otherwise.
+ */
+static int
+l2dbus_connectionIsPeer
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
+
+    lua_pushboolean(L, connUd->peer);
+
+    return 1;
+}
+
+
 /**
  @function getServerId
  @within Connection
@@ -403,8 +653,8 @@ l2dbus_connectionGetServerId
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
 
     serverId = dbus_connection_get_server_id(
                     cdbus_connectionGetDBus(connUd->conn));
@@ -446,8 +696,8 @@ l2dbus_connectionGetBusId
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
 
     busId = dbus_bus_get_id(
                     cdbus_connectionGetDBus(connUd->conn), NULL);
@@ -498,8 +748,8 @@ l2dbus_connectionGetDescriptor
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
 
     if ( cdbus_connectionGetDescriptor(connUd->conn, &descr) )
     {
@@ -544,8 +794,8 @@ l2dbus_connectionCanSendType
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
 
     if ( LUA_TNUMBER == lua_type(L, 2) )
     {
@@ -575,6 +825,52 @@ l2dbus_connectionCanSendType
 }
 
 
+/**
+ * @brief Queues (or holds if corked) a message to send on the connection.
+ *
+ * The message is counted in the statistics of the connection and recorded
+ * in the trace ring like every other message sent by the module.
+ *
+ * @param [in]  connUd    The connection.
+ * @param [in]  msg       The D-Bus message to send.
+ * @param [out] serialNum The serial number of a queued message. Zero (0)
+ *                        for a message held by the cork. May be NULL.
+ * @return L2DBUS_TRUE if the message is queued (or held) and L2DBUS_FALSE
+ * otherwise.
+ */
+l2dbus_Bool
+l2dbus_connectionQueue
+    (
+    l2dbus_Connection*  connUd,
+    DBusMessage*        msg,
+    dbus_uint32_t*      serialNum
+    )
+{
+    l2dbus_Bool queued;
+
+    if ( NULL != serialNum )
+    {
+        *serialNum = 0;
+    }
+
+    if ( connUd->corked && l2dbus_corkHold(connUd, msg) )
+    {
+        return L2DBUS_TRUE;
+    }
+
+    queued = dbus_connection_send(cdbus_connectionGetDBus(connUd->conn),
+                                msg, serialNum) ? L2DBUS_TRUE : L2DBUS_FALSE;
+    l2dbus_statsCountSent(&connUd->stats, msg, queued);
+    if ( queued )
+    {
+        l2dbus_traceRingRecord(connUd, msg, L2DBUS_TRACE_RING_SENT);
+    }
+    L2DBUS_TRACE_MSG((L2DBUS_TRC_TRACE, msg));
+
+    return queued;
+}
+
+
 /**
  @function send
  @within Connection
@@ -584,14 +880,17 @@ l2dbus_connectionCanSendType
  This method does **not** block to write the message to the network;
  that happens asynchronously. To force the message to be written an explicit
  call to @{flush} must be made otherwise the message will be sent the next
- time the main loop is run.
+ time the main loop is run. If the connection is @{cork|corked} the
+ message is held back and handed to D-Bus later.
 
  @tparam userdata conn The D-Bus connection object
  @tparam userdata msg The D-Bus message to send
- @treturn bool Returns **true** if the message is queued to be sent and
- **false** otherwise.
+ @treturn bool Returns **true** if the message is queued (or held) to be
+ sent and **false** otherwise.
  @treturn number If the message is queued successfully then this will be
  the transmitting serial number of the message otherwise this is zero (0).
+ A held message is given its serial number when it is handed to D-Bus so
+ zero is returned for it as well.
  */
 static int
 l2dbus_connectionSend
@@ -602,18 +901,17 @@ l2dbus_connectionSend
     l2dbus_Connection* connUd;
     l2dbus_Message* msgUd;
     dbus_uint32_t serialNum = 0;
+    l2dbus_Bool queued;
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                            L2DBUS_CONNECTION_MTBL_NAME);
-    msgUd = (l2dbus_Message*)luaL_checkudata(L, 2, L2DBUS_MESSAGE_MTBL_NAME);
-
-    lua_pushboolean(L, dbus_connection_send(cdbus_connectionGetDBus(connUd->conn),
-                    msgUd->msg, &serialNum));
-    L2DBUS_TRACE_MSG((L2DBUS_TRC_TRACE, msgUd->msg));
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    msgUd = (l2dbus_Message*)l2dbus_checkUserData(L, 2, L2DBUS_MESSAGE_TYPE_ID);
 
+    queued = l2dbus_connectionQueue(connUd, msgUd->msg, &serialNum);
+    lua_pushboolean(L, queued);
     lua_pushnumber(L, serialNum);
 
     return 2;
@@ -657,20 +955,26 @@ l2dbus_connectionSendWithReply
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                            L2DBUS_CONNECTION_MTBL_NAME);
-    msgUd = (l2dbus_Message*)luaL_checkudata(L, 2, L2DBUS_MESSAGE_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    msgUd = (l2dbus_Message*)l2dbus_checkUserData(L, 2, L2DBUS_MESSAGE_TYPE_ID);
     msecTimeout = luaL_optint(L, 3, DBUS_TIMEOUT_USE_DEFAULT);
 
+    /* Messages held by a cork must go out first */
+    l2dbus_corkRelease(connUd, L2DBUS_FALSE);
+
     if ( dbus_connection_send_with_reply(cdbus_connectionGetDBus(connUd->conn),
         msgUd->msg, &pending, msecTimeout) && (NULL != pending) )
     {
+        l2dbus_statsCountSent(&connUd->stats, msgUd->msg, L2DBUS_TRUE);
+        l2dbus_traceRingRecord(connUd, msgUd->msg, L2DBUS_TRACE_RING_SENT);
         L2DBUS_TRACE_MSG((L2DBUS_TRC_TRACE, msgUd->msg));
         lua_pushboolean(L, L2DBUS_TRUE);
         l2dbus_newPendingCall(L, pending, 1);
     }
     else
     {
+        l2dbus_statsCountSent(&connUd->stats, msgUd->msg, L2DBUS_FALSE);
         L2DBUS_TRACE_MSG((L2DBUS_TRC_ERROR, msgUd->msg));
         L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Failed to send message"));
         lua_pushboolean(L, L2DBUS_FALSE);
@@ -727,17 +1031,26 @@ l2dbus_connectionSendWithReplyAndBlock
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                            L2DBUS_CONNECTION_MTBL_NAME);
-    msgUd = (l2dbus_Message*)luaL_checkudata(L, 2, L2DBUS_MESSAGE_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    msgUd = (l2dbus_Message*)l2dbus_checkUserData(L, 2, L2DBUS_MESSAGE_TYPE_ID);
     msecTimeout = luaL_optint(L, 3, DBUS_TIMEOUT_USE_DEFAULT);
 
     dbus_error_init(&dbusError);
 
+    /* Messages held by a cork must go out first */
+    l2dbus_corkRelease(connUd, L2DBUS_FALSE);
+
     L2DBUS_TRACE_MSG((L2DBUS_TRC_TRACE, msgUd->msg));
     replyMsg = dbus_connection_send_with_reply_and_block(cdbus_connectionGetDBus(connUd->conn),
                                                         msgUd->msg, msecTimeout, &dbusError);
 
+    /* The reply bypasses the connection filters so count it here */
+    l2dbus_statsCountSent(&connUd->stats, msgUd->msg, L2DBUS_TRUE);
+    l2dbus_statsCountReceived(&connUd->stats, replyMsg);
+    l2dbus_traceRingRecord(connUd, msgUd->msg, L2DBUS_TRACE_RING_SENT);
+    l2dbus_traceRingRecord(connUd, replyMsg, L2DBUS_TRACE_RING_RECEIVED);
+
     if ( NULL == replyMsg )
     {
         lua_pushnil(L);
@@ -779,6 +1092,9 @@ l2dbus_connectionSendWithReplyAndBlock
 
  Blocks until the outgoing message queue is empty.
 
+ Any messages held by a @{cork} are queued first (the connection stays
+ corked).
+
  @tparam userdata conn The D-Bus connection object
  */
 static int
@@ -791,8 +1107,9 @@ l2dbus_connectionFlush
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
+    l2dbus_corkRelease(connUd, L2DBUS_FALSE);
     dbus_connection_flush(cdbus_connectionGetDBus(connUd->conn));
 
     return 0;
@@ -810,7 +1127,7 @@ l2dbus_connectionFlush
 
  @tparam userdata conn The D-Bus connection object
  @treturn bool Returns **true** if there are pending messages in
- the outgoing queue or **false** otherwise.
+ the outgoing queue (or held by a @{cork}) or **false** otherwise.
  */
 static int
 l2dbus_connectionHasMessagesToSend
@@ -822,9 +1139,9 @@ l2dbus_connectionHasMessagesToSend
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
-    if ( dbus_connection_has_messages_to_send(
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
+    if ( (0 < connUd->nCorked) || dbus_connection_has_messages_to_send(
         cdbus_connectionGetDBus(connUd->conn)) )
     {
         lua_pushboolean(L, L2DBUS_TRUE);
@@ -855,6 +1172,9 @@ l2dbus_connectionHasMessagesToSend
  The message handler should have the following prototype:
      function onMatch(match, message, userToken)
 
+ A rule with *predecode* set passes the message arguments as well:
+     function onMatch(match, message, userToken, ...)
+
  @tparam userdata conn The D-Bus connection object
  @tparam table rule The match rule table
  @see l2dbus.Match.MatchRule
@@ -877,8 +1197,8 @@ l2dbus_connectionRegisterMatch
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
     luaL_checktype(L, 2, LUA_TTABLE);
 
     luaL_checktype(L, 3, LUA_TFUNCTION);
@@ -934,8 +1254,8 @@ l2dbus_connectionUnregisterMatch
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
 
     luaL_checktype(L, 2, LUA_TLIGHTUSERDATA);
     hnd = (l2dbus_Match*)lua_touserdata(L, 2);
@@ -959,6 +1279,269 @@ l2dbus_connectionUnregisterMatch
 }
 
 
+/**
+ @function subscribeSignal
+ @within Connection
+
+ Subscribes a handler to a D-Bus signal through the shared signal router.
+
+ Unlike @{registerMatch} every subscription whose rule specifies the same
+ *sender*, *path*, *interface* and *member* shares one route and so a
+ single match rule on the bus and a single callback from the D-Bus
+ library. The signal is wrapped once and (if any subscriber asks for it)
+ its arguments are decoded once. Every subscriber then receives the same
+ Message userdata and argument values. The bus-side match rule is removed
+ once the last subscriber of a route unsubscribes.
+
+ The rule table supports the following fields. Other
+ @{l2dbus.Match.MatchRule|match rule} fields are not supported:
+ <ul>
+ <li>*sender* (string) Optional sender of the signal.</li>
+ <li>*path* (string) Optional object path emitting the signal.</li>
+ <li>*interface* (string) Optional interface of the signal.</li>
+ <li>*member* (string) Optional name of the signal.</li>
+ <li>*decodeArgs* (bool) If **true** the decoded signal arguments are
+ passed to the handler after the user token.</li>
+ </ul>
+
+ The signal handler should have the following prototype:
+     function onSignal(handle, message, userToken, ...)
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam table rule The signal rule table
+ @tparam func handler The signal handler
+ @tparam ?any userToken Optional user defined data that is delivered to
+ the signal handler
+ @treturn lightuserdata Returns a subscription handle that can be used to
+ @{unsubscribeSignal|unsubscribe}.
+ */
+static int
+l2dbus_connectionSubscribeSignal
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SigSubscriber* sub;
+    int userIdx = L2DBUS_CALLBACK_NOREF_NEEDED;
+    const char* errReason = "";
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+    l2dbus_checkUserData(L, 1, L2DBUS_CONNECTION_TYPE_ID);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+
+    if ( 3 < lua_gettop(L) )
+    {
+        /* Whatever comes after the callback function is assumed
+         * to be user data
+         */
+        userIdx = 4;
+    }
+
+    sub = l2dbus_sigRouterSubscribe(L, 1 /*conn*/, 2 /*rule*/,
+                                    3 /*callback*/, userIdx, &errReason);
+    if ( NULL == sub )
+    {
+        luaL_error(L, errReason);
+    }
+
+    lua_pushlightuserdata(L, sub);
+
+    return 1;
+}
+
+
+/**
+ @function unsubscribeSignal
+ @within Connection
+
+ Unsubscribes a signal handler.
+
+ This method unsubscribes the handler referenced by the handle returned
+ by @{subscribeSignal}. It's safe to unsubscribe from within a signal
+ handler.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam lightuserdata handle The subscription handle
+ @treturn bool Returns **true** if the handler is unsubscribed and
+ **false** if the handle is unknown.
+ */
+static int
+l2dbus_connectionUnsubscribeSignal
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_SigSubscriber* sub;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
+    luaL_checktype(L, 2, LUA_TLIGHTUSERDATA);
+    sub = (l2dbus_SigSubscriber*)lua_touserdata(L, 2);
+
+    lua_pushboolean(L, l2dbus_sigRouterUnsubscribe(L, connUd, sub));
+
+    return 1;
+}
+
+
+/**
+ @function getSignalRouterStats
+ @within Connection
+
+ Returns the number of routes and subscribers of the signal router.
+
+ Each route corresponds to one match rule registered with the bus.
+
+ @tparam userdata conn The D-Bus connection object
+ @treturn number The number of routes (bus-side match rules).
+ @treturn number The number of subscribers.
+ */
+static int
+l2dbus_connectionGetSignalRouterStats
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
+
+    lua_pushinteger(L, connUd->sigRouter.nRoutes);
+    lua_pushinteger(L, connUd->sigRouter.nSubscribers);
+
+    return 2;
+}
+
+
+/**
+ @function getStats
+ @within Connection
+
+ Returns the message counters of the connection.
+
+ Received messages are counted as they're dispatched by the connection.
+ Replies completing a @{l2dbus.PendingCall|PendingCall} are consumed by the
+ pending call before dispatch and are not counted. See @{l2dbus.Stats.snapshot} for the metrics of all connections.
+
+ @tparam userdata conn The D-Bus connection object
+ @treturn table The @{l2dbus.Stats.MessageCounters|message counters} of the
+ connection.
+ */
+static int
+l2dbus_connectionGetStats
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
+
+    l2dbus_statsPushMsgCounters(L, &connUd->stats);
+
+    return 1;
+}
+
+
+/**
+ @function setTraced
+ @within Connection
+
+ Includes or excludes the connection from the trace ring.
+
+ Connections are traced by default. Their messages are only recorded
+ while the @{l2dbus.TraceRing|trace ring} is enabled.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam bool traced **true** to record the messages of the connection,
+ **false** otherwise.
+ */
+static int
+l2dbus_connectionSetTraced
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
+    luaL_checktype(L, 2, LUA_TBOOLEAN);
+    connUd->traced = lua_toboolean(L, 2) ? L2DBUS_TRUE : L2DBUS_FALSE;
+
+    return 0;
+}
+
+
+/**
+ @function isTraced
+ @within Connection
+
+ Returns whether the messages of the connection are recorded by the trace
+ ring.
+
+ @tparam userdata conn The D-Bus connection object
+ @treturn bool **true** if the connection is traced, **false** otherwise.
+ */
+static int
+l2dbus_connectionIsTraced
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
+    lua_pushboolean(L, connUd->traced);
+
+    return 1;
+}
+
+
+/**
+ @function getTraceId
+ @within Connection
+
+ Returns the identifier of the connection in the records of the
+ @{l2dbus.TraceRing|trace ring}.
+
+ @tparam userdata conn The D-Bus connection object
+ @treturn number The trace identifier of the connection.
+ */
+static int
+l2dbus_connectionGetTraceId
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
+    lua_pushinteger(L, connUd->traceId);
+
+    return 1;
+}
+
+
 /**
  @function registerServiceObject
  @within Connection
@@ -984,15 +1567,22 @@ l2dbus_connectionRegisterObject
 {
     l2dbus_Connection* connUd;
     l2dbus_ServiceObject* svcObjUd;
+    l2dbus_Bool registered;
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
-    svcObjUd = (l2dbus_ServiceObject*)luaL_checkudata(L, 2,
-                                                L2DBUS_SERVICE_OBJECT_MTBL_NAME);
-
-    lua_pushboolean(L, cdbus_connectionRegisterObject(connUd->conn, svcObjUd->obj));
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
+    svcObjUd = (l2dbus_ServiceObject*)l2dbus_checkUserData(L, 2,
+                                                L2DBUS_SERVICE_OBJECT_TYPE_ID);
+
+    registered = cdbus_connectionRegisterObject(connUd->conn, svcObjUd->obj) ?
+                L2DBUS_TRUE : L2DBUS_FALSE;
+    if ( registered )
+    {
+        l2dbus_reconnectObjectRegistered(L, connUd, 2);
+    }
+    lua_pushboolean(L, registered);
 
     return 1;
 }
@@ -1023,11 +1613,12 @@ l2dbus_connectionUnregisterObject
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
 
-    svcObjUd = (l2dbus_ServiceObject*)luaL_checkudata(L, 2,
-                                                L2DBUS_SERVICE_OBJECT_MTBL_NAME);
+    svcObjUd = (l2dbus_ServiceObject*)l2dbus_checkUserData(L, 2,
+                                                L2DBUS_SERVICE_OBJECT_TYPE_ID);
+    l2dbus_reconnectObjectUnregistered(L, connUd, svcObjUd);
     lua_pushboolean(L, cdbus_connectionUnregisterObject(connUd->conn,
                        cdbus_objectGetPath(svcObjUd->obj)));
 
@@ -1057,8 +1648,8 @@ l2dbus_connectionGetMaxMessageSize
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
     lua_pushnumber(L,
         (lua_Number)dbus_connection_get_max_message_size(
                         cdbus_connectionGetDBus(connUd->conn)));
@@ -1090,8 +1681,8 @@ l2dbus_connectionSetMaxMessageSize
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
     long limit = luaL_checklong(L, 2);
 
     dbus_connection_set_max_message_size(cdbus_connectionGetDBus(connUd->conn),
@@ -1129,8 +1720,8 @@ l2dbus_connectionGetMaxReceivedSize
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
     lua_pushnumber(L,
         (lua_Number)dbus_connection_get_max_received_size(
                                     cdbus_connectionGetDBus(connUd->conn)));
@@ -1169,8 +1760,8 @@ l2dbus_connectionSetMaxReceivedSize
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
     long limit = luaL_checklong(L, 2);
 
     dbus_connection_set_max_received_size(cdbus_connectionGetDBus(connUd->conn),
@@ -1204,8 +1795,8 @@ l2dbus_connectionGetOutgoingSize
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
-    connUd = (l2dbus_Connection*)luaL_checkudata(L, 1,
-                                                L2DBUS_CONNECTION_MTBL_NAME);
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_CONNECTION_TYPE_ID);
     lua_pushnumber(L,
         (lua_Number)dbus_connection_get_outgoing_size(
                     cdbus_connectionGetDBus(connUd->conn)));
@@ -1214,6 +1805,70 @@ l2dbus_connectionGetOutgoingSize
 }
 
 
+/**
+ * @brief Replaces the CDBUS connection wrapped by a Connection userdata.
+ *
+ * The filters, subtrees and (recorded) match rules of the connection are
+ * moved to the new connection and the old connection is closed. Messages
+ * held by a cork are sent on the new connection once it is uncorked.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] connUd   The connection userdata.
+ * @param [in] newConn  The (re-opened) connection that replaces the old one.
+ */
+void
+l2dbus_connectionSwap
+    (
+    lua_State*          L,
+    l2dbus_Connection*  connUd,
+    cdbus_Connection*   newConn
+    )
+{
+    cdbus_Connection* oldConn = connUd->conn;
+    DBusConnection* oldDbusConn = cdbus_connectionGetDBus(oldConn);
+    l2dbus_Match* match;
+    l2dbus_SigRoute* route;
+    cdbus_HResult rc;
+    unsigned idx;
+
+    /* Map the new CDBUS connection to the (same) Lua userdata */
+    l2dbus_objectRegistryGet(L, oldConn);
+    l2dbus_objectRegistryRemove(L, oldConn);
+    l2dbus_objectRegistryAdd(L, newConn, -1);
+    lua_pop(L, 1);
+    connUd->conn = newConn;
+
+    if ( connUd->statsFilterAdded )
+    {
+        dbus_connection_remove_filter(oldDbusConn,
+                                    l2dbus_connectionStatsFilter, connUd);
+        l2dbus_connectionAddStatsFilter(connUd);
+    }
+    l2dbus_replyRouterMove(connUd, oldDbusConn);
+    l2dbus_subtreeMove(connUd, oldDbusConn);
+
+    LIST_FOREACH(match, &connUd->matches, link)
+    {
+        l2dbus_matchRestore(match, oldConn);
+    }
+    for ( idx = 0; idx < L2DBUS_SIGROUTER_BUCKETS; ++idx )
+    {
+        for ( route = connUd->sigRouter.buckets[idx]; NULL != route;
+            route = route->next )
+        {
+            l2dbus_matchRestore(route->match, oldConn);
+        }
+    }
+
+    rc = cdbus_connectionClose(oldConn);
+    if ( CDBUS_FAILED(rc) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN, "Failed to close connection (0x%X)", rc));
+    }
+    cdbus_connectionUnref(oldConn);
+}
+
+
 /**
  * @brief Called by Lua VM to GC/reclaim the Connection userdata.
  *
@@ -1233,8 +1888,8 @@ l2dbus_connectionDispose
     l2dbus_Match* match;
     l2dbus_Match* next;
 
-    l2dbus_Connection* ud = (l2dbus_Connection*)luaL_checkudata(L, -1,
-                                        L2DBUS_CONNECTION_MTBL_NAME);
+    l2dbus_Connection* ud = (l2dbus_Connection*)l2dbus_checkUserData(L, -1,
+                                        L2DBUS_CONNECTION_TYPE_ID);
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: connection (userdata=%p)", ud));
 
@@ -1247,6 +1902,24 @@ l2dbus_connectionDispose
         l2dbus_disposeMatch(L, match);
     }
 
+    /* Release the shared signal routes and their subscribers */
+    l2dbus_sigRouterDispose(L, ud);
+
+    /* Leave the dispatcher's round-robin queue of deferred deliveries */
+    l2dbus_dispatcherRemoveConnection(ud);
+
+    /* Hand any held messages to D-Bus before the connection is closed */
+    l2dbus_corkDispose(ud);
+
+    /* Stop routing replies and release the reply handlers */
+    l2dbus_replyRouterDispose(L, ud);
+
+    /* Stop serving the subtrees and release their handlers */
+    l2dbus_subtreeDispose(L, ud);
+
+    /* Stop reconnecting and forget the recorded registrations */
+    l2dbus_reconnectDispose(L, ud);
+
     if ( ud->conn != NULL )
     {
         /* Remove the (weak) association between
@@ -1255,6 +1928,13 @@ l2dbus_connectionDispose
          */
         l2dbus_objectRegistryRemove(L, ud->conn);
 
+        if ( ud->statsFilterAdded )
+        {
+            dbus_connection_remove_filter(cdbus_connectionGetDBus(ud->conn),
+                                        l2dbus_connectionStatsFilter, ud);
+            ud->statsFilterAdded = L2DBUS_FALSE;
+        }
+
         rc = cdbus_connectionClose(ud->conn);
         if ( CDBUS_FAILED(rc) )
         {
@@ -1283,6 +1963,7 @@ static const luaL_Reg l2dbus_connMetaTable[] = {
     {"isConnected", l2dbus_connectionIsConnected},
     {"isAuthenticated", l2dbus_connectionIsAuthenticated},
     {"isAnonymous", l2dbus_connectionIsAnonymous},
+    {"isPeer", l2dbus_connectionIsPeer},
     {"getServerId", l2dbus_connectionGetServerId},
     {"getBusId", l2dbus_connectionGetBusId},
     {"getDescriptor", l2dbus_connectionGetDescriptor},
@@ -1290,12 +1971,34 @@ static const luaL_Reg l2dbus_connMetaTable[] = {
     {"flush", l2dbus_connectionFlush},
     {"hasMessagesToSend", l2dbus_connectionHasMessagesToSend},
     {"send", l2dbus_connectionSend},
+    {"sendBatch", l2dbus_connectionSendBatch},
     {"sendWithReply", l2dbus_connectionSendWithReply},
     {"sendWithReplyAndBlock", l2dbus_connectionSendWithReplyAndBlock},
+    {"cork", l2dbus_connectionCork},
+    {"uncork", l2dbus_connectionUncork},
+    {"isCorked", l2dbus_connectionIsCorked},
+    {"addReplyHandler", l2dbus_connectionAddReplyHandler},
+    {"removeReplyHandler", l2dbus_connectionRemoveReplyHandler},
+    {"sendRouted", l2dbus_connectionSendRouted},
+    {"cancelRouted", l2dbus_connectionCancelRouted},
     {"registerMatch", l2dbus_connectionRegisterMatch},
     {"unregisterMatch", l2dbus_connectionUnregisterMatch},
+    {"subscribeSignal", l2dbus_connectionSubscribeSignal},
+    {"unsubscribeSignal", l2dbus_connectionUnsubscribeSignal},
+    {"getSignalRouterStats", l2dbus_connectionGetSignalRouterStats},
+    {"getStats", l2dbus_connectionGetStats},
+    {"setTraced", l2dbus_connectionSetTraced},
+    {"isTraced", l2dbus_connectionIsTraced},
+    {"getTraceId", l2dbus_connectionGetTraceId},
+    {"ffiHandle", l2dbus_connectionGetFfiHandle},
     {"registerServiceObject", l2dbus_connectionRegisterObject},
     {"unregisterServiceObject", l2dbus_connectionUnregisterObject},
+    {"enableRestore", l2dbus_connectionEnableRestore},
+    {"reconnect", l2dbus_connectionReconnect},
+    {"requestName", l2dbus_connectionRequestName},
+    {"releaseName", l2dbus_connectionReleaseName},
+    {"registerSubtree", l2dbus_connectionRegisterSubtree},
+    {"unregisterSubtree", l2dbus_connectionUnregisterSubtree},
     {"getMaxMessageSize", l2dbus_connectionGetMaxMessageSize},
     {"setMaxMessageSize", l2dbus_connectionSetMaxMessageSize},
     {"getMaxReceivedSize", l2dbus_connectionGetMaxReceivedSize},
@@ -1322,10 +2025,13 @@ l2dbus_openConnectionLib
     )
 {
     lua_pop(L, l2dbus_createMetatable(L, L2DBUS_CONNECTION_TYPE_ID, l2dbus_connMetaTable));
-    lua_createtable(L, 0, 2);
+    lua_createtable(L, 0, 3);
     lua_pushcfunction(L, l2dbus_openConnection);
     lua_setfield(L, -2, "open");
 
     lua_pushcfunction(L, l2dbus_openStandardConnection);
     lua_setfield(L, -2, "openStandard");
+
+    lua_pushcfunction(L, l2dbus_openPeerConnection);
+    lua_setfield(L, -2, "openPeer");
 }
@@ -30,22 +30,81 @@
 #include "lua.h"
 #include "queue.h"
 #include "l2dbus_match.h"
+#include "l2dbus_sigrouter.h"
 #include "l2dbus_callback.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_tracering.h"
+#include "l2dbus_replyrouter.h"
+#include "l2dbus_subtree.h"
+#include "l2dbus_reconnect.h"
 
 /* Forward declarations */
 struct cdbus_Connection;
+struct l2dbus_Dispatcher;
+struct l2dbus_DeferredMatch;
+struct cdbus_Timeout;
 
 typedef struct l2dbus_Connection
 {
     struct cdbus_Connection*    conn;
     int                         dispUdRef;
+    struct l2dbus_Dispatcher*   dispUd;
     l2dbus_CallbackCtx          cbCtx;
     l2dbus_Match*               nextMatch;
     LIST_HEAD(l2dbus_MatchHead,
                   l2dbus_Match) matches;
+    /* Subscribers sharing match rules through the signal router */
+    l2dbus_SigRouter            sigRouter;
+
+    /* Dispatch budget accounting and deferred match deliveries */
+    unsigned                    budgetGen;
+    unsigned                    budgetMsgs;
+    double                      budgetSecs;
+    l2dbus_Bool                 inBacklog;
+    TAILQ_HEAD(l2dbus_DeferredHead,
+                  l2dbus_DeferredMatch) deferred[L2DBUS_MATCH_PRIORITY_COUNT];
+    /* Higher priority deliveries in a row while a lower lane was waiting */
+    unsigned                    laneStreak;
+    /* The lower lane most recently served to prevent its starvation */
+    unsigned                    starvedLane;
+    TAILQ_ENTRY(l2dbus_Connection) backlogLink;
+
+    /* Messages sent and received by this connection */
+    l2dbus_StatsMsgCounters     stats;
+    l2dbus_Bool                 statsFilterAdded;
+    /* Identifies the connection in the trace ring records */
+    uint16_t                    traceId;
+    l2dbus_Bool                 traced;
+    /* A direct (peer-to-peer) connection rather than one to a bus */
+    l2dbus_Bool                 peer;
+
+    /* Messages held back (in order) while the connection is corked */
+    l2dbus_Bool                 corked;
+    l2dbus_Bool                 corkAutoFlush;
+    l2dbus_Bool                 corkArmed;
+    unsigned                    corkMaxMsgs;
+    unsigned                    corkMaxBytes;
+    unsigned                    corkedBytes;
+    unsigned                    nCorked;
+    unsigned                    corkCapacity;
+    struct DBusMessage**        corkedMsgs;
+    struct cdbus_Timeout*       corkTimeout;
+    /* Replies to requests sent with sendRouted */
+    l2dbus_ReplyRouter          replyRouter;
+    /* Object path prefixes served by a single handler */
+    l2dbus_Subtree*             subtrees;
+    /* Registrations restored when the connection is re-opened */
+    l2dbus_Reconnect            reconnect;
 } l2dbus_Connection;
 
 int l2dbus_newConnection(lua_State* L);
+l2dbus_Connection* l2dbus_connectionNewPeer(lua_State* L, int dispIdx,
+                                            struct DBusConnection* dbusConn);
+l2dbus_Bool l2dbus_connectionQueue(l2dbus_Connection* connUd,
+                                struct DBusMessage* msg,
+                                dbus_uint32_t* serialNum);
+void l2dbus_connectionSwap(lua_State* L, l2dbus_Connection* connUd,
+                            struct cdbus_Connection* newConn);
 void l2dbus_openConnectionLib(lua_State* L);
 
 #endif /* Guard for L2DBUS_CONNECTION_H_ */
@@ -0,0 +1,211 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_context.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the per Lua state module context.
+ *===========================================================================
+ */
+#include <string.h>
+#include "lauxlib.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_context.h"
+#include "l2dbus_defs.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_sigplan.h"
+
+/* The address of this variable is the registry key of the context */
+static const char gContextKey = 0;
+
+/* The context of the Lua state that most recently entered the module on
+ * this thread. Callbacks from CDBUS do not carry a Lua state so they rely
+ * on this being the context of the Lua state running the dispatcher.
+ */
+static L2DBUS_THREAD_LOCAL l2dbus_Context* gCurrentContext = NULL;
+
+/* The registry of the Lua state owning the current context. A Lua state
+ * that matches it can skip the registry lookup of its context.
+ */
+static L2DBUS_THREAD_LOCAL const void* gCurrentRegistry = NULL;
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the context userdata.
+ *
+ * The context is anchored in the registry so it's only reclaimed when the
+ * Lua state is closed. Since it's created before any other object of the
+ * module it's also the last to be finalized.
+ *
+ * @return nil
+ */
+static int
+l2dbus_contextDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* ctx = (l2dbus_Context*)luaL_checkudata(L, 1,
+                                            L2DBUS_CONTEXT_MTBL_NAME);
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: context (userdata=%p)", ctx));
+
+    /* The order in which the VM finalizes objects at shutdown is not the
+     * same for all Lua versions so release anything the module finalizer
+     * may not have released yet.
+     */
+    gCurrentContext = ctx;
+    gCurrentRegistry = ctx->registry;
+    l2dbus_sigPlanFlushCache();
+    l2dbus_objectRegistryFree(&ctx->objReg);
+    l2dbus_traceRingFree(&ctx->traceRing);
+    l2dbus_watchdogFree(&ctx->watchdog);
+    l2dbus_messageInternFree(ctx);
+    l2dbus_strPoolFree(&ctx->strPool);
+    gCurrentContext = NULL;
+    gCurrentRegistry = NULL;
+
+    return 0;
+}
+
+
+static const luaL_Reg l2dbus_contextMetaTable[] =
+{
+    {"__gc", l2dbus_contextDispose},
+    {NULL, NULL}
+};
+
+
+/**
+ * @brief Creates the module context of a Lua state.
+ *
+ * If the module has already been loaded by the Lua state then its existing
+ * context is returned. The context becomes the current context of the
+ * calling thread.
+ *
+ * @param [in] L The Lua state.
+ * @return The context of the Lua state.
+ */
+l2dbus_Context*
+l2dbus_contextNew
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
+    if ( NULL == ctx )
+    {
+        lua_pop(L, l2dbus_createMetatable(L, L2DBUS_CONTEXT_TYPE_ID,
+                                        l2dbus_contextMetaTable));
+
+        lua_pushlightuserdata(L, (void*)&gContextKey);
+        ctx = (l2dbus_Context*)lua_newuserdata(L, sizeof(*ctx));
+        memset(ctx, 0, sizeof(*ctx));
+        luaL_getmetatable(L, L2DBUS_CONTEXT_MTBL_NAME);
+        lua_setmetatable(L, -2);
+        lua_rawset(L, LUA_REGISTRYINDEX);
+
+        ctx->registry = lua_topointer(L, LUA_REGISTRYINDEX);
+        ctx->callbackRef = LUA_NOREF;
+        ctx->finalizerRef = LUA_NOREF;
+        ctx->traceMask = l2dbus_traceGetMask();
+        ctx->objReg.ref = LUA_NOREF;
+        TAILQ_INIT(&ctx->sigPlanCache);
+        ctx->msgPoolRef = LUA_NOREF;
+        ctx->shapeCacheRef = LUA_NOREF;
+        ctx->msgHeaderKeysRef = LUA_NOREF;
+        ctx->msgLive.gcStepKb = L2DBUS_MESSAGE_LIVE_GC_STEP;
+        ctx->introspectGen = 1;
+        l2dbus_statsInit(&ctx->stats);
+
+        L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Created context (userdata=%p)", ctx));
+        gCurrentContext = ctx;
+        gCurrentRegistry = ctx->registry;
+    }
+
+    return ctx;
+}
+
+
+/**
+ * @brief Returns the module context of a Lua state.
+ *
+ * The context (if any) also becomes the current context of the calling
+ * thread.
+ *
+ * @param [in] L The Lua state (or any of its threads).
+ * @return The context of the Lua state or NULL if the module has not
+ * been loaded by it.
+ */
+l2dbus_Context*
+l2dbus_contextGet
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* ctx;
+    const void* registry = lua_topointer(L, LUA_REGISTRYINDEX);
+
+    /* Nearly every call comes from the Lua state that owns the current
+     * context so only look up the context when the state differs.
+     */
+    if ( (NULL != gCurrentContext) && (registry == gCurrentRegistry) )
+    {
+        return gCurrentContext;
+    }
+
+    lua_pushlightuserdata(L, (void*)&gContextKey);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    ctx = (l2dbus_Context*)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    if ( NULL != ctx )
+    {
+        gCurrentContext = ctx;
+        gCurrentRegistry = registry;
+    }
+
+    return ctx;
+}
+
+
+/**
+ * @brief Returns the current module context of the calling thread.
+ *
+ * This is the context of the Lua state that last entered the module on
+ * this thread and is intended for code (such as CDBUS callbacks) that is
+ * not handed a Lua state.
+ *
+ * @return The current context or NULL if there isn't one.
+ */
+l2dbus_Context*
+l2dbus_contextCurrent(void)
+{
+    return gCurrentContext;
+}
@@ -0,0 +1,115 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_context.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the per Lua state module context.
+ *===========================================================================
+ */
+#ifndef L2DBUS_CONTEXT_H_
+#define L2DBUS_CONTEXT_H_
+
+#include "lua.h"
+#include "queue.h"
+#include "l2dbus_types.h"
+#include "l2dbus_object.h"
+#include "l2dbus_message.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_tracering.h"
+#include "l2dbus_strpool.h"
+#include "l2dbus_watchdog.h"
+
+/* Number of hash buckets for the shared introspection XML fragments */
+#define L2DBUS_INTROSPECTION_FRAGMENT_BUCKETS   (256)
+
+/* The metatable of a module type cached when the type is registered */
+typedef struct l2dbus_MetaTable
+{
+    /* Registry reference used to push the metatable */
+    int                         ref;
+    /* Identity of the metatable for fast type checks */
+    const void*                 table;
+} l2dbus_MetaTable;
+
+/* Forward declarations */
+struct l2dbus_SigPlan;
+struct l2dbus_XmlFragment;
+
+/*
+ * The state of the module for a single Lua state (VM). Each Lua state that
+ * loads the module gets its own context so independent VMs (e.g. running
+ * on their own threads) can use the module at the same time.
+ */
+typedef struct l2dbus_Context
+{
+    /* Identifies the Lua state (shared by all its threads) */
+    const void*                 registry;
+    /* The metatables of the module types indexed by l2dbus_TypeId */
+    l2dbus_MetaTable            metaTables[L2DBUS_END_TYPE_ID];
+    /* The Lua thread used to run all callbacks */
+    lua_State*                  callbackThread;
+    int                         callbackRef;
+    /* Reference to the userdata tracking the lifetime of the module */
+    int                         finalizerRef;
+    /* The trace levels enabled for this Lua state */
+    unsigned                    traceMask;
+    /* Maps C pointers to their (weakly held) Lua objects */
+    l2dbus_ObjectRegistry       objReg;
+    /* LRU cache of compiled signature plans (most recently used first) */
+    TAILQ_HEAD(l2dbus_SigPlanHead,
+                  l2dbus_SigPlan) sigPlanCache;
+    unsigned                    sigPlanCacheCount;
+    /* Message wrappers lent to callbacks using borrowed delivery */
+    int                         msgPoolRef;
+    l2dbus_Message*             msgPoolWrappers[L2DBUS_MESSAGE_POOL_SIZE];
+    l2dbus_Bool                 msgPoolInUse[L2DBUS_MESSAGE_POOL_SIZE];
+    /* The D-Bus messages owned by Message wrappers */
+    l2dbus_MessageLive          msgLive;
+    /* Header strings interned for Message:getHeader and the field names */
+    l2dbus_MessageIntern        msgIntern[L2DBUS_MESSAGE_INTERN_SLOTS];
+    int                         msgHeaderKeysRef;
+    /* Weak-keyed table of the signatures cached by Message.cacheShape */
+    int                         shapeCacheRef;
+    /* Identical interface XML fragments are shared between interfaces */
+    struct l2dbus_XmlFragment*  fragments[L2DBUS_INTROSPECTION_FRAGMENT_BUCKETS];
+    /* Names and signatures shared by the metadata of all interfaces */
+    l2dbus_StrPool              strPool;
+    /* Incremented whenever the metadata of any interface changes */
+    unsigned                    introspectGen;
+    /* Runtime metrics of this Lua state */
+    l2dbus_Stats                stats;
+    /* Accounts the time spent in each Lua callback handler */
+    l2dbus_Watchdog             watchdog;
+    /* Sampled records of the messages sent and received */
+    l2dbus_TraceRing            traceRing;
+} l2dbus_Context;
+
+l2dbus_Context* l2dbus_contextNew(lua_State* L);
+l2dbus_Context* l2dbus_contextGet(lua_State* L);
+l2dbus_Context* l2dbus_contextCurrent(void);
+
+#endif /* Guard for L2DBUS_CONTEXT_H_ */
@@ -44,6 +44,8 @@
 #include "l2dbus_message.h"
 #include "l2dbus_watch.h"
 #include "l2dbus_timeout.h"
+#include "l2dbus_timerwheel.h"
+#include "l2dbus_channel.h"
 #include "l2dbus_trace.h"
 #include "l2dbus_util.h"
 #include "l2dbus_callback.h"
@@ -53,6 +55,18 @@
 #include "l2dbus_serviceobject.h"
 #include "l2dbus_interface.h"
 #include "l2dbus_introspection.h"
+#include "l2dbus_objmanager.h"
+#include "l2dbus_rawvariant.h"
+#include "l2dbus_argcursor.h"
+#include "l2dbus_sigplan.h"
+#include "l2dbus_shape.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_context.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_tracering.h"
+#include "l2dbus_server.h"
+#include "l2dbus_shm.h"
+#include "l2dbus_buffer.h"
 
 /**
 The low-level L2DBUS core module.
@@ -66,6 +80,8 @@ required.
 The following namespaces are created when the *l2dbus* module is loaded:
 </br>
 <ul>
+<li>l2dbus.Buffer</li>
+<li>l2dbus.Channel</li>
 <li>l2dbus.Connection</li>
 <li>l2dbus.Dbus</li>
 <li>l2dbus.DbusTypes</li>
@@ -73,12 +89,20 @@ The following namespaces are created when the *l2dbus* module is loaded:
 <li>l2dbus.Int64</li>
 <li>l2dbus.Interface</li>
 <li>l2dbus.Introspection</li>
+<li>l2dbus.ObjectManager</li>
 <li>l2dbus.Match</li>
 <li>l2dbus.Message</li>
 <li>l2dbus.PendingCall</li>
+<li>l2dbus.RawVariant</li>
+<li>l2dbus.ArgCursor</li>
+<li>l2dbus.Server</li>
+<li>l2dbus.SharedMemory</li>
 <li>l2dbus.ServiceObject</li>
+<li>l2dbus.Stats</li>
 <li>l2dbus.Timeout</li>
+<li>l2dbus.TimerWheel</li>
 <li>l2dbus.Trace</li>
+<li>l2dbus.TraceRing</li>
 <li>l2dbus.Uint64</li>
 <li>l2dbus.Watch</li>
 </ul>
@@ -96,18 +120,6 @@ The following namespaces are created when the *l2dbus* module is loaded:
 #define L2DBUS_SHUTDOWN_CDBUS
 
 
-/**
- * @brief Used to track the lifetime of the module
- *
- * Initially the module is not initialized until it's
- * loaded by Lua. This variable references a global
- * Lua userdata item that should be GC'ed when the
- * module is unloaded or the VM shuts down.
- *
- */
-static l2dbus_Bool gModuleFinalizerRef = LUA_NOREF;
-
-
 /**
  * @brief Shuts down the underlying CDBUS library.
  *
@@ -158,10 +170,15 @@ l2dbus_shutdown
     lua_State*  L
     )
 {
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Shutting down l2dbus_core"));
 
-    l2dbus_moduleFinalizerUnref(L, gModuleFinalizerRef);
-    gModuleFinalizerRef = LUA_NOREF;
+    if ( NULL != ctx )
+    {
+        l2dbus_moduleFinalizerUnref(L, ctx->finalizerRef);
+        ctx->finalizerRef = LUA_NOREF;
+    }
 
     return 0;
 }
@@ -303,6 +320,29 @@ l2dbus_getLocalMachineId
 }
 
 
+/**
+ @function monotonicTime
+
+ Returns the time from a monotonic clock.
+
+ The time is measured from an arbitrary, fixed point in the past and is
+ unaffected by changes to the system time. It is intended for measuring
+ time intervals (e.g. latencies) rather than telling the time of day.
+
+ @treturn number The monotonic time in seconds (including the fraction of
+ a second).
+ */
+static int
+l2dbus_getMonotonicTime
+    (
+    lua_State*  L
+    )
+{
+    lua_pushnumber(L, l2dbus_monotonicTime());
+    return 1;
+}
+
+
 /**
  * @brief Adds a reference to the global module finalizer userdata.
  *
@@ -320,13 +360,17 @@ l2dbus_moduleFinalizerRef
     struct lua_State*  L
     )
 {
-    lua_rawgeti(L, LUA_REGISTRYINDEX, gModuleFinalizerRef);
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX,
+                (NULL != ctx) ? ctx->finalizerRef : LUA_NOREF);
     if ( LUA_TUSERDATA == lua_type(L, -1) )
     {
         return luaL_ref(L, LUA_REGISTRYINDEX);
     }
     else
     {
+        lua_pop(L, 1);
         L2DBUS_TRACE((L2DBUS_TRC_ERROR,
             "Trying to reference the module finalizer after it's been released"));
         return LUA_NOREF;
@@ -373,6 +417,10 @@ l2dbus_moduleFinalizerDispose
     )
 {
     void* p = lua_touserdata(L, -1);
+
+    /* Make this Lua state's context the current one */
+    l2dbus_contextGet(L);
+
     /* This *should* be the last thing destroyed by the module */
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: module finalizer (userdata=%p)", p));
     l2dbus_shutdownCdbus();
@@ -381,6 +429,15 @@ l2dbus_moduleFinalizerDispose
      * needed to cleanly shutdown CDBUS.
      */
     l2dbus_callbackShutdown(L);
+
+    /* Release any compiled signature plans held by the cache */
+    l2dbus_sigPlanFlushCache();
+
+    /* Release the memo of table shapes */
+    l2dbus_shapeShutdown();
+
+    /* Release the transient allocation arena */
+    l2dbus_arenaShutdown();
     return 0;
 }
 
@@ -389,6 +446,7 @@ static const luaL_Reg l2dbus_coreMetaTable[] =
 {
     {"getVersion", l2dbus_getVersion},
     {"machineId", l2dbus_getLocalMachineId},
+    {"monotonicTime", l2dbus_getMonotonicTime},
     {"shutdown", l2dbus_shutdown},
     {NULL, NULL},
 };
@@ -438,7 +496,9 @@ l2dbus_checkModuleInitialized
     struct lua_State*   L
     )
 {
-    if ( gModuleFinalizerRef == LUA_NOREF )
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
+    if ( (NULL == ctx) || (LUA_NOREF == ctx->finalizerRef) )
     {
         luaL_error(L, "l2dbus core module is not initialized!");
     }
@@ -451,8 +511,15 @@ luaopen_l2dbus_core
     lua_State* L
     )
 {
+    l2dbus_Context* ctx;
+
     luaL_checkversion(L);
 
+    /* Create (or find) the module state for this Lua state. This must
+     * happen first since the rest of the module depends on it.
+     */
+    ctx = l2dbus_contextNew(L);
+
     /* Set the default trace level */
 #ifdef DEBUG
     l2dbus_traceSetMask(L2DBUS_TRC_FATAL |
@@ -491,6 +558,12 @@ luaopen_l2dbus_core
     l2dbus_openTrace(L);
     lua_setfield(L, -2, "Trace");
 
+    l2dbus_openStats(L);
+    lua_setfield(L, -2, "Stats");
+
+    l2dbus_openTraceRing(L);
+    lua_setfield(L, -2, "TraceRing");
+
     l2dbus_openDbus(L);
     lua_setfield(L, -2, "Dbus");
 
@@ -502,6 +575,12 @@ luaopen_l2dbus_core
      * so there is no need to register a table
      */
 
+    l2dbus_openRawVariant(L);
+    /* Raw variants are only created by unmarshalling */
+
+    l2dbus_openArgCursor(L);
+    /* Cursors are only created by Message:iterArgs */
+
     l2dbus_openInt64(L);
     lua_setfield(L, -2, "Int64");
 
@@ -514,15 +593,30 @@ luaopen_l2dbus_core
     l2dbus_openTimeout(L);
     lua_setfield(L, -2, "Timeout");
 
+    l2dbus_openTimerWheel(L);
+    lua_setfield(L, -2, "TimerWheel");
+
     l2dbus_openWatch(L);
     lua_setfield(L, -2, "Watch");
 
+    l2dbus_openChannel(L);
+    lua_setfield(L, -2, "Channel");
+
+    l2dbus_openBuffer(L);
+    lua_setfield(L, -2, "Buffer");
+
     l2dbus_openMessage(L);
     lua_setfield(L, -2, "Message");;
 
     l2dbus_openConnectionLib(L);
     lua_setfield(L, -2, "Connection");
 
+    l2dbus_openServer(L);
+    lua_setfield(L, -2, "Server");
+
+    l2dbus_openSharedMemory(L);
+    lua_setfield(L, -2, "SharedMemory");
+
     l2dbus_openServiceObject(L);
     lua_setfield(L, -2, "ServiceObject");
 
@@ -533,12 +627,15 @@ luaopen_l2dbus_core
     l2dbus_openIntrospection(L);
     lua_setfield(L, -2, "Introspection");
 
+    l2dbus_openObjectManager(L);
+    lua_setfield(L, -2, "ObjectManager");
+
 
     /* The module has been successfully initialized */
     l2dbus_objectNew(L, 0, L2DBUS_MODULE_FINALIZER_TYPE_ID);
     L2DBUS_TRACE((L2DBUS_TRC_INFO, "Created module finalizer instance (userdata=%p)",
                 lua_touserdata(L, -1)));
-    gModuleFinalizerRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    ctx->finalizerRef = luaL_ref(L, LUA_REGISTRYINDEX);
 
     return 1;
 }
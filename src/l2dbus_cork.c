@@ -0,0 +1,469 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_cork.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of corked (deferred) message transmission.
+ *===========================================================================
+ */
+#include <assert.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_cork.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_dispatcher.h"
+#include "l2dbus_core.h"
+#include "l2dbus_util.h"
+#include "l2dbus_object.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_tracering.h"
+#include "lauxlib.h"
+
+/* The number of messages a corked connection can initially hold */
+#define L2DBUS_CORK_INITIAL_CAPACITY    (16)
+/* The end-of-dispatch flush runs as soon as the main loop is idle */
+#define L2DBUS_CORK_FLUSH_MSEC          (0)
+
+
+/**
+ * @brief Computes the size of a message on the wire.
+ *
+ * libdbus does not expose the length of a message so it is marshalled
+ * (and the copy discarded). This is only done when a byte limit is set.
+ *
+ * @param [in] msg The message to measure.
+ * @return The size (in bytes) of the marshalled message or zero if it
+ * could not be computed.
+ */
+static unsigned
+l2dbus_corkMessageSize
+    (
+    DBusMessage*    msg
+    )
+{
+    char* data = NULL;
+    int len = 0;
+
+    if ( !dbus_message_marshal(msg, &data, &len) )
+    {
+        len = 0;
+    }
+    dbus_free(data);
+
+    return (unsigned)len;
+}
+
+
+/**
+ * @brief Enables (or disables) the end-of-dispatch flush of a connection.
+ *
+ * @param [in] connUd The corked connection.
+ * @param [in] armed  L2DBUS_TRUE to arm the flush, L2DBUS_FALSE to disarm it.
+ */
+static void
+l2dbus_corkArm
+    (
+    l2dbus_Connection*  connUd,
+    l2dbus_Bool         armed
+    )
+{
+    if ( (NULL == connUd->corkTimeout) || (armed == connUd->corkArmed) )
+    {
+        return;
+    }
+
+    /* Re-arming a one-shot timeout requires it be disabled first */
+    cdbus_timeoutEnable(connUd->corkTimeout, CDBUS_FALSE);
+    connUd->corkArmed = L2DBUS_FALSE;
+    if ( armed )
+    {
+        if ( CDBUS_FAILED(cdbus_timeoutEnable(connUd->corkTimeout,
+                                            CDBUS_TRUE)) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                "Failed to arm the connection flush timeout"));
+        }
+        else
+        {
+            connUd->corkArmed = L2DBUS_TRUE;
+        }
+    }
+}
+
+
+/**
+ * @brief Writes the messages held during a main loop iteration.
+ *
+ * @param [in] t      The CDBUS timeout instance.
+ * @param [in] user   The corked connection.
+ * @return A boolean value that is currently unused by CDBUS.
+ */
+static cdbus_Bool
+l2dbus_corkFlushHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    l2dbus_Connection* connUd = (l2dbus_Connection*)user;
+
+    assert( NULL != t );
+    assert( NULL != connUd );
+
+    connUd->corkArmed = L2DBUS_FALSE;
+    l2dbus_corkRelease(connUd, L2DBUS_TRUE);
+
+    return CDBUS_TRUE;
+}
+
+
+/**
+ * @brief Holds a message on a corked connection.
+ *
+ * The message is referenced and handed to D-Bus the next time the held
+ * messages are released. Reaching either limit of the cork releases
+ * (and flushes) the held messages immediately.
+ *
+ * @param [in] connUd The corked connection.
+ * @param [in] msg    The message to hold.
+ * @return Returns L2DBUS_TRUE if the message is held (or was released)
+ * and L2DBUS_FALSE if it could not be held and should be sent directly.
+ */
+l2dbus_Bool
+l2dbus_corkHold
+    (
+    l2dbus_Connection*  connUd,
+    DBusMessage*        msg
+    )
+{
+    DBusMessage** held;
+    unsigned capacity;
+
+    if ( connUd->nCorked == connUd->corkCapacity )
+    {
+        capacity = (0 == connUd->corkCapacity) ?
+                    L2DBUS_CORK_INITIAL_CAPACITY : 2 * connUd->corkCapacity;
+        held = (DBusMessage**)l2dbus_realloc(connUd->corkedMsgs,
+                                            capacity * sizeof(*held));
+        if ( NULL == held )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_WARN,
+                "Cannot hold message on corked connection - sending now"));
+            l2dbus_corkRelease(connUd, L2DBUS_FALSE);
+            return L2DBUS_FALSE;
+        }
+        connUd->corkedMsgs = held;
+        connUd->corkCapacity = capacity;
+    }
+
+    if ( 0 < connUd->corkMaxBytes )
+    {
+        connUd->corkedBytes += l2dbus_corkMessageSize(msg);
+    }
+    connUd->corkedMsgs[connUd->nCorked++] = dbus_message_ref(msg);
+
+    if ( ((0 < connUd->corkMaxMsgs) &&
+            (connUd->nCorked >= connUd->corkMaxMsgs)) ||
+        ((0 < connUd->corkMaxBytes) &&
+            (connUd->corkedBytes >= connUd->corkMaxBytes)) )
+    {
+        l2dbus_corkRelease(connUd, L2DBUS_TRUE);
+    }
+    else if ( connUd->corkAutoFlush && !connUd->corkArmed )
+    {
+        l2dbus_corkArm(connUd, L2DBUS_TRUE);
+    }
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Hands the messages held by a connection to D-Bus.
+ *
+ * The messages are queued in the order they were sent and are counted
+ * (and traced) as they are queued. The connection stays corked.
+ *
+ * @param [in] connUd The connection holding the messages.
+ * @param [in] flush  If L2DBUS_TRUE block until the outgoing queue is
+ * written once all the messages are queued.
+ * @return The number of messages queued.
+ */
+unsigned
+l2dbus_corkRelease
+    (
+    l2dbus_Connection*  connUd,
+    l2dbus_Bool         flush
+    )
+{
+    DBusConnection* dbusConn;
+    DBusMessage* msg;
+    l2dbus_Bool queued;
+    unsigned nQueued = 0;
+    unsigned idx;
+
+    l2dbus_corkArm(connUd, L2DBUS_FALSE);
+    if ( (0 == connUd->nCorked) || (NULL == connUd->conn) )
+    {
+        return 0;
+    }
+
+    dbusConn = cdbus_connectionGetDBus(connUd->conn);
+    for ( idx = 0; idx < connUd->nCorked; ++idx )
+    {
+        msg = connUd->corkedMsgs[idx];
+        queued = dbus_connection_send(dbusConn, msg, NULL);
+        l2dbus_statsCountSent(&connUd->stats, msg, queued);
+        if ( queued )
+        {
+            l2dbus_traceRingRecord(connUd, msg, L2DBUS_TRACE_RING_SENT);
+            L2DBUS_TRACE_MSG((L2DBUS_TRC_TRACE, msg));
+            ++nQueued;
+        }
+        else
+        {
+            L2DBUS_TRACE_MSG((L2DBUS_TRC_ERROR, msg));
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Failed to send held message"));
+        }
+        dbus_message_unref(msg);
+    }
+    connUd->nCorked = 0;
+    connUd->corkedBytes = 0;
+
+    if ( flush && (0 < nQueued) )
+    {
+        dbus_connection_flush(dbusConn);
+    }
+
+    return nQueued;
+}
+
+
+/**
+ * @brief Releases the resources of the cork of a connection.
+ *
+ * Any messages still held are handed to D-Bus (without blocking). This
+ * must be called before the CDBUS connection is closed.
+ *
+ * @param [in] connUd The connection being destroyed.
+ */
+void
+l2dbus_corkDispose
+    (
+    l2dbus_Connection*  connUd
+    )
+{
+    l2dbus_corkRelease(connUd, L2DBUS_FALSE);
+    if ( NULL != connUd->corkTimeout )
+    {
+        cdbus_timeoutEnable(connUd->corkTimeout, CDBUS_FALSE);
+        cdbus_timeoutUnref(connUd->corkTimeout);
+        connUd->corkTimeout = NULL;
+    }
+    l2dbus_free(connUd->corkedMsgs);
+    connUd->corkedMsgs = NULL;
+    connUd->corkCapacity = 0;
+    connUd->corked = L2DBUS_FALSE;
+}
+
+
+/**
+ @function cork
+ @within Connection
+
+ Holds back the messages sent with @{send} until the connection is uncorked.
+
+ libdbus tries to write every message as soon as it is queued. While the
+ connection is corked the messages sent with @{send} are instead held (in
+ order) and handed to D-Bus together when the connection is
+ @{uncork|uncorked}, when one of the limits below is reached or (in the
+ auto-flush mode) at the end of the current main loop iteration. Each
+ release ends with a single @{flush}. Sending with @{sendWithReply},
+ @{sendWithReplyAndBlock} or @{sendBatch} (and calling @{flush}) first
+ releases the held messages so the order of messages is preserved.
+
+ A message must not be modified once it has been sent. The optional
+ *options* table can contain the following fields:
+
+ <ul>
+ <li>*maxMessages* - Release the held messages once this many are held.
+ Zero (the default) means there is no limit.</li>
+ <li>*maxBytes*    - Release the held messages once they add up to at
+ least this many bytes. Zero (the default) means there is no limit.</li>
+ <li>*autoFlush*   - If **true** everything held during one iteration of
+ the main loop is released at the end of the iteration. The default is
+ **false**.</li>
+ </ul>
+
+ Corking a connection that is already corked replaces its options.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam ?table options Options controlling when held messages are released.
+ @see uncork
+ */
+int
+l2dbus_connectionCork
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    lua_Number maxMsgs = 0;
+    lua_Number maxBytes = 0;
+    l2dbus_Bool autoFlush = L2DBUS_FALSE;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    if ( !lua_isnoneornil(L, 2) )
+    {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_getfield(L, 2, "maxMessages");
+        maxMsgs = luaL_optnumber(L, -1, 0);
+        lua_getfield(L, 2, "maxBytes");
+        maxBytes = luaL_optnumber(L, -1, 0);
+        lua_getfield(L, 2, "autoFlush");
+        autoFlush = lua_toboolean(L, -1) ? L2DBUS_TRUE : L2DBUS_FALSE;
+        lua_pop(L, 3);
+    }
+
+    if ( (maxMsgs < 0) || (maxBytes < 0) )
+    {
+        luaL_error(L, "The cork limits cannot be negative");
+    }
+
+    /* The flush timeout is created the first time it's needed */
+    if ( autoFlush && (NULL == connUd->corkTimeout) )
+    {
+        connUd->corkTimeout = cdbus_timeoutNew(connUd->dispUd->disp,
+                                    L2DBUS_CORK_FLUSH_MSEC, CDBUS_FALSE,
+                                    l2dbus_corkFlushHandler, connUd);
+        if ( NULL == connUd->corkTimeout )
+        {
+            luaL_error(L, "Failed to allocate the connection flush timeout");
+        }
+    }
+
+    connUd->corked = L2DBUS_TRUE;
+    connUd->corkAutoFlush = autoFlush;
+    connUd->corkMaxMsgs = (unsigned)maxMsgs;
+    connUd->corkMaxBytes = (unsigned)maxBytes;
+
+    /* Apply the new options to the messages already held */
+    if ( !autoFlush )
+    {
+        l2dbus_corkArm(connUd, L2DBUS_FALSE);
+    }
+    else if ( 0 < connUd->nCorked )
+    {
+        l2dbus_corkArm(connUd, L2DBUS_TRUE);
+    }
+    if ( (0 < connUd->corkMaxMsgs) &&
+        (connUd->nCorked >= connUd->corkMaxMsgs) )
+    {
+        l2dbus_corkRelease(connUd, L2DBUS_TRUE);
+    }
+
+    return 0;
+}
+
+
+/**
+ @function uncork
+ @within Connection
+
+ Stops holding back messages and sends the ones that are held.
+
+ The held messages are handed to D-Bus in the order they were sent.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam ?bool flush If **true** (the default) block until the outgoing
+ queue is written once the held messages are queued.
+ @treturn number The number of held messages queued to be sent.
+ @see cork
+ */
+int
+l2dbus_connectionUncork
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_Bool flush;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    flush = lua_isnoneornil(L, 2) || lua_toboolean(L, 2);
+
+    connUd->corked = L2DBUS_FALSE;
+    lua_pushinteger(L, l2dbus_corkRelease(connUd, flush));
+
+    return 1;
+}
+
+
+/**
+ @function isCorked
+ @within Connection
+
+ Checks whether the connection holds back the messages sent with @{send}.
+
+ @tparam userdata conn The D-Bus connection object
+ @treturn bool Returns **true** if the connection is corked.
+ @treturn number The number of messages currently held.
+ @treturn number The size (in bytes) of the messages currently held. This
+ is only tracked when the cork has a byte limit, otherwise it is zero.
+ @see cork
+ */
+int
+l2dbus_connectionIsCorked
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    lua_pushboolean(L, connUd->corked);
+    lua_pushinteger(L, connUd->nCorked);
+    lua_pushinteger(L, connUd->corkedBytes);
+
+    return 3;
+}
@@ -0,0 +1,54 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_cork.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of corked (deferred) message transmission.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_CORK_H_
+#define L2DBUS_CORK_H_
+
+#include "lua.h"
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
+
+/* Forward declarations */
+struct l2dbus_Connection;
+
+l2dbus_Bool l2dbus_corkHold(struct l2dbus_Connection* connUd,
+                            DBusMessage* msg);
+unsigned l2dbus_corkRelease(struct l2dbus_Connection* connUd,
+                            l2dbus_Bool flush);
+void l2dbus_corkDispose(struct l2dbus_Connection* connUd);
+
+int l2dbus_connectionCork(lua_State* L);
+int l2dbus_connectionUncork(lua_State* L);
+int l2dbus_connectionIsCorked(lua_State* L);
+
+#endif /* Guard for L2DBUS_CORK_H_ */
@@ -24,6 +24,7 @@
  *===========================================================================
  */
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include "cdbus/cdbus.h"
 #include "l2dbus_compat.h"
@@ -63,6 +64,391 @@ const char L2DBUS_DBUS_MTBL_NAME[] = "l2dbus.dbus";
     lua_rawset(L, -3); \
     } while (0)
 
+#define L2DBUS_DBUS_FUNC(N, F) \
+    do { \
+    lua_pushcfunction(L, F); \
+    lua_setfield(L, -2, N); \
+    } while (0)
+
+#define L2DBUS_DBUS_MAX_NAME_LEN    (255)
+#define L2DBUS_IS_ALPHA(c)          ((((c) >= 'A') && ((c) <= 'Z')) || \
+                                    (((c) >= 'a') && ((c) <= 'z')) || \
+                                    ((c) == '_'))
+#define L2DBUS_IS_DIGIT(c)          (((c) >= '0') && ((c) <= '9'))
+
+
+/*
+ * The validators below operate directly on the (counted) Lua strings so
+ * they neither depend on the version of libdbus nor stop at embedded
+ * NUL characters (which are never valid in a D-Bus name).
+ */
+
+static l2dbus_Bool
+l2dbus_dbusIsUtf8
+    (
+    const char* text,
+    size_t      len
+    )
+{
+    const unsigned char* s = (const unsigned char*)text;
+    size_t i = 0;
+    dbus_uint64_t word;
+    unsigned n;
+    unsigned char c;
+
+    while ( i < len )
+    {
+        /* Fast path: skip over ASCII eight bytes at a time */
+        while ( (i + sizeof(word) <= len) )
+        {
+            memcpy(&word, s + i, sizeof(word));
+            if ( 0 != (word & 0x8080808080808080ULL) )
+            {
+                break;
+            }
+            i += sizeof(word);
+        }
+
+        if ( i >= len )
+        {
+            break;
+        }
+
+        c = s[i];
+        if ( c < 0x80U )
+        {
+            i++;
+            continue;
+        }
+        /* Continuation bytes and overlong two byte sequences */
+        else if ( c < 0xC2U )
+        {
+            return L2DBUS_FALSE;
+        }
+        else if ( c < 0xE0U )
+        {
+            n = 1;
+        }
+        else if ( c < 0xF0U )
+        {
+            n = 2;
+        }
+        /* Sequences beyond U+10FFFF */
+        else if ( c < 0xF5U )
+        {
+            n = 3;
+        }
+        else
+        {
+            return L2DBUS_FALSE;
+        }
+
+        /* Truncated sequence */
+        if ( i + n >= len )
+        {
+            return L2DBUS_FALSE;
+        }
+
+        /* Reject overlong encodings, UTF-16 surrogates, and values larger
+         * than U+10FFFF by restricting the second byte.
+         */
+        if ( ((0xE0U == c) && (s[i + 1] < 0xA0U)) ||
+            ((0xEDU == c) && (s[i + 1] > 0x9FU)) ||
+            ((0xF0U == c) && (s[i + 1] < 0x90U)) ||
+            ((0xF4U == c) && (s[i + 1] > 0x8FU)) )
+        {
+            return L2DBUS_FALSE;
+        }
+
+        for ( i = i + 1; n > 0; --n, ++i )
+        {
+            if ( 0x80U != (s[i] & 0xC0U) )
+            {
+                return L2DBUS_FALSE;
+            }
+        }
+    }
+
+    return L2DBUS_TRUE;
+}
+
+
+/* Validates dot separated names: interfaces, error names and bus names */
+static l2dbus_Bool
+l2dbus_dbusIsDottedName
+    (
+    const char*     name,
+    size_t          len,
+    l2dbus_Bool     isBusName
+    )
+{
+    l2dbus_Bool isUnique = L2DBUS_FALSE;
+    l2dbus_Bool atElemStart = L2DBUS_TRUE;
+    unsigned nElems = 1;
+    size_t i = 0;
+    char c;
+
+    if ( (0 == len) || (len > L2DBUS_DBUS_MAX_NAME_LEN) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    if ( isBusName && (':' == name[0]) )
+    {
+        isUnique = L2DBUS_TRUE;
+        i = 1;
+    }
+
+    for ( ; i < len; ++i )
+    {
+        c = name[i];
+        if ( '.' == c )
+        {
+            /* Elements cannot be empty */
+            if ( atElemStart )
+            {
+                return L2DBUS_FALSE;
+            }
+            atElemStart = L2DBUS_TRUE;
+            nElems++;
+        }
+        else if ( L2DBUS_IS_ALPHA(c) || (isBusName && ('-' == c)) )
+        {
+            atElemStart = L2DBUS_FALSE;
+        }
+        else if ( L2DBUS_IS_DIGIT(c) )
+        {
+            /* Only the elements of unique names may begin with a digit */
+            if ( atElemStart && !isUnique )
+            {
+                return L2DBUS_FALSE;
+            }
+            atElemStart = L2DBUS_FALSE;
+        }
+        else
+        {
+            return L2DBUS_FALSE;
+        }
+    }
+
+    return !atElemStart && (nElems >= 2);
+}
+
+
+static l2dbus_Bool
+l2dbus_dbusIsMember
+    (
+    const char* name,
+    size_t      len
+    )
+{
+    size_t i;
+
+    if ( (0 == len) || (len > L2DBUS_DBUS_MAX_NAME_LEN) ||
+        L2DBUS_IS_DIGIT(name[0]) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    for ( i = 0; i < len; ++i )
+    {
+        if ( !L2DBUS_IS_ALPHA(name[i]) && !L2DBUS_IS_DIGIT(name[i]) )
+        {
+            return L2DBUS_FALSE;
+        }
+    }
+
+    return L2DBUS_TRUE;
+}
+
+
+static l2dbus_Bool
+l2dbus_dbusIsObjectPath
+    (
+    const char* path,
+    size_t      len
+    )
+{
+    size_t i;
+
+    if ( (0 == len) || ('/' != path[0]) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    for ( i = 1; i < len; ++i )
+    {
+        if ( '/' == path[i] )
+        {
+            /* No empty elements and no trailing slash */
+            if ( ('/' == path[i - 1]) || (i + 1 == len) )
+            {
+                return L2DBUS_FALSE;
+            }
+        }
+        else if ( !L2DBUS_IS_ALPHA(path[i]) && !L2DBUS_IS_DIGIT(path[i]) )
+        {
+            return L2DBUS_FALSE;
+        }
+    }
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ @function isValidUtf8
+
+ Verifies a string is valid UTF-8 text according to RFC 3629.
+
+ ASCII text is checked eight bytes at a time.
+
+ @tparam any text The value to check.
+ @treturn bool Returns **true** if *text* is a string of valid UTF-8
+ text and **false** otherwise.
+ */
+static int
+l2dbus_dbusIsValidUtf8
+    (
+    lua_State*  L
+    )
+{
+    size_t len;
+    const char* text;
+
+    if ( LUA_TSTRING != lua_type(L, 1) )
+    {
+        lua_pushboolean(L, L2DBUS_FALSE);
+    }
+    else
+    {
+        text = lua_tolstring(L, 1, &len);
+        lua_pushboolean(L, l2dbus_dbusIsUtf8(text, len));
+    }
+    return 1;
+}
+
+
+/**
+ @function isValidBusName
+
+ Verifies a string is a valid (unique or well-known) D-Bus bus name.
+
+ @tparam any name The value to check.
+ @treturn bool Returns **true** if *name* is a valid bus name.
+ */
+static int
+l2dbus_dbusIsValidBusName
+    (
+    lua_State*  L
+    )
+{
+    size_t len;
+    const char* name;
+
+    if ( LUA_TSTRING != lua_type(L, 1) )
+    {
+        lua_pushboolean(L, L2DBUS_FALSE);
+    }
+    else
+    {
+        name = lua_tolstring(L, 1, &len);
+        lua_pushboolean(L, l2dbus_dbusIsDottedName(name, len, L2DBUS_TRUE));
+    }
+    return 1;
+}
+
+
+/**
+ @function isValidInterface
+
+ Verifies a string is a valid D-Bus interface (or error) name.
+
+ @tparam any name The value to check.
+ @treturn bool Returns **true** if *name* is a valid interface name.
+ */
+static int
+l2dbus_dbusIsValidInterface
+    (
+    lua_State*  L
+    )
+{
+    size_t len;
+    const char* name;
+
+    if ( LUA_TSTRING != lua_type(L, 1) )
+    {
+        lua_pushboolean(L, L2DBUS_FALSE);
+    }
+    else
+    {
+        name = lua_tolstring(L, 1, &len);
+        lua_pushboolean(L, l2dbus_dbusIsDottedName(name, len, L2DBUS_FALSE));
+    }
+    return 1;
+}
+
+
+/**
+ @function isValidMember
+
+ Verifies a string is a valid D-Bus member (method or signal) name.
+
+ @tparam any name The value to check.
+ @treturn bool Returns **true** if *name* is a valid member name.
+ */
+static int
+l2dbus_dbusIsValidMember
+    (
+    lua_State*  L
+    )
+{
+    size_t len;
+    const char* name;
+
+    if ( LUA_TSTRING != lua_type(L, 1) )
+    {
+        lua_pushboolean(L, L2DBUS_FALSE);
+    }
+    else
+    {
+        name = lua_tolstring(L, 1, &len);
+        lua_pushboolean(L, l2dbus_dbusIsMember(name, len));
+    }
+    return 1;
+}
+
+
+/**
+ @function isValidObjectPath
+
+ Verifies a string is a valid D-Bus object path.
+
+ @tparam any path The value to check.
+ @treturn bool Returns **true** if *path* is a valid object path.
+ */
+static int
+l2dbus_dbusIsValidObjectPath
+    (
+    lua_State*  L
+    )
+{
+    size_t len;
+    const char* path;
+
+    if ( LUA_TSTRING != lua_type(L, 1) )
+    {
+        lua_pushboolean(L, L2DBUS_FALSE);
+    }
+    else
+    {
+        path = lua_tolstring(L, 1, &len);
+        lua_pushboolean(L, l2dbus_dbusIsObjectPath(path, len));
+    }
+    return 1;
+}
+
+
 /**
  * @brief Called by Lua VM to GC/reclaim the D-Bus userdata.
  *
@@ -565,6 +951,16 @@ l2dbus_openDbus
  The message meta data does not match the payload.
  */
     L2DBUS_DBUS_STRING_CONST(ERROR_INCONSISTENT_MESSAGE);
+
+    /*
+     * Native validators
+     */
+    L2DBUS_DBUS_FUNC("isValidUtf8", l2dbus_dbusIsValidUtf8);
+    L2DBUS_DBUS_FUNC("isValidBusName", l2dbus_dbusIsValidBusName);
+    L2DBUS_DBUS_FUNC("isValidInterface", l2dbus_dbusIsValidInterface);
+    L2DBUS_DBUS_FUNC("isValidErrorName", l2dbus_dbusIsValidInterface);
+    L2DBUS_DBUS_FUNC("isValidMember", l2dbus_dbusIsValidMember);
+    L2DBUS_DBUS_FUNC("isValidObjectPath", l2dbus_dbusIsValidObjectPath);
 }
 
 
@@ -34,5 +34,12 @@
 #define L2DBUS_META_TYPE_ID_FIELD   "__typeId"
 #define L2DBUS_META_TYPE_NAME_FIELD "__type"
 
+/* Storage class of variables that have a separate instance per thread */
+#if defined(_MSC_VER)
+#define L2DBUS_THREAD_LOCAL __declspec(thread)
+#else
+#define L2DBUS_THREAD_LOCAL __thread
+#endif
+
 
 #endif /* Guard for L2DBUS_DEFS_H_ */
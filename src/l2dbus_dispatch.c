@@ -0,0 +1,457 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_dispatch.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of a method dispatch index for service objects.
+ *===========================================================================
+ */
+#include <string.h>
+#include "l2dbus_compat.h"
+#include "l2dbus_dispatch.h"
+#include "l2dbus_alloc.h"
+#include "lauxlib.h"
+
+/* Initial number of buckets (must be a power of two) */
+#define L2DBUS_DISPATCH_INIT_BUCKETS    (16)
+
+
+/**
+ * @brief Computes the hash (FNV-1a) of a pair of strings.
+ *
+ * @param [in] first    The first string to hash.
+ * @param [in] second   The second string to hash (may be NULL).
+ * @return The computed hash value.
+ */
+static unsigned
+l2dbus_dispatchHash
+    (
+    const char* first,
+    const char* second
+    )
+{
+    unsigned hash = 2166136261U;
+
+    while ( '\0' != *first )
+    {
+        hash ^= (unsigned char)*first++;
+        hash *= 16777619U;
+    }
+
+    /* Hash the terminator so ("ab", "c") differs from ("a", "bc") */
+    hash *= 16777619U;
+
+    if ( NULL != second )
+    {
+        while ( '\0' != *second )
+        {
+            hash ^= (unsigned char)*second++;
+            hash *= 16777619U;
+        }
+    }
+
+    return hash;
+}
+
+
+/**
+ * @brief Doubles the number of buckets in the index.
+ *
+ * @return True if successful, false if memory could not be allocated.
+ */
+static l2dbus_Bool
+l2dbus_dispatchGrow
+    (
+    l2dbus_DispatchIndex*   index
+    )
+{
+    unsigned nBuckets = (0 == index->nBuckets) ? L2DBUS_DISPATCH_INIT_BUCKETS :
+                                                index->nBuckets * 2;
+    l2dbus_DispatchEntry** intfBuckets;
+    l2dbus_DispatchEntry** sigBuckets;
+    l2dbus_DispatchEntry* entry;
+    l2dbus_DispatchEntry* next;
+    unsigned idx;
+    unsigned slot;
+
+    intfBuckets = (l2dbus_DispatchEntry**)l2dbus_calloc(nBuckets,
+                                                    sizeof(*intfBuckets));
+    sigBuckets = (l2dbus_DispatchEntry**)l2dbus_calloc(nBuckets,
+                                                    sizeof(*sigBuckets));
+    if ( (NULL == intfBuckets) || (NULL == sigBuckets) )
+    {
+        l2dbus_free(intfBuckets);
+        l2dbus_free(sigBuckets);
+        return L2DBUS_FALSE;
+    }
+
+    /* Every entry is on exactly one chain of each kind */
+    for ( idx = 0; idx < index->nBuckets; ++idx )
+    {
+        for ( entry = index->intfBuckets[idx]; NULL != entry; entry = next )
+        {
+            next = entry->intfNext;
+            slot = entry->intfHash & (nBuckets - 1);
+            entry->intfNext = intfBuckets[slot];
+            intfBuckets[slot] = entry;
+        }
+
+        for ( entry = index->sigBuckets[idx]; NULL != entry; entry = next )
+        {
+            next = entry->sigNext;
+            slot = entry->sigHash & (nBuckets - 1);
+            entry->sigNext = sigBuckets[slot];
+            sigBuckets[slot] = entry;
+        }
+    }
+
+    l2dbus_free(index->intfBuckets);
+    l2dbus_free(index->sigBuckets);
+    index->intfBuckets = intfBuckets;
+    index->sigBuckets = sigBuckets;
+    index->nBuckets = nBuckets;
+
+    return L2DBUS_TRUE;
+}
+
+
+static void
+l2dbus_dispatchFreeEntry
+    (
+    l2dbus_DispatchEntry*   entry,
+    lua_State*              L
+    )
+{
+    luaL_unref(L, LUA_REGISTRYINDEX, entry->valueRef);
+    l2dbus_free(entry->intfName);
+    l2dbus_free(entry->member);
+    l2dbus_free(entry->inSig);
+    l2dbus_free(entry);
+}
+
+
+/**
+ * @brief Initializes an empty dispatch index.
+ *
+ * @param [in] index    The index to initialize.
+ */
+void
+l2dbus_dispatchInit
+    (
+    l2dbus_DispatchIndex*   index
+    )
+{
+    if ( NULL != index )
+    {
+        memset(index, 0, sizeof(*index));
+    }
+}
+
+
+/**
+ * @brief Frees all the entries of a dispatch index.
+ *
+ * Releases the references held on the Lua values associated with the
+ * entries. The index is left empty and may be re-used.
+ *
+ * @param [in] index    The index to free.
+ * @param [in] L        The Lua state.
+ */
+void
+l2dbus_dispatchFree
+    (
+    l2dbus_DispatchIndex*   index,
+    lua_State*              L
+    )
+{
+    unsigned idx;
+    l2dbus_DispatchEntry* entry;
+    l2dbus_DispatchEntry* next;
+
+    if ( NULL == index )
+    {
+        return;
+    }
+
+    for ( idx = 0; idx < index->nBuckets; ++idx )
+    {
+        for ( entry = index->intfBuckets[idx]; NULL != entry; entry = next )
+        {
+            next = entry->intfNext;
+            l2dbus_dispatchFreeEntry(entry, L);
+        }
+    }
+
+    l2dbus_free(index->intfBuckets);
+    l2dbus_free(index->sigBuckets);
+    l2dbus_dispatchInit(index);
+}
+
+
+/**
+ * @brief Associates a Lua value with an interface method.
+ *
+ * Any value previously associated with the interface/member is replaced.
+ *
+ * @param [in] index    The dispatch index.
+ * @param [in] L        The Lua state.
+ * @param [in] intfName The D-Bus interface name.
+ * @param [in] member   The D-Bus method name.
+ * @param [in] inSig    The input signature of the method.
+ * @param [in] valueIdx The stack index of the Lua value to associate.
+ * @return True if the value was added, false if out of memory.
+ */
+l2dbus_Bool
+l2dbus_dispatchAdd
+    (
+    l2dbus_DispatchIndex*   index,
+    lua_State*              L,
+    const char*             intfName,
+    const char*             member,
+    const char*             inSig,
+    int                     valueIdx
+    )
+{
+    l2dbus_DispatchEntry* entry;
+    unsigned slot;
+
+    valueIdx = lua_absindex(L, valueIdx);
+
+    /* Remove any existing association */
+    l2dbus_dispatchRemove(index, L, intfName, member);
+
+    if ( (index->nEntries >= index->nBuckets) && !l2dbus_dispatchGrow(index) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    entry = (l2dbus_DispatchEntry*)l2dbus_calloc(1, sizeof(*entry));
+    if ( NULL == entry )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    entry->intfName = l2dbus_strDup(intfName);
+    entry->member = l2dbus_strDup(member);
+    entry->inSig = l2dbus_strDup(inSig);
+    if ( (NULL == entry->intfName) || (NULL == entry->member) ||
+        (NULL == entry->inSig) )
+    {
+        l2dbus_free(entry->intfName);
+        l2dbus_free(entry->member);
+        l2dbus_free(entry->inSig);
+        l2dbus_free(entry);
+        return L2DBUS_FALSE;
+    }
+
+    lua_pushvalue(L, valueIdx);
+    entry->valueRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    entry->intfHash = l2dbus_dispatchHash(intfName, member);
+    entry->sigHash = l2dbus_dispatchHash(member, inSig);
+
+    slot = entry->intfHash & (index->nBuckets - 1);
+    entry->intfNext = index->intfBuckets[slot];
+    index->intfBuckets[slot] = entry;
+
+    slot = entry->sigHash & (index->nBuckets - 1);
+    entry->sigNext = index->sigBuckets[slot];
+    index->sigBuckets[slot] = entry;
+
+    index->nEntries++;
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Removes the value associated with an interface method.
+ *
+ * @param [in] index    The dispatch index.
+ * @param [in] L        The Lua state.
+ * @param [in] intfName The D-Bus interface name.
+ * @param [in] member   The D-Bus method name.
+ * @return True if an association was removed, false if none existed.
+ */
+l2dbus_Bool
+l2dbus_dispatchRemove
+    (
+    l2dbus_DispatchIndex*   index,
+    lua_State*              L,
+    const char*             intfName,
+    const char*             member
+    )
+{
+    l2dbus_DispatchEntry** link;
+    l2dbus_DispatchEntry* entry = NULL;
+    unsigned hash;
+
+    if ( 0 == index->nBuckets )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    hash = l2dbus_dispatchHash(intfName, member);
+    for ( link = &index->intfBuckets[hash & (index->nBuckets - 1)];
+        NULL != *link; link = &(*link)->intfNext )
+    {
+        if ( ((*link)->intfHash == hash) &&
+            (0 == strcmp((*link)->member, member)) &&
+            (0 == strcmp((*link)->intfName, intfName)) )
+        {
+            entry = *link;
+            *link = entry->intfNext;
+            break;
+        }
+    }
+
+    if ( NULL == entry )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    for ( link = &index->sigBuckets[entry->sigHash & (index->nBuckets - 1)];
+        NULL != *link; link = &(*link)->sigNext )
+    {
+        if ( entry == *link )
+        {
+            *link = entry->sigNext;
+            break;
+        }
+    }
+
+    l2dbus_dispatchFreeEntry(entry, L);
+    index->nEntries--;
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Removes all the methods of an interface.
+ *
+ * @param [in] index    The dispatch index.
+ * @param [in] L        The Lua state.
+ * @param [in] intfName The D-Bus interface name.
+ * @return True if any association was removed, false if none existed.
+ */
+l2dbus_Bool
+l2dbus_dispatchRemoveInterface
+    (
+    l2dbus_DispatchIndex*   index,
+    lua_State*              L,
+    const char*             intfName
+    )
+{
+    l2dbus_Bool removed = L2DBUS_FALSE;
+    l2dbus_DispatchEntry* entry;
+    unsigned idx;
+
+    for ( idx = 0; idx < index->nBuckets; ++idx )
+    {
+        entry = index->intfBuckets[idx];
+        while ( NULL != entry )
+        {
+            if ( 0 == strcmp(entry->intfName, intfName) )
+            {
+                /* Removal unlinks the entry so restart this bucket */
+                l2dbus_dispatchRemove(index, L, intfName, entry->member);
+                removed = L2DBUS_TRUE;
+                entry = index->intfBuckets[idx];
+            }
+            else
+            {
+                entry = entry->intfNext;
+            }
+        }
+    }
+
+    return removed;
+}
+
+
+/**
+ * @brief Finds the Lua value that should handle a request.
+ *
+ * If an interface name is provided the method is looked up by its
+ * interface and member name. Otherwise a method of any interface with a
+ * matching member name and input signature is selected.
+ *
+ * @param [in] index    The dispatch index.
+ * @param [in] intfName The D-Bus interface name of the request (or NULL).
+ * @param [in] member   The D-Bus member name of the request.
+ * @param [in] inSig    The signature of the request.
+ * @return The registry reference of the associated Lua value or
+ * LUA_NOREF if there is no match.
+ */
+int
+l2dbus_dispatchLookup
+    (
+    const l2dbus_DispatchIndex* index,
+    const char*                 intfName,
+    const char*                 member,
+    const char*                 inSig
+    )
+{
+    l2dbus_DispatchEntry* entry;
+    unsigned hash;
+
+    if ( (0 == index->nEntries) || (NULL == member) )
+    {
+        return LUA_NOREF;
+    }
+
+    if ( NULL != intfName )
+    {
+        hash = l2dbus_dispatchHash(intfName, member);
+        for ( entry = index->intfBuckets[hash & (index->nBuckets - 1)];
+            NULL != entry; entry = entry->intfNext )
+        {
+            if ( (entry->intfHash == hash) &&
+                (0 == strcmp(entry->member, member)) &&
+                (0 == strcmp(entry->intfName, intfName)) )
+            {
+                return entry->valueRef;
+            }
+        }
+    }
+    else
+    {
+        hash = l2dbus_dispatchHash(member, inSig);
+        for ( entry = index->sigBuckets[hash & (index->nBuckets - 1)];
+            NULL != entry; entry = entry->sigNext )
+        {
+            if ( (entry->sigHash == hash) &&
+                (0 == strcmp(entry->member, member)) &&
+                (0 == strcmp(entry->inSig, (NULL == inSig) ? "" : inSig)) )
+            {
+                return entry->valueRef;
+            }
+        }
+    }
+
+    return LUA_NOREF;
+}
@@ -0,0 +1,75 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_dispatch.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of a method dispatch index for service objects.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_DISPATCH_H_
+#define L2DBUS_DISPATCH_H_
+#include "lua.h"
+#include "l2dbus_types.h"
+
+typedef struct l2dbus_DispatchEntry
+{
+    char*                           intfName;
+    char*                           member;
+    char*                           inSig;
+    /* Registry reference to the Lua value associated with the method */
+    int                             valueRef;
+    unsigned                        intfHash;
+    unsigned                        sigHash;
+    /* Chain of entries hashed by (interface, member) */
+    struct l2dbus_DispatchEntry*    intfNext;
+    /* Chain of entries hashed by (member, input signature) */
+    struct l2dbus_DispatchEntry*    sigNext;
+} l2dbus_DispatchEntry;
+
+typedef struct l2dbus_DispatchIndex
+{
+    l2dbus_DispatchEntry**          intfBuckets;
+    l2dbus_DispatchEntry**          sigBuckets;
+    unsigned                        nBuckets;
+    unsigned                        nEntries;
+} l2dbus_DispatchIndex;
+
+void l2dbus_dispatchInit(l2dbus_DispatchIndex* index);
+void l2dbus_dispatchFree(l2dbus_DispatchIndex* index, lua_State* L);
+l2dbus_Bool l2dbus_dispatchAdd(l2dbus_DispatchIndex* index, lua_State* L,
+                                const char* intfName, const char* member,
+                                const char* inSig, int valueIdx);
+l2dbus_Bool l2dbus_dispatchRemove(l2dbus_DispatchIndex* index, lua_State* L,
+                                const char* intfName, const char* member);
+l2dbus_Bool l2dbus_dispatchRemoveInterface(l2dbus_DispatchIndex* index,
+                                lua_State* L, const char* intfName);
+int l2dbus_dispatchLookup(const l2dbus_DispatchIndex* index,
+                                const char* intfName, const char* member,
+                                const char* inSig);
+
+#endif /* Guard for L2DBUS_DISPATCH_H_ */
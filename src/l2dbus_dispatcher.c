@@ -43,6 +43,11 @@
 #include "l2dbus_types.h"
 #include "l2dbus_callback.h"
 #include "l2dbus_main-loop.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_match.h"
+#include "l2dbus_watch.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_predecode.h"
 
 /**
  The L2DBUS Event Dispatcher Object
@@ -77,6 +82,744 @@ l2dbus_dispatcherFinalized
 }
 
 
+/* The delay (in milliseconds) before deferred deliveries are resumed */
+#define L2DBUS_DISPATCH_DRAIN_MSEC  (0)
+
+/* Default number of higher priority deliveries before a lower lane's turn */
+#define L2DBUS_DISPATCH_STARVE_LIMIT    (16)
+
+/* A match delivery deferred because its connection exhausted its budget */
+typedef struct l2dbus_DeferredMatch
+{
+    l2dbus_Match*                       match;
+    DBusMessage*                        msg;
+    /* Only valid if the match conflates its deliveries */
+    l2dbus_MatchConflateKey             key;
+    TAILQ_ENTRY(l2dbus_DeferredMatch)   link;
+} l2dbus_DeferredMatch;
+
+
+/**
+ * @brief Initializes the deferred delivery state of a new connection.
+ *
+ * @param [in] connUd   The connection.
+ */
+void
+l2dbus_dispatcherInitConnection
+    (
+    l2dbus_Connection*  connUd
+    )
+{
+    unsigned lane;
+
+    for ( lane = 0; lane < L2DBUS_MATCH_PRIORITY_COUNT; ++lane )
+    {
+        TAILQ_INIT(&connUd->deferred[lane]);
+    }
+    connUd->laneStreak = 0;
+    connUd->starvedLane = L2DBUS_MATCH_PRIORITY_HIGH;
+}
+
+
+/**
+ * @brief Determines whether the lanes up to a given priority are empty.
+ *
+ * @param [in] connUd   The connection.
+ * @param [in] lowest   The lowest priority lane to check.
+ * @return Returns L2DBUS_TRUE if no delivery of this or a higher priority
+ * is deferred.
+ */
+static l2dbus_Bool
+l2dbus_dispatcherLanesEmpty
+    (
+    const l2dbus_Connection*    connUd,
+    l2dbus_MatchPriority        lowest
+    )
+{
+    unsigned lane;
+
+    for ( lane = 0; lane <= (unsigned)lowest; ++lane )
+    {
+        if ( !TAILQ_EMPTY(&connUd->deferred[lane]) )
+        {
+            return L2DBUS_FALSE;
+        }
+    }
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Removes the next deferred delivery of a connection.
+ *
+ * Deliveries are taken from the highest priority lane that isn't empty.
+ * Once *starveLimit* deliveries in a row have been taken from it while a
+ * lower lane was waiting, the next delivery is taken from a lower lane
+ * instead. The lower lanes take these turns in rotation so none of them
+ * is starved.
+ *
+ * @param [in] dispUd   The dispatcher (or NULL to ignore starvation).
+ * @param [in] connUd   The connection.
+ * @return The delivery or NULL if none are deferred.
+ */
+static l2dbus_DeferredMatch*
+l2dbus_dispatcherTakeDeferred
+    (
+    l2dbus_Dispatcher*  dispUd,
+    l2dbus_Connection*  connUd
+    )
+{
+    l2dbus_DeferredMatch* item;
+    unsigned highest = L2DBUS_MATCH_PRIORITY_COUNT;
+    unsigned lane;
+    l2dbus_Bool lowerWaiting = L2DBUS_FALSE;
+
+    for ( lane = 0; lane < L2DBUS_MATCH_PRIORITY_COUNT; ++lane )
+    {
+        if ( !TAILQ_EMPTY(&connUd->deferred[lane]) )
+        {
+            if ( L2DBUS_MATCH_PRIORITY_COUNT == highest )
+            {
+                highest = lane;
+            }
+            else
+            {
+                lowerWaiting = L2DBUS_TRUE;
+            }
+        }
+    }
+
+    if ( L2DBUS_MATCH_PRIORITY_COUNT == highest )
+    {
+        return NULL;
+    }
+
+    lane = highest;
+    if ( !lowerWaiting )
+    {
+        connUd->laneStreak = 0;
+    }
+    else if ( (NULL != dispUd) && (0 < dispUd->starveLimit) &&
+            (connUd->laneStreak >= dispUd->starveLimit) )
+    {
+        /* Rotate through the waiting lanes below the highest one */
+        lane = connUd->starvedLane;
+        do
+        {
+            lane = (lane + 1) % L2DBUS_MATCH_PRIORITY_COUNT;
+        }
+        while ( (lane <= highest) || TAILQ_EMPTY(&connUd->deferred[lane]) );
+        connUd->starvedLane = lane;
+        connUd->laneStreak = 0;
+    }
+    else
+    {
+        connUd->laneStreak++;
+    }
+
+    item = TAILQ_FIRST(&connUd->deferred[lane]);
+    TAILQ_REMOVE(&connUd->deferred[lane], item, link);
+
+    return item;
+}
+
+
+/**
+ * @brief Determines whether a connection has spent its dispatch budget.
+ *
+ * The budget of a connection is replenished whenever the dispatcher starts
+ * a new round of deferred deliveries.
+ *
+ * @param [in] dispUd   The dispatcher owning the budget.
+ * @param [in] connUd   The connection to check.
+ * @return Returns L2DBUS_TRUE if the connection may not deliver any more
+ * messages in this round.
+ */
+static l2dbus_Bool
+l2dbus_dispatcherBudgetSpent
+    (
+    l2dbus_Dispatcher*  dispUd,
+    l2dbus_Connection*  connUd
+    )
+{
+    if ( connUd->budgetGen != dispUd->budgetGen )
+    {
+        connUd->budgetGen = dispUd->budgetGen;
+        connUd->budgetMsgs = 0;
+        connUd->budgetSecs = 0.0;
+    }
+
+    return ((dispUd->maxMessages > 0) &&
+            (connUd->budgetMsgs >= dispUd->maxMessages)) ||
+           ((dispUd->maxSeconds > 0.0) &&
+            (connUd->budgetSecs >= dispUd->maxSeconds));
+}
+
+
+/**
+ * @brief Delivers a matched message and charges it to the connection.
+ *
+ * @param [in] dispUd   The dispatcher owning the budget.
+ * @param [in] connUd   The connection the message arrived on.
+ * @param [in] match    The match rule whose handler should be called.
+ * @param [in] msg      The D-Bus message that matched.
+ */
+static void
+l2dbus_dispatcherChargedDeliver
+    (
+    l2dbus_Dispatcher*  dispUd,
+    l2dbus_Connection*  connUd,
+    l2dbus_Match*       match,
+    DBusMessage*        msg
+    )
+{
+    double start = 0.0;
+
+    /* Only read the clock if there is a time budget to enforce */
+    if ( dispUd->maxSeconds > 0.0 )
+    {
+        start = l2dbus_monotonicTime();
+    }
+
+    connUd->budgetMsgs++;
+    l2dbus_matchDeliver(match, msg);
+
+    if ( dispUd->maxSeconds > 0.0 )
+    {
+        connUd->budgetSecs += l2dbus_monotonicTime() - start;
+    }
+}
+
+
+/**
+ * @brief Arms the timeout that resumes deferred deliveries.
+ *
+ * @param [in] dispUd   The dispatcher with deferred deliveries.
+ */
+static void
+l2dbus_dispatcherArmDrain
+    (
+    l2dbus_Dispatcher*  dispUd
+    )
+{
+    /* Re-arming a one-shot timeout requires it be disabled first */
+    cdbus_timeoutEnable(dispUd->drainTimeout, CDBUS_FALSE);
+    if ( CDBUS_FAILED(cdbus_timeoutEnable(dispUd->drainTimeout, CDBUS_TRUE)) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+            "Failed to arm the dispatcher drain timeout"));
+    }
+}
+
+
+/**
+ * @brief Resumes the deliveries deferred by the dispatch budget.
+ *
+ * Each connection with deferred deliveries gets a single turn, in
+ * round-robin order, to deliver messages until either its queue is empty
+ * or its replenished budget is spent. Connections with messages left over
+ * move to the back of the queue and the timeout is re-armed so the main
+ * loop can service other watches and timeouts in between rounds.
+ *
+ * @param [in] t      The CDBUS timeout instance.
+ * @param [in] user   The dispatcher.
+ * @return A boolean value that is currently unused by CDBUS.
+ */
+static cdbus_Bool
+l2dbus_dispatcherDrainHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    lua_State* L = l2dbus_callbackGetThread();
+    l2dbus_Dispatcher* dispUd = (l2dbus_Dispatcher*)user;
+    l2dbus_Connection* connUd;
+    l2dbus_DeferredMatch* item;
+    unsigned nTurns = 0;
+    int pinRef;
+
+    assert( NULL != t );
+    assert( NULL != L );
+    assert( NULL != dispUd );
+
+    /* Start a new round which replenishes the budget of every connection */
+    dispUd->budgetGen++;
+    TAILQ_FOREACH(connUd, &dispUd->backlog, backlogLink)
+    {
+        ++nTurns;
+    }
+
+    while ( (nTurns-- > 0) && !TAILQ_EMPTY(&dispUd->backlog) )
+    {
+        connUd = TAILQ_FIRST(&dispUd->backlog);
+        TAILQ_REMOVE(&dispUd->backlog, connUd, backlogLink);
+        connUd->inBacklog = L2DBUS_FALSE;
+
+        /* Anchor the connection in case a handler drops the last reference */
+        l2dbus_objectRegistryGet(L, connUd->conn);
+        pinRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+        while ( !l2dbus_dispatcherBudgetSpent(dispUd, connUd) &&
+                (NULL != (item = l2dbus_dispatcherTakeDeferred(dispUd,
+                                                                connUd))) )
+        {
+            dispUd->nDeferred--;
+            if ( NULL != item->match->conflate )
+            {
+                item->match->conflate->nQueued--;
+            }
+            l2dbus_dispatcherChargedDeliver(dispUd, connUd, item->match,
+                                            item->msg);
+            dbus_message_unref(item->msg);
+            l2dbus_free(item);
+        }
+
+        if ( !l2dbus_dispatcherLanesEmpty(connUd,
+                                        L2DBUS_MATCH_PRIORITY_COUNT - 1) &&
+            !connUd->inBacklog )
+        {
+            TAILQ_INSERT_TAIL(&dispUd->backlog, connUd, backlogLink);
+            connUd->inBacklog = L2DBUS_TRUE;
+        }
+
+        luaL_unref(L, LUA_REGISTRYINDEX, pinRef);
+    }
+
+    if ( !TAILQ_EMPTY(&dispUd->backlog) )
+    {
+        l2dbus_dispatcherArmDrain(dispUd);
+    }
+
+    return CDBUS_TRUE;
+}
+
+
+/**
+ * @brief Enables the deferral of match deliveries.
+ *
+ * Creates the timeout that resumes deferred deliveries (if it doesn't
+ * exist already). It's needed by a dispatch budget and by conflating
+ * matches.
+ *
+ * @param [in] dispUd   The dispatcher.
+ * @return Returns L2DBUS_FALSE if the timeout could not be allocated.
+ */
+l2dbus_Bool
+l2dbus_dispatcherEnableDeferral
+    (
+    l2dbus_Dispatcher*  dispUd
+    )
+{
+    if ( NULL == dispUd )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    if ( NULL == dispUd->drainTimeout )
+    {
+        dispUd->drainTimeout = cdbus_timeoutNew(dispUd->disp,
+                                    L2DBUS_DISPATCH_DRAIN_MSEC, CDBUS_FALSE,
+                                    l2dbus_dispatcherDrainHandler, dispUd);
+    }
+
+    return (NULL != dispUd->drainTimeout) ? L2DBUS_TRUE : L2DBUS_FALSE;
+}
+
+
+/**
+ * @brief Supersedes a deferred delivery with an equal conflation key.
+ *
+ * @param [in] connUd   The connection the message arrived on.
+ * @param [in] match    The conflating match rule.
+ * @param [in] msg      The D-Bus message that matched.
+ * @param [in] key      The conflation key of the message.
+ * @return Returns L2DBUS_TRUE if a deferred message was replaced by *msg*.
+ */
+static l2dbus_Bool
+l2dbus_dispatcherConflate
+    (
+    l2dbus_Connection*              connUd,
+    l2dbus_Match*                   match,
+    DBusMessage*                    msg,
+    const l2dbus_MatchConflateKey*  key
+    )
+{
+    l2dbus_DeferredMatch* item;
+
+    /* Avoid walking the queue if nothing of this match is waiting */
+    if ( 0 == match->conflate->nQueued )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    /* The newest deliveries are the most likely to be superseded */
+    TAILQ_FOREACH_REVERSE(item, &connUd->deferred[match->priority],
+                        l2dbus_DeferredHead, link)
+    {
+        if ( (item->match == match) &&
+            l2dbus_matchConflateEqual(&item->key, key) )
+        {
+            /* Keep the place in the queue but deliver the newest message */
+            dbus_message_unref(item->msg);
+            item->msg = dbus_message_ref(msg);
+            item->key = *key;
+            match->conflate->nConflated++;
+            l2dbus_statsCountConflated(&connUd->stats);
+            return L2DBUS_TRUE;
+        }
+    }
+
+    return L2DBUS_FALSE;
+}
+
+
+/**
+ * @brief Delivers or defers a matched message.
+ *
+ * The message is delivered immediately unless the connection it arrived
+ * on has spent its dispatch budget or already has deferred deliveries
+ * (which preserves the order of delivery). Deferred messages are
+ * referenced and delivered by a later round of the dispatcher. Messages
+ * of a conflating match are always deferred so that a newer message with
+ * the same key can supersede them before the handler is called.
+ *
+ * @param [in] match The match rule whose handler should be called.
+ * @param [in] msg The D-Bus message that matched.
+ */
+void
+l2dbus_dispatcherSubmitMatch
+    (
+    l2dbus_Match*   match,
+    DBusMessage*    msg
+    )
+{
+    l2dbus_Connection* connUd = match->connUd;
+    l2dbus_Dispatcher* dispUd = (NULL != connUd) ? connUd->dispUd : NULL;
+    l2dbus_DeferredMatch* item = NULL;
+    l2dbus_MatchConflateKey key;
+
+    if ( (NULL == dispUd) || (NULL == dispUd->drainTimeout) )
+    {
+        /* Deferral has never been enabled so take the fast path */
+        l2dbus_matchDeliver(match, msg);
+    }
+    else if ( (NULL == match->conflate) &&
+            (L2DBUS_MATCH_PRIORITY_BULK != match->priority) &&
+            l2dbus_dispatcherLanesEmpty(connUd, match->priority) &&
+            !l2dbus_dispatcherBudgetSpent(dispUd, connUd) )
+    {
+        l2dbus_dispatcherChargedDeliver(dispUd, connUd, match, msg);
+    }
+    else
+    {
+        if ( NULL != match->conflate )
+        {
+            l2dbus_matchConflateKey(match, msg, &key);
+            if ( l2dbus_dispatcherConflate(connUd, match, msg, &key) )
+            {
+                return;
+            }
+        }
+
+        item = (l2dbus_DeferredMatch*)l2dbus_malloc(sizeof(*item));
+        if ( NULL == item )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_WARN,
+                "Cannot defer match delivery - delivering immediately"));
+            l2dbus_dispatcherChargedDeliver(dispUd, connUd, match, msg);
+        }
+        else
+        {
+            item->match = match;
+            item->msg = dbus_message_ref(msg);
+            if ( NULL != match->conflate )
+            {
+                item->key = key;
+                match->conflate->nQueued++;
+            }
+            TAILQ_INSERT_TAIL(&connUd->deferred[match->priority], item, link);
+            dispUd->nDeferred++;
+
+            if ( !connUd->inBacklog )
+            {
+                TAILQ_INSERT_TAIL(&dispUd->backlog, connUd, backlogLink);
+                connUd->inBacklog = L2DBUS_TRUE;
+                if ( TAILQ_FIRST(&dispUd->backlog) == connUd )
+                {
+                    l2dbus_dispatcherArmDrain(dispUd);
+                }
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Discards the deferred deliveries of a match rule.
+ *
+ * This must be called before a match rule is destroyed.
+ *
+ * @param [in] match The match rule being destroyed.
+ */
+void
+l2dbus_dispatcherPurgeMatch
+    (
+    l2dbus_Match*   match
+    )
+{
+    l2dbus_Connection* connUd = match->connUd;
+    l2dbus_DeferredMatch* item;
+    l2dbus_DeferredMatch* next;
+
+    if ( NULL != connUd )
+    {
+        for ( item = TAILQ_FIRST(&connUd->deferred[match->priority]);
+            item != TAILQ_END(&connUd->deferred[match->priority]);
+            item = next )
+        {
+            next = TAILQ_NEXT(item, link);
+            if ( item->match == match )
+            {
+                TAILQ_REMOVE(&connUd->deferred[match->priority], item, link);
+                if ( NULL != connUd->dispUd )
+                {
+                    connUd->dispUd->nDeferred--;
+                }
+                dbus_message_unref(item->msg);
+                l2dbus_free(item);
+            }
+        }
+
+        if ( NULL != match->conflate )
+        {
+            match->conflate->nQueued = 0;
+        }
+    }
+}
+
+
+/**
+ * @brief Removes a connection from the queue of deferred deliveries.
+ *
+ * This must be called (after all its matches have been disposed)
+ * before a connection is destroyed.
+ *
+ * @param [in] connUd The connection being destroyed.
+ */
+void
+l2dbus_dispatcherRemoveConnection
+    (
+    l2dbus_Connection*  connUd
+    )
+{
+    if ( connUd->inBacklog && (NULL != connUd->dispUd) )
+    {
+        TAILQ_REMOVE(&connUd->dispUd->backlog, connUd, backlogLink);
+        connUd->inBacklog = L2DBUS_FALSE;
+    }
+}
+
+
+/**
+ * @brief Delivers the batched watch events to the batch handler.
+ *
+ * The events of every watch that became ready since the last batch are
+ * passed in a single Lua call. The arrays handed to the handler are
+ * re-used from one batch to the next.
+ *
+ * @param [in] t      The CDBUS timeout instance.
+ * @param [in] user   The dispatcher.
+ * @return A boolean value that is currently unused by CDBUS.
+ */
+static cdbus_Bool
+l2dbus_dispatcherBatchHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    lua_State* L = l2dbus_callbackGetThread();
+    l2dbus_Dispatcher* dispUd = (l2dbus_Dispatcher*)user;
+    const char* errMsg = "";
+    unsigned nBatch;
+    unsigned idx;
+    int nItems = 0;
+    int watchesIdx;
+    int masksIdx;
+    double cbStart;
+    int status;
+
+    assert( NULL != t );
+    assert( NULL != L );
+    assert( NULL != dispUd );
+
+    nBatch = dispUd->nBatch;
+    dispUd->nBatch = 0;
+    l2dbus_statsRecord(L2DBUS_STATS_HIST_WATCH_LAG, dispUd->batchQueuedAt);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, dispUd->batchCbCtx.funcRef);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, dispUd->batchWatchesRef);
+    watchesIdx = lua_gettop(L);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, dispUd->batchMasksRef);
+    masksIdx = lua_gettop(L);
+
+    for ( idx = 0; idx < nBatch; ++idx )
+    {
+        /* Watches collected since they were queued leave an empty slot */
+        if ( NULL == dispUd->batch[idx].watchUd )
+        {
+            continue;
+        }
+        dispUd->batch[idx].watchUd->batchSlot = -1;
+
+        if ( NULL == l2dbus_objectRegistryGet(L, dispUd->batch[idx].watchUd) )
+        {
+            lua_pop(L, 1);
+            continue;
+        }
+        ++nItems;
+        lua_rawseti(L, watchesIdx, nItems);
+        lua_pushinteger(L, dispUd->batch[idx].events);
+        lua_rawseti(L, masksIdx, nItems);
+    }
+
+    if ( (0 < nItems) && lua_isfunction(L, watchesIdx - 1) )
+    {
+        lua_pushinteger(L, nItems);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, dispUd->batchCbCtx.userRef);
+        cbStart = l2dbus_statsCallbackStart(L, 4 /* nArgs */);
+        status = lua_pcall(L, 4 /* nArgs */, 0, 0);
+        l2dbus_statsCallback(L2DBUS_STATS_CB_WATCH, cbStart, status);
+        if ( 0 != status )
+        {
+            if ( lua_isstring(L, -1) )
+            {
+                errMsg = lua_tostring(L, -1);
+            }
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Watch batch callback error: %s",
+                        errMsg));
+        }
+    }
+
+    /* Empty the arrays so they don't keep the watches alive */
+    lua_settop(L, 0);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, dispUd->batchWatchesRef);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, dispUd->batchMasksRef);
+    for ( idx = 1; idx <= (unsigned)nItems; ++idx )
+    {
+        lua_pushnil(L);
+        lua_rawseti(L, 1, idx);
+        lua_pushnil(L);
+        lua_rawseti(L, 2, idx);
+    }
+
+    /* Clean up the thread stack */
+    lua_settop(L, 0);
+
+    /* Reclaim any transient allocations made while servicing the callback */
+    l2dbus_arenaReset();
+
+    return CDBUS_TRUE;
+}
+
+
+/**
+ * @brief Queues a watch event for the next batch.
+ *
+ * A watch that becomes ready again before the batch is delivered has its
+ * events merged into its pending entry.
+ *
+ * @param [in] dispUd   The dispatcher of the watch.
+ * @param [in] watchUd  The watch that is ready.
+ * @param [in] events   The signaled events.
+ * @return L2DBUS_TRUE if the event was queued or L2DBUS_FALSE if the
+ * dispatcher has no batch handler (or memory is exhausted).
+ */
+l2dbus_Bool
+l2dbus_dispatcherQueueWatch
+    (
+    l2dbus_Dispatcher*  dispUd,
+    l2dbus_Watch*       watchUd,
+    unsigned            events
+    )
+{
+    l2dbus_WatchEvent* batch;
+    unsigned capacity;
+
+    if ( (NULL == dispUd) || (NULL == dispUd->batchTimeout) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    if ( 0 <= watchUd->batchSlot )
+    {
+        dispUd->batch[watchUd->batchSlot].events |= events;
+        return L2DBUS_TRUE;
+    }
+
+    if ( dispUd->nBatch == dispUd->batchCapacity )
+    {
+        capacity = (0 == dispUd->batchCapacity) ? 16 :
+                                                2 * dispUd->batchCapacity;
+        batch = (l2dbus_WatchEvent*)l2dbus_realloc(dispUd->batch,
+                                            capacity * sizeof(*batch));
+        if ( NULL == batch )
+        {
+            return L2DBUS_FALSE;
+        }
+        dispUd->batch = batch;
+        dispUd->batchCapacity = capacity;
+    }
+
+    if ( 0 == dispUd->nBatch )
+    {
+        /* Re-arming a one-shot timeout requires it be disabled first */
+        cdbus_timeoutEnable(dispUd->batchTimeout, CDBUS_FALSE);
+        if ( CDBUS_FAILED(cdbus_timeoutEnable(dispUd->batchTimeout,
+                                            CDBUS_TRUE)) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                "Failed to arm the dispatcher watch batch timeout"));
+            return L2DBUS_FALSE;
+        }
+        dispUd->batchQueuedAt = l2dbus_statsStart();
+    }
+
+    watchUd->batchSlot = (int)dispUd->nBatch;
+    dispUd->batch[dispUd->nBatch].watchUd = watchUd;
+    dispUd->batch[dispUd->nBatch].events = events;
+    dispUd->nBatch++;
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Discards the pending batched event of a watch.
+ *
+ * Must be called before a watch is destroyed.
+ *
+ * @param [in] dispUd   The dispatcher of the watch.
+ * @param [in] watchUd  The watch being destroyed.
+ */
+void
+l2dbus_dispatcherPurgeWatch
+    (
+    l2dbus_Dispatcher*  dispUd,
+    l2dbus_Watch*       watchUd
+    )
+{
+    if ( (NULL != dispUd) && (0 <= watchUd->batchSlot) &&
+        ((unsigned)watchUd->batchSlot < dispUd->nBatch) )
+    {
+        dispUd->batch[watchUd->batchSlot].watchUd = NULL;
+    }
+    watchUd->batchSlot = -1;
+}
+
+
 /**
  @function new
 
@@ -103,7 +846,7 @@ l2dbus_newDispatcher
     l2dbus_checkModuleInitialized(L);
 
     loopUd = (l2dbus_MainLoopUserData*)
-                            luaL_checkudata(L, 1, L2DBUS_MAIN_LOOP_MTBL_NAME);
+                            l2dbus_checkUserData(L, 1, L2DBUS_MAIN_LOOP_TYPE_ID);
 
 
     dispUd = (l2dbus_Dispatcher*)l2dbus_objectNew(L, sizeof(*dispUd),
@@ -114,6 +857,11 @@ l2dbus_newDispatcher
     {
         luaL_error(L, "Failed to allocate Dispatcher userdata!");
     }
+    TAILQ_INIT(&dispUd->backlog);
+    dispUd->starveLimit = L2DBUS_DISPATCH_STARVE_LIMIT;
+    l2dbus_callbackInit(&dispUd->batchCbCtx);
+    dispUd->batchWatchesRef = LUA_NOREF;
+    dispUd->batchMasksRef = LUA_NOREF;
 
     dispUd->disp = cdbus_dispatcherNew(loopUd->loop);
     if ( NULL == dispUd->disp )
@@ -184,8 +932,8 @@ l2dbus_dispatcherRun
 {
     cdbus_HResult rc;
     int runOpt = CDBUS_RUN_NO_WAIT;
-    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L,
-                                    1, L2DBUS_DISPATCHER_MTBL_NAME);
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)l2dbus_checkUserData(L,
+                                    1, L2DBUS_DISPATCHER_TYPE_ID);
 
     /* Make sure the module wasn't shutdown */
     l2dbus_checkModuleInitialized(L);
@@ -241,7 +989,7 @@ l2dbus_dispatcherStop
 {
     cdbus_HResult rc;
 
-    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L, 1, L2DBUS_DISPATCHER_MTBL_NAME);
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)l2dbus_checkUserData(L, 1, L2DBUS_DISPATCHER_TYPE_ID);
     /* Make sure the module wasn't shutdown */
     l2dbus_checkModuleInitialized(L);
 
@@ -257,6 +1005,275 @@ l2dbus_dispatcherStop
 }
 
 
+/**
+ @function setDispatchBudget
+ @within Dispatcher
+
+ Sets the budget each connection has to deliver matched messages.
+
+ A chatty connection sharing the Dispatcher can otherwise starve the
+ other connections and delay timeouts and watches. Once a connection
+ has delivered *maxMessages* messages to its match handlers, or spent
+ *maxMicroseconds* in them, any further messages matched on that
+ connection are deferred. The Dispatcher then yields back to the main
+ loop and drains the deferred messages of all connections in round-robin
+ order on later iterations, replenishing the budget of each connection
+ every round. Messages of a single connection and
+ @{l2dbus.Match.MatchRule|priority} are always delivered in order.
+ Deferred messages of a higher priority are delivered first (see
+ @{setStarvationLimit}).
+
+ The budget applies to the handlers registered with
+ @{l2dbus.Connection.registerMatch|registerMatch}. Method calls
+ dispatched to service objects must be answered synchronously and are
+ not deferred. Neither are replies to pending or routed calls. Both
+ therefore take precedence over any deferred signal.
+
+ @tparam userdata disp The Dispatcher instance.
+ @tparam ?number|nil maxMessages The maximum number of messages each
+ connection delivers per round. Zero or **nil** means unlimited.
+ @tparam ?number|nil maxMicroseconds The maximum time (in microseconds)
+ each connection may spend in its handlers per round. Zero or **nil** means
+ unlimited.
+ */
+static int
+l2dbus_dispatcherSetDispatchBudget
+    (
+    lua_State*  L
+    )
+{
+    lua_Number maxMessages;
+    lua_Number maxUsec;
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)l2dbus_checkUserData(L,
+                                    1, L2DBUS_DISPATCHER_TYPE_ID);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    maxMessages = luaL_optnumber(L, 2, 0);
+    maxUsec = luaL_optnumber(L, 3, 0);
+    if ( (maxMessages < 0) || (maxUsec < 0) )
+    {
+        luaL_error(L, "The dispatch budget cannot be negative");
+    }
+
+    /* The drain timeout is created the first time a budget is set */
+    if ( ((maxMessages > 0) || (maxUsec > 0)) &&
+        !l2dbus_dispatcherEnableDeferral(ud) )
+    {
+        luaL_error(L, "Failed to allocate the dispatcher drain timeout");
+    }
+
+    ud->maxMessages = (unsigned)maxMessages;
+    ud->maxSeconds = maxUsec / 1000000.0;
+
+    return 0;
+}
+
+
+/**
+ @function getDispatchBudget
+ @within Dispatcher
+
+ Returns the per-connection dispatch budget.
+
+ @tparam userdata disp The Dispatcher instance.
+ @treturn number The maximum number of messages each connection
+ delivers per round (zero is unlimited).
+ @treturn number The maximum time (in microseconds) each connection
+ may spend in its handlers per round (zero is unlimited).
+ @treturn number The number of messages currently deferred.
+ @see setDispatchBudget
+ */
+static int
+l2dbus_dispatcherGetDispatchBudget
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)l2dbus_checkUserData(L,
+                                    1, L2DBUS_DISPATCHER_TYPE_ID);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushnumber(L, (lua_Number)ud->maxMessages);
+    lua_pushnumber(L, ud->maxSeconds * 1000000.0);
+    lua_pushnumber(L, (lua_Number)ud->nDeferred);
+
+    return 3;
+}
+
+
+/**
+ @function setStarvationLimit
+ @within Dispatcher
+
+ Sets how long deferred deliveries of a lower priority may be passed over.
+
+ Deferred match deliveries of a connection are queued in lanes by the
+ @{l2dbus.Match.MatchRule|priority} of their match rule and the highest
+ priority lane is drained first. To keep a steady stream of higher
+ priority messages from starving the lower lanes, a lower lane gets a
+ turn after *limit* higher priority messages in a row have been delivered
+ while it was waiting. The lower lanes take these turns in rotation.
+
+ @tparam userdata disp The Dispatcher instance.
+ @tparam number limit The number of higher priority deliveries in a row
+ before a lower lane gets a turn. Zero means lower lanes wait until the
+ higher lanes are empty. The default is 16.
+ */
+static int
+l2dbus_dispatcherSetStarvationLimit
+    (
+    lua_State*  L
+    )
+{
+    lua_Number limit;
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)l2dbus_checkUserData(L,
+                                    1, L2DBUS_DISPATCHER_TYPE_ID);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    limit = luaL_checknumber(L, 2);
+    if ( limit < 0 )
+    {
+        luaL_error(L, "The starvation limit cannot be negative");
+    }
+    ud->starveLimit = (unsigned)limit;
+
+    return 0;
+}
+
+
+/**
+ @function getStarvationLimit
+ @within Dispatcher
+
+ Returns how long deferred deliveries of a lower priority may be passed over.
+
+ @tparam userdata disp The Dispatcher instance.
+ @treturn number The number of higher priority deliveries in a row before
+ a lower lane gets a turn.
+ @see setStarvationLimit
+ */
+static int
+l2dbus_dispatcherGetStarvationLimit
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)l2dbus_checkUserData(L,
+                                    1, L2DBUS_DISPATCHER_TYPE_ID);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushnumber(L, (lua_Number)ud->starveLimit);
+
+    return 1;
+}
+
+
+/**
+ @function setWatchBatchHandler
+ @within Dispatcher
+
+ Sets the handler that receives batched @{l2dbus.Watch|Watch} events.
+
+ Watches whose delivery mode is @{l2dbus.Watch.DELIVER_BATCH|DELIVER_BATCH}
+ do not call their own handler. Instead the events of every such watch that
+ becomes ready are collected and passed to this handler in a single call
+ once per main loop iteration. A watch that becomes ready more than once
+ before the batch is delivered appears once with its events merged. If no
+ batch handler is set these watches call their own handler as if their
+ mode were @{l2dbus.Watch.DELIVER_MASK|DELIVER_MASK}.
+
+ The batch handler has a signature of the form:
+
+    function onWatchBatch(watches, masks, count, userToken)
+
+ Where *watches* and *masks* are arrays holding *count* watches and the
+ event bitmask signaled for each. Both arrays are re-used from batch to
+ batch and must not be retained by the handler.
+
+ @tparam userdata disp The Dispatcher instance.
+ @tparam ?func|nil handler The batch handler or **nil** to remove it.
+ @tparam ?any userToken Optional user defined data that is delivered to
+ the batch handler.
+ */
+static int
+l2dbus_dispatcherSetWatchBatchHandler
+    (
+    lua_State*  L
+    )
+{
+    int userIdx = L2DBUS_CALLBACK_NOREF_NEEDED;
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)l2dbus_checkUserData(L,
+                                    1, L2DBUS_DISPATCHER_TYPE_ID);
+
+    /* Make sure the module wasn't shutdown */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( !lua_isnoneornil(L, 2) )
+    {
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+    }
+
+    if ( 2 < lua_gettop(L) )
+    {
+        userIdx = 3;
+    }
+
+    l2dbus_callbackUnref(L, &ud->batchCbCtx);
+    l2dbus_callbackInit(&ud->batchCbCtx);
+
+    if ( lua_isnoneornil(L, 2) )
+    {
+        /* Pending events are delivered to the watch handlers instead */
+        if ( NULL != ud->batchTimeout )
+        {
+            cdbus_timeoutEnable(ud->batchTimeout, CDBUS_FALSE);
+            cdbus_timeoutUnref(ud->batchTimeout);
+            ud->batchTimeout = NULL;
+        }
+        while ( 0 < ud->nBatch )
+        {
+            --ud->nBatch;
+            if ( NULL != ud->batch[ud->nBatch].watchUd )
+            {
+                ud->batch[ud->nBatch].watchUd->batchSlot = -1;
+            }
+        }
+        return 0;
+    }
+
+    if ( NULL == ud->batchTimeout )
+    {
+        ud->batchTimeout = cdbus_timeoutNew(ud->disp,
+                                    L2DBUS_DISPATCH_DRAIN_MSEC, CDBUS_FALSE,
+                                    l2dbus_dispatcherBatchHandler, ud);
+        if ( NULL == ud->batchTimeout )
+        {
+            luaL_error(L, "Failed to allocate the dispatcher batch timeout");
+        }
+    }
+
+    if ( LUA_NOREF == ud->batchWatchesRef )
+    {
+        lua_newtable(L);
+        ud->batchWatchesRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        lua_newtable(L);
+        ud->batchMasksRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    l2dbus_callbackRef(L, 2, userIdx, &ud->batchCbCtx);
+
+    return 0;
+}
+
+
 /**
  * @brief Called by Lua VM to GC/reclaim the Dispatcher userdata.
  *
@@ -272,10 +1289,54 @@ l2dbus_dispatcherDispose
     lua_State*  L
     )
 {
-    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)luaL_checkudata(L, -1, L2DBUS_DISPATCHER_MTBL_NAME);
+    l2dbus_Dispatcher* ud = (l2dbus_Dispatcher*)l2dbus_checkUserData(L, -1, L2DBUS_DISPATCHER_TYPE_ID);
+    l2dbus_Connection* connUd;
+    l2dbus_DeferredMatch* item;
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: dispatcher (userdata=%p)", ud));
 
+    /* Discard any deliveries that are still deferred */
+    while ( !TAILQ_EMPTY(&ud->backlog) )
+    {
+        connUd = TAILQ_FIRST(&ud->backlog);
+        TAILQ_REMOVE(&ud->backlog, connUd, backlogLink);
+        connUd->inBacklog = L2DBUS_FALSE;
+        while ( NULL != (item = l2dbus_dispatcherTakeDeferred(NULL, connUd)) )
+        {
+            dbus_message_unref(item->msg);
+            l2dbus_free(item);
+        }
+    }
+    ud->nDeferred = 0;
+
+    /* Stop the decoder thread before its watch goes with the dispatcher */
+    l2dbus_predecodeDispose(ud);
+
+    if ( NULL != ud->drainTimeout )
+    {
+        cdbus_timeoutEnable(ud->drainTimeout, CDBUS_FALSE);
+        cdbus_timeoutUnref(ud->drainTimeout);
+        ud->drainTimeout = NULL;
+    }
+
+    /* Release the watch batch (watches outlive their dispatcher) */
+    if ( NULL != ud->batchTimeout )
+    {
+        cdbus_timeoutEnable(ud->batchTimeout, CDBUS_FALSE);
+        cdbus_timeoutUnref(ud->batchTimeout);
+        ud->batchTimeout = NULL;
+    }
+    l2dbus_free(ud->batch);
+    ud->batch = NULL;
+    ud->nBatch = 0;
+    ud->batchCapacity = 0;
+    l2dbus_callbackUnref(L, &ud->batchCbCtx);
+    l2dbus_callbackInit(&ud->batchCbCtx);
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->batchWatchesRef);
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->batchMasksRef);
+    ud->batchWatchesRef = LUA_NOREF;
+    ud->batchMasksRef = LUA_NOREF;
+
     if ( ud->disp != NULL )
     {
         cdbus_dispatcherUnref(ud->disp);
@@ -298,6 +1359,11 @@ l2dbus_dispatcherDispose
 static const luaL_Reg l2dbus_dispatcherMetaTable[] = {
     {"run", l2dbus_dispatcherRun},
     {"stop", l2dbus_dispatcherStop},
+    {"setDispatchBudget", l2dbus_dispatcherSetDispatchBudget},
+    {"getDispatchBudget", l2dbus_dispatcherGetDispatchBudget},
+    {"setStarvationLimit", l2dbus_dispatcherSetStarvationLimit},
+    {"getStarvationLimit", l2dbus_dispatcherGetStarvationLimit},
+    {"setWatchBatchHandler", l2dbus_dispatcherSetWatchBatchHandler},
     {"__gc", l2dbus_dispatcherDispose},
     {NULL, NULL},
 };
@@ -32,20 +32,71 @@
  */
 
 #ifndef L2DBUS_DISPATCHER_H_
+#define L2DBUS_DISPATCHER_H_
+
 #include "lua.h"
+#include "queue.h"
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
+#include "l2dbus_callback.h"
 
 /* Forward declarations */
 struct cdbus_Dispatcher;
+struct cdbus_Timeout;
+struct l2dbus_Connection;
+struct l2dbus_Match;
+struct l2dbus_Watch;
+struct l2dbus_Predecoder;
+
+/* A watch event waiting to be delivered in the next batch */
+typedef struct l2dbus_WatchEvent
+{
+    struct l2dbus_Watch*        watchUd;
+    unsigned                    events;
+} l2dbus_WatchEvent;
 
 typedef struct l2dbus_Dispatcher
 {
     struct cdbus_Dispatcher* disp;
     int finalizerRef;
 
+    /* Per-connection dispatch budget (zero means unlimited) */
+    unsigned                    maxMessages;
+    double                      maxSeconds;
+    unsigned                    budgetGen;
+    unsigned                    nDeferred;
+    /* Higher priority deliveries in a row before a lower lane gets a turn */
+    unsigned                    starveLimit;
+    struct cdbus_Timeout*       drainTimeout;
+    TAILQ_HEAD(l2dbus_BacklogHead,
+                  l2dbus_Connection) backlog;
+
+    /* Watch events batched into one Lua call per main loop iteration */
+    l2dbus_CallbackCtx          batchCbCtx;
+    struct cdbus_Timeout*       batchTimeout;
+    int                         batchWatchesRef;
+    int                         batchMasksRef;
+    l2dbus_WatchEvent*          batch;
+    unsigned                    nBatch;
+    unsigned                    batchCapacity;
+    /* When the oldest event of the batch was queued */
+    double                      batchQueuedAt;
+
+    /* Decodes the messages of predecoding matches (NULL until needed) */
+    struct l2dbus_Predecoder*   predecoder;
 } l2dbus_Dispatcher;
 
 int l2dbus_newDispatcher(lua_State* L);
 void l2dbus_openDispatcher(lua_State* L);
+void l2dbus_dispatcherInitConnection(struct l2dbus_Connection* connUd);
+l2dbus_Bool l2dbus_dispatcherEnableDeferral(l2dbus_Dispatcher* dispUd);
+void l2dbus_dispatcherSubmitMatch(struct l2dbus_Match* match, DBusMessage* msg);
+void l2dbus_dispatcherPurgeMatch(struct l2dbus_Match* match);
+void l2dbus_dispatcherRemoveConnection(struct l2dbus_Connection* connUd);
+l2dbus_Bool l2dbus_dispatcherQueueWatch(l2dbus_Dispatcher* dispUd,
+                                struct l2dbus_Watch* watchUd, unsigned events);
+void l2dbus_dispatcherPurgeWatch(l2dbus_Dispatcher* dispUd,
+                                struct l2dbus_Watch* watchUd);
 
 
 #endif /* Guard for L2DBUS_DISPATCHER_H_ */
@@ -0,0 +1,876 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_ffi.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the C ABI used by the LuaJIT FFI module.
+ *===========================================================================
+ */
+#include <string.h>
+#include <stdint.h>
+#include "dbus/dbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_ffi.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_message.h"
+#include "l2dbus_core.h"
+#include "l2dbus_util.h"
+#include "l2dbus_object.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "lauxlib.h"
+
+struct l2dbus_FfiIter
+{
+    DBusMessageIter     iter;
+    /* Referenced so the iterator stays valid whatever the caller does */
+    DBusMessage*        msg;
+};
+
+/* Large enough for any basic D-Bus value */
+typedef union l2dbus_FfiValue
+{
+    unsigned char       byteVal;
+    dbus_bool_t         boolVal;
+    dbus_int16_t        i16;
+    dbus_uint16_t       u16;
+    dbus_int32_t        i32;
+    dbus_uint32_t       u32;
+    dbus_int64_t        i64;
+    dbus_uint64_t       u64;
+    double              dbl;
+    const char*         str;
+} l2dbus_FfiValue;
+
+
+int
+l2dbus_ffiAbiVersion(void)
+{
+    return L2DBUS_FFI_ABI_VERSION;
+}
+
+
+DBusMessage*
+l2dbus_ffiNewMethodCall
+    (
+    const char* destination,
+    const char* path,
+    const char* interface,
+    const char* member
+    )
+{
+    if ( (NULL == path) || (NULL == member) )
+    {
+        return NULL;
+    }
+
+    return dbus_message_new_method_call(destination, path, interface, member);
+}
+
+
+DBusMessage*
+l2dbus_ffiNewMethodReturn
+    (
+    DBusMessage*    call
+    )
+{
+    return (NULL == call) ? NULL : dbus_message_new_method_return(call);
+}
+
+
+DBusMessage*
+l2dbus_ffiNewSignal
+    (
+    const char* path,
+    const char* interface,
+    const char* member
+    )
+{
+    if ( (NULL == path) || (NULL == interface) || (NULL == member) )
+    {
+        return NULL;
+    }
+
+    return dbus_message_new_signal(path, interface, member);
+}
+
+
+DBusMessage*
+l2dbus_ffiNewError
+    (
+    DBusMessage*    replyTo,
+    const char*     name,
+    const char*     text
+    )
+{
+    if ( (NULL == replyTo) || (NULL == name) )
+    {
+        return NULL;
+    }
+
+    return dbus_message_new_error(replyTo, name, text);
+}
+
+
+void
+l2dbus_ffiMessageRef
+    (
+    DBusMessage*    msg
+    )
+{
+    if ( NULL != msg )
+    {
+        dbus_message_ref(msg);
+    }
+}
+
+
+void
+l2dbus_ffiMessageUnref
+    (
+    DBusMessage*    msg
+    )
+{
+    if ( NULL != msg )
+    {
+        dbus_message_unref(msg);
+    }
+}
+
+
+int
+l2dbus_ffiGetType
+    (
+    DBusMessage*    msg
+    )
+{
+    return dbus_message_get_type(msg);
+}
+
+
+uint32_t
+l2dbus_ffiGetSerial
+    (
+    DBusMessage*    msg
+    )
+{
+    return dbus_message_get_serial(msg);
+}
+
+
+uint32_t
+l2dbus_ffiGetReplySerial
+    (
+    DBusMessage*    msg
+    )
+{
+    return dbus_message_get_reply_serial(msg);
+}
+
+
+const char*
+l2dbus_ffiGetPath
+    (
+    DBusMessage*    msg
+    )
+{
+    return dbus_message_get_path(msg);
+}
+
+
+const char*
+l2dbus_ffiGetInterface
+    (
+    DBusMessage*    msg
+    )
+{
+    return dbus_message_get_interface(msg);
+}
+
+
+const char*
+l2dbus_ffiGetMember
+    (
+    DBusMessage*    msg
+    )
+{
+    return dbus_message_get_member(msg);
+}
+
+
+const char*
+l2dbus_ffiGetErrorName
+    (
+    DBusMessage*    msg
+    )
+{
+    return dbus_message_get_error_name(msg);
+}
+
+
+const char*
+l2dbus_ffiGetSignature
+    (
+    DBusMessage*    msg
+    )
+{
+    return dbus_message_get_signature(msg);
+}
+
+
+const char*
+l2dbus_ffiGetSender
+    (
+    DBusMessage*    msg
+    )
+{
+    return dbus_message_get_sender(msg);
+}
+
+
+const char*
+l2dbus_ffiGetDestination
+    (
+    DBusMessage*    msg
+    )
+{
+    return dbus_message_get_destination(msg);
+}
+
+
+/**
+ * @brief Appends a basic value to the end of the message arguments.
+ *
+ * @param [in] msg   The D-Bus message.
+ * @param [in] type  The D-Bus type of the value (e.g. DBUS_TYPE_INT32).
+ * @param [in] value Points to the value (or the string pointer for the
+ *                   string, object path and signature types).
+ * @return Non-zero if the value is appended and zero otherwise.
+ */
+int
+l2dbus_ffiAppendBasic
+    (
+    DBusMessage*    msg,
+    int             type,
+    const void*     value
+    )
+{
+    DBusMessageIter iter;
+
+    if ( (NULL == msg) || (NULL == value) || !dbus_type_is_basic(type) )
+    {
+        return 0;
+    }
+
+    dbus_message_iter_init_append(msg, &iter);
+
+    return dbus_message_iter_append_basic(&iter, type, value);
+}
+
+
+int
+l2dbus_ffiAppendBoolean
+    (
+    DBusMessage*    msg,
+    int             value
+    )
+{
+    dbus_bool_t boolVal = value ? TRUE : FALSE;
+
+    return l2dbus_ffiAppendBasic(msg, DBUS_TYPE_BOOLEAN, &boolVal);
+}
+
+
+int
+l2dbus_ffiAppendInt32
+    (
+    DBusMessage*    msg,
+    int32_t         value
+    )
+{
+    dbus_int32_t i32 = value;
+
+    return l2dbus_ffiAppendBasic(msg, DBUS_TYPE_INT32, &i32);
+}
+
+
+int
+l2dbus_ffiAppendUint32
+    (
+    DBusMessage*    msg,
+    uint32_t        value
+    )
+{
+    dbus_uint32_t u32 = value;
+
+    return l2dbus_ffiAppendBasic(msg, DBUS_TYPE_UINT32, &u32);
+}
+
+
+int
+l2dbus_ffiAppendInt64
+    (
+    DBusMessage*    msg,
+    int64_t         value
+    )
+{
+    dbus_int64_t i64 = value;
+
+    return l2dbus_ffiAppendBasic(msg, DBUS_TYPE_INT64, &i64);
+}
+
+
+int
+l2dbus_ffiAppendUint64
+    (
+    DBusMessage*    msg,
+    uint64_t        value
+    )
+{
+    dbus_uint64_t u64 = value;
+
+    return l2dbus_ffiAppendBasic(msg, DBUS_TYPE_UINT64, &u64);
+}
+
+
+int
+l2dbus_ffiAppendDouble
+    (
+    DBusMessage*    msg,
+    double          value
+    )
+{
+    return l2dbus_ffiAppendBasic(msg, DBUS_TYPE_DOUBLE, &value);
+}
+
+
+/**
+ * @brief Appends a string, object path or signature.
+ *
+ * @param [in] msg   The D-Bus message.
+ * @param [in] type  DBUS_TYPE_STRING, DBUS_TYPE_OBJECT_PATH or
+ *                   DBUS_TYPE_SIGNATURE.
+ * @param [in] value The (nul terminated) string.
+ * @return Non-zero if the string is appended and zero otherwise.
+ */
+int
+l2dbus_ffiAppendString
+    (
+    DBusMessage*    msg,
+    int             type,
+    const char*     value
+    )
+{
+    if ( (NULL == value) || ((DBUS_TYPE_STRING != type) &&
+        (DBUS_TYPE_OBJECT_PATH != type) && (DBUS_TYPE_SIGNATURE != type)) )
+    {
+        return 0;
+    }
+
+    return l2dbus_ffiAppendBasic(msg, type, &value);
+}
+
+
+/**
+ * @brief Appends an array of a fixed size type in a single copy.
+ *
+ * @param [in] msg      The D-Bus message.
+ * @param [in] elemType The (fixed size) D-Bus type of the elements.
+ * @param [in] elems    The elements in their native representation.
+ * @param [in] nElems   The number of elements.
+ * @return Non-zero if the array is appended and zero otherwise.
+ */
+int
+l2dbus_ffiAppendFixedArray
+    (
+    DBusMessage*    msg,
+    int             elemType,
+    const void*     elems,
+    int             nElems
+    )
+{
+    DBusMessageIter iter;
+    DBusMessageIter subIter;
+    char elemSig[2];
+    int isOk;
+
+    if ( (NULL == msg) || (0 > nElems) || ((NULL == elems) && (0 < nElems)) ||
+        !dbus_type_is_fixed(elemType) || (DBUS_TYPE_UNIX_FD == elemType) )
+    {
+        return 0;
+    }
+
+    elemSig[0] = (char)elemType;
+    elemSig[1] = '\0';
+
+    dbus_message_iter_init_append(msg, &iter);
+    if ( !dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, elemSig,
+                                        &subIter) )
+    {
+        return 0;
+    }
+
+    isOk = dbus_message_iter_append_fixed_array(&subIter, elemType, &elems,
+                                                nElems);
+    if ( !isOk )
+    {
+        dbus_message_iter_abandon_container(&iter, &subIter);
+        return 0;
+    }
+
+    return dbus_message_iter_close_container(&iter, &subIter);
+}
+
+
+/**
+ * @brief Creates an iterator positioned on the first argument.
+ *
+ * @param [in] msg The D-Bus message.
+ * @return The iterator (freed with l2dbus_ffiIterFree) or NULL if it
+ * cannot be allocated.
+ */
+l2dbus_FfiIter*
+l2dbus_ffiIterNew
+    (
+    DBusMessage*    msg
+    )
+{
+    l2dbus_FfiIter* iter;
+
+    if ( NULL == msg )
+    {
+        return NULL;
+    }
+
+    iter = (l2dbus_FfiIter*)l2dbus_malloc(sizeof(*iter));
+    if ( NULL != iter )
+    {
+        iter->msg = dbus_message_ref(msg);
+        dbus_message_iter_init(msg, &iter->iter);
+    }
+
+    return iter;
+}
+
+
+/**
+ * @brief Creates an iterator over the contents of the current container
+ * argument (array, struct, dict entry or variant).
+ *
+ * @param [in] iter The iterator positioned on the container.
+ * @return The sub-iterator (freed with l2dbus_ffiIterFree) or NULL if the
+ * argument isn't a container or memory is exhausted.
+ */
+l2dbus_FfiIter*
+l2dbus_ffiIterRecurse
+    (
+    l2dbus_FfiIter* iter
+    )
+{
+    l2dbus_FfiIter* subIter;
+
+    if ( (NULL == iter) ||
+        !dbus_type_is_container(dbus_message_iter_get_arg_type(&iter->iter)) )
+    {
+        return NULL;
+    }
+
+    subIter = (l2dbus_FfiIter*)l2dbus_malloc(sizeof(*subIter));
+    if ( NULL != subIter )
+    {
+        subIter->msg = dbus_message_ref(iter->msg);
+        dbus_message_iter_recurse(&iter->iter, &subIter->iter);
+    }
+
+    return subIter;
+}
+
+
+void
+l2dbus_ffiIterFree
+    (
+    l2dbus_FfiIter* iter
+    )
+{
+    if ( NULL != iter )
+    {
+        dbus_message_unref(iter->msg);
+        l2dbus_free(iter);
+    }
+}
+
+
+int
+l2dbus_ffiIterArgType
+    (
+    l2dbus_FfiIter* iter
+    )
+{
+    return dbus_message_iter_get_arg_type(&iter->iter);
+}
+
+
+int
+l2dbus_ffiIterElementType
+    (
+    l2dbus_FfiIter* iter
+    )
+{
+    if ( DBUS_TYPE_ARRAY != dbus_message_iter_get_arg_type(&iter->iter) )
+    {
+        return DBUS_TYPE_INVALID;
+    }
+
+    return dbus_message_iter_get_element_type(&iter->iter);
+}
+
+
+int
+l2dbus_ffiIterNext
+    (
+    l2dbus_FfiIter* iter
+    )
+{
+    return dbus_message_iter_next(&iter->iter);
+}
+
+
+/**
+ * @brief Returns the current integral (or boolean) argument as a signed
+ * 64-bit value.
+ *
+ * @return The value or zero (0) if the argument isn't integral.
+ */
+int64_t
+l2dbus_ffiIterGetInt64
+    (
+    l2dbus_FfiIter* iter
+    )
+{
+    l2dbus_FfiValue value;
+
+    switch ( dbus_message_iter_get_arg_type(&iter->iter) )
+    {
+        case DBUS_TYPE_BYTE:
+            dbus_message_iter_get_basic(&iter->iter, &value);
+            return value.byteVal;
+
+        case DBUS_TYPE_BOOLEAN:
+            dbus_message_iter_get_basic(&iter->iter, &value);
+            return value.boolVal ? 1 : 0;
+
+        case DBUS_TYPE_INT16:
+            dbus_message_iter_get_basic(&iter->iter, &value);
+            return value.i16;
+
+        case DBUS_TYPE_UINT16:
+            dbus_message_iter_get_basic(&iter->iter, &value);
+            return value.u16;
+
+        case DBUS_TYPE_INT32:
+            dbus_message_iter_get_basic(&iter->iter, &value);
+            return value.i32;
+
+        case DBUS_TYPE_UINT32:
+            dbus_message_iter_get_basic(&iter->iter, &value);
+            return value.u32;
+
+        case DBUS_TYPE_INT64:
+            dbus_message_iter_get_basic(&iter->iter, &value);
+            return value.i64;
+
+        case DBUS_TYPE_UINT64:
+            dbus_message_iter_get_basic(&iter->iter, &value);
+            return (int64_t)value.u64;
+
+        default:
+            return 0;
+    }
+}
+
+
+/**
+ * @brief Returns the current integral argument as an unsigned 64-bit value.
+ *
+ * @return The value or zero (0) if the argument isn't integral.
+ */
+uint64_t
+l2dbus_ffiIterGetUint64
+    (
+    l2dbus_FfiIter* iter
+    )
+{
+    l2dbus_FfiValue value;
+
+    if ( DBUS_TYPE_UINT64 == dbus_message_iter_get_arg_type(&iter->iter) )
+    {
+        dbus_message_iter_get_basic(&iter->iter, &value);
+        return value.u64;
+    }
+
+    return (uint64_t)l2dbus_ffiIterGetInt64(iter);
+}
+
+
+/**
+ * @brief Returns the current numeric argument as a double.
+ *
+ * @return The value or zero (0) if the argument isn't numeric.
+ */
+double
+l2dbus_ffiIterGetDouble
+    (
+    l2dbus_FfiIter* iter
+    )
+{
+    l2dbus_FfiValue value;
+
+    switch ( dbus_message_iter_get_arg_type(&iter->iter) )
+    {
+        case DBUS_TYPE_DOUBLE:
+            dbus_message_iter_get_basic(&iter->iter, &value);
+            return value.dbl;
+
+        case DBUS_TYPE_UINT64:
+            return (double)l2dbus_ffiIterGetUint64(iter);
+
+        default:
+            return (double)l2dbus_ffiIterGetInt64(iter);
+    }
+}
+
+
+/**
+ * @brief Returns the current string, object path or signature argument.
+ *
+ * The string belongs to the message.
+ *
+ * @return The string or NULL if the argument isn't a string type.
+ */
+const char*
+l2dbus_ffiIterGetString
+    (
+    l2dbus_FfiIter* iter
+    )
+{
+    l2dbus_FfiValue value;
+
+    switch ( dbus_message_iter_get_arg_type(&iter->iter) )
+    {
+        case DBUS_TYPE_STRING:
+        case DBUS_TYPE_OBJECT_PATH:
+        case DBUS_TYPE_SIGNATURE:
+            dbus_message_iter_get_basic(&iter->iter, &value);
+            return value.str;
+
+        default:
+            return NULL;
+    }
+}
+
+
+/**
+ * @brief Returns the elements of the current array of a fixed size type
+ * without copying them.
+ *
+ * The elements belong to the message.
+ *
+ * @param [in]  iter  The iterator positioned on the array.
+ * @param [out] elems Set to the first element.
+ * @return The number of elements or -1 if the argument isn't an array of
+ * a fixed size type.
+ */
+int
+l2dbus_ffiIterGetFixedArray
+    (
+    l2dbus_FfiIter* iter,
+    const void**    elems
+    )
+{
+    DBusMessageIter subIter;
+    int elemType;
+    int nElems = 0;
+
+    if ( (NULL == elems) ||
+        (DBUS_TYPE_ARRAY != dbus_message_iter_get_arg_type(&iter->iter)) )
+    {
+        return -1;
+    }
+
+    elemType = dbus_message_iter_get_element_type(&iter->iter);
+    if ( !dbus_type_is_fixed(elemType) || (DBUS_TYPE_UNIX_FD == elemType) )
+    {
+        return -1;
+    }
+
+    *elems = NULL;
+    dbus_message_iter_recurse(&iter->iter, &subIter);
+    dbus_message_iter_get_fixed_array(&subIter, (void*)elems, &nElems);
+
+    return nElems;
+}
+
+
+/**
+ * @brief Sends a message as Connection:send does.
+ *
+ * The message is held back if the connection is corked.
+ *
+ * @param [in]  conn   The connection handle (see Connection:ffiHandle).
+ * @param [in]  msg    The D-Bus message.
+ * @param [out] serial The serial number of the queued message (zero if it
+ *                     is held). May be NULL.
+ * @return Non-zero if the message is queued (or held) and zero otherwise.
+ */
+int
+l2dbus_ffiSend
+    (
+    l2dbus_Connection*  conn,
+    DBusMessage*        msg,
+    uint32_t*           serial
+    )
+{
+    dbus_uint32_t serialNum = 0;
+    l2dbus_Bool queued = L2DBUS_FALSE;
+
+    if ( (NULL != conn) && (NULL != conn->conn) && (NULL != msg) )
+    {
+        queued = l2dbus_connectionQueue(conn, msg, &serialNum);
+    }
+
+    if ( NULL != serial )
+    {
+        *serial = serialNum;
+    }
+
+    return queued;
+}
+
+
+/**
+ @function ffiHandle
+ @within l2dbus.Message
+
+ Returns the D-Bus message as a handle for the LuaJIT FFI.
+
+ The handle is a light userdata pointing to the underlying message. It's
+ only valid while the Message (or a reference taken through the FFI) is
+ alive. See @{l2dbus.ffi}.
+
+ @tparam userdata msg The D-Bus message.
+ @treturn lightuserdata The message handle.
+ */
+int
+l2dbus_messageGetFfiHandle
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = (l2dbus_Message*)l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+    luaL_argcheck(L, msgUd->msg != NULL, 1,
+                "reference to D-Bus message no longer exists");
+    lua_pushlightuserdata(L, msgUd->msg);
+
+    return 1;
+}
+
+
+/**
+ @function fromFfiHandle
+ @within l2dbus.Message
+
+ Wraps a message handle from the LuaJIT FFI in a Message.
+
+ @tparam lightuserdata|number handle The message handle (or its address
+ as a number, e.g. tonumber(ffi.cast("uintptr_t", ptr))).
+ @tparam ?bool adopt If **true** the Message takes over the caller's
+ reference rather than adding its own. Defaults to **false**.
+ @treturn userdata The Message userdata.
+ */
+int
+l2dbus_messageFromFfiHandle
+    (
+    lua_State*  L
+    )
+{
+    DBusMessage* msg = NULL;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( LUA_TLIGHTUSERDATA == lua_type(L, 1) )
+    {
+        msg = (DBusMessage*)lua_touserdata(L, 1);
+    }
+    else if ( LUA_TNUMBER == lua_type(L, 1) )
+    {
+        msg = (DBusMessage*)(uintptr_t)lua_tonumber(L, 1);
+    }
+    luaL_argcheck(L, NULL != msg, 1, "expected a D-Bus message handle");
+
+    l2dbus_messageWrap(L, msg, lua_toboolean(L, 2) ? L2DBUS_FALSE :
+                                                    L2DBUS_TRUE);
+
+    return 1;
+}
+
+
+/**
+ @function ffiHandle
+ @within Connection
+
+ Returns the connection as a handle for the LuaJIT FFI.
+
+ The handle is passed to l2dbus_ffiSend. It's only valid while the
+ Connection is alive. See @{l2dbus.ffi}.
+
+ @tparam userdata conn The D-Bus connection object
+ @treturn lightuserdata The connection handle.
+ */
+int
+l2dbus_connectionGetFfiHandle
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    lua_pushlightuserdata(L, connUd);
+
+    return 1;
+}
@@ -0,0 +1,122 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_ffi.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the C ABI used by the LuaJIT FFI module.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_FFI_H_
+#define L2DBUS_FFI_H_
+
+#include <stdint.h>
+#include "lua.h"
+
+/*
+ * A stable C ABI for the hottest message operations so LuaJIT can call
+ * them through its FFI (and keep compiling the calling code) rather than
+ * through the Lua C API. Only plain C types cross the interface. The
+ * declarations are repeated in lua/l2dbus/ffi.lua which must be kept in
+ * step with this file. L2DBUS_FFI_ABI_VERSION is incremented whenever an
+ * existing declaration changes.
+ */
+#define L2DBUS_FFI_ABI_VERSION  (1)
+
+/* Forward declarations */
+struct DBusMessage;
+struct l2dbus_Connection;
+
+/* An argument iterator (opaque to FFI callers) */
+typedef struct l2dbus_FfiIter l2dbus_FfiIter;
+
+int l2dbus_ffiAbiVersion(void);
+
+/* Message creation and ownership */
+struct DBusMessage* l2dbus_ffiNewMethodCall(const char* destination,
+                                            const char* path,
+                                            const char* interface,
+                                            const char* member);
+struct DBusMessage* l2dbus_ffiNewMethodReturn(struct DBusMessage* call);
+struct DBusMessage* l2dbus_ffiNewSignal(const char* path,
+                                        const char* interface,
+                                        const char* member);
+struct DBusMessage* l2dbus_ffiNewError(struct DBusMessage* replyTo,
+                                        const char* name,
+                                        const char* text);
+void l2dbus_ffiMessageRef(struct DBusMessage* msg);
+void l2dbus_ffiMessageUnref(struct DBusMessage* msg);
+
+/* Header access */
+int l2dbus_ffiGetType(struct DBusMessage* msg);
+uint32_t l2dbus_ffiGetSerial(struct DBusMessage* msg);
+uint32_t l2dbus_ffiGetReplySerial(struct DBusMessage* msg);
+const char* l2dbus_ffiGetPath(struct DBusMessage* msg);
+const char* l2dbus_ffiGetInterface(struct DBusMessage* msg);
+const char* l2dbus_ffiGetMember(struct DBusMessage* msg);
+const char* l2dbus_ffiGetErrorName(struct DBusMessage* msg);
+const char* l2dbus_ffiGetSignature(struct DBusMessage* msg);
+const char* l2dbus_ffiGetSender(struct DBusMessage* msg);
+const char* l2dbus_ffiGetDestination(struct DBusMessage* msg);
+
+/* Appending arguments (each returns non-zero on success) */
+int l2dbus_ffiAppendBoolean(struct DBusMessage* msg, int value);
+int l2dbus_ffiAppendInt32(struct DBusMessage* msg, int32_t value);
+int l2dbus_ffiAppendUint32(struct DBusMessage* msg, uint32_t value);
+int l2dbus_ffiAppendInt64(struct DBusMessage* msg, int64_t value);
+int l2dbus_ffiAppendUint64(struct DBusMessage* msg, uint64_t value);
+int l2dbus_ffiAppendDouble(struct DBusMessage* msg, double value);
+int l2dbus_ffiAppendString(struct DBusMessage* msg, int type,
+                            const char* value);
+int l2dbus_ffiAppendBasic(struct DBusMessage* msg, int type,
+                            const void* value);
+int l2dbus_ffiAppendFixedArray(struct DBusMessage* msg, int elemType,
+                            const void* elems, int nElems);
+
+/* Iterating arguments */
+l2dbus_FfiIter* l2dbus_ffiIterNew(struct DBusMessage* msg);
+l2dbus_FfiIter* l2dbus_ffiIterRecurse(l2dbus_FfiIter* iter);
+void l2dbus_ffiIterFree(l2dbus_FfiIter* iter);
+int l2dbus_ffiIterArgType(l2dbus_FfiIter* iter);
+int l2dbus_ffiIterElementType(l2dbus_FfiIter* iter);
+int l2dbus_ffiIterNext(l2dbus_FfiIter* iter);
+int64_t l2dbus_ffiIterGetInt64(l2dbus_FfiIter* iter);
+uint64_t l2dbus_ffiIterGetUint64(l2dbus_FfiIter* iter);
+double l2dbus_ffiIterGetDouble(l2dbus_FfiIter* iter);
+const char* l2dbus_ffiIterGetString(l2dbus_FfiIter* iter);
+int l2dbus_ffiIterGetFixedArray(l2dbus_FfiIter* iter, const void** elems);
+
+/* Sending */
+int l2dbus_ffiSend(struct l2dbus_Connection* conn, struct DBusMessage* msg,
+                    uint32_t* serial);
+
+/* Lua bindings exchanging handles with the FFI */
+int l2dbus_messageGetFfiHandle(lua_State* L);
+int l2dbus_messageFromFfiHandle(lua_State* L);
+int l2dbus_connectionGetFfiHandle(lua_State* L);
+
+#endif /* Guard for L2DBUS_FFI_H_ */
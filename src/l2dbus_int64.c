@@ -74,6 +74,18 @@
  @namespace l2dbus.Int64
  */
 
+#if defined(LUA_MAXINTEGER) && (LUA_MAXINTEGER >= INT64_MAX)
+/* Lua integers hold any Int64 */
+#define L2DBUS_INT64_IS_LOSSLESS(v) (1)
+#define L2DBUS_INT64_PUSH(L, v)     lua_pushinteger(L, (lua_Integer)(v))
+#else
+/* A Lua double represents integers in [-2^53, 2^53] exactly */
+#define L2DBUS_INT64_IS_LOSSLESS(v) (((v) >= -(((int64_t)1) << 53)) && \
+                                    ((v) <= (((int64_t)1) << 53)))
+#define L2DBUS_INT64_PUSH(L, v)     lua_pushnumber(L, (lua_Number)(v))
+#endif
+
+
 static int64_t
 l2dbus_int64Cast
     (
@@ -118,7 +130,7 @@ l2dbus_int64Cast
 
         case LUA_TUSERDATA:
             int64Ud = (l2dbus_Int64*)l2dbus_isUserData(L, numIdx,
-                                    L2DBUS_INT64_MTBL_NAME);
+                                    L2DBUS_INT64_TYPE_ID);
             if ( NULL != int64Ud )
             {
                 value = int64Ud->value;
@@ -126,7 +138,7 @@ l2dbus_int64Cast
             else
             {
                 uint64Ud = (l2dbus_Uint64*)l2dbus_isUserData(L, numIdx,
-                                            L2DBUS_UINT64_MTBL_NAME);
+                                            L2DBUS_UINT64_TYPE_ID);
                 if ( NULL != uint64Ud )
                 {
                     value = (int64_t)uint64Ud->value;
@@ -176,6 +188,40 @@ l2dbus_int64Create
 }
 
 
+/**
+ * @brief Pushes a Int64 value on the Lua stack.
+ *
+ * If a native Lua number is requested and can represent the value without
+ * any loss of precision then a Lua number (an integer on Lua 5.3+) is
+ * pushed otherwise an Int64 userdata is created.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] value    The value to push.
+ * @param [in] asNumber Set to L2DBUS_TRUE to push a Lua number when the
+ * conversion is lossless.
+ */
+void
+l2dbus_int64Push
+    (
+    lua_State*  L,
+    int64_t     value,
+    l2dbus_Bool asNumber
+    )
+{
+    l2dbus_Int64* ud;
+
+    if ( asNumber && L2DBUS_INT64_IS_LOSSLESS(value) )
+    {
+        L2DBUS_INT64_PUSH(L, value);
+    }
+    else
+    {
+        ud = l2dbus_objectNew(L, sizeof(*ud), L2DBUS_INT64_TYPE_ID);
+        ud->value = value;
+    }
+}
+
+
 /**
  @function new
 
@@ -439,8 +485,8 @@ l2dbus_int64ToString
     lua_State*  L
     )
 {
-    l2dbus_Int64* ud = (l2dbus_Int64*)luaL_checkudata(L, 1,
-                                                L2DBUS_INT64_MTBL_NAME);
+    l2dbus_Int64* ud = (l2dbus_Int64*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_INT64_TYPE_ID);
     int base = 10;
     int nArgs = lua_gettop(L);
     char fmt[16];
@@ -509,14 +555,99 @@ l2dbus_int64Dispose
     )
 {
     /* Nothing to explicitly free */
-    l2dbus_Int64* ud = (l2dbus_Int64*)luaL_checkudata(L, -1,
-                                            L2DBUS_INT64_MTBL_NAME);
+    l2dbus_Int64* ud = (l2dbus_Int64*)l2dbus_checkUserData(L, -1,
+                                            L2DBUS_INT64_TYPE_ID);
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: Int64 (userdata=%p)", ud));
     return 0;
 }
 
 
+/**
+ @function addAssign
+ @within l2dbus.Int64
+
+ Adds a value to the Int64 in place.
+
+ Unlike the arithmetic operators this does not allocate a new Int64 which
+ makes it suitable for accumulating (e.g. counters) in a loop.
+
+ @tparam userdata acc The Int64 to modify.
+ @tparam number|userdata value The value to add.
+ @treturn userdata The modified Int64 (*acc*).
+ */
+static int
+l2dbus_int64AddAssign
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Int64* ud = (l2dbus_Int64*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_INT64_TYPE_ID);
+    int64_t v = l2dbus_int64Cast(L, 2, L2DUS_INVALID_STACK_INDEX);
+
+    ud->value += v;
+    lua_settop(L, 1);
+    return 1;
+}
+
+
+/**
+ @function subAssign
+ @within l2dbus.Int64
+
+ Subtracts a value from the Int64 in place.
+
+ See @{addAssign}.
+
+ @tparam userdata acc The Int64 to modify.
+ @tparam number|userdata value The value to subtract.
+ @treturn userdata The modified Int64 (*acc*).
+ */
+static int
+l2dbus_int64SubAssign
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Int64* ud = (l2dbus_Int64*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_INT64_TYPE_ID);
+    int64_t v = l2dbus_int64Cast(L, 2, L2DUS_INVALID_STACK_INDEX);
+
+    ud->value -= v;
+    lua_settop(L, 1);
+    return 1;
+}
+
+
+/**
+ @function mulAssign
+ @within l2dbus.Int64
+
+ Multiplies the Int64 by a value in place.
+
+ See @{addAssign}.
+
+ @tparam userdata acc The Int64 to modify.
+ @tparam number|userdata value The value to multiply by.
+ @treturn userdata The modified Int64 (*acc*).
+ */
+static int
+l2dbus_int64MulAssign
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Int64* ud = (l2dbus_Int64*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_INT64_TYPE_ID);
+    int64_t v = l2dbus_int64Cast(L, 2, L2DUS_INVALID_STACK_INDEX);
+
+    ud->value *= v;
+    lua_settop(L, 1);
+    return 1;
+}
+
+
 /*
  * Define the methods of the Int64 class
  */
@@ -535,6 +666,9 @@ static const luaL_Reg l2dbus_int64MetaTable[] = {
     {"__tostring", l2dbus_int64ToString},
     {"toString", l2dbus_int64ToString},
     {"toNumber", l2dbus_int64ToNumber},
+    {"addAssign", l2dbus_int64AddAssign},
+    {"subAssign", l2dbus_int64SubAssign},
+    {"mulAssign", l2dbus_int64MulAssign},
     {"__concat", l2dbus_int64Concat},
     {"__gc", l2dbus_int64Dispose},
     {NULL, NULL},
@@ -29,6 +29,7 @@
 
 #include <stdint.h>
 #include "lua.h"
+#include "l2dbus_types.h"
 
 typedef struct l2dbus_Int64
 {
@@ -36,6 +37,7 @@ typedef struct l2dbus_Int64
 } l2dbus_Int64;
 
 int l2dbus_int64Create(lua_State* L, int idx, int base);
+void l2dbus_int64Push(lua_State* L, int64_t value, l2dbus_Bool asNumber);
 void l2dbus_openInt64(lua_State* L);
 
 #endif /* Guard for L2DBUS_INT64_H_ */
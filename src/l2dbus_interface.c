@@ -47,8 +47,10 @@
 #include "l2dbus_types.h"
 #include "l2dbus_alloc.h"
 #include "l2dbus_object.h"
+#include "l2dbus_introspection.h"
 #include "l2dbus_message.h"
 #include "l2dbus_dbuscompat.h"
+#include "l2dbus_stats.h"
 #include "lualib.h"
 
 /**
@@ -160,6 +162,9 @@ l2dbus_interfaceHandler
     const char* errMsg = "";
     DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     l2dbus_Interface* ud;
+    l2dbus_Message* msgUd = NULL;
+    double cbStart;
+    int status;
 
     /* Leaves the userdata sitting on the top of the stack */
     ud = l2dbus_objectRegistryGet(L, userdata);
@@ -193,11 +198,21 @@ l2dbus_interfaceHandler
         else
         {
             /* Push a Lua wrapper around the message */
-            l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
+            if ( ud->borrowMsg )
+            {
+                msgUd = l2dbus_messageBorrow(L, msg);
+            }
+            else
+            {
+                l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
+            }
 
             lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.userRef);
 
-            if ( 0 != lua_pcall(L, 4 /* nArgs */, 1 /* nResults */, 0) )
+            cbStart = l2dbus_statsCallbackStart(L, 4 /* nArgs */);
+            status = lua_pcall(L, 4 /* nArgs */, 1 /* nResults */, 0);
+            l2dbus_statsCallback(L2DBUS_STATS_CB_INTERFACE, cbStart, status);
+            if ( 0 != status )
             {
                 if ( lua_isstring(L, -1) )
                 {
@@ -230,9 +245,18 @@ l2dbus_interfaceHandler
         }
     }
 
+    /* Invalidate a borrowed message now the handler has returned */
+    if ( NULL != msgUd )
+    {
+        l2dbus_messageGiveBack(L, msgUd);
+    }
+
     /* Clean up the thread stack */
     lua_settop(L, 0);
 
+    /* Reclaim any transient allocations made while servicing the callback */
+    l2dbus_arenaReset();
+
     /* The return value is unused by CDBUS */
     return rc;
 }
@@ -325,8 +349,10 @@ l2dbus_newInterface
     {
         /* Reset the userdata structure */
         l2dbus_callbackInit(&intfUd->cbCtx);
+        l2dbus_propStoreInit(&intfUd->props);
 
         l2dbus_callbackRef(L, funcIdx, userIdx, &intfUd->cbCtx);
+        intfUd->handler = l2dbus_interfaceHandler;
         intfUd->intf = cdbus_interfaceNew(intfName, l2dbus_interfaceHandler, intfUd);
 
         if ( NULL == intfUd->intf )
@@ -363,8 +389,8 @@ l2dbus_interfaceDispose
     lua_State*  L
     )
 {
-    l2dbus_Interface* ud = (l2dbus_Interface*)luaL_checkudata(L, -1,
-                                        L2DBUS_INTERFACE_MTBL_NAME);
+    l2dbus_Interface* ud = (l2dbus_Interface*)l2dbus_checkUserData(L, -1,
+                                        L2DBUS_INTERFACE_TYPE_ID);
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: interface (userdata=%p)", ud));
 
@@ -373,6 +399,9 @@ l2dbus_interfaceDispose
         cdbus_interfaceUnref(ud->intf);
     }
 
+    l2dbus_introspectionReleaseInterface(L, ud);
+    l2dbus_propStoreClear(L, &ud->props);
+
     /* Remove the weak association between the interface userdata pointer
      * and itself.
      */
@@ -411,8 +440,8 @@ l2dbus_interfaceGetName
     )
 {
     const char* name;
-    l2dbus_Interface* ud = (l2dbus_Interface*)luaL_checkudata(L, 1,
-                                        L2DBUS_INTERFACE_MTBL_NAME);
+    l2dbus_Interface* ud = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_INTERFACE_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -446,8 +475,8 @@ l2dbus_interfaceSetData
     lua_State*  L
     )
 {
-    l2dbus_Interface* ud = (l2dbus_Interface*)luaL_checkudata(L, 1,
-                                        L2DBUS_INTERFACE_MTBL_NAME);
+    l2dbus_Interface* ud = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_INTERFACE_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -481,8 +510,8 @@ l2dbus_interfaceGetData
     lua_State*  L
     )
 {
-    l2dbus_Interface* ud = (l2dbus_Interface*)luaL_checkudata(L, 1,
-                                        L2DBUS_INTERFACE_MTBL_NAME);
+    l2dbus_Interface* ud = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_INTERFACE_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -493,6 +522,39 @@ l2dbus_interfaceGetData
 }
 
 
+/**
+ @function setBorrowMessages
+ @within Interface
+
+ Selects borrowed message delivery for the request handler.
+
+ When enabled the handler is passed a pooled Message wrapper that is
+ only valid until the handler returns. This avoids allocating a new
+ Message userdata for every request. A handler that needs the message
+ after it returns must call @{l2dbus.Message.retain|retain} on it.
+
+ @tparam userdata interface The Interface.
+ @tparam bool enable Set to **true** to enable borrowed delivery or
+ **false** (the default) to disable it.
+ */
+static int
+l2dbus_interfaceSetBorrowMessages
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ud = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_INTERFACE_TYPE_ID);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    ud->borrowMsg = lua_toboolean(L, 2) ? L2DBUS_TRUE : L2DBUS_FALSE;
+
+    return 0;
+}
+
+
 /**
  This table that defines an individual D-Bus property item in an interface
  description. An individual property is typically one of many in an array
@@ -810,13 +872,16 @@ l2dbus_interfaceRegisterMethods
     const char* reason = "";
 
     l2dbus_Bool isRegistered = L2DBUS_FALSE;
-    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
-                                        L2DBUS_INTERFACE_MTBL_NAME);
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_INTERFACE_TYPE_ID);
     luaL_checktype(L, 2, LUA_TTABLE);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
+    /* Any cached introspection XML no longer describes the interface */
+    l2dbus_introspectionReleaseInterface(L, ifUd);
+
     if ( l2dbus_interfaceParseItems(L, 2, &methods, &nMethods, L2DBUS_TRUE, &reason) )
     {
         isRegistered = cdbus_interfaceRegisterMethods(ifUd->intf, methods, nMethods);
@@ -861,11 +926,13 @@ l2dbus_interfaceClearMethods
     lua_State*  L
     )
 {
-    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
-                                            L2DBUS_INTERFACE_MTBL_NAME);
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_INTERFACE_TYPE_ID);
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
+    /* Any cached introspection XML no longer describes the interface */
+    l2dbus_introspectionReleaseInterface(L, ifUd);
     lua_pushboolean(L, cdbus_interfaceClearMethods(ifUd->intf));
 
     return 1;
@@ -923,13 +990,16 @@ l2dbus_interfaceRegisterSignals
     const char* reason = "";
 
     l2dbus_Bool isRegistered = L2DBUS_FALSE;
-    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
-                                        L2DBUS_INTERFACE_MTBL_NAME);
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_INTERFACE_TYPE_ID);
     luaL_checktype(L, 2, LUA_TTABLE);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
+    /* Any cached introspection XML no longer describes the interface */
+    l2dbus_introspectionReleaseInterface(L, ifUd);
+
     if ( l2dbus_interfaceParseItems(L, 2, &signals, &nSignals, L2DBUS_FALSE, &reason) )
     {
         isRegistered = cdbus_interfaceRegisterSignals(ifUd->intf, signals, nSignals);
@@ -974,11 +1044,13 @@ l2dbus_interfaceClearSignals
     lua_State*  L
     )
 {
-    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
-                                            L2DBUS_INTERFACE_MTBL_NAME);
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_INTERFACE_TYPE_ID);
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
+    /* Any cached introspection XML no longer describes the interface */
+    l2dbus_introspectionReleaseInterface(L, ifUd);
     lua_pushboolean(L, cdbus_interfaceClearSignals(ifUd->intf));
 
     return 1;
@@ -1036,14 +1108,18 @@ l2dbus_interfaceRegisterProperties
     l2dbus_Bool isRegistered = L2DBUS_FALSE;
     const char* reason = "unknown failure";
     cdbus_DbusIntrospectProperty* props = NULL;
-    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
-                                        L2DBUS_INTERFACE_MTBL_NAME);
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_INTERFACE_TYPE_ID);
 
     luaL_checktype(L, 2, LUA_TTABLE);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
+    /* Any cached introspection XML no longer describes the interface */
+    l2dbus_introspectionReleaseInterface(L, ifUd);
+    l2dbus_propStoreClear(L, &ifUd->props);
+
     nProps = lua_rawlen(L, 2);
     /* I guess it's valid to register no items */
     if ( 0 == nProps )
@@ -1125,6 +1201,20 @@ l2dbus_interfaceRegisterProperties
             {
                 isRegistered = cdbus_interfaceRegisterProperties(ifUd->intf, props, nProps);
             }
+
+            /* Mirror the properties in the (native) property store */
+            for ( propIdx = 0; isRegistered && (propIdx < nProps); ++propIdx )
+            {
+                if ( !l2dbus_propStoreAdd(&ifUd->props, props[propIdx].name,
+                                        props[propIdx].signature,
+                                        props[propIdx].read,
+                                        props[propIdx].write) )
+                {
+                    l2dbus_propStoreClear(L, &ifUd->props);
+                    reason = "failed to allocate memory for property store";
+                    isRegistered = L2DBUS_FALSE;
+                }
+            }
         }
     }
 
@@ -1163,11 +1253,14 @@ l2dbus_interfaceClearProperties
     lua_State*  L
     )
 {
-    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 1,
-                                            L2DBUS_INTERFACE_MTBL_NAME);
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_INTERFACE_TYPE_ID);
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
+    /* Any cached introspection XML no longer describes the interface */
+    l2dbus_introspectionReleaseInterface(L, ifUd);
+    l2dbus_propStoreClear(L, &ifUd->props);
     lua_pushboolean(L, cdbus_interfaceClearProperties(ifUd->intf));
 
     return 1;
@@ -1195,8 +1288,8 @@ l2dbus_interfaceIntrospect
     lua_State*  L
     )
 {
-    l2dbus_Interface* ud = (l2dbus_Interface*)luaL_checkudata(L, 1,
-                                        L2DBUS_INTERFACE_MTBL_NAME);
+    l2dbus_Interface* ud = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_INTERFACE_TYPE_ID);
     cdbus_StringBuffer* buf;
 
     /* Make sure the module is initialized */
@@ -1224,12 +1317,17 @@ static const luaL_Reg l2dbus_interfaceMetaTable[] = {
     {"name", l2dbus_interfaceGetName},
     {"setData", l2dbus_interfaceSetData},
     {"data", l2dbus_interfaceGetData},
+    {"setBorrowMessages", l2dbus_interfaceSetBorrowMessages},
     {"registerMethods", l2dbus_interfaceRegisterMethods},
     {"clearMethods", l2dbus_interfaceClearMethods},
     {"registerSignals", l2dbus_interfaceRegisterSignals},
     {"clearSignals", l2dbus_interfaceClearSignals},
     {"registerProperties", l2dbus_interfaceRegisterProperties},
     {"clearProperties", l2dbus_interfaceClearProperties},
+    {"enablePropertyStore", l2dbus_interfaceEnablePropertyStore},
+    {"setProperty", l2dbus_interfaceSetProperty},
+    {"getProperty", l2dbus_interfaceGetProperty},
+    {"setPropertyHandler", l2dbus_interfaceSetPropertyHandler},
     {"introspect", l2dbus_interfaceIntrospect},
     {"__gc", l2dbus_interfaceDispose},
     {NULL, NULL},
@@ -35,15 +35,33 @@
 #define L2DBUS_INTERFACE_H_
 
 #include "lua.h"
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
 #include "l2dbus_callback.h"
+#include "l2dbus_propstore.h"
 
 /* Forward declarations */
 struct cdbus_Interface;
+struct cdbus_Connection;
+struct cdbus_Object;
+struct l2dbus_XmlFragment;
+
+/* The CDBUS handler an interface was created with */
+typedef DBusHandlerResult (*l2dbus_InterfaceHandler)(
+                                        struct cdbus_Connection* conn,
+                                        struct cdbus_Object* obj,
+                                        DBusMessage* msg,
+                                        void* userdata);
 
 typedef struct l2dbus_Interface
 {
     struct cdbus_Interface*             intf;
+    l2dbus_InterfaceHandler             handler;
     l2dbus_CallbackCtx                  cbCtx;
+    l2dbus_Bool                         borrowMsg;
+    struct l2dbus_XmlFragment*          xmlFragment;
+    /* The registered properties and their (pre-marshalled) values */
+    l2dbus_PropStore                    props;
 } l2dbus_Interface;
 
 void l2dbus_openInterface(lua_State* L);
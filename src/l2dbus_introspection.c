@@ -35,6 +35,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <string.h>
+#include "dbus/dbus.h"
 #include "cdbus/cdbus.h"
 #include "l2dbus_compat.h"
 #include "l2dbus_trace.h"
@@ -42,10 +43,410 @@
 #include "l2dbus_types.h"
 #include "l2dbus_introspection.h"
 #include "l2dbus_interface.h"
+#include "l2dbus_serviceobject.h"
+#include "l2dbus_callback.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_util.h"
 #include "l2dbus_core.h"
 #include "l2dbus_object.h"
+#include "l2dbus_xmlparse.h"
+#include "l2dbus_context.h"
+#include "l2dbus_subtree.h"
 #include "lualib.h"
 
+struct l2dbus_XmlFragment
+{
+    struct l2dbus_XmlFragment*  next;
+    unsigned                    hash;
+    unsigned                    refCount;
+    size_t                      len;
+    char                        xml[1];
+};
+
+/* The shared interface fragments and the introspection generation are
+ * kept in the module context. A service object's cached XML is only valid
+ * for the generation it was built in.
+ */
+
+static cdbus_DbusIntrospectArgs gIntrospectArgs[] =
+{
+    { "xml_data", "s", CDBUS_XFER_OUT }
+};
+
+static cdbus_DbusIntrospectItem gIntrospectMethods[] =
+{
+    { "Introspect", gIntrospectArgs, 1 }
+};
+
+
+static unsigned
+l2dbus_introspectionHash
+    (
+    const char* s,
+    size_t      len
+    )
+{
+    unsigned h = 2166136261u;
+    size_t idx;
+
+    for ( idx = 0; idx < len; ++idx )
+    {
+        h = (h ^ (unsigned char)s[idx]) * 16777619u;
+    }
+    return h;
+}
+
+
+static l2dbus_XmlFragment*
+l2dbus_introspectionInternFragment
+    (
+    l2dbus_Context* ctx,
+    const char*     xml,
+    size_t          len
+    )
+{
+    unsigned hash = l2dbus_introspectionHash(xml, len);
+    l2dbus_XmlFragment** bucket = &ctx->fragments[hash %
+                                L2DBUS_INTROSPECTION_FRAGMENT_BUCKETS];
+    l2dbus_XmlFragment* frag;
+
+    for ( frag = *bucket; NULL != frag; frag = frag->next )
+    {
+        if ( (frag->hash == hash) && (frag->len == len) &&
+            (0 == memcmp(frag->xml, xml, len)) )
+        {
+            frag->refCount++;
+            return frag;
+        }
+    }
+
+    frag = (l2dbus_XmlFragment*)l2dbus_malloc(sizeof(*frag) + len);
+    if ( NULL != frag )
+    {
+        frag->hash = hash;
+        frag->refCount = 1;
+        frag->len = len;
+        memcpy(frag->xml, xml, len);
+        frag->xml[len] = '\0';
+        frag->next = *bucket;
+        *bucket = frag;
+    }
+
+    return frag;
+}
+
+
+static void
+l2dbus_introspectionUnrefFragment
+    (
+    l2dbus_Context*     ctx,
+    l2dbus_XmlFragment* frag
+    )
+{
+    l2dbus_XmlFragment** link;
+
+    if ( (NULL != frag) && (0 == --frag->refCount) )
+    {
+        link = &ctx->fragments[frag->hash %
+                                L2DBUS_INTROSPECTION_FRAGMENT_BUCKETS];
+        while ( NULL != *link )
+        {
+            if ( *link == frag )
+            {
+                *link = frag->next;
+                break;
+            }
+            link = &(*link)->next;
+        }
+        l2dbus_free(frag);
+    }
+}
+
+
+/* Returns the (cached) XML fragment for an interface or NULL if the
+ * interface has no methods, signals or properties.
+ */
+static l2dbus_XmlFragment*
+l2dbus_introspectionGetFragment
+    (
+    l2dbus_Context*     ctx,
+    l2dbus_Interface*   intfUd
+    )
+{
+    cdbus_StringBuffer* buf;
+
+    if ( NULL == intfUd->xmlFragment )
+    {
+        buf = cdbus_interfaceIntrospect(intfUd->intf);
+        if ( NULL != buf )
+        {
+            if ( !cdbus_stringBufferIsEmpty(buf) )
+            {
+                intfUd->xmlFragment = l2dbus_introspectionInternFragment(ctx,
+                                        cdbus_stringBufferRaw(buf),
+                                        cdbus_stringBufferLength(buf));
+            }
+            cdbus_stringBufferUnref(buf);
+        }
+    }
+
+    return intfUd->xmlFragment;
+}
+
+
+/* Concatenates the interface fragments of a service object */
+static void
+l2dbus_introspectionBuildObject
+    (
+    lua_State*              L,
+    l2dbus_ServiceObject*   objUd
+    )
+{
+    l2dbus_RefItem* item;
+    l2dbus_Interface* intfUd;
+    l2dbus_XmlFragment* frag;
+    size_t len = 0;
+    int top = lua_gettop(L);
+    int idx;
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
+    l2dbus_introspectionReleaseObject(objUd);
+
+    /* The fragments are gathered on the stack (as light userdata) so the
+     * interfaces only have to be visited once.
+     */
+    LIST_FOREACH(item, &objUd->interfaces.list, link)
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, item->refIdx);
+        intfUd = (l2dbus_Interface*)l2dbus_isUserData(L, -1,
+                                            L2DBUS_INTERFACE_TYPE_ID);
+        lua_pop(L, 1);
+        frag = (NULL != intfUd) ? l2dbus_introspectionGetFragment(ctx, intfUd) :
+                                    NULL;
+        if ( NULL != frag )
+        {
+            luaL_checkstack(L, 1, "too many interfaces");
+            lua_pushlightuserdata(L, frag);
+            len += frag->len;
+        }
+    }
+
+    objUd->introspectXml = (char*)l2dbus_malloc(len + 1);
+    if ( NULL != objUd->introspectXml )
+    {
+        len = 0;
+        for ( idx = top + 1; idx <= lua_gettop(L); ++idx )
+        {
+            frag = (l2dbus_XmlFragment*)lua_touserdata(L, idx);
+            memcpy(objUd->introspectXml + len, frag->xml, frag->len);
+            len += frag->len;
+        }
+        objUd->introspectXml[len] = '\0';
+        objUd->introspectGen = ctx->introspectGen;
+    }
+
+    lua_settop(L, top);
+}
+
+
+/**
+ * @brief Releases the cached introspection XML of an interface.
+ *
+ * Called whenever the methods, signals, or properties of an interface
+ * change (or the interface is disposed). Service objects regenerate their
+ * cached XML the next time they're introspected.
+ *
+ * @param [in] L Lua state
+ * @param [in] intfUd The interface whose metadata changed.
+ */
+void
+l2dbus_introspectionReleaseInterface
+    (
+    lua_State*          L,
+    l2dbus_Interface*   intfUd
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
+    if ( (NULL != intfUd) && (NULL != ctx) )
+    {
+        l2dbus_introspectionUnrefFragment(ctx, intfUd->xmlFragment);
+        intfUd->xmlFragment = NULL;
+        ctx->introspectGen++;
+    }
+}
+
+
+/**
+ * @brief Releases the cached introspection XML of a service object.
+ *
+ * Called when interfaces are added to or removed from the object (or the
+ * object is disposed).
+ *
+ * @param [in] objUd The service object.
+ */
+void
+l2dbus_introspectionReleaseObject
+    (
+    l2dbus_ServiceObject*   objUd
+    )
+{
+    if ( NULL != objUd )
+    {
+        l2dbus_free(objUd->introspectXml);
+        objUd->introspectXml = NULL;
+        objUd->introspectGen = 0;
+    }
+}
+
+
+/**
+ * @brief Generates the D-Bus XML introspection data for a service object.
+ *
+ * The XML describing the interfaces of the object is cached by the object
+ * and only regenerated after its interfaces change. The child nodes are
+ * always queried from the connection since objects may be registered or
+ * unregistered beneath the path at any time.
+ *
+ * @param [in] L Lua state
+ * @param [in] objUd The service object to introspect.
+ * @param [in] conn The connection the object is registered with.
+ * @param [in] path The object path being introspected.
+ * @return A string buffer (owned by the caller) or NULL on failure.
+ */
+cdbus_StringBuffer*
+l2dbus_introspectionGenerate
+    (
+    lua_State*              L,
+    l2dbus_ServiceObject*   objUd,
+    cdbus_Connection*       conn,
+    const char*             path
+    )
+{
+    cdbus_StringBuffer* buf;
+    char** children = NULL;
+    int idx;
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
+    if ( NULL == ctx )
+    {
+        return NULL;
+    }
+
+    if ( (NULL == objUd->introspectXml) ||
+        (objUd->introspectGen != ctx->introspectGen) )
+    {
+        l2dbus_introspectionBuildObject(L, objUd);
+    }
+
+    if ( NULL == objUd->introspectXml )
+    {
+        return NULL;
+    }
+
+    buf = cdbus_stringBufferNew(strlen(objUd->introspectXml) + 512);
+    if ( NULL != buf )
+    {
+        cdbus_stringBufferAppend(buf, DBUS_INTROSPECT_1_0_XML_DOCTYPE_DECL_NODE);
+        cdbus_stringBufferAppend(buf, "<node name=\"");
+        cdbus_stringBufferAppend(buf, path);
+        cdbus_stringBufferAppend(buf, "\">\n");
+        cdbus_stringBufferAppend(buf, objUd->introspectXml);
+
+        if ( (NULL != conn) && dbus_connection_list_registered(
+                cdbus_connectionGetDBus(conn), path, &children) )
+        {
+            for ( idx = 0; NULL != children[idx]; ++idx )
+            {
+                cdbus_stringBufferAppend(buf, "  <node name=\"");
+                cdbus_stringBufferAppend(buf, children[idx]);
+                cdbus_stringBufferAppend(buf, "\"/>\n");
+            }
+        }
+
+        /* Virtual children of a subtree aren't registered individually */
+        if ( NULL != conn )
+        {
+            l2dbus_subtreeAppendChildren(L, conn, path, buf, children);
+        }
+        if ( NULL != children )
+        {
+            dbus_free_string_array(children);
+        }
+        cdbus_stringBufferAppend(buf, "</node>\n");
+    }
+
+    return buf;
+}
+
+
+/**
+ * @brief Handles Introspect requests for a service object.
+ *
+ * Replies with the (cached) D-Bus XML introspection data of the service
+ * object the request was addressed to.
+ *
+ * @return The D-Bus handler result.
+ */
+static DBusHandlerResult
+l2dbus_introspectionHandler
+    (
+        struct cdbus_Connection*    conn,
+        struct cdbus_Object*        obj,
+        DBusMessage*                msg,
+        void*                       userdata
+    )
+{
+    lua_State* L = l2dbus_callbackGetThread();
+    DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    l2dbus_ServiceObject* objUd;
+    cdbus_StringBuffer* buf;
+    DBusMessage* reply;
+    const char* xml;
+
+    assert( NULL != L );
+
+    if ( dbus_message_is_method_call(msg, DBUS_INTERFACE_INTROSPECTABLE,
+                                    "Introspect") )
+    {
+        /* Leaves the service object (or nil) on the stack */
+        objUd = (l2dbus_ServiceObject*)l2dbus_objectRegistryGet(L, obj);
+        if ( NULL == objUd )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_WARN,
+                "Cannot introspect because the service object has been GC'ed"));
+        }
+        else
+        {
+            rc = DBUS_HANDLER_RESULT_NEED_MEMORY;
+            buf = l2dbus_introspectionGenerate(L, objUd, conn,
+                                            dbus_message_get_path(msg));
+            if ( NULL != buf )
+            {
+                reply = dbus_message_new_method_return(msg);
+                if ( NULL != reply )
+                {
+                    xml = cdbus_stringBufferRaw(buf);
+                    if ( dbus_message_append_args(reply, DBUS_TYPE_STRING,
+                        &xml, DBUS_TYPE_INVALID) &&
+                        dbus_connection_send(cdbus_connectionGetDBus(conn),
+                                            reply, NULL) )
+                    {
+                        rc = DBUS_HANDLER_RESULT_HANDLED;
+                    }
+                    dbus_message_unref(reply);
+                }
+                cdbus_stringBufferUnref(buf);
+            }
+        }
+    }
+
+    /* Clean up the thread stack */
+    lua_settop(L, 0);
+
+    return rc;
+}
+
 
 /**
  L2DBUS Introspection
@@ -104,7 +505,18 @@ l2dbus_newIntrospection
         /* Reset the userdata structure */
         l2dbus_callbackInit(&intfUd->cbCtx);
 
-        intfUd->intf = cdbus_introspectNew();
+        /* The XML is generated (and cached) by L2DBUS rather than CDBUS */
+        intfUd->handler = l2dbus_introspectionHandler;
+        intfUd->intf = cdbus_interfaceNew(DBUS_INTERFACE_INTROSPECTABLE,
+                                        l2dbus_introspectionHandler, intfUd);
+
+        if ( (NULL != intfUd->intf) &&
+            !cdbus_interfaceRegisterMethods(intfUd->intf, gIntrospectMethods,
+                    sizeof(gIntrospectMethods) / sizeof(gIntrospectMethods[0])) )
+        {
+            cdbus_interfaceUnref(intfUd->intf);
+            intfUd->intf = NULL;
+        }
 
         if ( NULL == intfUd->intf )
         {
@@ -125,6 +537,38 @@ l2dbus_newIntrospection
 }
 
 
+/**
+ @function parseXml
+
+ Parses D-Bus XML introspection data into a Lua introspection table.
+
+ Converts the XML returned by a call to the *Introspect* method of the
+ <a href="http://dbus.freedesktop.org/doc/dbus-specification.html#standard-interfaces-introspectable">Introspectable</a>
+ interface into the Lua introspection table used by the
+ @{l2dbus.proxyctrl|ProxyController}. The parser is implemented natively
+ and builds the table in a single pass over the XML. Only the interfaces of
+ the root node are included; child nodes are ignored. A Lua error is thrown
+ if the XML is malformed.
+
+ @tparam string xml The D-Bus XML introspection data.
+ @treturn table The Lua introspection table. See
+ ProxyController:bindNoIntrospect for a description of the layout of this
+ table.
+ */
+static int
+l2dbus_introspectionParseXml
+    (
+    lua_State*  L
+    )
+{
+    size_t len = 0;
+    const char* xml = luaL_checklstring(L, 1, &len);
+
+    l2dbus_xmlParseIntrospection(L, xml, len);
+    return 1;
+}
+
+
 /**
  * @brief Creates the Introspection sub-module.
  *
@@ -143,6 +587,8 @@ l2dbus_openIntrospection
     lua_newtable(L);
     lua_pushcfunction(L, l2dbus_newIntrospection);
     lua_setfield(L, -2, "new");
+    lua_pushcfunction(L, l2dbus_introspectionParseXml);
+    lua_setfield(L, -2, "parseXml");
 }
 
 
@@ -36,6 +36,22 @@
 
 #include "lua.h"
 
+/* Forward declarations */
+struct cdbus_Connection;
+struct cdbus_StringBuffer;
+struct l2dbus_Interface;
+struct l2dbus_ServiceObject;
+
+/* A (shared) XML introspection fragment for an interface */
+typedef struct l2dbus_XmlFragment l2dbus_XmlFragment;
+
+void l2dbus_introspectionReleaseInterface(lua_State* L,
+                                struct l2dbus_Interface* intfUd);
+void l2dbus_introspectionReleaseObject(struct l2dbus_ServiceObject* objUd);
+struct cdbus_StringBuffer* l2dbus_introspectionGenerate(lua_State* L,
+                                struct l2dbus_ServiceObject* objUd,
+                                struct cdbus_Connection* conn,
+                                const char* path);
 void l2dbus_openIntrospection(lua_State* L);
 
 #endif /* Guard for L2DBUS_INTROSPECTION_H_ */
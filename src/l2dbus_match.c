@@ -35,6 +35,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <string.h>
+#include <math.h>
 #include "l2dbus_compat.h"
 #include "l2dbus_match.h"
 #include "l2dbus_connection.h"
@@ -46,6 +47,10 @@
 #include "l2dbus_types.h"
 #include "l2dbus_message.h"
 #include "l2dbus_alloc.h"
+#include "l2dbus_dispatcher.h"
+#include "l2dbus_sigrouter.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_predecode.h"
 #include "lualib.h"
 
 /**
@@ -100,6 +105,88 @@
  rules, and all match rules behaved as if eavesdrop equals **true** had
  been used.
  @field filterArgs (array) A Lua array of arg*N* @{FilterArgs|filter arguments}.
+ @field borrowMessage (bool) An l2dbus specific option. If **true** the
+ message handler is passed a pooled Message wrapper that is only valid
+ until the handler returns. Use @{l2dbus.Message.retain|retain} to keep
+ the message beyond the handler. The default is **false**.
+ @field clientFilter (table) An l2dbus specific @{ClientFilter|filter}
+ evaluated in C before the message handler is called. Messages rejected
+ by the filter never enter Lua.
+ @field priority (string) An l2dbus specific delivery priority of *high*,
+ *normal* (the default) or *bulk*. Deliveries deferred by the
+ @{l2dbus.Dispatcher.setDispatchBudget|dispatch budget} are queued in a
+ lane per priority and higher priority lanes are drained first. Messages
+ of a *bulk* match are always deferred so the bulk traffic that arrives
+ together with method calls is handled after them.
+ @field conflate (table) An l2dbus specific @{ConflatePolicy|conflation policy}.
+ A queued message is superseded by a newer message of the same match that
+ has the same conflation key.
+ @field predecode (bool) An l2dbus specific option. If **true** the
+ message arguments are decoded by a helper thread of the
+ @{l2dbus.Dispatcher|Dispatcher} into a compact, pointer-free form and the
+ handler is called with the decoded arguments following the user token,
+ e.g. *handler(match, msg, userToken, arg1, arg2, ...)*. The values are
+ the same as those returned by @{l2dbus.Message.getArgs|getArgs} but the
+ Lua thread only copies them into Lua values. Deliveries of the match
+ happen in the order the messages arrived but may come after those of
+ other matches and they are not charged to the dispatch budget. It cannot
+ be combined with *conflate* or the *bulk* priority. The default is
+ **false**.
+ */
+
+/**
+ The table that describes how queued messages of a match are conflated.
+ A handler that falls behind a chatty sender (e.g. repeated
+ PropertiesChanged signals or progress updates) usually only cares about
+ the latest message for each object. Messages of a conflating match are
+ always queued until the @{l2dbus.Dispatcher|Dispatcher} returns to the
+ main loop (or the connection's dispatch budget is replenished) and a
+ queued message is replaced in place by a newer one with an equal key.
+ The handler is therefore called once per key with the newest message.
+ Messages of the same connection and priority not matched by a
+ conflating rule are queued behind them to preserve the order of
+ delivery. The number of
+ superseded messages is reported as *conflated* in the
+ @{l2dbus.Stats.MessageCounters|message counters}.
+
+ @table ConflatePolicy
+ @field path (bool) The object path is part of the key. The default is
+ **true**.
+ @field member (bool) The member name is part of the key. The default is
+ **true**.
+ @field argIndex (number) The index [0, 63] of a basic typed argument whose
+ value is part of the key. By default no argument is part of the key.
+ */
+
+/**
+ The table that describes additional conditions a matched message must
+ satisfy before it's delivered to the Lua handler. Unlike the rule itself
+ these conditions are evaluated by L2DBUS (not the bus daemon) and so can
+ test argument values the daemon can't. Every field is optional and all
+ the given conditions must hold.
+
+ @table ClientFilter
+ @field signature (string) The exact D-Bus signature of the message body.
+ @field pathPrefix (string) The object path of the message must start with
+ this prefix.
+ @field senders (array) An allow-list of (unique) sender names.
+ @field args (array) An array of at most 16 @{ArgPredicate|argument predicates}.
+ */
+
+/**
+ The table that describes a predicate on a single basic typed argument of
+ the message body. Specify *value* for an equality test or *min* and/or
+ *max* for an (inclusive) numeric range test. Numeric values are
+ compared as Lua numbers, strings compare equal to string, object path
+ and signature arguments, and booleans to boolean arguments. A predicate
+ on an argument that doesn't exist or has an unsuitable type rejects the
+ message.
+
+ @table ArgPredicate
+ @field index (number) The argument index [0, 63].
+ @field value (number|string|bool) The value the argument must equal.
+ @field min (number) The minimum numeric value of the argument.
+ @field max (number) The maximum numeric value of the argument.
  */
 
 /**
@@ -117,31 +204,37 @@
  */
 
 /**
- * @brief Process rule matches and dispatch to Lua handler function.
+ * @brief Delivers a matched message to the Lua handler function.
  *
- * This function is called whenever a match rule is matched and needs
- * to be dispatched to a Lua handler function.
+ * This function calls the Lua handler of a match rule with the given
+ * message. It is used by the match handler and is exposed so the
+ * delivery path can be exercised without a bus connection.
  *
- * @param [in] conn The CDBUS connection on which the message matched.
- * @param [in] hnd An opaque CDBUS match handle.
+ * @param [in] match The match rule whose handler should be called.
  * @param [in] msg The D-Bus message that matched.
- * @param [in] userData User provided data that is returned in the callback.
  */
-static void
-l2dbus_matchHandler
+void
+l2dbus_matchDeliver
     (
-    cdbus_Connection*   conn,
-    cdbus_Handle        hnd,
-    DBusMessage*        msg,
-    void*               userData
+    l2dbus_Match*   match,
+    DBusMessage*    msg
     )
 {
     lua_State* L = l2dbus_callbackGetThread();
     const char* errMsg = "";
-    l2dbus_Match* match = (l2dbus_Match*)userData;
+    l2dbus_Message* msgUd = NULL;
+    double cbStart;
+    int status;
 
     assert( NULL != L );
 
+    /* Signal routes fan the message out to all their subscribers */
+    if ( (NULL != match) && (NULL != match->route) )
+    {
+        l2dbus_sigRouterDeliver(match->route, msg);
+        return;
+    }
+
     if ( NULL != match)
     {
         /* Push function and user value on the stack and execute the callback */
@@ -149,11 +242,21 @@ l2dbus_matchHandler
         lua_pushlightuserdata(L, match);
 
         /* Leaves a Message userdata object on the stack */
-        l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
+        if ( match->borrowMsg )
+        {
+            msgUd = l2dbus_messageBorrow(L, msg);
+        }
+        else
+        {
+            l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
+        }
 
         lua_rawgeti(L, LUA_REGISTRYINDEX, match->cbCtx.userRef);
 
-        if ( 0 != lua_pcall(L, 3 /* nArgs */, 0, 0) )
+        cbStart = l2dbus_statsCallbackStart(L, 3 /* nArgs */);
+        status = lua_pcall(L, 3 /* nArgs */, 0, 0);
+        l2dbus_statsCallback(L2DBUS_STATS_CB_MATCH, cbStart, status);
+        if ( 0 != status )
         {
             if ( lua_isstring(L, -1) )
             {
@@ -161,51 +264,821 @@ l2dbus_matchHandler
             }
             L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Match callback error: %s", errMsg));
         }
+
+        /* Invalidate a borrowed message now the handler has returned */
+        if ( NULL != msgUd )
+        {
+            l2dbus_messageGiveBack(L, msgUd);
+        }
     }
 
     /* Clean up the thread stack */
     lua_settop(L, 0);
+
+    /* Reclaim any transient allocations made while servicing the callback */
+    l2dbus_arenaReset();
+}
+
+
+/* Releases a client-side filter */
+static void
+l2dbus_matchFreeFilter
+    (
+    l2dbus_MatchFilter* filter
+    )
+{
+    unsigned idx;
+
+    if ( NULL != filter )
+    {
+        l2dbus_free(filter->signature);
+        l2dbus_free(filter->pathPrefix);
+        for ( idx = 0; idx < filter->nSenders; ++idx )
+        {
+            l2dbus_free(filter->senders[idx]);
+        }
+        l2dbus_free(filter->senders);
+        for ( idx = 0; idx < filter->nArgs; ++idx )
+        {
+            l2dbus_free(filter->args[idx].str);
+        }
+        l2dbus_free(filter);
+    }
 }
 
 
 /**
- * @brief De-allocates and free's a match rule structure.
+ * @brief Parses the (optional) conflation policy of a match rule.
  *
- * This function is called to free and destroy a match rule
- * structure.
+ * @param [in]  L           Lua state
+ * @param [in]  ruleIdx     The index of the match rule table.
+ * @param [out] conflate    Receives the policy or NULL if there is none.
+ * @return NULL on success otherwise a constant error message.
+ */
+static const char*
+l2dbus_matchParseConflate
+    (
+    lua_State*              L,
+    int                     ruleIdx,
+    l2dbus_MatchConflate**  conflate
+    )
+{
+    l2dbus_MatchConflate* c;
+    const char* reason = NULL;
+    int top = lua_gettop(L);
+    int policyIdx;
+
+    *conflate = NULL;
+    lua_getfield(L, ruleIdx, "conflate");
+    if ( lua_isnil(L, -1) )
+    {
+        lua_settop(L, top);
+        return NULL;
+    }
+    else if ( !lua_istable(L, -1) )
+    {
+        lua_settop(L, top);
+        return "conflate table expected";
+    }
+    policyIdx = lua_gettop(L);
+
+    c = (l2dbus_MatchConflate*)l2dbus_calloc(1, sizeof(*c));
+    if ( NULL == c )
+    {
+        lua_settop(L, top);
+        return "failed to allocate memory for the conflation policy";
+    }
+
+    lua_getfield(L, policyIdx, "path");
+    c->byPath = (lua_isnil(L, -1) || lua_toboolean(L, -1)) ? L2DBUS_TRUE :
+                                                            L2DBUS_FALSE;
+    lua_getfield(L, policyIdx, "member");
+    c->byMember = (lua_isnil(L, -1) || lua_toboolean(L, -1)) ? L2DBUS_TRUE :
+                                                            L2DBUS_FALSE;
+    lua_getfield(L, policyIdx, "argIndex");
+    if ( lua_isnil(L, -1) )
+    {
+        c->argIndex = -1;
+    }
+    else if ( !lua_isnumber(L, -1) )
+    {
+        reason = "conflation argIndex must be a number";
+    }
+    else
+    {
+        c->argIndex = lua_tointeger(L, -1);
+        if ( (0 > c->argIndex) ||
+            (DBUS_MAXIMUM_MATCH_RULE_ARG_NUMBER < c->argIndex) )
+        {
+            reason = "conflation argIndex out of range";
+        }
+    }
+
+    lua_settop(L, top);
+
+    if ( NULL != reason )
+    {
+        l2dbus_free(c);
+    }
+    else
+    {
+        *conflate = c;
+    }
+
+    return reason;
+}
+
+
+/**
+ * @brief Extracts the conflation key of a message.
  *
- * @param [in] rule The match rule to free.
+ * Components excluded by the policy of the match are left NULL (or
+ * DBUS_TYPE_INVALID). So is an argument that doesn't exist or isn't of a
+ * basic type which means all such messages share that component.
+ *
+ * @param [in]  match   The conflating match rule.
+ * @param [in]  msg     The matched message.
+ * @param [out] key     Receives the key.
  */
-static void
-l2dbus_matchFreeRule
+void
+l2dbus_matchConflateKey
     (
-    cdbus_MatchRule*    rule
+    const l2dbus_Match*         match,
+    DBusMessage*                msg,
+    l2dbus_MatchConflateKey*    key
     )
 {
+    const l2dbus_MatchConflate* c = match->conflate;
+    DBusMessageIter iter;
     int idx;
-    if ( NULL != rule )
+
+    assert( NULL != c );
+
+    memset(key, 0, sizeof(*key));
+    key->argType = DBUS_TYPE_INVALID;
+    if ( c->byPath )
+    {
+        key->path = dbus_message_get_path(msg);
+    }
+    if ( c->byMember )
+    {
+        key->member = dbus_message_get_member(msg);
+    }
+
+    if ( (0 <= c->argIndex) && dbus_message_iter_init(msg, &iter) )
+    {
+        for ( idx = 0; idx < c->argIndex; ++idx )
+        {
+            if ( !dbus_message_iter_next(&iter) )
+            {
+                return;
+            }
+        }
+
+        key->argType = dbus_message_iter_get_arg_type(&iter);
+        if ( (DBUS_TYPE_STRING == key->argType) ||
+            (DBUS_TYPE_OBJECT_PATH == key->argType) ||
+            (DBUS_TYPE_SIGNATURE == key->argType) )
+        {
+            dbus_message_iter_get_basic(&iter, &key->arg.str);
+        }
+        else if ( dbus_type_is_basic(key->argType) &&
+                (DBUS_TYPE_UNIX_FD != key->argType) )
+        {
+            /* Fixed types are compared by their (zero extended) bits */
+            dbus_message_iter_get_basic(&iter, &key->arg.bits);
+        }
+        else
+        {
+            key->argType = DBUS_TYPE_INVALID;
+        }
+    }
+}
+
+
+/* Compares two optional strings */
+static l2dbus_Bool
+l2dbus_matchStrEqual
+    (
+    const char* a,
+    const char* b
+    )
+{
+    if ( (NULL == a) || (NULL == b) )
+    {
+        return (a == b) ? L2DBUS_TRUE : L2DBUS_FALSE;
+    }
+    return (0 == strcmp(a, b)) ? L2DBUS_TRUE : L2DBUS_FALSE;
+}
+
+
+/**
+ * @brief Determines whether two conflation keys are equal.
+ *
+ * @param [in] a    The first key.
+ * @param [in] b    The second key.
+ * @return L2DBUS_TRUE if a message with key *b* supersedes one with key *a*.
+ */
+l2dbus_Bool
+l2dbus_matchConflateEqual
+    (
+    const l2dbus_MatchConflateKey*  a,
+    const l2dbus_MatchConflateKey*  b
+    )
+{
+    if ( (a->argType != b->argType) ||
+        !l2dbus_matchStrEqual(a->member, b->member) ||
+        !l2dbus_matchStrEqual(a->path, b->path) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    switch ( a->argType )
+    {
+        case DBUS_TYPE_INVALID:
+            return L2DBUS_TRUE;
+
+        case DBUS_TYPE_STRING:
+        case DBUS_TYPE_OBJECT_PATH:
+        case DBUS_TYPE_SIGNATURE:
+            return l2dbus_matchStrEqual(a->arg.str, b->arg.str);
+
+        default:
+            return (a->arg.bits == b->arg.bits) ? L2DBUS_TRUE : L2DBUS_FALSE;
+    }
+}
+
+
+/* Orders argument predicates by the index of the argument they test */
+static int
+l2dbus_matchComparePred
+    (
+    const void* a,
+    const void* b
+    )
+{
+    return ((const l2dbus_MatchArgPred*)a)->index -
+            ((const l2dbus_MatchArgPred*)b)->index;
+}
+
+
+/* Duplicates the string field of a table (if present) */
+static l2dbus_Bool
+l2dbus_matchGetStringField
+    (
+    lua_State*      L,
+    int             tblIdx,
+    const char*     name,
+    char**          value
+    )
+{
+    l2dbus_Bool isValid = L2DBUS_TRUE;
+
+    *value = NULL;
+    lua_getfield(L, tblIdx, name);
+    if ( LUA_TSTRING == lua_type(L, -1) )
+    {
+        *value = l2dbus_strDup(lua_tostring(L, -1));
+        isValid = (NULL != *value);
+    }
+    else if ( !lua_isnil(L, -1) )
     {
-        l2dbus_free(rule->member);
-        l2dbus_free(rule->objInterface);
-        l2dbus_free(rule->sender);
-        l2dbus_free(rule->path);
-        l2dbus_free(rule->arg0Namespace);
+        isValid = L2DBUS_FALSE;
+    }
+    lua_pop(L, 1);
+
+    return isValid;
+}
+
 
-        if ( NULL != rule->filterArgs )
+/* Parses a single argument predicate table at the top of the stack */
+static const char*
+l2dbus_matchParsePred
+    (
+    lua_State*              L,
+    l2dbus_MatchArgPred*    pred
+    )
+{
+    int predIdx = lua_gettop(L);
+    l2dbus_Bool hasMin;
+    l2dbus_Bool hasMax;
+
+    if ( !lua_istable(L, predIdx) )
+    {
+        return "argument predicate table expected";
+    }
+
+    lua_getfield(L, predIdx, "index");
+    if ( !lua_isnumber(L, -1) )
+    {
+        return "argument predicate index not specified";
+    }
+    pred->index = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    if ( (0 > pred->index) ||
+        (DBUS_MAXIMUM_MATCH_RULE_ARG_NUMBER < pred->index) )
+    {
+        return "argument predicate index out of range";
+    }
+
+    lua_getfield(L, predIdx, "value");
+    switch ( lua_type(L, -1) )
+    {
+        case LUA_TNUMBER:
+            pred->kind = L2DBUS_MATCH_PRED_EQUAL_NUMBER;
+            pred->lo = lua_tonumber(L, -1);
+            pred->hi = pred->lo;
+            break;
+
+        case LUA_TSTRING:
+            pred->kind = L2DBUS_MATCH_PRED_EQUAL_STRING;
+            pred->str = l2dbus_strDup(lua_tostring(L, -1));
+            if ( NULL == pred->str )
+            {
+                return "failed to allocate memory for argument predicate";
+            }
+            break;
+
+        case LUA_TBOOLEAN:
+            pred->kind = L2DBUS_MATCH_PRED_EQUAL_BOOLEAN;
+            pred->boolVal = lua_toboolean(L, -1) ? L2DBUS_TRUE : L2DBUS_FALSE;
+            break;
+
+        case LUA_TNIL:
+            lua_getfield(L, predIdx, "min");
+            lua_getfield(L, predIdx, "max");
+            hasMin = lua_isnumber(L, -2) ? L2DBUS_TRUE : L2DBUS_FALSE;
+            hasMax = lua_isnumber(L, -1) ? L2DBUS_TRUE : L2DBUS_FALSE;
+            if ( !hasMin && !hasMax )
+            {
+                return "argument predicate needs a value, min or max";
+            }
+            pred->kind = L2DBUS_MATCH_PRED_RANGE;
+            pred->lo = hasMin ? lua_tonumber(L, -2) : -HUGE_VAL;
+            pred->hi = hasMax ? lua_tonumber(L, -1) : HUGE_VAL;
+            lua_pop(L, 2);
+            break;
+
+        default:
+            return "unsupported argument predicate value";
+    }
+    lua_pop(L, 1);
+
+    return NULL;
+}
+
+
+/**
+ * @brief Parses the (optional) client-side filter of a match rule.
+ *
+ * @param [in]  L       Lua state
+ * @param [in]  ruleIdx The index of the match rule table.
+ * @param [out] filter  Receives the filter or NULL if there is none.
+ * @return NULL on success otherwise a constant error message.
+ */
+static const char*
+l2dbus_matchParseFilter
+    (
+    lua_State*              L,
+    int                     ruleIdx,
+    l2dbus_MatchFilter**    filter
+    )
+{
+    l2dbus_MatchFilter* f;
+    const char* reason = NULL;
+    int top = lua_gettop(L);
+    int filterIdx;
+    int itemIdx;
+    unsigned idx;
+    unsigned n;
+
+    *filter = NULL;
+    lua_getfield(L, ruleIdx, "clientFilter");
+    if ( lua_isnil(L, -1) )
+    {
+        lua_settop(L, top);
+        return NULL;
+    }
+    else if ( !lua_istable(L, -1) )
+    {
+        lua_settop(L, top);
+        return "clientFilter table expected";
+    }
+    filterIdx = lua_gettop(L);
+
+    f = (l2dbus_MatchFilter*)l2dbus_calloc(1, sizeof(*f));
+    if ( NULL == f )
+    {
+        lua_settop(L, top);
+        return "failed to allocate memory for the client filter";
+    }
+
+    if ( !l2dbus_matchGetStringField(L, filterIdx, "signature",
+                                    &f->signature) ||
+        !l2dbus_matchGetStringField(L, filterIdx, "pathPrefix",
+                                    &f->pathPrefix) )
+    {
+        reason = "invalid client filter signature or pathPrefix";
+    }
+    else if ( NULL != f->pathPrefix )
+    {
+        f->pathPrefixLen = strlen(f->pathPrefix);
+    }
+
+    lua_getfield(L, filterIdx, "senders");
+    if ( (NULL == reason) && lua_istable(L, -1) )
+    {
+        itemIdx = lua_gettop(L);
+        n = lua_rawlen(L, itemIdx);
+        if ( 0 < n )
+        {
+            f->senders = (char**)l2dbus_calloc(n, sizeof(char*));
+            if ( NULL == f->senders )
+            {
+                reason = "failed to allocate memory for the client filter";
+            }
+        }
+
+        for ( idx = 0; (NULL == reason) && (idx < n); ++idx )
         {
-            for ( idx = 0; idx <= DBUS_MAXIMUM_MATCH_RULE_ARG_NUMBER; ++idx )
+            lua_rawgeti(L, itemIdx, idx + 1);
+            if ( LUA_TSTRING != lua_type(L, -1) )
             {
-                if ( CDBUS_FILTER_ARG_INVALID ==
-                    rule->filterArgs[idx].argType)
+                reason = "client filter senders must be strings";
+            }
+            else
+            {
+                f->senders[idx] = l2dbus_strDup(lua_tostring(L, -1));
+                if ( NULL == f->senders[idx] )
+                {
+                    reason = "failed to allocate memory for the client filter";
+                }
+                else
                 {
-                    break;
+                    f->nSenders++;
                 }
-                l2dbus_free(rule->filterArgs[idx].value);
             }
+            lua_pop(L, 1);
+        }
+    }
+    else if ( (NULL == reason) && !lua_isnil(L, -1) )
+    {
+        reason = "client filter senders must be an array";
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, filterIdx, "args");
+    if ( (NULL == reason) && lua_istable(L, -1) )
+    {
+        itemIdx = lua_gettop(L);
+        n = lua_rawlen(L, itemIdx);
+        if ( L2DBUS_MATCH_MAX_ARG_PREDICATES < n )
+        {
+            reason = "too many client filter argument predicates";
+        }
 
-            l2dbus_free(rule->filterArgs);
+        for ( idx = 0; (NULL == reason) && (idx < n); ++idx )
+        {
+            lua_rawgeti(L, itemIdx, idx + 1);
+            reason = l2dbus_matchParsePred(L, &f->args[idx]);
+            if ( NULL == reason )
+            {
+                f->nArgs++;
+                lua_pop(L, 1);
+            }
         }
+
+        /* Evaluate the predicates in a single pass over the arguments */
+        qsort(f->args, f->nArgs, sizeof(f->args[0]), l2dbus_matchComparePred);
     }
+    else if ( (NULL == reason) && !lua_isnil(L, -1) )
+    {
+        reason = "client filter args must be an array";
+    }
+
+    lua_settop(L, top);
+
+    if ( NULL != reason )
+    {
+        l2dbus_matchFreeFilter(f);
+    }
+    else
+    {
+        *filter = f;
+    }
+
+    return reason;
+}
+
+
+/* Evaluates an argument predicate against the current argument */
+static l2dbus_Bool
+l2dbus_matchEvalPred
+    (
+    const l2dbus_MatchArgPred*  pred,
+    DBusMessageIter*            iter
+    )
+{
+    union
+    {
+        dbus_bool_t     b;
+        unsigned char   y;
+        dbus_int16_t    n;
+        dbus_uint16_t   q;
+        dbus_int32_t    i;
+        dbus_uint32_t   u;
+        dbus_int64_t    x;
+        dbus_uint64_t   t;
+        double          d;
+        const char*     s;
+    } v;
+    double num;
+    int argType = dbus_message_iter_get_arg_type(iter);
+
+    switch ( argType )
+    {
+        case DBUS_TYPE_STRING:
+        case DBUS_TYPE_OBJECT_PATH:
+        case DBUS_TYPE_SIGNATURE:
+            dbus_message_iter_get_basic(iter, &v.s);
+            return (L2DBUS_MATCH_PRED_EQUAL_STRING == pred->kind) &&
+                    (0 == strcmp(pred->str, v.s));
+
+        case DBUS_TYPE_BOOLEAN:
+            dbus_message_iter_get_basic(iter, &v.b);
+            return (L2DBUS_MATCH_PRED_EQUAL_BOOLEAN == pred->kind) &&
+                    ((v.b ? L2DBUS_TRUE : L2DBUS_FALSE) == pred->boolVal);
+
+        case DBUS_TYPE_BYTE:
+            dbus_message_iter_get_basic(iter, &v.y);
+            num = v.y;
+            break;
+
+        case DBUS_TYPE_INT16:
+            dbus_message_iter_get_basic(iter, &v.n);
+            num = v.n;
+            break;
+
+        case DBUS_TYPE_UINT16:
+            dbus_message_iter_get_basic(iter, &v.q);
+            num = v.q;
+            break;
+
+        case DBUS_TYPE_INT32:
+            dbus_message_iter_get_basic(iter, &v.i);
+            num = v.i;
+            break;
+
+        case DBUS_TYPE_UINT32:
+            dbus_message_iter_get_basic(iter, &v.u);
+            num = v.u;
+            break;
+
+        case DBUS_TYPE_INT64:
+            dbus_message_iter_get_basic(iter, &v.x);
+            num = (double)v.x;
+            break;
+
+        case DBUS_TYPE_UINT64:
+            dbus_message_iter_get_basic(iter, &v.t);
+            num = (double)v.t;
+            break;
+
+        case DBUS_TYPE_DOUBLE:
+            dbus_message_iter_get_basic(iter, &v.d);
+            num = v.d;
+            break;
+
+        default:
+            /* Containers, variants and unix fds are never matched */
+            return L2DBUS_FALSE;
+    }
+
+    return ((L2DBUS_MATCH_PRED_EQUAL_NUMBER == pred->kind) ||
+            (L2DBUS_MATCH_PRED_RANGE == pred->kind)) &&
+            (num >= pred->lo) && (num <= pred->hi);
+}
+
+
+/**
+ * @brief Determines whether a message satisfies a client-side filter.
+ *
+ * The cheap header checks come first. The argument predicates are sorted by
+ * index so the message body is walked at most once.
+ *
+ * @param [in] filter   The client-side filter.
+ * @param [in] msg      The matched D-Bus message.
+ * @return L2DBUS_TRUE if the message should be delivered.
+ */
+static l2dbus_Bool
+l2dbus_matchFilterAccepts
+    (
+    const l2dbus_MatchFilter*   filter,
+    DBusMessage*                msg
+    )
+{
+    DBusMessageIter iter;
+    const char* str;
+    unsigned idx;
+    unsigned predIdx;
+    int argIdx;
+    l2dbus_Bool hasArg;
+
+    if ( NULL != filter->signature )
+    {
+        str = dbus_message_get_signature(msg);
+        if ( (NULL == str) || (0 != strcmp(str, filter->signature)) )
+        {
+            return L2DBUS_FALSE;
+        }
+    }
+
+    if ( NULL != filter->pathPrefix )
+    {
+        str = dbus_message_get_path(msg);
+        if ( (NULL == str) ||
+            (0 != strncmp(str, filter->pathPrefix, filter->pathPrefixLen)) )
+        {
+            return L2DBUS_FALSE;
+        }
+    }
+
+    if ( 0 < filter->nSenders )
+    {
+        str = dbus_message_get_sender(msg);
+        if ( NULL == str )
+        {
+            return L2DBUS_FALSE;
+        }
+        for ( idx = 0; idx < filter->nSenders; ++idx )
+        {
+            if ( 0 == strcmp(str, filter->senders[idx]) )
+            {
+                break;
+            }
+        }
+        if ( idx == filter->nSenders )
+        {
+            return L2DBUS_FALSE;
+        }
+    }
+
+    if ( 0 < filter->nArgs )
+    {
+        hasArg = dbus_message_iter_init(msg, &iter) ? L2DBUS_TRUE :
+                                                    L2DBUS_FALSE;
+        argIdx = 0;
+        for ( predIdx = 0; predIdx < filter->nArgs; ++predIdx )
+        {
+            while ( hasArg && (argIdx < filter->args[predIdx].index) )
+            {
+                hasArg = dbus_message_iter_next(&iter) ? L2DBUS_TRUE :
+                                                        L2DBUS_FALSE;
+                ++argIdx;
+            }
+
+            if ( !hasArg ||
+                !l2dbus_matchEvalPred(&filter->args[predIdx], &iter) )
+            {
+                return L2DBUS_FALSE;
+            }
+        }
+    }
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Process rule matches and dispatch to Lua handler function.
+ *
+ * This function is called whenever a match rule is matched and needs
+ * to be dispatched to a Lua handler function.
+ *
+ * @param [in] conn The CDBUS connection on which the message matched.
+ * @param [in] hnd An opaque CDBUS match handle.
+ * @param [in] msg The D-Bus message that matched.
+ * @param [in] userData User provided data that is returned in the callback.
+ */
+static void
+l2dbus_matchHandler
+    (
+    cdbus_Connection*   conn,
+    cdbus_Handle        hnd,
+    DBusMessage*        msg,
+    void*               userData
+    )
+{
+    l2dbus_Match* match = (l2dbus_Match*)userData;
+
+    /* Messages rejected by the client-side filter never reach Lua */
+    if ( (NULL != match->filter) &&
+        !l2dbus_matchFilterAccepts(match->filter, msg) )
+    {
+        match->filter->nRejected++;
+        return;
+    }
+
+    if ( match->predecode )
+    {
+        l2dbus_predecodeSubmit(match, msg);
+        return;
+    }
+
+    /* The dispatcher either delivers the message now or defers it when the
+     * connection has exhausted its dispatch budget.
+     */
+    l2dbus_dispatcherSubmitMatch(match, msg);
+}
+
+
+/* Copies a rule string to the next free byte of a copied rule */
+static char*
+l2dbus_matchCopyRuleStr
+    (
+    const char* s,
+    char**      pos
+    )
+{
+    char* copy = NULL;
+    size_t len;
+
+    if ( NULL != s )
+    {
+        len = strlen(s) + 1;
+        copy = *pos;
+        memcpy(copy, s, len);
+        *pos += len;
+    }
+
+    return copy;
+}
+
+
+/**
+ * @brief Makes a copy of a (parsed) match rule.
+ *
+ * The rule, its argN filters and strings are copied into a single
+ * allocation so the copy is released with l2dbus_free.
+ *
+ * @param [in] rule The rule to copy.
+ * @return The copy of the rule or NULL if it could not be allocated.
+ */
+static cdbus_MatchRule*
+l2dbus_matchCopyRule
+    (
+    const cdbus_MatchRule*  rule
+    )
+{
+    cdbus_MatchRule* copy;
+    size_t size = sizeof(*copy);
+    unsigned nArgs = 0;
+    unsigned idx;
+    char* pos;
+
+    if ( NULL != rule->filterArgs )
+    {
+        while ( CDBUS_FILTER_ARG_INVALID != rule->filterArgs[nArgs].argType )
+        {
+            size += strlen(rule->filterArgs[nArgs].value) + 1;
+            ++nArgs;
+        }
+        size += (nArgs + 1) * sizeof(cdbus_FilterArgItem);
+    }
+    size += (NULL == rule->member) ? 0 : strlen(rule->member) + 1;
+    size += (NULL == rule->objInterface) ? 0 : strlen(rule->objInterface) + 1;
+    size += (NULL == rule->sender) ? 0 : strlen(rule->sender) + 1;
+    size += (NULL == rule->path) ? 0 : strlen(rule->path) + 1;
+    size += (NULL == rule->arg0Namespace) ? 0 : strlen(rule->arg0Namespace) + 1;
+
+    copy = (cdbus_MatchRule*)l2dbus_malloc(size);
+    if ( NULL == copy )
+    {
+        return NULL;
+    }
+    *copy = *rule;
+    pos = (char*)(copy + 1);
+
+    if ( NULL != rule->filterArgs )
+    {
+        /* The argN filters go first so they stay aligned */
+        copy->filterArgs = (cdbus_FilterArgItem*)pos;
+        memcpy(copy->filterArgs, rule->filterArgs,
+            (nArgs + 1) * sizeof(cdbus_FilterArgItem));
+        pos += (nArgs + 1) * sizeof(cdbus_FilterArgItem);
+        for ( idx = 0; idx < nArgs; ++idx )
+        {
+            copy->filterArgs[idx].value = l2dbus_matchCopyRuleStr(
+                                    rule->filterArgs[idx].value, &pos);
+        }
+    }
+    copy->member = l2dbus_matchCopyRuleStr(rule->member, &pos);
+    copy->objInterface = l2dbus_matchCopyRuleStr(rule->objInterface, &pos);
+    copy->sender = l2dbus_matchCopyRuleStr(rule->sender, &pos);
+    copy->path = l2dbus_matchCopyRuleStr(rule->path, &pos);
+    copy->arg0Namespace = l2dbus_matchCopyRuleStr(rule->arg0Namespace, &pos);
+
+    return copy;
 }
 
 
@@ -218,7 +1091,7 @@ l2dbus_matchFreeRule
  * @param [in]      ruleIdx     The reference to the table on the Lua stack
  * containing the representation of the match rule.
  * @param [in]      funcIdx     The reference to a Lua function representing
- * the handler.
+ * the handler (or L2DBUS_CALLBACK_NOREF_NEEDED for an internal match).
  * @param [in]      userIdx     The reference to the user token data.
  * @param [in]      connIdx     The reference to the Lua connection userdata.
  * @param [in,out]  errMsg      A pointer to an optional string pointer to receive a
@@ -250,15 +1123,28 @@ l2dbus_newMatch
     l2dbus_Bool failed = FALSE;
     cdbus_FilterArgType argType;
     l2dbus_Connection* connUd;
+    l2dbus_ArenaMark arenaMark;
+    l2dbus_MatchFilter* filter = NULL;
+    l2dbus_MatchConflate* conflate = NULL;
+    l2dbus_MatchPriority priority = L2DBUS_MATCH_PRIORITY_NORMAL;
+    l2dbus_Bool predecode = L2DBUS_FALSE;
+    const char* filterReason;
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Create: match"));
     ruleIdx = lua_absindex(L, ruleIdx);
-    funcIdx = lua_absindex(L, funcIdx);
+    if ( L2DBUS_CALLBACK_NOREF_NEEDED != funcIdx )
+    {
+        funcIdx = lua_absindex(L, funcIdx);
+    }
     connIdx = lua_absindex(L, connIdx);
+    connUd = (l2dbus_Connection*)lua_touserdata(L, connIdx);
 
     /* Zero it out in preparation to filling it in */
     memset(&rule, 0, sizeof(rule));
 
+    /* The rule strings are only needed until the rule is registered */
+    l2dbus_arenaMark(&arenaMark);
+
     lua_getfield(L, ruleIdx, "msgType");
     if ( !lua_isnumber(L, -1) )
     {
@@ -295,7 +1181,7 @@ l2dbus_newMatch
     lua_getfield(L, ruleIdx, "member");
     if ( lua_isstring(L, -1) )
     {
-        rule.member = l2dbus_strDup(lua_tostring(L, -1));
+        rule.member = l2dbus_arenaStrDup(lua_tostring(L, -1));
     }
     else
     {
@@ -306,7 +1192,7 @@ l2dbus_newMatch
     lua_getfield(L, ruleIdx, "interface");
     if ( lua_isstring(L, -1) )
     {
-        rule.objInterface = l2dbus_strDup(lua_tostring(L, -1));
+        rule.objInterface = l2dbus_arenaStrDup(lua_tostring(L, -1));
     }
     else
     {
@@ -317,7 +1203,7 @@ l2dbus_newMatch
     lua_getfield(L, ruleIdx, "sender");
     if ( lua_isstring(L, -1) )
     {
-        rule.sender = l2dbus_strDup(lua_tostring(L, -1));
+        rule.sender = l2dbus_arenaStrDup(lua_tostring(L, -1));
     }
     else
     {
@@ -328,7 +1214,7 @@ l2dbus_newMatch
     lua_getfield(L, ruleIdx, "path");
     if ( lua_isstring(L, -1) )
     {
-        rule.path = l2dbus_strDup(lua_tostring(L, -1));
+        rule.path = l2dbus_arenaStrDup(lua_tostring(L, -1));
     }
     else
     {
@@ -350,7 +1236,7 @@ l2dbus_newMatch
     lua_getfield(L, ruleIdx, "arg0Namespace");
     if ( lua_isstring(L, -1) )
     {
-        rule.arg0Namespace = l2dbus_strDup(lua_tostring(L, -1));
+        rule.arg0Namespace = l2dbus_arenaStrDup(lua_tostring(L, -1));
     }
     else
     {
@@ -381,8 +1267,14 @@ l2dbus_newMatch
             {
                 nFilterArgs = DBUS_MAXIMUM_MATCH_RULE_ARG_NUMBER+1;
             }
-            rule.filterArgs = (cdbus_FilterArgItem*)l2dbus_calloc(nFilterArgs+1,
-                                sizeof(cdbus_FilterArgItem));
+            rule.filterArgs = (cdbus_FilterArgItem*)l2dbus_arenaAlloc(
+                                (nFilterArgs+1) * sizeof(cdbus_FilterArgItem));
+            if ( NULL != rule.filterArgs )
+            {
+                memset(rule.filterArgs, 0,
+                    (nFilterArgs+1) * sizeof(cdbus_FilterArgItem));
+            }
+
             if ( NULL == rule.filterArgs )
             {
                 failed = TRUE;
@@ -468,7 +1360,7 @@ l2dbus_newMatch
                         break;
                     }
 
-                    rule.filterArgs[idx].value = l2dbus_strDup(lua_tostring(L, -1));
+                    rule.filterArgs[idx].value = l2dbus_arenaStrDup(lua_tostring(L, -1));
 
                     /* Pop the value and the item table */
                     lua_pop(L, 2);
@@ -486,6 +1378,88 @@ l2dbus_newMatch
     /* Pop what should be the filterArgs table */
     lua_pop(L, 1);
 
+    if ( !failed )
+    {
+        filterReason = l2dbus_matchParseFilter(L, ruleIdx, &filter);
+        if ( NULL != filterReason )
+        {
+            failed = L2DBUS_TRUE;
+            reason = filterReason;
+        }
+    }
+
+    if ( !failed )
+    {
+        filterReason = l2dbus_matchParseConflate(L, ruleIdx, &conflate);
+        if ( NULL != filterReason )
+        {
+            failed = L2DBUS_TRUE;
+            reason = filterReason;
+        }
+    }
+
+    if ( !failed )
+    {
+        lua_getfield(L, ruleIdx, "priority");
+        if ( lua_isnil(L, -1) )
+        {
+            priority = L2DBUS_MATCH_PRIORITY_NORMAL;
+        }
+        else if ( LUA_TSTRING != lua_type(L, -1) )
+        {
+            failed = L2DBUS_TRUE;
+            reason = "match priority must be a string";
+        }
+        else if ( 0 == strcmp(lua_tostring(L, -1), "high") )
+        {
+            priority = L2DBUS_MATCH_PRIORITY_HIGH;
+        }
+        else if ( 0 == strcmp(lua_tostring(L, -1), "normal") )
+        {
+            priority = L2DBUS_MATCH_PRIORITY_NORMAL;
+        }
+        else if ( 0 == strcmp(lua_tostring(L, -1), "bulk") )
+        {
+            priority = L2DBUS_MATCH_PRIORITY_BULK;
+        }
+        else
+        {
+            failed = L2DBUS_TRUE;
+            reason = "unknown match priority (!= 'high', 'normal' or 'bulk')";
+        }
+        lua_pop(L, 1);
+    }
+
+    if ( !failed )
+    {
+        lua_getfield(L, ruleIdx, "predecode");
+        predecode = lua_toboolean(L, -1) ? L2DBUS_TRUE : L2DBUS_FALSE;
+        lua_pop(L, 1);
+        if ( predecode && ((NULL != conflate) ||
+            (L2DBUS_MATCH_PRIORITY_BULK == priority)) )
+        {
+            failed = L2DBUS_TRUE;
+            reason = "predecode cannot be combined with conflate or bulk priority";
+        }
+        else if ( predecode && !l2dbus_predecodeEnable(connUd->dispUd) )
+        {
+            failed = L2DBUS_TRUE;
+            reason = "failed to start the decoder thread";
+        }
+    }
+
+    if ( !failed )
+    {
+        /* Conflation and bulk deliveries work on the deferred queue */
+        if ( ((NULL != conflate) ||
+            (L2DBUS_MATCH_PRIORITY_BULK == priority)) &&
+            !l2dbus_dispatcherEnableDeferral(connUd->dispUd) )
+        {
+            failed = L2DBUS_TRUE;
+            reason = "failed to enable deferred delivery";
+        }
+    }
+
     /* If the rule has been parsed successfully then ... */
     if ( !failed )
     {
@@ -497,7 +1471,13 @@ l2dbus_newMatch
         }
         else
         {
-            connUd = (l2dbus_Connection*)lua_touserdata(L, connIdx);
+            /* The filter must be in place before the first message */
+            match->filter = filter;
+            filter = NULL;
+            match->conflate = conflate;
+            conflate = NULL;
+            match->priority = priority;
+            match->predecode = predecode;
             match->matchHnd = cdbus_connectionRegMatchHandler(
                                                     connUd->conn,
                                                     l2dbus_matchHandler,
@@ -514,8 +1494,25 @@ l2dbus_newMatch
             {
                 lua_pushvalue(L, connIdx);
                 match->connRef = luaL_ref(L, LUA_REGISTRYINDEX);
+                match->connUd = connUd;
                 l2dbus_callbackInit(&match->cbCtx);
                 l2dbus_callbackRef(L, funcIdx, userIdx, &match->cbCtx);
+
+                /* The arena copy of the rule is released below */
+                if ( connUd->reconnect.enabled )
+                {
+                    match->rule = l2dbus_matchCopyRule(&rule);
+                    if ( NULL == match->rule )
+                    {
+                        L2DBUS_TRACE((L2DBUS_TRC_WARN,
+                            "Failed to record match rule (not restored on reconnect)"));
+                    }
+                }
+
+                lua_getfield(L, ruleIdx, "borrowMessage");
+                match->borrowMsg = lua_toboolean(L, -1) ? L2DBUS_TRUE :
+                                                        L2DBUS_FALSE;
+                lua_pop(L, 1);
             }
         }
     }
@@ -527,12 +1524,19 @@ l2dbus_newMatch
 
     if ( failed )
     {
+        if ( NULL != match )
+        {
+            l2dbus_matchFreeFilter(match->filter);
+            l2dbus_free(match->conflate);
+        }
         free(match);
         match = NULL;
     }
+    l2dbus_matchFreeFilter(filter);
+    l2dbus_free(conflate);
 
-    /* Always free the rule since we no longer need it */
-    l2dbus_matchFreeRule(&rule);
+    /* Always release the rule since we no longer need it */
+    l2dbus_arenaRelease(&arenaMark);
 
     return match;
 }
@@ -565,6 +1569,25 @@ l2dbus_disposeMatch
         {
             L2DBUS_TRACE((L2DBUS_TRC_WARN, "Failed to unregister match (0x%x)", rc));
         }
+        /* Drop any deliveries still waiting on the dispatch budget */
+        l2dbus_dispatcherPurgeMatch(match);
+        if ( match->predecode )
+        {
+            l2dbus_predecodePurgeMatch(match);
+        }
+        if ( NULL != match->filter )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Match filter rejected %lu messages",
+                        match->filter->nRejected));
+            l2dbus_matchFreeFilter(match->filter);
+        }
+        if ( NULL != match->conflate )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Match conflated %lu messages",
+                        match->conflate->nConflated));
+            l2dbus_free(match->conflate);
+        }
+        l2dbus_free(match->rule);
         l2dbus_callbackUnref(L, &match->cbCtx);
         /* Pop of the connection userdata */
         lua_pop(L, 1);
@@ -574,3 +1597,43 @@ l2dbus_disposeMatch
 }
 
 
+/**
+ * @brief Moves a match to the (re-opened) connection of its connection userdata.
+ *
+ * The handler is unregistered from the old CDBUS connection and registered
+ * again with the recorded rule on the new one. A match whose rule was not
+ * recorded is left without a handler.
+ *
+ * @param [in] match    The match to restore.
+ * @param [in] oldConn  The CDBUS connection the match was registered with.
+ * @return L2DBUS_TRUE if the match is registered with the new connection.
+ */
+l2dbus_Bool
+l2dbus_matchRestore
+    (
+    l2dbus_Match*       match,
+    cdbus_Connection*   oldConn
+    )
+{
+    if ( CDBUS_INVALID_HANDLE != match->matchHnd )
+    {
+        cdbus_connectionUnregMatchHandler(oldConn, match->matchHnd);
+        match->matchHnd = CDBUS_INVALID_HANDLE;
+    }
+
+    if ( NULL == match->rule )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN,
+                    "Match registered before recording cannot be restored"));
+        return L2DBUS_FALSE;
+    }
+
+    match->matchHnd = cdbus_connectionRegMatchHandler(match->connUd->conn,
+                                                    l2dbus_matchHandler,
+                                                    match,
+                                                    match->rule,
+                                                    NULL);
+
+    return (CDBUS_INVALID_HANDLE != match->matchHnd) ? L2DBUS_TRUE :
+                                                    L2DBUS_FALSE;
+}
@@ -37,21 +37,129 @@
 #include "lua.h"
 #include "queue.h"
 #include "cdbus/cdbus.h"
+#include "l2dbus_types.h"
 #include "l2dbus_callback.h"
 
+/* Maximum number of argument predicates of a client-side filter */
+#define L2DBUS_MATCH_MAX_ARG_PREDICATES (16)
+
 /* Forward declarations */
 struct cdbus_MatchRule;
+struct l2dbus_Connection;
+struct l2dbus_SigRoute;
+
+/*
+ * The priority lanes of deferred match deliveries. Lanes with a lower value
+ * are drained first.
+ */
+typedef enum
+{
+    L2DBUS_MATCH_PRIORITY_HIGH,
+    L2DBUS_MATCH_PRIORITY_NORMAL,
+    L2DBUS_MATCH_PRIORITY_BULK,
+    L2DBUS_MATCH_PRIORITY_COUNT
+} l2dbus_MatchPriority;
+
+typedef enum
+{
+    L2DBUS_MATCH_PRED_EQUAL_NUMBER,
+    L2DBUS_MATCH_PRED_RANGE,
+    L2DBUS_MATCH_PRED_EQUAL_STRING,
+    L2DBUS_MATCH_PRED_EQUAL_BOOLEAN
+} l2dbus_MatchPredKind;
+
+/* A predicate on the value of a single (basic typed) message argument */
+typedef struct l2dbus_MatchArgPred
+{
+    int                         index;
+    l2dbus_MatchPredKind        kind;
+    double                      lo;
+    double                      hi;
+    char*                       str;
+    l2dbus_Bool                 boolVal;
+} l2dbus_MatchArgPred;
+
+/*
+ * Client-side filter evaluated in C before a matched message is handed to
+ * Lua. All of the specified conditions must hold for the message to be
+ * delivered.
+ */
+typedef struct l2dbus_MatchFilter
+{
+    char*                       signature;
+    char*                       pathPrefix;
+    size_t                      pathPrefixLen;
+    char**                      senders;
+    unsigned                    nSenders;
+    l2dbus_MatchArgPred         args[L2DBUS_MATCH_MAX_ARG_PREDICATES];
+    unsigned                    nArgs;
+    unsigned long               nRejected;
+} l2dbus_MatchFilter;
+
+/*
+ * Conflation policy of a match. Deferred deliveries of the match whose
+ * keys are equal are superseded by the newest one.
+ */
+typedef struct l2dbus_MatchConflate
+{
+    l2dbus_Bool                 byPath;
+    l2dbus_Bool                 byMember;
+    /* The index of the argument that's part of the key (-1 if none) */
+    int                         argIndex;
+    /* The number of deliveries of the match waiting in the deferred queue */
+    unsigned                    nQueued;
+    unsigned long               nConflated;
+} l2dbus_MatchConflate;
+
+/*
+ * The conflation key of a message. The strings point into the message so
+ * the key is only valid while the message is referenced.
+ */
+typedef struct l2dbus_MatchConflateKey
+{
+    const char*                 path;
+    const char*                 member;
+    int                         argType;
+    union
+    {
+        dbus_uint64_t           bits;
+        const char*             str;
+    } arg;
+} l2dbus_MatchConflateKey;
 
 typedef struct l2dbus_Match
 {
     int                         connRef;
+    struct l2dbus_Connection*   connUd;
     l2dbus_CallbackCtx          cbCtx;
     cdbus_Handle                matchHnd;
+    l2dbus_Bool                 borrowMsg;
+    /* Set if the arguments are decoded by the dispatcher's decoder thread */
+    l2dbus_Bool                 predecode;
+    /* The lane its deliveries are deferred in */
+    l2dbus_MatchPriority        priority;
+    /* Optional client-side filter (NULL if none) */
+    l2dbus_MatchFilter*         filter;
+    /* Optional conflation policy (NULL if none) */
+    l2dbus_MatchConflate*       conflate;
+    /* Set if the match is shared by the subscribers of a signal route */
+    struct l2dbus_SigRoute*     route;
+    /* A copy of the rule kept to restore the match after a reconnect
+     * (NULL unless the connection records its registrations)
+     */
+    cdbus_MatchRule*            rule;
     LIST_ENTRY(l2dbus_Match)    link;
 } l2dbus_Match;
 
 l2dbus_Match* l2dbus_newMatch(lua_State* L, int ruleIdx, int funcIdx, int userIdx,
                                 int connIdx, const char** errMsg);
 void l2dbus_disposeMatch(lua_State* L, l2dbus_Match* match);
+l2dbus_Bool l2dbus_matchRestore(l2dbus_Match* match,
+                            struct cdbus_Connection* oldConn);
+void l2dbus_matchDeliver(l2dbus_Match* match, DBusMessage* msg);
+void l2dbus_matchConflateKey(const l2dbus_Match* match, DBusMessage* msg,
+                            l2dbus_MatchConflateKey* key);
+l2dbus_Bool l2dbus_matchConflateEqual(const l2dbus_MatchConflateKey* a,
+                            const l2dbus_MatchConflateKey* b);
 
 #endif /* Guard for L2DBUS_MATCH_H_ */
@@ -35,6 +35,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <string.h>
+#include <unistd.h>
 #include "dbus/dbus.h"
 #include "l2dbus_compat.h"
 #include "l2dbus_core.h"
@@ -45,13 +46,231 @@
 #include "l2dbus_types.h"
 #include "l2dbus_message.h"
 #include "l2dbus_transcode.h"
+#include "l2dbus_sigplan.h"
+#include "l2dbus_calltemplate.h"
+#include "l2dbus_shape.h"
+#include "l2dbus_argcursor.h"
 #include "l2dbus_alloc.h"
 #include "l2dbus_dbuscompat.h"
+#include "l2dbus_context.h"
+#include "l2dbus_ffi.h"
 #include "lauxlib.h"
 
 static const char DBUS_MSG_NO_REF_ERROR[] =
         "reference to D-Bus message no longer exists";
 
+/*
+ * The pool of Message wrappers lent to callbacks that use borrowed message
+ * delivery is kept in the module context. The wrapper userdata are anchored
+ * in a Lua table (referenced from the registry) so that they are not
+ * reclaimed while in the pool.
+ */
+
+
+/*
+ * Counts a D-Bus message now owned by a wrapper. Once over the limit every
+ * new message also takes an incremental GC step (rather than forcing a full
+ * collection) and a warning is traced the first time the limit is crossed.
+ */
+static void
+l2dbus_messageLiveAdd
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+    l2dbus_MessageLive* live;
+
+    if ( NULL == ctx )
+    {
+        return;
+    }
+
+    live = &ctx->msgLive;
+    live->count++;
+    if ( live->count > live->peak )
+    {
+        live->peak = live->count;
+    }
+
+    if ( (0 != live->limit) && (live->count > live->limit) )
+    {
+        lua_gc(L, LUA_GCSTEP, live->gcStepKb);
+        live->gcSteps++;
+        if ( !live->overLimit && (live->count > live->limit) )
+        {
+            live->overLimit = L2DBUS_TRUE;
+            live->warnings++;
+            L2DBUS_TRACE((L2DBUS_TRC_WARN,
+                        "%u live D-Bus messages exceed the limit of %u",
+                        live->count, live->limit));
+        }
+    }
+}
+
+
+/* Counts a D-Bus message no longer owned by a wrapper */
+static void
+l2dbus_messageLiveRemove(void)
+{
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+    l2dbus_MessageLive* live;
+
+    if ( NULL == ctx )
+    {
+        return;
+    }
+
+    live = &ctx->msgLive;
+    if ( 0 != live->count )
+    {
+        live->count--;
+    }
+    if ( live->overLimit && (live->count <= live->limit) )
+    {
+        live->overLimit = L2DBUS_FALSE;
+    }
+}
+
+
+/* Releases the D-Bus message (if any) referenced by the wrapper */
+static void
+l2dbus_messageRelease
+    (
+    l2dbus_Message* ud
+    )
+{
+    /* A borrowed message is not owned by the wrapper */
+    if ( ud->isBorrowed )
+    {
+        ud->msg = NULL;
+        ud->isBorrowed = L2DBUS_FALSE;
+    }
+    else if ( ud->msg != NULL )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_TRACE,
+                "Unref D-Bus msg (%p) type: %s serial #: %d",
+                ud->msg,
+                dbus_message_type_to_string(dbus_message_get_type(ud->msg)),
+                dbus_message_get_serial(ud->msg)));
+        dbus_message_unref(ud->msg);
+        ud->msg = NULL;
+        l2dbus_messageLiveRemove();
+    }
+}
+
+
+/* Makes the wrapper the owner of (a reference to) the D-Bus message */
+static void
+l2dbus_messageAdopt
+    (
+    lua_State*          L,
+    l2dbus_Message*     msgUd,
+    struct DBusMessage* msg
+    )
+{
+    msgUd->msg = msg;
+    if ( NULL != msg )
+    {
+        l2dbus_messageLiveAdd(L);
+    }
+}
+
+/* The D-Bus data slot holding the Unix fds received with a message */
+static dbus_int32_t gUnixFdSlot = -1;
+
+/* The Unix fds unmarshalled from a D-Bus message */
+typedef struct l2dbus_MessageFds
+{
+    unsigned    count;
+    unsigned    capacity;
+    int*        fds;
+} l2dbus_MessageFds;
+
+
+/* Called by D-Bus to close the fds once the message is finalized */
+static void
+l2dbus_messageFreeFds
+    (
+    void*   data
+    )
+{
+    l2dbus_MessageFds* held = (l2dbus_MessageFds*)data;
+    unsigned idx;
+
+    for ( idx = 0; idx < held->count; ++idx )
+    {
+        close(held->fds[idx]);
+    }
+    l2dbus_free(held->fds);
+    l2dbus_free(held);
+}
+
+
+/**
+ * @brief Makes a D-Bus message the owner of a Unix fd unmarshalled from it.
+ *
+ * D-Bus returns a new (duplicated) descriptor every time a Unix fd is
+ * unmarshalled. The descriptor is closed when the D-Bus message is
+ * finalized unless it's claimed with Message:takeUnixFd. If the fd cannot
+ * be recorded it remains the responsibility of the caller.
+ *
+ * @param [in] msg  The message the fd was unmarshalled from.
+ * @param [in] fd   The unmarshalled descriptor.
+ */
+void
+l2dbus_messageHoldUnixFd
+    (
+    struct DBusMessage* msg,
+    int                 fd
+    )
+{
+    l2dbus_MessageFds* held = NULL;
+    int* fds;
+
+    /* The slot is allocated once and kept for the life of the process */
+    if ( (NULL != msg) && (fd >= 0) && ((gUnixFdSlot >= 0) ||
+        dbus_message_allocate_data_slot(&gUnixFdSlot)) )
+    {
+        held = (l2dbus_MessageFds*)dbus_message_get_data(msg, gUnixFdSlot);
+        if ( NULL == held )
+        {
+            held = (l2dbus_MessageFds*)l2dbus_calloc(1, sizeof(*held));
+            if ( (NULL != held) && !dbus_message_set_data(msg, gUnixFdSlot,
+                                            held, l2dbus_messageFreeFds) )
+            {
+                l2dbus_free(held);
+                held = NULL;
+            }
+        }
+    }
+
+    if ( (NULL != held) && (held->count == held->capacity) )
+    {
+        fds = (int*)l2dbus_realloc(held->fds, (held->capacity + 4U) *
+                                    sizeof(*fds));
+        if ( NULL == fds )
+        {
+            held = NULL;
+        }
+        else
+        {
+            held->fds = fds;
+            held->capacity += 4U;
+        }
+    }
+
+    if ( NULL != held )
+    {
+        held->fds[held->count++] = fd;
+    }
+    else if ( fd >= 0 )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN, "Cannot hold Unix fd %d", fd));
+    }
+}
+
+
 /**
  L2DBUS Message
 
@@ -131,7 +350,7 @@ l2dbus_newMessage
     }
     else
     {
-        msgUd->msg = dbusMsg;
+        l2dbus_messageAdopt(L, msgUd, dbusMsg);
     }
 
     return 1;
@@ -286,7 +505,7 @@ l2dbus_newMessageMethodCall
     }
     else
     {
-        msgUd->msg = dbusMsg;
+        l2dbus_messageAdopt(L, msgUd, dbusMsg);
     }
 
     return 1;
@@ -317,7 +536,7 @@ l2dbus_newMessageMethodReturn
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, -1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, -1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
     luaL_argcheck(L, DBUS_MESSAGE_TYPE_METHOD_CALL == dbus_message_get_type(msgUd->msg), 1,
                  "must be a D-Bus method call message");
@@ -339,7 +558,7 @@ l2dbus_newMessageMethodReturn
     }
     else
     {
-        replyUd->msg = replyMsg;
+        l2dbus_messageAdopt(L, replyUd, replyMsg);
     }
 
     return 1;
@@ -450,7 +669,7 @@ l2dbus_newMessageSignal
     }
     else
     {
-        msgUd->msg = dbusMsg;
+        l2dbus_messageAdopt(L, msgUd, dbusMsg);
     }
 
     return 1;
@@ -486,7 +705,7 @@ l2dbus_newMessageError
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    replyMsgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    replyMsgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, replyMsgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
     luaL_argcheck(L, DBUS_MESSAGE_TYPE_METHOD_CALL == dbus_message_get_type(replyMsgUd->msg), 1,
                  "must be a D-Bus method call message");
@@ -511,7 +730,7 @@ l2dbus_newMessageError
     }
     else
     {
-        errMsgUd->msg = errDbusMsg;
+        l2dbus_messageAdopt(L, errMsgUd, errDbusMsg);
     }
 
     return 1;
@@ -544,7 +763,7 @@ l2dbus_newMessageCopy
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     msgCopy = dbus_message_copy(msgUd->msg);
@@ -564,7 +783,7 @@ l2dbus_newMessageCopy
     }
     else
     {
-        copyUd->msg = msgCopy;
+        l2dbus_messageAdopt(L, copyUd, msgCopy);
     }
 
     return 1;
@@ -599,7 +818,7 @@ l2dbus_messageGetType
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     lua_pushinteger(L, dbus_message_get_type(msgUd->msg));
@@ -639,7 +858,7 @@ l2dbus_messageSetNoReply
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     luaL_argcheck(L, lua_isboolean(L, 2), 2, "boolean value expected");
@@ -673,7 +892,7 @@ l2dbus_messageGetNoReply
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     lua_pushboolean(L, dbus_message_get_no_reply(msgUd->msg));
@@ -708,7 +927,7 @@ l2dbus_messageSetAutoStart
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     luaL_argcheck(L, lua_isboolean(L, 2), 2, "boolean value expected");
@@ -742,7 +961,7 @@ l2dbus_messageGetAutoStart
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     lua_pushboolean(L, dbus_message_get_auto_start(msgUd->msg));
@@ -776,7 +995,7 @@ l2dbus_messageSetPath
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     msgType = dbus_message_get_type(msgUd->msg);
@@ -831,7 +1050,7 @@ l2dbus_messageGetPath
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     msgType = dbus_message_get_type(msgUd->msg);
@@ -877,7 +1096,7 @@ l2dbus_messageHasPath
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     msgType = dbus_message_get_type(msgUd->msg);
@@ -921,7 +1140,7 @@ l2dbus_messageDecomposedPath
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     msgType = dbus_message_get_type(msgUd->msg);
@@ -978,7 +1197,7 @@ l2dbus_messageSetInterface
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     msgType = dbus_message_get_type(msgUd->msg);
@@ -1031,7 +1250,7 @@ l2dbus_messageGetInterface
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     msgType = dbus_message_get_type(msgUd->msg);
@@ -1076,7 +1295,7 @@ l2dbus_messageHasInterface
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     msgType = dbus_message_get_type(msgUd->msg);
@@ -1118,7 +1337,7 @@ l2dbus_messageSetMember
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     msgType = dbus_message_get_type(msgUd->msg);
@@ -1171,7 +1390,7 @@ l2dbus_messageGetMember
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     msgType = dbus_message_get_type(msgUd->msg);
@@ -1216,7 +1435,7 @@ l2dbus_messageHasMember
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     msgType = dbus_message_get_type(msgUd->msg);
@@ -1255,7 +1474,7 @@ l2dbus_messageSetErrorName
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     msgType = dbus_message_get_type(msgUd->msg);
@@ -1306,7 +1525,7 @@ l2dbus_messageGetErrorName
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     msgType = dbus_message_get_type(msgUd->msg);
@@ -1352,7 +1571,7 @@ l2dbus_messageSetDestination
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     /* Can be either a string or nil */
@@ -1397,7 +1616,7 @@ l2dbus_messageGetDestination
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     destination = dbus_message_get_destination(msgUd->msg);
@@ -1440,7 +1659,7 @@ l2dbus_messageHasDestination
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     destination = luaL_checkstring(L, 2);
@@ -1477,7 +1696,7 @@ l2dbus_messageSetSender
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     /* Can be either a string or nil */
@@ -1522,7 +1741,7 @@ l2dbus_messageGetSender
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     sender = dbus_message_get_sender(msgUd->msg);
@@ -1569,7 +1788,7 @@ l2dbus_messageHasSender
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     sender = luaL_checkstring(L, 2);
@@ -1605,7 +1824,7 @@ l2dbus_messageGetSignature
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     signature = dbus_message_get_signature(msgUd->msg);
@@ -1644,7 +1863,7 @@ l2dbus_messageHasSignature
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     signature = luaL_checkstring(L, 2);
@@ -1675,7 +1894,7 @@ l2dbus_messageContainsUnixFds
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     lua_pushboolean(L, dbus_message_contains_unix_fds(msgUd->msg));
@@ -1684,6 +1903,66 @@ l2dbus_messageContainsUnixFds
 }
 
 
+/**
+ @function takeUnixFd
+ @within l2dbus.Message
+
+ Claims a Unix file descriptor (fd) unmarshalled from the message.
+
+ Unix fds appended to a message are duplicated by D-Bus so the caller
+ remains the owner of (and must close) the descriptors it appends. The
+ reverse holds for received messages: every time a Unix fd (*h*) is
+ unmarshalled a new descriptor is created that belongs to the message. It
+ remains open while the message is alive and is closed once the message is
+ released. To keep the descriptor beyond the life of the message it must
+ be claimed with this method and then closed by the caller.
+
+ @tparam userdata msg The D-Bus message the fd was unmarshalled from.
+ @tparam number fd The Unix fd returned by unmarshalling the message.
+ @treturn bool Returns **true** if the fd now belongs to the caller or
+ **false** if it's not held by the message.
+ */
+static int
+l2dbus_messageTakeUnixFd
+    (
+    lua_State* L
+    )
+{
+    l2dbus_Message* msgUd;
+    l2dbus_MessageFds* held = NULL;
+    int fd;
+    unsigned idx;
+    l2dbus_Bool taken = L2DBUS_FALSE;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+    fd = (int)luaL_checkinteger(L, 2);
+
+    if ( gUnixFdSlot >= 0 )
+    {
+        held = (l2dbus_MessageFds*)dbus_message_get_data(msgUd->msg,
+                                                        gUnixFdSlot);
+    }
+
+    for ( idx = 0; (NULL != held) && (idx < held->count); ++idx )
+    {
+        if ( held->fds[idx] == fd )
+        {
+            held->fds[idx] = held->fds[--held->count];
+            taken = L2DBUS_TRUE;
+            break;
+        }
+    }
+
+    lua_pushboolean(L, taken);
+
+    return 1;
+}
+
+
 /**
  @function setSerial
  @within l2dbus.Message
@@ -1713,7 +1992,7 @@ l2dbus_messageSetSerial
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     serial = luaL_checkinteger(L, 2);
@@ -1747,7 +2026,7 @@ l2dbus_messageGetSerial
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
 
     lua_pushinteger(L, dbus_message_get_serial(msgUd->msg));
@@ -1756,153 +2035,563 @@ l2dbus_messageGetSerial
 }
 
 
-/**
- @function msgTypeToString
+/* The fields of the table filled by getHeader (in key table order) */
+static const char* gHeaderKeys[] =
+{
+    "type",
+    "serial",
+    "replySerial",
+    "noReply",
+    "path",
+    "interface",
+    "member",
+    "errorName",
+    "signature",
+    "sender",
+    "destination"
+};
 
- Converts the D-Bus message type into a machine-readable string.
+#define L2DBUS_HEADER_KEY_COUNT \
+    ((int)(sizeof(gHeaderKeys) / sizeof(gHeaderKeys[0])))
 
- <ul>
- <li>@{l2dbus.Dbus.MESSAGE_TYPE_METHOD_CALL|MESSAGE_TYPE_METHOD_CALL} -> "method_call"</li>
- <li>@{l2dbus.Dbus.MESSAGE_TYPE_METHOD_RETURN|MESSAGE_TYPE_METHOD_RETURN} -> "method_return"</li>
- <li>@{l2dbus.Dbus.MESSAGE_TYPE_SIGNAL|MESSAGE_TYPE_SIGNAL} -> "signal"</li>
- <li>@{l2dbus.Dbus.MESSAGE_TYPE_ERROR|MESSAGE_TYPE_ERROR} -> "error"</li>
- <li>@{l2dbus.Dbus.MESSAGE_TYPE_INVALID|MESSAGE_TYPE_INVALID} -> "invalid"</li>
- </ul>
 
- @tparam number msgType The D-Bus message type.
- @treturn string The machine-readable message type string.
+/**
+ * @brief Pushes a header string using the cache of interned strings.
+ *
+ * The cache is direct mapped. A string that misses replaces the previous
+ * occupant of its slot so the strings seen most frequently stay interned.
+ *
+ * @param [in] L   The Lua state.
+ * @param [in] ctx The module context.
+ * @param [in] str The header string (or NULL to push nil).
  */
-static int
-l2dbus_messageTypeToString
+static void
+l2dbus_messagePushInterned
     (
-    lua_State* L
+    lua_State*      L,
+    l2dbus_Context* ctx,
+    const char*     str
     )
 {
-    const char* str = NULL;
+    l2dbus_MessageIntern* slot;
+    unsigned hash = 2166136261U;
+    const char* c;
 
-    /* Make sure the module is initialized */
-    l2dbus_checkModuleInitialized(L);
+    if ( NULL == str )
+    {
+        lua_pushnil(L);
+        return;
+    }
 
-    str = dbus_message_type_to_string(luaL_checkinteger(L, 1));
-    lua_pushstring(L, str);
+    for ( c = str; '\0' != *c; ++c )
+    {
+        hash = (hash ^ (unsigned char)*c) * 16777619U;
+    }
 
-    return 1;
+    slot = &ctx->msgIntern[hash % L2DBUS_MESSAGE_INTERN_SLOTS];
+    if ( (NULL != slot->str) && (slot->hash == hash) &&
+        (0 == strcmp(slot->str, str)) )
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, slot->ref);
+        return;
+    }
+
+    lua_pushlstring(L, str, c - str);
+    if ( NULL != slot->str )
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, slot->ref);
+        l2dbus_free(slot->str);
+    }
+    slot->str = l2dbus_strDup(str);
+    if ( NULL != slot->str )
+    {
+        slot->hash = hash;
+        lua_pushvalue(L, -1);
+        slot->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
 }
 
 
 /**
- @function addArgs
- @within l2dbus.Message
-
- Append Lua arguments to a D-Bus message.
-
- The Lua arguments are converted to their equivalent D-Bus types
- before encoding them into the message using a set of heuristics.
- A Lua error is generated if any errors are detected during the
- encoding process.
-
- @tparam userdata msg   D-Bus message to append arguments to.
- @tparam args ... Lua arguments to append to the message.
+ * @brief Releases the interned header strings of a module context.
+ *
+ * Only called when the Lua state is closed so the registry references
+ * are not released.
+ *
+ * @param [in] ctx The module context.
  */
-static int
-l2dbus_messageAddArgs
+void
+l2dbus_messageInternFree
     (
-    lua_State*  L
+    l2dbus_Context* ctx
     )
 {
-    l2dbus_Message* msgUd;
-    int nArgs = lua_gettop(L) - 1;
-
-    /* Make sure the module is initialized */
-    l2dbus_checkModuleInitialized(L);
+    unsigned idx;
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
-    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
-
-    if ( nArgs > 0 )
+    for ( idx = 0; idx < L2DBUS_MESSAGE_INTERN_SLOTS; ++idx )
     {
-        l2dbus_transcodeLuaArgsToDbus(L, msgUd->msg, 2, nArgs);
+        l2dbus_free(ctx->msgIntern[idx].str);
+        ctx->msgIntern[idx].str = NULL;
     }
-
-    return 0;
 }
 
 
 /**
- @function addArgsBySignature
+ @function getHeader
  @within l2dbus.Message
 
- Append Lua arguments to a D-Bus message using signature.
+ Returns all the header fields of the message in a single call.
 
- The Lua arguments are converted to their equivalent D-Bus types
- using the provide D-Bus signature. The signature is used as guide
- so that the conversions are explicit. If an error is encountered
- in the conversion process a Lua error is thrown. The provided
- signature **must** be a valid message signature.
+ The fields are stored in *tbl* (which is re-used) or a new table with the
+ keys *type*, *serial*, *replySerial*, *noReply*, *path*, *interface*,
+ *member*, *errorName*, *signature*, *sender* and *destination*. Fields
+ that are not set in the message are **nil**. The path, interface, member
+ and signature strings are interned by the module so frequently seen values
+ are handed out without being created (and hashed) again. Handlers routing
+ requests can fetch everything they need with this one call instead of
+ calling each getter.
 
- @tparam userdata msg   D-Bus message to append arguments to.
- @tparam string signature The valid D-Bus signature for the arguments.
- @tparam args ... Lua arguments to append to the message.
+ @tparam userdata msg The D-Bus message.
+ @tparam ?table tbl An optional table to fill (e.g. re-used by a handler).
+ @treturn table The table holding the header fields.
  */
 static int
-l2dbus_messageAddArgsBySignature
+l2dbus_messageGetHeader
     (
-    lua_State*  L
+    lua_State* L
     )
 {
     l2dbus_Message* msgUd;
-    int nArgs = lua_gettop(L) - 2;
-    const char* signature;
+    l2dbus_Context* ctx;
+    DBusMessage* msg;
+    dbus_uint32_t replySerial;
+    int idx;
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+    msg = msgUd->msg;
+    ctx = l2dbus_contextGet(L);
 
-    signature = luaL_checkstring(L, 2);
+    if ( lua_istable(L, 2) )
+    {
+        lua_settop(L, 2);
+    }
+    else
+    {
+        lua_settop(L, 1);
+        lua_createtable(L, 0, L2DBUS_HEADER_KEY_COUNT);
+    }
 
-    if ( nArgs > 0 )
+    /* The field names are pushed from an array rather than hashed again */
+    if ( LUA_NOREF == ctx->msgHeaderKeysRef )
     {
-        l2dbus_transcodeLuaArgsToDbusBySignature(L, msgUd->msg, 3,
-                                                    nArgs, signature);
+        lua_createtable(L, L2DBUS_HEADER_KEY_COUNT, 0);
+        for ( idx = 0; idx < L2DBUS_HEADER_KEY_COUNT; ++idx )
+        {
+            lua_pushstring(L, gHeaderKeys[idx]);
+            lua_rawseti(L, -2, idx + 1);
+        }
+        ctx->msgHeaderKeysRef = luaL_ref(L, LUA_REGISTRYINDEX);
     }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ctx->msgHeaderKeysRef);
 
-    return 0;
+    for ( idx = 0; idx < L2DBUS_HEADER_KEY_COUNT; ++idx )
+    {
+        lua_rawgeti(L, 3 /* Keys */, idx + 1);
+        switch ( idx )
+        {
+            case 0:
+                lua_pushinteger(L, dbus_message_get_type(msg));
+                break;
+
+            case 1:
+                lua_pushnumber(L, dbus_message_get_serial(msg));
+                break;
+
+            case 2:
+                replySerial = dbus_message_get_reply_serial(msg);
+                if ( 0 == replySerial )
+                {
+                    lua_pushnil(L);
+                }
+                else
+                {
+                    lua_pushnumber(L, replySerial);
+                }
+                break;
+
+            case 3:
+                lua_pushboolean(L, dbus_message_get_no_reply(msg));
+                break;
+
+            case 4:
+                l2dbus_messagePushInterned(L, ctx, dbus_message_get_path(msg));
+                break;
+
+            case 5:
+                l2dbus_messagePushInterned(L, ctx,
+                                        dbus_message_get_interface(msg));
+                break;
+
+            case 6:
+                l2dbus_messagePushInterned(L, ctx,
+                                        dbus_message_get_member(msg));
+                break;
+
+            case 7:
+                l2dbus_messagePushInterned(L, ctx,
+                                        dbus_message_get_error_name(msg));
+                break;
+
+            case 8:
+                l2dbus_messagePushInterned(L, ctx,
+                                        dbus_message_get_signature(msg));
+                break;
+
+            case 9:
+                lua_pushstring(L, dbus_message_get_sender(msg));
+                break;
+
+            default:
+                lua_pushstring(L, dbus_message_get_destination(msg));
+                break;
+        }
+        lua_rawset(L, 2);
+    }
+
+    lua_settop(L, 2);
+
+    return 1;
 }
 
 
 /**
- @function getArgs
+ @function clone
  @within l2dbus.Message
 
- Retrieve the arguments from the D-Bus message.
+ Creates a copy of the message.
 
- This method unmarshalls the arguments from the D-Bus message
- converting them to equivalent Lua types. The arguments are passed
- back as multiple return values. If there is an error then a Lua
- error is thrown.
+ The copy has no serial number and is not locked so arguments can be
+ appended to it. If *withoutBody* is **true** only the header (the type,
+ path, interface, member, error name, destination, sender, reply serial
+ and flags) is copied and the copy starts with no arguments. This is
+ cheaper than building the same header again from strings when many
+ messages differ only in their arguments. See also @{newTemplate}.
 
- @tparam userdata msg   D-Bus message to extract arguments.
- @treturn ... Lua arguments passed out as multiple return values.
+ @tparam userdata msg The D-Bus message to clone.
+ @tparam ?bool withoutBody If **true** the arguments of the message are not
+ copied. Defaults to **false**.
+ @treturn userdata The cloned Message userdata object.
  */
 static int
-l2dbus_messageGetArgs
+l2dbus_messageClone
     (
     lua_State*  L
     )
 {
     l2dbus_Message* msgUd;
+    DBusMessage* msgCopy;
+    l2dbus_Bool withoutBody;
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
-
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
     luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+    withoutBody = lua_toboolean(L, 2);
 
-    return l2dbus_transcodeDbusArgsToLua(L, msgUd->msg);
-}
+    if ( withoutBody )
+    {
+        msgCopy = l2dbus_messageCopyHeader(msgUd->msg);
+    }
+    else
+    {
+        msgCopy = dbus_message_copy(msgUd->msg);
+    }
+
+    if ( NULL == msgCopy )
+    {
+        luaL_error(L, "failed to copy D-Bus message");
+    }
+
+    l2dbus_messageWrap(L, msgCopy, L2DBUS_FALSE);
+    return 1;
+}
+
+
+/**
+ @function msgTypeToString
+
+ Converts the D-Bus message type into a machine-readable string.
+
+ <ul>
+ <li>@{l2dbus.Dbus.MESSAGE_TYPE_METHOD_CALL|MESSAGE_TYPE_METHOD_CALL} -> "method_call"</li>
+ <li>@{l2dbus.Dbus.MESSAGE_TYPE_METHOD_RETURN|MESSAGE_TYPE_METHOD_RETURN} -> "method_return"</li>
+ <li>@{l2dbus.Dbus.MESSAGE_TYPE_SIGNAL|MESSAGE_TYPE_SIGNAL} -> "signal"</li>
+ <li>@{l2dbus.Dbus.MESSAGE_TYPE_ERROR|MESSAGE_TYPE_ERROR} -> "error"</li>
+ <li>@{l2dbus.Dbus.MESSAGE_TYPE_INVALID|MESSAGE_TYPE_INVALID} -> "invalid"</li>
+ </ul>
+
+ @tparam number msgType The D-Bus message type.
+ @treturn string The machine-readable message type string.
+ */
+static int
+l2dbus_messageTypeToString
+    (
+    lua_State* L
+    )
+{
+    const char* str = NULL;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    str = dbus_message_type_to_string(luaL_checkinteger(L, 1));
+    lua_pushstring(L, str);
+
+    return 1;
+}
+
+
+/**
+ @function addArgs
+ @within l2dbus.Message
+
+ Append Lua arguments to a D-Bus message.
+
+ The Lua arguments are converted to their equivalent D-Bus types
+ before encoding them into the message using a set of heuristics.
+ A Lua error is generated if any errors are detected during the
+ encoding process.
+
+ @tparam userdata msg   D-Bus message to append arguments to.
+ @tparam args ... Lua arguments to append to the message.
+ */
+static int
+l2dbus_messageAddArgs
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd;
+    int nArgs = lua_gettop(L) - 1;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+
+    if ( nArgs > 0 )
+    {
+        l2dbus_transcodeLuaArgsToDbus(L, msgUd->msg, 2, nArgs);
+    }
+
+    return 0;
+}
+
+
+/**
+ @function addArgsBySignature
+ @within l2dbus.Message
+
+ Append Lua arguments to a D-Bus message using signature.
+
+ The Lua arguments are converted to their equivalent D-Bus types
+ using the provide D-Bus signature. The signature is used as guide
+ so that the conversions are explicit. If an error is encountered
+ in the conversion process a Lua error is thrown. The provided
+ signature **must** be a valid message signature. A signature
+ precompiled by @{compileSignature} can be passed in place of the
+ signature string to avoid re-parsing it for every message.
+
+ @tparam userdata msg   D-Bus message to append arguments to.
+ @tparam string|userdata signature The valid D-Bus signature for the
+ arguments or a precompiled signature handle.
+ @tparam args ... Lua arguments to append to the message.
+ */
+static int
+l2dbus_messageAddArgsBySignature
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd;
+    int nArgs = lua_gettop(L) - 2;
+    l2dbus_SigPlan* plan;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+
+    plan = l2dbus_sigPlanCheck(L, 2);
+
+    if ( nArgs > 0 )
+    {
+        l2dbus_transcodeLuaArgsToDbusByPlan(L, msgUd->msg, 3, nArgs, plan);
+    }
+
+    return 0;
+}
+
+
+/**
+ @function addArgsFromJson
+ @within l2dbus.Message
+
+ Append arguments described by a JSON document to a D-Bus message.
+
+ The JSON document is converted directly into D-Bus arguments using
+ the provided signature without creating intermediate Lua values. The
+ document must be a JSON array holding one element for each complete
+ type in the signature. Structures are given as JSON arrays, dictionaries
+ as JSON objects (non-string keys are quoted, e.g. {"1":"one"}) and byte
+ arrays may also be given as a JSON string. The D-Bus type of a variant
+ is inferred from its JSON value: strings become "s", booleans "b",
+ integers "i" (or "x"/"t" if out of range), other numbers "d", arrays
+ "av" and objects "a{sv}". JSON *null* has no D-Bus equivalent and is
+ rejected. If an error is encountered a Lua error is thrown which includes
+ the offset of the error within the document.
+
+ @tparam userdata msg   D-Bus message to append arguments to.
+ @tparam string signature The valid D-Bus signature for the arguments.
+ @tparam string json The JSON array of arguments.
+ */
+static int
+l2dbus_messageAddArgsFromJson
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd;
+    const char* signature;
+    const char* json;
+    size_t jsonLen;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+
+    signature = luaL_checkstring(L, 2);
+    json = luaL_checklstring(L, 3, &jsonLen);
+
+    l2dbus_transcodeJsonToDbus(L, msgUd->msg, signature, json, jsonLen);
+
+    return 0;
+}
+
+
+/**
+ * @brief Parses the (optional) argument conversion options.
+ *
+ * The options are provided as a Lua table. Unrecognized fields are
+ * silently ignored.
+ *
+ * @param [in]  L       The Lua state.
+ * @param [in]  idx     The stack index of the options table (or nil/none).
+ * @param [out] opts    The parsed conversion options.
+ */
+static void
+l2dbus_messageCheckTranscodeOpts
+    (
+    lua_State*              L,
+    int                     idx,
+    l2dbus_TranscodeOpts*   opts
+    )
+{
+    memset(opts, 0, sizeof(*opts));
+
+    if ( !lua_isnoneornil(L, idx) )
+    {
+        luaL_checktype(L, idx, LUA_TTABLE);
+
+        lua_getfield(L, idx, "byteArrayAsString");
+        opts->byteArrayAsString = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+
+        lua_getfield(L, idx, "byteArrayAsBuffer");
+        opts->byteArrayAsBuffer = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+
+        lua_getfield(L, idx, "internKeys");
+        opts->internKeys = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+
+        lua_getfield(L, idx, "int64AsNumber");
+        opts->int64AsNumber = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+
+        lua_getfield(L, idx, "rawVariants");
+        opts->rawVariants = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+    }
+}
+
+
+/**
+ @function getArgs
+ @within l2dbus.Message
+
+ Retrieve the arguments from the D-Bus message.
+
+ This method unmarshalls the arguments from the D-Bus message
+ converting them to equivalent Lua types. The arguments are passed
+ back as multiple return values. If there is an error then a Lua
+ error is thrown.
+
+ An optional table of conversion options can be provided. Currently
+ supported options include:
+
+ <ul>
+ <li>*byteArrayAsString* - If **true** byte arrays ("ay") are returned as
+ Lua strings rather than arrays of numbers.</li>
+ <li>*byteArrayAsBuffer* - If **true** byte arrays ("ay") are returned as
+ read-only @{l2dbus.Buffer|Buffers} that refer to the bytes of the message
+ rather than copying them. Takes precedence over *byteArrayAsString*.</li>
+ <li>*internKeys* - If **true** repeated dictionary keys within the message
+ share a single Lua string. This reduces allocations when decoding large
+ nested dictionaries (e.g. a{oa{sa{sv}}}).</li>
+ <li>*int64AsNumber* - If **true** 64-bit integers are returned as Lua
+ numbers (integers on Lua 5.3+) whenever the value can be represented
+ exactly. Otherwise @{l2dbus.Int64|Int64}/@{l2dbus.Uint64|Uint64} userdata
+ are returned as before.</li>
+ <li>*rawVariants* - If **true** variants are returned as
+ @{l2dbus.RawVariant|RawVariant} handles which are decoded on demand and
+ re-marshalled verbatim (preserving their D-Bus type) when passed as a
+ variant argument of another message.</li>
+ </ul>
+
+ @tparam userdata msg   D-Bus message to extract arguments.
+ @tparam ?table opts Optional conversion options.
+ @treturn ... Lua arguments passed out as multiple return values.
+ */
+static int
+l2dbus_messageGetArgs
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd;
+    l2dbus_TranscodeOpts opts;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+
+    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+
+    l2dbus_messageCheckTranscodeOpts(L, 2, &opts);
+
+    return l2dbus_transcodeDbusArgsToLua(L, msgUd->msg, &opts);
+}
 
 
 /**
@@ -1915,8 +2604,11 @@ l2dbus_messageGetArgs
  converting them to equivalent Lua types. The arguments are returned
  in a Lua table treated as an array. The arguments are ordered arg[1..N]
  in the array. If there is an error then a Lua error is thrown.
+ The optional conversion options are the same as those supported
+ by @{getArgs}.
 
  @tparam userdata msg   D-Bus message to extract arguments.
+ @tparam ?table opts Optional conversion options.
  @treturn array Lua arguments returned in an array.
  */
 static int
@@ -1926,69 +2618,393 @@ l2dbus_messageGetArgsAsArray
     )
 {
     l2dbus_Message* msgUd;
+    l2dbus_TranscodeOpts opts;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+
+    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+
+    l2dbus_messageCheckTranscodeOpts(L, 2, &opts);
+
+    return l2dbus_transcodeDbusArgsToLuaArray(L, msgUd->msg, &opts);
+}
+
+
+/**
+ @function getArgsAsJson
+ @within l2dbus.Message
+
+ Retrieve the arguments from the D-Bus message as a JSON document.
+
+ The arguments are converted directly from D-Bus to JSON text without
+ creating intermediate Lua values. The document is a JSON array holding
+ one element for each argument. Structures and arrays become JSON arrays,
+ dictionaries become JSON objects (with non-string keys quoted) and
+ variants are replaced by their value. 64-bit integers are written
+ exactly and doubles which are not finite are written as *null*. If an
+ argument cannot be represented (e.g. a Unix file descriptor) then a Lua
+ error is thrown.
+
+ @tparam userdata msg   D-Bus message to extract arguments.
+ @treturn string The JSON array of arguments.
+ */
+static int
+l2dbus_messageGetArgsAsJson
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+
+    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+
+    return l2dbus_transcodeDbusArgsToJson(L, msgUd->msg);
+}
+
+
+/**
+ @function takeArgs
+ @within l2dbus.Message
+
+ Retrieve the arguments from the D-Bus message and dispose of it.
+
+ This is equivalent to calling @{getArgs} followed by @{dispose} so the
+ underlying D-Bus message is released as soon as its arguments have been
+ decoded rather than when the garbage collector reclaims the message. If
+ the arguments cannot be decoded a Lua error is thrown and the message is
+ **not** disposed. A borrowed message is only invalidated.
+
+ @tparam userdata msg   D-Bus message to extract arguments.
+ @tparam ?table opts Optional conversion options.
+ @treturn ... Lua arguments passed out as multiple return values.
+ */
+static int
+l2dbus_messageTakeArgs
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd;
+    l2dbus_TranscodeOpts opts;
+    int nArgs;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+
+    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+
+    l2dbus_messageCheckTranscodeOpts(L, 2, &opts);
+
+    nArgs = l2dbus_transcodeDbusArgsToLua(L, msgUd->msg, &opts);
+
+    l2dbus_messageRelease(msgUd);
+
+    return nArgs;
+}
+
+
+/**
+ @function iterArgs
+ @within l2dbus.Message
+
+ Returns a cursor to lazily decode the message arguments.
+
+ Unlike @{getArgs}, no arguments are decoded up front. The returned
+ @{l2dbus.ArgCursor|ArgCursor} decodes arguments one at a time on demand
+ and can skip arguments (or peek at their types) without converting them
+ to Lua values. The optional conversion options are the same as those
+ supported by @{getArgs} and apply to every value decoded by the cursor.
+
+ @tparam userdata msg   D-Bus message to iterate.
+ @tparam ?table opts Optional conversion options.
+ @treturn userdata An ArgCursor positioned at the first argument.
+ */
+static int
+l2dbus_messageIterArgs
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd;
+    l2dbus_TranscodeOpts opts;
+    DBusMessageIter iter;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+
+    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+
+    l2dbus_messageCheckTranscodeOpts(L, 2, &opts);
+
+    /* An iterator over a message without arguments is at its end */
+    dbus_message_iter_init(msgUd->msg, &iter);
+    l2dbus_argCursorNew(L, msgUd->msg, &iter, &opts);
+
+    return 1;
+}
+
+
+/**
+ @function marshallToArray
+ @within l2dbus.Message
+
+ Marshall the D-Bus message data to a byte array.
+
+ This method marshalls the contents of the D-Bus message into a Lua array
+ of numbers (bytes). The array represents a binary representation of the
+ D-Bus message.
+
+ @tparam userdata msg D-Bus message to extract binary data.
+ @treturn array Array of numbers containing the binary representation of
+ the message.
+ */
+static int
+l2dbus_messageMarshallToArray
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd;
+    char* msgBuf;
+    int msgBufLen = 0;
+    int idx;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+
+    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+
+    if ( !dbus_message_marshal(msgUd->msg, &msgBuf, &msgBufLen) )
+    {
+        luaL_error(L, "failed to allocate memory for D-Bus message");
+    }
+    else
+    {
+        lua_createtable(L, msgBufLen, 0);
+        for ( idx = 0; idx < msgBufLen; ++idx )
+        {
+            lua_pushinteger(L, (unsigned char)msgBuf[idx]);
+            lua_rawseti(L, -2, idx + 1);
+        }
+        dbus_free(msgBuf);
+    }
+
+    return 1;
+}
+
+
+/**
+ @function marshallToString
+ @within l2dbus.Message
+
+ Marshall the D-Bus message data to a (binary) Lua string.
+
+ This method marshalls the contents of the D-Bus message into a Lua string
+ holding the binary (wire) representation of the D-Bus message. This is far
+ more compact than the array produced by @{marshallToArray} and is
+ suitable for persisting or forwarding messages.
+
+ @tparam userdata msg D-Bus message to extract binary data.
+ @treturn string A string containing the binary representation of the
+ message.
+ */
+static int
+l2dbus_messageMarshallToString
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd;
+    char* msgBuf;
+    int msgBufLen = 0;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+
+    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+
+    if ( !dbus_message_marshal(msgUd->msg, &msgBuf, &msgBufLen) )
+    {
+        luaL_error(L, "failed to allocate memory for D-Bus message");
+    }
+    else
+    {
+        lua_pushlstring(L, msgBuf, msgBufLen);
+        dbus_free(msgBuf);
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Retrieves a slice of a Lua string.
+ *
+ * The slice starts at the (1-based) offset and extends for the given length.
+ * If the length is omitted the slice runs to the end of the string. A Lua
+ * error is thrown if the slice lies outside the string.
+ *
+ * @param [in]  L           The Lua state.
+ * @param [in]  strIdx      The stack index of the string.
+ * @param [in]  offsetIdx   The stack index of the (optional) offset.
+ * @param [in]  lenIdx      The stack index of the (optional) length. If
+ * zero (0) the length is not parsed.
+ * @param [out] sliceLen    The length of the slice.
+ * @return A pointer to the start of the slice within the Lua string.
+ */
+static const char*
+l2dbus_messageCheckSlice
+    (
+    lua_State*  L,
+    int         strIdx,
+    int         offsetIdx,
+    int         lenIdx,
+    size_t*     sliceLen
+    )
+{
+    size_t strLen;
+    const char* str = luaL_checklstring(L, strIdx, &strLen);
+    lua_Integer offset = luaL_optinteger(L, offsetIdx, 1);
+    lua_Integer len;
 
-    /* Make sure the module is initialized */
-    l2dbus_checkModuleInitialized(L);
+    luaL_argcheck(L, (offset >= 1) && ((size_t)offset <= strLen + 1),
+                    offsetIdx, "offset out of range");
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    len = (lua_Integer)(strLen - (size_t)(offset - 1));
+    if ( 0 != lenIdx )
+    {
+        len = luaL_optinteger(L, lenIdx, len);
+        luaL_argcheck(L, (len >= 0) &&
+                    ((size_t)len <= strLen - (size_t)(offset - 1)),
+                    lenIdx, "length out of range");
+    }
 
-    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+    *sliceLen = (size_t)len;
 
-    return l2dbus_transcodeDbusArgsToLuaArray(L, msgUd->msg);
+    return str + (offset - 1);
 }
 
 
 /**
- @function marshallToArray
- @within l2dbus.Message
+ @function unmarshallFromString
 
- Marshall the D-Bus message data to a byte array.
+ Unmarshalls a binary string (or a slice of it) into a D-Bus message.
 
- This method marshalls the contents of the D-Bus message into a Lua array
- of numbers (bytes). The array represents a binary representation of the
- D-Bus message.
+ This method takes a Lua string holding the binary representation of a
+ D-Bus message and turns it into a new message. This is the opposite
+ operation performed by @{marshallToString}. The message is decoded
+ directly from the string without an intermediate copy. An optional offset
+ and length can be given to decode a message embedded within a larger
+ string (e.g. a buffer read from a socket).
 
- @tparam userdata msg D-Bus message to extract binary data.
- @treturn array Array of numbers containing the binary representation of
+ @tparam string msgBuf String containing the binary representation of
  the message.
+ @tparam ?int offset The (1-based) offset in the string where the message
+ starts. Defaults to **1**.
+ @tparam ?int length The length in bytes of the message. Defaults to the
+ remainder of the string.
+ @return userdata A D-Bus message created from the binary representation.
  */
 static int
-l2dbus_messageMarshallToArray
+l2dbus_messageUnmarshallFromString
     (
     lua_State*  L
     )
 {
+    const char* buf;
+    size_t  bufLen;
+    DBusMessage* dbusMsg = NULL;
+    DBusError dbusErr;
     l2dbus_Message* msgUd;
-    char* msgBuf;
-    int msgBufLen = 0;
-    int idx;
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    msgUd = luaL_checkudata(L, 1, L2DBUS_MESSAGE_MTBL_NAME);
+    buf = l2dbus_messageCheckSlice(L, 1, 2, 3, &bufLen);
 
-    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+    dbus_error_init(&dbusErr);
+    dbusMsg = dbus_message_demarshal(buf, (int)bufLen, &dbusErr);
+    if ( NULL == dbusMsg )
+    {
+        lua_pushfstring(L, "failed to demarshall message: %s",
+                        dbusErr.message ? dbusErr.message : "");
+        dbus_error_free(&dbusErr);
+        lua_error(L);
+    }
 
-    if ( !dbus_message_marshal(msgUd->msg, &msgBuf, &msgBufLen) )
+    msgUd = (l2dbus_Message*)l2dbus_objectNew(L, sizeof(*msgUd),
+                                                     L2DBUS_MESSAGE_TYPE_ID);
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Message userdata=%p", msgUd));
+
+    if ( NULL == msgUd )
     {
-        luaL_error(L, "failed to allocate memory for D-Bus message");
+        dbus_message_unref(dbusMsg);
+        luaL_error(L, "failed to allocate userdata for DBus message");
     }
     else
     {
-        lua_createtable(L, msgBufLen, 0);
-        for ( idx = 0; idx < msgBufLen; ++idx )
-        {
-            lua_pushinteger(L, msgBuf[idx]);
-            lua_rawseti(L, -2, idx);
-        }
-        dbus_free(msgBuf);
+        l2dbus_messageAdopt(L, msgUd, dbusMsg);
     }
 
     return 1;
 }
 
 
+/**
+ @function unmarshallBytesNeeded
+
+ Determines the number of bytes needed to unmarshall a message.
+
+ Given the beginning of a binary message this function returns the number
+ of bytes needed to hold the complete message. This allows messages to be
+ framed when they are read incrementally from a stream (e.g. a socket). At
+ least 16 bytes (the fixed header) must be available before the size can be
+ determined.
+
+ @tparam string msgBuf String containing the (partial) binary
+ representation of a message.
+ @tparam ?int offset The (1-based) offset in the string where the message
+ starts. Defaults to **1**.
+ @treturn int The total size of the message in bytes, **0** if more data
+ is needed to determine the size, or **-1** if the data is not a valid
+ message.
+ */
+static int
+l2dbus_messageUnmarshallBytesNeeded
+    (
+    lua_State*  L
+    )
+{
+    const char* buf;
+    size_t  bufLen;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    buf = l2dbus_messageCheckSlice(L, 1, 2, 0, &bufLen);
+
+    lua_pushinteger(L, dbus_message_demarshal_bytes_needed(buf, (int)bufLen));
+
+    return 1;
+}
+
+
 /**
  @function unmarshallToMessage
 
@@ -2054,7 +3070,7 @@ l2dbus_messageUnmarshallToMessage
     }
     else
     {
-        msgUd->msg = dbusMsg;
+        l2dbus_messageAdopt(L, msgUd, dbusMsg);
     }
 
     return 1;
@@ -2105,6 +3121,80 @@ l2dbus_messageValidateSignature
 }
 
 
+/**
+ @function retain
+ @within l2dbus.Message
+
+ Retains a borrowed message beyond the lifetime of the callback.
+
+ Handlers that opt into *borrowed* message delivery receive a Message
+ wrapper that is only valid for the duration of the callback. Once the
+ handler returns the wrapper is invalidated and re-used for subsequent
+ messages. Calling *retain* takes a reference to the underlying D-Bus
+ message so that it remains valid (and is never re-used) after the
+ handler returns. Calling this on a message that is not borrowed has
+ no effect.
+
+ @tparam userdata msg The Lua D-Bus message to retain.
+ @treturn userdata The (now retained) message.
+ */
+static int
+l2dbus_messageRetain
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = (l2dbus_Message*)l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+    luaL_argcheck(L, msgUd->msg != NULL, 1, DBUS_MSG_NO_REF_ERROR);
+
+    if ( msgUd->isBorrowed )
+    {
+        dbus_message_ref(msgUd->msg);
+        msgUd->isBorrowed = L2DBUS_FALSE;
+        msgUd->isRetained = L2DBUS_TRUE;
+        l2dbus_messageLiveAdd(L);
+    }
+
+    lua_pushvalue(L, 1);
+    return 1;
+}
+
+
+/**
+ @function isBorrowed
+ @within l2dbus.Message
+
+ Determines whether the message is borrowed.
+
+ A borrowed message is only valid for the duration of the handler that
+ received it. See @{retain}.
+
+ @tparam userdata msg The Lua D-Bus message.
+ @treturn bool Returns **true** if the message is borrowed, **false**
+ otherwise.
+ */
+static int
+l2dbus_messageIsBorrowed
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    msgUd = (l2dbus_Message*)l2dbus_checkUserData(L, 1, L2DBUS_MESSAGE_TYPE_ID);
+    lua_pushboolean(L, msgUd->isBorrowed);
+    return 1;
+}
+
+
 /**
  @function dispose
  @within l2dbus.Message
@@ -2138,19 +3228,10 @@ l2dbus_messageUnref
     lua_State*  L
     )
 {
-    l2dbus_Message* ud = (l2dbus_Message*)luaL_checkudata(L, -1,
-                                        L2DBUS_MESSAGE_MTBL_NAME);
+    l2dbus_Message* ud = (l2dbus_Message*)l2dbus_checkUserData(L, -1,
+                                        L2DBUS_MESSAGE_TYPE_ID);
 
-    if ( ud->msg != NULL )
-    {
-        L2DBUS_TRACE((L2DBUS_TRC_TRACE,
-                "Unref D-Bus msg (%p) type: %s serial #: %d",
-                ud->msg,
-                dbus_message_type_to_string(dbus_message_get_type(ud->msg)),
-                dbus_message_get_serial(ud->msg)));
-        dbus_message_unref(ud->msg);
-        ud->msg = NULL;
-    }
+    l2dbus_messageRelease(ud);
     return 0;
 }
 
@@ -2170,8 +3251,8 @@ l2dbus_messageDispose
     lua_State*  L
     )
 {
-    l2dbus_Message* ud = (l2dbus_Message*)luaL_checkudata(L, -1,
-                                        L2DBUS_MESSAGE_MTBL_NAME);
+    l2dbus_Message* ud = (l2dbus_Message*)l2dbus_checkUserData(L, -1,
+                                        L2DBUS_MESSAGE_TYPE_ID);
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: message (userdata=%p)", ud));
     l2dbus_messageUnref(L);
     return 0;
@@ -2208,13 +3289,24 @@ static const luaL_Reg l2dbus_messageMetaTable[] = {
     {"getSignature", l2dbus_messageGetSignature},
     {"hasSignature", l2dbus_messageHasSignature},
     {"containsUnixFds", l2dbus_messageContainsUnixFds},
+    {"takeUnixFd", l2dbus_messageTakeUnixFd},
     {"setSerial", l2dbus_messageSetSerial},
     {"getSerial", l2dbus_messageGetSerial},
+    {"getHeader", l2dbus_messageGetHeader},
+    {"ffiHandle", l2dbus_messageGetFfiHandle},
+    {"clone", l2dbus_messageClone},
     {"addArgs", l2dbus_messageAddArgs},
     {"addArgsBySignature", l2dbus_messageAddArgsBySignature},
+    {"addArgsFromJson", l2dbus_messageAddArgsFromJson},
     {"getArgs", l2dbus_messageGetArgs},
     {"getArgsAsArray", l2dbus_messageGetArgsAsArray},
+    {"getArgsAsJson", l2dbus_messageGetArgsAsJson},
+    {"takeArgs", l2dbus_messageTakeArgs},
+    {"iterArgs", l2dbus_messageIterArgs},
     {"marshallToArray", l2dbus_messageMarshallToArray},
+    {"marshallToString", l2dbus_messageMarshallToString},
+    {"retain", l2dbus_messageRetain},
+    {"isBorrowed", l2dbus_messageIsBorrowed},
     {"dispose", l2dbus_messageUnref},
     {"__gc", l2dbus_messageDispose},
     {NULL, NULL},
@@ -2253,13 +3345,288 @@ l2dbus_messageWrap
         {
             dbus_message_ref(msg);
         }
-        msgUd->msg = msg;
+        l2dbus_messageAdopt(L, msgUd, msg);
+    }
+
+    return msgUd;
+}
+
+
+/**
+ * @brief Copies the header of a D-Bus message without its arguments.
+ *
+ * Unlike dbus_message_copy() the body of the message is not copied so the
+ * new message can be filled with different arguments. The copy has no
+ * serial number.
+ *
+ * @param [in] msg  The D-Bus message whose header is copied.
+ * @return The new D-Bus message (owned by the caller) or NULL if it could
+ * not be allocated.
+ */
+struct DBusMessage*
+l2dbus_messageCopyHeader
+    (
+    struct DBusMessage* msg
+    )
+{
+    DBusMessage* copy;
+    dbus_bool_t isOk;
+    const char* field;
+    dbus_uint32_t replySerial;
+
+    copy = dbus_message_new(dbus_message_get_type(msg));
+    if ( NULL == copy )
+    {
+        return NULL;
+    }
+
+    isOk = dbus_message_set_path(copy, dbus_message_get_path(msg)) &&
+        dbus_message_set_interface(copy, dbus_message_get_interface(msg)) &&
+        dbus_message_set_member(copy, dbus_message_get_member(msg)) &&
+        dbus_message_set_error_name(copy, dbus_message_get_error_name(msg)) &&
+        dbus_message_set_destination(copy, dbus_message_get_destination(msg));
+
+    field = dbus_message_get_sender(msg);
+    if ( isOk && (NULL != field) )
+    {
+        isOk = dbus_message_set_sender(copy, field);
+    }
+
+    replySerial = dbus_message_get_reply_serial(msg);
+    if ( isOk && (0 != replySerial) )
+    {
+        isOk = dbus_message_set_reply_serial(copy, replySerial);
+    }
+
+    if ( !isOk )
+    {
+        dbus_message_unref(copy);
+        return NULL;
+    }
+
+    dbus_message_set_no_reply(copy, dbus_message_get_no_reply(msg));
+    dbus_message_set_auto_start(copy, dbus_message_get_auto_start(msg));
+
+    return copy;
+}
+
+
+/**
+ * @brief Lends a pooled Message wrapper for the duration of a callback.
+ *
+ * This function binds a re-usable Message wrapper to the D-Bus message
+ * without taking a reference to it. The wrapper is left on the top of the
+ * Lua stack and must be handed back by calling l2dbus_messageGiveBack()
+ * once the callback returns. If every pooled wrapper is already on loan
+ * (e.g. nested callbacks) a regular owning wrapper is created instead.
+ *
+ * @param [in] L    The Lua state.
+ * @param [in] msg  The raw D-Bus message to lend to the callback.
+ * @return The Lua userdata pointer.
+ */
+l2dbus_Message*
+l2dbus_messageBorrow
+    (
+    lua_State*          L,
+    struct DBusMessage* msg
+    )
+{
+    l2dbus_Message* msgUd;
+    int idx;
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+
+    if ( NULL == ctx )
+    {
+        return l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
+    }
+
+    for ( idx = 0; idx < L2DBUS_MESSAGE_POOL_SIZE; ++idx )
+    {
+        if ( !ctx->msgPoolInUse[idx] )
+        {
+            break;
+        }
     }
 
+    if ( (L2DBUS_MESSAGE_POOL_SIZE == idx) ||
+        (LUA_NOREF == ctx->msgPoolRef) )
+    {
+        return l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ctx->msgPoolRef);
+    if ( NULL == ctx->msgPoolWrappers[idx] )
+    {
+        msgUd = (l2dbus_Message*)l2dbus_objectNew(L, sizeof(*msgUd),
+                                                L2DBUS_MESSAGE_TYPE_ID);
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, -3, idx + 1);
+        ctx->msgPoolWrappers[idx] = msgUd;
+    }
+    else
+    {
+        lua_rawgeti(L, -1, idx + 1);
+        msgUd = ctx->msgPoolWrappers[idx];
+    }
+    /* Remove the pool table leaving the wrapper on the stack */
+    lua_remove(L, -2);
+
+    ctx->msgPoolInUse[idx] = L2DBUS_TRUE;
+    msgUd->msg = msg;
+    msgUd->isBorrowed = L2DBUS_TRUE;
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Borrow Message userdata=%p (slot=%d)",
+                msgUd, idx));
+
     return msgUd;
 }
 
 
+/**
+ * @brief Returns a borrowed Message wrapper to the pool.
+ *
+ * Invalidates a wrapper previously lent by l2dbus_messageBorrow(). If the
+ * callback retained the message the wrapper is released from the pool and
+ * left to the garbage collector (even if the handler has since disposed
+ * of the message, since Lua may still reference the wrapper).
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] msgUd    The wrapper returned by l2dbus_messageBorrow().
+ */
+void
+l2dbus_messageGiveBack
+    (
+    lua_State*      L,
+    l2dbus_Message* msgUd
+    )
+{
+    int idx;
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+
+    if ( NULL == ctx )
+    {
+        return;
+    }
+
+    for ( idx = 0; idx < L2DBUS_MESSAGE_POOL_SIZE; ++idx )
+    {
+        if ( msgUd == ctx->msgPoolWrappers[idx] )
+        {
+            break;
+        }
+    }
+
+    /* The wrapper did not come from the pool */
+    if ( L2DBUS_MESSAGE_POOL_SIZE == idx )
+    {
+        return;
+    }
+
+    if ( msgUd->isBorrowed )
+    {
+        msgUd->msg = NULL;
+        msgUd->isBorrowed = L2DBUS_FALSE;
+    }
+    else if ( msgUd->isRetained )
+    {
+        /* Retained by the handler so it can no longer be re-used */
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ctx->msgPoolRef);
+        lua_pushnil(L);
+        lua_rawseti(L, -2, idx + 1);
+        lua_pop(L, 1);
+        ctx->msgPoolWrappers[idx] = NULL;
+    }
+
+    ctx->msgPoolInUse[idx] = L2DBUS_FALSE;
+}
+
+
+/**
+ @function setLiveLimit
+ @within l2dbus.Message
+
+ Bounds the number of live D-Bus messages without forcing full collections.
+
+ Every Message that owns a D-Bus message counts as *live* until it's
+ disposed (explicitly, by @{takeArgs}, or by the garbage collector).
+ Borrowed messages are not counted. Once more than *limit* messages are
+ live each new message also performs an incremental garbage collection
+ step of *gcStep* Kbytes so unreferenced messages are reclaimed while
+ under load. A warning is traced each time the limit is exceeded. The
+ limit applies to all the connections of the Lua state since a message is
+ not tied to a single connection.
+
+ @tparam number limit The maximum number of live messages or zero (0) for
+ no limit (the default).
+ @tparam ?number gcStep The size (in Kbytes) of the incremental garbage
+ collection step. Defaults to 64.
+ */
+static int
+l2dbus_messageSetLiveLimit
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* ctx;
+    lua_Number limit;
+    int gcStep;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    limit = luaL_checknumber(L, 1);
+    gcStep = luaL_optint(L, 2, L2DBUS_MESSAGE_LIVE_GC_STEP);
+    luaL_argcheck(L, (limit >= 0) && (limit <= 0xFFFFFFFFU), 1,
+                "limit must be zero or a positive number");
+    luaL_argcheck(L, gcStep > 0, 2, "GC step must be a positive number");
+
+    ctx = l2dbus_contextCurrent();
+    ctx->msgLive.limit = (unsigned)limit;
+    ctx->msgLive.gcStepKb = gcStep;
+    ctx->msgLive.overLimit = L2DBUS_FALSE;
+
+    return 0;
+}
+
+
+/**
+ @function getLiveStats
+ @within l2dbus.Message
+
+ Returns the accounting of live D-Bus messages.
+
+ @treturn table A table with the fields *live* (the number of live
+ messages), *peak* (the largest number live at once), *limit* (see
+ @{setLiveLimit}), *gcSteps* (incremental collections taken over the
+ limit) and *warnings* (the number of times the limit was exceeded).
+ */
+static int
+l2dbus_messageGetLiveStats
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_MessageLive* live;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+    live = &l2dbus_contextCurrent()->msgLive;
+
+    lua_createtable(L, 0, 5);
+    lua_pushnumber(L, live->count);
+    lua_setfield(L, -2, "live");
+    lua_pushnumber(L, live->peak);
+    lua_setfield(L, -2, "peak");
+    lua_pushnumber(L, live->limit);
+    lua_setfield(L, -2, "limit");
+    lua_pushnumber(L, (lua_Number)live->gcSteps);
+    lua_setfield(L, -2, "gcSteps");
+    lua_pushnumber(L, (lua_Number)live->warnings);
+    lua_setfield(L, -2, "warnings");
+
+    return 1;
+}
+
+
 /**
  * @brief Creates the Message sub-module.
  *
@@ -2275,8 +3642,28 @@ l2dbus_openMessage
     lua_State*  L
     )
 {
+    l2dbus_Context* ctx;
+
     lua_pop(L, l2dbus_createMetatable(L, L2DBUS_MESSAGE_TYPE_ID,
             l2dbus_messageMetaTable));
+    l2dbus_openSigPlan(L);
+    l2dbus_openCallTemplate(L);
+
+    /* (Re)create the pool of wrappers used for borrowed delivery */
+    ctx = l2dbus_contextGet(L);
+    if ( NULL == ctx )
+    {
+        luaL_error(L, "Message pool has no module context!");
+    }
+    if ( LUA_NOREF != ctx->msgPoolRef )
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, ctx->msgPoolRef);
+    }
+    memset(ctx->msgPoolWrappers, 0, sizeof(ctx->msgPoolWrappers));
+    memset(ctx->msgPoolInUse, 0, sizeof(ctx->msgPoolInUse));
+    lua_createtable(L, L2DBUS_MESSAGE_POOL_SIZE, 0);
+    ctx->msgPoolRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
     lua_newtable(L);
     lua_pushcfunction(L, l2dbus_newMessage);
     lua_setfield(L, -2, "new");
@@ -2302,9 +3689,36 @@ l2dbus_openMessage
     lua_pushcfunction(L, l2dbus_messageUnmarshallToMessage);
     lua_setfield(L, -2, "unmarshallToMessage");
 
+    lua_pushcfunction(L, l2dbus_messageUnmarshallFromString);
+    lua_setfield(L, -2, "unmarshallFromString");
+
+    lua_pushcfunction(L, l2dbus_messageUnmarshallBytesNeeded);
+    lua_setfield(L, -2, "unmarshallBytesNeeded");
+
     lua_pushcfunction(L, l2dbus_messageValidateSignature);
     lua_setfield(L, -2, "validateSignature");
 
+    lua_pushcfunction(L, l2dbus_messageFromFfiHandle);
+    lua_setfield(L, -2, "fromFfiHandle");
+
+    lua_pushcfunction(L, l2dbus_sigPlanCompile);
+    lua_setfield(L, -2, "compileSignature");
+
+    lua_pushcfunction(L, l2dbus_callTemplateNew);
+    lua_setfield(L, -2, "newCallTemplate");
+
+    lua_pushcfunction(L, l2dbus_callTemplateFromMessage);
+    lua_setfield(L, -2, "newTemplate");
+
+    lua_pushcfunction(L, l2dbus_shapeCache);
+    lua_setfield(L, -2, "cacheShape");
+
+    lua_pushcfunction(L, l2dbus_messageSetLiveLimit);
+    lua_setfield(L, -2, "setLiveLimit");
+
+    lua_pushcfunction(L, l2dbus_messageGetLiveStats);
+    lua_setfield(L, -2, "getLiveStats");
+
 /**
  @messageType INVALID
  This value is never a valid message type.
@@ -38,13 +38,62 @@
 
 /* Forward declarations */
 struct DBusMessage;
+struct l2dbus_Context;
 
 typedef struct l2dbus_Message
 {
     struct DBusMessage* msg;
+    /* True if the wrapper is on loan to a callback and holds no reference */
+    l2dbus_Bool         isBorrowed;
+    /* True once a borrowed wrapper was retained (it may never be re-used) */
+    l2dbus_Bool         isRetained;
 } l2dbus_Message;
 
+/* Number of re-usable wrappers available for borrowed message delivery */
+#define L2DBUS_MESSAGE_POOL_SIZE    (8)
+
+/* Default amount of work (in Kbytes) of the GC step taken over the limit */
+#define L2DBUS_MESSAGE_LIVE_GC_STEP (64)
+
+/*
+ * Accounting of the D-Bus messages owned by Message wrappers. Once more
+ * than *limit* messages are alive an incremental GC step is taken for
+ * every new message so unreferenced wrappers are reclaimed without
+ * waiting for (or forcing) a full collection.
+ */
+typedef struct l2dbus_MessageLive
+{
+    unsigned        count;
+    unsigned        peak;
+    /* Zero (0) if there is no limit */
+    unsigned        limit;
+    int             gcStepKb;
+    l2dbus_Bool     overLimit;
+    unsigned long   gcSteps;
+    unsigned long   warnings;
+} l2dbus_MessageLive;
+
+/* Number of slots in the cache of interned header strings */
+#define L2DBUS_MESSAGE_INTERN_SLOTS (256)
+
+/*
+ * A header string (path, interface, member or signature) whose Lua string
+ * is kept referenced so it can be pushed without being hashed by Lua again.
+ * A slot with a NULL string is empty.
+ */
+typedef struct l2dbus_MessageIntern
+{
+    unsigned        hash;
+    char*           str;
+    int             ref;
+} l2dbus_MessageIntern;
+
 l2dbus_Message* l2dbus_messageWrap(lua_State* L, struct DBusMessage* msg, l2dbus_Bool addRef);
+l2dbus_Message* l2dbus_messageBorrow(lua_State* L, struct DBusMessage* msg);
+void l2dbus_messageGiveBack(lua_State* L, l2dbus_Message* msgUd);
+struct DBusMessage* l2dbus_messageCopyHeader(struct DBusMessage* msg);
+void l2dbus_messageHoldUnixFd(struct DBusMessage* msg, int fd);
+void l2dbus_messageInternFree(struct l2dbus_Context* ctx);
 void l2dbus_openMessage(lua_State* L);
 
 #endif /* Guard for L2DBUS_MESSAGE_H_ */
@@ -34,9 +34,164 @@
 #include <string.h>
 #include "lauxlib.h"
 #include "l2dbus_object.h"
+#include "l2dbus_context.h"
 #include "l2dbus_compat.h"
+#include "l2dbus_alloc.h"
+
+/* Initial number of hash buckets (must be a power of two) */
+#define L2DBUS_OBJREG_INIT_BUCKETS  (64)
+
+/* Marks a bucket whose key has been removed */
+static char gObjRegTombstone;
+#define L2DBUS_OBJREG_TOMBSTONE ((void*)&gObjRegTombstone)
+
+
+static size_t
+l2dbus_objectRegistryHash
+    (
+    void*   key
+    )
+{
+    size_t h = (size_t)key;
+    h ^= h >> 4;
+    h *= (size_t)2654435761U;
+    h ^= h >> 16;
+    return h;
+}
+
+
+/**
+ * @brief Finds the bucket holding the key.
+ *
+ * @param [in]  key     The key to find.
+ * @param [out] freeIdx If not NULL, the bucket where the key could be
+ * inserted if it is not found.
+ * @return The index of the bucket holding the key or -1 if not found.
+ */
+static long
+l2dbus_objectRegistryFind
+    (
+    l2dbus_ObjectRegistry*  reg,
+    void*                   key,
+    size_t*                 freeIdx
+    )
+{
+    size_t mask = reg->nBuckets - 1;
+    size_t idx = l2dbus_objectRegistryHash(key) & mask;
+    long tombIdx = -1;
+    l2dbus_ObjRegBucket* bucket;
+
+    for ( ;; )
+    {
+        bucket = &reg->buckets[idx];
+        if ( NULL == bucket->key )
+        {
+            if ( NULL != freeIdx )
+            {
+                *freeIdx = (tombIdx >= 0) ? (size_t)tombIdx : idx;
+            }
+            return -1;
+        }
+        else if ( key == bucket->key )
+        {
+            return (long)idx;
+        }
+        else if ( (L2DBUS_OBJREG_TOMBSTONE == bucket->key) && (tombIdx < 0) )
+        {
+            tombIdx = (long)idx;
+        }
+        idx = (idx + 1) & mask;
+    }
+}
+
+
+/**
+ * @brief Rebuilds the hash table (purging tombstones) with the given size.
+ *
+ * @return True if successful, false if memory could not be allocated.
+ */
+static l2dbus_Bool
+l2dbus_objectRegistryRehash
+    (
+    l2dbus_ObjectRegistry*  reg,
+    size_t                  nBuckets
+    )
+{
+    l2dbus_ObjRegBucket* oldBuckets = reg->buckets;
+    size_t oldSize = reg->nBuckets;
+    size_t idx;
+    size_t freeIdx = 0;
+
+    reg->buckets = (l2dbus_ObjRegBucket*)l2dbus_calloc(nBuckets,
+                                                sizeof(*reg->buckets));
+    if ( NULL == reg->buckets )
+    {
+        reg->buckets = oldBuckets;
+        return L2DBUS_FALSE;
+    }
+    reg->nBuckets = nBuckets;
+    reg->nUsed = 0;
+
+    for ( idx = 0; idx < oldSize; ++idx )
+    {
+        if ( (NULL != oldBuckets[idx].key) &&
+            (L2DBUS_OBJREG_TOMBSTONE != oldBuckets[idx].key) )
+        {
+            (void)l2dbus_objectRegistryFind(reg, oldBuckets[idx].key, &freeIdx);
+            reg->buckets[freeIdx] = oldBuckets[idx];
+            reg->nUsed++;
+        }
+    }
+    l2dbus_free(oldBuckets);
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Returns the object registry of the Lua state.
+ *
+ * A Lua error is thrown if the registry has not been created.
+ *
+ * @param [in] L The Lua state.
+ * @return The object registry of the Lua state.
+ */
+static l2dbus_ObjectRegistry*
+l2dbus_objectRegistryCheck
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+
+    if ( (NULL == ctx) || (LUA_NOREF == ctx->objReg.ref) )
+    {
+        luaL_error(L, "Object Registry not initialized!");
+    }
+
+    return &ctx->objReg;
+}
+
+
+/**
+ * @brief Frees the memory held by an object registry.
+ *
+ * The Lua array anchoring the objects is owned (and collected) by Lua.
+ *
+ * @param [in] reg The object registry to free.
+ */
+void
+l2dbus_objectRegistryFree
+    (
+    l2dbus_ObjectRegistry*  reg
+    )
+{
+    l2dbus_free(reg->buckets);
+    l2dbus_free(reg->freeSlots);
+    memset(reg, 0, sizeof(*reg));
+    reg->ref = LUA_NOREF;
+}
 
-static int gObjRegRef = LUA_NOREF;
 
 void
 l2dbus_objectRegistryNew
@@ -44,14 +199,36 @@ l2dbus_objectRegistryNew
     lua_State*  L
     )
 {
-    /* Create an object with a weak value that references object handles */
-    lua_newtable(L);
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+    l2dbus_ObjectRegistry* reg;
+
+    if ( NULL == ctx )
+    {
+        luaL_error(L, "Object Registry has no module context!");
+    }
+
+    /* Discard any state left over from a previous load of the module */
+    reg = &ctx->objReg;
+    l2dbus_objectRegistryFree(reg);
+
+    reg->buckets = (l2dbus_ObjRegBucket*)l2dbus_calloc(
+                                L2DBUS_OBJREG_INIT_BUCKETS,
+                                sizeof(*reg->buckets));
+    if ( NULL == reg->buckets )
+    {
+        reg->ref = LUA_NOREF;
+        luaL_error(L, "Failed to allocate Object Registry!");
+    }
+    reg->nBuckets = L2DBUS_OBJREG_INIT_BUCKETS;
+
+    /* Create an array with weak values that references object handles */
+    lua_createtable(L, L2DBUS_OBJREG_INIT_BUCKETS, 0);
     lua_createtable(L, 0, 1);
     lua_pushstring(L, "v");
     lua_setfield(L, -2, "__mode");
     lua_setmetatable(L, -2);
 
-    gObjRegRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    reg->ref = luaL_ref(L, LUA_REGISTRYINDEX);
 }
 
 
@@ -61,23 +238,13 @@ l2dbus_objectRegistryCount
     lua_State*  L
     )
 {
-    int objCount = 0;
-    lua_rawgeti(L, LUA_REGISTRYINDEX, gObjRegRef);
-    if ( lua_type(L, -1) != LUA_TTABLE )
-    {
-        luaL_error(L, "Object Registry not initialized!");
-    }
+    l2dbus_ObjectRegistry* reg;
 
-    lua_pushnil(L);
-    while ( lua_next(L, -2) != 0 )
-    {
-        objCount++;
-        lua_pop(L, 1);
-    }
-    lua_pushinteger(L, objCount);
+    reg = l2dbus_objectRegistryCheck(L);
+
+    lua_pushinteger(L, reg->count);
 
     return 1;
-    return objCount;
 }
 
 
@@ -89,20 +256,80 @@ l2dbus_objectRegistryAdd
     int         objIdx
     )
 {
+    l2dbus_ObjectRegistry* reg;
+    long found;
+    size_t freeIdx = 0;
+    size_t nBuckets;
+    int slot;
+    int* freeSlots;
+
     /* Get the absolute index of the object */
     objIdx = lua_absindex(L, objIdx);
-    lua_rawgeti(L, LUA_REGISTRYINDEX, gObjRegRef);
-    if ( lua_type(L, -1) != LUA_TTABLE )
+    reg = l2dbus_objectRegistryCheck(L);
+
+    found = l2dbus_objectRegistryFind(reg, key, &freeIdx);
+    if ( found >= 0 )
     {
-        luaL_error(L, "Object Registry not initialized!");
+        /* Replace the object already associated with this key */
+        slot = reg->buckets[found].slot;
     }
+    else
+    {
+        /* Keep the load factor (including tombstones) below 3/4. If
+         * tombstones account for most of the load the table is rebuilt at
+         * its current size rather than grown, so adding and removing
+         * distinct keys doesn't keep doubling it.
+         */
+        if ( (reg->nUsed + 1) * 4 > reg->nBuckets * 3 )
+        {
+            nBuckets = reg->nBuckets;
+            if ( ((size_t)reg->count + 1) * 8 > reg->nBuckets * 3 )
+            {
+                nBuckets *= 2;
+            }
+            if ( !l2dbus_objectRegistryRehash(reg, nBuckets) )
+            {
+                luaL_error(L, "Failed to grow Object Registry!");
+            }
+            (void)l2dbus_objectRegistryFind(reg, key, &freeIdx);
+        }
 
-    /* Use the obj pointer (lightuserdata) as the key and
-     * the object stack index as the value.
-     */
-    lua_pushlightuserdata(L, key);
+        /* Make sure the slot can be recycled when the key is removed */
+        if ( (reg->nFree == 0) &&
+            (reg->nSlots >= reg->freeCapacity) )
+        {
+            freeSlots = (int*)l2dbus_realloc(reg->freeSlots,
+                        sizeof(int) * (reg->freeCapacity * 2 + 16));
+            if ( NULL == freeSlots )
+            {
+                luaL_error(L, "Failed to grow Object Registry!");
+            }
+            reg->freeSlots = freeSlots;
+            reg->freeCapacity = reg->freeCapacity * 2 + 16;
+        }
+
+        if ( 0 < reg->nFree )
+        {
+            slot = reg->freeSlots[--reg->nFree];
+        }
+        else
+        {
+            slot = ++reg->nSlots;
+        }
+
+        if ( NULL == reg->buckets[freeIdx].key )
+        {
+            reg->nUsed++;
+        }
+        reg->buckets[freeIdx].key = key;
+        reg->buckets[freeIdx].slot = slot;
+        reg->count++;
+    }
+
+    /* Anchor the object (weakly) in its slot */
+    lua_rawgeti(L, LUA_REGISTRYINDEX, reg->ref);
     lua_pushvalue(L, objIdx);
-    lua_rawset(L, -3);
+    lua_rawseti(L, -2, slot);
 
     /* Pop the registry table off the stack */
     lua_pop(L, 1);
@@ -115,14 +342,20 @@ l2dbus_objectRegistryGet
     void*       key
     )
 {
-    lua_rawgeti(L, LUA_REGISTRYINDEX, gObjRegRef);
-    if ( lua_type(L, -1) != LUA_TTABLE )
+    l2dbus_ObjectRegistry* reg;
+    long found;
+
+    reg = l2dbus_objectRegistryCheck(L);
+
+    found = l2dbus_objectRegistryFind(reg, key, NULL);
+    if ( found < 0 )
     {
-        luaL_error(L, "Object Registry not initialized!");
+        lua_pushnil(L);
+        return NULL;
     }
 
-    lua_pushlightuserdata(L, key);
-    lua_rawget(L, -2);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, reg->ref);
+    lua_rawgeti(L, -1, reg->buckets[found].slot);
 
     /* Remove the registry table and just leave either the value
      * associated with the key or nil.
@@ -140,18 +373,73 @@ l2dbus_objectRegistryRemove
     void*       key
     )
 {
-    lua_rawgeti(L, LUA_REGISTRYINDEX, gObjRegRef);
-    if ( lua_type(L, -1) != LUA_TTABLE )
+    l2dbus_ObjectRegistry* reg;
+    long found;
+    int slot;
+
+    reg = l2dbus_objectRegistryCheck(L);
+
+    found = l2dbus_objectRegistryFind(reg, key, NULL);
+    if ( found >= 0 )
     {
-        luaL_error(L, "Object Registry not initialized!");
+        slot = reg->buckets[found].slot;
+        reg->buckets[found].key = L2DBUS_OBJREG_TOMBSTONE;
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, reg->ref);
+        lua_pushnil(L);
+        lua_rawseti(L, -2, slot);
+
+        /* Pop off the registry table */
+        lua_pop(L, 1);
+
+        /* Capacity for every issued slot was reserved when it was added */
+        reg->freeSlots[reg->nFree++] = slot;
+        reg->count--;
     }
+}
 
-    lua_pushlightuserdata(L, key);
-    lua_pushnil(L);
-    lua_rawset(L, -3);
 
-    /* Pop off the registry table */
-    lua_pop(L, 1);
+/**
+ * @brief Returns the cached metatable of a module type.
+ *
+ * The metatable is looked up by name the first time and then cached in
+ * the context so later calls avoid the string keyed registry lookup.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] typeId   The type of the module object.
+ * @return The cached metatable or NULL if the type has no metatable (yet).
+ */
+static l2dbus_MetaTable*
+l2dbus_objectMetaTable
+    (
+    lua_State*      L,
+    l2dbus_TypeId   typeId
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextGet(L);
+    l2dbus_MetaTable* meta = NULL;
+
+    if ( (NULL != ctx) && (L2DBUS_START_TYPE_ID < typeId) &&
+        (L2DBUS_END_TYPE_ID > typeId) )
+    {
+        meta = &ctx->metaTables[typeId];
+        if ( NULL == meta->table )
+        {
+            luaL_getmetatable(L, l2dbus_getNameByTypeId(typeId));
+            if ( lua_istable(L, -1) )
+            {
+                meta->table = lua_topointer(L, -1);
+                meta->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+            }
+            else
+            {
+                lua_pop(L, 1);
+                meta = NULL;
+            }
+        }
+    }
+
+    return meta;
 }
 
 
@@ -164,6 +452,7 @@ l2dbus_objectNew
     )
 {
     void* object;
+    l2dbus_MetaTable* meta = l2dbus_objectMetaTable(L, typeId);
     const char* typeName = l2dbus_getNameByTypeId(typeId);
 
     assert( size >= 0);
@@ -171,7 +460,14 @@ l2dbus_objectNew
 
     object = lua_newuserdata(L, size);
     memset(object, 0, size);
-    luaL_getmetatable(L, typeName);
+    if ( NULL != meta )
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, meta->ref);
+    }
+    else
+    {
+        luaL_getmetatable(L, typeName);
+    }
     lua_setmetatable(L, -2);
 
 #if 0
@@ -185,3 +481,73 @@ l2dbus_objectNew
     return object;
 }
 
+
+/**
+ * @brief Returns the module object at an index if it has the given type.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] udIdx    The stack index of the value.
+ * @param [in] typeId   The expected type of the module object.
+ * @return The userdata or NULL if the value is not of the type.
+ */
+void*
+l2dbus_isUserData
+    (
+    lua_State*      L,
+    int             udIdx,
+    l2dbus_TypeId   typeId
+    )
+{
+    l2dbus_MetaTable* meta;
+
+    /* Is value a userdata? */
+    void *p = lua_touserdata(L, udIdx);
+    if ( NULL != p )
+    {
+        /* Does it have a metatable? */
+        if ( lua_getmetatable(L, udIdx) )
+        {
+            /* Is it the (cached) metatable of the type? */
+            meta = l2dbus_objectMetaTable(L, typeId);
+            if ( (NULL == meta) || (lua_topointer(L, -1) != meta->table) )
+            {
+                p = NULL;
+            }
+            lua_pop(L, 1);
+            return p;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * @brief Checks that the argument at an index is a module object of the
+ * given type.
+ *
+ * This is a faster replacement for luaL_checkudata() and raises the same
+ * error if the argument is not of the type.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] udIdx    The stack index of the argument.
+ * @param [in] typeId   The expected type of the module object.
+ * @return The userdata of the module object.
+ */
+void*
+l2dbus_checkUserData
+    (
+    lua_State*      L,
+    int             udIdx,
+    l2dbus_TypeId   typeId
+    )
+{
+    void* p = l2dbus_isUserData(L, udIdx, typeId);
+
+    if ( NULL == p )
+    {
+        /* Let Lua raise the usual error for the wrong type */
+        p = luaL_checkudata(L, udIdx, l2dbus_getNameByTypeId(typeId));
+    }
+
+    return p;
+}
@@ -33,15 +33,48 @@
 
 #ifndef L2DBUS_OBJECT_H_
 #define L2DBUS_OBJECT_H_
+#include <stddef.h>
 #include "lua.h"
 #include "l2dbus_types.h"
 
+/*
+ * Maps a (C pointer) key to the slot in the weak-valued Lua array that
+ * holds the associated Lua object. Keys are hashed in C so that a lookup
+ * in the Lua array is a simple integer index.
+ */
+typedef struct l2dbus_ObjRegBucket
+{
+    void*   key;
+    int     slot;
+} l2dbus_ObjRegBucket;
+
+typedef struct l2dbus_ObjectRegistry
+{
+    /* Reference to the weak-valued Lua array anchoring the objects */
+    int                     ref;
+    l2dbus_ObjRegBucket*    buckets;
+    size_t                  nBuckets;
+    /* Number of buckets that are occupied or hold a tombstone */
+    size_t                  nUsed;
+    /* Stack of slots available for re-use */
+    int*                    freeSlots;
+    int                     nFree;
+    int                     freeCapacity;
+    /* Highest slot number handed out so far */
+    int                     nSlots;
+    /* Number of objects currently registered */
+    int                     count;
+} l2dbus_ObjectRegistry;
+
 void l2dbus_objectRegistryNew(lua_State* L);
+void l2dbus_objectRegistryFree(l2dbus_ObjectRegistry* reg);
 int l2dbus_objectRegistryCount(lua_State* L);
 void l2dbus_objectRegistryAdd(lua_State* L, void* key, int objIdx);
 void* l2dbus_objectRegistryGet(lua_State* L, void* key);
 void l2dbus_objectRegistryRemove(lua_State* L, void* key);
 void* l2dbus_objectNew(lua_State* L, size_t size, l2dbus_TypeId typeId);
+void* l2dbus_isUserData(lua_State* L, int udIdx, l2dbus_TypeId typeId);
+void* l2dbus_checkUserData(lua_State* L, int udIdx, l2dbus_TypeId typeId);
 
 
 #endif /* Guard for L2DBUS_OBJECT_H_ */
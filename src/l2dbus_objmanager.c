@@ -0,0 +1,1160 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_objmanager.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the native ObjectManager interface.
+ *===========================================================================
+ */
+#include <string.h>
+#include <assert.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_objmanager.h"
+#include "l2dbus_interface.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_message.h"
+#include "l2dbus_transcode.h"
+#include "l2dbus_callback.h"
+#include "l2dbus_core.h"
+#include "l2dbus_object.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_dbuscompat.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_tracering.h"
+#include "l2dbus_strpool.h"
+#include "lauxlib.h"
+
+#define L2DBUS_OBJMGR_MIN_BUCKETS   (64)
+
+static cdbus_DbusIntrospectArgs gGetManagedObjectsArgs[] =
+{
+    { "objpath_interfaces_and_properties", "a{oa{sa{sv}}}", CDBUS_XFER_OUT }
+};
+
+static cdbus_DbusIntrospectItem gObjMgrMethods[] =
+{
+    { "GetManagedObjects", gGetManagedObjectsArgs, 1 }
+};
+
+static cdbus_DbusIntrospectArgs gInterfacesAddedArgs[] =
+{
+    { "object_path", "o", CDBUS_XFER_OUT },
+    { "interfaces_and_properties", "a{sa{sv}}", CDBUS_XFER_OUT }
+};
+
+static cdbus_DbusIntrospectArgs gInterfacesRemovedArgs[] =
+{
+    { "object_path", "o", CDBUS_XFER_OUT },
+    { "interfaces", "as", CDBUS_XFER_OUT }
+};
+
+static cdbus_DbusIntrospectItem gObjMgrSignals[] =
+{
+    { "InterfacesAdded", gInterfacesAddedArgs, 2 },
+    { "InterfacesRemoved", gInterfacesRemovedArgs, 2 }
+};
+
+
+/**
+ L2DBUS ObjectManager
+
+ This section describes a Lua ObjectManager class.
+
+ The ObjectManager class is a native implementation of the
+ <a href="http://dbus.freedesktop.org/doc/dbus-specification.html#standard-interfaces-objectmanager">ObjectManager</a>
+ interface. It tracks the objects (and the properties of their interfaces)
+ beneath a root path. The properties are marshalled once when an object
+ is added or updated so answering *GetManagedObjects* only copies the
+ cached values into the reply. The *InterfacesAdded* and
+ *InterfacesRemoved* signals are emitted automatically once a connection
+ has been set. The @{interface|interface} of the manager must be added
+ to the service object registered at the root path. The ObjectManager
+ must be kept referenced for as long as it is expected to answer
+ requests.
+
+ @namespace l2dbus.ObjectManager
+ */
+
+
+static unsigned
+l2dbus_objMgrHash
+    (
+    const char* path
+    )
+{
+    unsigned h = 2166136261u;
+
+    while ( '\0' != *path )
+    {
+        h = (h ^ (unsigned char)*path++) * 16777619u;
+    }
+    return h;
+}
+
+
+static l2dbus_Bool
+l2dbus_objMgrIsManagedPath
+    (
+    l2dbus_ObjectManager*   mgr,
+    const char*             path
+    )
+{
+    size_t rootLen = strlen(mgr->rootPath);
+
+    if ( (1 == rootLen) && ('/' == mgr->rootPath[0]) )
+    {
+        return ('/' == path[0]) && ('\0' != path[1]);
+    }
+
+    return (0 == strncmp(path, mgr->rootPath, rootLen)) &&
+            ('/' == path[rootLen]) && ('\0' != path[rootLen + 1]);
+}
+
+
+static l2dbus_ObjMgrObject*
+l2dbus_objMgrFind
+    (
+    l2dbus_ObjectManager*   mgr,
+    const char*             path
+    )
+{
+    l2dbus_ObjMgrObject* obj = NULL;
+    unsigned hash;
+
+    if ( 0 != mgr->nBuckets )
+    {
+        hash = l2dbus_objMgrHash(path);
+        for ( obj = mgr->buckets[hash % mgr->nBuckets]; NULL != obj;
+            obj = obj->hashNext )
+        {
+            if ( (obj->hash == hash) && (0 == strcmp(obj->path, path)) )
+            {
+                break;
+            }
+        }
+    }
+
+    return obj;
+}
+
+
+static l2dbus_Bool
+l2dbus_objMgrGrow
+    (
+    l2dbus_ObjectManager*   mgr
+    )
+{
+    unsigned nBuckets = (0 == mgr->nBuckets) ? L2DBUS_OBJMGR_MIN_BUCKETS :
+                                                mgr->nBuckets * 2;
+    l2dbus_ObjMgrObject** buckets;
+    l2dbus_ObjMgrObject* obj;
+
+    buckets = (l2dbus_ObjMgrObject**)l2dbus_calloc(nBuckets, sizeof(*buckets));
+    if ( NULL == buckets )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    TAILQ_FOREACH(obj, &mgr->objects, link)
+    {
+        obj->hashNext = buckets[obj->hash % nBuckets];
+        buckets[obj->hash % nBuckets] = obj;
+    }
+
+    l2dbus_free(mgr->buckets);
+    mgr->buckets = buckets;
+    mgr->nBuckets = nBuckets;
+    return L2DBUS_TRUE;
+}
+
+
+static l2dbus_ObjMgrObject*
+l2dbus_objMgrNewObject
+    (
+    l2dbus_ObjectManager*   mgr,
+    const char*             path
+    )
+{
+    l2dbus_ObjMgrObject* obj;
+
+    if ( (mgr->nObjects >= mgr->nBuckets) && !l2dbus_objMgrGrow(mgr) )
+    {
+        return NULL;
+    }
+
+    obj = (l2dbus_ObjMgrObject*)l2dbus_calloc(1, sizeof(*obj));
+    if ( NULL != obj )
+    {
+        obj->path = l2dbus_strDup(path);
+        if ( NULL == obj->path )
+        {
+            l2dbus_free(obj);
+            obj = NULL;
+        }
+        else
+        {
+            obj->hash = l2dbus_objMgrHash(path);
+            obj->hashNext = mgr->buckets[obj->hash % mgr->nBuckets];
+            mgr->buckets[obj->hash % mgr->nBuckets] = obj;
+            TAILQ_INSERT_TAIL(&mgr->objects, obj, link);
+            mgr->nObjects++;
+        }
+    }
+
+    return obj;
+}
+
+
+static void
+l2dbus_objMgrFreeInterface
+    (
+    l2dbus_ObjMgrInterface* intf
+    )
+{
+    if ( NULL != intf->props )
+    {
+        dbus_message_unref(intf->props);
+    }
+    l2dbus_strPoolRelease(intf->name);
+    l2dbus_free(intf);
+}
+
+
+static void
+l2dbus_objMgrFreeObject
+    (
+    l2dbus_ObjectManager*   mgr,
+    l2dbus_ObjMgrObject*    obj
+    )
+{
+    l2dbus_ObjMgrObject** link = &mgr->buckets[obj->hash % mgr->nBuckets];
+    l2dbus_ObjMgrInterface* intf;
+
+    while ( NULL != *link )
+    {
+        if ( *link == obj )
+        {
+            *link = obj->hashNext;
+            break;
+        }
+        link = &(*link)->hashNext;
+    }
+    TAILQ_REMOVE(&mgr->objects, obj, link);
+    mgr->nObjects--;
+
+    while ( NULL != obj->interfaces )
+    {
+        intf = obj->interfaces;
+        obj->interfaces = intf->next;
+        l2dbus_objMgrFreeInterface(intf);
+    }
+    l2dbus_free(obj->path);
+    l2dbus_free(obj);
+}
+
+
+static l2dbus_ObjMgrInterface**
+l2dbus_objMgrFindInterface
+    (
+    l2dbus_ObjMgrObject*    obj,
+    const char*             name
+    )
+{
+    l2dbus_ObjMgrInterface** link = &obj->interfaces;
+
+    while ( (NULL != *link) && (0 != strcmp((*link)->name, name)) )
+    {
+        link = &(*link)->next;
+    }
+
+    /* Points at the link to the interface or at the tail of the list */
+    return link;
+}
+
+
+/* Appends a {sa{sv}} entry for the interface to an open array */
+static l2dbus_Bool
+l2dbus_objMgrAppendInterface
+    (
+    DBusMessageIter*        arrIt,
+    l2dbus_ObjMgrInterface* intf
+    )
+{
+    DBusMessageIter entryIt;
+    DBusMessageIter propsIt;
+    l2dbus_Bool isOk;
+
+    if ( !dbus_message_iter_open_container(arrIt, DBUS_TYPE_DICT_ENTRY, NULL,
+                                            &entryIt) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    isOk = dbus_message_iter_append_basic(&entryIt, DBUS_TYPE_STRING,
+                                            &intf->name);
+    if ( isOk )
+    {
+        dbus_message_iter_init(intf->props, &propsIt);
+        isOk = l2dbus_copyMessageIter(&propsIt, &entryIt);
+    }
+
+    if ( !dbus_message_iter_close_container(arrIt, &entryIt) )
+    {
+        isOk = L2DBUS_FALSE;
+    }
+
+    return isOk;
+}
+
+
+/* Appends an {oa{sa{sv}}} entry for the object to an open array */
+static l2dbus_Bool
+l2dbus_objMgrAppendObject
+    (
+    DBusMessageIter*        arrIt,
+    l2dbus_ObjMgrObject*    obj
+    )
+{
+    DBusMessageIter entryIt;
+    DBusMessageIter intfArrIt;
+    l2dbus_ObjMgrInterface* intf;
+    l2dbus_Bool isOk;
+
+    if ( !dbus_message_iter_open_container(arrIt, DBUS_TYPE_DICT_ENTRY, NULL,
+                                            &entryIt) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    isOk = dbus_message_iter_append_basic(&entryIt, DBUS_TYPE_OBJECT_PATH,
+                                        &obj->path) &&
+            dbus_message_iter_open_container(&entryIt, DBUS_TYPE_ARRAY,
+                                        "{sa{sv}}", &intfArrIt);
+    if ( isOk )
+    {
+        for ( intf = obj->interfaces; isOk && (NULL != intf); intf = intf->next )
+        {
+            isOk = l2dbus_objMgrAppendInterface(&intfArrIt, intf);
+        }
+
+        if ( !dbus_message_iter_close_container(&entryIt, &intfArrIt) )
+        {
+            isOk = L2DBUS_FALSE;
+        }
+    }
+
+    if ( !dbus_message_iter_close_container(arrIt, &entryIt) )
+    {
+        isOk = L2DBUS_FALSE;
+    }
+
+    return isOk;
+}
+
+
+static l2dbus_Bool
+l2dbus_objMgrAppendManagedObjects
+    (
+    l2dbus_ObjectManager*   mgr,
+    DBusMessage*            msg
+    )
+{
+    DBusMessageIter msgIt;
+    DBusMessageIter arrIt;
+    l2dbus_ObjMgrObject* obj;
+    l2dbus_Bool isOk;
+
+    dbus_message_iter_init_append(msg, &msgIt);
+    isOk = dbus_message_iter_open_container(&msgIt, DBUS_TYPE_ARRAY,
+                                            "{oa{sa{sv}}}", &arrIt);
+    if ( isOk )
+    {
+        TAILQ_FOREACH(obj, &mgr->objects, link)
+        {
+            if ( !l2dbus_objMgrAppendObject(&arrIt, obj) )
+            {
+                isOk = L2DBUS_FALSE;
+                break;
+            }
+        }
+
+        if ( !dbus_message_iter_close_container(&msgIt, &arrIt) )
+        {
+            isOk = L2DBUS_FALSE;
+        }
+    }
+
+    return isOk;
+}
+
+
+/* Sends a signal on the manager's connection (if there is one) */
+static void
+l2dbus_objMgrSend
+    (
+    lua_State*              L,
+    l2dbus_ObjectManager*   mgr,
+    DBusMessage*            msg
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_Bool queued;
+
+    if ( LUA_NOREF != mgr->connRef )
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, mgr->connRef);
+        connUd = (l2dbus_Connection*)l2dbus_isUserData(L, -1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+        if ( (NULL != connUd) && (NULL != connUd->conn) )
+        {
+            queued = dbus_connection_send(cdbus_connectionGetDBus(connUd->conn),
+                                        msg, NULL);
+            l2dbus_statsCountSent(&connUd->stats, msg, queued);
+            if ( !queued )
+            {
+                L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Failed to send %s signal",
+                            dbus_message_get_member(msg)));
+            }
+            else
+            {
+                l2dbus_traceRingRecord(connUd, msg, L2DBUS_TRACE_RING_SENT);
+            }
+        }
+        lua_pop(L, 1);
+    }
+}
+
+
+static DBusMessage*
+l2dbus_objMgrNewSignal
+    (
+    lua_State*              L,
+    l2dbus_ObjectManager*   mgr,
+    const char*             member
+    )
+{
+    DBusMessage* msg = dbus_message_new_signal(mgr->rootPath,
+                                    L2DBUS_INTERFACE_OBJECT_MANAGER, member);
+    if ( NULL == msg )
+    {
+        luaL_error(L, "failed to allocate %s signal", member);
+    }
+
+    /* The wrapper owns the message so it is released even on error */
+    l2dbus_messageWrap(L, msg, L2DBUS_FALSE);
+    return msg;
+}
+
+
+/* Marshals the Lua table of properties as an a{sv} snapshot */
+static DBusMessage*
+l2dbus_objMgrMarshalProps
+    (
+    lua_State*  L,
+    int         propsIdx
+    )
+{
+    DBusMessage* msg;
+
+    propsIdx = lua_absindex(L, propsIdx);
+    msg = dbus_message_new(DBUS_MESSAGE_TYPE_SIGNAL);
+    if ( NULL == msg )
+    {
+        luaL_error(L, "failed to allocate property snapshot");
+    }
+
+    l2dbus_messageWrap(L, msg, L2DBUS_FALSE);
+    l2dbus_transcodeLuaArgsToDbusBySignature(L, msg, propsIdx, 1, "a{sv}");
+
+    /* Leaves the wrapper (which owns the message) on the stack */
+    return msg;
+}
+
+
+/**
+ * @brief Handles requests for the ObjectManager interface.
+ *
+ * @return The D-Bus handler result.
+ */
+static DBusHandlerResult
+l2dbus_objMgrHandler
+    (
+        struct cdbus_Connection*    conn,
+        struct cdbus_Object*        obj,
+        DBusMessage*                msg,
+        void*                       userdata
+    )
+{
+    lua_State* L = l2dbus_callbackGetThread();
+    DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    l2dbus_ObjectManager* mgr;
+    DBusMessage* reply;
+
+    assert( NULL != L );
+
+    if ( dbus_message_is_method_call(msg, L2DBUS_INTERFACE_OBJECT_MANAGER,
+                                    "GetManagedObjects") )
+    {
+        /* Leaves the manager (or nil) on the stack */
+        mgr = (l2dbus_ObjectManager*)l2dbus_objectRegistryGet(L, userdata);
+        if ( NULL == mgr )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_WARN,
+                "Cannot enumerate objects because the manager has been GC'ed"));
+        }
+        else
+        {
+            rc = DBUS_HANDLER_RESULT_NEED_MEMORY;
+            reply = dbus_message_new_method_return(msg);
+            if ( NULL != reply )
+            {
+                if ( l2dbus_objMgrAppendManagedObjects(mgr, reply) &&
+                    dbus_connection_send(cdbus_connectionGetDBus(conn),
+                                        reply, NULL) )
+                {
+                    rc = DBUS_HANDLER_RESULT_HANDLED;
+                }
+                dbus_message_unref(reply);
+            }
+        }
+    }
+
+    /* Clean up the thread stack */
+    lua_settop(L, 0);
+
+    return rc;
+}
+
+
+static l2dbus_ObjectManager*
+l2dbus_objMgrCheck
+    (
+    lua_State*  L,
+    int         idx
+    )
+{
+    return (l2dbus_ObjectManager*)l2dbus_checkUserData(L, idx,
+                                        L2DBUS_OBJECT_MANAGER_TYPE_ID);
+}
+
+
+static const char*
+l2dbus_objMgrCheckPath
+    (
+    lua_State*              L,
+    l2dbus_ObjectManager*   mgr,
+    int                     idx
+    )
+{
+    const char* path = luaL_checkstring(L, idx);
+
+    if ( !l2dbus_validatePath(path) )
+    {
+        luaL_error(L, "invalid D-Bus object path (%s)", path);
+    }
+    if ( !l2dbus_objMgrIsManagedPath(mgr, path) )
+    {
+        luaL_error(L, "object path (%s) is not beneath the manager's root (%s)",
+                    path, mgr->rootPath);
+    }
+
+    return path;
+}
+
+
+/**
+ @function new
+
+ Creates a new ObjectManager.
+
+ @tparam string rootPath The object path of the service object that will
+ implement the ObjectManager interface. Only objects beneath this path can
+ be managed.
+ @treturn userdata The userdata object representing the ObjectManager.
+ */
+static int
+l2dbus_newObjectManager
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ObjectManager* mgr;
+    l2dbus_Interface* intfUd;
+    const char* rootPath;
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Create: object manager"));
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    rootPath = luaL_checkstring(L, 1);
+    if ( !l2dbus_validatePath(rootPath) )
+    {
+        luaL_error(L, "invalid D-Bus object path (%s)", rootPath);
+    }
+
+    mgr = (l2dbus_ObjectManager*)l2dbus_objectNew(L, sizeof(*mgr),
+                                            L2DBUS_OBJECT_MANAGER_TYPE_ID);
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Object manager userdata=%p", mgr));
+
+    mgr->intfRef = LUA_NOREF;
+    mgr->connRef = LUA_NOREF;
+    TAILQ_INIT(&mgr->objects);
+    mgr->rootPath = l2dbus_strDup(rootPath);
+    if ( NULL == mgr->rootPath )
+    {
+        luaL_error(L, "Failed to allocate object manager");
+    }
+
+    /* Create a (weak) mapping so the interface handler can find the
+     * manager.
+     */
+    l2dbus_objectRegistryAdd(L, mgr, -1);
+
+    intfUd = (l2dbus_Interface*)l2dbus_objectNew(L, sizeof(*intfUd),
+                                            L2DBUS_INTERFACE_TYPE_ID);
+    l2dbus_callbackInit(&intfUd->cbCtx);
+    intfUd->intf = cdbus_interfaceNew(L2DBUS_INTERFACE_OBJECT_MANAGER,
+                                    l2dbus_objMgrHandler, mgr);
+    if ( (NULL == intfUd->intf) ||
+        !cdbus_interfaceRegisterMethods(intfUd->intf, gObjMgrMethods,
+                sizeof(gObjMgrMethods) / sizeof(gObjMgrMethods[0])) ||
+        !cdbus_interfaceRegisterSignals(intfUd->intf, gObjMgrSignals,
+                sizeof(gObjMgrSignals) / sizeof(gObjMgrSignals[0])) )
+    {
+        luaL_error(L, "Failed to allocate object manager interface");
+    }
+    l2dbus_objectRegistryAdd(L, intfUd, -1);
+    mgr->intfRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the ObjectManager userdata.
+ *
+ * @return nil
+ */
+static int
+l2dbus_objMgrDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ObjectManager* mgr = l2dbus_objMgrCheck(L, 1);
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: object manager (userdata=%p)", mgr));
+
+    while ( !TAILQ_EMPTY(&mgr->objects) )
+    {
+        l2dbus_objMgrFreeObject(mgr, TAILQ_FIRST(&mgr->objects));
+    }
+    l2dbus_free(mgr->buckets);
+    mgr->buckets = NULL;
+    mgr->nBuckets = 0;
+    l2dbus_free(mgr->rootPath);
+    mgr->rootPath = NULL;
+
+    luaL_unref(L, LUA_REGISTRYINDEX, mgr->intfRef);
+    mgr->intfRef = LUA_NOREF;
+    luaL_unref(L, LUA_REGISTRYINDEX, mgr->connRef);
+    mgr->connRef = LUA_NOREF;
+
+    l2dbus_objectRegistryRemove(L, mgr);
+
+    return 0;
+}
+
+
+/**
+ * The L2DBUS ObjectManager class.
+ * @type ObjectManager
+ */
+
+/**
+ @function interface
+ @within ObjectManager
+
+ Returns the ObjectManager @{l2dbus.Interface|Interface}.
+
+ The interface should be @{l2dbus.ServiceObject.addInterface|added} to the
+ service object registered at the manager's root path.
+
+ @tparam userdata mgr The ObjectManager.
+ @treturn userdata The Interface implementing
+ org.freedesktop.DBus.ObjectManager.
+ */
+static int
+l2dbus_objMgrGetInterface
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ObjectManager* mgr = l2dbus_objMgrCheck(L, 1);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, mgr->intfRef);
+    return 1;
+}
+
+
+/**
+ @function setConnection
+ @within ObjectManager
+
+ Sets the connection used to emit InterfacesAdded/InterfacesRemoved.
+
+ @tparam userdata mgr The ObjectManager.
+ @tparam ?userdata|nil conn The @{l2dbus.Connection|Connection} to emit the
+ signals on or **nil** to stop emitting signals.
+ */
+static int
+l2dbus_objMgrSetConnection
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ObjectManager* mgr = l2dbus_objMgrCheck(L, 1);
+
+    if ( !lua_isnoneornil(L, 2) )
+    {
+        l2dbus_checkUserData(L, 2, L2DBUS_CONNECTION_TYPE_ID);
+    }
+
+    luaL_unref(L, LUA_REGISTRYINDEX, mgr->connRef);
+    mgr->connRef = LUA_NOREF;
+    if ( !lua_isnoneornil(L, 2) )
+    {
+        lua_pushvalue(L, 2);
+        mgr->connRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    return 0;
+}
+
+
+/**
+ @function addObject
+ @within ObjectManager
+
+ Adds an object (or more interfaces of an existing object).
+
+ The properties of each interface are marshalled as an *a{sv}* snapshot
+ which is used to answer *GetManagedObjects*. If an interface already
+ exists on the object its snapshot is replaced. An *InterfacesAdded*
+ signal listing the given interfaces is emitted if a connection is set.
+
+ @tparam userdata mgr The ObjectManager.
+ @tparam string path The object path. Must be beneath the manager's root.
+ @tparam table interfaces A table mapping interface names to tables of
+ property name/value pairs (e.g. { ["org.acme.Device"] = { Name = "x" } }).
+ */
+static int
+l2dbus_objMgrAddObject
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ObjectManager* mgr = l2dbus_objMgrCheck(L, 1);
+    const char* path = l2dbus_objMgrCheckPath(L, mgr, 2);
+    const char* intfName;
+    l2dbus_ObjMgrObject* obj;
+    l2dbus_ObjMgrInterface** link;
+    l2dbus_ObjMgrInterface* intf;
+    l2dbus_Message* msgUd;
+    DBusMessage* sigMsg;
+    DBusMessageIter msgIt;
+    DBusMessageIter arrIt;
+    l2dbus_Bool isOk;
+    int snapIdx;
+
+    luaL_checktype(L, 3, LUA_TTABLE);
+
+    /* Marshal all the snapshots first so an error leaves the manager
+     * unchanged.
+     */
+    lua_newtable(L);
+    snapIdx = lua_gettop(L);
+    lua_pushnil(L);
+    while ( lua_next(L, 3) )
+    {
+        intfName = lua_tostring(L, -2);
+        if ( (LUA_TSTRING != lua_type(L, -2)) ||
+            !l2dbus_validateInterface(intfName) )
+        {
+            luaL_error(L, "invalid D-Bus interface name in arg #3");
+        }
+        luaL_checktype(L, -1, LUA_TTABLE);
+        l2dbus_objMgrMarshalProps(L, -1);
+        lua_pushvalue(L, -3);
+        lua_insert(L, -2);
+        lua_rawset(L, snapIdx);
+        lua_pop(L, 1);
+    }
+
+    obj = l2dbus_objMgrFind(mgr, path);
+    if ( (NULL == obj) && (NULL == (obj = l2dbus_objMgrNewObject(mgr, path))) )
+    {
+        luaL_error(L, "failed to allocate managed object");
+    }
+
+    sigMsg = l2dbus_objMgrNewSignal(L, mgr, "InterfacesAdded");
+    dbus_message_iter_init_append(sigMsg, &msgIt);
+    isOk = dbus_message_iter_append_basic(&msgIt, DBUS_TYPE_OBJECT_PATH, &path) &&
+            dbus_message_iter_open_container(&msgIt, DBUS_TYPE_ARRAY,
+                                            "{sa{sv}}", &arrIt);
+
+    lua_pushnil(L);
+    while ( lua_next(L, snapIdx) )
+    {
+        intfName = lua_tostring(L, -2);
+        msgUd = (l2dbus_Message*)lua_touserdata(L, -1);
+        link = l2dbus_objMgrFindInterface(obj, intfName);
+        if ( NULL != *link )
+        {
+            intf = *link;
+            dbus_message_unref(intf->props);
+        }
+        else
+        {
+            intf = (l2dbus_ObjMgrInterface*)l2dbus_calloc(1, sizeof(*intf));
+            if ( (NULL == intf) ||
+                (NULL == (intf->name = l2dbus_strIntern(intfName))) )
+            {
+                l2dbus_free(intf);
+                luaL_error(L, "failed to allocate managed interface");
+            }
+            *link = intf;
+        }
+        intf->props = dbus_message_ref(msgUd->msg);
+        isOk = isOk && l2dbus_objMgrAppendInterface(&arrIt, intf);
+        lua_pop(L, 1);
+    }
+
+    if ( isOk && dbus_message_iter_close_container(&msgIt, &arrIt) )
+    {
+        l2dbus_objMgrSend(L, mgr, sigMsg);
+    }
+    else
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Failed to build InterfacesAdded signal"));
+    }
+
+    return 0;
+}
+
+
+/**
+ @function updateProperties
+ @within ObjectManager
+
+ Replaces the property snapshot of an interface of a managed object.
+
+ No signal is emitted. Services should emit PropertiesChanged themselves.
+
+ @tparam userdata mgr The ObjectManager.
+ @tparam string path The object path.
+ @tparam string interface The interface name.
+ @tparam table props A table of property name/value pairs.
+ @treturn bool Returns **true** if the snapshot was replaced or **false**
+ if the object does not implement the interface.
+ */
+static int
+l2dbus_objMgrUpdateProperties
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ObjectManager* mgr = l2dbus_objMgrCheck(L, 1);
+    const char* path = luaL_checkstring(L, 2);
+    const char* intfName = luaL_checkstring(L, 3);
+    l2dbus_ObjMgrObject* obj;
+    l2dbus_ObjMgrInterface** link = NULL;
+    DBusMessage* msg;
+
+    luaL_checktype(L, 4, LUA_TTABLE);
+
+    obj = l2dbus_objMgrFind(mgr, path);
+    if ( NULL != obj )
+    {
+        link = l2dbus_objMgrFindInterface(obj, intfName);
+    }
+
+    if ( (NULL == link) || (NULL == *link) )
+    {
+        lua_pushboolean(L, L2DBUS_FALSE);
+    }
+    else
+    {
+        msg = l2dbus_objMgrMarshalProps(L, 4);
+        dbus_message_unref((*link)->props);
+        (*link)->props = dbus_message_ref(msg);
+        lua_pushboolean(L, L2DBUS_TRUE);
+    }
+
+    return 1;
+}
+
+
+/* Removes interfaces of an object and emits InterfacesRemoved. If names
+ * is zero then all the interfaces are removed.
+ */
+static int
+l2dbus_objMgrRemove
+    (
+    lua_State*              L,
+    l2dbus_ObjectManager*   mgr,
+    const char*             path,
+    int                     namesIdx
+    )
+{
+    l2dbus_ObjMgrObject* obj = l2dbus_objMgrFind(mgr, path);
+    l2dbus_ObjMgrInterface** link;
+    l2dbus_ObjMgrInterface* intf;
+    DBusMessage* sigMsg;
+    DBusMessageIter msgIt;
+    DBusMessageIter arrIt;
+    l2dbus_Bool isOk;
+    int nRemoved = 0;
+    int nNames;
+    int idx;
+
+    if ( NULL == obj )
+    {
+        return 0;
+    }
+
+    sigMsg = l2dbus_objMgrNewSignal(L, mgr, "InterfacesRemoved");
+    dbus_message_iter_init_append(sigMsg, &msgIt);
+    isOk = dbus_message_iter_append_basic(&msgIt, DBUS_TYPE_OBJECT_PATH, &path) &&
+            dbus_message_iter_open_container(&msgIt, DBUS_TYPE_ARRAY,
+                                            DBUS_TYPE_STRING_AS_STRING, &arrIt);
+
+    nNames = (0 != namesIdx) ? (int)lua_rawlen(L, namesIdx) : 0;
+    for ( idx = 1; (0 == namesIdx) || (idx <= nNames); ++idx )
+    {
+        if ( 0 == namesIdx )
+        {
+            link = &obj->interfaces;
+            if ( NULL == *link )
+            {
+                break;
+            }
+        }
+        else
+        {
+            lua_rawgeti(L, namesIdx, idx);
+            link = l2dbus_objMgrFindInterface(obj, luaL_checkstring(L, -1));
+            lua_pop(L, 1);
+            if ( NULL == *link )
+            {
+                continue;
+            }
+        }
+
+        intf = *link;
+        *link = intf->next;
+        isOk = isOk && dbus_message_iter_append_basic(&arrIt, DBUS_TYPE_STRING,
+                                                    &intf->name);
+        l2dbus_objMgrFreeInterface(intf);
+        nRemoved++;
+    }
+
+    if ( NULL == obj->interfaces )
+    {
+        l2dbus_objMgrFreeObject(mgr, obj);
+    }
+
+    if ( (0 < nRemoved) && isOk && dbus_message_iter_close_container(&msgIt, &arrIt) )
+    {
+        l2dbus_objMgrSend(L, mgr, sigMsg);
+    }
+
+    return nRemoved;
+}
+
+
+/**
+ @function removeInterfaces
+ @within ObjectManager
+
+ Removes interfaces from a managed object.
+
+ The object itself is removed once it has no interfaces left. An
+ *InterfacesRemoved* signal is emitted if a connection is set.
+
+ @tparam userdata mgr The ObjectManager.
+ @tparam string path The object path.
+ @tparam table interfaces An array of interface names to remove.
+ @treturn number The number of interfaces removed.
+ */
+static int
+l2dbus_objMgrRemoveInterfaces
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ObjectManager* mgr = l2dbus_objMgrCheck(L, 1);
+    const char* path = luaL_checkstring(L, 2);
+
+    luaL_checktype(L, 3, LUA_TTABLE);
+    lua_pushinteger(L, l2dbus_objMgrRemove(L, mgr, path, 3));
+    return 1;
+}
+
+
+/**
+ @function removeObject
+ @within ObjectManager
+
+ Removes a managed object and all its interfaces.
+
+ An *InterfacesRemoved* signal is emitted if a connection is set.
+
+ @tparam userdata mgr The ObjectManager.
+ @tparam string path The object path.
+ @treturn bool Returns **true** if the object was managed.
+ */
+static int
+l2dbus_objMgrRemoveObject
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ObjectManager* mgr = l2dbus_objMgrCheck(L, 1);
+    const char* path = luaL_checkstring(L, 2);
+
+    lua_pushboolean(L, 0 < l2dbus_objMgrRemove(L, mgr, path, 0));
+    return 1;
+}
+
+
+/**
+ @function count
+ @within ObjectManager
+
+ Returns the number of managed objects.
+
+ @tparam userdata mgr The ObjectManager.
+ @treturn number The number of managed objects.
+ */
+static int
+l2dbus_objMgrCount
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ObjectManager* mgr = l2dbus_objMgrCheck(L, 1);
+
+    lua_pushinteger(L, (lua_Integer)mgr->nObjects);
+    return 1;
+}
+
+
+/**
+ @function getManagedObjects
+ @within ObjectManager
+
+ Returns the managed objects as a Lua table.
+
+ The table has the same layout as the reply to *GetManagedObjects*: it maps
+ object paths to tables of interfaces which in turn map to their properties.
+
+ @tparam userdata mgr The ObjectManager.
+ @treturn table The managed objects.
+ */
+static int
+l2dbus_objMgrGetManagedObjects
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ObjectManager* mgr = l2dbus_objMgrCheck(L, 1);
+    l2dbus_TranscodeOpts opts;
+    DBusMessage* msg;
+
+    memset(&opts, 0, sizeof(opts));
+    msg = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_RETURN);
+    if ( NULL == msg )
+    {
+        luaL_error(L, "failed to allocate D-Bus message");
+    }
+    l2dbus_messageWrap(L, msg, L2DBUS_FALSE);
+
+    if ( !l2dbus_objMgrAppendManagedObjects(mgr, msg) )
+    {
+        luaL_error(L, "failed to marshal the managed objects");
+    }
+
+    l2dbus_transcodeDbusArgsToLua(L, msg, &opts);
+    return 1;
+}
+
+
+/*
+ * Define the methods of the ObjectManager class
+ */
+static const luaL_Reg l2dbus_objMgrMetaTable[] = {
+    {"interface", l2dbus_objMgrGetInterface},
+    {"setConnection", l2dbus_objMgrSetConnection},
+    {"addObject", l2dbus_objMgrAddObject},
+    {"updateProperties", l2dbus_objMgrUpdateProperties},
+    {"removeInterfaces", l2dbus_objMgrRemoveInterfaces},
+    {"removeObject", l2dbus_objMgrRemoveObject},
+    {"count", l2dbus_objMgrCount},
+    {"getManagedObjects", l2dbus_objMgrGetManagedObjects},
+    {"__gc", l2dbus_objMgrDispose},
+    {NULL, NULL},
+};
+
+
+/**
+ * @brief Creates the ObjectManager sub-module.
+ *
+ * This function creates a metatable entry for the ObjectManager userdata
+ * and simulates opening the ObjectManager sub-module.
+ *
+ * @return A table defining the ObjectManager sub-module.
+ *
+ */
+void
+l2dbus_openObjectManager
+    (
+    lua_State*  L
+    )
+{
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_OBJECT_MANAGER_TYPE_ID,
+            l2dbus_objMgrMetaTable));
+    lua_newtable(L);
+    lua_pushcfunction(L, l2dbus_newObjectManager);
+    lua_setfield(L, -2, "new");
+}
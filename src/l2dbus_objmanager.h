@@ -0,0 +1,79 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_objmanager.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the native ObjectManager interface.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_OBJMANAGER_H_
+#define L2DBUS_OBJMANAGER_H_
+
+#include "lua.h"
+#include "queue.h"
+#include "l2dbus_types.h"
+
+/* Forward declarations */
+struct DBusMessage;
+
+#define L2DBUS_INTERFACE_OBJECT_MANAGER     "org.freedesktop.DBus.ObjectManager"
+
+/* The cached properties of one interface of a managed object */
+typedef struct l2dbus_ObjMgrInterface
+{
+    struct l2dbus_ObjMgrInterface*  next;
+    /* Interned in the string pool of the context */
+    const char*                     name;
+    /* A message holding a single a{sv} argument */
+    struct DBusMessage*             props;
+} l2dbus_ObjMgrInterface;
+
+typedef struct l2dbus_ObjMgrObject
+{
+    struct l2dbus_ObjMgrObject*         hashNext;
+    TAILQ_ENTRY(l2dbus_ObjMgrObject)    link;
+    unsigned                            hash;
+    char*                               path;
+    l2dbus_ObjMgrInterface*             interfaces;
+} l2dbus_ObjMgrObject;
+
+typedef struct l2dbus_ObjectManager
+{
+    char*                               rootPath;
+    int                                 intfRef;
+    int                                 connRef;
+    l2dbus_ObjMgrObject**               buckets;
+    unsigned                            nBuckets;
+    unsigned                            nObjects;
+    TAILQ_HEAD(l2dbus_ObjMgrHead,
+                l2dbus_ObjMgrObject)    objects;
+} l2dbus_ObjectManager;
+
+void l2dbus_openObjectManager(lua_State* L);
+
+#endif /* Guard for L2DBUS_OBJMANAGER_H_ */
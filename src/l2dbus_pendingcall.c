@@ -45,7 +45,9 @@
 #include "l2dbus_trace.h"
 #include "l2dbus_debug.h"
 #include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
 #include "l2dbus_message.h"
+#include "l2dbus_stats.h"
 #include "lualib.h"
 
 /**
@@ -79,6 +81,8 @@ l2dbus_pendingCallHandler
     lua_State* L = l2dbus_callbackGetThread();
     const char* errMsg = "";
     l2dbus_PendingCall* ud = l2dbus_objectRegistryGet(L, user);
+    double cbStart;
+    int status;
 
     /* Nil or the PendingCall userdata is sitting at the top of the
      * stack at this point.
@@ -97,12 +101,18 @@ l2dbus_pendingCallHandler
     }
     else
     {
+        /* The round-trip time includes a reply that timed out */
+        l2dbus_statsRecord(L2DBUS_STATS_HIST_PENDING_RTT, ud->sentAt);
+
         // Push function and user value on the stack and execute the callback
         lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.funcRef);
         lua_pushvalue(L, -2 /* PendingCall ud */);
         lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.userRef);
 
-        if ( 0 != lua_pcall(L, 2 /* nArgs */, 0, 0) )
+        cbStart = l2dbus_statsCallbackStart(L, 2 /* nArgs */);
+        status = lua_pcall(L, 2 /* nArgs */, 0, 0);
+        l2dbus_statsCallback(L2DBUS_STATS_CB_PENDING_CALL, cbStart, status);
+        if ( 0 != status )
         {
             if ( lua_isstring(L, -1) )
             {
@@ -114,6 +124,9 @@ l2dbus_pendingCallHandler
 
     /* Clean up the thread stack */
     lua_settop(L, 0);
+
+    /* Reclaim any transient allocations made while servicing the callback */
+    l2dbus_arenaReset();
 }
 
 
@@ -158,6 +171,7 @@ l2dbus_newPendingCall
         /* Reset the userdata structure */
         l2dbus_callbackInit(&pcUd->cbCtx);
         pcUd->pendingCall = dbusPending;
+        pcUd->sentAt = l2dbus_statsStart();
         /* Add a reference to the connection userdata */
         lua_pushvalue(L, connIdx);
         pcUd->connRef = luaL_ref(L, LUA_REGISTRYINDEX);
@@ -204,8 +218,8 @@ l2dbus_pendingCallSetNotify
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    ud = (l2dbus_PendingCall*)luaL_checkudata(L, 1,
-                                              L2DBUS_PENDING_CALL_MTBL_NAME);
+    ud = (l2dbus_PendingCall*)l2dbus_checkUserData(L, 1,
+                                              L2DBUS_PENDING_CALL_TYPE_ID);
     luaL_checktype(L, 2, LUA_TFUNCTION);
 
     if ( 2 < lua_gettop(L) )
@@ -266,8 +280,8 @@ l2dbus_pendingCallCancel
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    ud = (l2dbus_PendingCall*)luaL_checkudata(L, 1,
-                                                L2DBUS_PENDING_CALL_MTBL_NAME);
+    ud = (l2dbus_PendingCall*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_PENDING_CALL_TYPE_ID);
 
     dbus_pending_call_cancel(ud->pendingCall);
     l2dbus_callbackUnref(L, &ud->cbCtx);
@@ -299,8 +313,8 @@ l2dbus_pendingCallIsCompleted
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    ud = (l2dbus_PendingCall*)luaL_checkudata(L, 1,
-                                              L2DBUS_PENDING_CALL_MTBL_NAME);
+    ud = (l2dbus_PendingCall*)l2dbus_checkUserData(L, 1,
+                                              L2DBUS_PENDING_CALL_TYPE_ID);
 
     if ( dbus_pending_call_get_completed(ud->pendingCall) )
     {
@@ -341,8 +355,8 @@ l2dbus_pendingCallStealReply
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    ud = (l2dbus_PendingCall*)luaL_checkudata(L, 1,
-                                              L2DBUS_PENDING_CALL_MTBL_NAME);
+    ud = (l2dbus_PendingCall*)l2dbus_checkUserData(L, 1,
+                                              L2DBUS_PENDING_CALL_TYPE_ID);
 
     msg = dbus_pending_call_steal_reply(ud->pendingCall);
     if ( NULL != msg )
@@ -391,8 +405,8 @@ l2dbus_pendingCallBlock
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
-    ud = (l2dbus_PendingCall*)luaL_checkudata(L, 1,
-                                              L2DBUS_PENDING_CALL_MTBL_NAME);
+    ud = (l2dbus_PendingCall*)l2dbus_checkUserData(L, 1,
+                                              L2DBUS_PENDING_CALL_TYPE_ID);
 
     dbus_pending_call_block(ud->pendingCall);
 
@@ -415,8 +429,8 @@ l2dbus_pendingCallDispose
     lua_State*  L
     )
 {
-    l2dbus_PendingCall* ud = (l2dbus_PendingCall*)luaL_checkudata(L, 1,
-                                            L2DBUS_PENDING_CALL_MTBL_NAME);
+    l2dbus_PendingCall* ud = (l2dbus_PendingCall*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_PENDING_CALL_TYPE_ID);
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: pending call (userdata=%p)", ud));
 
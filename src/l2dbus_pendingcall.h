@@ -45,6 +45,8 @@ typedef struct l2dbus_PendingCall
     struct DBusPendingCall* pendingCall;
     int                     connRef;
     l2dbus_CallbackCtx      cbCtx;
+    /* When the request was sent (zero if not being timed) */
+    double                  sentAt;
 } l2dbus_PendingCall;
 
 int l2dbus_newPendingCall(lua_State* L, struct DBusPendingCall* pc,
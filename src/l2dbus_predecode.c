@@ -0,0 +1,1334 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_predecode.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the background decoding of matched messages.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <assert.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_predecode.h"
+#include "l2dbus_dispatcher.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_match.h"
+#include "l2dbus_message.h"
+#include "l2dbus_transcode.h"
+#include "l2dbus_int64.h"
+#include "l2dbus_uint64.h"
+#include "l2dbus_callback.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_stats.h"
+#include "lauxlib.h"
+
+/*
+ * The tags of the flattened message arguments. Every value starts with a
+ * tag byte followed by its (unaligned) payload:
+ *
+ *   NUMBER         double
+ *   BOOLEAN        uint8_t
+ *   INT64/UINT64   int64_t/uint64_t
+ *   STRING         uint32_t length, bytes (not terminated)
+ *   FIXED_ARRAY    uint8_t D-Bus element type, uint32_t count, packed elements
+ *   ARRAY          uint32_t count, values (also used for structures)
+ *   DICT           uint32_t count, key/value pairs
+ *
+ * The buffer starts with the uint32_t count of top-level arguments. It
+ * holds no pointers so it can be built on one thread and read on another.
+ */
+#define L2DBUS_FLAT_NUMBER          ('d')
+#define L2DBUS_FLAT_BOOLEAN         ('b')
+#define L2DBUS_FLAT_INT64           ('x')
+#define L2DBUS_FLAT_UINT64          ('t')
+#define L2DBUS_FLAT_STRING          ('s')
+#define L2DBUS_FLAT_FIXED_ARRAY     ('f')
+#define L2DBUS_FLAT_ARRAY           ('a')
+#define L2DBUS_FLAT_DICT            ('e')
+
+/* The initial size of a flattened argument buffer */
+#define L2DBUS_FLAT_INITIAL_SIZE    (256U)
+
+/* A growable buffer of flattened arguments */
+typedef struct l2dbus_FlatWriter
+{
+    unsigned char*  data;
+    size_t          len;
+    size_t          cap;
+    l2dbus_Bool     failed;
+} l2dbus_FlatWriter;
+
+
+/**
+ * @brief Opens a descriptor pair used to wake up the other side of a ring.
+ *
+ * On Linux an eventfd is used for both ends, elsewhere a non-blocking pipe.
+ *
+ * @param [out] fd  The read (index 0) and write (index 1) descriptors.
+ * @return L2DBUS_TRUE if the descriptors were opened.
+ */
+static l2dbus_Bool
+l2dbus_predecodeOpenSignal
+    (
+    int fd[2]
+    )
+{
+#if defined(__linux__)
+    fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    fd[1] = fd[0];
+    return (fd[0] >= 0) ? L2DBUS_TRUE : L2DBUS_FALSE;
+#else
+    l2dbus_Bool failed;
+    int idx;
+
+    failed = (0 != pipe(fd));
+    for ( idx = 0; !failed && (idx < 2); ++idx )
+    {
+        failed = (0 != fcntl(fd[idx], F_SETFL,
+                        fcntl(fd[idx], F_GETFL) | O_NONBLOCK)) ||
+                (0 != fcntl(fd[idx], F_SETFD, FD_CLOEXEC));
+    }
+    return failed ? L2DBUS_FALSE : L2DBUS_TRUE;
+#endif
+}
+
+
+/**
+ * @brief Closes a descriptor pair opened by l2dbus_predecodeOpenSignal.
+ *
+ * @param [in] fd   The read and write descriptors.
+ */
+static void
+l2dbus_predecodeCloseSignal
+    (
+    int fd[2]
+    )
+{
+    if ( fd[0] >= 0 )
+    {
+        close(fd[0]);
+    }
+
+    if ( (fd[1] >= 0) && (fd[1] != fd[0]) )
+    {
+        close(fd[1]);
+    }
+
+    fd[0] = -1;
+    fd[1] = -1;
+}
+
+
+/**
+ * @brief Wakes up the consumer of a ring.
+ *
+ * @param [in] fd   The write descriptor of the ring's signal.
+ */
+static void
+l2dbus_predecodeSignal
+    (
+    int fd
+    )
+{
+    const uint64_t token = 1;
+    ssize_t n;
+
+    do
+    {
+        n = write(fd, &token, sizeof(token));
+    }
+    while ( (n < 0) && (EINTR == errno) );
+
+    /* A full pipe (or counter) means the consumer has already been signaled */
+}
+
+
+/**
+ * @brief Clears any pending wake-up of a ring.
+ *
+ * @param [in] fd   The read descriptor of the ring's signal.
+ */
+static void
+l2dbus_predecodeClearSignal
+    (
+    int fd
+    )
+{
+    char buf[64];
+    ssize_t n;
+
+    do
+    {
+        n = read(fd, buf, sizeof(buf));
+    }
+    while ( (n > 0) || ((n < 0) && (EINTR == errno)) );
+}
+
+
+/**
+ * @brief Reserves room at the end of a flattened argument buffer.
+ *
+ * @param [in] w    The buffer.
+ * @param [in] n    The number of bytes to reserve.
+ * @return A pointer to the reserved bytes or NULL if the buffer could not
+ * be grown (which marks the buffer as failed).
+ */
+static unsigned char*
+l2dbus_flatReserve
+    (
+    l2dbus_FlatWriter*  w,
+    size_t              n
+    )
+{
+    unsigned char* p;
+    size_t newCap;
+
+    if ( w->failed )
+    {
+        return NULL;
+    }
+
+    if ( w->len + n > w->cap )
+    {
+        newCap = (0 == w->cap) ? L2DBUS_FLAT_INITIAL_SIZE : w->cap * 2;
+        while ( newCap < w->len + n )
+        {
+            newCap *= 2;
+        }
+
+        p = (unsigned char*)l2dbus_realloc(w->data, newCap);
+        if ( NULL == p )
+        {
+            w->failed = L2DBUS_TRUE;
+            return NULL;
+        }
+        w->data = p;
+        w->cap = newCap;
+    }
+
+    p = w->data + w->len;
+    w->len += n;
+
+    return p;
+}
+
+
+/* Appends bytes to a flattened argument buffer */
+static void
+l2dbus_flatPut
+    (
+    l2dbus_FlatWriter*  w,
+    const void*         src,
+    size_t              n
+    )
+{
+    unsigned char* p = l2dbus_flatReserve(w, n);
+
+    if ( (NULL != p) && (0 < n) )
+    {
+        memcpy(p, src, n);
+    }
+}
+
+
+/* Appends a tag byte to a flattened argument buffer */
+static void
+l2dbus_flatPutTag
+    (
+    l2dbus_FlatWriter*  w,
+    unsigned char       tag
+    )
+{
+    l2dbus_flatPut(w, &tag, sizeof(tag));
+}
+
+
+/* Appends a number to a flattened argument buffer */
+static void
+l2dbus_flatPutNumber
+    (
+    l2dbus_FlatWriter*  w,
+    double              value
+    )
+{
+    l2dbus_flatPutTag(w, L2DBUS_FLAT_NUMBER);
+    l2dbus_flatPut(w, &value, sizeof(value));
+}
+
+
+/* Appends a count placeholder and returns its offset */
+static size_t
+l2dbus_flatOpenCount
+    (
+    l2dbus_FlatWriter*  w
+    )
+{
+    const uint32_t count = 0;
+    size_t offset = w->len;
+
+    l2dbus_flatPut(w, &count, sizeof(count));
+
+    return offset;
+}
+
+
+/* Fills in a count placeholder */
+static void
+l2dbus_flatCloseCount
+    (
+    l2dbus_FlatWriter*  w,
+    size_t              offset,
+    uint32_t            count
+    )
+{
+    if ( !w->failed )
+    {
+        memcpy(w->data + offset, &count, sizeof(count));
+    }
+}
+
+
+/**
+ * @brief Flattens the value a D-Bus iterator points at.
+ *
+ * Runs on the decoder thread so it must not touch any Lua state. The
+ * buffer is marked failed for types that can only be decoded on the Lua
+ * thread (i.e. Unix file descriptors).
+ *
+ * @param [in] w    The buffer the value is appended to.
+ * @param [in] iter The D-Bus iterator.
+ */
+static void
+l2dbus_predecodeFlattenValue
+    (
+    l2dbus_FlatWriter*  w,
+    DBusMessageIter*    iter
+    )
+{
+    uint8_t uint8Value;
+    dbus_bool_t boolValue;
+    int16_t int16Value;
+    uint16_t uint16Value;
+    int32_t int32Value;
+    uint32_t uint32Value;
+    dbus_int64_t int64Value;
+    dbus_uint64_t uint64Value;
+    double doubleValue;
+    const char* strValue;
+    const void* data;
+    int nElts;
+    int elemType;
+    size_t eltSize;
+    size_t countAt;
+    uint32_t count;
+    DBusMessageIter subIter;
+
+    switch ( dbus_message_iter_get_arg_type(iter) )
+    {
+        case DBUS_TYPE_BYTE:
+            dbus_message_iter_get_basic(iter, &uint8Value);
+            l2dbus_flatPutNumber(w, uint8Value);
+            break;
+
+        case DBUS_TYPE_BOOLEAN:
+            dbus_message_iter_get_basic(iter, &boolValue);
+            l2dbus_flatPutTag(w, L2DBUS_FLAT_BOOLEAN);
+            uint8Value = boolValue ? 1U : 0U;
+            l2dbus_flatPut(w, &uint8Value, sizeof(uint8Value));
+            break;
+
+        case DBUS_TYPE_INT16:
+            dbus_message_iter_get_basic(iter, &int16Value);
+            l2dbus_flatPutNumber(w, int16Value);
+            break;
+
+        case DBUS_TYPE_UINT16:
+            dbus_message_iter_get_basic(iter, &uint16Value);
+            l2dbus_flatPutNumber(w, uint16Value);
+            break;
+
+        case DBUS_TYPE_INT32:
+            dbus_message_iter_get_basic(iter, &int32Value);
+            l2dbus_flatPutNumber(w, int32Value);
+            break;
+
+        case DBUS_TYPE_UINT32:
+            dbus_message_iter_get_basic(iter, &uint32Value);
+            l2dbus_flatPutNumber(w, uint32Value);
+            break;
+
+        case DBUS_TYPE_DOUBLE:
+            dbus_message_iter_get_basic(iter, &doubleValue);
+            l2dbus_flatPutNumber(w, doubleValue);
+            break;
+
+        case DBUS_TYPE_INT64:
+            dbus_message_iter_get_basic(iter, &int64Value);
+            l2dbus_flatPutTag(w, L2DBUS_FLAT_INT64);
+            l2dbus_flatPut(w, &int64Value, sizeof(int64Value));
+            break;
+
+        case DBUS_TYPE_UINT64:
+            dbus_message_iter_get_basic(iter, &uint64Value);
+            l2dbus_flatPutTag(w, L2DBUS_FLAT_UINT64);
+            l2dbus_flatPut(w, &uint64Value, sizeof(uint64Value));
+            break;
+
+        case DBUS_TYPE_STRING:
+        case DBUS_TYPE_OBJECT_PATH:
+        case DBUS_TYPE_SIGNATURE:
+            dbus_message_iter_get_basic(iter, &strValue);
+            count = (uint32_t)strlen(strValue);
+            l2dbus_flatPutTag(w, L2DBUS_FLAT_STRING);
+            l2dbus_flatPut(w, &count, sizeof(count));
+            l2dbus_flatPut(w, strValue, count);
+            break;
+
+        case DBUS_TYPE_ARRAY:
+            elemType = dbus_message_iter_get_element_type(iter);
+            dbus_message_iter_recurse(iter, &subIter);
+            eltSize = l2dbus_transcodeFixedTypeSize(elemType);
+            if ( 0 != eltSize )
+            {
+                data = NULL;
+                nElts = 0;
+                dbus_message_iter_get_fixed_array(&subIter, &data, &nElts);
+                l2dbus_flatPutTag(w, L2DBUS_FLAT_FIXED_ARRAY);
+                uint8Value = (uint8_t)elemType;
+                l2dbus_flatPut(w, &uint8Value, sizeof(uint8Value));
+                count = (uint32_t)nElts;
+                l2dbus_flatPut(w, &count, sizeof(count));
+                l2dbus_flatPut(w, data, (size_t)nElts * eltSize);
+                break;
+            }
+
+            l2dbus_flatPutTag(w, (DBUS_TYPE_DICT_ENTRY == elemType) ?
+                                L2DBUS_FLAT_DICT : L2DBUS_FLAT_ARRAY);
+            countAt = l2dbus_flatOpenCount(w);
+            count = 0;
+            while ( !w->failed && (DBUS_TYPE_INVALID !=
+                dbus_message_iter_get_arg_type(&subIter)) )
+            {
+                l2dbus_predecodeFlattenValue(w, &subIter);
+                ++count;
+                dbus_message_iter_next(&subIter);
+            }
+            l2dbus_flatCloseCount(w, countAt, count);
+            break;
+
+        case DBUS_TYPE_STRUCT:
+            l2dbus_flatPutTag(w, L2DBUS_FLAT_ARRAY);
+            countAt = l2dbus_flatOpenCount(w);
+            count = 0;
+            dbus_message_iter_recurse(iter, &subIter);
+            while ( !w->failed && (DBUS_TYPE_INVALID !=
+                dbus_message_iter_get_arg_type(&subIter)) )
+            {
+                l2dbus_predecodeFlattenValue(w, &subIter);
+                ++count;
+                dbus_message_iter_next(&subIter);
+            }
+            l2dbus_flatCloseCount(w, countAt, count);
+            break;
+
+        case DBUS_TYPE_VARIANT:
+            /* Variants decode to their contained value */
+            dbus_message_iter_recurse(iter, &subIter);
+            l2dbus_predecodeFlattenValue(w, &subIter);
+            break;
+
+        case DBUS_TYPE_DICT_ENTRY:
+            dbus_message_iter_recurse(iter, &subIter);
+            l2dbus_predecodeFlattenValue(w, &subIter);
+            if ( !dbus_message_iter_next(&subIter) )
+            {
+                w->failed = L2DBUS_TRUE;
+            }
+            else
+            {
+                l2dbus_predecodeFlattenValue(w, &subIter);
+            }
+            break;
+
+        default:
+            /* Unix file descriptors are duplicated when they are read and
+             * must be held by the message on the Lua thread.
+             */
+            w->failed = L2DBUS_TRUE;
+            break;
+    }
+}
+
+
+/**
+ * @brief Flattens the arguments of the message of an item.
+ *
+ * If the arguments cannot be flattened the item is left undecoded and
+ * the Lua thread falls back to decoding the message itself.
+ *
+ * @param [in] item The item to decode.
+ */
+static void
+l2dbus_predecodeFlatten
+    (
+    l2dbus_PredecodeItem*   item
+    )
+{
+    l2dbus_FlatWriter w;
+    DBusMessageIter iter;
+    size_t countAt;
+    uint32_t count = 0;
+
+    memset(&w, 0, sizeof(w));
+    countAt = l2dbus_flatOpenCount(&w);
+    if ( dbus_message_iter_init(item->msg, &iter) )
+    {
+        while ( !w.failed && (DBUS_TYPE_INVALID !=
+            dbus_message_iter_get_arg_type(&iter)) )
+        {
+            l2dbus_predecodeFlattenValue(&w, &iter);
+            ++count;
+            dbus_message_iter_next(&iter);
+        }
+    }
+    l2dbus_flatCloseCount(&w, countAt, count);
+
+    if ( w.failed )
+    {
+        l2dbus_free(w.data);
+        item->flat = NULL;
+        item->flatLen = 0;
+        item->decoded = L2DBUS_FALSE;
+    }
+    else
+    {
+        item->flat = w.data;
+        item->flatLen = w.len;
+        item->decoded = L2DBUS_TRUE;
+    }
+}
+
+
+/**
+ * @brief Takes the next item handed to the decoder thread.
+ *
+ * @param [in] pd   The decoder.
+ * @return The next item or NULL if there is none.
+ */
+static l2dbus_PredecodeItem*
+l2dbus_predecodeTakeTodo
+    (
+    l2dbus_Predecoder*  pd
+    )
+{
+    l2dbus_PredecodeItem* item;
+    unsigned head;
+    unsigned tail;
+
+    head = __atomic_load_n(&pd->todoHead, __ATOMIC_RELAXED);
+    tail = __atomic_load_n(&pd->todoTail, __ATOMIC_SEQ_CST);
+    if ( head == tail )
+    {
+        /* Clear the signal before checking one last time so an item
+         * submitted in between is either seen now or signaled again.
+         */
+        l2dbus_predecodeClearSignal(pd->todoFd[0]);
+        tail = __atomic_load_n(&pd->todoTail, __ATOMIC_SEQ_CST);
+    }
+
+    if ( head == tail )
+    {
+        return NULL;
+    }
+
+    item = pd->todo[head & pd->mask];
+    __atomic_store_n(&pd->todoHead, head + 1U, __ATOMIC_SEQ_CST);
+
+    return item;
+}
+
+
+/**
+ * @brief Hands a decoded item back to the Lua thread.
+ *
+ * There is always room in the ring since no more items than it can hold
+ * are ever in flight.
+ *
+ * @param [in] pd   The decoder.
+ * @param [in] item The decoded item.
+ */
+static void
+l2dbus_predecodeGiveDone
+    (
+    l2dbus_Predecoder*      pd,
+    l2dbus_PredecodeItem*   item
+    )
+{
+    unsigned tail = __atomic_load_n(&pd->doneTail, __ATOMIC_RELAXED);
+
+    pd->done[tail & pd->mask] = item;
+    __atomic_store_n(&pd->doneTail, tail + 1U, __ATOMIC_SEQ_CST);
+
+    /* If the Lua thread has caught up it may be waiting for a signal */
+    if ( __atomic_load_n(&pd->doneHead, __ATOMIC_SEQ_CST) == tail )
+    {
+        l2dbus_predecodeSignal(pd->doneFd[1]);
+    }
+}
+
+
+/**
+ * @brief The entry point of the decoder thread.
+ *
+ * @param [in] data The decoder.
+ * @return Always NULL.
+ */
+static void*
+l2dbus_predecodeThread
+    (
+    void*   data
+    )
+{
+    l2dbus_Predecoder* pd = (l2dbus_Predecoder*)data;
+    l2dbus_PredecodeItem* item;
+    struct pollfd pfd;
+
+    for ( ;; )
+    {
+        item = l2dbus_predecodeTakeTodo(pd);
+        if ( NULL != item )
+        {
+            l2dbus_predecodeFlatten(item);
+            l2dbus_predecodeGiveDone(pd, item);
+        }
+        else if ( __atomic_load_n(&pd->stop, __ATOMIC_SEQ_CST) )
+        {
+            break;
+        }
+        else
+        {
+            pfd.fd = pd->todoFd[0];
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            (void)poll(&pfd, 1, -1);
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief Takes the next item decoded by the decoder thread.
+ *
+ * @param [in] pd   The decoder.
+ * @return The next item or NULL if there is none.
+ */
+static l2dbus_PredecodeItem*
+l2dbus_predecodeTakeDone
+    (
+    l2dbus_Predecoder*  pd
+    )
+{
+    l2dbus_PredecodeItem* item;
+    unsigned head;
+    unsigned tail;
+
+    head = __atomic_load_n(&pd->doneHead, __ATOMIC_RELAXED);
+    tail = __atomic_load_n(&pd->doneTail, __ATOMIC_SEQ_CST);
+    if ( head == tail )
+    {
+        l2dbus_predecodeClearSignal(pd->doneFd[0]);
+        tail = __atomic_load_n(&pd->doneTail, __ATOMIC_SEQ_CST);
+    }
+
+    if ( head == tail )
+    {
+        return NULL;
+    }
+
+    item = pd->done[head & pd->mask];
+    __atomic_store_n(&pd->doneHead, head + 1U, __ATOMIC_SEQ_CST);
+
+    return item;
+}
+
+
+/**
+ * @brief Hands an item to the decoder thread.
+ *
+ * The caller must make sure fewer items than the ring can hold are in
+ * flight.
+ *
+ * @param [in] pd   The decoder.
+ * @param [in] item The item to decode.
+ */
+static void
+l2dbus_predecodeGiveTodo
+    (
+    l2dbus_Predecoder*      pd,
+    l2dbus_PredecodeItem*   item
+    )
+{
+    unsigned tail;
+
+    TAILQ_INSERT_TAIL(&pd->inFlight, item, link);
+    pd->nInFlight++;
+
+    tail = __atomic_load_n(&pd->todoTail, __ATOMIC_RELAXED);
+    pd->todo[tail & pd->mask] = item;
+    __atomic_store_n(&pd->todoTail, tail + 1U, __ATOMIC_SEQ_CST);
+
+    /* If the decoder thread has caught up it may be waiting for a signal */
+    if ( __atomic_load_n(&pd->todoHead, __ATOMIC_SEQ_CST) == tail )
+    {
+        l2dbus_predecodeSignal(pd->todoFd[1]);
+    }
+}
+
+
+/**
+ * @brief Hands items waiting for room to the decoder thread.
+ *
+ * @param [in] pd   The decoder.
+ */
+static void
+l2dbus_predecodeFeed
+    (
+    l2dbus_Predecoder*  pd
+    )
+{
+    l2dbus_PredecodeItem* item;
+
+    while ( (pd->nInFlight <= pd->mask) &&
+            (NULL != (item = TAILQ_FIRST(&pd->overflow))) )
+    {
+        TAILQ_REMOVE(&pd->overflow, item, link);
+        l2dbus_predecodeGiveTodo(pd, item);
+    }
+}
+
+
+/* Frees an item and releases its message */
+static void
+l2dbus_predecodeFreeItem
+    (
+    l2dbus_PredecodeItem*   item
+    )
+{
+    dbus_message_unref(item->msg);
+    l2dbus_free(item->flat);
+    l2dbus_free(item);
+}
+
+
+/**
+ * @brief Pushes the elements of a flattened fixed-size array as a table.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] elemType The D-Bus type of the elements.
+ * @param [in] count    The number of elements.
+ * @param [in] p        The packed elements.
+ * @return A pointer just past the elements.
+ */
+static const unsigned char*
+l2dbus_predecodePushFixedArray
+    (
+    lua_State*              L,
+    int                     elemType,
+    uint32_t                count,
+    const unsigned char*    p
+    )
+{
+    size_t eltSize = l2dbus_transcodeFixedTypeSize(elemType);
+    dbus_bool_t boolValue;
+    int16_t int16Value;
+    uint16_t uint16Value;
+    int32_t int32Value;
+    uint32_t uint32Value;
+    int64_t int64Value;
+    uint64_t uint64Value;
+    double doubleValue;
+    uint32_t idx;
+
+    lua_createtable(L, (int)count, 0);
+    for ( idx = 0; idx < count; ++idx, p += eltSize )
+    {
+        switch ( elemType )
+        {
+            case DBUS_TYPE_BYTE:
+                lua_pushnumber(L, *p);
+                break;
+            case DBUS_TYPE_BOOLEAN:
+                memcpy(&boolValue, p, sizeof(boolValue));
+                lua_pushboolean(L, boolValue);
+                break;
+            case DBUS_TYPE_INT16:
+                memcpy(&int16Value, p, sizeof(int16Value));
+                lua_pushnumber(L, int16Value);
+                break;
+            case DBUS_TYPE_UINT16:
+                memcpy(&uint16Value, p, sizeof(uint16Value));
+                lua_pushnumber(L, uint16Value);
+                break;
+            case DBUS_TYPE_INT32:
+                memcpy(&int32Value, p, sizeof(int32Value));
+                lua_pushnumber(L, int32Value);
+                break;
+            case DBUS_TYPE_UINT32:
+                memcpy(&uint32Value, p, sizeof(uint32Value));
+                lua_pushnumber(L, uint32Value);
+                break;
+            case DBUS_TYPE_INT64:
+                memcpy(&int64Value, p, sizeof(int64Value));
+                l2dbus_int64Push(L, int64Value, L2DBUS_FALSE);
+                break;
+            case DBUS_TYPE_UINT64:
+                memcpy(&uint64Value, p, sizeof(uint64Value));
+                l2dbus_uint64Push(L, uint64Value, L2DBUS_FALSE);
+                break;
+            case DBUS_TYPE_DOUBLE:
+                memcpy(&doubleValue, p, sizeof(doubleValue));
+                lua_pushnumber(L, doubleValue);
+                break;
+            default:
+                luaL_error(L, "unsupported D-Bus fixed array type (%d)",
+                            elemType);
+                break;
+        }
+        lua_rawseti(L, -2, (int)idx + 1);
+    }
+
+    return p;
+}
+
+
+/**
+ * @brief Pushes a flattened value on the Lua stack.
+ *
+ * The values are converted exactly as Message:getArgs converts the message
+ * arguments with its default options.
+ *
+ * @param [in] L    The Lua state.
+ * @param [in] p    The tag of the flattened value.
+ * @return A pointer just past the value.
+ */
+static const unsigned char*
+l2dbus_predecodePushValue
+    (
+    lua_State*              L,
+    const unsigned char*    p
+    )
+{
+    unsigned char tag = *p++;
+    int elemType;
+    uint32_t count;
+    uint32_t idx;
+    int64_t int64Value;
+    uint64_t uint64Value;
+    double doubleValue;
+
+    luaL_checkstack(L, 3, "flattened arguments nested too deeply");
+
+    switch ( tag )
+    {
+        case L2DBUS_FLAT_NUMBER:
+            memcpy(&doubleValue, p, sizeof(doubleValue));
+            p += sizeof(doubleValue);
+            lua_pushnumber(L, doubleValue);
+            break;
+
+        case L2DBUS_FLAT_BOOLEAN:
+            lua_pushboolean(L, *p++);
+            break;
+
+        case L2DBUS_FLAT_INT64:
+            memcpy(&int64Value, p, sizeof(int64Value));
+            p += sizeof(int64Value);
+            l2dbus_int64Push(L, int64Value, L2DBUS_FALSE);
+            break;
+
+        case L2DBUS_FLAT_UINT64:
+            memcpy(&uint64Value, p, sizeof(uint64Value));
+            p += sizeof(uint64Value);
+            l2dbus_uint64Push(L, uint64Value, L2DBUS_FALSE);
+            break;
+
+        case L2DBUS_FLAT_STRING:
+            memcpy(&count, p, sizeof(count));
+            p += sizeof(count);
+            lua_pushlstring(L, (const char*)p, count);
+            p += count;
+            break;
+
+        case L2DBUS_FLAT_FIXED_ARRAY:
+            elemType = *p++;
+            memcpy(&count, p, sizeof(count));
+            p += sizeof(count);
+            p = l2dbus_predecodePushFixedArray(L, elemType, count, p);
+            break;
+
+        case L2DBUS_FLAT_ARRAY:
+            memcpy(&count, p, sizeof(count));
+            p += sizeof(count);
+            lua_createtable(L, (int)count, 0);
+            for ( idx = 1; idx <= count; ++idx )
+            {
+                p = l2dbus_predecodePushValue(L, p);
+                lua_rawseti(L, -2, (int)idx);
+            }
+            break;
+
+        case L2DBUS_FLAT_DICT:
+            memcpy(&count, p, sizeof(count));
+            p += sizeof(count);
+            lua_createtable(L, 0, (int)count);
+            for ( idx = 0; idx < count; ++idx )
+            {
+                p = l2dbus_predecodePushValue(L, p);
+                p = l2dbus_predecodePushValue(L, p);
+                lua_rawset(L, -3);
+            }
+            break;
+
+        default:
+            luaL_error(L, "corrupt flattened argument (tag=%d)", tag);
+            break;
+    }
+
+    return p;
+}
+
+
+/* Protected push of the arguments of the item (at index 1) */
+static int
+l2dbus_predecodeUnpack
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_PredecodeItem* item = (l2dbus_PredecodeItem*)lua_touserdata(L, 1);
+    l2dbus_TranscodeOpts opts;
+    const unsigned char* p;
+    uint32_t nArgs;
+    uint32_t idx;
+
+    if ( !item->decoded )
+    {
+        memset(&opts, 0, sizeof(opts));
+        return l2dbus_transcodeDbusArgsToLua(L, item->msg, &opts);
+    }
+
+    p = item->flat;
+    memcpy(&nArgs, p, sizeof(nArgs));
+    p += sizeof(nArgs);
+    luaL_checkstack(L, (int)nArgs, "too many message arguments");
+    for ( idx = 0; idx < nArgs; ++idx )
+    {
+        p = l2dbus_predecodePushValue(L, p);
+    }
+    assert( p == item->flat + item->flatLen );
+
+    return (int)nArgs;
+}
+
+
+/**
+ * @brief Delivers a (pre-)decoded message to the handler of its match.
+ *
+ * The decoded arguments are passed to the handler after the user token.
+ *
+ * @param [in] item The item whose match is still registered.
+ */
+static void
+l2dbus_predecodeDeliver
+    (
+    l2dbus_PredecodeItem*   item
+    )
+{
+    lua_State* L = l2dbus_callbackGetThread();
+    l2dbus_Match* match = item->match;
+    l2dbus_Message* msgUd = NULL;
+    const char* errMsg = "";
+    int baseIdx;
+    int nArgs;
+    double cbStart;
+    int status;
+
+    assert( NULL != L );
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, match->cbCtx.funcRef);
+    lua_pushlightuserdata(L, match);
+    if ( match->borrowMsg )
+    {
+        msgUd = l2dbus_messageBorrow(L, item->msg);
+    }
+    else
+    {
+        l2dbus_messageWrap(L, item->msg, L2DBUS_TRUE);
+    }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, match->cbCtx.userRef);
+    baseIdx = lua_gettop(L);
+
+    lua_pushcfunction(L, l2dbus_predecodeUnpack);
+    lua_pushlightuserdata(L, item);
+    if ( 0 != lua_pcall(L, 1 /* nArgs */, LUA_MULTRET, 0) )
+    {
+        if ( lua_isstring(L, -1) )
+        {
+            errMsg = lua_tostring(L, -1);
+        }
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Match decode error: %s", errMsg));
+        lua_settop(L, baseIdx);
+    }
+    nArgs = lua_gettop(L) - baseIdx;
+
+    cbStart = l2dbus_statsCallbackStart(L, 3 + nArgs);
+    status = lua_pcall(L, 3 + nArgs, 0, 0);
+    l2dbus_statsCallback(L2DBUS_STATS_CB_MATCH, cbStart, status);
+    if ( 0 != status )
+    {
+        errMsg = "";
+        if ( lua_isstring(L, -1) )
+        {
+            errMsg = lua_tostring(L, -1);
+        }
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Match callback error: %s", errMsg));
+    }
+
+    /* Invalidate a borrowed message now the handler has returned */
+    if ( NULL != msgUd )
+    {
+        l2dbus_messageGiveBack(L, msgUd);
+    }
+
+    lua_settop(L, 0);
+    l2dbus_arenaReset();
+}
+
+
+/**
+ * @brief Delivers the items decoded by the decoder thread.
+ *
+ * @param [in] w            CDBUS Watch instance.
+ * @param [in] rcvEvents    The bitmask of signaled events.
+ * @param [in] user         The decoder.
+ * @return A boolean value that is ignored by CDBUS.
+ */
+static cdbus_Bool
+l2dbus_predecodeWatchHandler
+    (
+    cdbus_Watch*    w,
+    cdbus_UInt32    rcvEvents,
+    void*           user
+    )
+{
+    l2dbus_Predecoder* pd = (l2dbus_Predecoder*)user;
+    l2dbus_PredecodeItem* item;
+
+    assert( NULL != pd );
+
+    while ( NULL != (item = l2dbus_predecodeTakeDone(pd)) )
+    {
+        TAILQ_REMOVE(&pd->inFlight, item, link);
+        pd->nInFlight--;
+        if ( item->decoded )
+        {
+            pd->nDecoded++;
+        }
+        else
+        {
+            pd->nFallback++;
+        }
+
+        /* The match may have been unregistered in the meantime */
+        if ( NULL != item->match )
+        {
+            l2dbus_predecodeDeliver(item);
+        }
+        l2dbus_predecodeFreeItem(item);
+        l2dbus_predecodeFeed(pd);
+    }
+
+    return CDBUS_TRUE;
+}
+
+
+/* Frees a decoder whose thread is not running */
+static void
+l2dbus_predecodeFree
+    (
+    l2dbus_Predecoder*  pd
+    )
+{
+    l2dbus_PredecodeItem* item;
+
+    while ( NULL != (item = TAILQ_FIRST(&pd->inFlight)) )
+    {
+        TAILQ_REMOVE(&pd->inFlight, item, link);
+        l2dbus_predecodeFreeItem(item);
+    }
+
+    while ( NULL != (item = TAILQ_FIRST(&pd->overflow)) )
+    {
+        TAILQ_REMOVE(&pd->overflow, item, link);
+        l2dbus_predecodeFreeItem(item);
+    }
+
+    if ( NULL != pd->doneWatch )
+    {
+        cdbus_watchEnable(pd->doneWatch, CDBUS_FALSE);
+        cdbus_watchUnref(pd->doneWatch);
+    }
+
+    l2dbus_predecodeCloseSignal(pd->todoFd);
+    l2dbus_predecodeCloseSignal(pd->doneFd);
+    l2dbus_free(pd->todo);
+    l2dbus_free(pd->done);
+    l2dbus_free(pd);
+}
+
+
+/**
+ * @brief Starts the decoder thread of a dispatcher.
+ *
+ * The thread is started once, when the first match asks for its messages
+ * to be decoded in the background.
+ *
+ * @param [in] dispUd   The dispatcher.
+ * @return Returns L2DBUS_TRUE if the decoder thread is running.
+ */
+l2dbus_Bool
+l2dbus_predecodeEnable
+    (
+    l2dbus_Dispatcher*  dispUd
+    )
+{
+    l2dbus_Predecoder* pd;
+    l2dbus_Bool failed;
+
+    if ( NULL == dispUd )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    if ( NULL != dispUd->predecoder )
+    {
+        return L2DBUS_TRUE;
+    }
+
+    /* Messages will be referenced from more than one thread */
+    if ( !dbus_threads_init_default() )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    pd = (l2dbus_Predecoder*)l2dbus_calloc(1, sizeof(*pd));
+    if ( NULL == pd )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    pd->todoFd[0] = pd->todoFd[1] = -1;
+    pd->doneFd[0] = pd->doneFd[1] = -1;
+    pd->mask = L2DBUS_PREDECODE_CAPACITY - 1U;
+    TAILQ_INIT(&pd->inFlight);
+    TAILQ_INIT(&pd->overflow);
+    pd->todo = (l2dbus_PredecodeItem**)l2dbus_calloc(
+                                L2DBUS_PREDECODE_CAPACITY, sizeof(*pd->todo));
+    pd->done = (l2dbus_PredecodeItem**)l2dbus_calloc(
+                                L2DBUS_PREDECODE_CAPACITY, sizeof(*pd->done));
+    failed = (NULL == pd->todo) || (NULL == pd->done) ||
+            !l2dbus_predecodeOpenSignal(pd->todoFd) ||
+            !l2dbus_predecodeOpenSignal(pd->doneFd);
+
+    if ( !failed )
+    {
+        pd->doneWatch = cdbus_watchNew(dispUd->disp, pd->doneFd[0],
+                                    DBUS_WATCH_READABLE,
+                                    l2dbus_predecodeWatchHandler, pd);
+        failed = (NULL == pd->doneWatch) ||
+            CDBUS_FAILED(cdbus_watchEnable(pd->doneWatch, CDBUS_TRUE));
+    }
+
+    if ( !failed )
+    {
+        failed = (0 != pthread_create(&pd->thread, NULL,
+                                    l2dbus_predecodeThread, pd));
+    }
+
+    if ( failed )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Failed to start the decoder thread"));
+        l2dbus_predecodeFree(pd);
+        return L2DBUS_FALSE;
+    }
+
+    dispUd->predecoder = pd;
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Hands a matched message to the decoder thread of its dispatcher.
+ *
+ * The handler of the match is called from the dispatcher once the
+ * arguments have been decoded. Messages of the same dispatcher are
+ * delivered in the order they were submitted.
+ *
+ * @param [in] match    The match rule whose handler should be called.
+ * @param [in] msg      The D-Bus message that matched.
+ */
+void
+l2dbus_predecodeSubmit
+    (
+    l2dbus_Match*   match,
+    DBusMessage*    msg
+    )
+{
+    l2dbus_Dispatcher* dispUd = (NULL != match->connUd) ?
+                                    match->connUd->dispUd : NULL;
+    l2dbus_Predecoder* pd = (NULL != dispUd) ? dispUd->predecoder : NULL;
+    l2dbus_PredecodeItem* item = NULL;
+
+    if ( NULL != pd )
+    {
+        item = (l2dbus_PredecodeItem*)l2dbus_calloc(1, sizeof(*item));
+    }
+
+    if ( NULL == item )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN,
+            "Cannot decode in the background - delivering immediately"));
+        l2dbus_dispatcherSubmitMatch(match, msg);
+        return;
+    }
+
+    item->match = match;
+    item->msg = dbus_message_ref(msg);
+
+    /* Wait behind earlier items if the decoder thread is saturated */
+    if ( TAILQ_EMPTY(&pd->overflow) && (pd->nInFlight <= pd->mask) )
+    {
+        l2dbus_predecodeGiveTodo(pd, item);
+    }
+    else
+    {
+        TAILQ_INSERT_TAIL(&pd->overflow, item, link);
+    }
+}
+
+
+/**
+ * @brief Discards the pending deliveries of a match rule.
+ *
+ * Items already handed to the decoder thread are kept until they come
+ * back but are no longer delivered. This must be called before a match
+ * rule is destroyed.
+ *
+ * @param [in] match The match rule being destroyed.
+ */
+void
+l2dbus_predecodePurgeMatch
+    (
+    l2dbus_Match*   match
+    )
+{
+    l2dbus_Dispatcher* dispUd = (NULL != match->connUd) ?
+                                    match->connUd->dispUd : NULL;
+    l2dbus_Predecoder* pd = (NULL != dispUd) ? dispUd->predecoder : NULL;
+    l2dbus_PredecodeItem* item;
+    l2dbus_PredecodeItem* next;
+
+    if ( NULL == pd )
+    {
+        return;
+    }
+
+    TAILQ_FOREACH(item, &pd->inFlight, link)
+    {
+        if ( item->match == match )
+        {
+            item->match = NULL;
+        }
+    }
+
+    for ( item = TAILQ_FIRST(&pd->overflow); NULL != item; item = next )
+    {
+        next = TAILQ_NEXT(item, link);
+        if ( item->match == match )
+        {
+            TAILQ_REMOVE(&pd->overflow, item, link);
+            l2dbus_predecodeFreeItem(item);
+        }
+    }
+}
+
+
+/**
+ * @brief Stops the decoder thread of a dispatcher.
+ *
+ * Messages that have not been delivered yet are discarded.
+ *
+ * @param [in] dispUd   The dispatcher.
+ */
+void
+l2dbus_predecodeDispose
+    (
+    l2dbus_Dispatcher*  dispUd
+    )
+{
+    l2dbus_Predecoder* pd = dispUd->predecoder;
+
+    if ( NULL != pd )
+    {
+        __atomic_store_n(&pd->stop, 1, __ATOMIC_SEQ_CST);
+        l2dbus_predecodeSignal(pd->todoFd[1]);
+        pthread_join(pd->thread, NULL);
+
+        L2DBUS_TRACE((L2DBUS_TRC_TRACE,
+                    "Decoder thread decoded %lu messages (%lu on the Lua thread)",
+                    pd->nDecoded, pd->nFallback));
+        l2dbus_predecodeFree(pd);
+        dispUd->predecoder = NULL;
+    }
+}
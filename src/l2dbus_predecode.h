@@ -0,0 +1,101 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_predecode.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the background decoding of matched messages.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_PREDECODE_H_
+#define L2DBUS_PREDECODE_H_
+
+#include <pthread.h>
+#include "dbus/dbus.h"
+#include "queue.h"
+#include "l2dbus_types.h"
+
+/* The number of messages that can be handed to the decoder thread at once */
+#define L2DBUS_PREDECODE_CAPACITY   (1024U)
+
+/* Forward declarations */
+struct l2dbus_Dispatcher;
+struct l2dbus_Match;
+struct cdbus_Watch;
+
+/* A matched message on its way through the decoder thread */
+typedef struct l2dbus_PredecodeItem
+{
+    /* Only accessed by the Lua thread (NULL once the match is gone) */
+    struct l2dbus_Match*                match;
+    TAILQ_ENTRY(l2dbus_PredecodeItem)   link;
+    /* Only accessed by the decoder thread until the item is handed back */
+    DBusMessage*                        msg;
+    unsigned char*                      flat;
+    size_t                              flatLen;
+    l2dbus_Bool                         decoded;
+} l2dbus_PredecodeItem;
+
+TAILQ_HEAD(l2dbus_PredecodeList, l2dbus_PredecodeItem);
+
+/*
+ * The decoder thread of a Dispatcher. Items travel to the thread and back
+ * through two single-producer/single-consumer rings and each direction
+ * has its own wake-up descriptor.
+ */
+typedef struct l2dbus_Predecoder
+{
+    pthread_t                   thread;
+    int                         stop;
+    /* Lua thread -> decoder thread */
+    l2dbus_PredecodeItem**      todo;
+    unsigned                    todoHead;
+    unsigned                    todoTail;
+    int                         todoFd[2];
+    /* Decoder thread -> Lua thread */
+    l2dbus_PredecodeItem**      done;
+    unsigned                    doneHead;
+    unsigned                    doneTail;
+    int                         doneFd[2];
+    unsigned                    mask;
+    struct cdbus_Watch*         doneWatch;
+    /* Items owned by the decoder thread (in submission order) */
+    struct l2dbus_PredecodeList inFlight;
+    unsigned                    nInFlight;
+    /* Items waiting for room in the rings */
+    struct l2dbus_PredecodeList overflow;
+    unsigned long               nDecoded;
+    unsigned long               nFallback;
+} l2dbus_Predecoder;
+
+l2dbus_Bool l2dbus_predecodeEnable(struct l2dbus_Dispatcher* dispUd);
+void l2dbus_predecodeSubmit(struct l2dbus_Match* match, DBusMessage* msg);
+void l2dbus_predecodePurgeMatch(struct l2dbus_Match* match);
+void l2dbus_predecodeDispose(struct l2dbus_Dispatcher* dispUd);
+
+#endif /* Guard for L2DBUS_PREDECODE_H_ */
@@ -0,0 +1,921 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_propstore.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the C resident property store of an interface.
+ *===========================================================================
+ */
+#include <string.h>
+#include <assert.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_propstore.h"
+#include "l2dbus_interface.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_cork.h"
+#include "l2dbus_message.h"
+#include "l2dbus_transcode.h"
+#include "l2dbus_reflist.h"
+#include "l2dbus_object.h"
+#include "l2dbus_core.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_tracering.h"
+#include "l2dbus_strpool.h"
+#include "lauxlib.h"
+
+/* The requests of the Properties interface handled by the store */
+#define L2DBUS_PROP_STORE_GET       (0)
+#define L2DBUS_PROP_STORE_GET_ALL   (1)
+#define L2DBUS_PROP_STORE_SET       (2)
+
+
+/**
+ * @brief Initializes an (empty and disabled) property store.
+ *
+ * @param [in] store The property store to initialize.
+ */
+void
+l2dbus_propStoreInit
+    (
+    l2dbus_PropStore*   store
+    )
+{
+    memset(store, 0, sizeof(*store));
+}
+
+
+/**
+ * @brief Removes every property (and its value) from the store.
+ *
+ * The store stays enabled (or disabled).
+ *
+ * @param [in] L     The Lua state.
+ * @param [in] store The property store to clear.
+ */
+void
+l2dbus_propStoreClear
+    (
+    lua_State*          L,
+    l2dbus_PropStore*   store
+    )
+{
+    l2dbus_PropStoreItem* item;
+    unsigned idx;
+
+    for ( idx = 0; idx < store->nItems; ++idx )
+    {
+        item = &store->items[idx];
+        l2dbus_strPoolRelease(item->name);
+        l2dbus_strPoolRelease(item->signature);
+        if ( NULL != item->value )
+        {
+            dbus_message_unref(item->value);
+        }
+        l2dbus_callbackUnref(L, &item->cbCtx);
+    }
+    l2dbus_free(store->items);
+    store->items = NULL;
+    store->nItems = 0;
+    store->capacity = 0;
+}
+
+
+/**
+ * @brief Adds a property (without a value) to the store.
+ *
+ * @param [in] store     The property store.
+ * @param [in] name      The name of the property.
+ * @param [in] signature The (validated) D-Bus signature of the property.
+ * @param [in] read      L2DBUS_TRUE if the property can be read.
+ * @param [in] write     L2DBUS_TRUE if the property can be written.
+ * @return L2DBUS_TRUE if the property is added or L2DBUS_FALSE if memory
+ * could not be allocated.
+ */
+l2dbus_Bool
+l2dbus_propStoreAdd
+    (
+    l2dbus_PropStore*   store,
+    const char*         name,
+    const char*         signature,
+    l2dbus_Bool         read,
+    l2dbus_Bool         write
+    )
+{
+    l2dbus_PropStoreItem* items;
+    l2dbus_PropStoreItem* item;
+    unsigned capacity;
+
+    if ( store->nItems == store->capacity )
+    {
+        capacity = (0 == store->capacity) ? 4 : 2 * store->capacity;
+        items = (l2dbus_PropStoreItem*)l2dbus_realloc(store->items,
+                                            capacity * sizeof(*items));
+        if ( NULL == items )
+        {
+            return L2DBUS_FALSE;
+        }
+        store->items = items;
+        store->capacity = capacity;
+    }
+
+    item = &store->items[store->nItems];
+    memset(item, 0, sizeof(*item));
+    l2dbus_callbackInit(&item->cbCtx);
+    /* Interfaces implemented by many objects share the same strings */
+    item->name = l2dbus_strIntern(name);
+    item->signature = l2dbus_strIntern(signature);
+    if ( (NULL == item->name) || (NULL == item->signature) )
+    {
+        l2dbus_strPoolRelease(item->name);
+        l2dbus_strPoolRelease(item->signature);
+        return L2DBUS_FALSE;
+    }
+    item->read = read;
+    item->write = write;
+    store->nItems++;
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Finds a property of the store by name.
+ *
+ * Interfaces declare a handful of properties so they are searched in
+ * order.
+ *
+ * @param [in] store The property store.
+ * @param [in] name  The name of the property.
+ * @return The property or NULL if the interface does not declare it.
+ */
+static l2dbus_PropStoreItem*
+l2dbus_propStoreFind
+    (
+    l2dbus_PropStore*   store,
+    const char*         name
+    )
+{
+    unsigned idx;
+
+    for ( idx = 0; idx < store->nItems; ++idx )
+    {
+        if ( 0 == strcmp(store->items[idx].name, name) )
+        {
+            return &store->items[idx];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief Marshals a Lua value with the signature of a property.
+ *
+ * @param [in] L         The Lua state.
+ * @param [in] valueIdx  The index of the value on the Lua stack.
+ * @param [in] signature The signature of the property.
+ * @return The message holding the value as its only argument. The
+ * message wrapper (which owns the message) is left on the stack so the
+ * message is released if marshalling throws a Lua error.
+ */
+static DBusMessage*
+l2dbus_propStoreMarshal
+    (
+    lua_State*  L,
+    int         valueIdx,
+    const char* signature
+    )
+{
+    DBusMessage* msg;
+
+    valueIdx = lua_absindex(L, valueIdx);
+    msg = dbus_message_new(DBUS_MESSAGE_TYPE_SIGNAL);
+    if ( NULL == msg )
+    {
+        luaL_error(L, "failed to allocate property value");
+    }
+
+    l2dbus_messageWrap(L, msg, L2DBUS_FALSE);
+    l2dbus_transcodeLuaArgsToDbusBySignature(L, msg, valueIdx, 1, signature);
+
+    return msg;
+}
+
+
+/*
+ * Protected entry point of l2dbus_propStoreMarshal(): expects the value
+ * and the signature on the stack and returns the message wrapper.
+ */
+static int
+l2dbus_propStoreMarshalValue
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_propStoreMarshal(L, 1, lua_tostring(L, 2));
+    return 1;
+}
+
+
+/**
+ * @brief Computes the value of a dynamic property.
+ *
+ * The handler is called (protected) as handler(interface, name, userToken)
+ * and the value it returns is marshalled with the property signature.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] intfIdx  The index of the Interface userdata on the stack.
+ * @param [in] item     The dynamic property.
+ * @return A new reference to a message holding the value or NULL if the
+ * handler failed or returned a value that cannot be marshalled.
+ */
+static DBusMessage*
+l2dbus_propStoreCallHandler
+    (
+    lua_State*              L,
+    int                     intfIdx,
+    l2dbus_PropStoreItem*   item
+    )
+{
+    DBusMessage* value = NULL;
+    l2dbus_Message* msgUd;
+    int top = lua_gettop(L);
+    double cbStart;
+    int status;
+
+    lua_pushcfunction(L, l2dbus_propStoreMarshalValue);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, item->cbCtx.funcRef);
+    lua_pushvalue(L, intfIdx);
+    lua_pushstring(L, item->name);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, item->cbCtx.userRef);
+
+    cbStart = l2dbus_statsCallbackStart(L, 3 /* nArgs */);
+    status = lua_pcall(L, 3 /* nArgs */, 1 /* nResults */, 0);
+    l2dbus_statsCallback(L2DBUS_STATS_CB_INTERFACE, cbStart, status);
+    if ( 0 == status )
+    {
+        lua_pushstring(L, item->signature);
+        status = lua_pcall(L, 2 /* nArgs */, 1 /* nResults */, 0);
+        if ( 0 == status )
+        {
+            msgUd = (l2dbus_Message*)lua_touserdata(L, -1);
+            value = dbus_message_ref(msgUd->msg);
+        }
+    }
+
+    if ( 0 != status )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Property '%s' handler error: %s",
+                    item->name, lua_isstring(L, -1) ? lua_tostring(L, -1) : ""));
+    }
+    lua_settop(L, top);
+
+    return value;
+}
+
+
+/**
+ * @brief Appends the value of a property to a message as a variant.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] intfIdx  The index of the Interface userdata on the stack.
+ * @param [in] item     The (readable) property.
+ * @param [in] msgIt    The iterator to append the variant to.
+ * @return L2DBUS_TRUE if the value is appended and L2DBUS_FALSE otherwise.
+ */
+static l2dbus_Bool
+l2dbus_propStoreAppendValue
+    (
+    lua_State*              L,
+    int                     intfIdx,
+    l2dbus_PropStoreItem*   item,
+    DBusMessageIter*        msgIt
+    )
+{
+    DBusMessage* value = item->value;
+    DBusMessageIter valueIt;
+    DBusMessageIter varIt;
+    l2dbus_Bool isOk;
+
+    if ( LUA_NOREF != item->cbCtx.funcRef )
+    {
+        value = l2dbus_propStoreCallHandler(L, intfIdx, item);
+        if ( NULL == value )
+        {
+            return L2DBUS_FALSE;
+        }
+    }
+
+    isOk = dbus_message_iter_init(value, &valueIt) &&
+            dbus_message_iter_open_container(msgIt, DBUS_TYPE_VARIANT,
+                                            item->signature, &varIt);
+    if ( isOk )
+    {
+        isOk = l2dbus_copyMessageValue(&valueIt, &varIt);
+        if ( !dbus_message_iter_close_container(msgIt, &varIt) )
+        {
+            isOk = L2DBUS_FALSE;
+        }
+    }
+
+    if ( value != item->value )
+    {
+        dbus_message_unref(value);
+    }
+
+    return isOk;
+}
+
+
+/**
+ * @brief Appends the a{sv} dictionary of every readable property.
+ *
+ * @return L2DBUS_TRUE if the dictionary is appended and L2DBUS_FALSE
+ * otherwise.
+ */
+static l2dbus_Bool
+l2dbus_propStoreAppendAll
+    (
+    lua_State*          L,
+    int                 intfIdx,
+    l2dbus_PropStore*   store,
+    DBusMessageIter*    msgIt
+    )
+{
+    DBusMessageIter dictIt;
+    DBusMessageIter entryIt;
+    l2dbus_PropStoreItem* item;
+    l2dbus_Bool isOk;
+    unsigned idx;
+
+    isOk = dbus_message_iter_open_container(msgIt, DBUS_TYPE_ARRAY,
+                                            "{sv}", &dictIt);
+    if ( !isOk )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    for ( idx = 0; isOk && (idx < store->nItems); ++idx )
+    {
+        item = &store->items[idx];
+        if ( !item->read )
+        {
+            continue;
+        }
+
+        isOk = dbus_message_iter_open_container(&dictIt,
+                                    DBUS_TYPE_DICT_ENTRY, NULL, &entryIt);
+        if ( isOk )
+        {
+            isOk = dbus_message_iter_append_basic(&entryIt,
+                                    DBUS_TYPE_STRING, &item->name) &&
+                    l2dbus_propStoreAppendValue(L, intfIdx, item, &entryIt);
+            if ( !dbus_message_iter_close_container(&dictIt, &entryIt) )
+            {
+                isOk = L2DBUS_FALSE;
+            }
+        }
+    }
+
+    if ( !dbus_message_iter_close_container(msgIt, &dictIt) )
+    {
+        isOk = L2DBUS_FALSE;
+    }
+
+    return isOk;
+}
+
+
+/**
+ * @brief Checks whether every readable property can be read natively.
+ */
+static l2dbus_Bool
+l2dbus_propStoreIsComplete
+    (
+    l2dbus_PropStore*   store
+    )
+{
+    unsigned idx;
+
+    for ( idx = 0; idx < store->nItems; ++idx )
+    {
+        if ( store->items[idx].read && (NULL == store->items[idx].value) &&
+            (LUA_NOREF == store->items[idx].cbCtx.funcRef) )
+        {
+            return L2DBUS_FALSE;
+        }
+    }
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Finds an interface of the object with an enabled property store.
+ *
+ * @return The Interface (left on the top of the stack) or NULL (with
+ * nothing left on the stack) if no such interface is implemented.
+ */
+static l2dbus_Interface*
+l2dbus_propStoreFindInterface
+    (
+    lua_State*          L,
+    l2dbus_RefList*     interfaces,
+    const char*         name
+    )
+{
+    l2dbus_RefItem* ref;
+    l2dbus_Interface* intfUd;
+
+    LIST_FOREACH(ref, &interfaces->list, link)
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ref->refIdx);
+        intfUd = (l2dbus_Interface*)l2dbus_isUserData(L, -1,
+                                            L2DBUS_INTERFACE_TYPE_ID);
+        if ( (NULL != intfUd) && intfUd->props.enabled &&
+            (NULL != intfUd->intf) &&
+            (0 == strcmp(cdbus_interfaceGetName(intfUd->intf), name)) )
+        {
+            return intfUd;
+        }
+        lua_pop(L, 1);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief Queues a reply built by the property store.
+ *
+ * The reply is counted and traced (or held by a cork) as if it was sent
+ * from Lua.
+ *
+ * @return L2DBUS_TRUE if the reply is queued (or held).
+ */
+static l2dbus_Bool
+l2dbus_propStoreSendReply
+    (
+    lua_State*                  L,
+    struct cdbus_Connection*    conn,
+    DBusMessage*                reply
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_Bool queued;
+
+    /* Leaves the connection userdata (or nil) on the stack */
+    connUd = (l2dbus_Connection*)l2dbus_objectRegistryGet(L, conn);
+    if ( (NULL != connUd) && connUd->corked &&
+        l2dbus_corkHold(connUd, reply) )
+    {
+        queued = L2DBUS_TRUE;
+    }
+    else
+    {
+        queued = dbus_connection_send(cdbus_connectionGetDBus(conn),
+                                    reply, NULL);
+        if ( NULL != connUd )
+        {
+            l2dbus_statsCountSent(&connUd->stats, reply, queued);
+            if ( queued )
+            {
+                l2dbus_traceRingRecord(connUd, reply, L2DBUS_TRACE_RING_SENT);
+            }
+        }
+    }
+    lua_pop(L, 1);
+
+    return queued;
+}
+
+
+/**
+ * @brief Answers Properties requests from the property stores.
+ *
+ * Called by a service object before its Lua handler. Get and GetAll are
+ * answered in C when the interface named by the request has an enabled
+ * property store holding a value (or handler) for every property that
+ * is requested. Set requests that cannot succeed (unknown or read-only
+ * properties and values of the wrong type) are rejected in C. Everything
+ * else (including valid Set requests) is left to the Lua handlers.
+ *
+ * @param [in] L          The Lua state.
+ * @param [in] interfaces The interfaces implemented by the service object.
+ * @param [in] conn       The CDBUS connection the request arrived on.
+ * @param [in] msg        The request message.
+ * @return DBUS_HANDLER_RESULT_HANDLED if a reply was sent or
+ * DBUS_HANDLER_RESULT_NOT_YET_HANDLED if the request is left to Lua.
+ */
+DBusHandlerResult
+l2dbus_propStoreHandle
+    (
+    lua_State*                  L,
+    struct l2dbus_RefList*      interfaces,
+    struct cdbus_Connection*    conn,
+    DBusMessage*                msg
+    )
+{
+    DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    const char* member;
+    const char* intfName = NULL;
+    const char* propName = NULL;
+    const char* errName = NULL;
+    const char* errMsg = NULL;
+    l2dbus_Interface* intfUd;
+    l2dbus_PropStoreItem* item = NULL;
+    DBusMessage* reply = NULL;
+    DBusMessageIter msgIt;
+    DBusMessageIter varIt;
+    char* varSig;
+    int top = lua_gettop(L);
+    int request;
+
+    if ( (DBUS_MESSAGE_TYPE_METHOD_CALL != dbus_message_get_type(msg)) ||
+        !dbus_message_has_interface(msg, DBUS_INTERFACE_PROPERTIES) ||
+        (NULL == (member = dbus_message_get_member(msg))) )
+    {
+        return rc;
+    }
+
+    if ( (0 == strcmp(member, "Get")) && dbus_message_has_signature(msg, "ss") )
+    {
+        request = L2DBUS_PROP_STORE_GET;
+    }
+    else if ( (0 == strcmp(member, "GetAll")) &&
+            dbus_message_has_signature(msg, "s") )
+    {
+        request = L2DBUS_PROP_STORE_GET_ALL;
+    }
+    else if ( (0 == strcmp(member, "Set")) &&
+            dbus_message_has_signature(msg, "ssv") )
+    {
+        request = L2DBUS_PROP_STORE_SET;
+    }
+    else
+    {
+        return rc;
+    }
+
+    dbus_message_iter_init(msg, &msgIt);
+    dbus_message_iter_get_basic(&msgIt, &intfName);
+    if ( L2DBUS_PROP_STORE_GET_ALL != request )
+    {
+        dbus_message_iter_next(&msgIt);
+        dbus_message_iter_get_basic(&msgIt, &propName);
+    }
+
+    /* Leaves the interface on the stack to anchor it while handling */
+    intfUd = l2dbus_propStoreFindInterface(L, interfaces, intfName);
+    if ( NULL == intfUd )
+    {
+        return rc;
+    }
+
+    if ( NULL != propName )
+    {
+        item = l2dbus_propStoreFind(&intfUd->props, propName);
+        if ( NULL == item )
+        {
+            errName = DBUS_ERROR_UNKNOWN_PROPERTY;
+            errMsg = lua_pushfstring(L, "Unknown property '%s' of '%s'",
+                                    propName, intfName);
+        }
+    }
+
+    if ( NULL != errName )
+    {
+        /* The error reply is built below */
+    }
+    else if ( L2DBUS_PROP_STORE_GET == request )
+    {
+        if ( !item->read )
+        {
+            errName = DBUS_ERROR_ACCESS_DENIED;
+            errMsg = lua_pushfstring(L, "Property '%s' is write-only",
+                                    propName);
+        }
+        else if ( (NULL != item->value) ||
+                (LUA_NOREF != item->cbCtx.funcRef) )
+        {
+            reply = dbus_message_new_method_return(msg);
+            rc = DBUS_HANDLER_RESULT_NEED_MEMORY;
+            if ( NULL != reply )
+            {
+                dbus_message_iter_init_append(reply, &msgIt);
+                if ( !l2dbus_propStoreAppendValue(L, top + 1, item, &msgIt) )
+                {
+                    dbus_message_unref(reply);
+                    reply = NULL;
+                    errName = DBUS_ERROR_FAILED;
+                    errMsg = lua_pushfstring(L,
+                                "Failed to get property '%s'", propName);
+                }
+            }
+        }
+    }
+    else if ( L2DBUS_PROP_STORE_GET_ALL == request )
+    {
+        if ( l2dbus_propStoreIsComplete(&intfUd->props) )
+        {
+            reply = dbus_message_new_method_return(msg);
+            rc = DBUS_HANDLER_RESULT_NEED_MEMORY;
+            if ( NULL != reply )
+            {
+                dbus_message_iter_init_append(reply, &msgIt);
+                if ( !l2dbus_propStoreAppendAll(L, top + 1, &intfUd->props,
+                                                &msgIt) )
+                {
+                    dbus_message_unref(reply);
+                    reply = NULL;
+                    errName = DBUS_ERROR_FAILED;
+                    errMsg = lua_pushfstring(L,
+                                "Failed to get the properties of '%s'",
+                                intfName);
+                }
+            }
+        }
+    }
+    else if ( !item->write )
+    {
+        errName = DBUS_ERROR_PROPERTY_READ_ONLY;
+        errMsg = lua_pushfstring(L, "Property '%s' is read-only", propName);
+    }
+    else
+    {
+        dbus_message_iter_next(&msgIt);
+        dbus_message_iter_recurse(&msgIt, &varIt);
+        varSig = dbus_message_iter_get_signature(&varIt);
+        if ( (NULL != varSig) && (0 != strcmp(varSig, item->signature)) )
+        {
+            errName = DBUS_ERROR_INVALID_ARGS;
+            errMsg = lua_pushfstring(L,
+                        "Property '%s' has signature '%s' but got '%s'",
+                        propName, item->signature, varSig);
+        }
+        dbus_free(varSig);
+    }
+
+    if ( NULL != errName )
+    {
+        reply = dbus_message_new_error(msg, errName, errMsg);
+        rc = DBUS_HANDLER_RESULT_NEED_MEMORY;
+    }
+
+    if ( (NULL != reply) )
+    {
+        if ( l2dbus_propStoreSendReply(L, conn, reply) )
+        {
+            rc = DBUS_HANDLER_RESULT_HANDLED;
+        }
+        dbus_message_unref(reply);
+    }
+
+    lua_settop(L, top);
+
+    return rc;
+}
+
+
+/**
+ @function enablePropertyStore
+ @within Interface
+
+ Enables (or disables) the native property store of the interface.
+
+ Once enabled, requests of the
+ <a href="http://dbus.freedesktop.org/doc/dbus-specification.html#standard-interfaces-properties">Properties</a>
+ interface for this interface are answered in C by any
+ @{l2dbus.ServiceObject|ServiceObject} implementing it, without calling
+ Lua:
+
+ <ul>
+ <li>**Get** and **GetAll** are answered from the values stored with
+ @{setProperty} (or computed by the handler given to
+ @{setPropertyHandler}). A request for a property which has neither is
+ passed on to the Lua handlers instead, as is a **GetAll** when any
+ readable property has neither.</li>
+ <li>**Set**, as well as **Get** for an unknown or write-only property,
+ is rejected with an error reply if the property is unknown, read-only
+ or the value has the wrong type. Otherwise it is passed on to the Lua
+ handlers, which can then store the new value with @{setProperty}.</li>
+ </ul>
+
+ The stored values are those of the interface so they are shared by every
+ object implementing it. Registering the properties again discards the
+ stored values.
+
+ @tparam userdata interface The Interface.
+ @tparam ?bool enable If **true** (the default) the store is enabled.
+ */
+int
+l2dbus_interfaceEnablePropertyStore
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_INTERFACE_TYPE_ID);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    ifUd->props.enabled = lua_isnoneornil(L, 2) || lua_toboolean(L, 2);
+
+    return 0;
+}
+
+
+/* Returns the registered property named at the Lua stack index */
+static l2dbus_PropStoreItem*
+l2dbus_propStoreCheckItem
+    (
+    lua_State*          L,
+    l2dbus_Interface*   ifUd,
+    int                 nameIdx
+    )
+{
+    const char* name = luaL_checkstring(L, nameIdx);
+    l2dbus_PropStoreItem* item = l2dbus_propStoreFind(&ifUd->props, name);
+
+    if ( NULL == item )
+    {
+        luaL_error(L, "property '%s' is not registered with the interface",
+                    name);
+    }
+
+    return item;
+}
+
+
+/**
+ @function setProperty
+ @within Interface
+
+ Stores the value of a property in the property store.
+
+ The value is marshalled once, using the signature the property was
+ registered with, and is then copied into every **Get** and **GetAll**
+ reply. Setting a property to **nil** removes its value. This does not
+ emit the PropertiesChanged signal.
+
+ @tparam userdata interface The Interface.
+ @tparam string name The name of a registered property.
+ @tparam any value The new value of the property or **nil**.
+ @see enablePropertyStore
+ */
+int
+l2dbus_interfaceSetProperty
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_INTERFACE_TYPE_ID);
+    l2dbus_PropStoreItem* item;
+    DBusMessage* value = NULL;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    item = l2dbus_propStoreCheckItem(L, ifUd, 2);
+    luaL_checkany(L, 3);
+    if ( !lua_isnil(L, 3) )
+    {
+        value = dbus_message_ref(l2dbus_propStoreMarshal(L, 3,
+                                                        item->signature));
+    }
+
+    if ( NULL != item->value )
+    {
+        dbus_message_unref(item->value);
+    }
+    item->value = value;
+
+    return 0;
+}
+
+
+/**
+ @function getProperty
+ @within Interface
+
+ Returns the value of a property held by the property store.
+
+ @tparam userdata interface The Interface.
+ @tparam string name The name of a registered property.
+ @treturn any The (decoded) stored value or **nil** if there is none.
+ */
+int
+l2dbus_interfaceGetProperty
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_INTERFACE_TYPE_ID);
+    l2dbus_PropStoreItem* item;
+    l2dbus_TranscodeOpts opts;
+    DBusMessageIter valueIt;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    item = l2dbus_propStoreCheckItem(L, ifUd, 2);
+    if ( (NULL == item->value) ||
+        !dbus_message_iter_init(item->value, &valueIt) )
+    {
+        lua_pushnil(L);
+    }
+    else
+    {
+        memset(&opts, 0, sizeof(opts));
+        l2dbus_transcodeDbusIterToLua(L, item->value, &valueIt, &opts);
+    }
+
+    return 1;
+}
+
+
+/**
+ @function setPropertyHandler
+ @within Interface
+
+ Makes a property of the property store dynamic.
+
+ The value of a dynamic property is computed by calling the handler for
+ every **Get** (and **GetAll**) request instead of being stored. The
+ handler has the following signature:
+
+     any function onGetProperty(interface, name, userToken)
+
+ The value it returns is marshalled with the signature of the property.
+ If the handler throws an error (or returns a value that cannot be
+ marshalled) the client receives an error reply.
+
+ @tparam userdata interface The Interface.
+ @tparam string name The name of a registered property.
+ @tparam ?func|nil handler The handler or **nil** to make the property
+ static again.
+ @tparam ?any userToken Optional client data passed to the handler.
+ */
+int
+l2dbus_interfaceSetPropertyHandler
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_INTERFACE_TYPE_ID);
+    l2dbus_PropStoreItem* item;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    item = l2dbus_propStoreCheckItem(L, ifUd, 2);
+    if ( !lua_isnoneornil(L, 3) )
+    {
+        luaL_checktype(L, 3, LUA_TFUNCTION);
+    }
+
+    l2dbus_callbackUnref(L, &item->cbCtx);
+    l2dbus_callbackInit(&item->cbCtx);
+    if ( !lua_isnoneornil(L, 3) )
+    {
+        l2dbus_callbackRef(L, 3, lua_isnone(L, 4) ?
+                            L2DBUS_CALLBACK_NOREF_NEEDED : 4, &item->cbCtx);
+    }
+
+    return 0;
+}
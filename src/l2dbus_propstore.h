@@ -0,0 +1,84 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_propstore.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the C resident property store of an interface.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_PROPSTORE_H_
+#define L2DBUS_PROPSTORE_H_
+
+#include "lua.h"
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
+#include "l2dbus_callback.h"
+
+/* Forward declarations */
+struct cdbus_Connection;
+struct l2dbus_RefList;
+
+/* A property declared by an interface and its current value */
+typedef struct l2dbus_PropStoreItem
+{
+    /* Interned in the string pool of the context */
+    const char*             name;
+    const char*             signature;
+    l2dbus_Bool             read;
+    l2dbus_Bool             write;
+    /* A message holding the pre-marshalled value as its only argument */
+    DBusMessage*            value;
+    /* Computes the value of a dynamic property for every request */
+    l2dbus_CallbackCtx      cbCtx;
+} l2dbus_PropStoreItem;
+
+typedef struct l2dbus_PropStore
+{
+    l2dbus_PropStoreItem*   items;
+    unsigned                nItems;
+    unsigned                capacity;
+    /* Get/GetAll/Set are only handled natively once enabled */
+    l2dbus_Bool             enabled;
+} l2dbus_PropStore;
+
+void l2dbus_propStoreInit(l2dbus_PropStore* store);
+void l2dbus_propStoreClear(lua_State* L, l2dbus_PropStore* store);
+l2dbus_Bool l2dbus_propStoreAdd(l2dbus_PropStore* store, const char* name,
+                                const char* signature, l2dbus_Bool read,
+                                l2dbus_Bool write);
+DBusHandlerResult l2dbus_propStoreHandle(lua_State* L,
+                                        struct l2dbus_RefList* interfaces,
+                                        struct cdbus_Connection* conn,
+                                        DBusMessage* msg);
+
+int l2dbus_interfaceEnablePropertyStore(lua_State* L);
+int l2dbus_interfaceSetProperty(lua_State* L);
+int l2dbus_interfaceGetProperty(lua_State* L);
+int l2dbus_interfaceSetPropertyHandler(lua_State* L);
+
+#endif /* Guard for L2DBUS_PROPSTORE_H_ */
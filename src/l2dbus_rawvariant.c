@@ -0,0 +1,237 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_rawvariant.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the raw (undecoded) variant handle.
+ *===========================================================================
+ */
+#include <string.h>
+#include "l2dbus_compat.h"
+#include "l2dbus_rawvariant.h"
+#include "l2dbus_transcode.h"
+#include "l2dbus_object.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "lauxlib.h"
+
+/**
+ L2DBUS RawVariant
+
+ This section describes the Lua RawVariant class.
+
+ A RawVariant is returned in place of the decoded value of a D-Bus variant
+ when a message is unmarshalled with the *rawVariants* option (see
+ @{l2dbus.Message.getArgs|getArgs}). It references the variant inside the
+ original message so its value is only decoded when (and if) it is
+ requested. When a RawVariant is marshalled into a variant of another
+ message the serialized value is copied verbatim, preserving its exact
+ D-Bus type without any type inference. The original message must not be
+ modified while RawVariants reference it.
+
+ @namespace l2dbus.RawVariant
+ */
+
+
+/**
+ * @brief Creates a new RawVariant for the variant at the iterator position.
+ *
+ * The new RawVariant is left on the top of the Lua stack and holds a
+ * reference to the message.
+ *
+ * @param [in] L    The Lua state.
+ * @param [in] msg  The message containing the variant.
+ * @param [in] iter Iterator positioned at the variant.
+ */
+void
+l2dbus_rawVariantNew
+    (
+    lua_State*          L,
+    DBusMessage*        msg,
+    DBusMessageIter*    iter
+    )
+{
+    l2dbus_RawVariant* ud;
+
+    ud = (l2dbus_RawVariant*)l2dbus_objectNew(L, sizeof(*ud),
+                                            L2DBUS_RAW_VARIANT_TYPE_ID);
+    ud->msg = dbus_message_ref(msg);
+    ud->iter = *iter;
+}
+
+
+/**
+ * @brief Decodes the value of the RawVariant and pushes it on the stack.
+ *
+ * @param [in] L    The Lua state.
+ * @param [in] ud   The RawVariant.
+ */
+void
+l2dbus_rawVariantPushValue
+    (
+    lua_State*          L,
+    l2dbus_RawVariant*  ud
+    )
+{
+    DBusMessageIter subIter;
+    l2dbus_TranscodeOpts opts;
+
+    memset(&opts, 0, sizeof(opts));
+    dbus_message_iter_recurse(&ud->iter, &subIter);
+    l2dbus_transcodeDbusIterToLua(L, ud->msg, &subIter, &opts);
+}
+
+
+/**
+ * @brief Appends the (serialized) variant to a message.
+ *
+ * @param [in] ud       The RawVariant.
+ * @param [in] msgIt    The iterator to append the variant to.
+ * @return L2DBUS_TRUE if the variant is appended or L2DBUS_FALSE on
+ * failure.
+ */
+l2dbus_Bool
+l2dbus_rawVariantAppend
+    (
+    l2dbus_RawVariant*  ud,
+    DBusMessageIter*    msgIt
+    )
+{
+    return l2dbus_copyMessageValue(&ud->iter, msgIt);
+}
+
+
+/**
+ @function value
+ @within l2dbus.RawVariant
+
+ Decodes and returns the value of the variant.
+
+ @tparam userdata rawVariant The RawVariant.
+ @treturn any The decoded value.
+ */
+static int
+l2dbus_rawVariantValue
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_RawVariant* ud = (l2dbus_RawVariant*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_RAW_VARIANT_TYPE_ID);
+
+    l2dbus_rawVariantPushValue(L, ud);
+    return 1;
+}
+
+
+/**
+ @function signature
+ @within l2dbus.RawVariant
+
+ Returns the D-Bus signature of the value held by the variant.
+
+ @tparam userdata rawVariant The RawVariant.
+ @treturn string The signature of the value (e.g. "a{sv}").
+ */
+static int
+l2dbus_rawVariantSignature
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_RawVariant* ud = (l2dbus_RawVariant*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_RAW_VARIANT_TYPE_ID);
+    DBusMessageIter subIter;
+    char* signature;
+
+    dbus_message_iter_recurse(&ud->iter, &subIter);
+    signature = dbus_message_iter_get_signature(&subIter);
+    if ( NULL == signature )
+    {
+        luaL_error(L, "failed to get the variant signature");
+    }
+    lua_pushstring(L, signature);
+    dbus_free(signature);
+
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the RawVariant userdata.
+ *
+ * @return nil
+ */
+static int
+l2dbus_rawVariantDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_RawVariant* ud = (l2dbus_RawVariant*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_RAW_VARIANT_TYPE_ID);
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: RawVariant (userdata=%p)", ud));
+
+    if ( NULL != ud->msg )
+    {
+        dbus_message_unref(ud->msg);
+        ud->msg = NULL;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Define the methods of the RawVariant class
+ */
+static const luaL_Reg l2dbus_rawVariantMetaTable[] = {
+    {"value", l2dbus_rawVariantValue},
+    {"signature", l2dbus_rawVariantSignature},
+    {"__gc", l2dbus_rawVariantDispose},
+    {NULL, NULL},
+};
+
+
+/**
+ * @brief Creates the RawVariant sub-module.
+ *
+ * This function creates a metatable entry for the RawVariant userdata.
+ * A RawVariant can only be created by unmarshalling a message so no
+ * table is registered.
+ */
+void
+l2dbus_openRawVariant
+    (
+    lua_State*  L
+    )
+{
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_RAW_VARIANT_TYPE_ID,
+            l2dbus_rawVariantMetaTable));
+}
@@ -0,0 +1,1053 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_reconnect.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the restoration of a connection after a reconnect.
+ *===========================================================================
+ */
+#include <string.h>
+#include <assert.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_reconnect.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_dispatcher.h"
+#include "l2dbus_serviceobject.h"
+#include "l2dbus_cork.h"
+#include "l2dbus_core.h"
+#include "l2dbus_util.h"
+#include "l2dbus_object.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_tracering.h"
+#include "lauxlib.h"
+
+/* The delay before the first attempt to re-open a dropped connection */
+#define L2DBUS_RECONNECT_RETRY_MSEC         (250)
+/* The delay between attempts doubles up to this limit */
+#define L2DBUS_RECONNECT_MAX_RETRY_MSEC     (8000)
+
+
+/**
+ * @brief Prepares the reconnect state of a new Connection userdata.
+ *
+ * @param [in] connUd The (zeroed) connection userdata.
+ */
+void
+l2dbus_reconnectInit
+    (
+    l2dbus_Connection*  connUd
+    )
+{
+    l2dbus_Reconnect* rc = &connUd->reconnect;
+
+    rc->retryMsec = L2DBUS_RECONNECT_RETRY_MSEC;
+    rc->maxRetryMsec = L2DBUS_RECONNECT_MAX_RETRY_MSEC;
+    rc->nextRetryMsec = L2DBUS_RECONNECT_RETRY_MSEC;
+    l2dbus_callbackInit(&rc->cbCtx);
+}
+
+
+/**
+ * @brief Records how a connection was opened so it can be opened again.
+ *
+ * @param [in] connUd           The connection.
+ * @param [in] address          The address of the bus (or NULL for one of
+ *                              the standard buses).
+ * @param [in] busType          The standard bus (if there is no address).
+ * @param [in] privConn         L2DBUS_TRUE for a private connection.
+ * @param [in] exitOnDisconnect L2DBUS_TRUE if the application exits when
+ *                              the connection is dropped.
+ */
+void
+l2dbus_reconnectRecordOpen
+    (
+    l2dbus_Connection*  connUd,
+    const char*         address,
+    int                 busType,
+    l2dbus_Bool         privConn,
+    l2dbus_Bool         exitOnDisconnect
+    )
+{
+    l2dbus_Reconnect* rc = &connUd->reconnect;
+
+    rc->address = NULL;
+    if ( NULL != address )
+    {
+        rc->address = l2dbus_strDup(address);
+        if ( NULL == rc->address )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_WARN,
+                        "Failed to record the connection address"));
+            return;
+        }
+    }
+    rc->busType = busType;
+    rc->privConn = privConn;
+    rc->exitOnDisconnect = exitOnDisconnect;
+    rc->reopenable = L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Sends the RequestName call of a recorded bus name.
+ *
+ * The call is only queued. The reply is picked up by the reconnect filter
+ * so any number of names can be requested without a round trip each.
+ *
+ * @param [in] connUd The connection.
+ * @param [in] name   The recorded name.
+ * @return L2DBUS_TRUE if the call is queued.
+ */
+static l2dbus_Bool
+l2dbus_reconnectSendRequest
+    (
+    l2dbus_Connection*      connUd,
+    l2dbus_ReconnectName*   name
+    )
+{
+    DBusMessage* msg;
+    l2dbus_Bool queued = L2DBUS_FALSE;
+
+    name->serial = 0;
+    msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                    DBUS_INTERFACE_DBUS, "RequestName");
+    if ( (NULL != msg) &&
+        dbus_message_append_args(msg, DBUS_TYPE_STRING, &name->name,
+                                DBUS_TYPE_UINT32, &name->flags,
+                                DBUS_TYPE_INVALID) )
+    {
+        queued = dbus_connection_send(cdbus_connectionGetDBus(connUd->conn),
+                                    msg, &name->serial) ? L2DBUS_TRUE :
+                                                        L2DBUS_FALSE;
+        l2dbus_statsCountSent(&connUd->stats, msg, queued);
+        if ( queued )
+        {
+            l2dbus_traceRingRecord(connUd, msg, L2DBUS_TRACE_RING_SENT);
+        }
+    }
+
+    if ( !queued )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Failed to request name '%s'",
+                    name->name));
+        name->serial = 0;
+    }
+    if ( NULL != msg )
+    {
+        dbus_message_unref(msg);
+    }
+
+    return queued;
+}
+
+
+/**
+ * @brief Calls the handler of a requested name with the reply of the bus.
+ *
+ * The handler is called as handler(conn, name, result, errName, userToken).
+ *
+ * @param [in] connUd The connection.
+ * @param [in] name   The requested name.
+ * @param [in] reply  The method return or error message.
+ */
+static void
+l2dbus_reconnectDeliverName
+    (
+    l2dbus_Connection*      connUd,
+    l2dbus_ReconnectName*   name,
+    DBusMessage*            reply
+    )
+{
+    lua_State* L = l2dbus_callbackGetThread();
+    dbus_uint32_t result;
+    int top;
+    double cbStart;
+    int status;
+
+    assert( NULL != L );
+
+    if ( LUA_NOREF == name->cbCtx.funcRef )
+    {
+        return;
+    }
+
+    top = lua_gettop(L);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, name->cbCtx.funcRef);
+    l2dbus_objectRegistryGet(L, connUd->conn);
+    lua_pushstring(L, name->name);
+    if ( (DBUS_MESSAGE_TYPE_METHOD_RETURN == dbus_message_get_type(reply)) &&
+        dbus_message_get_args(reply, NULL, DBUS_TYPE_UINT32, &result,
+                            DBUS_TYPE_INVALID) )
+    {
+        lua_pushinteger(L, (lua_Integer)result);
+        lua_pushnil(L);
+    }
+    else
+    {
+        lua_pushnil(L);
+        lua_pushstring(L, (NULL != dbus_message_get_error_name(reply)) ?
+                        dbus_message_get_error_name(reply) :
+                        DBUS_ERROR_INVALID_ARGS);
+    }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, name->cbCtx.userRef);
+
+    cbStart = l2dbus_statsCallbackStart(L, 5 /* nArgs */);
+    status = lua_pcall(L, 5 /* nArgs */, 0 /* nResults */, 0);
+    l2dbus_statsCallback(L2DBUS_STATS_CB_NAME_HANDLER, cbStart, status);
+    if ( 0 != status )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Name handler error: %s",
+                    lua_isstring(L, -1) ? lua_tostring(L, -1) : ""));
+    }
+    lua_settop(L, top);
+
+    /* Reclaim any transient allocations made while servicing the callback */
+    l2dbus_arenaReset();
+}
+
+
+/**
+ * @brief Re-arms the timeout that re-opens a dropped connection.
+ *
+ * @param [in] connUd The connection.
+ * @param [in] msec   The delay before the next attempt.
+ */
+static void
+l2dbus_reconnectArm
+    (
+    l2dbus_Connection*  connUd,
+    unsigned            msec
+    )
+{
+    l2dbus_Reconnect* rc = &connUd->reconnect;
+
+    if ( NULL == rc->retryTimeout )
+    {
+        return;
+    }
+
+    /* Re-arming a one-shot timeout requires it be disabled first */
+    cdbus_timeoutEnable(rc->retryTimeout, CDBUS_FALSE);
+    cdbus_timeoutSetInterval(rc->retryTimeout, (cdbus_Int32)msec);
+    if ( CDBUS_FAILED(cdbus_timeoutEnable(rc->retryTimeout, CDBUS_TRUE)) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Failed to arm the reconnect timeout"));
+    }
+}
+
+
+/**
+ * @brief Watches for the loss of the connection and the replies to the
+ * RequestName calls of the recorded names.
+ */
+static DBusHandlerResult
+l2dbus_reconnectFilter
+    (
+    DBusConnection* dbusConn,
+    DBusMessage*    msg,
+    void*           user
+    )
+{
+    l2dbus_Connection* connUd = (l2dbus_Connection*)user;
+    l2dbus_Reconnect* rc = &connUd->reconnect;
+    l2dbus_ReconnectName* name;
+    dbus_uint32_t serial;
+    int msgType = dbus_message_get_type(msg);
+
+    if ( (DBUS_MESSAGE_TYPE_METHOD_RETURN == msgType) ||
+        (DBUS_MESSAGE_TYPE_ERROR == msgType) )
+    {
+        serial = dbus_message_get_reply_serial(msg);
+        for ( name = rc->names; NULL != name; name = name->next )
+        {
+            if ( (0 != name->serial) && (serial == name->serial) )
+            {
+                name->serial = 0;
+                l2dbus_reconnectDeliverName(connUd, name, msg);
+                return DBUS_HANDLER_RESULT_HANDLED;
+            }
+        }
+    }
+    else if ( dbus_message_is_signal(msg, DBUS_INTERFACE_LOCAL,
+                                    "Disconnected") )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN, "Connection (userdata=%p) dropped",
+                    connUd));
+        if ( rc->enabled && rc->autoReconnect )
+        {
+            rc->nextRetryMsec = rc->retryMsec;
+            l2dbus_reconnectArm(connUd, rc->nextRetryMsec);
+        }
+    }
+
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+
+/* Installs the reconnect filter the first time it's needed */
+static l2dbus_Bool
+l2dbus_reconnectAddFilter
+    (
+    l2dbus_Connection*  connUd
+    )
+{
+    l2dbus_Reconnect* rc = &connUd->reconnect;
+
+    if ( !rc->filterAdded )
+    {
+        rc->filterAdded = dbus_connection_add_filter(
+                                    cdbus_connectionGetDBus(connUd->conn),
+                                    l2dbus_reconnectFilter, connUd, NULL) ?
+                                    L2DBUS_TRUE : L2DBUS_FALSE;
+    }
+
+    return rc->filterAdded;
+}
+
+
+/**
+ * @brief Re-opens a connection and restores its recorded registrations.
+ *
+ * The recorded matches, service objects and subtrees are registered with
+ * the new connection and the RequestName calls of the recorded names are
+ * all queued before the connection is flushed once.
+ *
+ * @param [in] L      The Lua state.
+ * @param [in] connUd The connection.
+ * @return L2DBUS_TRUE if the connection was re-opened.
+ */
+static l2dbus_Bool
+l2dbus_reconnectRestore
+    (
+    lua_State*          L,
+    l2dbus_Connection*  connUd
+    )
+{
+    l2dbus_Reconnect* rc = &connUd->reconnect;
+    cdbus_Connection* oldConn = connUd->conn;
+    cdbus_Connection* newConn;
+    l2dbus_ReconnectObject* obj;
+    l2dbus_ReconnectName* name;
+    unsigned nNames = 0;
+
+    if ( !rc->reopenable )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN,
+                    "Connection (userdata=%p) cannot be re-opened", connUd));
+        return L2DBUS_FALSE;
+    }
+
+    /* A shared connection that is still up would just be handed back */
+    if ( !rc->privConn &&
+        dbus_connection_get_is_connected(cdbus_connectionGetDBus(oldConn)) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    if ( NULL != rc->address )
+    {
+        newConn = cdbus_connectionOpen(connUd->dispUd->disp, rc->address,
+                                    rc->privConn, rc->exitOnDisconnect);
+    }
+    else
+    {
+        newConn = cdbus_connectionOpenStandard(connUd->dispUd->disp,
+                                    (DBusBusType)rc->busType,
+                                    rc->privConn, rc->exitOnDisconnect);
+    }
+
+    if ( NULL == newConn )
+    {
+        rc->nFailures++;
+        L2DBUS_TRACE((L2DBUS_TRC_WARN,
+                    "Failed to re-open connection (userdata=%p)", connUd));
+        return L2DBUS_FALSE;
+    }
+
+    for ( obj = rc->objects; NULL != obj; obj = obj->next )
+    {
+        cdbus_connectionUnregisterObject(oldConn,
+                                    cdbus_objectGetPath(obj->svcObjUd->obj));
+    }
+    if ( rc->filterAdded )
+    {
+        dbus_connection_remove_filter(cdbus_connectionGetDBus(oldConn),
+                                    l2dbus_reconnectFilter, connUd);
+        rc->filterAdded = L2DBUS_FALSE;
+    }
+
+    /* Everything else moves with the connection and the old one is closed */
+    l2dbus_connectionSwap(L, connUd, newConn);
+
+    if ( !l2dbus_reconnectAddFilter(connUd) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Failed to add the reconnect filter"));
+    }
+    for ( obj = rc->objects; NULL != obj; obj = obj->next )
+    {
+        if ( !cdbus_connectionRegisterObject(newConn, obj->svcObjUd->obj) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_WARN, "Failed to restore object '%s'",
+                        cdbus_objectGetPath(obj->svcObjUd->obj)));
+        }
+    }
+
+    /* Messages held by a cork go out ahead of the name requests */
+    l2dbus_corkRelease(connUd, L2DBUS_FALSE);
+    for ( name = rc->names; NULL != name; name = name->next )
+    {
+        if ( l2dbus_reconnectSendRequest(connUd, name) )
+        {
+            ++nNames;
+        }
+    }
+    dbus_connection_flush(cdbus_connectionGetDBus(newConn));
+
+    rc->nReconnects++;
+    rc->nextRetryMsec = rc->retryMsec;
+    L2DBUS_TRACE((L2DBUS_TRC_INFO,
+                "Connection (userdata=%p) re-opened (#%lu, %u names requested)",
+                connUd, rc->nReconnects, nNames));
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Calls the reconnect handler with the outcome of an attempt.
+ *
+ * The handler is called as handler(conn, reconnected, userToken).
+ *
+ * @param [in] L           The Lua state.
+ * @param [in] connUd      The connection.
+ * @param [in] reconnected L2DBUS_TRUE if the connection was re-opened.
+ */
+static void
+l2dbus_reconnectNotify
+    (
+    lua_State*          L,
+    l2dbus_Connection*  connUd,
+    l2dbus_Bool         reconnected
+    )
+{
+    l2dbus_Reconnect* rc = &connUd->reconnect;
+    int top;
+    double cbStart;
+    int status;
+
+    if ( LUA_NOREF == rc->cbCtx.funcRef )
+    {
+        return;
+    }
+
+    top = lua_gettop(L);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, rc->cbCtx.funcRef);
+    l2dbus_objectRegistryGet(L, connUd->conn);
+    lua_pushboolean(L, reconnected);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, rc->cbCtx.userRef);
+
+    cbStart = l2dbus_statsCallbackStart(L, 3 /* nArgs */);
+    status = lua_pcall(L, 3 /* nArgs */, 0 /* nResults */, 0);
+    l2dbus_statsCallback(L2DBUS_STATS_CB_RECONNECT, cbStart, status);
+    if ( 0 != status )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Reconnect handler error: %s",
+                    lua_isstring(L, -1) ? lua_tostring(L, -1) : ""));
+    }
+    lua_settop(L, top);
+
+    /* Reclaim any transient allocations made while servicing the callback */
+    l2dbus_arenaReset();
+}
+
+
+/**
+ * @brief Tries to re-open a dropped connection.
+ *
+ * An attempt that fails is retried after twice the delay (up to the
+ * configured limit).
+ *
+ * @param [in] t      The CDBUS timeout instance.
+ * @param [in] user   The connection.
+ * @return A boolean value that is currently unused by CDBUS.
+ */
+static cdbus_Bool
+l2dbus_reconnectRetryHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    l2dbus_Connection* connUd = (l2dbus_Connection*)user;
+    l2dbus_Reconnect* rc = &connUd->reconnect;
+    lua_State* L = l2dbus_callbackGetThread();
+    l2dbus_Bool reconnected;
+
+    assert( NULL != t );
+    assert( NULL != L );
+
+    cdbus_timeoutEnable(t, CDBUS_FALSE);
+    reconnected = l2dbus_reconnectRestore(L, connUd);
+    if ( !reconnected && rc->enabled && rc->autoReconnect )
+    {
+        rc->nextRetryMsec *= 2;
+        if ( rc->nextRetryMsec > rc->maxRetryMsec )
+        {
+            rc->nextRetryMsec = rc->maxRetryMsec;
+        }
+        l2dbus_reconnectArm(connUd, rc->nextRetryMsec);
+    }
+    l2dbus_reconnectNotify(L, connUd, reconnected);
+
+    return CDBUS_TRUE;
+}
+
+
+/* Forgets a recorded service object */
+static void
+l2dbus_reconnectFreeObject
+    (
+    lua_State*              L,
+    l2dbus_ReconnectObject* obj
+    )
+{
+    luaL_unref(L, LUA_REGISTRYINDEX, obj->svcObjRef);
+    l2dbus_free(obj);
+}
+
+
+/* Forgets a recorded bus name */
+static void
+l2dbus_reconnectFreeName
+    (
+    lua_State*              L,
+    l2dbus_ReconnectName*   name
+    )
+{
+    l2dbus_callbackUnref(L, &name->cbCtx);
+    l2dbus_free(name->name);
+    l2dbus_free(name);
+}
+
+
+/**
+ * @brief Records a service object registered with the connection.
+ *
+ * Nothing is recorded unless restoration is enabled. The service object is
+ * referenced for as long as it is recorded.
+ *
+ * @param [in] L         The Lua state.
+ * @param [in] connUd    The connection.
+ * @param [in] svcObjIdx The stack index of the service object.
+ */
+void
+l2dbus_reconnectObjectRegistered
+    (
+    lua_State*          L,
+    l2dbus_Connection*  connUd,
+    int                 svcObjIdx
+    )
+{
+    l2dbus_Reconnect* rc = &connUd->reconnect;
+    l2dbus_ServiceObject* svcObjUd;
+    l2dbus_ReconnectObject* obj;
+
+    if ( !rc->enabled )
+    {
+        return;
+    }
+
+    svcObjUd = (l2dbus_ServiceObject*)lua_touserdata(L, svcObjIdx);
+    for ( obj = rc->objects; NULL != obj; obj = obj->next )
+    {
+        if ( svcObjUd == obj->svcObjUd )
+        {
+            return;
+        }
+    }
+
+    obj = (l2dbus_ReconnectObject*)l2dbus_malloc(sizeof(*obj));
+    if ( NULL == obj )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN,
+            "Failed to record service object (not restored on reconnect)"));
+        return;
+    }
+    obj->svcObjUd = svcObjUd;
+    lua_pushvalue(L, svcObjIdx);
+    obj->svcObjRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    obj->next = rc->objects;
+    rc->objects = obj;
+}
+
+
+/**
+ * @brief Forgets a service object unregistered from the connection.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] connUd   The connection.
+ * @param [in] svcObjUd The service object.
+ */
+void
+l2dbus_reconnectObjectUnregistered
+    (
+    lua_State*              L,
+    l2dbus_Connection*      connUd,
+    l2dbus_ServiceObject*   svcObjUd
+    )
+{
+    l2dbus_ReconnectObject** link = &connUd->reconnect.objects;
+    l2dbus_ReconnectObject* obj;
+
+    while ( NULL != *link )
+    {
+        obj = *link;
+        if ( svcObjUd == obj->svcObjUd )
+        {
+            *link = obj->next;
+            l2dbus_reconnectFreeObject(L, obj);
+            break;
+        }
+        link = &obj->next;
+    }
+}
+
+
+/**
+ * @brief Stops reconnecting and releases the recorded registrations.
+ *
+ * This must be called before the CDBUS connection is closed.
+ *
+ * @param [in] L      The Lua state.
+ * @param [in] connUd The connection being destroyed.
+ */
+void
+l2dbus_reconnectDispose
+    (
+    lua_State*          L,
+    l2dbus_Connection*  connUd
+    )
+{
+    l2dbus_Reconnect* rc = &connUd->reconnect;
+    l2dbus_ReconnectObject* obj;
+    l2dbus_ReconnectName* name;
+
+    if ( rc->filterAdded && (NULL != connUd->conn) )
+    {
+        dbus_connection_remove_filter(cdbus_connectionGetDBus(connUd->conn),
+                                    l2dbus_reconnectFilter, connUd);
+    }
+    rc->filterAdded = L2DBUS_FALSE;
+
+    if ( NULL != rc->retryTimeout )
+    {
+        cdbus_timeoutEnable(rc->retryTimeout, CDBUS_FALSE);
+        cdbus_timeoutUnref(rc->retryTimeout);
+        rc->retryTimeout = NULL;
+    }
+
+    while ( NULL != rc->objects )
+    {
+        obj = rc->objects;
+        rc->objects = obj->next;
+        l2dbus_reconnectFreeObject(L, obj);
+    }
+    while ( NULL != rc->names )
+    {
+        name = rc->names;
+        rc->names = name->next;
+        l2dbus_reconnectFreeName(L, name);
+    }
+
+    l2dbus_callbackUnref(L, &rc->cbCtx);
+    l2dbus_callbackInit(&rc->cbCtx);
+    l2dbus_free(rc->address);
+    rc->address = NULL;
+    rc->enabled = L2DBUS_FALSE;
+}
+
+
+/**
+ @function enableRestore
+ @within Connection
+
+ Records the registrations of the connection so they survive a reconnect.
+
+ While restoration is enabled the connection records the rules of the
+ matches (including @{subscribeSignal|signal subscriptions}) and the
+ @{registerServiceObject|service objects} registered with it. When the
+ connection is re-opened (see @{reconnect}) they are registered again
+ together with its @{registerSubtree|subtrees} and the bus names
+ @{requestName|requested} on it. The RequestName calls are all queued
+ before the connection is flushed once rather than waiting for each reply
+ in turn. Matches and service objects registered before restoration was
+ enabled are not recorded so it should be enabled right after the
+ connection is opened.
+
+ By default the connection is re-opened automatically when the bus drops
+ it. The optional *options* table can contain the following fields:
+
+ <ul>
+ <li>*autoReconnect*    - If **false** the connection is only re-opened by
+ calling @{reconnect}. The default is **true**.</li>
+ <li>*retryInterval*    - The delay (in milliseconds) before the first
+ attempt to re-open a dropped connection. Each failed attempt doubles the
+ delay. The default is 250 milliseconds.</li>
+ <li>*maxRetryInterval* - The longest delay (in milliseconds) between two
+ attempts. The default is 8000 milliseconds.</li>
+ <li>*handler*          - A function called after each attempt:
+ <br>function onReconnect(conn, reconnected, userToken)</li>
+ <li>*userToken*        - Optional user data passed to the handler.</li>
+ </ul>
+
+ A connection opened as a peer (or wrapped by a server) cannot be
+ re-opened. Requests sent with @{sendRouted} that are waiting when the
+ connection drops receive a NoReply error once they time out.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam bool enable **true** to record the registrations and **false**
+ to stop recording (and reconnecting).
+ @tparam ?table options Options controlling the automatic reconnect.
+ @see reconnect
+ */
+int
+l2dbus_connectionEnableRestore
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_Reconnect* rc;
+    l2dbus_ReconnectObject* obj;
+    l2dbus_Bool enable;
+    l2dbus_Bool autoReconnect = L2DBUS_TRUE;
+    lua_Number retryMsec = L2DBUS_RECONNECT_RETRY_MSEC;
+    lua_Number maxRetryMsec = L2DBUS_RECONNECT_MAX_RETRY_MSEC;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    luaL_checktype(L, 2, LUA_TBOOLEAN);
+    enable = lua_toboolean(L, 2) ? L2DBUS_TRUE : L2DBUS_FALSE;
+    rc = &connUd->reconnect;
+
+    if ( !enable )
+    {
+        if ( NULL != rc->retryTimeout )
+        {
+            cdbus_timeoutEnable(rc->retryTimeout, CDBUS_FALSE);
+        }
+        while ( NULL != rc->objects )
+        {
+            obj = rc->objects;
+            rc->objects = obj->next;
+            l2dbus_reconnectFreeObject(L, obj);
+        }
+        rc->enabled = L2DBUS_FALSE;
+        return 0;
+    }
+
+    if ( !lua_isnoneornil(L, 3) )
+    {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        lua_getfield(L, 3, "autoReconnect");
+        autoReconnect = lua_isnil(L, -1) || lua_toboolean(L, -1);
+        lua_getfield(L, 3, "retryInterval");
+        retryMsec = luaL_optnumber(L, -1, L2DBUS_RECONNECT_RETRY_MSEC);
+        lua_getfield(L, 3, "maxRetryInterval");
+        maxRetryMsec = luaL_optnumber(L, -1, L2DBUS_RECONNECT_MAX_RETRY_MSEC);
+        lua_pop(L, 3);
+    }
+
+    if ( (retryMsec <= 0) || (maxRetryMsec < retryMsec) )
+    {
+        luaL_error(L, "The retry interval must be positive and not exceed "
+                    "the maximum retry interval");
+    }
+
+    if ( !l2dbus_reconnectAddFilter(connUd) )
+    {
+        luaL_error(L, "Failed to add the reconnect filter");
+    }
+
+    /* The retry timeout is created the first time it's needed */
+    if ( autoReconnect && (NULL == rc->retryTimeout) )
+    {
+        rc->retryTimeout = cdbus_timeoutNew(connUd->dispUd->disp,
+                                    (cdbus_Int32)retryMsec, CDBUS_FALSE,
+                                    l2dbus_reconnectRetryHandler, connUd);
+        if ( NULL == rc->retryTimeout )
+        {
+            luaL_error(L, "Failed to allocate the reconnect timeout");
+        }
+    }
+
+    l2dbus_callbackUnref(L, &rc->cbCtx);
+    l2dbus_callbackInit(&rc->cbCtx);
+    if ( !lua_isnoneornil(L, 3) )
+    {
+        lua_getfield(L, 3, "handler");
+        lua_getfield(L, 3, "userToken");
+        if ( !lua_isnil(L, -2) )
+        {
+            luaL_checktype(L, -2, LUA_TFUNCTION);
+            l2dbus_callbackRef(L, -2, -1, &rc->cbCtx);
+        }
+        lua_pop(L, 2);
+    }
+
+    rc->enabled = L2DBUS_TRUE;
+    rc->autoReconnect = autoReconnect;
+    rc->retryMsec = (unsigned)retryMsec;
+    rc->maxRetryMsec = (unsigned)maxRetryMsec;
+    rc->nextRetryMsec = rc->retryMsec;
+
+    return 0;
+}
+
+
+/**
+ @function reconnect
+ @within Connection
+
+ Re-opens the connection and restores its registrations.
+
+ The connection is opened again with the address (or standard bus) and
+ options it was originally opened with and its recorded registrations are
+ restored (see @{enableRestore}). The Connection object (and every handle
+ returned by it) stays valid. A shared connection can only be re-opened
+ once the bus has dropped it. This should not be called from a handler
+ of a message received on the connection itself.
+
+ @tparam userdata conn The D-Bus connection object
+ @treturn bool Returns **true** if the connection was re-opened.
+ @see enableRestore
+ */
+int
+l2dbus_connectionReconnect
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    if ( NULL != connUd->reconnect.retryTimeout )
+    {
+        cdbus_timeoutEnable(connUd->reconnect.retryTimeout, CDBUS_FALSE);
+    }
+    lua_pushboolean(L, l2dbus_reconnectRestore(L, connUd));
+
+    return 1;
+}
+
+
+/**
+ @function requestName
+ @within Connection
+
+ Asks the bus to assign a (well-known) name to the connection.
+
+ Unlike calling RequestName with @{sendWithReplyAndBlock} the call does
+ not wait for the reply. Any number of names can be requested before the
+ first reply arrives. The reply is delivered to the optional handler:
+
+     function onName(conn, name, result, errName, userToken)
+
+ Where *result* is one of the
+ @{l2dbus.Dbus.REQUEST_NAME_REPLY_PRIMARY_OWNER|REQUEST_NAME_REPLY_*}
+ values or **nil** if the bus returned the error *errName*. The name is
+ remembered until it is @{releaseName|released} and requested again
+ whenever the connection is re-opened. Requesting a name a second time
+ replaces its flags and handler.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam string name The bus name to request.
+ @tparam ?number flags The
+ @{l2dbus.Dbus.NAME_FLAG_ALLOW_REPLACEMENT|NAME_FLAG_*} flags of the
+ request. Defaults to zero.
+ @tparam ?func handler The handler of the reply.
+ @tparam ?any userToken Optional user data passed to the handler.
+ @treturn bool Returns **true** if the request was queued.
+ @see releaseName
+ */
+int
+l2dbus_connectionRequestName
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_Reconnect* rc;
+    l2dbus_ReconnectName* name;
+    const char* busName;
+    dbus_uint32_t flags;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    busName = luaL_checkstring(L, 2);
+    flags = (dbus_uint32_t)luaL_optnumber(L, 3, 0);
+    if ( !lua_isnoneornil(L, 4) )
+    {
+        luaL_checktype(L, 4, LUA_TFUNCTION);
+    }
+    if ( !dbus_validate_bus_name(busName, NULL) )
+    {
+        luaL_argerror(L, 2, "invalid bus name");
+    }
+    rc = &connUd->reconnect;
+
+    if ( !l2dbus_reconnectAddFilter(connUd) )
+    {
+        luaL_error(L, "Failed to add the reconnect filter");
+    }
+
+    for ( name = rc->names; NULL != name; name = name->next )
+    {
+        if ( 0 == strcmp(name->name, busName) )
+        {
+            break;
+        }
+    }
+
+    if ( NULL == name )
+    {
+        name = (l2dbus_ReconnectName*)l2dbus_calloc(1, sizeof(*name));
+        if ( NULL != name )
+        {
+            name->name = l2dbus_strDup(busName);
+        }
+        if ( (NULL == name) || (NULL == name->name) )
+        {
+            l2dbus_free(name);
+            luaL_error(L, "Failed to allocate the name request");
+        }
+        l2dbus_callbackInit(&name->cbCtx);
+        name->next = rc->names;
+        rc->names = name;
+    }
+    else
+    {
+        l2dbus_callbackUnref(L, &name->cbCtx);
+        l2dbus_callbackInit(&name->cbCtx);
+    }
+
+    name->flags = flags;
+    if ( !lua_isnoneornil(L, 4) )
+    {
+        l2dbus_callbackRef(L, 4, lua_isnone(L, 5) ?
+                            L2DBUS_CALLBACK_NOREF_NEEDED : 5, &name->cbCtx);
+    }
+
+    /* Messages held by a cork must go out first */
+    l2dbus_corkRelease(connUd, L2DBUS_FALSE);
+    lua_pushboolean(L, l2dbus_reconnectSendRequest(connUd, name));
+
+    return 1;
+}
+
+
+/**
+ @function releaseName
+ @within Connection
+
+ Releases a name @{requestName|requested} by the connection.
+
+ The ReleaseName call is sent without waiting for (or expecting) a reply
+ and the name is no longer requested when the connection is re-opened.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam string name The bus name to release.
+ @treturn bool Returns **true** if the ReleaseName call was queued.
+ @see requestName
+ */
+int
+l2dbus_connectionReleaseName
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_ReconnectName** link;
+    l2dbus_ReconnectName* name;
+    const char* busName;
+    DBusMessage* msg;
+    dbus_uint32_t serial;
+    l2dbus_Bool queued = L2DBUS_FALSE;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    busName = luaL_checkstring(L, 2);
+
+    for ( link = &connUd->reconnect.names; NULL != *link;
+        link = &(*link)->next )
+    {
+        name = *link;
+        if ( 0 == strcmp(name->name, busName) )
+        {
+            *link = name->next;
+            l2dbus_reconnectFreeName(L, name);
+            break;
+        }
+    }
+
+    msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                    DBUS_INTERFACE_DBUS, "ReleaseName");
+    if ( (NULL != msg) &&
+        dbus_message_append_args(msg, DBUS_TYPE_STRING, &busName,
+                                DBUS_TYPE_INVALID) )
+    {
+        dbus_message_set_no_reply(msg, TRUE);
+        l2dbus_corkRelease(connUd, L2DBUS_FALSE);
+        queued = l2dbus_connectionQueue(connUd, msg, &serial);
+    }
+    if ( NULL != msg )
+    {
+        dbus_message_unref(msg);
+    }
+
+    lua_pushboolean(L, queued);
+
+    return 1;
+}
@@ -0,0 +1,108 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_reconnect.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the restoration of a connection after a reconnect.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_RECONNECT_H_
+#define L2DBUS_RECONNECT_H_
+
+#include "lua.h"
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
+#include "l2dbus_callback.h"
+
+/* Forward declarations */
+struct cdbus_Timeout;
+struct l2dbus_Connection;
+struct l2dbus_ServiceObject;
+
+/* A bus name requested with Connection:requestName */
+typedef struct l2dbus_ReconnectName
+{
+    struct l2dbus_ReconnectName*    next;
+    char*                           name;
+    dbus_uint32_t                   flags;
+    /* The serial of the outstanding RequestName call (zero if none) */
+    dbus_uint32_t                   serial;
+    l2dbus_CallbackCtx              cbCtx;
+} l2dbus_ReconnectName;
+
+/* A service object registered while the connection was recording */
+typedef struct l2dbus_ReconnectObject
+{
+    struct l2dbus_ReconnectObject*  next;
+    struct l2dbus_ServiceObject*    svcObjUd;
+    int                             svcObjRef;
+} l2dbus_ReconnectObject;
+
+typedef struct l2dbus_Reconnect
+{
+    /* How the connection was opened so it can be opened again */
+    l2dbus_Bool                     reopenable;
+    char*                           address;
+    int                             busType;
+    l2dbus_Bool                     privConn;
+    l2dbus_Bool                     exitOnDisconnect;
+    /* Record the registrations made on the connection */
+    l2dbus_Bool                     enabled;
+    l2dbus_Bool                     filterAdded;
+    /* Re-open the connection once the bus drops it */
+    l2dbus_Bool                     autoReconnect;
+    unsigned                        retryMsec;
+    unsigned                        maxRetryMsec;
+    unsigned                        nextRetryMsec;
+    struct cdbus_Timeout*           retryTimeout;
+    l2dbus_CallbackCtx              cbCtx;
+    l2dbus_ReconnectName*           names;
+    l2dbus_ReconnectObject*         objects;
+    unsigned long                   nReconnects;
+    unsigned long                   nFailures;
+} l2dbus_Reconnect;
+
+void l2dbus_reconnectInit(struct l2dbus_Connection* connUd);
+void l2dbus_reconnectRecordOpen(struct l2dbus_Connection* connUd,
+                                const char* address, int busType,
+                                l2dbus_Bool privConn,
+                                l2dbus_Bool exitOnDisconnect);
+void l2dbus_reconnectObjectRegistered(lua_State* L,
+                                struct l2dbus_Connection* connUd,
+                                int svcObjIdx);
+void l2dbus_reconnectObjectUnregistered(lua_State* L,
+                                struct l2dbus_Connection* connUd,
+                                struct l2dbus_ServiceObject* svcObjUd);
+void l2dbus_reconnectDispose(lua_State* L, struct l2dbus_Connection* connUd);
+
+int l2dbus_connectionEnableRestore(lua_State* L);
+int l2dbus_connectionReconnect(lua_State* L);
+int l2dbus_connectionRequestName(lua_State* L);
+int l2dbus_connectionReleaseName(lua_State* L);
+
+#endif /* Guard for L2DBUS_RECONNECT_H_ */
@@ -0,0 +1,937 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_replyrouter.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of reply routing by serial number.
+ *===========================================================================
+ */
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_replyrouter.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_dispatcher.h"
+#include "l2dbus_cork.h"
+#include "l2dbus_message.h"
+#include "l2dbus_object.h"
+#include "l2dbus_core.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_tracering.h"
+#include "lauxlib.h"
+
+/* A route identifier combines the slot generation with the slot index */
+#define L2DBUS_REPLY_ROUTE_BITS         (12)
+#define L2DBUS_REPLY_MAX_ROUTES         ((1 << L2DBUS_REPLY_ROUTE_BITS) - 1)
+#define L2DBUS_REPLY_ROUTE_MASK         (L2DBUS_REPLY_MAX_ROUTES)
+#define L2DBUS_REPLY_GEN_MASK           (0x7FFFFU)
+#define L2DBUS_REPLY_INITIAL_CAPACITY   (64)
+/* The timeout libdbus applies when the default timeout is requested */
+#define L2DBUS_REPLY_DEFAULT_MSEC       (25000)
+
+
+/* Maps a serial number onto its home slot of the request table */
+static unsigned
+l2dbus_replyRouterHome
+    (
+    const l2dbus_ReplyRouter*   router,
+    dbus_uint32_t               serial
+    )
+{
+    return (serial * 2654435761U) & (router->capacity - 1);
+}
+
+
+/**
+ * @brief Finds the waiting request with the given serial number.
+ *
+ * @return The index of the request in the table or -1 if there is none.
+ */
+static int
+l2dbus_replyRouterFind
+    (
+    const l2dbus_ReplyRouter*   router,
+    dbus_uint32_t               serial
+    )
+{
+    unsigned pos;
+
+    if ( (0 == router->nEntries) || (0 == serial) )
+    {
+        return -1;
+    }
+
+    pos = l2dbus_replyRouterHome(router, serial);
+    while ( 0 != router->entries[pos].serial )
+    {
+        if ( router->entries[pos].serial == serial )
+        {
+            return (int)pos;
+        }
+        pos = (pos + 1) & (router->capacity - 1);
+    }
+
+    return -1;
+}
+
+
+/* Places a request in a table known to have a free slot */
+static void
+l2dbus_replyRouterPlace
+    (
+    l2dbus_ReplyRouter*         router,
+    const l2dbus_ReplyEntry*    entry
+    )
+{
+    unsigned pos = l2dbus_replyRouterHome(router, entry->serial);
+
+    while ( 0 != router->entries[pos].serial )
+    {
+        pos = (pos + 1) & (router->capacity - 1);
+    }
+    router->entries[pos] = *entry;
+    router->nEntries++;
+}
+
+
+/**
+ * @brief Adds a waiting request to the table (growing it if needed).
+ *
+ * The load factor of the table is kept at or below 1/2.
+ *
+ * @return L2DBUS_TRUE if the request is added or L2DBUS_FALSE if memory
+ * could not be allocated.
+ */
+static l2dbus_Bool
+l2dbus_replyRouterInsert
+    (
+    l2dbus_ReplyRouter*         router,
+    const l2dbus_ReplyEntry*    entry
+    )
+{
+    l2dbus_ReplyEntry* old = router->entries;
+    unsigned oldCapacity = router->capacity;
+    unsigned capacity;
+    unsigned idx;
+
+    if ( 2 * (router->nEntries + 1) > router->capacity )
+    {
+        capacity = (0 == oldCapacity) ? L2DBUS_REPLY_INITIAL_CAPACITY :
+                                        2 * oldCapacity;
+        router->entries = (l2dbus_ReplyEntry*)l2dbus_calloc(capacity,
+                                                    sizeof(*old));
+        if ( NULL == router->entries )
+        {
+            router->entries = old;
+            return L2DBUS_FALSE;
+        }
+        router->capacity = capacity;
+        router->nEntries = 0;
+        for ( idx = 0; idx < oldCapacity; ++idx )
+        {
+            if ( 0 != old[idx].serial )
+            {
+                l2dbus_replyRouterPlace(router, &old[idx]);
+            }
+        }
+        l2dbus_free(old);
+    }
+
+    l2dbus_replyRouterPlace(router, entry);
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Removes a request from the table.
+ *
+ * The requests following it in the probe sequence are shifted back so
+ * the table never needs tombstones.
+ *
+ * @param [in] router The reply router.
+ * @param [in] pos    The index of the request to remove.
+ */
+static void
+l2dbus_replyRouterRemove
+    (
+    l2dbus_ReplyRouter* router,
+    unsigned            pos
+    )
+{
+    unsigned mask = router->capacity - 1;
+    unsigned next = (pos + 1) & mask;
+    unsigned home;
+
+    while ( 0 != router->entries[next].serial )
+    {
+        home = l2dbus_replyRouterHome(router, router->entries[next].serial);
+        /* Move the request back if its home is not between the hole and it */
+        if ( ((next - home) & mask) >= ((next - pos) & mask) )
+        {
+            router->entries[pos] = router->entries[next];
+            pos = next;
+        }
+        next = (next + 1) & mask;
+    }
+
+    router->entries[pos].serial = 0;
+    router->nEntries--;
+}
+
+
+/* Pushes a deadline on the min-heap */
+static l2dbus_Bool
+l2dbus_replyRouterPushDeadline
+    (
+    l2dbus_ReplyRouter* router,
+    double              deadline,
+    dbus_uint32_t       serial
+    )
+{
+    l2dbus_ReplyDeadline* heap;
+    unsigned capacity;
+    unsigned pos;
+    unsigned parent;
+
+    if ( router->heapSize == router->heapCapacity )
+    {
+        capacity = (0 == router->heapCapacity) ?
+                    L2DBUS_REPLY_INITIAL_CAPACITY : 2 * router->heapCapacity;
+        heap = (l2dbus_ReplyDeadline*)l2dbus_realloc(router->heap,
+                                                capacity * sizeof(*heap));
+        if ( NULL == heap )
+        {
+            return L2DBUS_FALSE;
+        }
+        router->heap = heap;
+        router->heapCapacity = capacity;
+    }
+
+    pos = router->heapSize++;
+    while ( pos > 0 )
+    {
+        parent = (pos - 1) / 2;
+        if ( router->heap[parent].deadline <= deadline )
+        {
+            break;
+        }
+        router->heap[pos] = router->heap[parent];
+        pos = parent;
+    }
+    router->heap[pos].deadline = deadline;
+    router->heap[pos].serial = serial;
+
+    return L2DBUS_TRUE;
+}
+
+
+/* Removes the earliest deadline from the min-heap */
+static void
+l2dbus_replyRouterPopDeadline
+    (
+    l2dbus_ReplyRouter* router
+    )
+{
+    l2dbus_ReplyDeadline last;
+    unsigned pos = 0;
+    unsigned child;
+
+    last = router->heap[--router->heapSize];
+    while ( (child = 2 * pos + 1) < router->heapSize )
+    {
+        if ( (child + 1 < router->heapSize) &&
+            (router->heap[child + 1].deadline < router->heap[child].deadline) )
+        {
+            ++child;
+        }
+        if ( last.deadline <= router->heap[child].deadline )
+        {
+            break;
+        }
+        router->heap[pos] = router->heap[child];
+        pos = child;
+    }
+    if ( 0 < router->heapSize )
+    {
+        router->heap[pos] = last;
+    }
+}
+
+
+/* Drops the deadlines of requests that were already answered */
+static void
+l2dbus_replyRouterPruneDeadlines
+    (
+    l2dbus_ReplyRouter* router
+    )
+{
+    int pos;
+
+    while ( 0 < router->heapSize )
+    {
+        pos = l2dbus_replyRouterFind(router, router->heap[0].serial);
+        if ( (0 <= pos) &&
+            (router->entries[pos].deadline == router->heap[0].deadline) )
+        {
+            break;
+        }
+        l2dbus_replyRouterPopDeadline(router);
+    }
+}
+
+
+/**
+ * @brief Arms the shared timeout for the earliest deadline.
+ *
+ * @param [in] router The reply router.
+ */
+static void
+l2dbus_replyRouterArm
+    (
+    l2dbus_ReplyRouter* router
+    )
+{
+    double delay;
+
+    if ( NULL == router->timeout )
+    {
+        return;
+    }
+
+    l2dbus_replyRouterPruneDeadlines(router);
+    if ( 0 == router->heapSize )
+    {
+        cdbus_timeoutEnable(router->timeout, CDBUS_FALSE);
+        router->armedDeadline = 0.0;
+    }
+    else if ( router->heap[0].deadline != router->armedDeadline )
+    {
+        delay = ceil((router->heap[0].deadline - l2dbus_monotonicTime()) *
+                    1000.0);
+        /* Re-arming a one-shot timeout requires it be disabled first */
+        cdbus_timeoutEnable(router->timeout, CDBUS_FALSE);
+        cdbus_timeoutSetInterval(router->timeout,
+                                (delay > 0.0) ? (cdbus_Int32)delay : 0);
+        if ( CDBUS_FAILED(cdbus_timeoutEnable(router->timeout, CDBUS_TRUE)) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                "Failed to arm the reply router timeout"));
+            router->armedDeadline = 0.0;
+        }
+        else
+        {
+            router->armedDeadline = router->heap[0].deadline;
+        }
+    }
+}
+
+
+/**
+ * @brief Calls the handler of a route with a reply.
+ *
+ * The handler is called as handler(conn, serial, reply, userToken).
+ *
+ * @param [in] connUd  The connection the request was sent on.
+ * @param [in] routeId The route of the request.
+ * @param [in] serial  The serial number of the request.
+ * @param [in] reply   The reply (or synthesized error) message.
+ */
+static void
+l2dbus_replyRouterDeliver
+    (
+    l2dbus_Connection*  connUd,
+    unsigned            routeId,
+    dbus_uint32_t       serial,
+    DBusMessage*        reply
+    )
+{
+    lua_State* L = l2dbus_callbackGetThread();
+    l2dbus_ReplyRouter* router = &connUd->replyRouter;
+    l2dbus_ReplyRoute* route;
+    unsigned routeIdx = (routeId & L2DBUS_REPLY_ROUTE_MASK) - 1;
+    int top;
+    double cbStart;
+    int status;
+
+    assert( NULL != L );
+
+    if ( routeIdx >= router->nRoutes )
+    {
+        return;
+    }
+    route = &router->routes[routeIdx];
+    if ( (route->gen != (routeId >> L2DBUS_REPLY_ROUTE_BITS)) ||
+        (LUA_NOREF == route->cbCtx.funcRef) )
+    {
+        /* The route was removed while the request was waiting */
+        return;
+    }
+
+    top = lua_gettop(L);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, route->cbCtx.funcRef);
+    l2dbus_objectRegistryGet(L, connUd->conn);
+    lua_pushnumber(L, serial);
+    l2dbus_messageWrap(L, reply, L2DBUS_TRUE);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, route->cbCtx.userRef);
+
+    cbStart = l2dbus_statsCallbackStart(L, 4 /* nArgs */);
+    status = lua_pcall(L, 4 /* nArgs */, 0 /* nResults */, 0);
+    l2dbus_statsCallback(L2DBUS_STATS_CB_REPLY_ROUTE, cbStart, status);
+    if ( 0 != status )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Reply handler error: %s",
+                    lua_isstring(L, -1) ? lua_tostring(L, -1) : ""));
+    }
+    lua_settop(L, top);
+
+    /* Reclaim any transient allocations made while servicing the callback */
+    l2dbus_arenaReset();
+}
+
+
+/**
+ * @brief Routes the replies to requests sent with sendRouted.
+ *
+ * Replies to requests that are not waiting are left to the other filters
+ * and handlers of the connection.
+ */
+static DBusHandlerResult
+l2dbus_replyRouterFilter
+    (
+    DBusConnection* dbusConn,
+    DBusMessage*    msg,
+    void*           user
+    )
+{
+    l2dbus_Connection* connUd = (l2dbus_Connection*)user;
+    l2dbus_ReplyRouter* router = &connUd->replyRouter;
+    int msgType = dbus_message_get_type(msg);
+    dbus_uint32_t serial;
+    unsigned routeId;
+    int pos;
+
+    if ( (DBUS_MESSAGE_TYPE_METHOD_RETURN != msgType) &&
+        (DBUS_MESSAGE_TYPE_ERROR != msgType) )
+    {
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+
+    serial = dbus_message_get_reply_serial(msg);
+    pos = l2dbus_replyRouterFind(router, serial);
+    if ( 0 > pos )
+    {
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+
+    routeId = router->entries[pos].routeId;
+    l2dbus_replyRouterRemove(router, (unsigned)pos);
+    l2dbus_replyRouterDeliver(connUd, routeId, serial, msg);
+
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+
+/**
+ * @brief Expires the requests whose deadline has passed.
+ *
+ * Each expired request is delivered a synthesized
+ * org.freedesktop.DBus.Error.NoReply error as libdbus does for a
+ * PendingCall that times out.
+ *
+ * @param [in] t      The CDBUS timeout instance.
+ * @param [in] user   The connection.
+ * @return A boolean value that is currently unused by CDBUS.
+ */
+static cdbus_Bool
+l2dbus_replyRouterTimeoutHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    l2dbus_Connection* connUd = (l2dbus_Connection*)user;
+    l2dbus_ReplyRouter* router = &connUd->replyRouter;
+    const char* errMsg = "Did not receive a reply before the timeout expired";
+    DBusMessage* reply;
+    dbus_uint32_t serial;
+    unsigned routeId;
+    double now = l2dbus_monotonicTime();
+    int pos;
+
+    assert( NULL != t );
+
+    router->armedDeadline = 0.0;
+    l2dbus_replyRouterPruneDeadlines(router);
+    while ( (0 < router->heapSize) && (router->heap[0].deadline <= now) )
+    {
+        serial = router->heap[0].serial;
+        l2dbus_replyRouterPopDeadline(router);
+        pos = l2dbus_replyRouterFind(router, serial);
+        routeId = router->entries[pos].routeId;
+        l2dbus_replyRouterRemove(router, (unsigned)pos);
+
+        reply = dbus_message_new(DBUS_MESSAGE_TYPE_ERROR);
+        if ( (NULL != reply) &&
+            dbus_message_set_error_name(reply, DBUS_ERROR_NO_REPLY) &&
+            dbus_message_set_reply_serial(reply, serial) &&
+            dbus_message_append_args(reply, DBUS_TYPE_STRING, &errMsg,
+                                    DBUS_TYPE_INVALID) )
+        {
+            l2dbus_replyRouterDeliver(connUd, routeId, serial, reply);
+        }
+        else
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                "Failed to allocate the timeout reply (serial #=%u)", serial));
+        }
+        if ( NULL != reply )
+        {
+            dbus_message_unref(reply);
+        }
+        l2dbus_replyRouterPruneDeadlines(router);
+    }
+
+    l2dbus_replyRouterArm(router);
+
+    return CDBUS_TRUE;
+}
+
+
+/**
+ * @brief Releases the routes and waiting requests of a connection.
+ *
+ * This must be called before the CDBUS connection is closed.
+ *
+ * @param [in] L      The Lua state.
+ * @param [in] connUd The connection being destroyed.
+ */
+void
+l2dbus_replyRouterDispose
+    (
+    lua_State*          L,
+    l2dbus_Connection*  connUd
+    )
+{
+    l2dbus_ReplyRouter* router = &connUd->replyRouter;
+    unsigned idx;
+
+    if ( router->filterAdded && (NULL != connUd->conn) )
+    {
+        dbus_connection_remove_filter(cdbus_connectionGetDBus(connUd->conn),
+                                    l2dbus_replyRouterFilter, connUd);
+    }
+    router->filterAdded = L2DBUS_FALSE;
+
+    if ( NULL != router->timeout )
+    {
+        cdbus_timeoutEnable(router->timeout, CDBUS_FALSE);
+        cdbus_timeoutUnref(router->timeout);
+        router->timeout = NULL;
+    }
+
+    for ( idx = 0; idx < router->nRoutes; ++idx )
+    {
+        l2dbus_callbackUnref(L, &router->routes[idx].cbCtx);
+    }
+    l2dbus_free(router->routes);
+    l2dbus_free(router->entries);
+    l2dbus_free(router->heap);
+    memset(router, 0, sizeof(*router));
+}
+
+
+/**
+ * @brief Moves the reply router filter to a re-opened connection.
+ *
+ * The requests waiting on the old connection are never answered so they
+ * are delivered a NoReply error once their timeout expires.
+ *
+ * @param [in] connUd   The connection (already holding the new CDBUS
+ * connection).
+ * @param [in] oldConn  The D-Bus connection being replaced.
+ */
+void
+l2dbus_replyRouterMove
+    (
+    l2dbus_Connection*  connUd,
+    DBusConnection*     oldConn
+    )
+{
+    l2dbus_ReplyRouter* router = &connUd->replyRouter;
+
+    if ( router->filterAdded )
+    {
+        dbus_connection_remove_filter(oldConn, l2dbus_replyRouterFilter,
+                                    connUd);
+        router->filterAdded = dbus_connection_add_filter(
+                                    cdbus_connectionGetDBus(connUd->conn),
+                                    l2dbus_replyRouterFilter, connUd, NULL) ?
+                                    L2DBUS_TRUE : L2DBUS_FALSE;
+        if ( !router->filterAdded )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                        "Failed to move the reply router filter"));
+        }
+    }
+}
+
+
+/**
+ @function addReplyHandler
+ @within Connection
+
+ Adds a handler for the replies of requests sent with @{sendRouted}.
+
+ Unlike @{sendWithReply} no @{l2dbus.PendingCall|PendingCall} is created
+ for each request. Instead the requests sent on a route are tracked by
+ serial number in C and every reply (or timeout) is delivered to the
+ single handler of the route. The handler has the following signature:
+
+     function onReply(conn, serial, reply, userToken)
+
+ Where *serial* is the serial number returned by @{sendRouted} and
+ *reply* is the method return or error @{l2dbus.Message|Message}. A
+ request that times out receives a (locally synthesized)
+ @{l2dbus.Dbus.ERROR_NO_REPLY|NoReply} error.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam func handler The reply handler.
+ @tparam ?any userToken Optional client data passed to the handler.
+ @treturn number The identifier of the route to pass to @{sendRouted}.
+ @see removeReplyHandler
+ */
+int
+l2dbus_connectionAddReplyHandler
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_ReplyRouter* router;
+    l2dbus_ReplyRoute* routes;
+    unsigned idx;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    router = &connUd->replyRouter;
+
+    if ( !router->filterAdded )
+    {
+        router->filterAdded = dbus_connection_add_filter(
+                                    cdbus_connectionGetDBus(connUd->conn),
+                                    l2dbus_replyRouterFilter, connUd, NULL) ?
+                                    L2DBUS_TRUE : L2DBUS_FALSE;
+        if ( !router->filterAdded )
+        {
+            luaL_error(L, "Failed to add the reply router filter");
+        }
+    }
+
+    if ( NULL == router->timeout )
+    {
+        router->timeout = cdbus_timeoutNew(connUd->dispUd->disp, 0,
+                                    CDBUS_FALSE,
+                                    l2dbus_replyRouterTimeoutHandler, connUd);
+        if ( NULL == router->timeout )
+        {
+            luaL_error(L, "Failed to allocate the reply router timeout");
+        }
+    }
+
+    /* Re-use the slot of a removed route if there is one */
+    for ( idx = 0; idx < router->nRoutes; ++idx )
+    {
+        if ( LUA_NOREF == router->routes[idx].cbCtx.funcRef )
+        {
+            break;
+        }
+    }
+
+    if ( idx == router->nRoutes )
+    {
+        if ( L2DBUS_REPLY_MAX_ROUTES == router->nRoutes )
+        {
+            luaL_error(L, "Too many reply handlers on the connection");
+        }
+        routes = (l2dbus_ReplyRoute*)l2dbus_realloc(router->routes,
+                                    (router->nRoutes + 1) * sizeof(*routes));
+        if ( NULL == routes )
+        {
+            luaL_error(L, "Failed to allocate the reply handler");
+        }
+        router->routes = routes;
+        routes[idx].gen = 0;
+        router->nRoutes++;
+    }
+
+    l2dbus_callbackInit(&router->routes[idx].cbCtx);
+    l2dbus_callbackRef(L, 2, lua_isnone(L, 3) ?
+                        L2DBUS_CALLBACK_NOREF_NEEDED : 3,
+                        &router->routes[idx].cbCtx);
+    lua_pushinteger(L, (lua_Integer)((router->routes[idx].gen <<
+                                    L2DBUS_REPLY_ROUTE_BITS) | (idx + 1)));
+
+    return 1;
+}
+
+
+/* Returns the route slot identified at the Lua stack index (or NULL) */
+static l2dbus_ReplyRoute*
+l2dbus_replyRouterGetRoute
+    (
+    lua_State*          L,
+    l2dbus_ReplyRouter* router,
+    int                 idIdx,
+    unsigned*           routeId
+    )
+{
+    lua_Integer id = luaL_checkinteger(L, idIdx);
+    unsigned routeIdx = ((unsigned)id & L2DBUS_REPLY_ROUTE_MASK) - 1;
+    l2dbus_ReplyRoute* route;
+
+    if ( (id <= 0) || (routeIdx >= router->nRoutes) )
+    {
+        return NULL;
+    }
+
+    route = &router->routes[routeIdx];
+    if ( (route->gen != ((unsigned)id >> L2DBUS_REPLY_ROUTE_BITS)) ||
+        (LUA_NOREF == route->cbCtx.funcRef) )
+    {
+        return NULL;
+    }
+
+    *routeId = (unsigned)id;
+    return route;
+}
+
+
+/**
+ @function removeReplyHandler
+ @within Connection
+
+ Removes a reply handler added with @{addReplyHandler}.
+
+ The replies of requests still waiting on the route are discarded when
+ they arrive (or time out).
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam number route The identifier of the route.
+ @treturn bool Returns **true** if the handler is removed or **false** if
+ there was no such route.
+ */
+int
+l2dbus_connectionRemoveReplyHandler
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_ReplyRoute* route;
+    unsigned routeId;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    route = l2dbus_replyRouterGetRoute(L, &connUd->replyRouter, 2, &routeId);
+    if ( NULL != route )
+    {
+        l2dbus_callbackUnref(L, &route->cbCtx);
+        l2dbus_callbackInit(&route->cbCtx);
+        route->gen = (route->gen + 1) & L2DBUS_REPLY_GEN_MASK;
+    }
+    lua_pushboolean(L, NULL != route);
+
+    return 1;
+}
+
+
+/**
+ @function sendRouted
+ @within Connection
+
+ Sends a method call whose reply is delivered to a reply handler.
+
+ See @{addReplyHandler} for how the reply is delivered. The reply
+ handler is never called from within this method.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam userdata msg The D-Bus method call to send
+ @tparam number route The identifier of the route returned by
+ @{addReplyHandler}.
+ @tparam ?number timeout An optional timeout in milliseconds to wait for a
+ reply. Two special values are allowed as well:
+ @{l2dbus.Dbus.TIMEOUT_USE_DEFAULT|TIMEOUT_USE_DEFAULT}
+ and @{l2dbus.Dbus.TIMEOUT_INFINITE|TIMEOUT_INFINITE}. The default
+ value (if none is specified) is @{l2dbus.Dbus.TIMEOUT_USE_DEFAULT|TIMEOUT_USE_DEFAULT}.
+ @treturn bool Returns **true** if the message is queued to be sent and
+ **false** otherwise.
+ @treturn number If the message is queued successfully then this will be
+ the serial number passed to the reply handler otherwise this is zero (0).
+ */
+int
+l2dbus_connectionSendRouted
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_Message* msgUd;
+    l2dbus_ReplyRouter* router;
+    l2dbus_ReplyEntry entry;
+    dbus_uint32_t serialNum = 0;
+    l2dbus_Bool queued = L2DBUS_FALSE;
+    int msecTimeout;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    msgUd = (l2dbus_Message*)l2dbus_checkUserData(L, 2, L2DBUS_MESSAGE_TYPE_ID);
+    router = &connUd->replyRouter;
+    if ( NULL == l2dbus_replyRouterGetRoute(L, router, 3, &entry.routeId) )
+    {
+        luaL_argerror(L, 3, "unknown reply handler route");
+    }
+    msecTimeout = luaL_optint(L, 4, DBUS_TIMEOUT_USE_DEFAULT);
+    if ( DBUS_MESSAGE_TYPE_METHOD_CALL != dbus_message_get_type(msgUd->msg) )
+    {
+        luaL_argerror(L, 2, "expected a method call");
+    }
+
+    /* Messages held by a cork must go out first */
+    l2dbus_corkRelease(connUd, L2DBUS_FALSE);
+
+    entry.deadline = 0.0;
+    if ( DBUS_TIMEOUT_INFINITE != msecTimeout )
+    {
+        entry.deadline = l2dbus_monotonicTime() +
+                    (((DBUS_TIMEOUT_USE_DEFAULT == msecTimeout) ||
+                    (0 > msecTimeout)) ? L2DBUS_REPLY_DEFAULT_MSEC :
+                                        msecTimeout) / 1000.0;
+    }
+
+    /* The request must be waiting before its reply can be dispatched */
+    dbus_message_set_no_reply(msgUd->msg, FALSE);
+    if ( dbus_connection_send(cdbus_connectionGetDBus(connUd->conn),
+                            msgUd->msg, &serialNum) )
+    {
+        queued = L2DBUS_TRUE;
+        entry.serial = serialNum;
+        if ( !l2dbus_replyRouterInsert(router, &entry) ||
+            ((0.0 != entry.deadline) &&
+            !l2dbus_replyRouterPushDeadline(router, entry.deadline,
+                                            serialNum)) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                "Failed to track the reply (serial #=%u)", serialNum));
+            if ( 0 <= l2dbus_replyRouterFind(router, serialNum) )
+            {
+                l2dbus_replyRouterRemove(router, (unsigned)
+                                l2dbus_replyRouterFind(router, serialNum));
+            }
+            queued = L2DBUS_FALSE;
+            serialNum = 0;
+        }
+        else if ( 0.0 != entry.deadline )
+        {
+            l2dbus_replyRouterArm(router);
+        }
+    }
+
+    l2dbus_statsCountSent(&connUd->stats, msgUd->msg, queued);
+    if ( queued )
+    {
+        l2dbus_traceRingRecord(connUd, msgUd->msg, L2DBUS_TRACE_RING_SENT);
+    }
+    L2DBUS_TRACE_MSG((L2DBUS_TRC_TRACE, msgUd->msg));
+    lua_pushboolean(L, queued);
+    lua_pushnumber(L, serialNum);
+
+    return 2;
+}
+
+
+/**
+ @function cancelRouted
+ @within Connection
+
+ Stops waiting for the reply of a request sent with @{sendRouted}.
+
+ The reply handler is not called for the request, even if its reply
+ arrives later.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam number serial The serial number returned by @{sendRouted}.
+ @treturn bool Returns **true** if the request was waiting for its reply.
+ @treturn number The number of requests still waiting for their reply.
+ */
+int
+l2dbus_connectionCancelRouted
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_ReplyRouter* router;
+    lua_Number serial;
+    int pos;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    serial = luaL_checknumber(L, 2);
+    router = &connUd->replyRouter;
+
+    pos = ((serial > 0) && (serial <= 0xFFFFFFFFU)) ?
+            l2dbus_replyRouterFind(router, (dbus_uint32_t)serial) : -1;
+    if ( 0 <= pos )
+    {
+        /* Its deadline is dropped when it reaches the top of the heap */
+        l2dbus_replyRouterRemove(router, (unsigned)pos);
+    }
+    lua_pushboolean(L, 0 <= pos);
+    lua_pushinteger(L, router->nEntries);
+
+    return 2;
+}
@@ -0,0 +1,95 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_replyrouter.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of reply routing by serial number.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_REPLYROUTER_H_
+#define L2DBUS_REPLYROUTER_H_
+
+#include "lua.h"
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
+#include "l2dbus_callback.h"
+
+/* Forward declarations */
+struct cdbus_Timeout;
+struct l2dbus_Connection;
+
+/* A reply handler shared by every request sent on its route */
+typedef struct l2dbus_ReplyRoute
+{
+    l2dbus_CallbackCtx          cbCtx;
+    /* Distinguishes the re-uses of the same route slot */
+    unsigned                    gen;
+} l2dbus_ReplyRoute;
+
+/* A request waiting for its reply (a zero serial marks a free slot) */
+typedef struct l2dbus_ReplyEntry
+{
+    dbus_uint32_t               serial;
+    unsigned                    routeId;
+    double                      deadline;
+} l2dbus_ReplyEntry;
+
+/* The deadline of a request with a timeout */
+typedef struct l2dbus_ReplyDeadline
+{
+    double                      deadline;
+    dbus_uint32_t               serial;
+} l2dbus_ReplyDeadline;
+
+typedef struct l2dbus_ReplyRouter
+{
+    l2dbus_ReplyRoute*          routes;
+    unsigned                    nRoutes;
+    /* Open addressed (linear probing) table of waiting requests */
+    l2dbus_ReplyEntry*          entries;
+    unsigned                    capacity;
+    unsigned                    nEntries;
+    /* Min-heap of deadlines (entries of answered requests are stale) */
+    l2dbus_ReplyDeadline*       heap;
+    unsigned                    heapSize;
+    unsigned                    heapCapacity;
+    struct cdbus_Timeout*       timeout;
+    double                      armedDeadline;
+    l2dbus_Bool                 filterAdded;
+} l2dbus_ReplyRouter;
+
+void l2dbus_replyRouterDispose(lua_State* L, struct l2dbus_Connection* connUd);
+void l2dbus_replyRouterMove(struct l2dbus_Connection* connUd,
+                            DBusConnection* oldConn);
+
+int l2dbus_connectionAddReplyHandler(lua_State* L);
+int l2dbus_connectionRemoveReplyHandler(lua_State* L);
+int l2dbus_connectionSendRouted(lua_State* L);
+int l2dbus_connectionCancelRouted(lua_State* L);
+
+#endif /* Guard for L2DBUS_REPLYROUTER_H_ */
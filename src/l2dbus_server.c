@@ -0,0 +1,730 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_server.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of a D-Bus peer-to-peer server object
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <assert.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_server.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_dispatcher.h"
+#include "l2dbus_core.h"
+#include "l2dbus_object.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_stats.h"
+
+/**
+ L2DBUS Server
+
+ This section describes a L2DBUS Server class which listens for direct
+ (peer-to-peer) D-Bus connections.
+
+ A Server accepts connections from peers that open its address with
+ @{l2dbus.Connection.openPeer|Connection.openPeer}. Messages exchanged over
+ these connections do not pass through a bus daemon so there is one less
+ hop (and one less copy) for every message. Each accepted connection is
+ handed to the *onNewConnection* handler as a regular
+ @{l2dbus.Connection|Connection} that can be used by
+ @{l2dbus.proxyctrl|ProxyController} and @{l2dbus.service|Service} objects
+ just like a bus connection, except that there are no bus names.
+
+ The Server and the accepted connections are driven by the
+ @{l2dbus.Dispatcher|Dispatcher} main loop. The Server stops listening when
+ it's garbage collected and an accepted connection is closed when it's
+ garbage collected, so the client must keep a reference to both of them.
+ By default only peers authenticated as the same user are accepted.
+
+ @namespace l2dbus.Server
+ */
+
+
+/**
+ * @brief Dispatches activity on a server descriptor to D-Bus.
+ *
+ * @param [in] w            CDBUS Watch instance.
+ * @param [in] rcvEvents    The bitmask of signaled events.
+ * @param [in] user         The D-Bus watch being serviced.
+ * @return A boolean value that is ignored by CDBUS.
+ */
+static cdbus_Bool
+l2dbus_serverWatchHandler
+    (
+    cdbus_Watch*    w,
+    cdbus_UInt32    rcvEvents,
+    void*           user
+    )
+{
+    assert( NULL != user );
+
+    /* A new connection is reported from within the handler */
+    dbus_watch_handle((DBusWatch*)user, rcvEvents);
+
+    return CDBUS_TRUE;
+}
+
+
+/**
+ * @brief Called by D-Bus to add a server watch.
+ *
+ * @param [in] watch    The D-Bus watch to add.
+ * @param [in] data     The Server userdata.
+ * @return TRUE if the watch was added, FALSE otherwise.
+ */
+static dbus_bool_t
+l2dbus_serverAddWatch
+    (
+    DBusWatch*  watch,
+    void*       data
+    )
+{
+    l2dbus_Server* ud = (l2dbus_Server*)data;
+    cdbus_Watch* w;
+
+    w = cdbus_watchNew(ud->dispUd->disp, dbus_watch_get_unix_fd(watch),
+                        dbus_watch_get_flags(watch),
+                        l2dbus_serverWatchHandler, watch);
+    if ( NULL == w )
+    {
+        return FALSE;
+    }
+
+    dbus_watch_set_data(watch, w, NULL);
+    cdbus_watchEnable(w, dbus_watch_get_enabled(watch) ?
+                        CDBUS_TRUE : CDBUS_FALSE);
+
+    return TRUE;
+}
+
+
+/**
+ * @brief Called by D-Bus to remove a server watch.
+ *
+ * @param [in] watch    The D-Bus watch to remove.
+ * @param [in] data     The Server userdata.
+ */
+static void
+l2dbus_serverRemoveWatch
+    (
+    DBusWatch*  watch,
+    void*       data
+    )
+{
+    cdbus_Watch* w = (cdbus_Watch*)dbus_watch_get_data(watch);
+
+
+    if ( NULL != w )
+    {
+        cdbus_watchEnable(w, CDBUS_FALSE);
+        cdbus_watchUnref(w);
+        dbus_watch_set_data(watch, NULL, NULL);
+    }
+}
+
+
+/**
+ * @brief Called by D-Bus when a server watch is enabled or disabled.
+ *
+ * @param [in] watch    The D-Bus watch that was toggled.
+ * @param [in] data     The Server userdata.
+ */
+static void
+l2dbus_serverToggleWatch
+    (
+    DBusWatch*  watch,
+    void*       data
+    )
+{
+    cdbus_Watch* w = (cdbus_Watch*)dbus_watch_get_data(watch);
+
+
+    if ( NULL != w )
+    {
+        cdbus_watchSetFlags(w, dbus_watch_get_flags(watch));
+        cdbus_watchEnable(w, dbus_watch_get_enabled(watch) ?
+                            CDBUS_TRUE : CDBUS_FALSE);
+    }
+}
+
+
+/**
+ * @brief Dispatches an expired server timeout to D-Bus.
+ *
+ * @param [in] t        CDBUS Timeout instance.
+ * @param [in] user     The D-Bus timeout being serviced.
+ * @return A boolean value that is ignored by CDBUS.
+ */
+static cdbus_Bool
+l2dbus_serverTimeoutHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    assert( NULL != user );
+
+    dbus_timeout_handle((DBusTimeout*)user);
+
+    return CDBUS_TRUE;
+}
+
+
+/**
+ * @brief Called by D-Bus to add a server timeout.
+ *
+ * @param [in] timeout  The D-Bus timeout to add.
+ * @param [in] data     The Server userdata.
+ * @return TRUE if the timeout was added, FALSE otherwise.
+ */
+static dbus_bool_t
+l2dbus_serverAddTimeout
+    (
+    DBusTimeout*    timeout,
+    void*           data
+    )
+{
+    l2dbus_Server* ud = (l2dbus_Server*)data;
+    cdbus_Timeout* t;
+
+    t = cdbus_timeoutNew(ud->dispUd->disp, dbus_timeout_get_interval(timeout),
+                        CDBUS_TRUE, l2dbus_serverTimeoutHandler, timeout);
+    if ( NULL == t )
+    {
+        return FALSE;
+    }
+
+    dbus_timeout_set_data(timeout, t, NULL);
+    cdbus_timeoutEnable(t, dbus_timeout_get_enabled(timeout) ?
+                        CDBUS_TRUE : CDBUS_FALSE);
+
+    return TRUE;
+}
+
+
+/**
+ * @brief Called by D-Bus to remove a server timeout.
+ *
+ * @param [in] timeout  The D-Bus timeout to remove.
+ * @param [in] data     The Server userdata.
+ */
+static void
+l2dbus_serverRemoveTimeout
+    (
+    DBusTimeout*    timeout,
+    void*           data
+    )
+{
+    cdbus_Timeout* t = (cdbus_Timeout*)dbus_timeout_get_data(timeout);
+
+
+    if ( NULL != t )
+    {
+        cdbus_timeoutEnable(t, CDBUS_FALSE);
+        cdbus_timeoutUnref(t);
+        dbus_timeout_set_data(timeout, NULL, NULL);
+    }
+}
+
+
+/**
+ * @brief Called by D-Bus when a server timeout is enabled or disabled.
+ *
+ * @param [in] timeout  The D-Bus timeout that was toggled.
+ * @param [in] data     The Server userdata.
+ */
+static void
+l2dbus_serverToggleTimeout
+    (
+    DBusTimeout*    timeout,
+    void*           data
+    )
+{
+    cdbus_Timeout* t = (cdbus_Timeout*)dbus_timeout_get_data(timeout);
+
+
+    if ( NULL != t )
+    {
+        cdbus_timeoutSetInterval(t, dbus_timeout_get_interval(timeout));
+        cdbus_timeoutEnable(t, dbus_timeout_get_enabled(timeout) ?
+                            CDBUS_TRUE : CDBUS_FALSE);
+    }
+}
+
+
+/**
+ * @brief Wraps and delivers an accepted connection in protected mode.
+ *
+ * Expects the handler, the Server userdata, the user token, the
+ * Dispatcher userdata and the D-Bus connection (light userdata) on the
+ * stack.
+ *
+ * @param [in] L    Lua state.
+ * @return Nothing
+ */
+static int
+l2dbus_serverDeliverConnection
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_connectionNewPeer(L, 4, (DBusConnection*)lua_touserdata(L, 5));
+
+    /* Call onNewConnection(server, conn, userToken) */
+    lua_pushvalue(L, 1);
+    lua_pushvalue(L, 2);
+    lua_pushvalue(L, -3);
+    lua_pushvalue(L, 3);
+    lua_call(L, 3, 0);
+
+    return 0;
+}
+
+
+/**
+ * @brief Called by D-Bus when a peer connects to the server.
+ *
+ * The connection is only kept if the handler succeeds in wrapping it.
+ * Otherwise D-Bus closes it once this function returns.
+ *
+ * @param [in] server   The D-Bus server.
+ * @param [in] dbusConn The newly accepted D-Bus connection.
+ * @param [in] data     The Server userdata.
+ */
+static void
+l2dbus_serverNewConnection
+    (
+    DBusServer*     server,
+    DBusConnection* dbusConn,
+    void*           data
+    )
+{
+    lua_State* L = l2dbus_callbackGetThread();
+    const char* errMsg = "";
+    l2dbus_Server* ud;
+    double cbStart;
+    int status;
+
+    assert( NULL != L );
+
+    lua_pushcfunction(L, l2dbus_serverDeliverConnection);
+    ud = l2dbus_objectRegistryGet(L, data);
+
+    if ( NULL == ud )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN,
+            "Cannot accept connection because the server has been GC'ed"));
+    }
+    else
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.funcRef);
+        lua_insert(L, -2);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.userRef);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->dispUdRef);
+        lua_pushlightuserdata(L, dbusConn);
+
+        /* The handler (not the C function wrapping it) is the first
+         * argument: hand it to the watchdog so it's accounted by name.
+         */
+        cbStart = l2dbus_statsCallbackStart(L, 4 /* nArgs */);
+        status = lua_pcall(L, 5 /* nArgs */, 0, 0);
+        l2dbus_statsCallback(L2DBUS_STATS_CB_SERVER, cbStart, status);
+        if ( 0 != status )
+        {
+            if ( lua_isstring(L, -1) )
+            {
+                errMsg = lua_tostring(L, -1);
+            }
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Server callback error: %s", errMsg));
+        }
+    }
+
+    /* Clean up the thread stack */
+    lua_settop(L, 0);
+
+    /* Reclaim any transient allocations made while servicing the callback */
+    l2dbus_arenaReset();
+}
+
+
+/**
+ @function new
+
+ Creates a new Server listening on the given address.
+
+ The server starts listening immediately and accepts connections while
+ the @{l2dbus.Dispatcher|Dispatcher} runs. Every accepted connection is
+ passed to a handler with a signature of the form:
+
+    function onNewConnection(server, conn, userToken)
+
+ Where:
+
+ <ul>
+ <li>*server*       - The L2DBUS Server instance</li>
+ <li>*conn*         - The accepted peer @{l2dbus.Connection|Connection}</li>
+ <li>*userToken*    - A value specified by the client when the server is created.</li>
+ </ul>
+
+ The handler must keep a reference to the connection or it will be
+ closed when it's garbage collected.
+
+ @tparam userdata dispatcher The @{l2dbus.Dispatcher|dispatcher} with which
+ to associate the Server and the connections it accepts.
+ @tparam string address The D-Bus address to listen on (e.g.
+ "unix:tmpdir=/tmp" or "tcp:host=localhost,port=0").
+ @tparam func onNewConnection The handler called for each accepted
+ connection.
+ @tparam ?any userToken User data that will be passed to the handler when
+ it's called. Can be any Lua value.
+ @treturn userdata The userdata object representing the Server.
+ */
+static int
+l2dbus_newServer
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Server* serverUd;
+    l2dbus_Dispatcher* dispUd;
+    const char* address;
+    DBusError dbusError;
+    int userIdx = L2DBUS_CALLBACK_NOREF_NEEDED;
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Create: server"));
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    dispUd = (l2dbus_Dispatcher*)l2dbus_checkUserData(L, 1,
+                                L2DBUS_DISPATCHER_TYPE_ID);
+    address = luaL_checkstring(L, 2);
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+
+    /* See if an optional user value is provided */
+    if ( lua_gettop(L) >= 4 )
+    {
+        userIdx = 4;
+    }
+
+    serverUd = (l2dbus_Server*)l2dbus_objectNew(L, sizeof(*serverUd),
+                                             L2DBUS_SERVER_TYPE_ID);
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Server userdata=%p", serverUd));
+
+    if ( NULL == serverUd )
+    {
+        luaL_error(L, "Failed to create server userdata!");
+    }
+
+    /* Reset the userdata structure */
+    l2dbus_callbackInit(&serverUd->cbCtx);
+    serverUd->dispUdRef = LUA_NOREF;
+    serverUd->dispUd = dispUd;
+
+    dbus_error_init(&dbusError);
+    serverUd->server = dbus_server_listen(address, &dbusError);
+    if ( NULL == serverUd->server )
+    {
+        lua_pushfstring(L, "Failed to listen on %s (%s)", address,
+                        dbus_error_is_set(&dbusError) ?
+                        dbusError.message : "unknown error");
+        dbus_error_free(&dbusError);
+        lua_error(L);
+    }
+
+    l2dbus_callbackRef(L, 3 /* func */, userIdx, &serverUd->cbCtx);
+
+    /* Add a reference to the Dispatcher userdata */
+    lua_pushvalue(L, 1 /* dispUd */);
+    serverUd->dispUdRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    /* Create a weak reference to the Server user data */
+    l2dbus_objectRegistryAdd(L, serverUd, -1);
+
+    dbus_server_set_new_connection_function(serverUd->server,
+                                    l2dbus_serverNewConnection, serverUd, NULL);
+    if ( !dbus_server_set_watch_functions(serverUd->server,
+                                    l2dbus_serverAddWatch,
+                                    l2dbus_serverRemoveWatch,
+                                    l2dbus_serverToggleWatch,
+                                    serverUd, NULL) ||
+        !dbus_server_set_timeout_functions(serverUd->server,
+                                    l2dbus_serverAddTimeout,
+                                    l2dbus_serverRemoveTimeout,
+                                    l2dbus_serverToggleTimeout,
+                                    serverUd, NULL) )
+    {
+        /* The collector releases the server and the references */
+        luaL_error(L, "Failed to attach the server to the dispatcher");
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Stops the server listening and releases it.
+ *
+ * @param [in] ud   The Server userdata.
+ */
+static void
+l2dbus_serverRelease
+    (
+    l2dbus_Server*  ud
+    )
+{
+    if ( NULL != ud->server )
+    {
+        dbus_server_disconnect(ud->server);
+
+        /* Removes any watches/timeouts still attached to the dispatcher */
+        dbus_server_set_watch_functions(ud->server, NULL, NULL, NULL,
+                                        NULL, NULL);
+        dbus_server_set_timeout_functions(ud->server, NULL, NULL, NULL,
+                                        NULL, NULL);
+        dbus_server_set_new_connection_function(ud->server, NULL, NULL, NULL);
+        dbus_server_unref(ud->server);
+        ud->server = NULL;
+    }
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the Server userdata.
+ *
+ * This method is called by the Lua VM to reclaim the Server userdata.
+ *
+ * @return nil
+ *
+ */
+static int
+l2dbus_serverDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Server* ud = (l2dbus_Server*)l2dbus_checkUserData(L, -1,
+                                        L2DBUS_SERVER_TYPE_ID);
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: server (userdata=%p)", ud));
+
+    l2dbus_serverRelease(ud);
+
+    /* Drop the weak reference to the userdata */
+    l2dbus_objectRegistryRemove(L, ud);
+
+    /* We no longer need to anchor the dispatcher */
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->dispUdRef);
+
+    /* Unreference the function/data associated with a callback */
+    l2dbus_callbackUnref(L, &ud->cbCtx);
+
+    return 0;
+}
+
+
+/**
+ * The L2DBUS Server class.
+ * @type Server
+ */
+
+/**
+ @function getAddress
+ @within Server
+
+ Returns the address peers use to connect to the server.
+
+ The address is resolved by D-Bus (e.g. the socket chosen for a
+ *tmpdir* address) and includes the GUID of the server.
+
+ @tparam userdata server The server.
+ @treturn ?string|nil The address or **nil** if the server has been
+ disconnected.
+ */
+static int
+l2dbus_serverGetAddress
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Server* ud = (l2dbus_Server*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SERVER_TYPE_ID);
+    char* address;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( (NULL == ud->server) ||
+        (NULL == (address = dbus_server_get_address(ud->server))) )
+    {
+        lua_pushnil(L);
+    }
+    else
+    {
+        lua_pushstring(L, address);
+        dbus_free(address);
+    }
+
+    return 1;
+}
+
+
+/**
+ @function getId
+ @within Server
+
+ Returns the unique ID (GUID) of the server.
+
+ @tparam userdata server The server.
+ @treturn ?string|nil The ID or **nil** if the server has been
+ disconnected.
+ */
+static int
+l2dbus_serverGetId
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Server* ud = (l2dbus_Server*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SERVER_TYPE_ID);
+    char* id;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( (NULL == ud->server) ||
+        (NULL == (id = dbus_server_get_id(ud->server))) )
+    {
+        lua_pushnil(L);
+    }
+    else
+    {
+        lua_pushstring(L, id);
+        dbus_free(id);
+    }
+
+    return 1;
+}
+
+
+/**
+ @function isConnected
+ @within Server
+
+ Tests whether the server is still listening for connections.
+
+ @tparam userdata server The server.
+ @treturn bool Returns **true** if listening, **false** otherwise.
+ */
+static int
+l2dbus_serverIsConnected
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Server* ud = (l2dbus_Server*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SERVER_TYPE_ID);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushboolean(L, (NULL != ud->server) &&
+                    dbus_server_get_is_connected(ud->server));
+
+    return 1;
+}
+
+
+/**
+ @function disconnect
+ @within Server
+
+ Stops the server listening for new connections.
+
+ Connections that were already accepted are not affected by this call.
+
+ @tparam userdata server The server.
+ */
+static int
+l2dbus_serverDisconnect
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Server* ud = (l2dbus_Server*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SERVER_TYPE_ID);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    l2dbus_serverRelease(ud);
+
+    return 0;
+}
+
+
+/*
+ * Define the methods of the Server class
+ */
+static const luaL_Reg l2dbus_serverMetaTable[] = {
+    {"getAddress", l2dbus_serverGetAddress},
+    {"getId", l2dbus_serverGetId},
+    {"isConnected", l2dbus_serverIsConnected},
+    {"disconnect", l2dbus_serverDisconnect},
+    {"__gc", l2dbus_serverDispose},
+    {NULL, NULL},
+};
+
+
+/**
+ * @brief Creates the Server sub-module.
+ *
+ * This function creates a metatable entry for the Server userdata
+ * and simulates opening the Server sub-module.
+ *
+ * @return A table defining the Server sub-module.
+ */
+void
+l2dbus_openServer
+    (
+    lua_State*  L
+    )
+{
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_SERVER_TYPE_ID,
+            l2dbus_serverMetaTable));
+    lua_newtable(L);
+    lua_pushcfunction(L, l2dbus_newServer);
+    lua_setfield(L, -2, "new");
+}
@@ -50,6 +50,9 @@
 #include "l2dbus_alloc.h"
 #include "l2dbus_message.h"
 #include "l2dbus_dbuscompat.h"
+#include "l2dbus_introspection.h"
+#include "l2dbus_propstore.h"
+#include "l2dbus_stats.h"
 #include "lualib.h"
 
 /**
@@ -114,6 +117,10 @@ l2dbus_serviceObjectHandler
     const char* errMsg = "";
     DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     l2dbus_ServiceObject* ud;
+    l2dbus_Message* msgUd = NULL;
+    int dispatchRef;
+    double cbStart;
+    int status;
 
     /* Leaves the userdata sitting on the top of the stack */
     ud = l2dbus_objectRegistryGet(L, obj);
@@ -131,6 +138,12 @@ l2dbus_serviceObjectHandler
         L2DBUS_TRACE((L2DBUS_TRC_WARN,
             "Cannot call handler because service object has been GC'ed"));
     }
+    /* Else if the request was answered by a native property store */
+    else if ( DBUS_HANDLER_RESULT_NOT_YET_HANDLED !=
+            (rc = l2dbus_propStoreHandle(L, &ud->interfaces, conn, msg)) )
+    {
+        /* Nothing more to do */
+    }
     /* Else if a default callback function was provided then ... */
     else if ( LUA_NOREF != ud->cbCtx.funcRef )
     {
@@ -148,12 +161,36 @@ l2dbus_serviceObjectHandler
         else
         {
             /* Push a Lua wrapper around the message */
-            l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
+            if ( ud->borrowMsg )
+            {
+                msgUd = l2dbus_messageBorrow(L, msg);
+            }
+            else
+            {
+                l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
+            }
 
             /* Push the user provided value on the stack */
             lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.userRef);
 
-            if ( 0 != lua_pcall(L, 4 /* nArgs */, 1 /* nResults */, 0) )
+            /* Push the value registered for the method (or nil) */
+            dispatchRef = l2dbus_dispatchLookup(&ud->dispatch,
+                                            dbus_message_get_interface(msg),
+                                            dbus_message_get_member(msg),
+                                            dbus_message_get_signature(msg));
+            if ( LUA_NOREF == dispatchRef )
+            {
+                lua_pushnil(L);
+            }
+            else
+            {
+                lua_rawgeti(L, LUA_REGISTRYINDEX, dispatchRef);
+            }
+
+            cbStart = l2dbus_statsCallbackStart(L, 5 /* nArgs */);
+            status = lua_pcall(L, 5 /* nArgs */, 1 /* nResults */, 0);
+            l2dbus_statsCallback(L2DBUS_STATS_CB_SERVICE_OBJECT, cbStart, status);
+            if ( 0 != status )
             {
                 if ( lua_isstring(L, -1) )
                 {
@@ -185,14 +222,83 @@ l2dbus_serviceObjectHandler
         }
     }
 
+    /* Invalidate a borrowed message now the handler has returned */
+    if ( NULL != msgUd )
+    {
+        l2dbus_messageGiveBack(L, msgUd);
+    }
+
     /* Clean up the thread stack */
     lua_settop(L, 0);
 
+    /* Reclaim any transient allocations made while servicing the callback */
+    l2dbus_arenaReset();
+
     /* The return value is unused by CDBUS */
     return rc;
 }
 
 
+/**
+ * @brief Dispatches a request to a service object that isn't registered.
+ *
+ * Used for the service objects materialized on demand by a subtree
+ * registration. Like CDBUS the interface named by the request gets the
+ * first chance to handle it followed by the object handler. The thread
+ * stack is cleared by the handlers.
+ *
+ * @param [in] L         The Lua callback thread.
+ * @param [in] svcObjUd  The service object (which must be kept alive by
+ *                       the caller).
+ * @param [in] conn      The CDBUS connection the request arrived on.
+ * @param [in] msg       The D-Bus request message.
+ * @return The D-Bus handler result.
+ */
+DBusHandlerResult
+l2dbus_serviceObjectDispatch
+    (
+    lua_State*                  L,
+    l2dbus_ServiceObject*       svcObjUd,
+    struct cdbus_Connection*    conn,
+    DBusMessage*                msg
+    )
+{
+    DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    const char* intfName = dbus_message_get_interface(msg);
+    l2dbus_Interface* intfUd = NULL;
+    l2dbus_RefItem* item;
+
+    if ( NULL != intfName )
+    {
+        LIST_FOREACH(item, &svcObjUd->interfaces.list, link)
+        {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, item->refIdx);
+            intfUd = (l2dbus_Interface*)l2dbus_isUserData(L, -1,
+                                                L2DBUS_INTERFACE_TYPE_ID);
+            lua_pop(L, 1);
+            if ( (NULL != intfUd) && (NULL != intfUd->handler) &&
+                (0 == strcmp(intfName, cdbus_interfaceGetName(intfUd->intf))) )
+            {
+                break;
+            }
+            intfUd = NULL;
+        }
+    }
+
+    if ( NULL != intfUd )
+    {
+        rc = intfUd->handler(conn, svcObjUd->obj, msg, intfUd);
+    }
+
+    if ( DBUS_HANDLER_RESULT_NOT_YET_HANDLED == rc )
+    {
+        rc = l2dbus_serviceObjectHandler(svcObjUd->obj, conn, msg);
+    }
+
+    return rc;
+}
+
+
 /**
  @brief Removes an interface from the underlying CDBUS object.
 
@@ -228,7 +334,7 @@ l2dbus_serviceObjectFreeObject
  can be associated a handler that can process client requests. The signature of
  the handler has the form:
 
-     DBusHandlerResult function onRequest(svcObj, conn, msg, userToken)
+     DBusHandlerResult function onRequest(svcObj, conn, msg, userToken, method)
 
  Where:
 
@@ -237,6 +343,8 @@ l2dbus_serviceObjectFreeObject
  <li>*conn*       - The D-Bus connection from which the request was received</li>
  <li>*msg*        - The D-Bus request message</li>
  <li>*userToken*  - A value specified by the user when the object was created.</li>
+ <li>*method*     - The value registered with @{setMethodDispatch} for the
+ requested method or **nil** if there is none.</li>
  </ul>
 
  The handler function should return one of the following values:
@@ -306,6 +414,7 @@ l2dbus_newServiceObject
         /* Reset the userdata structure */
         l2dbus_callbackInit(&svcObjUd->cbCtx);
         l2dbus_refListInit(&svcObjUd->interfaces);
+        l2dbus_dispatchInit(&svcObjUd->dispatch);
 
         l2dbus_callbackRef(L, funcIdx, userIdx, &svcObjUd->cbCtx);
         svcObjUd->obj = cdbus_objectNew(path, l2dbus_serviceObjectHandler, svcObjUd);
@@ -345,12 +454,13 @@ l2dbus_serviceObjectDispose
     lua_State*  L
     )
 {
-    l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)luaL_checkudata(L, -1,
-                                        L2DBUS_SERVICE_OBJECT_MTBL_NAME);
+    l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)l2dbus_checkUserData(L, -1,
+                                        L2DBUS_SERVICE_OBJECT_TYPE_ID);
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: service object (userdata=%p)", ud));
 
     l2dbus_refListFree(&ud->interfaces, L, l2dbus_serviceObjectFreeObject, ud);
+    l2dbus_introspectionReleaseObject(ud);
 
     if ( ud->obj != NULL )
     {
@@ -364,6 +474,8 @@ l2dbus_serviceObjectDispose
     /* Unreference the function/data associated with a callback */
     l2dbus_callbackUnref(L, &ud->cbCtx);
 
+    l2dbus_dispatchFree(&ud->dispatch, L);
+
     return 0;
 }
 
@@ -390,8 +502,8 @@ l2dbus_serviceObjectGetPath
     )
 {
     const char* path;
-    l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)luaL_checkudata(L, 1,
-                                        L2DBUS_SERVICE_OBJECT_MTBL_NAME);
+    l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -425,8 +537,8 @@ l2dbus_serviceObjectSetData
     lua_State*  L
     )
 {
-    l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)luaL_checkudata(L, 1,
-                                        L2DBUS_SERVICE_OBJECT_MTBL_NAME);
+    l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -461,8 +573,8 @@ l2dbus_serviceObjectGetData
     lua_State*  L
     )
 {
-    l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)luaL_checkudata(L, 1,
-                                        L2DBUS_SERVICE_OBJECT_MTBL_NAME);
+    l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -473,6 +585,132 @@ l2dbus_serviceObjectGetData
 }
 
 
+/**
+ @function setBorrowMessages
+ @within ServiceObject
+
+ Selects borrowed message delivery for the request handler.
+
+ When enabled the handler is passed a pooled Message wrapper that is
+ only valid until the handler returns. This avoids allocating a new
+ Message userdata for every request. A handler that needs the message
+ after it returns must call @{l2dbus.Message.retain|retain} on it.
+
+ @tparam userdata object The ServiceObject.
+ @tparam bool enable Set to **true** to enable borrowed delivery or
+ **false** (the default) to disable it.
+ */
+static int
+l2dbus_serviceObjectSetBorrowMessages
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_TYPE_ID);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    ud->borrowMsg = lua_toboolean(L, 2) ? L2DBUS_TRUE : L2DBUS_FALSE;
+
+    return 0;
+}
+
+/**
+ @function setMethodDispatch
+ @within ServiceObject
+
+ Associates a value with a method in the object's dispatch index.
+
+ The dispatch index is searched (in C) whenever a request arrives. The
+ matching value is passed to the object request handler so it does not
+ need to search for the method itself. Requests that specify an interface
+ are matched by interface and method name. Requests without an interface
+ are matched by method name and input signature. A value previously
+ associated with the interface/method is replaced.
+
+ @tparam userdata object The userdata representing the ServiceObject.
+ @tparam string intfName The D-Bus interface name of the method.
+ @tparam string member The D-Bus method name.
+ @tparam string inSig The input signature of the method.
+ @tparam any value The value passed to the handler for matching requests.
+ */
+static int
+l2dbus_serviceObjectSetMethodDispatch
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_TYPE_ID);
+    const char* intfName;
+    const char* member;
+    const char* inSig;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    intfName = luaL_checkstring(L, 2);
+    member = luaL_checkstring(L, 3);
+    inSig = luaL_optstring(L, 4, "");
+    luaL_checkany(L, 5);
+
+    if ( !l2dbus_dispatchAdd(&ud->dispatch, L, intfName, member, inSig, 5) )
+    {
+        luaL_error(L, "failed to allocate dispatch entry");
+    }
+
+    return 0;
+}
+
+
+/**
+ @function clearMethodDispatch
+ @within ServiceObject
+
+ Removes a method from the object's dispatch index.
+
+ @tparam userdata object The userdata representing the ServiceObject.
+ @tparam string intfName The D-Bus interface name of the method.
+ @tparam ?string member The D-Bus method name. If **nil** then all the
+ methods of the interface are removed.
+ @treturn bool Returns **true** if any method was removed and **false**
+ otherwise.
+ */
+static int
+l2dbus_serviceObjectClearMethodDispatch
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_ServiceObject* ud = (l2dbus_ServiceObject*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_TYPE_ID);
+    const char* intfName;
+    const char* member;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    intfName = luaL_checkstring(L, 2);
+    member = luaL_optstring(L, 3, NULL);
+
+    if ( NULL != member )
+    {
+        lua_pushboolean(L, l2dbus_dispatchRemove(&ud->dispatch, L,
+                                                intfName, member));
+    }
+    else
+    {
+        lua_pushboolean(L, l2dbus_dispatchRemoveInterface(&ud->dispatch, L,
+                                                intfName));
+    }
+
+    return 1;
+}
+
+
+
 /**
  @function addInterface
  @within ServiceObject
@@ -497,10 +735,10 @@ l2dbus_serviceObjectAddInterface
 {
     l2dbus_Bool isAdded = L2DBUS_FALSE;
 
-    l2dbus_ServiceObject* objUd = (l2dbus_ServiceObject*)luaL_checkudata(L, 1,
-                                        L2DBUS_SERVICE_OBJECT_MTBL_NAME);
-    l2dbus_Interface* ifUd = (l2dbus_Interface*)luaL_checkudata(L, 2,
-                                        L2DBUS_INTERFACE_MTBL_NAME);
+    l2dbus_ServiceObject* objUd = (l2dbus_ServiceObject*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_TYPE_ID);
+    l2dbus_Interface* ifUd = (l2dbus_Interface*)l2dbus_checkUserData(L, 2,
+                                        L2DBUS_INTERFACE_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -518,6 +756,7 @@ l2dbus_serviceObjectAddInterface
         else
         {
             isAdded = L2DBUS_TRUE;
+            l2dbus_introspectionReleaseObject(objUd);
         }
     }
 
@@ -554,10 +793,10 @@ l2dbus_serviceObjectRemoveInterface
     l2dbus_Bool removed = L2DBUS_FALSE;
     l2dbus_RefListIter iter;
 
-    l2dbus_ServiceObject* objUd = (l2dbus_ServiceObject*)luaL_checkudata(L, 1,
-                                        L2DBUS_SERVICE_OBJECT_MTBL_NAME);
-    l2dbus_Interface* intfUd = (l2dbus_Interface*)luaL_checkudata(L, 2,
-                                            L2DBUS_INTERFACE_MTBL_NAME);
+    l2dbus_ServiceObject* objUd = (l2dbus_ServiceObject*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_TYPE_ID);
+    l2dbus_Interface* intfUd = (l2dbus_Interface*)l2dbus_checkUserData(L, 2,
+                                            L2DBUS_INTERFACE_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -575,6 +814,7 @@ l2dbus_serviceObjectRemoveInterface
          * object.
          */
         removed = L2DBUS_TRUE;
+        l2dbus_introspectionReleaseObject(objUd);
 
         /* Make best effort to remove the strong reference to the interface */
 
@@ -618,10 +858,10 @@ l2dbus_serviceObjectIntrospect
     lua_State*  L
     )
 {
-    l2dbus_ServiceObject* objUd = (l2dbus_ServiceObject*)luaL_checkudata(L, 1,
-                                        L2DBUS_SERVICE_OBJECT_MTBL_NAME);
-    l2dbus_Connection* connUd = (l2dbus_Connection*)luaL_checkudata(L, 2,
-                                        L2DBUS_CONNECTION_MTBL_NAME);
+    l2dbus_ServiceObject* objUd = (l2dbus_ServiceObject*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SERVICE_OBJECT_TYPE_ID);
+    l2dbus_Connection* connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 2,
+                                        L2DBUS_CONNECTION_TYPE_ID);
     const char* path;
     cdbus_StringBuffer* buf;
 
@@ -630,8 +870,8 @@ l2dbus_serviceObjectIntrospect
 
     path = luaL_checkstring(L, 3);
 
-    buf = cdbus_objectIntrospect(objUd->obj, connUd->conn, path);
-    if ( cdbus_stringBufferIsEmpty(buf) )
+    buf = l2dbus_introspectionGenerate(L, objUd, connUd->conn, path);
+    if ( (NULL == buf) || cdbus_stringBufferIsEmpty(buf) )
     {
         lua_pushnil(L);
     }
@@ -652,6 +892,9 @@ static const luaL_Reg l2dbus_serviceObjectMetaTable[] = {
     {"path", l2dbus_serviceObjectGetPath},
     {"setData", l2dbus_serviceObjectSetData},
     {"data", l2dbus_serviceObjectGetData},
+    {"setBorrowMessages", l2dbus_serviceObjectSetBorrowMessages},
+    {"setMethodDispatch", l2dbus_serviceObjectSetMethodDispatch},
+    {"clearMethodDispatch", l2dbus_serviceObjectClearMethodDispatch},
     {"addInterface", l2dbus_serviceObjectAddInterface},
     {"removeInterface", l2dbus_serviceObjectRemoveInterface},
     {"introspect", l2dbus_serviceObjectIntrospect},
@@ -35,11 +35,15 @@
 #define L2DBUS_SERVICEOBJECT_H_
 
 #include "lua.h"
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
 #include "l2dbus_callback.h"
 #include "l2dbus_reflist.h"
+#include "l2dbus_dispatch.h"
 
 /* Forward declarations */
 struct cdbus_Object;
+struct cdbus_Connection;
 struct l2dbus_Interface;
 
 typedef struct l2dbus_ServiceObject
@@ -47,8 +51,16 @@ typedef struct l2dbus_ServiceObject
     struct cdbus_Object*                obj;
     l2dbus_CallbackCtx                  cbCtx;
     l2dbus_RefList                      interfaces;
+    l2dbus_Bool                         borrowMsg;
+    l2dbus_DispatchIndex                dispatch;
+    char*                               introspectXml;
+    unsigned                            introspectGen;
 } l2dbus_ServiceObject;
 
+DBusHandlerResult l2dbus_serviceObjectDispatch(lua_State* L,
+                                l2dbus_ServiceObject* svcObjUd,
+                                struct cdbus_Connection* conn,
+                                DBusMessage* msg);
 void l2dbus_openServiceObject(lua_State* L);
 
 #endif /* Guard for L2DBUS_SERVICEOBJECT_H_ */
@@ -0,0 +1,693 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_shape.c
+ * @author         Glenn Schmottlach
+ * @brief          Single-pass inference of the D-Bus shapes of Lua tables.
+ *===========================================================================
+ */
+#include <string.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_shape.h"
+#include "l2dbus_transcode.h"
+#include "l2dbus_core.h"
+#include "l2dbus_util.h"
+#include "l2dbus_object.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_context.h"
+#include "l2dbus_defs.h"
+#include "lauxlib.h"
+
+/*
+ * Internal states of a memo slot. A table is marked as pending while its
+ * shape is being inferred so a table that (indirectly) contains itself is
+ * detected rather than recursing forever.
+ */
+#define L2DBUS_SHAPE_PENDING    (0x80U)
+#define L2DBUS_SHAPE_UNKNOWN    (0x100U)
+
+/* Tables nested deeper than this can never be marshalled */
+#define L2DBUS_SHAPE_MAX_DEPTH  (2 * DBUS_MAXIMUM_TYPE_RECURSION_DEPTH)
+
+/* The size of the signature pool allocated the first time it's needed */
+#define L2DBUS_SHAPE_SIG_POOL_SIZE  (256)
+
+/* A Lua table whose shape (and possibly signature) has been inferred */
+typedef struct l2dbus_ShapeSlot
+{
+    const void*     table;
+    /* The slot is empty unless it belongs to the current generation */
+    unsigned        gen;
+    unsigned        shape;
+    /* Offset of the signature in the signature pool */
+    size_t          sigPos;
+    /* Zero (0) if the signature of the table is not known */
+    size_t          sigLen;
+} l2dbus_ShapeSlot;
+
+/*
+ * The shapes of the tables seen while marshalling one set of arguments.
+ * Tables are identified by their address which is stable because every
+ * table being marshalled is reachable from the Lua stack. Starting a new
+ * generation empties the memo without touching the slots so a marshalling
+ * abandoned by a Lua error (long jump) leaves nothing behind that could be
+ * mistaken for a later table at the same address.
+ */
+typedef struct l2dbus_ShapeMemo
+{
+    l2dbus_ShapeSlot*   slots;
+    /* Always a power of two */
+    unsigned            nSlots;
+    unsigned            count;
+    unsigned            gen;
+    l2dbus_Bool         active;
+    char*               sigPool;
+    size_t              sigPoolLen;
+    size_t              sigPoolSize;
+} l2dbus_ShapeMemo;
+
+/* Each thread (and so each Lua state running on it) has its own memo */
+static L2DBUS_THREAD_LOCAL l2dbus_ShapeMemo gShapeMemo;
+
+
+/* Hashes the address of a Lua table */
+static unsigned
+l2dbus_shapeHash
+    (
+    const void* table
+    )
+{
+    size_t addr = (size_t)table;
+    return (unsigned)((addr >> 4) ^ (addr >> 12)) * 2654435761U;
+}
+
+
+/* Finds the slot for the table, if create is true adding one if needed */
+static l2dbus_ShapeSlot*
+l2dbus_shapeFind
+    (
+    const void*     table,
+    l2dbus_Bool     create
+    )
+{
+    l2dbus_ShapeMemo* memo = &gShapeMemo;
+    l2dbus_ShapeSlot* slots;
+    l2dbus_ShapeSlot* slot;
+    unsigned nSlots;
+    unsigned idx;
+    unsigned mask;
+
+    if ( create && ((memo->count + 1) * 4 > memo->nSlots * 3) )
+    {
+        /* Grow the memo (re-inserting the current generation) */
+        nSlots = (0 == memo->nSlots) ? L2DBUS_SHAPE_MEMO_SIZE :
+                                        memo->nSlots * 2;
+        slots = (l2dbus_ShapeSlot*)l2dbus_calloc(nSlots, sizeof(*slots));
+        if ( NULL == slots )
+        {
+            return NULL;
+        }
+        for ( idx = 0; idx < memo->nSlots; ++idx )
+        {
+            if ( memo->gen == memo->slots[idx].gen )
+            {
+                mask = l2dbus_shapeHash(memo->slots[idx].table) & (nSlots - 1);
+                while ( memo->gen == slots[mask].gen )
+                {
+                    mask = (mask + 1) & (nSlots - 1);
+                }
+                slots[mask] = memo->slots[idx];
+            }
+        }
+        l2dbus_free(memo->slots);
+        memo->slots = slots;
+        memo->nSlots = nSlots;
+    }
+
+    if ( 0 == memo->nSlots )
+    {
+        return NULL;
+    }
+
+    mask = memo->nSlots - 1;
+    idx = l2dbus_shapeHash(table) & mask;
+    for ( slot = &memo->slots[idx]; memo->gen == slot->gen;
+        slot = &memo->slots[idx] )
+    {
+        if ( table == slot->table )
+        {
+            return slot;
+        }
+        idx = (idx + 1) & mask;
+    }
+
+    if ( !create )
+    {
+        return NULL;
+    }
+
+    slot->table = table;
+    slot->gen = memo->gen;
+    slot->shape = L2DBUS_SHAPE_UNKNOWN;
+    slot->sigPos = 0;
+    slot->sigLen = 0;
+    memo->count++;
+
+    return slot;
+}
+
+
+/* Tests whether the userdata is an l2dbus value that can be marshalled */
+static l2dbus_Bool
+l2dbus_shapeIsSendable
+    (
+    lua_State*      L,
+    int             idx,
+    l2dbus_TypeId   metaTypeId
+    )
+{
+    /* Make sure it's l2dbus userdata */
+    if ( NULL == l2dbus_isUserData(L, idx, metaTypeId) )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    return (L2DBUS_INT64_TYPE_ID == metaTypeId) ||
+            (L2DBUS_UINT64_TYPE_ID == metaTypeId) ||
+            (L2DBUS_RAW_VARIANT_TYPE_ID == metaTypeId) ||
+            (L2DBUS_BUFFER_TYPE_ID == metaTypeId) ||
+            ((L2DBUS_START_DBUS_TYPE_ID < metaTypeId) &&
+             (L2DBUS_END_DBUS_TYPE_ID > metaTypeId) &&
+             (L2DBUS_DBUS_INVALID_TYPE_ID != metaTypeId));
+}
+
+
+/* Tests whether the Lua value can be the key of a D-Bus dictionary */
+static l2dbus_Bool
+l2dbus_shapeIsDictKey
+    (
+    lua_State*  L,
+    int         idx
+    )
+{
+    int dbusType = DBUS_TYPE_INVALID;
+    l2dbus_TypeId metaTypeId;
+
+    switch ( lua_type(L, idx) )
+    {
+        case LUA_TNUMBER:
+        case LUA_TBOOLEAN:
+        case LUA_TSTRING:
+            return L2DBUS_TRUE;
+
+        case LUA_TUSERDATA:
+            if ( l2dbus_dbusQueryDbusTypeId(L, idx, &dbusType) )
+            {
+                /* Only *basic* D-Bus types can be dictionary keys */
+                return dbus_type_is_basic(dbusType);
+            }
+            metaTypeId = l2dbus_getMetaTypeId(L, idx);
+            return (L2DBUS_INT64_TYPE_ID == metaTypeId) ||
+                    (L2DBUS_UINT64_TYPE_ID == metaTypeId);
+
+        default:
+            return L2DBUS_FALSE;
+    }
+}
+
+
+static unsigned l2dbus_shapeLookup(lua_State* L, int idx, int level);
+
+
+/*
+ * Classifies the table as an array, structure and/or dictionary with a
+ * single traversal. A nested table is acceptable in any of the containers
+ * as long as it can be represented as a dictionary (the least restrictive
+ * mapping) so only its own (memoized) shape is consulted.
+ */
+static unsigned
+l2dbus_shapeInfer
+    (
+    lua_State*  L,
+    int         tableIdx,
+    int         level
+    )
+{
+    unsigned shape = L2DBUS_SHAPE_ARRAY | L2DBUS_SHAPE_STRUCT |
+                    L2DBUS_SHAPE_DICT;
+    size_t itemCnt = 0;
+    int firstType = LUA_TNONE;
+    int valueType;
+    l2dbus_TypeId firstMetaTypeId = L2DBUS_INVALID_TYPE_ID;
+    l2dbus_TypeId metaTypeId;
+
+    lua_pushnil(L);
+    while ( lua_next(L, tableIdx) )
+    {
+        ++itemCnt;
+
+        /* Arrays and structures are indexed by number */
+        if ( !lua_isnumber(L, -2) )
+        {
+            shape &= ~(L2DBUS_SHAPE_ARRAY | L2DBUS_SHAPE_STRUCT);
+        }
+
+        if ( (0 != (shape & L2DBUS_SHAPE_DICT)) &&
+            !l2dbus_shapeIsDictKey(L, -2) )
+        {
+            shape &= ~L2DBUS_SHAPE_DICT;
+        }
+
+        /* The elements of an array must all be of the same type */
+        valueType = lua_type(L, -1);
+        if ( LUA_TNONE == firstType )
+        {
+            firstType = valueType;
+        }
+        else if ( firstType != valueType )
+        {
+            shape &= ~L2DBUS_SHAPE_ARRAY;
+        }
+
+        switch ( valueType )
+        {
+            case LUA_TNUMBER:
+            case LUA_TBOOLEAN:
+            case LUA_TSTRING:
+                break;
+
+            case LUA_TTABLE:
+                if ( 0 == (l2dbus_shapeLookup(L, -1, level + 1) &
+                    L2DBUS_SHAPE_DICT) )
+                {
+                    shape = 0;
+                }
+                break;
+
+            case LUA_TUSERDATA:
+                metaTypeId = l2dbus_getMetaTypeId(L, -1);
+                if ( !l2dbus_shapeIsSendable(L, -1, metaTypeId) )
+                {
+                    shape = 0;
+                }
+                else if ( L2DBUS_INVALID_TYPE_ID == firstMetaTypeId )
+                {
+                    firstMetaTypeId = metaTypeId;
+                }
+                else if ( firstMetaTypeId != metaTypeId )
+                {
+                    shape &= ~L2DBUS_SHAPE_ARRAY;
+                }
+                break;
+
+            default:
+                shape = 0;
+                break;
+        }
+
+        if ( 0 == shape )
+        {
+            /* Pop the key/value pair */
+            lua_pop(L, 2);
+            break;
+        }
+
+        /* Get ready for the next go-around */
+        lua_pop(L, 1);
+    }
+
+    /* An array or structure has no holes */
+    if ( itemCnt != lua_rawlen(L, tableIdx) )
+    {
+        shape &= ~(L2DBUS_SHAPE_ARRAY | L2DBUS_SHAPE_STRUCT);
+    }
+
+    return shape;
+}
+
+
+/* Returns the shape of the table, inferring it if it's not memoized */
+static unsigned
+l2dbus_shapeLookup
+    (
+    lua_State*  L,
+    int         idx,
+    int         level
+    )
+{
+    l2dbus_ShapeSlot* slot;
+    const void* table;
+    unsigned shape;
+
+    idx = lua_absindex(L, idx);
+    if ( L2DBUS_SHAPE_MAX_DEPTH < level )
+    {
+        return 0;
+    }
+
+    if ( !gShapeMemo.active )
+    {
+        return l2dbus_shapeInfer(L, idx, level);
+    }
+
+    table = lua_topointer(L, idx);
+    slot = l2dbus_shapeFind(table, L2DBUS_TRUE);
+    if ( NULL == slot )
+    {
+        return l2dbus_shapeInfer(L, idx, level);
+    }
+    else if ( L2DBUS_SHAPE_PENDING == slot->shape )
+    {
+        /* The table contains itself */
+        return 0;
+    }
+    else if ( L2DBUS_SHAPE_UNKNOWN != slot->shape )
+    {
+        return slot->shape;
+    }
+
+    slot->shape = L2DBUS_SHAPE_PENDING;
+    shape = l2dbus_shapeInfer(L, idx, level);
+
+    /* The slot may have moved if the memo grew */
+    slot = l2dbus_shapeFind(table, L2DBUS_FALSE);
+    if ( NULL != slot )
+    {
+        slot->shape = shape;
+    }
+
+    return shape;
+}
+
+
+/**
+ * @brief Starts memoizing the shapes of the tables being marshalled.
+ *
+ * Any shapes memoized by an earlier (possibly abandoned) marshalling are
+ * forgotten. Must be paired with l2dbus_shapeEnd() once every table is
+ * marshalled.
+ */
+void
+l2dbus_shapeBegin(void)
+{
+    l2dbus_ShapeMemo* memo = &gShapeMemo;
+
+    memo->gen++;
+    if ( 0 == memo->gen )
+    {
+        /* The generation wrapped so stale slots could look current */
+        if ( NULL != memo->slots )
+        {
+            memset(memo->slots, 0, memo->nSlots * sizeof(*memo->slots));
+        }
+        memo->gen = 1;
+    }
+    memo->count = 0;
+    memo->sigPoolLen = 0;
+    memo->active = L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Stops memoizing the shapes of tables.
+ */
+void
+l2dbus_shapeEnd(void)
+{
+    gShapeMemo.active = L2DBUS_FALSE;
+}
+
+
+/**
+ * @brief Frees the shape memo of the calling thread.
+ */
+void
+l2dbus_shapeShutdown(void)
+{
+    l2dbus_free(gShapeMemo.slots);
+    l2dbus_free(gShapeMemo.sigPool);
+    memset(&gShapeMemo, 0, sizeof(gShapeMemo));
+}
+
+
+/**
+ * @brief Returns the D-Bus containers a Lua table can be marshalled as.
+ *
+ * Every table is traversed once. While a marshalling is in progress (see
+ * l2dbus_shapeBegin()) the shape of every table encountered, including the
+ * nested ones, is memoized so it's never inferred twice.
+ *
+ * @param [in] L    The Lua state.
+ * @param [in] idx  The index of the Lua table.
+ * @return A combination of the L2DBUS_SHAPE_* flags or zero (0) if the
+ * table cannot be marshalled at all.
+ */
+unsigned
+l2dbus_shapeOfTable
+    (
+    lua_State*  L,
+    int         idx
+    )
+{
+    if ( LUA_TTABLE != lua_type(L, idx) )
+    {
+        return 0;
+    }
+
+    return l2dbus_shapeLookup(L, idx, 0);
+}
+
+
+/**
+ * @brief Returns the known D-Bus signature of a Lua table.
+ *
+ * The signature is taken from the tables whose shape is cached by
+ * l2dbus.Message.cacheShape or else from the memo of the marshalling
+ * in progress.
+ *
+ * @param [in] L    The Lua state.
+ * @param [in] idx  The index of the Lua table.
+ * @return The complete D-Bus type of the table or NULL if it's unknown.
+ * The signature must be used before another signature is recorded.
+ */
+const char*
+l2dbus_shapeGetSignature
+    (
+    lua_State*  L,
+    int         idx
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+    l2dbus_ShapeSlot* slot;
+    const char* sig = NULL;
+
+    idx = lua_absindex(L, idx);
+    if ( (NULL != ctx) && (LUA_NOREF != ctx->shapeCacheRef) )
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ctx->shapeCacheRef);
+        lua_pushvalue(L, idx);
+        lua_rawget(L, -2);
+        /* The cache holds the string for as long as the table is alive */
+        sig = lua_tostring(L, -1);
+        lua_pop(L, 2);
+        if ( NULL != sig )
+        {
+            return sig;
+        }
+    }
+
+    if ( gShapeMemo.active )
+    {
+        slot = l2dbus_shapeFind(lua_topointer(L, idx), L2DBUS_FALSE);
+        if ( (NULL != slot) && (0 != slot->sigLen) )
+        {
+            sig = gShapeMemo.sigPool + slot->sigPos;
+        }
+    }
+
+    return sig;
+}
+
+
+/**
+ * @brief Records the D-Bus signature computed for a Lua table.
+ *
+ * The signature is only remembered for the marshalling in progress.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] idx      The index of the Lua table.
+ * @param [in] sig      The complete D-Bus type of the table (need not be
+ * NUL terminated).
+ * @param [in] sigLen   The length of the signature.
+ */
+void
+l2dbus_shapeSetSignature
+    (
+    lua_State*  L,
+    int         idx,
+    const char* sig,
+    size_t      sigLen
+    )
+{
+    l2dbus_ShapeMemo* memo = &gShapeMemo;
+    l2dbus_ShapeSlot* slot;
+    size_t size;
+    char* pool;
+
+    if ( !memo->active || (0 == sigLen) )
+    {
+        return;
+    }
+
+    if ( memo->sigPoolLen + sigLen + 1 > memo->sigPoolSize )
+    {
+        size = (0 == memo->sigPoolSize) ? L2DBUS_SHAPE_SIG_POOL_SIZE :
+                                        memo->sigPoolSize;
+        while ( memo->sigPoolLen + sigLen + 1 > size )
+        {
+            size *= 2;
+        }
+        pool = (char*)l2dbus_realloc(memo->sigPool, size);
+        if ( NULL == pool )
+        {
+            return;
+        }
+        memo->sigPool = pool;
+        memo->sigPoolSize = size;
+    }
+
+    slot = l2dbus_shapeFind(lua_topointer(L, idx), L2DBUS_TRUE);
+    if ( NULL != slot )
+    {
+        memcpy(memo->sigPool + memo->sigPoolLen, sig, sigLen);
+        memo->sigPool[memo->sigPoolLen + sigLen] = '\0';
+        slot->sigPos = memo->sigPoolLen;
+        slot->sigLen = sigLen;
+        memo->sigPoolLen += sigLen + 1;
+    }
+}
+
+
+/**
+ @function cacheShape
+ @within l2dbus.Message
+
+ Caches the D-Bus signature inferred for a Lua table.
+
+ Marshalling a table without a signature (e.g. with
+ @{l2dbus.Message.addArgs|addArgs}) infers its D-Bus type from its
+ contents. For a table that is sent repeatedly (e.g. a configuration) the
+ type can be inferred once and cached so the table's contents are only
+ visited to marshall them. The cache is keyed by the identity of the table
+ and does not keep it from being collected. The cached signature is used
+ wherever the table is marshalled without a signature (including inside
+ variants and other tables) so the *shape* of the table (e.g. the types of
+ its values or whether it's an array or a dictionary) must not change
+ while it's cached. Call this function again after changing the shape.
+
+ @tparam table tbl The Lua table.
+ @tparam ?bool enable Caches the table's signature if **true** (the
+ default) or removes the table from the cache if **false**.
+ @treturn ?string The cached signature of the table or **nil** if the
+ table was removed from the cache.
+ */
+int
+l2dbus_shapeCache
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* ctx;
+    l2dbus_Bool enable;
+    cdbus_StringBuffer* sigBuf;
+    l2dbus_Bool isValid;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+    enable = lua_isnoneornil(L, 2) ? L2DBUS_TRUE : lua_toboolean(L, 2);
+
+    ctx = l2dbus_contextCurrent();
+    if ( LUA_NOREF == ctx->shapeCacheRef )
+    {
+        if ( !enable )
+        {
+            return 0;
+        }
+
+        /* The cache is keyed weakly by the tables */
+        lua_newtable(L);
+        lua_createtable(L, 0, 1);
+        lua_pushstring(L, "k");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        ctx->shapeCacheRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    /* Forget (any) earlier signature so the table's shape is re-inferred */
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ctx->shapeCacheRef);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    lua_rawset(L, -3);
+
+    if ( !enable )
+    {
+        return 0;
+    }
+
+    sigBuf = cdbus_stringBufferNew(L2DBUS_DEFAULT_SIGNATURE_LENGTH);
+    if ( NULL == sigBuf )
+    {
+        luaL_error(L, "failed to allocate memory for signature buffer");
+    }
+
+    l2dbus_shapeBegin();
+    isValid = l2dbus_dbusComputeSignature(L, 1, sigBuf, 0) &&
+        dbus_signature_validate_single(cdbus_stringBufferRaw(sigBuf), NULL);
+    l2dbus_shapeEnd();
+
+    if ( isValid )
+    {
+        lua_pushvalue(L, 1);
+        lua_pushstring(L, cdbus_stringBufferRaw(sigBuf));
+        lua_rawset(L, -3);
+    }
+    cdbus_stringBufferUnref(sigBuf);
+
+    if ( !isValid )
+    {
+        luaL_argerror(L, 1, "cannot convert table to D-Bus type");
+    }
+
+    /* Return the cached signature */
+    lua_pushvalue(L, 1);
+    lua_rawget(L, -2);
+    return 1;
+}
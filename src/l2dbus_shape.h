@@ -0,0 +1,60 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_shape.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the single-pass shape inference of Lua tables.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_SHAPE_H_
+#define L2DBUS_SHAPE_H_
+
+#include "lua.h"
+#include "l2dbus_types.h"
+
+/*
+ * The D-Bus containers a Lua table can be marshalled as. A table may have
+ * more than one shape (e.g. every array is also a valid structure).
+ */
+#define L2DBUS_SHAPE_ARRAY      (0x01U)
+#define L2DBUS_SHAPE_STRUCT     (0x02U)
+#define L2DBUS_SHAPE_DICT       (0x04U)
+
+/* The initial number of slots in the per-thread shape memo */
+#define L2DBUS_SHAPE_MEMO_SIZE  (64)
+
+void l2dbus_shapeBegin(void);
+void l2dbus_shapeEnd(void);
+void l2dbus_shapeShutdown(void);
+unsigned l2dbus_shapeOfTable(lua_State* L, int idx);
+const char* l2dbus_shapeGetSignature(lua_State* L, int idx);
+void l2dbus_shapeSetSignature(lua_State* L, int idx, const char* sig,
+                            size_t sigLen);
+int l2dbus_shapeCache(lua_State* L);
+
+#endif /* Guard for L2DBUS_SHAPE_H_ */
@@ -0,0 +1,826 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_shm.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of a shared memory region for bulk payloads
+ *===========================================================================
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#include "l2dbus_compat.h"
+#include "l2dbus_shm.h"
+#include "l2dbus_core.h"
+#include "l2dbus_object.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_types.h"
+#include "lauxlib.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC         (0x0001U)
+#endif
+
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING   (0x0002U)
+#endif
+
+/* The D-Bus signature of a payload reference: fd, offset and length */
+#define L2DBUS_SHM_PAYLOAD_SIGNATURE    "(htt)"
+
+static const char L2DBUS_SHM_CLOSED_ERROR[] = "shared memory has been closed";
+
+/**
+ L2DBUS SharedMemory
+
+ This section describes a L2DBUS SharedMemory class which holds a large
+ payload in a memory region that can be shared with another process.
+
+ Large payloads (images, log bundles, etc...) sent as a byte array (*ay*)
+ are copied into the message and then copied again by the bus daemon and
+ the receiver. A SharedMemory region is instead written once and only a
+ reference to it is sent: the Unix file descriptor (fd) of the region and
+ the offset and length of the payload within it (see
+ @{PAYLOAD_SIGNATURE}). The receiver @{map|maps} the region read-only and
+ reads the payload in place.
+
+ On Linux the region is an anonymous *memfd* which can be
+ @{seal|sealed} so the receiver knows the payload can no longer change.
+ Elsewhere an unlinked temporary file is used instead. Passing Unix fds
+ requires a connection (and bus) that supports them (see
+ @{l2dbus.Connection.canSendType|Connection:canSendType}).
+
+ A region is unmapped (and its fd closed) when it's @{close|closed} or
+ garbage collected. An fd unmarshalled from a message belongs to the
+ message (see @{l2dbus.Message.takeUnixFd|Message:takeUnixFd}) but the
+ mapping of a region remains valid after the message is released.
+
+ @namespace l2dbus.SharedMemory
+ */
+
+
+/**
+ * @brief Creates the (anonymous) file backing a shared memory region.
+ *
+ * @param [in] name The name of the region (for debugging only).
+ * @param [out] sealable Set to true if the file supports sealing.
+ * @return The file descriptor or -1 if the file cannot be created.
+ */
+static int
+l2dbus_shmCreateFd
+    (
+    const char*     name,
+    l2dbus_Bool*    sealable
+    )
+{
+    int fd = -1;
+    char path[64];
+    const char* dirs[] = {"/dev/shm", "/tmp"};
+    unsigned idx;
+
+    *sealable = L2DBUS_FALSE;
+
+#if defined(SYS_memfd_create)
+    fd = (int)syscall(SYS_memfd_create, name,
+                        MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if ( fd >= 0 )
+    {
+        *sealable = L2DBUS_TRUE;
+        return fd;
+    }
+#endif
+
+    /* Fall back on an unlinked temporary file */
+    for ( idx = 0; (fd < 0) && (idx < sizeof(dirs) / sizeof(dirs[0])); ++idx )
+    {
+        snprintf(path, sizeof(path), "%s/l2dbus-shm-XXXXXX", dirs[idx]);
+        fd = mkstemp(path);
+        if ( fd >= 0 )
+        {
+            unlink(path);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+
+    return fd;
+}
+
+
+/**
+ * @brief Maps (part of) a file into a SharedMemory userdata.
+ *
+ * The mapping starts at the page containing the offset so any offset can
+ * be used.
+ *
+ * @param [in] ud       The SharedMemory userdata.
+ * @param [in] fd       The descriptor of the file.
+ * @param [in] offset   The offset of the payload in the file.
+ * @param [in] length   The length of the payload.
+ * @param [in] prot     The protection of the mapping.
+ * @return True if the region is mapped.
+ */
+static l2dbus_Bool
+l2dbus_shmMap
+    (
+    l2dbus_SharedMemory*    ud,
+    int                     fd,
+    off_t                   offset,
+    size_t                  length,
+    int                     prot
+    )
+{
+    long pageSize = sysconf(_SC_PAGESIZE);
+    off_t delta = offset % (off_t)pageSize;
+    void* base;
+
+    base = mmap(NULL, length + (size_t)delta, prot, MAP_SHARED, fd,
+                offset - delta);
+    if ( MAP_FAILED == base )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    ud->base = base;
+    ud->mapLen = length + (size_t)delta;
+    ud->data = (unsigned char*)base + delta;
+    ud->size = length;
+    ud->readOnly = (0 == (prot & PROT_WRITE));
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Unmaps the region and closes the descriptor (if kept).
+ *
+ * @param [in] ud   The SharedMemory userdata.
+ */
+static void
+l2dbus_shmRelease
+    (
+    l2dbus_SharedMemory*    ud
+    )
+{
+    if ( NULL != ud->base )
+    {
+        munmap(ud->base, ud->mapLen);
+        ud->base = NULL;
+        ud->data = NULL;
+    }
+
+    if ( ud->fd >= 0 )
+    {
+        close(ud->fd);
+        ud->fd = -1;
+    }
+}
+
+
+/**
+ * @brief Creates the SharedMemory userdata on the top of the Lua stack.
+ *
+ * @param [in] L    Lua state.
+ * @return The (unmapped) SharedMemory userdata.
+ */
+static l2dbus_SharedMemory*
+l2dbus_shmNewUserdata
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SharedMemory* ud;
+
+    ud = (l2dbus_SharedMemory*)l2dbus_objectNew(L, sizeof(*ud),
+                                            L2DBUS_SHARED_MEMORY_TYPE_ID);
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "SharedMemory userdata=%p", ud));
+    if ( NULL == ud )
+    {
+        luaL_error(L, "Failed to create shared memory userdata!");
+    }
+
+    ud->fd = -1;
+
+    return ud;
+}
+
+
+/**
+ * @brief Creates a writable region of the given size.
+ *
+ * The userdata is left on the top of the Lua stack.
+ *
+ * @param [in] L        Lua state.
+ * @param [in] size     The size of the region.
+ * @param [in] name     The name of the region.
+ * @param [out] sealable Set to true if the region supports sealing.
+ * @return The SharedMemory userdata.
+ */
+static l2dbus_SharedMemory*
+l2dbus_shmCreate
+    (
+    lua_State*      L,
+    size_t          size,
+    const char*     name,
+    l2dbus_Bool*    sealable
+    )
+{
+    l2dbus_SharedMemory* ud = l2dbus_shmNewUserdata(L);
+
+    ud->fd = l2dbus_shmCreateFd(name, sealable);
+    if ( ud->fd < 0 )
+    {
+        luaL_error(L, "Failed to create shared memory (%s)", strerror(errno));
+    }
+
+    if ( (0 != ftruncate(ud->fd, (off_t)size)) ||
+        !l2dbus_shmMap(ud, ud->fd, 0, size, PROT_READ | PROT_WRITE) )
+    {
+        luaL_error(L, "Failed to allocate %d bytes of shared memory (%s)",
+                    (int)size, strerror(errno));
+    }
+
+    return ud;
+}
+
+
+/**
+ * @brief Seals a writable region so its content can no longer change.
+ *
+ * The writable mapping is replaced by a read-only one since a region
+ * cannot be sealed against writes while it's mapped for writing.
+ *
+ * @param [in] ud   The SharedMemory userdata.
+ * @return True if the region is sealed by the kernel.
+ */
+static l2dbus_Bool
+l2dbus_shmSeal
+    (
+    l2dbus_SharedMemory*    ud
+    )
+{
+    l2dbus_Bool sealed = L2DBUS_FALSE;
+    size_t size = ud->size;
+
+    munmap(ud->base, ud->mapLen);
+    ud->base = NULL;
+    ud->data = NULL;
+
+#if defined(F_ADD_SEALS) && defined(F_SEAL_WRITE)
+    sealed = (0 == fcntl(ud->fd, F_ADD_SEALS,
+                F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL));
+#endif
+
+    if ( !l2dbus_shmMap(ud, ud->fd, 0, size, PROT_READ) )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                    "Failed to remap sealed shared memory (%s)",
+                    strerror(errno)));
+        sealed = L2DBUS_FALSE;
+    }
+
+    return sealed;
+}
+
+
+/**
+ @function new
+
+ Creates a new writable SharedMemory region.
+
+ The region is filled with zero bytes. Once the payload is
+ @{write|written} it should be @{seal|sealed} before it's sent.
+
+ @tparam number size The size (in bytes) of the region. Must be greater
+ than zero.
+ @tparam ?string name An optional name of the region. It's only used for
+ debugging.
+ @treturn userdata The SharedMemory userdata.
+ */
+static int
+l2dbus_newSharedMemory
+    (
+    lua_State*  L
+    )
+{
+    lua_Number size;
+    l2dbus_Bool sealable;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    size = luaL_checknumber(L, 1);
+    luaL_argcheck(L, size >= 1, 1, "size must be greater than zero");
+
+    l2dbus_shmCreate(L, (size_t)size, luaL_optstring(L, 2, "l2dbus"),
+                    &sealable);
+
+    return 1;
+}
+
+
+/**
+ @function fromString
+
+ Creates a sealed SharedMemory region holding a copy of a payload.
+
+ This is the usual way to send a large payload: the region is created,
+ the payload copied into it and the region is @{seal|sealed} so it can be
+ referenced by a message with @{getPayload}.
+
+ @tparam string data The payload. Must not be empty.
+ @tparam ?string name An optional name of the region. It's only used for
+ debugging.
+ @treturn userdata The (read-only) SharedMemory userdata.
+ */
+static int
+l2dbus_shmFromString
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SharedMemory* ud;
+    const char* data;
+    size_t len;
+    l2dbus_Bool sealable;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    data = luaL_checklstring(L, 1, &len);
+    luaL_argcheck(L, len > 0, 1, "payload must not be empty");
+
+    ud = l2dbus_shmCreate(L, len, luaL_optstring(L, 2, "l2dbus"), &sealable);
+    memcpy(ud->data, data, len);
+    if ( sealable )
+    {
+        l2dbus_shmSeal(ud);
+    }
+
+    return 1;
+}
+
+
+/**
+ @function map
+
+ Maps a payload received from another process.
+
+ The payload is mapped read-only. The descriptor is not kept by the
+ SharedMemory region. The mapping fails if the payload extends beyond the
+ end of the region. The reference can also be passed as the array
+ decoded from a @{PAYLOAD_SIGNATURE} argument, e.g.:
+
+    local shm = l2dbus.SharedMemory.map(msg:getArgs())
+
+ @tparam number|table fd The Unix fd of the region or an array of the fd,
+ offset and length.
+ @tparam ?number offset The offset of the payload in the region.
+ @tparam ?number length The length of the payload.
+ @treturn userdata The (read-only) SharedMemory userdata.
+ */
+static int
+l2dbus_shmMapPayload
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SharedMemory* ud;
+    lua_Number fd;
+    lua_Number offset;
+    lua_Number length;
+    struct stat st;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    if ( LUA_TTABLE == lua_type(L, 1) )
+    {
+        lua_rawgeti(L, 1, 1);
+        lua_rawgeti(L, 1, 2);
+        lua_rawgeti(L, 1, 3);
+        lua_replace(L, 3);
+        lua_replace(L, 2);
+        lua_replace(L, 1);
+    }
+
+    fd = luaL_checknumber(L, 1);
+    offset = luaL_checknumber(L, 2);
+    length = luaL_checknumber(L, 3);
+    luaL_argcheck(L, fd >= 0, 1, "invalid descriptor");
+    luaL_argcheck(L, offset >= 0, 2, "offset must not be negative");
+    luaL_argcheck(L, length >= 1, 3, "length must be greater than zero");
+
+    /* Touching pages beyond the end of the region would raise SIGBUS */
+    if ( (0 != fstat((int)fd, &st)) ||
+        ((lua_Number)st.st_size < offset + length) )
+    {
+        luaL_error(L, "payload is outside of the shared memory region");
+    }
+
+    ud = l2dbus_shmNewUserdata(L);
+    if ( !l2dbus_shmMap(ud, (int)fd, (off_t)offset, (size_t)length,
+                        PROT_READ) )
+    {
+        luaL_error(L, "Failed to map shared memory (%s)", strerror(errno));
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the SharedMemory userdata.
+ *
+ * This method is called by the Lua VM to reclaim the SharedMemory userdata.
+ *
+ * @return nil
+ *
+ */
+static int
+l2dbus_shmDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SharedMemory* ud = (l2dbus_SharedMemory*)l2dbus_checkUserData(L, -1,
+                                        L2DBUS_SHARED_MEMORY_TYPE_ID);
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: shared memory (userdata=%p)", ud));
+
+    l2dbus_shmRelease(ud);
+
+    return 0;
+}
+
+
+/*
+ * Checks the argument is an open SharedMemory region.
+ */
+static l2dbus_SharedMemory*
+l2dbus_shmCheck
+    (
+    lua_State*  L,
+    int         idx
+    )
+{
+    l2dbus_SharedMemory* ud = (l2dbus_SharedMemory*)l2dbus_checkUserData(L, idx,
+                                        L2DBUS_SHARED_MEMORY_TYPE_ID);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    luaL_argcheck(L, NULL != ud->base, idx, L2DBUS_SHM_CLOSED_ERROR);
+
+    return ud;
+}
+
+
+/**
+ * The L2DBUS SharedMemory class.
+ * @type SharedMemory
+ */
+
+/**
+ @function read
+ @within SharedMemory
+
+ Copies (part of) the payload into a Lua string.
+
+ @tparam userdata shm The SharedMemory region.
+ @tparam ?number offset The offset (from zero) of the first byte to read.
+ Defaults to zero.
+ @tparam ?number length The number of bytes to read. Defaults to the rest
+ of the payload.
+ @treturn string The bytes read.
+ */
+static int
+l2dbus_shmRead
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SharedMemory* ud = l2dbus_shmCheck(L, 1);
+    lua_Number offset = luaL_optnumber(L, 2, 0);
+    lua_Number length;
+
+    luaL_argcheck(L, (offset >= 0) && (offset <= (lua_Number)ud->size), 2,
+                "offset is out of range");
+    length = luaL_optnumber(L, 3, (lua_Number)ud->size - offset);
+    luaL_argcheck(L, (length >= 0) &&
+                (offset + length <= (lua_Number)ud->size), 3,
+                "length is out of range");
+
+    lua_pushlstring(L, (const char*)ud->data + (size_t)offset,
+                    (size_t)length);
+
+    return 1;
+}
+
+
+/**
+ @function write
+ @within SharedMemory
+
+ Copies a Lua string into a writable region.
+
+ A Lua error is thrown if the region is read-only or too small.
+
+ @tparam userdata shm The SharedMemory region.
+ @tparam number offset The offset (from zero) at which to write.
+ @tparam string data The bytes to write.
+ */
+static int
+l2dbus_shmWrite
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SharedMemory* ud = l2dbus_shmCheck(L, 1);
+    lua_Number offset = luaL_checknumber(L, 2);
+    size_t len;
+    const char* data = luaL_checklstring(L, 3, &len);
+
+    if ( ud->readOnly )
+    {
+        luaL_error(L, "shared memory is read-only");
+    }
+    luaL_argcheck(L, (offset >= 0) &&
+                (offset + (lua_Number)len <= (lua_Number)ud->size), 2,
+                "data does not fit in the shared memory");
+
+    memcpy(ud->data + (size_t)offset, data, len);
+
+    return 0;
+}
+
+
+/**
+ @function seal
+ @within SharedMemory
+
+ Makes a writable region read-only before it's shared.
+
+ The region is mapped read-only afterwards. Where supported (Linux memfd)
+ the kernel seals the region so no process can modify, grow or shrink it
+ any longer.
+
+ @tparam userdata shm The SharedMemory region.
+ @treturn bool Returns **true** if the region is sealed by the kernel or
+ **false** if it's only read-only in this process.
+ */
+static int
+l2dbus_shmSealRegion
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SharedMemory* ud = l2dbus_shmCheck(L, 1);
+
+    if ( ud->fd < 0 )
+    {
+        luaL_error(L, "a mapped payload cannot be sealed");
+    }
+
+    lua_pushboolean(L, !ud->readOnly && l2dbus_shmSeal(ud));
+
+    return 1;
+}
+
+
+/**
+ @function getPayload
+ @within SharedMemory
+
+ Returns the reference to the payload sent in place of its bytes.
+
+ The reference is an array holding the Unix fd of the region, the offset
+ (zero) and the length of the payload. It's marshalled with the
+ @{PAYLOAD_SIGNATURE}, e.g.:
+
+    msg:addArgsBySignature(l2dbus.SharedMemory.PAYLOAD_SIGNATURE,
+                            shm:getPayload())
+
+ D-Bus duplicates the fd when it's added so the region can be closed
+ after the message is sent.
+
+ @tparam userdata shm The SharedMemory region created by this process.
+ @treturn table The payload reference.
+ */
+static int
+l2dbus_shmGetPayload
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SharedMemory* ud = l2dbus_shmCheck(L, 1);
+
+    if ( ud->fd < 0 )
+    {
+        luaL_error(L, "a mapped payload cannot be forwarded");
+    }
+
+    lua_createtable(L, 3, 0);
+    lua_pushinteger(L, ud->fd);
+    lua_rawseti(L, -2, 1);
+    lua_pushinteger(L, 0);
+    lua_rawseti(L, -2, 2);
+    lua_pushnumber(L, (lua_Number)ud->size);
+    lua_rawseti(L, -2, 3);
+
+    return 1;
+}
+
+
+/**
+ @function getFd
+ @within SharedMemory
+
+ Returns the Unix fd of a region created by this process.
+
+ @tparam userdata shm The SharedMemory region.
+ @treturn ?number|nil The fd or **nil** for a mapped payload.
+ */
+static int
+l2dbus_shmGetFd
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SharedMemory* ud = l2dbus_shmCheck(L, 1);
+
+    if ( ud->fd < 0 )
+    {
+        lua_pushnil(L);
+    }
+    else
+    {
+        lua_pushinteger(L, ud->fd);
+    }
+
+    return 1;
+}
+
+
+/**
+ @function getSize
+ @within SharedMemory
+
+ Returns the size of the payload. The length operator (#) can be used
+ as well.
+
+ @tparam userdata shm The SharedMemory region.
+ @treturn number The size (in bytes) of the payload.
+ */
+static int
+l2dbus_shmGetSize
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SharedMemory* ud = l2dbus_shmCheck(L, 1);
+
+    lua_pushnumber(L, (lua_Number)ud->size);
+
+    return 1;
+}
+
+
+/**
+ @function isReadOnly
+ @within SharedMemory
+
+ Tests whether the region is mapped read-only.
+
+ @tparam userdata shm The SharedMemory region.
+ @treturn bool Returns **true** if read-only, **false** otherwise.
+ */
+static int
+l2dbus_shmIsReadOnly
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SharedMemory* ud = l2dbus_shmCheck(L, 1);
+
+    lua_pushboolean(L, ud->readOnly);
+
+    return 1;
+}
+
+
+/**
+ @function close
+ @within SharedMemory
+
+ Unmaps the region (and closes its fd) without waiting for the garbage
+ collector. The region cannot be used afterwards.
+
+ @tparam userdata shm The SharedMemory region.
+ */
+static int
+l2dbus_shmClose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SharedMemory* ud = (l2dbus_SharedMemory*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SHARED_MEMORY_TYPE_ID);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    l2dbus_shmRelease(ud);
+
+    return 0;
+}
+
+
+/*
+ * Define the methods of the SharedMemory class
+ */
+static const luaL_Reg l2dbus_shmMetaTable[] = {
+    {"read", l2dbus_shmRead},
+    {"write", l2dbus_shmWrite},
+    {"seal", l2dbus_shmSealRegion},
+    {"getPayload", l2dbus_shmGetPayload},
+    {"getFd", l2dbus_shmGetFd},
+    {"getSize", l2dbus_shmGetSize},
+    {"isReadOnly", l2dbus_shmIsReadOnly},
+    {"close", l2dbus_shmClose},
+    {"__len", l2dbus_shmGetSize},
+    {"__gc", l2dbus_shmDispose},
+    {NULL, NULL},
+};
+
+
+/**
+ * @brief Creates the SharedMemory sub-module.
+ *
+ * This function creates a metatable entry for the SharedMemory userdata
+ * and simulates opening the SharedMemory sub-module.
+ *
+ * @return A table defining the SharedMemory sub-module.
+ */
+void
+l2dbus_openSharedMemory
+    (
+    lua_State*  L
+    )
+{
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_SHARED_MEMORY_TYPE_ID,
+            l2dbus_shmMetaTable));
+    lua_newtable(L);
+    lua_pushcfunction(L, l2dbus_newSharedMemory);
+    lua_setfield(L, -2, "new");
+
+    lua_pushcfunction(L, l2dbus_shmFromString);
+    lua_setfield(L, -2, "fromString");
+
+    lua_pushcfunction(L, l2dbus_shmMapPayload);
+    lua_setfield(L, -2, "map");
+
+/**
+ @constant PAYLOAD_SIGNATURE
+ The D-Bus signature of a payload reference: a structure holding the
+ Unix fd of the region followed by the offset and length of the payload.
+ */
+    lua_pushstring(L, L2DBUS_SHM_PAYLOAD_SIGNATURE);
+    lua_setfield(L, -2, "PAYLOAD_SIGNATURE");
+}
@@ -0,0 +1,521 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_sigplan.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of compiled D-Bus signature (marshal) plans.
+ *===========================================================================
+ */
+#include <string.h>
+#include <assert.h>
+#include "dbus/dbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_sigplan.h"
+#include "l2dbus_core.h"
+#include "l2dbus_object.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_context.h"
+#include "lauxlib.h"
+
+/**
+ * @brief Computes the hash (FNV-1a) of a D-Bus signature.
+ *
+ * @param [in] signature    The signature to hash.
+ * @return The computed hash value.
+ */
+static unsigned
+l2dbus_sigPlanHash
+    (
+    const char* signature
+    )
+{
+    unsigned hash = 2166136261U;
+
+    while ( '\0' != *signature )
+    {
+        hash ^= (unsigned char)*signature++;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+
+/**
+ * @brief Frees a compiled plan and all its operations.
+ *
+ * @param [in] plan The plan to free.
+ */
+static void
+l2dbus_sigPlanFree
+    (
+    l2dbus_SigPlan* plan
+    )
+{
+    int idx;
+
+    if ( NULL != plan )
+    {
+        if ( NULL != plan->ops )
+        {
+            for ( idx = 0; idx < plan->nOps; ++idx )
+            {
+                /* Allocated by dbus_signature_iter_get_signature() */
+                l2dbus_free(plan->ops[idx].subSig);
+            }
+            l2dbus_free(plan->ops);
+        }
+        l2dbus_free(plan->signature);
+        l2dbus_free(plan);
+    }
+}
+
+
+/**
+ * @brief Compiles a single complete type into the plan.
+ *
+ * This (recursive) function flattens the complete type referenced by
+ * the signature iterator (and any contained types) into plan operations.
+ *
+ * @param [in,out] plan     The plan being compiled.
+ * @param [in]     sigIt    The signature iterator positioned at the type.
+ * @param [in]     maxOps   The capacity of the plan's operation array.
+ * @return Returns true if the type was compiled, false otherwise.
+ */
+static l2dbus_Bool
+l2dbus_sigPlanCompileType
+    (
+    l2dbus_SigPlan*     plan,
+    DBusSignatureIter*  sigIt,
+    int                 maxOps
+    )
+{
+    l2dbus_Bool isOk = L2DBUS_TRUE;
+    DBusSignatureIter sigSubIt;
+    int opIdx = plan->nOps;
+
+    if ( opIdx >= maxOps )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    plan->nOps++;
+    plan->ops[opIdx].dbusType = dbus_signature_iter_get_current_type(sigIt);
+    plan->ops[opIdx].subSig = NULL;
+
+    switch ( plan->ops[opIdx].dbusType )
+    {
+        case DBUS_TYPE_ARRAY:
+            dbus_signature_iter_recurse(sigIt, &sigSubIt);
+            plan->ops[opIdx].subSig = dbus_signature_iter_get_signature(&sigSubIt);
+            isOk = (NULL != plan->ops[opIdx].subSig) &&
+                    l2dbus_sigPlanCompileType(plan, &sigSubIt, maxOps);
+            break;
+
+        case DBUS_TYPE_STRUCT:
+        case DBUS_TYPE_DICT_ENTRY:
+            dbus_signature_iter_recurse(sigIt, &sigSubIt);
+            do
+            {
+                isOk = l2dbus_sigPlanCompileType(plan, &sigSubIt, maxOps);
+            }
+            while ( isOk && dbus_signature_iter_next(&sigSubIt) );
+            break;
+
+        default:
+            /* Basic types and variants have no (static) contents */
+            break;
+    }
+
+    plan->ops[opIdx].next = plan->nOps;
+
+    return isOk;
+}
+
+
+/**
+ * @brief Creates a new compiled plan for a signature.
+ *
+ * @param [in] signature    The D-Bus signature to compile.
+ * @param [in] hash         The pre-computed hash of the signature.
+ * @return A new plan (with a reference count of one) or NULL if the
+ * signature is invalid or memory could not be allocated.
+ */
+static l2dbus_SigPlan*
+l2dbus_sigPlanNew
+    (
+    const char* signature,
+    unsigned    hash
+    )
+{
+    l2dbus_SigPlan* plan = NULL;
+    DBusSignatureIter sigIt;
+    l2dbus_Bool isOk = L2DBUS_TRUE;
+    size_t maxOps;
+
+    if ( dbus_signature_validate(signature, NULL) )
+    {
+        plan = l2dbus_calloc(1, sizeof(*plan));
+        if ( NULL != plan )
+        {
+            /* Each complete type consumes at least one signature character */
+            maxOps = strlen(signature);
+            plan->signature = l2dbus_strDup(signature);
+            plan->hash = hash;
+            plan->refCount = 1;
+            if ( maxOps > 0 )
+            {
+                plan->ops = l2dbus_calloc(maxOps, sizeof(*plan->ops));
+            }
+
+            if ( (NULL == plan->signature) ||
+                ((maxOps > 0) && (NULL == plan->ops)) )
+            {
+                isOk = L2DBUS_FALSE;
+            }
+            else if ( maxOps > 0 )
+            {
+                dbus_signature_iter_init(&sigIt, signature);
+                do
+                {
+                    isOk = l2dbus_sigPlanCompileType(plan, &sigIt, (int)maxOps);
+                }
+                while ( isOk && dbus_signature_iter_next(&sigIt) );
+            }
+
+            if ( !isOk )
+            {
+                L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                    "Failed to compile signature plan (%s)", signature));
+                l2dbus_sigPlanFree(plan);
+                plan = NULL;
+            }
+        }
+    }
+
+    return plan;
+}
+
+
+/**
+ * @brief Looks up (or compiles) the plan for a signature.
+ *
+ * The plan is retrieved from the LRU cache if present otherwise it's
+ * compiled and inserted into the cache, possibly evicting the least recently
+ * used plan. The returned plan is *borrowed* from the cache. Plans are only
+ * evicted by this function so the plan remains valid until the next lookup.
+ * Callers needing to hold on to a plan longer should add a reference.
+ * The cache belongs to the current module context.
+ *
+ * @param [in] signature    The D-Bus signature.
+ * @return The compiled plan or NULL if the signature is invalid.
+ */
+l2dbus_SigPlan*
+l2dbus_sigPlanLookup
+    (
+    const char* signature
+    )
+{
+    l2dbus_SigPlan* plan = NULL;
+    l2dbus_SigPlan* victim;
+    unsigned hash;
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+
+    assert( NULL != ctx );
+    if ( (NULL != signature) && (NULL != ctx) )
+    {
+        hash = l2dbus_sigPlanHash(signature);
+        TAILQ_FOREACH(plan, &ctx->sigPlanCache, link)
+        {
+            if ( (plan->hash == hash) &&
+                (0 == strcmp(plan->signature, signature)) )
+            {
+                break;
+            }
+        }
+
+        if ( NULL != plan )
+        {
+            /* Move the plan to the front of the LRU list */
+            if ( plan != TAILQ_FIRST(&ctx->sigPlanCache) )
+            {
+                TAILQ_REMOVE(&ctx->sigPlanCache, plan, link);
+                TAILQ_INSERT_HEAD(&ctx->sigPlanCache, plan, link);
+            }
+        }
+        else
+        {
+            plan = l2dbus_sigPlanNew(signature, hash);
+            if ( NULL != plan )
+            {
+                /* The cache owns the initial reference */
+                plan->isCached = L2DBUS_TRUE;
+                TAILQ_INSERT_HEAD(&ctx->sigPlanCache, plan, link);
+                ++ctx->sigPlanCacheCount;
+
+                if ( ctx->sigPlanCacheCount > L2DBUS_SIGPLAN_CACHE_SIZE )
+                {
+                    victim = TAILQ_LAST(&ctx->sigPlanCache, l2dbus_SigPlanHead);
+                    TAILQ_REMOVE(&ctx->sigPlanCache, victim, link);
+                    victim->isCached = L2DBUS_FALSE;
+                    --ctx->sigPlanCacheCount;
+                    l2dbus_sigPlanUnref(victim);
+                }
+            }
+        }
+    }
+
+    return plan;
+}
+
+
+/**
+ * @brief Adds a reference to a compiled plan.
+ *
+ * @param [in] plan The plan to reference.
+ * @return The referenced plan.
+ */
+l2dbus_SigPlan*
+l2dbus_sigPlanRef
+    (
+    l2dbus_SigPlan* plan
+    )
+{
+    if ( NULL != plan )
+    {
+        ++plan->refCount;
+    }
+    return plan;
+}
+
+
+/**
+ * @brief Releases a reference to a compiled plan.
+ *
+ * The plan is freed once the last reference is released.
+ *
+ * @param [in] plan The plan to unreference.
+ */
+void
+l2dbus_sigPlanUnref
+    (
+    l2dbus_SigPlan* plan
+    )
+{
+    if ( NULL != plan )
+    {
+        --plan->refCount;
+        if ( 0 >= plan->refCount )
+        {
+            l2dbus_sigPlanFree(plan);
+        }
+    }
+}
+
+
+/**
+ * @brief Releases all the plans held by the LRU cache.
+ *
+ * Plans still referenced by a Lua handle remain valid until the handle
+ * is collected. Only the cache of the current module context is flushed.
+ */
+void
+l2dbus_sigPlanFlushCache(void)
+{
+    l2dbus_SigPlan* plan;
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+
+    if ( NULL == ctx )
+    {
+        return;
+    }
+
+    while ( !TAILQ_EMPTY(&ctx->sigPlanCache) )
+    {
+        plan = TAILQ_FIRST(&ctx->sigPlanCache);
+        TAILQ_REMOVE(&ctx->sigPlanCache, plan, link);
+        plan->isCached = L2DBUS_FALSE;
+        l2dbus_sigPlanUnref(plan);
+    }
+    ctx->sigPlanCacheCount = 0;
+}
+
+
+/**
+ * @brief Retrieves a plan from a signature string or precompiled handle.
+ *
+ * Throws a Lua error if the argument is neither a valid signature nor
+ * a precompiled signature handle.
+ *
+ * @param [in] L    The Lua state.
+ * @param [in] idx  The stack index of the signature or handle.
+ * @return The (borrowed) compiled plan.
+ */
+l2dbus_SigPlan*
+l2dbus_sigPlanCheck
+    (
+    lua_State*  L,
+    int         idx
+    )
+{
+    l2dbus_SigPlan* plan;
+    l2dbus_SigPlanUd* ud;
+    const char* signature;
+
+    ud = (l2dbus_SigPlanUd*)l2dbus_isUserData(L, idx,
+                                    L2DBUS_SIGNATURE_PLAN_TYPE_ID);
+    if ( NULL != ud )
+    {
+        plan = ud->plan;
+    }
+    else
+    {
+        signature = luaL_checkstring(L, idx);
+        plan = l2dbus_sigPlanLookup(signature);
+        if ( NULL == plan )
+        {
+            luaL_error(L, "invalid D-Bus message signature (%s)", signature);
+        }
+    }
+
+    return plan;
+}
+
+
+/**
+ @function compileSignature
+ @within l2dbus.Message
+
+ Precompiles a D-Bus signature into a reusable handle.
+
+ The signature is validated and flattened into a marshalling plan once. The
+ returned handle can be passed anywhere a signature is accepted by
+ @{addArgsBySignature} to avoid re-parsing the signature on every message.
+ Signatures passed as strings are also compiled but are held in a bounded
+ least-recently-used cache. A Lua error is thrown if the signature is
+ invalid.
+
+ @tparam string signature The D-Bus signature to compile.
+ @treturn userdata A handle to the precompiled signature.
+ */
+int
+l2dbus_sigPlanCompile
+    (
+    lua_State*  L
+    )
+{
+    const char* signature;
+    l2dbus_SigPlan* plan;
+    l2dbus_SigPlanUd* ud;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    signature = luaL_checkstring(L, 1);
+    plan = l2dbus_sigPlanLookup(signature);
+    if ( NULL == plan )
+    {
+        luaL_error(L, "invalid D-Bus message signature (%s)", signature);
+    }
+
+    ud = (l2dbus_SigPlanUd*)l2dbus_objectNew(L, sizeof(*ud),
+                                            L2DBUS_SIGNATURE_PLAN_TYPE_ID);
+    ud->plan = l2dbus_sigPlanRef(plan);
+
+    return 1;
+}
+
+
+/**
+ * @brief Returns the signature string of a precompiled handle.
+ *
+ * @return The signature string.
+ */
+static int
+l2dbus_sigPlanGetSignature
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SigPlanUd* ud = (l2dbus_SigPlanUd*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SIGNATURE_PLAN_TYPE_ID);
+    lua_pushstring(L, ud->plan->signature);
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the precompiled signature handle.
+ *
+ * @return nil
+ */
+static int
+l2dbus_sigPlanDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_SigPlanUd* ud = (l2dbus_SigPlanUd*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_SIGNATURE_PLAN_TYPE_ID);
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: signature plan (userdata=%p)", ud));
+
+    l2dbus_sigPlanUnref(ud->plan);
+    ud->plan = NULL;
+
+    return 0;
+}
+
+
+/*
+ * Define the methods of the precompiled signature handle
+ */
+static const luaL_Reg l2dbus_sigPlanMetaTable[] = {
+    {"signature", l2dbus_sigPlanGetSignature},
+    {"__tostring", l2dbus_sigPlanGetSignature},
+    {"__gc", l2dbus_sigPlanDispose},
+    {NULL, NULL},
+};
+
+
+/**
+ * @brief Creates the metatable for precompiled signature handles.
+ *
+ * Handles are created via l2dbus.Message.compileSignature so there is
+ * no separate sub-module table.
+ */
+void
+l2dbus_openSigPlan
+    (
+    lua_State*  L
+    )
+{
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_SIGNATURE_PLAN_TYPE_ID,
+            l2dbus_sigPlanMetaTable));
+}
@@ -0,0 +1,85 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_sigplan.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of compiled D-Bus signature (marshal) plans.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_SIGPLAN_H_
+#define L2DBUS_SIGPLAN_H_
+
+#include "lua.h"
+#include "queue.h"
+#include "l2dbus_types.h"
+
+/* The maximum number of compiled signature plans held in the LRU cache */
+#ifndef L2DBUS_SIGPLAN_CACHE_SIZE
+#define L2DBUS_SIGPLAN_CACHE_SIZE   (64)
+#endif
+
+/*
+ * A single operation in a flattened marshal plan. Every complete D-Bus
+ * type in the signature maps to exactly one operation. Container types
+ * are immediately followed by the operations describing their contents.
+ */
+typedef struct l2dbus_SigPlanOp
+{
+    int                             dbusType;
+    /* Index of the operation following this complete type */
+    int                             next;
+    /* The element signature of an array (NULL for other types) */
+    char*                           subSig;
+} l2dbus_SigPlanOp;
+
+typedef struct l2dbus_SigPlan
+{
+    char*                           signature;
+    unsigned                        hash;
+    int                             refCount;
+    int                             nOps;
+    l2dbus_SigPlanOp*               ops;
+    l2dbus_Bool                     isCached;
+    TAILQ_ENTRY(l2dbus_SigPlan)     link;
+} l2dbus_SigPlan;
+
+/* The Lua userdata (handle) for a precompiled signature */
+typedef struct l2dbus_SigPlanUd
+{
+    l2dbus_SigPlan*                 plan;
+} l2dbus_SigPlanUd;
+
+l2dbus_SigPlan* l2dbus_sigPlanLookup(const char* signature);
+l2dbus_SigPlan* l2dbus_sigPlanRef(l2dbus_SigPlan* plan);
+void l2dbus_sigPlanUnref(l2dbus_SigPlan* plan);
+l2dbus_SigPlan* l2dbus_sigPlanCheck(lua_State* L, int idx);
+void l2dbus_sigPlanFlushCache(void);
+int l2dbus_sigPlanCompile(lua_State* L);
+void l2dbus_openSigPlan(lua_State* L);
+
+#endif /* Guard for L2DBUS_SIGPLAN_H_ */
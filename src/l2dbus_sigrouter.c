@@ -0,0 +1,550 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_sigrouter.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the shared signal subscription router
+ *===========================================================================
+ */
+#include <string.h>
+#include <assert.h>
+#include "l2dbus_compat.h"
+#include "l2dbus_sigrouter.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_match.h"
+#include "l2dbus_message.h"
+#include "l2dbus_transcode.h"
+#include "l2dbus_callback.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_stats.h"
+#include "lauxlib.h"
+
+/* The rule fields that make up the key of a route */
+static const char* const gRouteFields[] =
+{
+    "sender", "path", "interface", "member"
+};
+
+#define L2DBUS_SIGROUTER_N_FIELDS   \
+    (sizeof(gRouteFields) / sizeof(gRouteFields[0]))
+
+
+static unsigned
+l2dbus_sigRouterHash
+    (
+    const char* s,
+    size_t      len
+    )
+{
+    unsigned h = 2166136261u;
+    size_t idx;
+
+    for ( idx = 0; idx < len; ++idx )
+    {
+        h = (h ^ (unsigned char)s[idx]) * 16777619u;
+    }
+    return h;
+}
+
+
+/* Removes a route from the router and releases its bus-side match */
+static void
+l2dbus_sigRouterFreeRoute
+    (
+    lua_State*          L,
+    l2dbus_Connection*  connUd,
+    l2dbus_SigRoute*    route
+    )
+{
+    l2dbus_SigRoute** link;
+    l2dbus_SigSubscriber* sub;
+
+    link = &connUd->sigRouter.buckets[route->hash % L2DBUS_SIGROUTER_BUCKETS];
+    while ( NULL != *link )
+    {
+        if ( *link == route )
+        {
+            *link = route->next;
+            --connUd->sigRouter.nRoutes;
+            break;
+        }
+        link = &(*link)->next;
+    }
+
+    while ( !TAILQ_EMPTY(&route->subscribers) )
+    {
+        sub = TAILQ_FIRST(&route->subscribers);
+        TAILQ_REMOVE(&route->subscribers, sub, link);
+        if ( !sub->isDead )
+        {
+            l2dbus_callbackUnref(L, &sub->cbCtx);
+            --connUd->sigRouter.nSubscribers;
+        }
+        l2dbus_free(sub);
+    }
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Free signal route (%p)", route));
+    l2dbus_disposeMatch(L, route->match);
+    l2dbus_free(route->key);
+    l2dbus_free(route);
+}
+
+
+/* Frees the subscribers removed while the route was delivering a signal
+ * and the route itself once nobody is subscribed to it.
+ */
+static void
+l2dbus_sigRouterSweep
+    (
+    lua_State*          L,
+    l2dbus_Connection*  connUd,
+    l2dbus_SigRoute*    route
+    )
+{
+    l2dbus_SigSubscriber* sub;
+    l2dbus_SigSubscriber* next;
+
+    if ( 0 != route->inDelivery )
+    {
+        return;
+    }
+
+    if ( 0 == route->nSubscribers )
+    {
+        l2dbus_sigRouterFreeRoute(L, connUd, route);
+    }
+    else
+    {
+        for ( sub = TAILQ_FIRST(&route->subscribers); NULL != sub; sub = next )
+        {
+            next = TAILQ_NEXT(sub, link);
+            if ( sub->isDead )
+            {
+                TAILQ_REMOVE(&route->subscribers, sub, link);
+                l2dbus_free(sub);
+            }
+        }
+    }
+}
+
+
+/* Protected decoding of the message (at index 1) arguments */
+static int
+l2dbus_sigRouterDecode
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Message* msgUd = (l2dbus_Message*)lua_touserdata(L, 1);
+    l2dbus_TranscodeOpts opts;
+
+    memset(&opts, 0, sizeof(opts));
+    return l2dbus_transcodeDbusArgsToLua(L, msgUd->msg, &opts);
+}
+
+
+/**
+ * @brief Delivers a signal to every subscriber of a route.
+ *
+ * The message is wrapped once and, if any subscriber asked for them, the
+ * arguments are decoded once. Every subscriber is then handed the same
+ * Message userdata (and argument values). Subscribers may unsubscribe from
+ * within their handler.
+ *
+ * @param [in] route    The route whose (shared) match rule matched.
+ * @param [in] msg      The D-Bus signal.
+ */
+void
+l2dbus_sigRouterDeliver
+    (
+    l2dbus_SigRoute*    route,
+    DBusMessage*        msg
+    )
+{
+    lua_State* L = l2dbus_callbackGetThread();
+    l2dbus_Connection* connUd = route->match->connUd;
+    l2dbus_SigSubscriber* sub;
+    const char* errMsg = "";
+    int msgIdx;
+    int nArgs = 0;
+    int nCallArgs;
+    int idx;
+    double cbStart;
+    int status;
+
+    assert( NULL != L );
+
+    ++route->inDelivery;
+
+    l2dbus_messageWrap(L, msg, L2DBUS_TRUE);
+    msgIdx = lua_gettop(L);
+
+    if ( 0 < route->nDecode )
+    {
+        lua_pushcfunction(L, l2dbus_sigRouterDecode);
+        lua_pushvalue(L, msgIdx);
+        if ( 0 != lua_pcall(L, 1 /* nArgs */, LUA_MULTRET, 0) )
+        {
+            if ( lua_isstring(L, -1) )
+            {
+                errMsg = lua_tostring(L, -1);
+            }
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Signal decode error: %s", errMsg));
+            lua_settop(L, msgIdx);
+        }
+        nArgs = lua_gettop(L) - msgIdx;
+    }
+
+    TAILQ_FOREACH(sub, &route->subscribers, link)
+    {
+        if ( sub->isDead )
+        {
+            continue;
+        }
+
+        nCallArgs = 3;
+        if ( sub->decodeArgs )
+        {
+            nCallArgs += nArgs;
+        }
+
+        if ( !lua_checkstack(L, nCallArgs + 1) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Too many signal arguments"));
+            break;
+        }
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, sub->cbCtx.funcRef);
+        lua_pushlightuserdata(L, sub);
+        lua_pushvalue(L, msgIdx);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, sub->cbCtx.userRef);
+        if ( sub->decodeArgs )
+        {
+            for ( idx = 1; idx <= nArgs; ++idx )
+            {
+                lua_pushvalue(L, msgIdx + idx);
+            }
+        }
+
+        cbStart = l2dbus_statsCallbackStart(L, nCallArgs);
+        status = lua_pcall(L, nCallArgs, 0, 0);
+        l2dbus_statsCallback(L2DBUS_STATS_CB_SIGNAL_ROUTER, cbStart, status);
+        if ( 0 != status )
+        {
+            errMsg = "";
+            if ( lua_isstring(L, -1) )
+            {
+                errMsg = lua_tostring(L, -1);
+            }
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Signal callback error: %s", errMsg));
+            lua_pop(L, 1);
+        }
+    }
+
+    --route->inDelivery;
+    l2dbus_sigRouterSweep(L, connUd, route);
+
+    /* Clean up the thread stack */
+    lua_settop(L, 0);
+
+    /* Reclaim any transient allocations made while servicing the callback */
+    l2dbus_arenaReset();
+}
+
+
+/* Finds (or creates) the route for a subscription rule. The stack is left
+ * unchanged.
+ */
+static l2dbus_SigRoute*
+l2dbus_sigRouterGetRoute
+    (
+    lua_State*          L,
+    l2dbus_Connection*  connUd,
+    int                 connIdx,
+    int                 ruleIdx,
+    const char**        reason
+    )
+{
+    l2dbus_SigRoute* route = NULL;
+    const char* key;
+    size_t keyLen;
+    unsigned hash;
+    unsigned idx;
+    int top = lua_gettop(L);
+    int matchRuleIdx;
+
+    /* Build the match rule of the route and its key at the same time */
+    lua_createtable(L, 0, L2DBUS_SIGROUTER_N_FIELDS + 1);
+    matchRuleIdx = lua_gettop(L);
+    lua_pushinteger(L, DBUS_MESSAGE_TYPE_SIGNAL);
+    lua_setfield(L, matchRuleIdx, "msgType");
+
+    for ( idx = 0; idx < L2DBUS_SIGROUTER_N_FIELDS; ++idx )
+    {
+        lua_getfield(L, ruleIdx, gRouteFields[idx]);
+        if ( LUA_TSTRING == lua_type(L, -1) )
+        {
+            lua_pushvalue(L, -1);
+            lua_setfield(L, matchRuleIdx, gRouteFields[idx]);
+        }
+        else if ( lua_isnil(L, -1) )
+        {
+            lua_pop(L, 1);
+            lua_pushliteral(L, "");
+        }
+        else
+        {
+            *reason = "signal rule fields must be strings";
+            lua_settop(L, top);
+            return NULL;
+        }
+        /* Separate the fields with a character not valid in any of them */
+        lua_pushliteral(L, "\n");
+    }
+    lua_concat(L, 2 * L2DBUS_SIGROUTER_N_FIELDS);
+    key = lua_tolstring(L, -1, &keyLen);
+    hash = l2dbus_sigRouterHash(key, keyLen);
+
+    for ( route = connUd->sigRouter.buckets[hash % L2DBUS_SIGROUTER_BUCKETS];
+        NULL != route; route = route->next )
+    {
+        if ( (route->hash == hash) && (0 == strcmp(route->key, key)) )
+        {
+            break;
+        }
+    }
+
+    if ( NULL == route )
+    {
+        route = (l2dbus_SigRoute*)l2dbus_calloc(1, sizeof(*route));
+        if ( NULL != route )
+        {
+            route->key = l2dbus_strDup(key);
+            if ( NULL != route->key )
+            {
+                route->match = l2dbus_newMatch(L, matchRuleIdx,
+                                            L2DBUS_CALLBACK_NOREF_NEEDED,
+                                            L2DBUS_CALLBACK_NOREF_NEEDED,
+                                            connIdx, reason);
+            }
+            else
+            {
+                *reason = "failed to allocate memory for signal route";
+            }
+
+            if ( NULL == route->match )
+            {
+                l2dbus_free(route->key);
+                l2dbus_free(route);
+                route = NULL;
+            }
+        }
+        else
+        {
+            *reason = "failed to allocate memory for signal route";
+        }
+
+        if ( NULL != route )
+        {
+            route->match->route = route;
+            route->hash = hash;
+            TAILQ_INIT(&route->subscribers);
+            idx = hash % L2DBUS_SIGROUTER_BUCKETS;
+            route->next = connUd->sigRouter.buckets[idx];
+            connUd->sigRouter.buckets[idx] = route;
+            ++connUd->sigRouter.nRoutes;
+            L2DBUS_TRACE((L2DBUS_TRC_TRACE, "New signal route (%p)", route));
+        }
+    }
+
+    lua_settop(L, top);
+
+    return route;
+}
+
+
+/**
+ * @brief Subscribes a Lua handler to a signal.
+ *
+ * Subscribers whose rules have the same sender, path, interface and member
+ * share a route and therefore a single bus-side match rule. A route is
+ * created (and the match rule added) for the first subscriber.
+ *
+ * @param [in]      L           Lua state
+ * @param [in]      connIdx     The index of the Lua connection userdata.
+ * @param [in]      ruleIdx     The index of the subscription rule table.
+ * @param [in]      funcIdx     The index of the Lua handler function.
+ * @param [in]      userIdx     The index of the user token (or
+ *                              L2DBUS_CALLBACK_NOREF_NEEDED).
+ * @param [in,out]  errMsg      Optionally receives a constant error message
+ *                              on failure.
+ * @return The new subscriber or NULL on failure.
+ */
+l2dbus_SigSubscriber*
+l2dbus_sigRouterSubscribe
+    (
+    lua_State*      L,
+    int             connIdx,
+    int             ruleIdx,
+    int             funcIdx,
+    int             userIdx,
+    const char**    errMsg
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_SigRoute* route;
+    l2dbus_SigSubscriber* sub = NULL;
+    const char* reason = "";
+
+    connIdx = lua_absindex(L, connIdx);
+    ruleIdx = lua_absindex(L, ruleIdx);
+    connUd = (l2dbus_Connection*)lua_touserdata(L, connIdx);
+
+    route = l2dbus_sigRouterGetRoute(L, connUd, connIdx, ruleIdx, &reason);
+    if ( NULL != route )
+    {
+        sub = (l2dbus_SigSubscriber*)l2dbus_calloc(1, sizeof(*sub));
+        if ( NULL == sub )
+        {
+            reason = "failed to allocate memory for signal subscriber";
+            /* The route may have been created just for this subscriber */
+            l2dbus_sigRouterSweep(L, connUd, route);
+        }
+        else
+        {
+            sub->route = route;
+            l2dbus_callbackInit(&sub->cbCtx);
+            l2dbus_callbackRef(L, funcIdx, userIdx, &sub->cbCtx);
+            lua_getfield(L, ruleIdx, "decodeArgs");
+            sub->decodeArgs = lua_toboolean(L, -1) ? L2DBUS_TRUE :
+                                                    L2DBUS_FALSE;
+            lua_pop(L, 1);
+
+            TAILQ_INSERT_TAIL(&route->subscribers, sub, link);
+            ++route->nSubscribers;
+            if ( sub->decodeArgs )
+            {
+                ++route->nDecode;
+            }
+            ++connUd->sigRouter.nSubscribers;
+        }
+    }
+
+    if ( NULL != errMsg )
+    {
+        *errMsg = reason;
+    }
+
+    return sub;
+}
+
+
+/**
+ * @brief Unsubscribes a handler from its signal route.
+ *
+ * The bus-side match rule is removed with the last subscriber of a route.
+ *
+ * @param [in] L        Lua state
+ * @param [in] connUd   The connection the subscription was made on.
+ * @param [in] sub      The (unverified) subscriber handle.
+ * @return L2DBUS_TRUE if the handle was subscribed, L2DBUS_FALSE otherwise.
+ */
+l2dbus_Bool
+l2dbus_sigRouterUnsubscribe
+    (
+    lua_State*              L,
+    l2dbus_Connection*      connUd,
+    l2dbus_SigSubscriber*   sub
+    )
+{
+    l2dbus_SigRoute* route;
+    l2dbus_SigSubscriber* item = NULL;
+    unsigned idx;
+
+    /* Verify the handle belongs to this connection before touching it */
+    for ( idx = 0; (idx < L2DBUS_SIGROUTER_BUCKETS) && (NULL == item); ++idx )
+    {
+        for ( route = connUd->sigRouter.buckets[idx];
+            (NULL != route) && (NULL == item); route = route->next )
+        {
+            TAILQ_FOREACH(item, &route->subscribers, link)
+            {
+                if ( (item == sub) && !item->isDead )
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    if ( NULL == item )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    route = sub->route;
+    l2dbus_callbackUnref(L, &sub->cbCtx);
+    sub->isDead = L2DBUS_TRUE;
+    --route->nSubscribers;
+    if ( sub->decodeArgs )
+    {
+        --route->nDecode;
+    }
+    --connUd->sigRouter.nSubscribers;
+
+    l2dbus_sigRouterSweep(L, connUd, route);
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Releases every route (and subscriber) of a connection.
+ *
+ * @param [in] L        Lua state
+ * @param [in] connUd   The connection being disposed.
+ */
+void
+l2dbus_sigRouterDispose
+    (
+    lua_State*          L,
+    l2dbus_Connection*  connUd
+    )
+{
+    unsigned idx;
+
+    for ( idx = 0; idx < L2DBUS_SIGROUTER_BUCKETS; ++idx )
+    {
+        while ( NULL != connUd->sigRouter.buckets[idx] )
+        {
+            l2dbus_sigRouterFreeRoute(L, connUd,
+                                    connUd->sigRouter.buckets[idx]);
+        }
+    }
+}
@@ -0,0 +1,94 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_sigrouter.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the shared signal subscription router
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_SIGROUTER_H_
+#define L2DBUS_SIGROUTER_H_
+
+#include "lua.h"
+#include "queue.h"
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
+#include "l2dbus_callback.h"
+
+/* Number of hash buckets used to find the route of a signal rule */
+#define L2DBUS_SIGROUTER_BUCKETS    (64)
+
+/* Forward declarations */
+struct l2dbus_Connection;
+struct l2dbus_Match;
+struct l2dbus_SigRoute;
+
+/* A single Lua handler subscribed to a (shared) signal route */
+typedef struct l2dbus_SigSubscriber
+{
+    struct l2dbus_SigRoute*             route;
+    l2dbus_CallbackCtx                  cbCtx;
+    l2dbus_Bool                         decodeArgs;
+    l2dbus_Bool                         isDead;
+    TAILQ_ENTRY(l2dbus_SigSubscriber)   link;
+} l2dbus_SigSubscriber;
+
+/*
+ * All the subscribers to signals matching the same (sender, path, interface,
+ * member) tuple share one route and so a single bus-side match rule.
+ */
+typedef struct l2dbus_SigRoute
+{
+    struct l2dbus_SigRoute*     next;
+    unsigned                    hash;
+    char*                       key;
+    struct l2dbus_Match*        match;
+    TAILQ_HEAD(l2dbus_SigSubscriberHead,
+                  l2dbus_SigSubscriber) subscribers;
+    unsigned                    nSubscribers;
+    unsigned                    nDecode;
+    unsigned                    inDelivery;
+} l2dbus_SigRoute;
+
+typedef struct l2dbus_SigRouter
+{
+    l2dbus_SigRoute*            buckets[L2DBUS_SIGROUTER_BUCKETS];
+    unsigned                    nRoutes;
+    unsigned                    nSubscribers;
+} l2dbus_SigRouter;
+
+l2dbus_SigSubscriber* l2dbus_sigRouterSubscribe(lua_State* L, int connIdx,
+                                int ruleIdx, int funcIdx, int userIdx,
+                                const char** errMsg);
+l2dbus_Bool l2dbus_sigRouterUnsubscribe(lua_State* L,
+                                struct l2dbus_Connection* connUd,
+                                l2dbus_SigSubscriber* sub);
+void l2dbus_sigRouterDispose(lua_State* L, struct l2dbus_Connection* connUd);
+void l2dbus_sigRouterDeliver(l2dbus_SigRoute* route, DBusMessage* msg);
+
+#endif /* Guard for L2DBUS_SIGROUTER_H_ */
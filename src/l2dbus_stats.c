@@ -0,0 +1,910 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_stats.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the runtime metrics (statistics) of the module.
+ *===========================================================================
+ */
+#include <string.h>
+#include <math.h>
+#include "lauxlib.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_context.h"
+#include "l2dbus_core.h"
+#include "l2dbus_util.h"
+
+/**
+ L2DBUS Stats
+
+ This section describes the L2DBUS runtime metrics.
+
+ Unlike @{l2dbus.Trace} the metrics are always compiled in and cost little
+ more than an increment (and, for timed events, a read of the monotonic
+ clock). They are kept separately for each Lua state. A @{snapshot} can be
+ taken at any time and handed to a metrics exporter (e.g. Prometheus) and
+ the metrics can be @{reset} between snapshots if deltas are preferred.
+
+ Counters are kept for messages sent and received by type, the number of
+ arguments marshalled and unmarshalled, and Lua callback invocations and
+ errors. Times are recorded in log-bucketed histograms: bucket *i* counts
+ samples taking less than 2^*i* microseconds.
+
+ @namespace l2dbus.Stats
+ */
+
+#define X(a, b) b,
+static const char* const gStatsCbNames[] =
+{
+    L2DBUS_STATS_CB_TABLE
+};
+
+static const char* const gStatsHistNames[] =
+{
+    L2DBUS_STATS_HIST_TABLE
+};
+#undef X
+
+/* Names of the message counters indexed by D-Bus message type */
+static const char* const gStatsMsgTypeNames[L2DBUS_STATS_MSG_TYPES] =
+{
+    "invalid",
+    "methodCall",
+    "methodReturn",
+    "error",
+    "signal"
+};
+
+
+static l2dbus_Stats*
+l2dbus_statsCurrent(void)
+{
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+
+    return (NULL != ctx) ? &ctx->stats : NULL;
+}
+
+
+static void
+l2dbus_statsHistAdd
+    (
+    l2dbus_StatsHist*   hist,
+    double              secs
+    )
+{
+    double usec;
+    int bucket = 0;
+
+    if ( secs < 0.0 )
+    {
+        secs = 0.0;
+    }
+
+    usec = secs * 1.0e6;
+    if ( usec >= 1.0 )
+    {
+        /* usec = m * 2^bucket with m in [0.5, 1) so usec < 2^bucket */
+        (void)frexp(usec, &bucket);
+        if ( bucket >= L2DBUS_STATS_HIST_BUCKETS )
+        {
+            bucket = L2DBUS_STATS_HIST_BUCKETS - 1;
+        }
+    }
+
+    hist->count++;
+    hist->sum += secs;
+    if ( secs > hist->max )
+    {
+        hist->max = secs;
+    }
+    hist->buckets[bucket]++;
+}
+
+
+/**
+ * @brief Resets all the metrics.
+ *
+ * @param [in] stats The metrics to reset.
+ */
+void
+l2dbus_statsInit
+    (
+    l2dbus_Stats*   stats
+    )
+{
+    l2dbus_Bool timingEnabled = L2DBUS_TRUE;
+
+    if ( NULL != stats )
+    {
+        /* Resetting the metrics does not change whether they're timed */
+        if ( 0.0 != stats->resetTime )
+        {
+            timingEnabled = stats->timingEnabled;
+        }
+        memset(stats, 0, sizeof(*stats));
+        stats->timingEnabled = timingEnabled;
+        stats->resetTime = l2dbus_monotonicTime();
+    }
+}
+
+
+/**
+ * @brief Returns the start time of a timed event.
+ *
+ * @return The current monotonic time (in seconds) or zero if timing is
+ * disabled. A zero start time is ignored when the event is recorded.
+ */
+double
+l2dbus_statsStart(void)
+{
+    l2dbus_Stats* stats = l2dbus_statsCurrent();
+
+    return ((NULL != stats) && stats->timingEnabled) ?
+                                    l2dbus_monotonicTime() : 0.0;
+}
+
+
+/**
+ * @brief Returns the start time of a Lua callback.
+ *
+ * The callback function and its arguments must be on the top of the stack
+ * of the thread calling it. The callback is also handed to the watchdog.
+ *
+ * @param [in] L        The thread that calls the callback.
+ * @param [in] nArgs    The number of arguments above the callback function.
+ * @return The start time to pass to l2dbus_statsCallback().
+ */
+double
+l2dbus_statsCallbackStart
+    (
+    lua_State*  L,
+    int         nArgs
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+
+    if ( NULL != ctx )
+    {
+        l2dbus_watchdogEnter(&ctx->watchdog, L, -(nArgs + 1));
+    }
+
+    return l2dbus_statsStart();
+}
+
+
+/**
+ * @brief Records the time elapsed since an event started.
+ *
+ * @param [in] histId       The histogram recording the event.
+ * @param [in] startTime    The start time returned by l2dbus_statsStart().
+ */
+void
+l2dbus_statsRecord
+    (
+    l2dbus_StatsHistId  histId,
+    double              startTime
+    )
+{
+    if ( 0.0 != startTime )
+    {
+        l2dbus_statsObserve(histId, l2dbus_monotonicTime() - startTime);
+    }
+}
+
+
+/**
+ * @brief Adds a sample to a latency histogram.
+ *
+ * @param [in] histId   The histogram recording the sample.
+ * @param [in] secs     The sample (in seconds).
+ */
+void
+l2dbus_statsObserve
+    (
+    l2dbus_StatsHistId  histId,
+    double              secs
+    )
+{
+    l2dbus_Stats* stats = l2dbus_statsCurrent();
+
+    if ( (NULL != stats) && (histId < L2DBUS_STATS_HIST_COUNT) )
+    {
+        l2dbus_statsHistAdd(&stats->hist[histId], secs);
+    }
+}
+
+
+/**
+ * @brief Counts (and times) a Lua callback.
+ *
+ * @param [in] cbId         The kind of callback.
+ * @param [in] startTime    The start time returned by
+ * l2dbus_statsCallbackStart() before the callback was called.
+ * @param [in] pcallStatus  The status returned by lua_pcall().
+ */
+void
+l2dbus_statsCallback
+    (
+    l2dbus_StatsCallbackId  cbId,
+    double                  startTime,
+    int                     pcallStatus
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+    l2dbus_Stats* stats = (NULL != ctx) ? &ctx->stats : NULL;
+    l2dbus_StatsHist* hist;
+
+    if ( NULL != ctx )
+    {
+        l2dbus_watchdogLeave(&ctx->watchdog);
+    }
+
+    if ( (NULL != stats) && (cbId < L2DBUS_STATS_CB_COUNT) )
+    {
+        hist = &stats->cbHist[cbId];
+        if ( 0.0 != startTime )
+        {
+            l2dbus_statsHistAdd(hist, l2dbus_monotonicTime() - startTime);
+        }
+        else
+        {
+            /* Keep the count exact even when callbacks aren't timed */
+            hist->count++;
+        }
+
+        if ( 0 != pcallStatus )
+        {
+            stats->cbErrors[cbId]++;
+        }
+    }
+}
+
+
+/**
+ * @brief Counts arguments converted between Lua and D-Bus.
+ *
+ * @param [in] marshalled   L2DBUS_TRUE if the arguments were marshalled
+ * (Lua to D-Bus) or L2DBUS_FALSE if unmarshalled (D-Bus to Lua).
+ * @param [in] nArgs        The number of arguments.
+ */
+void
+l2dbus_statsCountArgs
+    (
+    l2dbus_Bool marshalled,
+    unsigned    nArgs
+    )
+{
+    l2dbus_Stats* stats = l2dbus_statsCurrent();
+
+    if ( NULL != stats )
+    {
+        if ( marshalled )
+        {
+            stats->argsMarshalled += nArgs;
+        }
+        else
+        {
+            stats->argsUnmarshalled += nArgs;
+        }
+    }
+}
+
+
+static unsigned
+l2dbus_statsMsgType
+    (
+    DBusMessage*    msg
+    )
+{
+    int msgType = dbus_message_get_type(msg);
+
+    return ((msgType > DBUS_MESSAGE_TYPE_INVALID) &&
+            (msgType < L2DBUS_STATS_MSG_TYPES)) ?
+                (unsigned)msgType : DBUS_MESSAGE_TYPE_INVALID;
+}
+
+
+/**
+ * @brief Counts a message queued (or not) for sending.
+ *
+ * @param [in] connCounters The counters of the connection (may be NULL).
+ * @param [in] msg          The message.
+ * @param [in] queued       L2DBUS_TRUE if the message was queued.
+ */
+void
+l2dbus_statsCountSent
+    (
+    l2dbus_StatsMsgCounters*    connCounters,
+    DBusMessage*                msg,
+    l2dbus_Bool                 queued
+    )
+{
+    l2dbus_Stats* stats = l2dbus_statsCurrent();
+    unsigned msgType;
+
+    if ( NULL == msg )
+    {
+        return;
+    }
+
+    msgType = l2dbus_statsMsgType(msg);
+    if ( queued )
+    {
+        if ( NULL != stats )
+        {
+            stats->msgs.sent[msgType]++;
+        }
+        if ( NULL != connCounters )
+        {
+            connCounters->sent[msgType]++;
+        }
+    }
+    else
+    {
+        if ( NULL != stats )
+        {
+            stats->msgs.sendFailures++;
+        }
+        if ( NULL != connCounters )
+        {
+            connCounters->sendFailures++;
+        }
+    }
+}
+
+
+/**
+ * @brief Counts a received message.
+ *
+ * @param [in] connCounters The counters of the connection (may be NULL).
+ * @param [in] msg          The message.
+ */
+void
+l2dbus_statsCountReceived
+    (
+    l2dbus_StatsMsgCounters*    connCounters,
+    DBusMessage*                msg
+    )
+{
+    l2dbus_Stats* stats = l2dbus_statsCurrent();
+    unsigned msgType;
+
+    if ( NULL == msg )
+    {
+        return;
+    }
+
+    msgType = l2dbus_statsMsgType(msg);
+    if ( NULL != stats )
+    {
+        stats->msgs.received[msgType]++;
+    }
+    if ( NULL != connCounters )
+    {
+        connCounters->received[msgType]++;
+    }
+}
+
+
+/**
+ * @brief Counts a received message superseded by a newer one.
+ *
+ * @param [in] connCounters The counters of the connection (may be NULL).
+ */
+void
+l2dbus_statsCountConflated
+    (
+    l2dbus_StatsMsgCounters*    connCounters
+    )
+{
+    l2dbus_Stats* stats = l2dbus_statsCurrent();
+
+    if ( NULL != stats )
+    {
+        stats->msgs.conflated++;
+    }
+    if ( NULL != connCounters )
+    {
+        connCounters->conflated++;
+    }
+}
+
+
+static void
+l2dbus_statsPushTypeCounts
+    (
+    lua_State*                  L,
+    const unsigned long long*   counts
+    )
+{
+    unsigned long long total = 0;
+    unsigned idx;
+
+    lua_createtable(L, 0, L2DBUS_STATS_MSG_TYPES + 1);
+    for ( idx = DBUS_MESSAGE_TYPE_METHOD_CALL; idx < L2DBUS_STATS_MSG_TYPES;
+        ++idx )
+    {
+        lua_pushnumber(L, (lua_Number)counts[idx]);
+        lua_setfield(L, -2, gStatsMsgTypeNames[idx]);
+        total += counts[idx];
+    }
+    lua_pushnumber(L, (lua_Number)total);
+    lua_setfield(L, -2, "total");
+}
+
+
+/**
+ * @brief Pushes a table of message counters on the Lua stack.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] counters The message counters.
+ */
+void
+l2dbus_statsPushMsgCounters
+    (
+    lua_State*                      L,
+    const l2dbus_StatsMsgCounters*  counters
+    )
+{
+    lua_createtable(L, 0, 4);
+    l2dbus_statsPushTypeCounts(L, counters->sent);
+    lua_setfield(L, -2, "sent");
+    l2dbus_statsPushTypeCounts(L, counters->received);
+    lua_setfield(L, -2, "received");
+    lua_pushnumber(L, (lua_Number)counters->sendFailures);
+    lua_setfield(L, -2, "sendFailures");
+    lua_pushnumber(L, (lua_Number)counters->conflated);
+    lua_setfield(L, -2, "conflated");
+}
+
+
+static void
+l2dbus_statsPushHist
+    (
+    lua_State*              L,
+    const l2dbus_StatsHist* hist
+    )
+{
+    unsigned long long cumulative = 0;
+    int last = -1;
+    int idx;
+    int arrIdx = 1;
+
+    lua_createtable(L, 0, 4);
+    lua_pushnumber(L, (lua_Number)hist->count);
+    lua_setfield(L, -2, "count");
+    lua_pushnumber(L, hist->sum);
+    lua_setfield(L, -2, "sum");
+    lua_pushnumber(L, hist->max);
+    lua_setfield(L, -2, "max");
+
+    /* Only report buckets up to the last non-empty (finite) one */
+    for ( idx = 0; idx < (L2DBUS_STATS_HIST_BUCKETS - 1); ++idx )
+    {
+        if ( 0 != hist->buckets[idx] )
+        {
+            last = idx;
+        }
+    }
+
+    lua_createtable(L, last + 2, 0);
+    for ( idx = 0; idx <= last; ++idx )
+    {
+        cumulative += hist->buckets[idx];
+        lua_createtable(L, 0, 2);
+        lua_pushnumber(L, ldexp(1.0, idx) / 1.0e6);
+        lua_setfield(L, -2, "le");
+        lua_pushnumber(L, (lua_Number)cumulative);
+        lua_setfield(L, -2, "count");
+        lua_rawseti(L, -2, arrIdx++);
+    }
+    lua_createtable(L, 0, 2);
+    lua_pushnumber(L, HUGE_VAL);
+    lua_setfield(L, -2, "le");
+    lua_pushnumber(L, (lua_Number)hist->count);
+    lua_setfield(L, -2, "count");
+    lua_rawseti(L, -2, arrIdx);
+    lua_setfield(L, -2, "buckets");
+}
+
+
+/**
+ Histogram table.
+
+ All times are reported in seconds.
+
+ @table Histogram
+ @field count (number) The number of samples.
+ @field sum (number) The sum of all samples.
+ @field max (number) The largest sample.
+ @field buckets (array) Cumulative buckets in ascending order. Each bucket
+ is a table with the fields *le* (the upper bound of the bucket, the last
+ bucket is *math.huge*) and *count* (the number of samples less than or
+ equal to *le*). This matches the layout of a Prometheus histogram.
+ */
+
+/**
+ Callback metrics table.
+
+ @table CallbackStats
+ @field count (number) The number of times the callback was called.
+ @field errors (number) The number of calls that raised a Lua error.
+ @field duration (table) A @{Histogram} of the call durations (empty when
+ timing is disabled).
+ */
+
+/**
+ Message counters table.
+
+ @table MessageCounters
+ @field sent (table) Messages queued for sending by type: *methodCall*,
+ *methodReturn*, *error*, *signal* and *total*.
+ @field received (table) Messages received by type (same fields as *sent*).
+ @field sendFailures (number) The number of messages that could not be
+ queued.
+ @field conflated (number) The number of received messages superseded by a
+ newer message of a @{l2dbus.Match.ConflatePolicy|conflating} match.
+ */
+
+/**
+ Metrics snapshot table.
+
+ @table Snapshot
+ @field elapsed (number) Seconds since the metrics were last reset.
+ @field timingEnabled (bool) Whether events are being timed.
+ @field messages (table) The @{MessageCounters} of all connections.
+ @field argsMarshalled (number) Arguments marshalled from Lua to D-Bus.
+ @field argsUnmarshalled (number) Arguments unmarshalled from D-Bus to Lua.
+ @field callbacks (table) @{CallbackStats} for each kind of Lua callback:
+ *match*, *signalRouter*, *interface*, *serviceObject*, *pendingCall*,
+ *timeout*, *watch*, *replyRoute* (replies routed by serial number),
+ *subtree* (subtree handlers and their enumeration), *nameHandler* (results
+ of non-blocking name requests), *reconnect*, *timerWheel* (per-timer
+ handlers), *timerWheelBatch* (batched timer wheel expiries) and *server*
+ (new peer connections).
+ @field latency (table) @{Histogram|Histograms} of *marshall* and
+ *unmarshall* times, the pending call round-trip time (*pendingCallRtt*),
+ how late timeouts fire (*timeoutLag*) and how long batched watch events
+ wait for delivery (*watchLag*).
+ @field stringPool (table) The strings interned for interface metadata:
+ the number of distinct *strings*, the *bytes* they occupy and the number
+ of times an existing string was *shared*. These aren't reset.
+ @field registry (table) The object registry mapping C objects to their
+ Lua wrappers: the number of live *objects*, the number of *slots* its
+ (weak) Lua array has grown to and the number of hash *buckets*. A steadily growing count of objects points
+ at wrappers (e.g. PendingCalls) that are never released. These aren't
+ reset.
+ @field handlers (array) The @{HandlerStats} of every callback handler
+ called since the last reset while the @{setCallbackBudget|watchdog} was
+ enabled (in no particular order).
+ */
+
+/**
+ Handler metrics table.
+
+ A handler is identified by where its function is defined so all the
+ closures created by the same code are accounted together.
+
+ @table HandlerStats
+ @field name (string) The source and line where the handler is defined
+ (e.g. *service.lua:42*).
+ @field count (number) The number of times the handler was called.
+ @field time (number) The total time (in seconds) spent in the handler.
+ @field max (number) The longest call (in seconds).
+ @field overBudget (number) The number of calls that exceeded the budget.
+ @field aborted (number) The number of calls aborted by the watchdog.
+ @field traceback (string) Where the handler was the last time it was
+ sampled over its budget (absent if it never was).
+ */
+
+/**
+ @function snapshot
+
+ Returns a snapshot of the runtime metrics.
+
+ @treturn table A @{Snapshot} of the metrics.
+ */
+static int
+l2dbus_statsSnapshot
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Stats* stats;
+    const l2dbus_StrPool* pool;
+    const l2dbus_ObjectRegistry* reg;
+    unsigned idx;
+
+    l2dbus_checkModuleInitialized(L);
+    stats = l2dbus_statsCurrent();
+
+    lua_createtable(L, 0, 10);
+    lua_pushnumber(L, l2dbus_monotonicTime() - stats->resetTime);
+    lua_setfield(L, -2, "elapsed");
+    lua_pushboolean(L, stats->timingEnabled);
+    lua_setfield(L, -2, "timingEnabled");
+    l2dbus_statsPushMsgCounters(L, &stats->msgs);
+    lua_setfield(L, -2, "messages");
+    lua_pushnumber(L, (lua_Number)stats->argsMarshalled);
+    lua_setfield(L, -2, "argsMarshalled");
+    lua_pushnumber(L, (lua_Number)stats->argsUnmarshalled);
+    lua_setfield(L, -2, "argsUnmarshalled");
+
+    lua_createtable(L, 0, L2DBUS_STATS_CB_COUNT);
+    for ( idx = 0; idx < L2DBUS_STATS_CB_COUNT; ++idx )
+    {
+        lua_createtable(L, 0, 3);
+        lua_pushnumber(L, (lua_Number)stats->cbHist[idx].count);
+        lua_setfield(L, -2, "count");
+        lua_pushnumber(L, (lua_Number)stats->cbErrors[idx]);
+        lua_setfield(L, -2, "errors");
+        l2dbus_statsPushHist(L, &stats->cbHist[idx]);
+        lua_setfield(L, -2, "duration");
+        lua_setfield(L, -2, gStatsCbNames[idx]);
+    }
+    lua_setfield(L, -2, "callbacks");
+
+    lua_createtable(L, 0, L2DBUS_STATS_HIST_COUNT);
+    for ( idx = 0; idx < L2DBUS_STATS_HIST_COUNT; ++idx )
+    {
+        l2dbus_statsPushHist(L, &stats->hist[idx]);
+        lua_setfield(L, -2, gStatsHistNames[idx]);
+    }
+    lua_setfield(L, -2, "latency");
+
+    pool = &l2dbus_contextCurrent()->strPool;
+    lua_createtable(L, 0, 3);
+    lua_pushnumber(L, (lua_Number)pool->nStrings);
+    lua_setfield(L, -2, "strings");
+    lua_pushnumber(L, (lua_Number)pool->nBytes);
+    lua_setfield(L, -2, "bytes");
+    lua_pushnumber(L, (lua_Number)pool->nShared);
+    lua_setfield(L, -2, "shared");
+    lua_setfield(L, -2, "stringPool");
+
+    reg = &l2dbus_contextCurrent()->objReg;
+    lua_createtable(L, 0, 3);
+    lua_pushinteger(L, reg->count);
+    lua_setfield(L, -2, "objects");
+    lua_pushinteger(L, reg->nSlots);
+    lua_setfield(L, -2, "slots");
+    lua_pushinteger(L, (lua_Integer)reg->nBuckets);
+    lua_setfield(L, -2, "buckets");
+    lua_setfield(L, -2, "registry");
+
+    l2dbus_watchdogPushHandlers(L, &l2dbus_contextCurrent()->watchdog);
+    lua_setfield(L, -2, "handlers");
+
+    return 1;
+}
+
+
+/**
+ @function reset
+
+ Resets all the runtime metrics to zero.
+
+ This includes the metrics of the callback handlers. The per-connection counters returned by @{l2dbus.Connection.getStats}
+ are not affected.
+ */
+static int
+l2dbus_statsReset
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_checkModuleInitialized(L);
+    l2dbus_statsInit(l2dbus_statsCurrent());
+    l2dbus_watchdogReset(&l2dbus_contextCurrent()->watchdog);
+
+    return 0;
+}
+
+
+/**
+ @function setTimingEnabled
+
+ Enables or disables the timing of events.
+
+ Timing is enabled by default. When disabled the counters are still
+ maintained but no histogram samples (other than callback counts) are
+ recorded and the monotonic clock is not read.
+
+ @tparam bool enable **true** to time events, **false** otherwise.
+ */
+static int
+l2dbus_statsSetTimingEnabled
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_checkModuleInitialized(L);
+    luaL_checktype(L, 1, LUA_TBOOLEAN);
+    l2dbus_statsCurrent()->timingEnabled = lua_toboolean(L, 1) ?
+                                            L2DBUS_TRUE : L2DBUS_FALSE;
+
+    return 0;
+}
+
+
+/**
+ @function isTimingEnabled
+
+ Returns whether events are being timed.
+
+ @treturn bool **true** if events are timed, **false** otherwise.
+ */
+static int
+l2dbus_statsIsTimingEnabled
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_checkModuleInitialized(L);
+    lua_pushboolean(L, l2dbus_statsCurrent()->timingEnabled);
+
+    return 1;
+}
+
+
+/**
+ @function setCallbackBudget
+
+ Sets the latency budget of the Lua callbacks (or disables the watchdog).
+
+ While a budget is set every handler called by L2DBUS (for matches,
+ interfaces, service objects, pending calls, timeouts, watches, ...) is
+ timed and accounted in the *handlers* of the @{snapshot}. The thread
+ running the callbacks is sampled with a count hook and the first time a
+ handler is found to be over its budget its Lua traceback is recorded
+ and reported as a warning. A handler can optionally be aborted (with a
+ Lua error) once it exceeds a hard limit.
+
+ The sampling hook calls any debug hook already installed on the callback
+ thread (which is restored when the watchdog is disabled); if that hook
+ counts instructions its count is used instead of *sampleInterval*. The
+ sampling doesn't see code running in coroutines resumed by a handler.
+ Time spent outside the Lua VM (e.g. in a blocking call) is accounted but
+ can't be sampled or aborted.
+
+ @tparam ?number budget The budget (in seconds) or **nil** to disable the
+ watchdog.
+ @tparam ?table options Optional table with the fields *abortAfter* (the
+ time in seconds after which a handler is aborted, never by default) and
+ *sampleInterval* (the number of VM instructions between two samples,
+ 1000 by default).
+ */
+static int
+l2dbus_statsSetCallbackBudget
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Context* ctx;
+    double budget;
+    double abortAfter = 0.0;
+    int sampleInterval = L2DBUS_WATCHDOG_SAMPLE_INTERVAL;
+
+    l2dbus_checkModuleInitialized(L);
+    ctx = l2dbus_contextCurrent();
+
+    if ( lua_isnoneornil(L, 1) )
+    {
+        l2dbus_watchdogDisable(&ctx->watchdog);
+        return 0;
+    }
+
+    budget = luaL_checknumber(L, 1);
+    luaL_argcheck(L, budget >= 0.0, 1, "budget must not be negative");
+
+    if ( !lua_isnoneornil(L, 2) )
+    {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_getfield(L, 2, "abortAfter");
+        abortAfter = luaL_optnumber(L, -1, 0.0);
+        luaL_argcheck(L, (0.0 == abortAfter) || (abortAfter >= budget), 2,
+                    "abortAfter must not be less than the budget");
+        lua_pop(L, 1);
+        lua_getfield(L, 2, "sampleInterval");
+        sampleInterval = (int)luaL_optnumber(L, -1,
+                                        L2DBUS_WATCHDOG_SAMPLE_INTERVAL);
+        luaL_argcheck(L, sampleInterval > 0, 2,
+                    "sampleInterval must be positive");
+        lua_pop(L, 1);
+    }
+
+    l2dbus_watchdogEnable(&ctx->watchdog, ctx->callbackThread, budget,
+                        abortAfter, sampleInterval);
+
+    return 0;
+}
+
+
+/**
+ @function getCallbackBudget
+
+ Returns the latency budget of the Lua callbacks.
+
+ @treturn ?number The budget (in seconds) or **nil** if the watchdog is
+ disabled.
+ @treturn ?number The time after which handlers are aborted (zero if they
+ are never aborted).
+ @treturn ?number The number of VM instructions between two samples.
+ */
+static int
+l2dbus_statsGetCallbackBudget
+    (
+    lua_State*  L
+    )
+{
+    const l2dbus_Watchdog* wd;
+
+    l2dbus_checkModuleInitialized(L);
+    wd = &l2dbus_contextCurrent()->watchdog;
+
+    if ( !wd->enabled )
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_pushnumber(L, wd->budgetSecs);
+    lua_pushnumber(L, wd->abortSecs);
+    lua_pushinteger(L, wd->sampleInterval);
+
+    return 3;
+}
+
+
+/**
+ * @brief Creates the Stats sub-module.
+ *
+ * This function simulates opening the Stats sub-module.
+ *
+ * @return A table defining the Stats sub-module.
+ */
+void
+l2dbus_openStats
+    (
+    lua_State*  L
+    )
+{
+    lua_createtable(L, 0, 6);
+    lua_pushcfunction(L, l2dbus_statsSnapshot);
+    lua_setfield(L, -2, "snapshot");
+    lua_pushcfunction(L, l2dbus_statsReset);
+    lua_setfield(L, -2, "reset");
+    lua_pushcfunction(L, l2dbus_statsSetTimingEnabled);
+    lua_setfield(L, -2, "setTimingEnabled");
+    lua_pushcfunction(L, l2dbus_statsIsTimingEnabled);
+    lua_setfield(L, -2, "isTimingEnabled");
+    lua_pushcfunction(L, l2dbus_statsSetCallbackBudget);
+    lua_setfield(L, -2, "setCallbackBudget");
+    lua_pushcfunction(L, l2dbus_statsGetCallbackBudget);
+    lua_setfield(L, -2, "getCallbackBudget");
+}
@@ -0,0 +1,138 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_stats.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the runtime metrics (statistics) of the module.
+ *===========================================================================
+ */
+#ifndef L2DBUS_STATS_H_
+#define L2DBUS_STATS_H_
+
+#include "lua.h"
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
+
+/* Number of log2 (microsecond) buckets in a latency histogram. Bucket *i*
+ * counts samples below 2^i microseconds and the last bucket is unbounded.
+ */
+#define L2DBUS_STATS_HIST_BUCKETS   (28)
+
+/* Message types are indexed by their D-Bus type code */
+#define L2DBUS_STATS_MSG_TYPES      (DBUS_NUM_MESSAGE_TYPES)
+
+/*
+ * The Lua callbacks that are counted and timed. Each entry gives the
+ * callback kind and the name it's reported under.
+ */
+#define L2DBUS_STATS_CB_TABLE \
+X(L2DBUS_STATS_CB_MATCH, "match") \
+X(L2DBUS_STATS_CB_SIGNAL_ROUTER, "signalRouter") \
+X(L2DBUS_STATS_CB_INTERFACE, "interface") \
+X(L2DBUS_STATS_CB_SERVICE_OBJECT, "serviceObject") \
+X(L2DBUS_STATS_CB_PENDING_CALL, "pendingCall") \
+X(L2DBUS_STATS_CB_TIMEOUT, "timeout") \
+X(L2DBUS_STATS_CB_WATCH, "watch") \
+X(L2DBUS_STATS_CB_REPLY_ROUTE, "replyRoute") \
+X(L2DBUS_STATS_CB_SUBTREE, "subtree") \
+X(L2DBUS_STATS_CB_NAME_HANDLER, "nameHandler") \
+X(L2DBUS_STATS_CB_RECONNECT, "reconnect") \
+X(L2DBUS_STATS_CB_TIMER_WHEEL, "timerWheel") \
+X(L2DBUS_STATS_CB_TIMER_WHEEL_BATCH, "timerWheelBatch") \
+X(L2DBUS_STATS_CB_SERVER, "server")
+
+/*
+ * The latencies that are recorded independent of a callback.
+ */
+#define L2DBUS_STATS_HIST_TABLE \
+X(L2DBUS_STATS_HIST_MARSHALL, "marshall") \
+X(L2DBUS_STATS_HIST_UNMARSHALL, "unmarshall") \
+X(L2DBUS_STATS_HIST_PENDING_RTT, "pendingCallRtt") \
+X(L2DBUS_STATS_HIST_TIMEOUT_LAG, "timeoutLag") \
+X(L2DBUS_STATS_HIST_WATCH_LAG, "watchLag")
+
+#define X(a, b) a,
+typedef enum
+{
+    L2DBUS_STATS_CB_TABLE
+    L2DBUS_STATS_CB_COUNT
+} l2dbus_StatsCallbackId;
+
+typedef enum
+{
+    L2DBUS_STATS_HIST_TABLE
+    L2DBUS_STATS_HIST_COUNT
+} l2dbus_StatsHistId;
+#undef X
+
+typedef struct l2dbus_StatsHist
+{
+    unsigned long long  count;
+    double              sum;
+    double              max;
+    unsigned long long  buckets[L2DBUS_STATS_HIST_BUCKETS];
+} l2dbus_StatsHist;
+
+typedef struct l2dbus_StatsMsgCounters
+{
+    unsigned long long  sent[L2DBUS_STATS_MSG_TYPES];
+    unsigned long long  received[L2DBUS_STATS_MSG_TYPES];
+    unsigned long long  sendFailures;
+    unsigned long long  conflated;
+} l2dbus_StatsMsgCounters;
+
+typedef struct l2dbus_Stats
+{
+    /* When timing is disabled only the counters are maintained */
+    l2dbus_Bool             timingEnabled;
+    double                  resetTime;
+    l2dbus_StatsMsgCounters msgs;
+    unsigned long long      argsMarshalled;
+    unsigned long long      argsUnmarshalled;
+    unsigned long long      cbErrors[L2DBUS_STATS_CB_COUNT];
+    l2dbus_StatsHist        cbHist[L2DBUS_STATS_CB_COUNT];
+    l2dbus_StatsHist        hist[L2DBUS_STATS_HIST_COUNT];
+} l2dbus_Stats;
+
+void l2dbus_statsInit(l2dbus_Stats* stats);
+double l2dbus_statsStart(void);
+void l2dbus_statsRecord(l2dbus_StatsHistId histId, double startTime);
+void l2dbus_statsObserve(l2dbus_StatsHistId histId, double secs);
+double l2dbus_statsCallbackStart(lua_State* L, int nArgs);
+void l2dbus_statsCallback(l2dbus_StatsCallbackId cbId, double startTime,
+                        int pcallStatus);
+void l2dbus_statsCountArgs(l2dbus_Bool marshalled, unsigned nArgs);
+void l2dbus_statsCountSent(l2dbus_StatsMsgCounters* connCounters,
+                        DBusMessage* msg, l2dbus_Bool queued);
+void l2dbus_statsCountReceived(l2dbus_StatsMsgCounters* connCounters,
+                        DBusMessage* msg);
+void l2dbus_statsCountConflated(l2dbus_StatsMsgCounters* connCounters);
+void l2dbus_statsPushMsgCounters(lua_State* L,
+                        const l2dbus_StatsMsgCounters* counters);
+void l2dbus_openStats(lua_State* L);
+
+#endif /* Guard for L2DBUS_STATS_H_ */
@@ -0,0 +1,218 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_strpool.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the reference counted pool of interned strings.
+ *===========================================================================
+ */
+#include <string.h>
+#include <stddef.h>
+#include "l2dbus_strpool.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_context.h"
+
+typedef struct l2dbus_StrPoolEntry
+{
+    struct l2dbus_StrPoolEntry* next;
+    /* The pool is needed to unlink the entry once it's released */
+    l2dbus_StrPool*             pool;
+    unsigned                    hash;
+    unsigned                    refCount;
+    size_t                      len;
+    char                        str[1];
+} l2dbus_StrPoolEntry;
+
+
+static unsigned
+l2dbus_strPoolHash
+    (
+    const char* s,
+    size_t      len
+    )
+{
+    unsigned h = 2166136261u;
+    size_t idx;
+
+    for ( idx = 0; idx < len; ++idx )
+    {
+        h = (h ^ (unsigned char)s[idx]) * 16777619u;
+    }
+    return h;
+}
+
+
+/**
+ * @brief Returns the interned copy of a string.
+ *
+ * Every call must be balanced by a call to l2dbus_strPoolRelease.
+ *
+ * @param [in] pool The string pool.
+ * @param [in] s    The string to intern.
+ * @return The shared (read-only) copy of the string or NULL if memory
+ * could not be allocated.
+ */
+const char*
+l2dbus_strPoolIntern
+    (
+    l2dbus_StrPool* pool,
+    const char*     s
+    )
+{
+    size_t len;
+    unsigned hash;
+    l2dbus_StrPoolEntry** bucket;
+    l2dbus_StrPoolEntry* entry;
+
+    if ( (NULL == pool) || (NULL == s) )
+    {
+        return NULL;
+    }
+
+    len = strlen(s);
+    hash = l2dbus_strPoolHash(s, len);
+    bucket = &pool->buckets[hash % L2DBUS_STRPOOL_BUCKETS];
+    for ( entry = *bucket; NULL != entry; entry = entry->next )
+    {
+        if ( (entry->hash == hash) && (entry->len == len) &&
+            (0 == memcmp(entry->str, s, len)) )
+        {
+            entry->refCount++;
+            pool->nShared++;
+            return entry->str;
+        }
+    }
+
+    entry = (l2dbus_StrPoolEntry*)l2dbus_malloc(sizeof(*entry) + len);
+    if ( NULL == entry )
+    {
+        return NULL;
+    }
+
+    entry->pool = pool;
+    entry->hash = hash;
+    entry->refCount = 1;
+    entry->len = len;
+    memcpy(entry->str, s, len + 1);
+    entry->next = *bucket;
+    *bucket = entry;
+    pool->nStrings++;
+    pool->nBytes += len + 1;
+
+    return entry->str;
+}
+
+
+/**
+ * @brief Returns the interned copy of a string from the current context.
+ *
+ * @param [in] s    The string to intern.
+ * @return The shared (read-only) copy of the string or NULL if there is no
+ * current context or memory could not be allocated.
+ */
+const char*
+l2dbus_strIntern
+    (
+    const char* s
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+
+    return (NULL != ctx) ? l2dbus_strPoolIntern(&ctx->strPool, s) : NULL;
+}
+
+
+/**
+ * @brief Releases a reference to an interned string.
+ *
+ * @param [in] s The string returned by l2dbus_strPoolIntern (or NULL).
+ */
+void
+l2dbus_strPoolRelease
+    (
+    const char* s
+    )
+{
+    l2dbus_StrPoolEntry* entry;
+    l2dbus_StrPoolEntry** link;
+    l2dbus_StrPool* pool;
+
+    if ( NULL == s )
+    {
+        return;
+    }
+
+    entry = (l2dbus_StrPoolEntry*)(s - offsetof(l2dbus_StrPoolEntry, str));
+    if ( 0 == --entry->refCount )
+    {
+        pool = entry->pool;
+        link = &pool->buckets[entry->hash % L2DBUS_STRPOOL_BUCKETS];
+        while ( NULL != *link )
+        {
+            if ( *link == entry )
+            {
+                *link = entry->next;
+                break;
+            }
+            link = &(*link)->next;
+        }
+        pool->nStrings--;
+        pool->nBytes -= entry->len + 1;
+        l2dbus_free(entry);
+    }
+}
+
+
+/**
+ * @brief Frees every string of a pool regardless of its references.
+ *
+ * This is only called when the module context is destroyed after all the
+ * objects holding references have been finalized.
+ *
+ * @param [in] pool The string pool.
+ */
+void
+l2dbus_strPoolFree
+    (
+    l2dbus_StrPool* pool
+    )
+{
+    l2dbus_StrPoolEntry* entry;
+    unsigned idx;
+
+    for ( idx = 0; idx < L2DBUS_STRPOOL_BUCKETS; ++idx )
+    {
+        while ( NULL != pool->buckets[idx] )
+        {
+            entry = pool->buckets[idx];
+            pool->buckets[idx] = entry->next;
+            l2dbus_free(entry);
+        }
+    }
+    pool->nStrings = 0;
+    pool->nBytes = 0;
+}
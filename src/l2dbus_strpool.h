@@ -0,0 +1,65 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_strpool.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the reference counted pool of interned strings.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_STRPOOL_H_
+#define L2DBUS_STRPOOL_H_
+
+#include <stddef.h>
+#include "l2dbus_types.h"
+
+/* Number of hash buckets of a string pool */
+#define L2DBUS_STRPOOL_BUCKETS  (256)
+
+/* Forward declarations */
+struct l2dbus_StrPoolEntry;
+
+/*
+ * Interned strings shared by the metadata of all interfaces. Each distinct
+ * string is stored once and freed when its last reference is released.
+ */
+typedef struct l2dbus_StrPool
+{
+    struct l2dbus_StrPoolEntry* buckets[L2DBUS_STRPOOL_BUCKETS];
+    /* The number of distinct strings and the bytes they occupy */
+    unsigned                    nStrings;
+    size_t                      nBytes;
+    /* The number of references handed out for an existing string */
+    unsigned long               nShared;
+} l2dbus_StrPool;
+
+const char* l2dbus_strPoolIntern(l2dbus_StrPool* pool, const char* s);
+const char* l2dbus_strIntern(const char* s);
+void l2dbus_strPoolRelease(const char* s);
+void l2dbus_strPoolFree(l2dbus_StrPool* pool);
+
+#endif /* Guard for L2DBUS_STRPOOL_H_ */
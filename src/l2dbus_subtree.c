@@ -0,0 +1,660 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_subtree.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of virtual object subtrees.
+ *===========================================================================
+ */
+#include <string.h>
+#include <assert.h>
+#include "dbus/dbus.h"
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_subtree.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_serviceobject.h"
+#include "l2dbus_message.h"
+#include "l2dbus_object.h"
+#include "l2dbus_core.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_dbuscompat.h"
+#include "lauxlib.h"
+
+/* Describes the Introspectable interface answered natively by a subtree */
+#define L2DBUS_SUBTREE_INTROSPECTABLE_XML \
+    "  <interface name=\"" DBUS_INTERFACE_INTROSPECTABLE "\">\n" \
+    "    <method name=\"Introspect\">\n" \
+    "      <arg name=\"xml_data\" type=\"s\" direction=\"out\"/>\n" \
+    "    </method>\n" \
+    "  </interface>\n"
+
+
+/* Returns true if the path is the prefix of the subtree or lies beneath it */
+static l2dbus_Bool
+l2dbus_subtreeContains
+    (
+    const l2dbus_Subtree*   subtree,
+    const char*             path
+    )
+{
+    /* Everything lies beneath the root */
+    if ( 1 == subtree->prefixLen )
+    {
+        return L2DBUS_TRUE;
+    }
+
+    return (0 == strncmp(path, subtree->prefix, subtree->prefixLen)) &&
+            (('\0' == path[subtree->prefixLen]) ||
+            ('/' == path[subtree->prefixLen]));
+}
+
+
+/* Finds the (most specific) subtree of the connection serving the path */
+static l2dbus_Subtree*
+l2dbus_subtreeFind
+    (
+    l2dbus_Connection*  connUd,
+    const char*         path
+    )
+{
+    l2dbus_Subtree* subtree;
+    l2dbus_Subtree* found = NULL;
+
+    for ( subtree = connUd->subtrees; NULL != subtree; subtree = subtree->next )
+    {
+        if ( l2dbus_subtreeContains(subtree, path) &&
+            ((NULL == found) || (subtree->prefixLen > found->prefixLen)) )
+        {
+            found = subtree;
+        }
+    }
+
+    return found;
+}
+
+
+/**
+ * @brief Appends the child nodes reported by the enumeration callback.
+ *
+ * The callback is called as enumerate(conn, path, userToken) and returns
+ * an array with the names of the child nodes directly beneath the path.
+ * Names that are already registered with the connection are skipped.
+ *
+ * @param [in] L          The Lua state.
+ * @param [in] conn       The connection being introspected.
+ * @param [in] path       The object path being introspected.
+ * @param [in] buf        The introspection XML buffer to append to.
+ * @param [in] registered The (NULL terminated) names of the child nodes
+ *                        registered with the connection or NULL.
+ */
+void
+l2dbus_subtreeAppendChildren
+    (
+    lua_State*              L,
+    cdbus_Connection*       conn,
+    const char*             path,
+    cdbus_StringBuffer*     buf,
+    char**                  registered
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_Subtree* subtree = NULL;
+    const char* name;
+    int top = lua_gettop(L);
+    int nChildren;
+    int idx;
+    int regIdx;
+    double cbStart;
+    int status;
+
+    connUd = (l2dbus_Connection*)l2dbus_objectRegistryGet(L, conn);
+    if ( NULL != connUd )
+    {
+        subtree = l2dbus_subtreeFind(connUd, path);
+    }
+
+    if ( (NULL == subtree) || (LUA_NOREF == subtree->enumRef) )
+    {
+        lua_settop(L, top);
+        return;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, subtree->enumRef);
+    lua_pushvalue(L, top + 1 /* Connection ud */);
+    lua_pushstring(L, path);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, subtree->cbCtx.userRef);
+
+    cbStart = l2dbus_statsCallbackStart(L, 3 /* nArgs */);
+    status = lua_pcall(L, 3 /* nArgs */, 1 /* nResults */, 0);
+    l2dbus_statsCallback(L2DBUS_STATS_CB_SUBTREE, cbStart, status);
+    if ( 0 != status )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Subtree enumeration error: %s",
+                    lua_isstring(L, -1) ? lua_tostring(L, -1) : ""));
+    }
+    else if ( lua_istable(L, -1) )
+    {
+        nChildren = (int)lua_rawlen(L, -1);
+        for ( idx = 1; idx <= nChildren; ++idx )
+        {
+            lua_rawgeti(L, -1, idx);
+            name = (LUA_TSTRING == lua_type(L, -1)) ? lua_tostring(L, -1) : NULL;
+            for ( regIdx = 0; (NULL != name) && (NULL != registered) &&
+                (NULL != registered[regIdx]); ++regIdx )
+            {
+                if ( 0 == strcmp(name, registered[regIdx]) )
+                {
+                    name = NULL;
+                }
+            }
+
+            if ( NULL != name )
+            {
+                cdbus_stringBufferAppend(buf, "  <node name=\"");
+                cdbus_stringBufferAppend(buf, name);
+                cdbus_stringBufferAppend(buf, "\"/>\n");
+            }
+            lua_pop(L, 1);
+        }
+    }
+
+    lua_settop(L, top);
+}
+
+
+/**
+ * @brief Answers an Introspect request for a path nothing handled.
+ *
+ * The reply lists the Introspectable interface and the child nodes of the
+ * path.
+ *
+ * @return The D-Bus handler result.
+ */
+static DBusHandlerResult
+l2dbus_subtreeIntrospect
+    (
+    lua_State*          L,
+    l2dbus_Connection*  connUd,
+    DBusMessage*        msg
+    )
+{
+    DBusHandlerResult rc = DBUS_HANDLER_RESULT_NEED_MEMORY;
+    DBusConnection* dbusConn = cdbus_connectionGetDBus(connUd->conn);
+    const char* path = dbus_message_get_path(msg);
+    cdbus_StringBuffer* buf;
+    DBusMessage* reply;
+    char** children = NULL;
+    const char* xml;
+    int idx;
+
+    buf = cdbus_stringBufferNew(512);
+    if ( NULL == buf )
+    {
+        return rc;
+    }
+
+    cdbus_stringBufferAppend(buf, DBUS_INTROSPECT_1_0_XML_DOCTYPE_DECL_NODE);
+    cdbus_stringBufferAppend(buf, "<node name=\"");
+    cdbus_stringBufferAppend(buf, path);
+    cdbus_stringBufferAppend(buf, "\">\n");
+    cdbus_stringBufferAppend(buf, L2DBUS_SUBTREE_INTROSPECTABLE_XML);
+
+    if ( dbus_connection_list_registered(dbusConn, path, &children) )
+    {
+        for ( idx = 0; NULL != children[idx]; ++idx )
+        {
+            cdbus_stringBufferAppend(buf, "  <node name=\"");
+            cdbus_stringBufferAppend(buf, children[idx]);
+            cdbus_stringBufferAppend(buf, "\"/>\n");
+        }
+    }
+    l2dbus_subtreeAppendChildren(L, connUd->conn, path, buf, children);
+    if ( NULL != children )
+    {
+        dbus_free_string_array(children);
+    }
+    cdbus_stringBufferAppend(buf, "</node>\n");
+
+    reply = dbus_message_new_method_return(msg);
+    if ( NULL != reply )
+    {
+        xml = cdbus_stringBufferRaw(buf);
+        if ( dbus_message_append_args(reply, DBUS_TYPE_STRING, &xml,
+                                    DBUS_TYPE_INVALID) &&
+            dbus_connection_send(dbusConn, reply, NULL) )
+        {
+            rc = DBUS_HANDLER_RESULT_HANDLED;
+        }
+        dbus_message_unref(reply);
+    }
+    cdbus_stringBufferUnref(buf);
+
+    return rc;
+}
+
+
+/**
+ * @brief Handles the requests addressed to any path of a subtree.
+ *
+ * A service object materialized earlier for the path is used if it's still
+ * alive. Otherwise the subtree handler is called as
+ * handler(conn, path, msg, userToken). It either handles the request itself
+ * (returning a D-Bus handler result) or returns the service object for the
+ * path, which is remembered and given the request. Introspect requests that
+ * are not handled are answered from the enumeration callback.
+ */
+static DBusHandlerResult
+l2dbus_subtreeMessageHandler
+    (
+    DBusConnection* dbusConn,
+    DBusMessage*    msg,
+    void*           user
+    )
+{
+    lua_State* L = l2dbus_callbackGetThread();
+    l2dbus_Subtree* subtree = (l2dbus_Subtree*)user;
+    l2dbus_Connection* connUd = subtree->connUd;
+    DBusHandlerResult rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    l2dbus_ServiceObject* svcObjUd = NULL;
+    l2dbus_Message* msgUd = NULL;
+    const char* path = dbus_message_get_path(msg);
+    int svcObjRef = LUA_NOREF;
+    double cbStart;
+    int status;
+
+    assert( NULL != L );
+
+    if ( NULL == path )
+    {
+        return rc;
+    }
+
+    lua_settop(L, 0);
+
+    /* Look for an object materialized by an earlier request */
+    lua_rawgeti(L, LUA_REGISTRYINDEX, subtree->cacheRef);
+    lua_getfield(L, -1, path);
+    svcObjUd = (l2dbus_ServiceObject*)l2dbus_isUserData(L, -1,
+                                        L2DBUS_SERVICE_OBJECT_TYPE_ID);
+    if ( NULL != svcObjUd )
+    {
+        svcObjRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    else if ( LUA_NOREF != subtree->cbCtx.funcRef )
+    {
+        lua_pop(L, 1);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, subtree->cbCtx.funcRef);
+        l2dbus_objectRegistryGet(L, connUd->conn);
+        lua_pushstring(L, path);
+        msgUd = l2dbus_messageBorrow(L, msg);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, subtree->cbCtx.userRef);
+
+        cbStart = l2dbus_statsCallbackStart(L, 4 /* nArgs */);
+        status = lua_pcall(L, 4 /* nArgs */, 1 /* nResults */, 0);
+        l2dbus_statsCallback(L2DBUS_STATS_CB_SUBTREE, cbStart, status);
+        if ( 0 != status )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_ERROR, "Subtree handler error: %s",
+                        lua_isstring(L, -1) ? lua_tostring(L, -1) : ""));
+        }
+        else if ( lua_isnumber(L, -1) )
+        {
+            rc = lua_tointeger(L, -1);
+            switch ( rc )
+            {
+                case DBUS_HANDLER_RESULT_HANDLED:
+                case DBUS_HANDLER_RESULT_NOT_YET_HANDLED:
+                case DBUS_HANDLER_RESULT_NEED_MEMORY:
+                    /* These are understood */
+                    break;
+
+                default:
+                    L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                        "Unknown subtree handler return code (%d)", rc));
+                    rc = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+                    break;
+            }
+        }
+        else
+        {
+            svcObjUd = (l2dbus_ServiceObject*)l2dbus_isUserData(L, -1,
+                                        L2DBUS_SERVICE_OBJECT_TYPE_ID);
+            if ( NULL != svcObjUd )
+            {
+                /* Remember the object while something else references it */
+                lua_pushvalue(L, -1);
+                lua_setfield(L, 1 /* Cache table */, path);
+                svcObjRef = luaL_ref(L, LUA_REGISTRYINDEX);
+            }
+        }
+
+        /* The handler must retain the message to keep it */
+        l2dbus_messageGiveBack(L, msgUd);
+    }
+    lua_settop(L, 0);
+
+    if ( NULL != svcObjUd )
+    {
+        /* The object is anchored (by reference) while it's dispatched */
+        rc = l2dbus_serviceObjectDispatch(L, svcObjUd, connUd->conn, msg);
+        luaL_unref(L, LUA_REGISTRYINDEX, svcObjRef);
+    }
+
+    if ( (DBUS_HANDLER_RESULT_NOT_YET_HANDLED == rc) &&
+        dbus_message_is_method_call(msg, DBUS_INTERFACE_INTROSPECTABLE,
+                                    "Introspect") )
+    {
+        rc = l2dbus_subtreeIntrospect(L, connUd, msg);
+    }
+
+    /* Clean up the thread stack */
+    lua_settop(L, 0);
+
+    /* Reclaim any transient allocations made while servicing the callback */
+    l2dbus_arenaReset();
+
+    return rc;
+}
+
+
+/* Releases a subtree (which must already be unregistered from D-Bus) */
+static void
+l2dbus_subtreeFree
+    (
+    lua_State*      L,
+    l2dbus_Subtree* subtree
+    )
+{
+    l2dbus_callbackUnref(L, &subtree->cbCtx);
+    luaL_unref(L, LUA_REGISTRYINDEX, subtree->enumRef);
+    luaL_unref(L, LUA_REGISTRYINDEX, subtree->cacheRef);
+    l2dbus_free(subtree->prefix);
+    l2dbus_free(subtree);
+}
+
+
+/**
+ * @brief Unregisters and releases the subtrees of a connection.
+ *
+ * This must be called before the CDBUS connection is closed.
+ *
+ * @param [in] L      The Lua state.
+ * @param [in] connUd The connection being destroyed.
+ */
+void
+l2dbus_subtreeDispose
+    (
+    lua_State*          L,
+    l2dbus_Connection*  connUd
+    )
+{
+    l2dbus_Subtree* subtree;
+
+    while ( NULL != connUd->subtrees )
+    {
+        subtree = connUd->subtrees;
+        connUd->subtrees = subtree->next;
+        if ( NULL != connUd->conn )
+        {
+            dbus_connection_unregister_object_path(
+                                    cdbus_connectionGetDBus(connUd->conn),
+                                    subtree->prefix);
+        }
+        l2dbus_subtreeFree(L, subtree);
+    }
+}
+
+
+static const DBusObjectPathVTable gSubtreeVTable =
+{
+    NULL,
+    l2dbus_subtreeMessageHandler,
+    NULL, NULL, NULL, NULL
+};
+
+
+/**
+ * @brief Moves the subtrees of a connection to its re-opened connection.
+ *
+ * @param [in] connUd   The connection (already holding the new CDBUS
+ * connection).
+ * @param [in] oldConn  The D-Bus connection being replaced.
+ */
+void
+l2dbus_subtreeMove
+    (
+    l2dbus_Connection*  connUd,
+    DBusConnection*     oldConn
+    )
+{
+    l2dbus_Subtree* subtree;
+    DBusError dbusError;
+
+    for ( subtree = connUd->subtrees; NULL != subtree; subtree = subtree->next )
+    {
+        dbus_connection_unregister_object_path(oldConn, subtree->prefix);
+
+        dbus_error_init(&dbusError);
+        if ( !dbus_connection_try_register_fallback(
+                                    cdbus_connectionGetDBus(connUd->conn),
+                                    subtree->prefix, &gSubtreeVTable, subtree,
+                                    &dbusError) )
+        {
+            L2DBUS_TRACE((L2DBUS_TRC_WARN, "Failed to restore subtree '%s': %s",
+                        subtree->prefix, dbusError.message));
+            dbus_error_free(&dbusError);
+        }
+    }
+}
+
+
+/**
+ @function registerSubtree
+ @within Connection
+
+ Registers a single handler for every object path beneath a prefix.
+
+ Instead of creating and registering a @{l2dbus.ServiceObject|ServiceObject}
+ for each exported path, a subtree serves the prefix and all the paths
+ beneath it (that aren't registered individually) with one handler:
+
+     function onRequest(conn, path, msg, userToken)
+
+ The handler can answer the request itself and return a
+ @{l2dbus.Dbus.HANDLER_RESULT_HANDLED|HANDLER_RESULT_*} value. Otherwise it
+ returns the service object for *path* (created on demand with the same
+ path but **not** registered with the connection) and the request is
+ dispatched to the object and its interfaces. The object is remembered for
+ as long as it is referenced elsewhere so the handler isn't called again
+ for its path; objects nobody references are collected and materialized
+ again when next needed. Returning **nil** leaves the request unhandled.
+ The message is borrowed (see @{l2dbus.Message.retain|retain}).
+
+ The optional enumeration callback reports the child nodes of a path for
+ introspection:
+
+     function onEnumerate(conn, path, userToken)
+
+ It returns an array with the names of the nodes directly beneath *path*.
+ Introspect requests that are not handled by an object are answered with
+ these nodes.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam string prefix The object path prefix of the subtree.
+ @tparam func handler The request handler.
+ @tparam ?func|nil enumerate The optional enumeration callback.
+ @tparam ?any userToken Optional client data passed to the callbacks.
+ @treturn bool Returns **true** if the subtree is registered and **false**
+ if the prefix is already registered.
+ @see unregisterSubtree
+ */
+int
+l2dbus_connectionRegisterSubtree
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_Subtree* subtree;
+    const char* prefix;
+    DBusError dbusError;
+    l2dbus_Bool registered;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    prefix = luaL_checkstring(L, 2);
+    if ( !l2dbus_validatePath(prefix) )
+    {
+        luaL_error(L, "invalid D-Bus object path");
+    }
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+    if ( !lua_isnoneornil(L, 4) )
+    {
+        luaL_checktype(L, 4, LUA_TFUNCTION);
+    }
+
+    subtree = (l2dbus_Subtree*)l2dbus_calloc(1, sizeof(*subtree));
+    if ( NULL == subtree )
+    {
+        luaL_error(L, "Failed to allocate the subtree");
+    }
+    subtree->prefix = l2dbus_strDup(prefix);
+    if ( NULL == subtree->prefix )
+    {
+        l2dbus_free(subtree);
+        luaL_error(L, "Failed to allocate the subtree");
+    }
+    subtree->prefixLen = strlen(prefix);
+    subtree->connUd = connUd;
+
+    l2dbus_callbackInit(&subtree->cbCtx);
+    l2dbus_callbackRef(L, 3, lua_isnone(L, 5) ?
+                        L2DBUS_CALLBACK_NOREF_NEEDED : 5, &subtree->cbCtx);
+    if ( lua_isnoneornil(L, 4) )
+    {
+        subtree->enumRef = LUA_NOREF;
+    }
+    else
+    {
+        lua_pushvalue(L, 4);
+        subtree->enumRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    /* The materialized objects are only weakly referenced */
+    lua_newtable(L);
+    lua_createtable(L, 0, 1);
+    lua_pushstring(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    subtree->cacheRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    dbus_error_init(&dbusError);
+    registered = dbus_connection_try_register_fallback(
+                                    cdbus_connectionGetDBus(connUd->conn),
+                                    prefix, &gSubtreeVTable, subtree,
+                                    &dbusError) ? L2DBUS_TRUE : L2DBUS_FALSE;
+    if ( registered )
+    {
+        subtree->next = connUd->subtrees;
+        connUd->subtrees = subtree;
+    }
+    else
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN, "Failed to register subtree '%s': %s",
+                    prefix, dbusError.message));
+        dbus_error_free(&dbusError);
+        l2dbus_subtreeFree(L, subtree);
+    }
+
+    lua_pushboolean(L, registered);
+
+    return 1;
+}
+
+
+/**
+ @function unregisterSubtree
+ @within Connection
+
+ Unregisters a subtree registered with @{registerSubtree}.
+
+ The subtree stops handling requests and forgets the service objects it
+ materialized.
+
+ @tparam userdata conn The D-Bus connection object
+ @tparam string prefix The object path prefix of the subtree.
+ @treturn bool Returns **true** if the subtree is unregistered or **false**
+ if there is no subtree with the prefix.
+ */
+int
+l2dbus_connectionUnregisterSubtree
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Connection* connUd;
+    l2dbus_Subtree** link;
+    l2dbus_Subtree* subtree;
+    const char* prefix;
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    connUd = (l2dbus_Connection*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_CONNECTION_TYPE_ID);
+    prefix = luaL_checkstring(L, 2);
+
+    for ( link = &connUd->subtrees; NULL != *link; link = &(*link)->next )
+    {
+        if ( 0 == strcmp(prefix, (*link)->prefix) )
+        {
+            break;
+        }
+    }
+
+    subtree = *link;
+    if ( NULL != subtree )
+    {
+        *link = subtree->next;
+        dbus_connection_unregister_object_path(
+                                    cdbus_connectionGetDBus(connUd->conn),
+                                    subtree->prefix);
+        l2dbus_subtreeFree(L, subtree);
+    }
+
+    lua_pushboolean(L, NULL != subtree);
+
+    return 1;
+}
@@ -0,0 +1,73 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_subtree.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of virtual object subtrees.
+ *===========================================================================
+ */
+
+#ifndef L2DBUS_SUBTREE_H_
+#define L2DBUS_SUBTREE_H_
+
+#include "lua.h"
+#include "l2dbus_types.h"
+#include "l2dbus_callback.h"
+
+/* Forward declarations */
+struct cdbus_Connection;
+struct cdbus_StringBuffer;
+struct DBusConnection;
+struct l2dbus_Connection;
+
+/* A path prefix whose objects are served by a single handler */
+typedef struct l2dbus_Subtree
+{
+    struct l2dbus_Subtree*      next;
+    struct l2dbus_Connection*   connUd;
+    char*                       prefix;
+    size_t                      prefixLen;
+    /* The request handler and user token */
+    l2dbus_CallbackCtx          cbCtx;
+    /* Enumerates the child nodes of a path (or LUA_NOREF) */
+    int                         enumRef;
+    /* Weak valued table mapping paths to materialized service objects */
+    int                         cacheRef;
+} l2dbus_Subtree;
+
+void l2dbus_subtreeAppendChildren(lua_State* L, struct cdbus_Connection* conn,
+                                const char* path,
+                                struct cdbus_StringBuffer* buf,
+                                char** registered);
+void l2dbus_subtreeDispose(lua_State* L, struct l2dbus_Connection* connUd);
+void l2dbus_subtreeMove(struct l2dbus_Connection* connUd,
+                        struct DBusConnection* oldConn);
+
+int l2dbus_connectionRegisterSubtree(lua_State* L);
+int l2dbus_connectionUnregisterSubtree(lua_State* L);
+
+#endif /* Guard for L2DBUS_SUBTREE_H_ */
@@ -42,6 +42,8 @@
 #include "l2dbus_trace.h"
 #include "l2dbus_debug.h"
 #include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_stats.h"
 
 /**
  L2DBUS Timeout
@@ -99,6 +101,9 @@ l2dbus_timeoutHandler
     lua_State* L = l2dbus_callbackGetThread();
     const char* errMsg = "";
     l2dbus_Timeout* ud = l2dbus_objectRegistryGet(L, user);
+    double firedAt;
+    double cbStart;
+    int status;
 
     /* Nil or the Timeout userdata is sitting at the top of the
      * stack at this point.
@@ -115,12 +120,26 @@ l2dbus_timeoutHandler
     }
     else
     {
+        /* Record how late the timeout fired relative to when it was due */
+        firedAt = l2dbus_statsStart();
+        if ( (0.0 != firedAt) && (0.0 != ud->armedAt) )
+        {
+            l2dbus_statsObserve(L2DBUS_STATS_HIST_TIMEOUT_LAG,
+                firedAt - ud->armedAt -
+                ((double)cdbus_timeoutInterval(ud->timeout) / 1000.0));
+        }
+        /* A repeating timeout is due again one interval from now */
+        ud->armedAt = firedAt;
+
         /* Push function and user value on the stack and execute the callback */
         lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.funcRef);
         lua_pushvalue(L, -2 /* Timeout ud */);
         lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.userRef);
 
-        if ( 0 != lua_pcall(L, 2 /* nArgs */, 0, 0) )
+        cbStart = l2dbus_statsCallbackStart(L, 2 /* nArgs */);
+        status = lua_pcall(L, 2 /* nArgs */, 0, 0);
+        l2dbus_statsCallback(L2DBUS_STATS_CB_TIMEOUT, cbStart, status);
+        if ( 0 != status )
         {
             if ( lua_isstring(L, -1) )
             {
@@ -149,6 +168,9 @@ l2dbus_timeoutHandler
     /* Clean up the thread stack */
     lua_settop(L, 0);
 
+    /* Reclaim any transient allocations made while servicing the callback */
+    l2dbus_arenaReset();
+
     /* The return value is unused by CDBUS */
     return CDBUS_TRUE;
 }
@@ -215,8 +237,8 @@ l2dbus_newTimeout
     }
 
 
-    dispUd = (l2dbus_Dispatcher*)luaL_checkudata(L, 1,
-                                    L2DBUS_DISPATCHER_MTBL_NAME);
+    dispUd = (l2dbus_Dispatcher*)l2dbus_checkUserData(L, 1,
+                                    L2DBUS_DISPATCHER_TYPE_ID);
     msecInterval = luaL_checkint(L, 2);
     luaL_checktype(L, 3, LUA_TBOOLEAN);
     repeat = lua_toboolean(L, 3);
@@ -282,8 +304,8 @@ l2dbus_timeoutDispose
     lua_State*  L
     )
 {
-    l2dbus_Timeout* ud = (l2dbus_Timeout*)luaL_checkudata(L, -1,
-                                        L2DBUS_TIMEOUT_MTBL_NAME);
+    l2dbus_Timeout* ud = (l2dbus_Timeout*)l2dbus_checkUserData(L, -1,
+                                        L2DBUS_TIMEOUT_TYPE_ID);
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: timeout (userdata=%p)", ud));
 
@@ -327,8 +349,8 @@ l2dbus_timeoutIsEnabled
     lua_State*  L
     )
 {
-    l2dbus_Timeout* ud = (l2dbus_Timeout*)luaL_checkudata(L, 1,
-                                                L2DBUS_TIMEOUT_MTBL_NAME);
+    l2dbus_Timeout* ud = (l2dbus_Timeout*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_TIMEOUT_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -363,8 +385,8 @@ l2dbus_timeoutSetEnable
     cdbus_HResult rc;
     int enable;
 
-    l2dbus_Timeout* ud = (l2dbus_Timeout*)luaL_checkudata(L, 1,
-                                                    L2DBUS_TIMEOUT_MTBL_NAME);
+    l2dbus_Timeout* ud = (l2dbus_Timeout*)l2dbus_checkUserData(L, 1,
+                                                    L2DBUS_TIMEOUT_TYPE_ID);
     luaL_checktype(L, 2, LUA_TBOOLEAN);
 
     /* Make sure the module is initialized */
@@ -372,6 +394,7 @@ l2dbus_timeoutSetEnable
 
     enable = lua_toboolean(L, 2);
     rc = cdbus_timeoutEnable(ud->timeout, enable);
+    ud->armedAt = enable ? l2dbus_statsStart() : 0.0;
     if ( CDBUS_FAILED(rc) )
     {
         l2dbus_cdbusError(L, rc, "Cannot enable/disable timer");
@@ -415,8 +438,8 @@ l2dbus_timeoutInterval
     lua_State*  L
     )
 {
-    l2dbus_Timeout* ud = (l2dbus_Timeout*)luaL_checkudata(L, 1,
-                                                L2DBUS_TIMEOUT_MTBL_NAME);
+    l2dbus_Timeout* ud = (l2dbus_Timeout*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_TIMEOUT_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -447,14 +470,19 @@ l2dbus_timeoutSetInterval
     cdbus_HResult rc;
     cdbus_Int32 interval;
 
-    l2dbus_Timeout* ud = (l2dbus_Timeout*)luaL_checkudata(L, 1,
-                                                    L2DBUS_TIMEOUT_MTBL_NAME);
+    l2dbus_Timeout* ud = (l2dbus_Timeout*)l2dbus_checkUserData(L, 1,
+                                                    L2DBUS_TIMEOUT_TYPE_ID);
     interval = luaL_checkint(L, 2);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
 
     rc = cdbus_timeoutSetInterval(ud->timeout, interval);
+    if ( 0.0 != ud->armedAt )
+    {
+        /* Measure the lag of an enabled timeout from the new interval */
+        ud->armedAt = l2dbus_statsStart();
+    }
     if ( CDBUS_FAILED(rc) )
     {
         l2dbus_cdbusError(L, rc, "Cannot set the timeout interval");
@@ -480,8 +508,8 @@ l2dbus_timeoutRepeat
     lua_State*  L
     )
 {
-    l2dbus_Timeout* ud = (l2dbus_Timeout*)luaL_checkudata(L, 1,
-                                                L2DBUS_TIMEOUT_MTBL_NAME);
+    l2dbus_Timeout* ud = (l2dbus_Timeout*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_TIMEOUT_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -510,8 +538,8 @@ l2dbus_timeoutSetRepeat
     lua_State*  L
     )
 {
-    l2dbus_Timeout* ud = (l2dbus_Timeout*)luaL_checkudata(L, 1,
-                                                    L2DBUS_TIMEOUT_MTBL_NAME);
+    l2dbus_Timeout* ud = (l2dbus_Timeout*)l2dbus_checkUserData(L, 1,
+                                                    L2DBUS_TIMEOUT_TYPE_ID);
     luaL_checktype(L, 2, LUA_TBOOLEAN);
 
     /* Make sure the module is initialized */
@@ -538,8 +566,8 @@ l2dbus_timeoutData
     lua_State*  L
     )
 {
-    l2dbus_Timeout* ud = (l2dbus_Timeout*)luaL_checkudata(L, 1,
-                                                L2DBUS_TIMEOUT_MTBL_NAME);
+    l2dbus_Timeout* ud = (l2dbus_Timeout*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_TIMEOUT_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -565,8 +593,8 @@ l2dbus_timeoutSetData
     lua_State*  L
     )
 {
-    l2dbus_Timeout* ud = (l2dbus_Timeout*)luaL_checkudata(L, 1,
-                                                L2DBUS_TIMEOUT_MTBL_NAME);
+    l2dbus_Timeout* ud = (l2dbus_Timeout*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_TIMEOUT_TYPE_ID);
     /* Any value is acceptable - but it should be specified */
     luaL_checkany(L, 2);
 
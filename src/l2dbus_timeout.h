@@ -46,6 +46,8 @@ typedef struct l2dbus_Timeout
     int                     dispUdRef;
     int                     timeoutUdRef;
     l2dbus_CallbackCtx      cbCtx;
+    /* When the timeout was (re)started (zero if not being timed) */
+    double                  armedAt;
 } l2dbus_Timeout;
 
 int l2dbus_newTimeout(lua_State* L);
@@ -0,0 +1,944 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_timerwheel.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the hierarchical timer wheel.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "cdbus/cdbus.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_timerwheel.h"
+#include "l2dbus_dispatcher.h"
+#include "l2dbus_core.h"
+#include "l2dbus_object.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_debug.h"
+#include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_stats.h"
+#include "lualib.h"
+
+/**
+ L2DBUS TimerWheel
+
+ This section describes a Lua TimerWheel class.
+
+ A TimerWheel schedules large numbers of lightweight timers using a single
+ underlying @{l2dbus.Timeout|Timeout} that ticks at a fixed interval while
+ timers are pending. Timers are kept in a hierarchical wheel so they can be
+ scheduled, rescheduled and cancelled in constant time which makes the
+ wheel well suited to per-request deadlines that are mostly cancelled
+ before they expire. The resolution of a timer is the tick interval of the
+ wheel and a timer never expires early.
+
+ @namespace l2dbus.TimerWheel
+ */
+
+#define L2DBUS_WHEEL_NIL            (-1)
+#define L2DBUS_WHEEL_SLOT_MASK      (L2DBUS_WHEEL_SLOTS - 1)
+/* The furthest (in ticks) a timer can be placed in the wheel. Timers
+ * further out are cascaded until they're in range.
+ */
+#define L2DBUS_WHEEL_MAX_DELTA      ((((uint64_t)1) << (L2DBUS_WHEEL_BITS * \
+                                    L2DBUS_WHEEL_LEVELS)) - 1)
+/* Timer identifiers combine a generation count with the timer index */
+#define L2DBUS_WHEEL_MAX_TIMERS     (1 << 24)
+#define L2DBUS_WHEEL_GEN_MASK       (0x0FFFFFFFU)
+#define L2DBUS_WHEEL_INITIAL_SIZE   (64)
+
+
+static void
+l2dbus_timerWheelUnlink
+    (
+    l2dbus_TimerWheel*  wheel,
+    int                 idx
+    )
+{
+    l2dbus_WheelTimer* t = &wheel->timers[idx];
+
+    if ( L2DBUS_WHEEL_NIL != t->prev )
+    {
+        wheel->timers[t->prev].next = t->next;
+    }
+    else
+    {
+        wheel->heads[t->list] = t->next;
+    }
+
+    if ( L2DBUS_WHEEL_NIL != t->next )
+    {
+        wheel->timers[t->next].prev = t->prev;
+    }
+
+    t->next = L2DBUS_WHEEL_NIL;
+    t->prev = L2DBUS_WHEEL_NIL;
+    t->list = L2DBUS_WHEEL_NIL;
+}
+
+
+static void
+l2dbus_timerWheelLink
+    (
+    l2dbus_TimerWheel*  wheel,
+    int                 list,
+    int                 idx
+    )
+{
+    l2dbus_WheelTimer* t = &wheel->timers[idx];
+
+    t->list = list;
+    t->prev = L2DBUS_WHEEL_NIL;
+    t->next = wheel->heads[list];
+    if ( L2DBUS_WHEEL_NIL != t->next )
+    {
+        wheel->timers[t->next].prev = idx;
+    }
+    wheel->heads[list] = idx;
+}
+
+
+/**
+ * @brief Places a timer in the wheel slot matching its expiry.
+ *
+ * @param [in] wheel    The timer wheel.
+ * @param [in] idx      The index of the (unlinked) timer.
+ */
+static void
+l2dbus_timerWheelInsert
+    (
+    l2dbus_TimerWheel*  wheel,
+    int                 idx
+    )
+{
+    uint64_t expiry = wheel->timers[idx].expiry;
+    uint64_t delta;
+    int level;
+
+    if ( expiry < wheel->curTick )
+    {
+        expiry = wheel->curTick;
+    }
+
+    delta = expiry - wheel->curTick;
+    if ( delta > L2DBUS_WHEEL_MAX_DELTA )
+    {
+        delta = L2DBUS_WHEEL_MAX_DELTA;
+        expiry = wheel->curTick + delta;
+    }
+
+    for ( level = 0; level < (L2DBUS_WHEEL_LEVELS - 1); ++level )
+    {
+        if ( delta < (((uint64_t)1) << (L2DBUS_WHEEL_BITS * (level + 1))) )
+        {
+            break;
+        }
+    }
+
+    l2dbus_timerWheelLink(wheel, (level * L2DBUS_WHEEL_SLOTS) +
+        (int)((expiry >> (L2DBUS_WHEEL_BITS * level)) & L2DBUS_WHEEL_SLOT_MASK),
+        idx);
+}
+
+
+/**
+ * @brief Re-distributes the timers of a slot into the lower levels.
+ *
+ * @param [in] wheel    The timer wheel.
+ * @param [in] level    The level of the slot to cascade.
+ * @param [in] slot     The slot within the level.
+ */
+static void
+l2dbus_timerWheelCascade
+    (
+    l2dbus_TimerWheel*  wheel,
+    int                 level,
+    int                 slot
+    )
+{
+    int list = (level * L2DBUS_WHEEL_SLOTS) + slot;
+    int idx;
+
+    while ( L2DBUS_WHEEL_NIL != (idx = wheel->heads[list]) )
+    {
+        l2dbus_timerWheelUnlink(wheel, idx);
+        l2dbus_timerWheelInsert(wheel, idx);
+    }
+}
+
+
+/**
+ * @brief Advances the wheel by one tick.
+ *
+ * The timers due on the new tick are moved to the expired list.
+ *
+ * @param [in] wheel    The timer wheel.
+ */
+static void
+l2dbus_timerWheelAdvance
+    (
+    l2dbus_TimerWheel*  wheel
+    )
+{
+    int level;
+    int slot;
+    int idx;
+
+    wheel->curTick++;
+    slot = (int)(wheel->curTick & L2DBUS_WHEEL_SLOT_MASK);
+
+    /* When the lowest level wraps pull down timers from the higher levels */
+    if ( 0 == slot )
+    {
+        for ( level = 1; level < L2DBUS_WHEEL_LEVELS; ++level )
+        {
+            slot = (int)((wheel->curTick >> (L2DBUS_WHEEL_BITS * level)) &
+                                            L2DBUS_WHEEL_SLOT_MASK);
+            l2dbus_timerWheelCascade(wheel, level, slot);
+            if ( 0 != slot )
+            {
+                break;
+            }
+        }
+        slot = 0;
+    }
+
+    while ( L2DBUS_WHEEL_NIL != (idx = wheel->heads[slot]) )
+    {
+        l2dbus_timerWheelUnlink(wheel, idx);
+        l2dbus_timerWheelLink(wheel, L2DBUS_WHEEL_EXPIRED_LIST, idx);
+    }
+}
+
+
+/**
+ * @brief Returns the (fractional) number of ticks elapsed since the base.
+ */
+static double
+l2dbus_timerWheelNow
+    (
+    l2dbus_TimerWheel*  wheel
+    )
+{
+    return ((l2dbus_monotonicTime() - wheel->baseTime) * 1000.0) /
+            (double)wheel->tickMsec;
+}
+
+
+/**
+ * @brief Arms or disarms the underlying timeout based on the timer count.
+ *
+ * A strong reference to the wheel is kept while it's armed so the Lua GC
+ * cannot reclaim a wheel that still has timers.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] wheel    The timer wheel.
+ * @param [in] udIdx    The stack index of the wheel userdata.
+ */
+static void
+l2dbus_timerWheelUpdateArmed
+    (
+    lua_State*          L,
+    l2dbus_TimerWheel*  wheel,
+    int                 udIdx
+    )
+{
+    l2dbus_Bool isArmed = (LUA_NOREF != wheel->wheelUdRef);
+
+    if ( (wheel->count > 0) && !isArmed )
+    {
+        /* Restart the clock so time spent idle isn't "caught up" */
+        wheel->baseTime = l2dbus_monotonicTime() -
+                    (((double)wheel->curTick * wheel->tickMsec) / 1000.0);
+        if ( CDBUS_FAILED(cdbus_timeoutEnable(wheel->timeout, CDBUS_TRUE)) )
+        {
+            luaL_error(L, "cannot enable the timer wheel timeout");
+        }
+        lua_pushvalue(L, udIdx);
+        wheel->wheelUdRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    else if ( (0 == wheel->count) && isArmed )
+    {
+        cdbus_timeoutEnable(wheel->timeout, CDBUS_FALSE);
+        luaL_unref(L, LUA_REGISTRYINDEX, wheel->wheelUdRef);
+        wheel->wheelUdRef = LUA_NOREF;
+    }
+}
+
+
+/**
+ * @brief Returns a timer to the free list and drops its handler/token.
+ *
+ * On exit the handler and token of the timer are left on the Lua stack (in
+ * that order).
+ */
+static void
+l2dbus_timerWheelRelease
+    (
+    lua_State*          L,
+    l2dbus_TimerWheel*  wheel,
+    int                 idx
+    )
+{
+    l2dbus_WheelTimer* t = &wheel->timers[idx];
+
+    if ( L2DBUS_WHEEL_NIL != t->list )
+    {
+        l2dbus_timerWheelUnlink(wheel, idx);
+    }
+
+    t->gen = (t->gen + 1) & L2DBUS_WHEEL_GEN_MASK;
+    t->next = wheel->freeHead;
+    wheel->freeHead = idx;
+    wheel->count--;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, wheel->timerTblRef);
+    lua_rawgeti(L, -1, (2 * idx) + 1);
+    lua_rawgeti(L, -2, (2 * idx) + 2);
+    lua_pushnil(L);
+    lua_rawseti(L, -4, (2 * idx) + 1);
+    lua_pushnil(L);
+    lua_rawseti(L, -4, (2 * idx) + 2);
+    lua_remove(L, -3);
+}
+
+
+/**
+ * @brief Handles the ticks of the underlying timeout.
+ *
+ * The wheel is advanced to the current time and the handlers of all the
+ * expired timers are called. The tokens of timers without their own
+ * handler are collected and passed to the batch handler in a single call.
+ *
+ * @param [in] t      The CDBUS timeout instance.
+ * @param [in] user   The timer wheel.
+ * @return A boolean value that is currently unused by CDBUS.
+ */
+static cdbus_Bool
+l2dbus_timerWheelHandler
+    (
+    cdbus_Timeout*  t,
+    void*           user
+    )
+{
+    lua_State* L = l2dbus_callbackGetThread();
+    const char* errMsg = "";
+    l2dbus_TimerWheel* wheel = l2dbus_objectRegistryGet(L, user);
+    uint64_t now;
+    int udIdx;
+    int batchIdx = 0;
+    int nBatch = 0;
+    int idx;
+    l2dbus_Bool hasHandler;
+    double cbStart;
+    int status;
+
+    assert( NULL != t );
+    assert( NULL != L );
+
+    if ( NULL == wheel )
+    {
+        L2DBUS_TRACE((L2DBUS_TRC_WARN,
+            "Cannot process timer wheel because it has been GC'ed"));
+    }
+    else
+    {
+        udIdx = lua_gettop(L);
+        now = (uint64_t)floor(l2dbus_timerWheelNow(wheel));
+        while ( wheel->curTick < now )
+        {
+            l2dbus_timerWheelAdvance(wheel);
+        }
+
+        if ( LUA_NOREF != wheel->cbCtx.funcRef )
+        {
+            lua_newtable(L);
+            batchIdx = lua_gettop(L);
+        }
+
+        /* Handlers may schedule or cancel other timers (including those
+         * still in the expired list) so take one timer at a time.
+         */
+        while ( L2DBUS_WHEEL_NIL !=
+            (idx = wheel->heads[L2DBUS_WHEEL_EXPIRED_LIST]) )
+        {
+            hasHandler = wheel->timers[idx].hasHandler;
+            l2dbus_timerWheelRelease(L, wheel, idx);
+            if ( hasHandler )
+            {
+                lua_pushvalue(L, udIdx);
+                lua_insert(L, -2);
+                cbStart = l2dbus_statsCallbackStart(L, 2 /* nArgs */);
+                status = lua_pcall(L, 2 /* nArgs */, 0, 0);
+                l2dbus_statsCallback(L2DBUS_STATS_CB_TIMER_WHEEL, cbStart,
+                                    status);
+                if ( 0 != status )
+                {
+                    if ( lua_isstring(L, -1) )
+                    {
+                        errMsg = lua_tostring(L, -1);
+                    }
+                    L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                                "Timer wheel callback error: %s", errMsg));
+                    lua_pop(L, 1);
+                }
+            }
+            else if ( 0 != batchIdx )
+            {
+                lua_rawseti(L, batchIdx, ++nBatch);
+                lua_pop(L, 1);
+            }
+            else
+            {
+                lua_pop(L, 2);
+            }
+        }
+
+        if ( nBatch > 0 )
+        {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, wheel->cbCtx.funcRef);
+            lua_pushvalue(L, udIdx);
+            lua_pushvalue(L, batchIdx);
+            lua_rawgeti(L, LUA_REGISTRYINDEX, wheel->cbCtx.userRef);
+            cbStart = l2dbus_statsCallbackStart(L, 3 /* nArgs */);
+            status = lua_pcall(L, 3 /* nArgs */, 0, 0);
+            l2dbus_statsCallback(L2DBUS_STATS_CB_TIMER_WHEEL_BATCH, cbStart,
+                                status);
+            if ( 0 != status )
+            {
+                if ( lua_isstring(L, -1) )
+                {
+                    errMsg = lua_tostring(L, -1);
+                }
+                L2DBUS_TRACE((L2DBUS_TRC_ERROR,
+                            "Timer wheel batch callback error: %s", errMsg));
+            }
+        }
+
+        l2dbus_timerWheelUpdateArmed(L, wheel, udIdx);
+    }
+
+    /* Clean up the thread stack */
+    lua_settop(L, 0);
+
+    /* Reclaim any transient allocations made while servicing the callback */
+    l2dbus_arenaReset();
+
+    /* The return value is unused by CDBUS */
+    return CDBUS_TRUE;
+}
+
+
+/**
+ * @brief Looks up the timer index from a Lua timer identifier.
+ *
+ * @return The index of the scheduled timer or L2DBUS_WHEEL_NIL if the
+ * identifier does not refer to a scheduled timer.
+ */
+static int
+l2dbus_timerWheelCheckId
+    (
+    lua_State*          L,
+    l2dbus_TimerWheel*  wheel,
+    int                 argIdx
+    )
+{
+    lua_Number id = luaL_checknumber(L, argIdx);
+    double gen;
+    int idx;
+
+    if ( id < 0 )
+    {
+        return L2DBUS_WHEEL_NIL;
+    }
+
+    gen = floor(id / L2DBUS_WHEEL_MAX_TIMERS);
+    idx = (int)(id - (gen * L2DBUS_WHEEL_MAX_TIMERS));
+    if ( (idx >= wheel->capacity) ||
+        (L2DBUS_WHEEL_NIL == wheel->timers[idx].list) ||
+        ((unsigned)gen != wheel->timers[idx].gen) )
+    {
+        return L2DBUS_WHEEL_NIL;
+    }
+
+    return idx;
+}
+
+
+/**
+ * @brief Computes the expiry tick for an interval from now.
+ */
+static uint64_t
+l2dbus_timerWheelExpiry
+    (
+    l2dbus_TimerWheel*  wheel,
+    lua_Number          msecInterval
+    )
+{
+    double now;
+    double expiry;
+
+    /* An idle wheel is restarted when it's armed */
+    now = (LUA_NOREF == wheel->wheelUdRef) ? (double)wheel->curTick :
+                                            l2dbus_timerWheelNow(wheel);
+    if ( msecInterval < 0 )
+    {
+        msecInterval = 0;
+    }
+
+    /* Round up so the timer never expires early */
+    expiry = ceil(now + (msecInterval / (double)wheel->tickMsec));
+    if ( expiry <= (double)wheel->curTick )
+    {
+        expiry = (double)wheel->curTick + 1.0;
+    }
+
+    return (uint64_t)expiry;
+}
+
+
+/**
+ @function new
+
+ Creates a new TimerWheel.
+
+ Creates a timer wheel that uses a single timeout, which ticks at the given
+ interval while timers are scheduled. An optional batch handler is called
+ once per tick with the tokens of all the expired timers that were
+ scheduled without their own handler. The signature of the batch handler
+ has the form:
+
+    function onExpired(wheel, tokens, userToken)
+
+ Where:
+
+ <ul>
+ <li>*wheel*      - The L2DBUS TimerWheel instance</li>
+ <li>*tokens*     - An array of the tokens of the expired timers</li>
+ <li>*userToken*  - A value specified by the user when the wheel was created.</li>
+ </ul>
+
+ @tparam userdata dispatcher The @{l2dbus.Dispatcher|dispatcher} with which
+ to associate the TimerWheel.
+ @tparam number tick The resolution (in milliseconds) of the wheel.
+ @tparam ?func handler The optional batch handler.
+ @tparam ?any userToken User data that will be passed to the batch handler.
+ @treturn userdata The userdata object representing the TimerWheel.
+ */
+int
+l2dbus_newTimerWheel
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TimerWheel* wheel;
+    l2dbus_Dispatcher* dispUd;
+    int tickMsec;
+    int funcIdx = L2DBUS_CALLBACK_NOREF_NEEDED;
+    int userIdx = L2DBUS_CALLBACK_NOREF_NEEDED;
+    int idx;
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "Create: timer wheel"));
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    dispUd = (l2dbus_Dispatcher*)l2dbus_checkUserData(L, 1,
+                                    L2DBUS_DISPATCHER_TYPE_ID);
+    tickMsec = luaL_checkint(L, 2);
+    luaL_argcheck(L, tickMsec > 0, 2, "tick must be greater than zero");
+
+    if ( !lua_isnoneornil(L, 3) )
+    {
+        luaL_checktype(L, 3, LUA_TFUNCTION);
+        funcIdx = 3;
+        if ( lua_gettop(L) >= 4 )
+        {
+            userIdx = 4;
+        }
+    }
+
+    wheel = (l2dbus_TimerWheel*)l2dbus_objectNew(L, sizeof(*wheel),
+                                                L2DBUS_TIMER_WHEEL_TYPE_ID);
+    if ( NULL == wheel )
+    {
+        luaL_error(L, "Failed to create timer wheel userdata!");
+    }
+
+    l2dbus_callbackInit(&wheel->cbCtx);
+    wheel->dispUdRef = LUA_NOREF;
+    wheel->wheelUdRef = LUA_NOREF;
+    wheel->timerTblRef = LUA_NOREF;
+    wheel->tickMsec = tickMsec;
+    wheel->freeHead = L2DBUS_WHEEL_NIL;
+    for ( idx = 0; idx < L2DBUS_WHEEL_NUM_LISTS; ++idx )
+    {
+        wheel->heads[idx] = L2DBUS_WHEEL_NIL;
+    }
+
+    wheel->timeout = cdbus_timeoutNew(dispUd->disp, tickMsec, CDBUS_TRUE,
+                                    l2dbus_timerWheelHandler, wheel);
+    if ( NULL == wheel->timeout )
+    {
+        luaL_error(L, "Failed to allocate timer wheel timeout");
+    }
+
+    l2dbus_callbackRef(L, funcIdx, userIdx, &wheel->cbCtx);
+
+    lua_newtable(L);
+    wheel->timerTblRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    /* Add a reference to the Dispatcher userdata */
+    lua_pushvalue(L, 1 /* dispUd */);
+    wheel->dispUdRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    /* Create a weak reference to the TimerWheel user data */
+    l2dbus_objectRegistryAdd(L, wheel, -1);
+
+    return 1;
+}
+
+
+/**
+ @function schedule
+ @within l2dbus.TimerWheel
+
+ Schedules a timer.
+
+ The handler of the timer is called once when it expires. If no handler is
+ given the token is passed to the wheel's batch handler instead. The
+ signature of the handler has the form:
+
+    function onTimer(wheel, token)
+
+ @tparam userdata wheel The TimerWheel.
+ @tparam number interval The time (in milliseconds) until the timer expires.
+ @tparam ?func handler The handler called when the timer expires.
+ @tparam ?any token A value passed to the handler.
+ @treturn number An identifier used to @{cancel} or @{reschedule} the timer.
+ */
+static int
+l2dbus_timerWheelSchedule
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TimerWheel* wheel = (l2dbus_TimerWheel*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_TIMER_WHEEL_TYPE_ID);
+    lua_Number msecInterval = luaL_checknumber(L, 2);
+    l2dbus_Bool hasHandler = !lua_isnoneornil(L, 3);
+    l2dbus_WheelTimer* timers;
+    int newCapacity;
+    int idx;
+
+    /* Make sure the optional handler and token have a stack slot */
+    lua_settop(L, 4);
+
+    if ( hasHandler )
+    {
+        luaL_checktype(L, 3, LUA_TFUNCTION);
+    }
+    else if ( LUA_NOREF == wheel->cbCtx.funcRef )
+    {
+        luaL_error(L, "no handler provided and the wheel has no batch handler");
+    }
+
+    /* Grow the timer array if there are no free timers */
+    if ( L2DBUS_WHEEL_NIL == wheel->freeHead )
+    {
+        newCapacity = (0 == wheel->capacity) ? L2DBUS_WHEEL_INITIAL_SIZE :
+                                                (2 * wheel->capacity);
+        if ( newCapacity > L2DBUS_WHEEL_MAX_TIMERS )
+        {
+            newCapacity = L2DBUS_WHEEL_MAX_TIMERS;
+        }
+
+        if ( newCapacity <= wheel->capacity )
+        {
+            luaL_error(L, "too many timers scheduled");
+        }
+
+        timers = l2dbus_realloc(wheel->timers, newCapacity * sizeof(*timers));
+        if ( NULL == timers )
+        {
+            luaL_error(L, "failed to allocate memory for timers");
+        }
+
+        for ( idx = newCapacity - 1; idx >= wheel->capacity; --idx )
+        {
+            memset(&timers[idx], 0, sizeof(timers[idx]));
+            timers[idx].list = L2DBUS_WHEEL_NIL;
+            timers[idx].prev = L2DBUS_WHEEL_NIL;
+            timers[idx].next = wheel->freeHead;
+            wheel->freeHead = idx;
+        }
+        wheel->timers = timers;
+        wheel->capacity = newCapacity;
+    }
+
+    idx = wheel->freeHead;
+    wheel->freeHead = wheel->timers[idx].next;
+    wheel->timers[idx].next = L2DBUS_WHEEL_NIL;
+    wheel->timers[idx].hasHandler = hasHandler;
+    wheel->timers[idx].expiry = l2dbus_timerWheelExpiry(wheel, msecInterval);
+    l2dbus_timerWheelInsert(wheel, idx);
+    wheel->count++;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, wheel->timerTblRef);
+    lua_pushvalue(L, 3);
+    lua_rawseti(L, -2, (2 * idx) + 1);
+    lua_pushvalue(L, 4);
+    lua_rawseti(L, -2, (2 * idx) + 2);
+    lua_pop(L, 1);
+
+    l2dbus_timerWheelUpdateArmed(L, wheel, 1);
+
+    lua_pushnumber(L, ((lua_Number)wheel->timers[idx].gen *
+                        L2DBUS_WHEEL_MAX_TIMERS) + idx);
+    return 1;
+}
+
+
+/**
+ @function cancel
+ @within l2dbus.TimerWheel
+
+ Cancels a scheduled timer.
+
+ @tparam userdata wheel The TimerWheel.
+ @tparam number id The identifier returned by @{schedule}.
+ @treturn bool Returns **true** if the timer was cancelled or **false** if
+ it was not scheduled (e.g. it already expired).
+ */
+static int
+l2dbus_timerWheelCancel
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TimerWheel* wheel = (l2dbus_TimerWheel*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_TIMER_WHEEL_TYPE_ID);
+    int idx = l2dbus_timerWheelCheckId(L, wheel, 2);
+
+    if ( L2DBUS_WHEEL_NIL != idx )
+    {
+        l2dbus_timerWheelRelease(L, wheel, idx);
+        lua_pop(L, 2);
+        l2dbus_timerWheelUpdateArmed(L, wheel, 1);
+    }
+
+    lua_pushboolean(L, L2DBUS_WHEEL_NIL != idx);
+    return 1;
+}
+
+
+/**
+ @function reschedule
+ @within l2dbus.TimerWheel
+
+ Changes the time until a scheduled timer expires.
+
+ @tparam userdata wheel The TimerWheel.
+ @tparam number id The identifier returned by @{schedule}.
+ @tparam number interval The time (in milliseconds) from now until the timer
+ expires.
+ @treturn bool Returns **true** if the timer was rescheduled or **false**
+ if it was not scheduled.
+ */
+static int
+l2dbus_timerWheelReschedule
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TimerWheel* wheel = (l2dbus_TimerWheel*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_TIMER_WHEEL_TYPE_ID);
+    int idx = l2dbus_timerWheelCheckId(L, wheel, 2);
+    lua_Number msecInterval = luaL_checknumber(L, 3);
+
+    if ( L2DBUS_WHEEL_NIL != idx )
+    {
+        l2dbus_timerWheelUnlink(wheel, idx);
+        wheel->timers[idx].expiry = l2dbus_timerWheelExpiry(wheel,
+                                                            msecInterval);
+        l2dbus_timerWheelInsert(wheel, idx);
+    }
+
+    lua_pushboolean(L, L2DBUS_WHEEL_NIL != idx);
+    return 1;
+}
+
+
+/**
+ @function isScheduled
+ @within l2dbus.TimerWheel
+
+ Determines whether a timer is still scheduled.
+
+ @tparam userdata wheel The TimerWheel.
+ @tparam number id The identifier returned by @{schedule}.
+ @treturn bool Returns **true** if the timer has not yet expired or been
+ cancelled.
+ */
+static int
+l2dbus_timerWheelIsScheduled
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TimerWheel* wheel = (l2dbus_TimerWheel*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_TIMER_WHEEL_TYPE_ID);
+
+    lua_pushboolean(L, L2DBUS_WHEEL_NIL !=
+                        l2dbus_timerWheelCheckId(L, wheel, 2));
+    return 1;
+}
+
+
+/**
+ @function count
+ @within l2dbus.TimerWheel
+
+ Returns the number of scheduled timers.
+
+ @tparam userdata wheel The TimerWheel.
+ @treturn number The number of scheduled timers.
+ */
+static int
+l2dbus_timerWheelCount
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TimerWheel* wheel = (l2dbus_TimerWheel*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_TIMER_WHEEL_TYPE_ID);
+
+    lua_pushinteger(L, wheel->count);
+    return 1;
+}
+
+
+/**
+ @function tick
+ @within l2dbus.TimerWheel
+
+ Returns the tick interval (resolution) of the wheel.
+
+ @tparam userdata wheel The TimerWheel.
+ @treturn number The tick interval in milliseconds.
+ */
+static int
+l2dbus_timerWheelTick
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TimerWheel* wheel = (l2dbus_TimerWheel*)l2dbus_checkUserData(L, 1,
+                                            L2DBUS_TIMER_WHEEL_TYPE_ID);
+
+    lua_pushinteger(L, wheel->tickMsec);
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the TimerWheel userdata.
+ *
+ * @return nil
+ */
+static int
+l2dbus_timerWheelDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TimerWheel* wheel = (l2dbus_TimerWheel*)l2dbus_checkUserData(L, -1,
+                                            L2DBUS_TIMER_WHEEL_TYPE_ID);
+
+    L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: timer wheel (userdata=%p)", wheel));
+
+    if ( NULL != wheel->timeout )
+    {
+        cdbus_timeoutEnable(wheel->timeout, CDBUS_FALSE);
+        cdbus_timeoutUnref(wheel->timeout);
+        wheel->timeout = NULL;
+    }
+
+    /* Drop the weak reference to the userdata */
+    l2dbus_objectRegistryRemove(L, wheel);
+
+    luaL_unref(L, LUA_REGISTRYINDEX, wheel->dispUdRef);
+    luaL_unref(L, LUA_REGISTRYINDEX, wheel->timerTblRef);
+    l2dbus_callbackUnref(L, &wheel->cbCtx);
+
+    l2dbus_free(wheel->timers);
+    wheel->timers = NULL;
+
+    return 0;
+}
+
+
+/*
+ * Define the methods of the TimerWheel class
+ */
+static const luaL_Reg l2dbus_timerWheelMetaTable[] = {
+    {"schedule", l2dbus_timerWheelSchedule},
+    {"cancel", l2dbus_timerWheelCancel},
+    {"reschedule", l2dbus_timerWheelReschedule},
+    {"isScheduled", l2dbus_timerWheelIsScheduled},
+    {"count", l2dbus_timerWheelCount},
+    {"tick", l2dbus_timerWheelTick},
+    {"__gc", l2dbus_timerWheelDispose},
+    {NULL, NULL},
+};
+
+
+/**
+ * @brief Creates the TimerWheel sub-module.
+ *
+ * This function creates a metatable entry for the TimerWheel userdata
+ * and simulates opening the TimerWheel sub-module.
+ *
+ * @return A table defining the TimerWheel sub-module.
+ */
+void
+l2dbus_openTimerWheel
+    (
+    lua_State*  L
+    )
+{
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_TIMER_WHEEL_TYPE_ID,
+            l2dbus_timerWheelMetaTable));
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, l2dbus_newTimerWheel);
+    lua_setfield(L, -2, "new");
+}
@@ -0,0 +1,86 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_timerwheel.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the hierarchical timer wheel.
+ *===========================================================================
+ */
+#ifndef L2DBUS_TIMERWHEEL_H_
+#define L2DBUS_TIMERWHEEL_H_
+
+#include <stdint.h>
+#include "lua.h"
+#include "l2dbus_types.h"
+#include "l2dbus_callback.h"
+
+/* Forward declarations */
+struct cdbus_Timeout;
+
+/* Each level of the wheel has 2^L2DBUS_WHEEL_BITS slots */
+#define L2DBUS_WHEEL_BITS           (6)
+#define L2DBUS_WHEEL_SLOTS          (1 << L2DBUS_WHEEL_BITS)
+#define L2DBUS_WHEEL_LEVELS         (4)
+/* Timers that have expired but whose handlers have not been called yet */
+#define L2DBUS_WHEEL_EXPIRED_LIST   (L2DBUS_WHEEL_LEVELS * L2DBUS_WHEEL_SLOTS)
+#define L2DBUS_WHEEL_NUM_LISTS      (L2DBUS_WHEEL_EXPIRED_LIST + 1)
+
+typedef struct l2dbus_WheelTimer
+{
+    /* Timers are linked by index so the timer array can be grown */
+    int                     next;
+    int                     prev;
+    /* The list holding the timer or L2DBUS_WHEEL_NIL if it's free */
+    int                     list;
+    unsigned                gen;
+    uint64_t                expiry;
+    l2dbus_Bool             hasHandler;
+} l2dbus_WheelTimer;
+
+typedef struct l2dbus_TimerWheel
+{
+    struct cdbus_Timeout*   timeout;
+    int                     dispUdRef;
+    int                     wheelUdRef;
+    /* Table holding the handler and token of each timer */
+    int                     timerTblRef;
+    /* The batch handler and its user token */
+    l2dbus_CallbackCtx      cbCtx;
+    int                     tickMsec;
+    double                  baseTime;
+    uint64_t                curTick;
+    l2dbus_WheelTimer*      timers;
+    int                     capacity;
+    int                     freeHead;
+    int                     count;
+    int                     heads[L2DBUS_WHEEL_NUM_LISTS];
+} l2dbus_TimerWheel;
+
+int l2dbus_newTimerWheel(lua_State* L);
+void l2dbus_openTimerWheel(lua_State* L);
+
+#endif /* Guard for L2DBUS_TIMERWHEEL_H_ */
@@ -36,6 +36,7 @@
 #include <stdlib.h>
 #include <dbus/dbus.h>
 #include "l2dbus_trace.h"
+#include "l2dbus_context.h"
 #include "lauxlib.h"
 
 /**
@@ -60,6 +61,9 @@
  */
 
 
+/* The trace mask used when there is no current module context. It's also
+ * the initial trace mask of a new context.
+ */
 static volatile unsigned gsTraceMask = L2DBUS_TRC_ALL;
 
 
@@ -76,7 +80,7 @@ l2dbus_traceIsEnabled
     ...
     )
 {
-    return (level & gsTraceMask) != 0;
+    return (level & l2dbus_traceGetMask()) != 0;
 }
 
 
@@ -129,7 +133,7 @@ l2dbus_trace
     const char* levelStr = "";
     va_list args;
 
-    if ( level & gsTraceMask )
+    if ( level & l2dbus_traceGetMask() )
     {
         switch( level )
         {
@@ -169,6 +173,9 @@ l2dbus_trace
 /**
  * @brief Sets the trace mask to enable/disable trace levels.
  *
+ * The mask applies to the current module context (e.g. Lua state) or
+ * becomes the default mask if there is no current context.
+ *
  * @param [in] mask    A bitmask of trace levels.
  */
 void
@@ -177,19 +184,31 @@ l2dbus_traceSetMask
     unsigned    mask
     )
 {
-    gsTraceMask = mask;
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+
+    if ( NULL != ctx )
+    {
+        ctx->traceMask = mask;
+    }
+    else
+    {
+        gsTraceMask = mask;
+    }
 }
 
 
 /**
  * @brief Gets the current trace mask.
  *
- * @return The trace mask.
+ * @return The trace mask of the current module context or the default
+ * mask if there is no current context.
  */
 unsigned
 l2dbus_traceGetMask()
 {
-    return gsTraceMask;
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+
+    return (NULL != ctx) ? ctx->traceMask : gsTraceMask;
 }
 
 
@@ -215,6 +234,9 @@ l2dbus_traceSetFlags
     int nArgs = lua_gettop(L);
     int idx;
 
+    /* Apply the flags to the context of this Lua state */
+    l2dbus_contextGet(L);
+
     for ( idx = 1; idx <= nArgs; ++idx )
     {
         mask = luaL_checkinteger(L, idx);
@@ -274,7 +296,10 @@ l2dbus_traceGetFlags
     static const unsigned flags[] = {L2DBUS_TRC_FATAL, L2DBUS_TRC_ERROR,
                             L2DBUS_TRC_WARN, L2DBUS_TRC_INFO,
                             L2DBUS_TRC_DEBUG, L2DBUS_TRC_TRACE};
-    unsigned mask = l2dbus_traceGetMask();
+    unsigned mask;
+
+    l2dbus_contextGet(L);
+    mask = l2dbus_traceGetMask();
     lua_newtable(L);
     lua_pushinteger(L, mask);
     lua_setfield(L, -2, "mask");
@@ -0,0 +1,844 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_tracering.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the sampling message trace ring.
+ *===========================================================================
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "lauxlib.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_tracering.h"
+#include "l2dbus_context.h"
+#include "l2dbus_connection.h"
+#include "l2dbus_core.h"
+#include "l2dbus_alloc.h"
+
+/**
+ L2DBUS TraceRing
+
+ This section describes the L2DBUS sampling message tracer.
+
+ Unlike the message tracing of @{l2dbus.Trace}, which formats each message
+ as text when it's sent or received, the trace ring records a small fixed
+ size binary record (see @{Record}) for each (sampled) message into an
+ in-memory ring buffer. Recording a message costs little more than hashing
+ a few header fields so tracing can be left on in production. The newest
+ records are kept once the ring wraps and they can be @{dump|dumped} to Lua
+ on demand or @{write|written} to a binary file which can be @{read|read}
+ back (e.g. on a development host) to be decoded offline.
+
+ String header fields (path, interface, member, etc.) are stored as 32-bit
+ FNV-1a hashes. Use @{hash} to compute the hash of a known name to match
+ it against the records.
+
+ The ring is kept separately for each Lua state. All the connections of
+ the Lua state are traced by default once the ring is @{enable|enabled}
+ and individual connections can be excluded with
+ @{l2dbus.Connection.setTraced}.
+
+ @namespace l2dbus.TraceRing
+ */
+
+#define L2DBUS_TRACE_RING_NSECS_PER_SEC    (1000000000LL)
+
+
+static uint32_t
+l2dbus_traceRingHash
+    (
+    const char* str
+    )
+{
+    uint32_t hash = 2166136261U;
+
+    if ( NULL == str )
+    {
+        return 0U;
+    }
+
+    while ( '\0' != *str )
+    {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+
+static int64_t
+l2dbus_traceRingClock
+    (
+    clockid_t   clockId
+    )
+{
+    struct timespec now;
+
+    if ( 0 != clock_gettime(clockId, &now) )
+    {
+        return 0;
+    }
+
+    return ((int64_t)now.tv_sec * L2DBUS_TRACE_RING_NSECS_PER_SEC) +
+            (int64_t)now.tv_nsec;
+}
+
+
+static l2dbus_TraceRing*
+l2dbus_traceRingCurrent(void)
+{
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+
+    return (NULL != ctx) ? &ctx->traceRing : NULL;
+}
+
+
+/**
+ * @brief Releases the records of a trace ring.
+ *
+ * The ring is left disabled.
+ *
+ * @param [in] ring The trace ring.
+ */
+void
+l2dbus_traceRingFree
+    (
+    l2dbus_TraceRing*   ring
+    )
+{
+    if ( NULL != ring )
+    {
+        l2dbus_free(ring->records);
+        ring->records = NULL;
+        ring->capacity = 0;
+        ring->sampleCount = 0;
+        ring->total = 0;
+    }
+}
+
+
+/**
+ * @brief Returns a new identifier for a connection of the current context.
+ *
+ * Identifiers are never zero (0) and only wrap after 65535 connections.
+ *
+ * @return The connection identifier.
+ */
+uint16_t
+l2dbus_traceRingNextConnId(void)
+{
+    l2dbus_TraceRing* ring = l2dbus_traceRingCurrent();
+
+    if ( NULL == ring )
+    {
+        return 0;
+    }
+
+    if ( 0 == ++ring->lastConnId )
+    {
+        ring->lastConnId = 1;
+    }
+
+    return ring->lastConnId;
+}
+
+
+/**
+ * @brief Records a message sent or received by a connection.
+ *
+ * Nothing is recorded unless the trace ring of the current context is
+ * enabled, the connection is traced and the message is sampled. Sent
+ * messages must be recorded after they're queued so they have a serial.
+ *
+ * @param [in] connUd    The connection (may be NULL).
+ * @param [in] msg       The message.
+ * @param [in] direction L2DBUS_TRACE_RING_SENT or L2DBUS_TRACE_RING_RECEIVED.
+ */
+void
+l2dbus_traceRingRecord
+    (
+    struct l2dbus_Connection*   connUd,
+    DBusMessage*                msg,
+    unsigned                    direction
+    )
+{
+    l2dbus_TraceRing* ring = l2dbus_traceRingCurrent();
+    l2dbus_TraceRecord* rec;
+    int msgType;
+
+    if ( (NULL == ring) || (NULL == ring->records) || (NULL == msg) ||
+        ((NULL != connUd) && !connUd->traced) )
+    {
+        return;
+    }
+
+    /* Only one in every sampleRate messages is recorded */
+    if ( ++ring->sampleCount < ring->sampleRate )
+    {
+        return;
+    }
+    ring->sampleCount = 0;
+
+    rec = &ring->records[ring->total & (ring->capacity - 1)];
+    ring->total++;
+
+    msgType = dbus_message_get_type(msg);
+    rec->timestamp = (uint64_t)l2dbus_traceRingClock(CLOCK_MONOTONIC);
+    rec->serial = dbus_message_get_serial(msg);
+    rec->replySerial = dbus_message_get_reply_serial(msg);
+    rec->pathHash = l2dbus_traceRingHash(dbus_message_get_path(msg));
+    rec->interfaceHash = l2dbus_traceRingHash(
+                                        dbus_message_get_interface(msg));
+    rec->memberHash = l2dbus_traceRingHash(dbus_message_get_member(msg));
+    if ( DBUS_MESSAGE_TYPE_ERROR == msgType )
+    {
+        rec->nameHash = l2dbus_traceRingHash(
+                                        dbus_message_get_error_name(msg));
+    }
+    else
+    {
+        rec->nameHash = l2dbus_traceRingHash(
+                                        dbus_message_get_destination(msg));
+    }
+    rec->signatureHash = l2dbus_traceRingHash(
+                                        dbus_message_get_signature(msg));
+    rec->connId = (NULL != connUd) ? connUd->traceId : 0;
+    rec->msgType = (uint8_t)msgType;
+    rec->direction = (uint8_t)direction;
+}
+
+
+/**
+ @table Record
+
+ A traced message.
+
+ @field time (number) The (monotonic clock) time in seconds the message
+ was sent or received.
+ @field direction (number) @{SENT} or @{RECEIVED}.
+ @field connection (number) The @{l2dbus.Connection.getTraceId|trace
+ identifier} of the connection.
+ @field type (number) The D-Bus message type (e.g.
+ @{l2dbus.Message.METHOD_CALL}).
+ @field serial (number) The serial number of the message.
+ @field replySerial (number) The serial number of the message being replied
+ to (or zero if it's not a reply).
+ @field path (number) The @{hash} of the object path.
+ @field interface (number) The @{hash} of the interface.
+ @field member (number) The @{hash} of the member.
+ @field name (number) The @{hash} of the error name for error messages or
+ of the destination otherwise.
+ @field signature (number) The @{hash} of the signature of the message.
+
+ Hashes of header fields the message does not have are zero (0).
+ */
+static void
+l2dbus_traceRingPushRecord
+    (
+    lua_State*                  L,
+    const l2dbus_TraceRecord*   rec
+    )
+{
+    lua_createtable(L, 0, 11);
+    lua_pushnumber(L, (lua_Number)rec->timestamp /
+                    (lua_Number)L2DBUS_TRACE_RING_NSECS_PER_SEC);
+    lua_setfield(L, -2, "time");
+    lua_pushinteger(L, rec->direction);
+    lua_setfield(L, -2, "direction");
+    lua_pushinteger(L, rec->connId);
+    lua_setfield(L, -2, "connection");
+    lua_pushinteger(L, rec->msgType);
+    lua_setfield(L, -2, "type");
+    lua_pushnumber(L, rec->serial);
+    lua_setfield(L, -2, "serial");
+    lua_pushnumber(L, rec->replySerial);
+    lua_setfield(L, -2, "replySerial");
+    lua_pushnumber(L, rec->pathHash);
+    lua_setfield(L, -2, "path");
+    lua_pushnumber(L, rec->interfaceHash);
+    lua_setfield(L, -2, "interface");
+    lua_pushnumber(L, rec->memberHash);
+    lua_setfield(L, -2, "member");
+    lua_pushnumber(L, rec->nameHash);
+    lua_setfield(L, -2, "name");
+    lua_pushnumber(L, rec->signatureHash);
+    lua_setfield(L, -2, "signature");
+}
+
+
+/* Returns the number of records held and the index of the oldest one */
+static uint32_t
+l2dbus_traceRingCount
+    (
+    const l2dbus_TraceRing* ring,
+    uint32_t*               first
+    )
+{
+    uint32_t count;
+
+    if ( ring->total < ring->capacity )
+    {
+        count = (uint32_t)ring->total;
+        *first = 0;
+    }
+    else
+    {
+        count = ring->capacity;
+        *first = (uint32_t)(ring->total & (ring->capacity - 1));
+    }
+
+    return count;
+}
+
+
+/**
+ @function enable
+
+ Enables the trace ring.
+
+ Any records already in the ring are discarded.
+
+ @tparam ?number capacity The number of records to keep. It's rounded up
+ to a power of two and defaults to 4096.
+ @tparam ?number sampleRate Records one in every *sampleRate* messages.
+ Defaults to one (1), recording every message.
+ */
+static int
+l2dbus_traceRingEnable
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TraceRing* ring;
+    lua_Number reqCapacity;
+    lua_Number sampleRate;
+    uint32_t capacity = 1;
+
+    l2dbus_checkModuleInitialized(L);
+    reqCapacity = luaL_optnumber(L, 1, L2DBUS_TRACE_RING_DEFAULT_CAPACITY);
+    sampleRate = luaL_optnumber(L, 2, 1);
+    luaL_argcheck(L, (reqCapacity >= 1) && (reqCapacity <= 0x1000000), 1,
+                "capacity must be between 1 and 16777216");
+    luaL_argcheck(L, (sampleRate >= 1) && (sampleRate <= 0xFFFFFFFFU), 2,
+                "sample rate must be a positive number");
+
+    while ( capacity < (uint32_t)reqCapacity )
+    {
+        capacity <<= 1;
+    }
+
+    ring = l2dbus_traceRingCurrent();
+    l2dbus_traceRingFree(ring);
+    ring->records = (l2dbus_TraceRecord*)l2dbus_calloc(capacity,
+                                                    sizeof(*ring->records));
+    if ( NULL == ring->records )
+    {
+        return luaL_error(L, "Failed to allocate the trace ring");
+    }
+    ring->capacity = capacity;
+    ring->sampleRate = (uint32_t)sampleRate;
+
+    return 0;
+}
+
+
+/**
+ @function disable
+
+ Disables the trace ring and discards its records.
+ */
+static int
+l2dbus_traceRingDisable
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_checkModuleInitialized(L);
+    l2dbus_traceRingFree(l2dbus_traceRingCurrent());
+
+    return 0;
+}
+
+
+/**
+ @function isEnabled
+
+ Returns whether the trace ring is enabled.
+
+ @treturn bool **true** if the trace ring is enabled, **false** otherwise.
+ */
+static int
+l2dbus_traceRingIsEnabled
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_checkModuleInitialized(L);
+    lua_pushboolean(L, NULL != l2dbus_traceRingCurrent()->records);
+
+    return 1;
+}
+
+
+/**
+ @function setSampleRate
+
+ Sets the rate messages are sampled by an enabled trace ring.
+
+ @tparam number sampleRate Records one in every *sampleRate* messages.
+ */
+static int
+l2dbus_traceRingSetSampleRate
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TraceRing* ring;
+    lua_Number sampleRate;
+
+    l2dbus_checkModuleInitialized(L);
+    sampleRate = luaL_checknumber(L, 1);
+    luaL_argcheck(L, (sampleRate >= 1) && (sampleRate <= 0xFFFFFFFFU), 1,
+                "sample rate must be a positive number");
+
+    ring = l2dbus_traceRingCurrent();
+    ring->sampleRate = (uint32_t)sampleRate;
+    ring->sampleCount = 0;
+
+    return 0;
+}
+
+
+/**
+ @function clear
+
+ Discards the records of the trace ring without disabling it.
+ */
+static int
+l2dbus_traceRingClear
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TraceRing* ring;
+
+    l2dbus_checkModuleInitialized(L);
+    ring = l2dbus_traceRingCurrent();
+    ring->total = 0;
+    ring->sampleCount = 0;
+
+    return 0;
+}
+
+
+/**
+ @function getInfo
+
+ Returns information about the trace ring.
+
+ @treturn table A table with the fields *enabled* (bool), *capacity*,
+ *sampleRate*, *count* (the number of records held) and *total* (the number
+ of records ever written, including those that have been overwritten).
+ */
+static int
+l2dbus_traceRingGetInfo
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TraceRing* ring;
+    uint32_t first;
+
+    l2dbus_checkModuleInitialized(L);
+    ring = l2dbus_traceRingCurrent();
+
+    lua_createtable(L, 0, 5);
+    lua_pushboolean(L, NULL != ring->records);
+    lua_setfield(L, -2, "enabled");
+    lua_pushnumber(L, ring->capacity);
+    lua_setfield(L, -2, "capacity");
+    lua_pushnumber(L, ring->sampleRate);
+    lua_setfield(L, -2, "sampleRate");
+    lua_pushnumber(L, l2dbus_traceRingCount(ring, &first));
+    lua_setfield(L, -2, "count");
+    lua_pushnumber(L, (lua_Number)ring->total);
+    lua_setfield(L, -2, "total");
+
+    return 1;
+}
+
+
+/**
+ @function dump
+
+ Returns the records held by the trace ring.
+
+ @tparam ?bool clear If **true** the records are discarded after they're
+ returned. Defaults to **false**.
+ @treturn array An array of @{Record|records}, oldest first.
+ */
+static int
+l2dbus_traceRingDump
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TraceRing* ring;
+    uint32_t first;
+    uint32_t count;
+    uint32_t idx;
+
+    l2dbus_checkModuleInitialized(L);
+    ring = l2dbus_traceRingCurrent();
+    count = l2dbus_traceRingCount(ring, &first);
+
+    lua_createtable(L, (int)count, 0);
+    for ( idx = 0; idx < count; ++idx )
+    {
+        l2dbus_traceRingPushRecord(L,
+                    &ring->records[(first + idx) & (ring->capacity - 1)]);
+        lua_rawseti(L, -2, (int)idx + 1);
+    }
+
+    if ( lua_toboolean(L, 1) )
+    {
+        ring->total = 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ @function write
+
+ Writes the records held by the trace ring to a binary file.
+
+ The file starts with a header (see *l2dbus_TraceFileHeader* in
+ l2dbus_tracering.h) followed by the raw records, oldest first, in the
+ byte order of the writer. The file can be decoded with @{read}.
+
+ @tparam string filename The name of the file to write.
+ @treturn bool|nil **true** if the file was written, **nil** otherwise.
+ @treturn ?string An error message if the file was not written.
+ */
+static int
+l2dbus_traceRingWrite
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TraceRing* ring;
+    l2dbus_TraceFileHeader hdr;
+    const char* filename;
+    FILE* file;
+    uint32_t first;
+    uint32_t count;
+    uint32_t tail;
+    int ok;
+
+    l2dbus_checkModuleInitialized(L);
+    filename = luaL_checkstring(L, 1);
+    ring = l2dbus_traceRingCurrent();
+    count = l2dbus_traceRingCount(ring, &first);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, L2DBUS_TRACE_RING_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.byteOrder = L2DBUS_TRACE_RING_FILE_ORDER;
+    hdr.version = L2DBUS_TRACE_RING_FILE_VERSION;
+    hdr.recordSize = (uint16_t)sizeof(l2dbus_TraceRecord);
+    hdr.count = count;
+    hdr.sampleRate = ring->sampleRate;
+    hdr.total = ring->total;
+    hdr.realtimeOffset = l2dbus_traceRingClock(CLOCK_REALTIME) -
+                        l2dbus_traceRingClock(CLOCK_MONOTONIC);
+
+    file = fopen(filename, "wb");
+    if ( NULL == file )
+    {
+        lua_pushnil(L);
+        lua_pushfstring(L, "%s: %s", filename, strerror(errno));
+        return 2;
+    }
+
+    /* The records are written oldest first in at most two chunks */
+    tail = (count > 0) ? ring->capacity - first : 0;
+    if ( tail > count )
+    {
+        tail = count;
+    }
+    ok = (1 == fwrite(&hdr, sizeof(hdr), 1, file)) &&
+         (tail == fwrite(&ring->records[first], sizeof(l2dbus_TraceRecord),
+                        tail, file)) &&
+         ((count - tail) == fwrite(ring->records, sizeof(l2dbus_TraceRecord),
+                        count - tail, file));
+    ok = (0 == fclose(file)) && ok;
+
+    if ( !ok )
+    {
+        lua_pushnil(L);
+        lua_pushfstring(L, "%s: failed to write trace records", filename);
+        return 2;
+    }
+
+    lua_pushboolean(L, L2DBUS_TRUE);
+    return 1;
+}
+
+
+static uint16_t
+l2dbus_traceRingSwap16
+    (
+    uint16_t    v
+    )
+{
+    return (uint16_t)((v >> 8) | (v << 8));
+}
+
+
+static uint32_t
+l2dbus_traceRingSwap32
+    (
+    uint32_t    v
+    )
+{
+    return ((v >> 24) & 0xFFU) | ((v >> 8) & 0xFF00U) |
+            ((v << 8) & 0xFF0000U) | (v << 24);
+}
+
+
+static uint64_t
+l2dbus_traceRingSwap64
+    (
+    uint64_t    v
+    )
+{
+    return ((uint64_t)l2dbus_traceRingSwap32((uint32_t)v) << 32) |
+            l2dbus_traceRingSwap32((uint32_t)(v >> 32));
+}
+
+
+static void
+l2dbus_traceRingSwapRecord
+    (
+    l2dbus_TraceRecord* rec
+    )
+{
+    rec->timestamp = l2dbus_traceRingSwap64(rec->timestamp);
+    rec->serial = l2dbus_traceRingSwap32(rec->serial);
+    rec->replySerial = l2dbus_traceRingSwap32(rec->replySerial);
+    rec->pathHash = l2dbus_traceRingSwap32(rec->pathHash);
+    rec->interfaceHash = l2dbus_traceRingSwap32(rec->interfaceHash);
+    rec->memberHash = l2dbus_traceRingSwap32(rec->memberHash);
+    rec->nameHash = l2dbus_traceRingSwap32(rec->nameHash);
+    rec->signatureHash = l2dbus_traceRingSwap32(rec->signatureHash);
+    rec->connId = l2dbus_traceRingSwap16(rec->connId);
+}
+
+
+/**
+ @function read
+
+ Reads the records of a file written by @{write}.
+
+ Files written by a host with a different byte order are converted.
+
+ @tparam string filename The name of the file to read.
+ @treturn table|nil A table with the fields *sampleRate*, *total* and
+ *realtimeOffset* (the number of seconds to add to the time of a record to
+ get the wall clock time) of the writer and *records*, an array of
+ @{Record|records}, oldest first. Returns **nil** on failure.
+ @treturn ?string An error message if the file could not be read.
+ */
+static int
+l2dbus_traceRingRead
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_TraceFileHeader hdr;
+    l2dbus_TraceRecord rec;
+    const char* filename;
+    const char* errMsg = NULL;
+    FILE* file;
+    l2dbus_Bool swap = L2DBUS_FALSE;
+    uint32_t idx;
+
+    l2dbus_checkModuleInitialized(L);
+    filename = luaL_checkstring(L, 1);
+
+    file = fopen(filename, "rb");
+    if ( NULL == file )
+    {
+        lua_pushnil(L);
+        lua_pushfstring(L, "%s: %s", filename, strerror(errno));
+        return 2;
+    }
+
+    if ( (1 != fread(&hdr, sizeof(hdr), 1, file)) ||
+        (0 != memcmp(hdr.magic, L2DBUS_TRACE_RING_FILE_MAGIC,
+                    sizeof(hdr.magic))) )
+    {
+        errMsg = "not a trace ring file";
+    }
+    else
+    {
+        if ( L2DBUS_TRACE_RING_FILE_ORDER != hdr.byteOrder )
+        {
+            swap = L2DBUS_TRUE;
+            hdr.version = l2dbus_traceRingSwap16(hdr.version);
+            hdr.recordSize = l2dbus_traceRingSwap16(hdr.recordSize);
+            hdr.count = l2dbus_traceRingSwap32(hdr.count);
+            hdr.sampleRate = l2dbus_traceRingSwap32(hdr.sampleRate);
+            hdr.total = l2dbus_traceRingSwap64(hdr.total);
+            hdr.realtimeOffset = (int64_t)l2dbus_traceRingSwap64(
+                                            (uint64_t)hdr.realtimeOffset);
+        }
+
+        if ( (L2DBUS_TRACE_RING_FILE_VERSION != hdr.version) ||
+            (sizeof(rec) != hdr.recordSize) )
+        {
+            errMsg = "unsupported trace ring file version";
+        }
+    }
+
+    if ( NULL == errMsg )
+    {
+        lua_createtable(L, 0, 4);
+        lua_pushnumber(L, hdr.sampleRate);
+        lua_setfield(L, -2, "sampleRate");
+        lua_pushnumber(L, (lua_Number)hdr.total);
+        lua_setfield(L, -2, "total");
+        lua_pushnumber(L, (lua_Number)hdr.realtimeOffset /
+                        (lua_Number)L2DBUS_TRACE_RING_NSECS_PER_SEC);
+        lua_setfield(L, -2, "realtimeOffset");
+
+        lua_createtable(L, (int)hdr.count, 0);
+        for ( idx = 0; (NULL == errMsg) && (idx < hdr.count); ++idx )
+        {
+            if ( 1 != fread(&rec, sizeof(rec), 1, file) )
+            {
+                errMsg = "truncated trace ring file";
+            }
+            else
+            {
+                if ( swap )
+                {
+                    l2dbus_traceRingSwapRecord(&rec);
+                }
+                l2dbus_traceRingPushRecord(L, &rec);
+                lua_rawseti(L, -2, (int)idx + 1);
+            }
+        }
+        lua_setfield(L, -2, "records");
+    }
+    fclose(file);
+
+    if ( NULL != errMsg )
+    {
+        lua_pushnil(L);
+        lua_pushfstring(L, "%s: %s", filename, errMsg);
+        return 2;
+    }
+
+    return 1;
+}
+
+
+/**
+ @function hash
+
+ Returns the hash of a name as stored in a @{Record}.
+
+ @tparam string name The name (e.g. an interface or member name).
+ @treturn number The hash of the name.
+ */
+static int
+l2dbus_traceRingHashName
+    (
+    lua_State*  L
+    )
+{
+    lua_pushnumber(L, l2dbus_traceRingHash(luaL_checkstring(L, 1)));
+
+    return 1;
+}
+
+
+/**
+ * @brief Creates the TraceRing sub-module.
+ *
+ * This function simulates opening the TraceRing sub-module.
+ *
+ * @return A table defining the TraceRing sub-module.
+ */
+void
+l2dbus_openTraceRing
+    (
+    lua_State*  L
+    )
+{
+    lua_createtable(L, 0, 12);
+    lua_pushcfunction(L, l2dbus_traceRingEnable);
+    lua_setfield(L, -2, "enable");
+    lua_pushcfunction(L, l2dbus_traceRingDisable);
+    lua_setfield(L, -2, "disable");
+    lua_pushcfunction(L, l2dbus_traceRingIsEnabled);
+    lua_setfield(L, -2, "isEnabled");
+    lua_pushcfunction(L, l2dbus_traceRingSetSampleRate);
+    lua_setfield(L, -2, "setSampleRate");
+    lua_pushcfunction(L, l2dbus_traceRingClear);
+    lua_setfield(L, -2, "clear");
+    lua_pushcfunction(L, l2dbus_traceRingGetInfo);
+    lua_setfield(L, -2, "getInfo");
+    lua_pushcfunction(L, l2dbus_traceRingDump);
+    lua_setfield(L, -2, "dump");
+    lua_pushcfunction(L, l2dbus_traceRingWrite);
+    lua_setfield(L, -2, "write");
+    lua_pushcfunction(L, l2dbus_traceRingRead);
+    lua_setfield(L, -2, "read");
+    lua_pushcfunction(L, l2dbus_traceRingHashName);
+    lua_setfield(L, -2, "hash");
+
+/**
+ @constant RECEIVED
+ The @{Record} direction of a received message.
+ */
+    lua_pushinteger(L, L2DBUS_TRACE_RING_RECEIVED);
+    lua_setfield(L, -2, "RECEIVED");
+
+/**
+ @constant SENT
+ The @{Record} direction of a sent message.
+ */
+    lua_pushinteger(L, L2DBUS_TRACE_RING_SENT);
+    lua_setfield(L, -2, "SENT");
+}
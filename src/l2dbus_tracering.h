@@ -0,0 +1,124 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_tracering.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the sampling message trace ring.
+ *===========================================================================
+ */
+#ifndef L2DBUS_TRACERING_H_
+#define L2DBUS_TRACERING_H_
+
+#include <stdint.h>
+#include "lua.h"
+#include "dbus/dbus.h"
+#include "l2dbus_types.h"
+
+/* Forward declarations */
+struct l2dbus_Connection;
+
+/* The direction of a traced message */
+#define L2DBUS_TRACE_RING_RECEIVED  (0)
+#define L2DBUS_TRACE_RING_SENT      (1)
+
+/* Capacity (in records) of the ring if none is given when it's enabled */
+#define L2DBUS_TRACE_RING_DEFAULT_CAPACITY  (4096)
+
+/* The header of a trace ring dump file */
+#define L2DBUS_TRACE_RING_FILE_MAGIC    "L2DBTRC"
+#define L2DBUS_TRACE_RING_FILE_VERSION  (1)
+#define L2DBUS_TRACE_RING_FILE_ORDER    (0x01020304U)
+
+/*
+ * A fixed size record describing a single traced message. String header
+ * fields are stored as (32-bit FNV-1a) hashes so recording a message never
+ * copies or allocates. The record is written to dump files as-is so its
+ * layout must not change without bumping the file version.
+ */
+typedef struct l2dbus_TraceRecord
+{
+    /* CLOCK_MONOTONIC time (in nanoseconds) the message was traced */
+    uint64_t        timestamp;
+    uint32_t        serial;
+    uint32_t        replySerial;
+    uint32_t        pathHash;
+    uint32_t        interfaceHash;
+    uint32_t        memberHash;
+    /* Hash of the error name (errors) or destination (everything else) */
+    uint32_t        nameHash;
+    uint32_t        signatureHash;
+    /* Identifies the connection within the Lua state */
+    uint16_t        connId;
+    uint8_t         msgType;
+    uint8_t         direction;
+} l2dbus_TraceRecord;
+
+/*
+ * The header at the start of a dump file. It's followed by *count* records
+ * of *recordSize* bytes each, oldest first, in the byte order of the host
+ * that wrote the file (identified by *byteOrder*).
+ */
+typedef struct l2dbus_TraceFileHeader
+{
+    char            magic[8];
+    uint32_t        byteOrder;
+    uint16_t        version;
+    uint16_t        recordSize;
+    uint32_t        count;
+    uint32_t        sampleRate;
+    /* The number of records written (older ones may be overwritten) */
+    uint64_t        total;
+    /* CLOCK_REALTIME minus CLOCK_MONOTONIC (in nanoseconds) at dump time */
+    int64_t         realtimeOffset;
+} l2dbus_TraceFileHeader;
+
+/*
+ * The per Lua state trace ring. There is a single writer (the thread
+ * running the Lua state) so the ring needs no locking: the write position
+ * only ever increases and the oldest records are overwritten once the ring
+ * has wrapped.
+ */
+typedef struct l2dbus_TraceRing
+{
+    l2dbus_TraceRecord* records;
+    /* Always a power of two so the position can be masked */
+    uint32_t            capacity;
+    uint32_t            sampleRate;
+    uint32_t            sampleCount;
+    /* The number of records ever written */
+    uint64_t            total;
+    /* The last connection identifier handed out */
+    uint16_t            lastConnId;
+} l2dbus_TraceRing;
+
+void l2dbus_traceRingFree(l2dbus_TraceRing* ring);
+uint16_t l2dbus_traceRingNextConnId(void);
+void l2dbus_traceRingRecord(struct l2dbus_Connection* connUd,
+                            DBusMessage* msg, unsigned direction);
+void l2dbus_openTraceRing(lua_State* L);
+
+#endif /* Guard for L2DBUS_TRACERING_H_ */
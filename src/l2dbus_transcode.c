@@ -28,6 +28,9 @@
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#include <errno.h>
+#include <ctype.h>
+#include <stdio.h>
 #include <float.h>
 #include <luaconf.h>
 #include "cdbus/cdbus.h"
@@ -37,11 +40,18 @@
 #include "l2dbus_object.h"
 #include "l2dbus_int64.h"
 #include "l2dbus_uint64.h"
+#include "l2dbus_rawvariant.h"
+#include "l2dbus_message.h"
+#include "l2dbus_buffer.h"
 #include "l2dbus_util.h"
 #include "l2dbus_defs.h"
 #include "l2dbus_trace.h"
 #include "l2dbus_debug.h"
 #include "l2dbus_alloc.h"
+#include "l2dbus_sigplan.h"
+#include "l2dbus_shape.h"
+#include "l2dbus_stats.h"
+#include "l2dbus_dbuscompat.h"
 
 /**
  The L2DBUS DbusTypes module.
@@ -56,9 +66,6 @@
  @namespace l2dbus.DbusTypes
  */
 
-
-#define L2DBUS_DEFAULT_SIGNATURE_LENGTH (32)
-
 #ifdef LUA_NUMBER_DOUBLE
 #define L2DBUS_LUA_MANTISSA_DIG (DBL_MANT_DIG)
 #elif defined(LUA_NUMBER_FLOAT)
@@ -77,9 +84,6 @@
 /*
  * Forward prototypes
  */
-static l2dbus_Bool l2dbus_dbusIsTableArray(lua_State* L, int idx);
-static l2dbus_Bool l2dbus_dbusIsTableDictionary(lua_State* L, int idx);
-static l2dbus_Bool l2dbus_dbusIsTableStructure(lua_State* L, int idx);
 static int l2dbus_transcodeMapLuaToDbusType(lua_State* L, int idx);
 static void l2dbus_transcodeMarshallAsType(lua_State* L, int argIdx,
                                 DBusMessageIter* msgIt, DBusSignatureIter* sigIt);
@@ -192,10 +196,13 @@ l2dbus_dbusGetCachedSignature
     const char* signature = NULL;
     argIdx = lua_absindex(L, argIdx);
     l2dbus_DbusValue* ud;
+    l2dbus_TypeId typeId = l2dbus_getMetaTypeId(L, argIdx);
 
-    ud = l2dbus_isUserData(L, argIdx, l2dbus_getTypeName(L, argIdx));
-    if ( NULL != ud )
+    /* Only the D-Bus wrapper types carry a signature */
+    if ( (L2DBUS_START_DBUS_TYPE_ID < typeId) &&
+        (L2DBUS_END_DBUS_TYPE_ID > typeId) )
     {
+        ud = (l2dbus_DbusValue*)lua_touserdata(L, argIdx);
         signature = ud->signature;
     }
 
@@ -276,7 +283,7 @@ l2dbus_dbusAttachValue
  * @return Return true if the referenced object is a valid D-Bus userdata
  * object, false otherwise.
  */
-static l2dbus_Bool
+l2dbus_Bool
 l2dbus_dbusQueryDbusTypeId
     (
     lua_State*  L,
@@ -354,9 +361,16 @@ l2dbus_transcodeGetValue
 {
     int typeId = DBUS_TYPE_INVALID;
     l2dbus_DbusValue* ud;
+    l2dbus_RawVariant* rawUd;
     idx = lua_absindex(L, idx);
 
-    if ( l2dbus_dbusQueryDbusTypeId(L, idx, &typeId) )
+    /* A raw variant stands for its (decoded) value */
+    if ( NULL != (rawUd = (l2dbus_RawVariant*)l2dbus_isUserData(L, idx,
+                                            L2DBUS_RAW_VARIANT_TYPE_ID)) )
+    {
+        l2dbus_rawVariantPushValue(L, rawUd);
+    }
+    else if ( l2dbus_dbusQueryDbusTypeId(L, idx, &typeId) )
     {
         ud = lua_touserdata(L, idx);
         lua_getuservalue(L, idx);
@@ -408,6 +422,9 @@ l2dbus_dbusComputeSignature
     const char* sigStr = NULL;
     const char* cachedSig = NULL;
     l2dbus_Bool isValid = L2DBUS_TRUE;
+    l2dbus_Bool isTable;
+    l2dbus_Bool isKnown;
+    size_t sigStart = 0;
 
     /* Reset to the absolute index */
     argIdx = lua_absindex(L, argIdx);
@@ -425,7 +442,17 @@ l2dbus_dbusComputeSignature
     }
     else
     {
-        dbusTypeId = l2dbus_transcodeMapLuaToDbusType(L, argIdx);
+        /* The signature of a (plain) table may already be known */
+        isTable = (LUA_TTABLE == lua_type(L, argIdx));
+        if ( isTable )
+        {
+            sigStart = cdbus_stringBufferLength(sigBuf);
+            sigStr = l2dbus_shapeGetSignature(L, argIdx);
+        }
+        isKnown = (NULL != sigStr);
+
+        dbusTypeId = isKnown ? DBUS_TYPE_INVALID :
+                            l2dbus_transcodeMapLuaToDbusType(L, argIdx);
 
         switch ( dbusTypeId )
         {
@@ -478,6 +505,12 @@ l2dbus_dbusComputeSignature
                 break;
 
             case DBUS_TYPE_ARRAY:
+                /* A Buffer is always a byte array */
+                if ( L2DBUS_BUFFER_TYPE_ID == l2dbus_getMetaTypeId(L, argIdx) )
+                {
+                    sigStr = DBUS_TYPE_ARRAY_AS_STRING DBUS_TYPE_BYTE_AS_STRING;
+                    break;
+                }
                 cachedSig = l2dbus_dbusGetCachedSignature(L, argIdx);
                 if ( NULL != cachedSig )
                 {
@@ -579,6 +612,12 @@ l2dbus_dbusComputeSignature
                 break;
 
             case DBUS_TYPE_VARIANT:
+                /* A raw variant is marshalled as is */
+                if ( L2DBUS_RAW_VARIANT_TYPE_ID == l2dbus_getMetaTypeId(L, argIdx) )
+                {
+                    sigStr = DBUS_TYPE_VARIANT_AS_STRING;
+                    break;
+                }
                 cachedSig = l2dbus_dbusGetCachedSignature(L, argIdx);
                 if ( NULL != cachedSig )
                 {
@@ -689,7 +728,8 @@ l2dbus_dbusComputeSignature
                 break;
 
             default:
-                isValid = L2DBUS_FALSE;
+                /* Unless the signature of the table is already known */
+                isValid = isKnown;
                 break;
         }
 
@@ -701,6 +741,14 @@ l2dbus_dbusComputeSignature
                 isValid = L2DBUS_FALSE;
             }
         }
+
+        /* Remember the signature of the table for when it's marshalled */
+        if ( isValid && isTable && !isKnown )
+        {
+            l2dbus_shapeSetSignature(L, argIdx,
+                                cdbus_stringBufferRaw(sigBuf) + sigStart,
+                                cdbus_stringBufferLength(sigBuf) - sigStart);
+        }
     }
 
     lua_settop(L, origTop);
@@ -784,459 +832,6 @@ l2dbus_dbusToString
 }
 
 
-/**
- * @brief Tests to see if a Lua table can be converted to a D-Bus dictionary.
- *
- * This function is used to determine whether a Lua table can be encoded as
- * a D-Bus dictionary (e.g. an array of dictionary entries). A D-Bus dictionary
- * is the least restrictive data structure that D-Bus permits.
- *
- * @param [in]      L       The Lua state.
- * @param [in]      idx     Index on the Lua stack where the Lua table is
- * located.
- *
- * @return Returns true if the table could be converted to a D-Bus dictionary,
- * otherwise false.
- */
-static l2dbus_Bool
-l2dbus_dbusIsTableDictionary
-    (
-    lua_State*  L,
-    int         idx
-    )
-{
-    int tableIdx = lua_absindex(L, idx);
-    l2dbus_Bool isDict = L2DBUS_FALSE;
-    int luaType = LUA_TNONE;
-    int dbusType = DBUS_TYPE_INVALID;
-    l2dbus_TypeId metaTypeId = L2DBUS_INVALID_TYPE_ID;
-
-    if ( LUA_TTABLE == lua_type(L, tableIdx) )
-    {
-        /* Now we'll assume this is a dictionary */
-        isDict = L2DBUS_TRUE;
-
-        lua_pushnil(L);
-        while ( lua_next(L, tableIdx) )
-        {
-            /* First make sure the key is a basic D-Bus compatible
-             * type.
-             */
-            luaType = lua_type(L, -2);
-            switch ( luaType )
-            {
-                case LUA_TNUMBER:
-                case LUA_TBOOLEAN:
-                case LUA_TSTRING:
-                    break;
-
-                case LUA_TUSERDATA:
-                    metaTypeId = l2dbus_getMetaTypeId(L, -2);
-                    if ( !l2dbus_dbusQueryDbusTypeId(L, -2, &dbusType) )
-                    {
-                        if ( (L2DBUS_INT64_TYPE_ID != metaTypeId) &&
-                            (L2DBUS_UINT64_TYPE_ID != metaTypeId) )
-                        {
-                            isDict = L2DBUS_FALSE;
-                        }
-                    }
-                    else
-                    {
-                        /* Only *basic* D-Bus types are acceptable
-                         * to be used as keys in a dictionary.
-                         */
-                        if ( !dbus_type_is_basic(dbusType) )
-                        {
-                            isDict = L2DBUS_FALSE;
-                        }
-                    }
-                    break;
-
-                default:
-                    isDict = L2DBUS_FALSE;
-                    break;
-            }
-
-            /* If the key checks out then check the "value" */
-            if ( isDict )
-            {
-                /* We need to make sure the values are valid D-Bus types. */
-                luaType = lua_type(L, -1);
-                switch ( luaType )
-                {
-                    case LUA_TNUMBER:
-                    case LUA_TBOOLEAN:
-                    case LUA_TSTRING:
-                        break;
-
-                    case LUA_TTABLE:
-                        /* A Lua table can either be mapped to a D-Bus
-                         * dictionary, structure, or array. Since the criteria
-                         * for a D-Bus dictionary is the loosest representation
-                         * and if it can be represented as a D-Bus dictionary
-                         * then a sufficient mapping exists. It would be
-                         * redundant to verify that it can be mapped to other
-                         * types.
-                         */
-                        if ( !l2dbus_dbusIsTableDictionary(L, -1) )
-                        {
-                            isDict = L2DBUS_FALSE;
-                        }
-                        break;
-
-                    case LUA_TUSERDATA:
-                        metaTypeId = l2dbus_getMetaTypeId(L, -1);
-                        /* Make sure it's l2dbus userdata */
-                        if ( NULL == l2dbus_isUserData(L, -1,
-                            l2dbus_getNameByTypeId(metaTypeId)) )
-                        {
-                            isDict = L2DBUS_FALSE;
-                        }
-
-                        /* Now make sure it's a type of L2DBUS userdata
-                         * that can be sent over D-Bus
-                         */
-                        if ( !(
-                            (L2DBUS_INT64_TYPE_ID == metaTypeId) ||
-                            (L2DBUS_UINT64_TYPE_ID == metaTypeId) ||
-                            ((L2DBUS_START_DBUS_TYPE_ID < metaTypeId) &&
-                             (L2DBUS_END_DBUS_TYPE_ID > metaTypeId) &&
-                             (L2DBUS_DBUS_INVALID_TYPE_ID != metaTypeId))
-                             ) )
-                        {
-                            isDict = L2DBUS_FALSE;
-                        }
-                        break;
-
-                    default:
-                        isDict = L2DBUS_FALSE;
-                        break;
-                }
-            }
-
-            if ( !isDict )
-            {
-                /* Pop the key/value pair */
-                lua_pop(L, 2);
-                break;
-            }
-            else
-            {
-                /* Get ready for the next go-around */
-                lua_pop(L, 1);
-            }
-        }
-    }
-
-    return isDict;
-}
-
-
-/**
- * @brief Tests to see if a Lua table can be converted to a D-Bus array.
- *
- * This function is used to determine whether a Lua table can be encoded as
- * a D-Bus array. A D-Bus array requires the Lua table to have consecutively
- * number elements (no holes) all of the same homogeneous type.
- *
- * @param [in]      L       The Lua state.
- * @param [in]      idx     Index on the Lua stack where the Lua table is
- * located.
- *
- * @return Returns true if the table could be converted to a D-Bus array,
- * otherwise false.
- */
-static l2dbus_Bool
-l2dbus_dbusIsTableArray
-    (
-    lua_State*  L,
-    int         idx
-    )
-{
-    size_t itemCnt = 0;
-    int tableIdx = lua_absindex(L, idx);
-    l2dbus_Bool isArray = L2DBUS_FALSE;
-    int luaType = LUA_TNONE;
-    l2dbus_TypeId metaTypeId = L2DBUS_INVALID_TYPE_ID;
-    l2dbus_TypeId curMetaTypeId = L2DBUS_INVALID_TYPE_ID;
-
-    if ( LUA_TTABLE == lua_type(L, tableIdx) )
-    {
-        /* Now we'll assume this is a valid array */
-        isArray = L2DBUS_TRUE;
-
-        lua_pushnil(L);
-        while ( lua_next(L, tableIdx) )
-        {
-            /* First make sure the key is a number
-             */
-            if ( !lua_isnumber(L, -2) )
-            {
-                lua_pop(L, 2);
-                isArray = L2DBUS_FALSE;
-                break;
-            }
-
-            /* Count the number of items in the array */
-            ++itemCnt;
-
-            /* Now verify the value is a supported type and
-             * the array contains homogeneous values since
-             * D-Bus does *not* support a non-homogeneous mixture.
-             */
-
-            /* If this is the first element */
-            if ( LUA_TNONE == luaType )
-            {
-                luaType = lua_type(L, -1);
-            }
-
-
-            /* The current type must be the same as the last type */
-            if ( luaType != lua_type(L, -1) )
-            {
-                lua_pop(L, 2);
-                isArray = L2DBUS_FALSE;
-                break;
-            }
-
-            /* We need to scrutinize some Lua types more than
-             * others.
-             */
-            switch ( luaType )
-            {
-                case LUA_TNUMBER:
-                case LUA_TBOOLEAN:
-                case LUA_TSTRING:
-                    break;
-
-                case LUA_TTABLE:
-                    /* A Lua table can either be mapped to a D-Bus dictionary,
-                     * structure, or array. Since the criteria for a D-Bus dictionary
-                     * is the loosest representation and if it can be represented as
-                     * a D-Bus dictionary then a sufficient mapping exists. It
-                     * would be redundant to verify that it can be mapped to
-                     * other types.
-                     */
-                    if ( !l2dbus_dbusIsTableDictionary(L, -1)  )
-                    {
-                        isArray = L2DBUS_FALSE;
-                    }
-                    break;
-
-                case LUA_TUSERDATA:
-                    /* Get the string name of the userdata if it
-                     * hasn't been found yet
-                     */
-                    if ( L2DBUS_INVALID_TYPE_ID == metaTypeId )
-                    {
-                        metaTypeId = l2dbus_getMetaTypeId(L, -1);
-
-                        /* Make sure it's l2dbus userdata */
-                        if ( NULL == l2dbus_isUserData(L, -1,
-                            l2dbus_getNameByTypeId(metaTypeId)) )
-                        {
-                            isArray = L2DBUS_FALSE;
-                        }
-
-                        /* Now make sure it's a type of L2DBUS userdata
-                         * that can be sent over D-Bus
-                         */
-                        if ( !(
-                            (L2DBUS_INT64_TYPE_ID == metaTypeId) ||
-                            (L2DBUS_UINT64_TYPE_ID == metaTypeId) ||
-                            ((L2DBUS_START_DBUS_TYPE_ID < metaTypeId) &&
-                             (L2DBUS_END_DBUS_TYPE_ID > metaTypeId) &&
-                             (L2DBUS_DBUS_INVALID_TYPE_ID != metaTypeId))
-                             ) )
-                        {
-                            isArray = L2DBUS_FALSE;
-                        }
-                    }
-
-                    if ( isArray )
-                    {
-                        /* Now get the "current" userdata type name */
-                        curMetaTypeId = l2dbus_getMetaTypeId(L, -1);
-                        /* If the userdata types don't match then this
-                         * isn't a valid homogeneous D-Bus array
-                         */
-                        if ( metaTypeId != curMetaTypeId )
-                        {
-                            isArray = L2DBUS_FALSE;
-                        }
-                    }
-                    break;
-
-                default:
-                    isArray = L2DBUS_FALSE;
-                    break;
-            }
-
-            if ( !isArray )
-            {
-                /* Pop the key/value pair */
-                lua_pop(L, 2);
-                break;
-            }
-            else
-            {
-                /* Get ready for the next go-around */
-                lua_pop(L, 1);
-            }
-        }
-
-        /* If this is an array then the number of elements that
-         * Lua reports in the array should match what we've
-         * counted.
-         */
-        if ( isArray && (itemCnt != lua_rawlen(L, tableIdx)) )
-        {
-            /* The number of items we counted
-             * better equal the number the table reports.
-             */
-            isArray = L2DBUS_FALSE;
-        }
-    }
-
-    return isArray;
-}
-
-
-/**
- * @brief Tests to see if a Lua table can be converted to a D-Bus structure.
- *
- * This function is used to determine whether a Lua table can be encoded as
- * a D-Bus structure. A D-Bus structure has the same requirements as a D-Bus
- * array with the exception that the types do not need to be of the same
- * homogeneous type.
- *
- * @param [in]      L       The Lua state.
- * @param [in]      idx     Index on the Lua stack where the Lua table is
- * located.
- *
- * @return Returns true if the table could be converted to a D-Bus structure,
- * otherwise false.
- */
-static l2dbus_Bool
-l2dbus_dbusIsTableStructure
-    (
-    lua_State*  L,
-    int         idx
-    )
-{
-    size_t itemCnt = 0;
-    int tableIdx = lua_absindex(L, idx);
-    l2dbus_Bool isStruct = L2DBUS_FALSE;
-    int luaType = LUA_TNONE;
-    l2dbus_TypeId metaTypeId = L2DBUS_INVALID_TYPE_ID;
-
-    if ( LUA_TTABLE == lua_type(L, tableIdx) )
-    {
-        /* Now we'll assume this is a valid structure */
-        isStruct = L2DBUS_TRUE;
-
-        lua_pushnil(L);
-        while ( lua_next(L, tableIdx) )
-        {
-            /* First make sure the key is a number*/
-            if ( !lua_isnumber(L, -2) )
-            {
-                lua_pop(L, 2);
-                isStruct = L2DBUS_FALSE;
-                break;
-            }
-            /* Keep track of the number of items
-             * in the array.
-             */
-            ++itemCnt;
-
-            /* Now verify the value is a type that can
-             * be marshalled over D-Bus
-             */
-
-
-            /* We need to scrutinize some Lua types more than
-             * others.
-             */
-            luaType = lua_type(L, -1);
-            switch ( luaType )
-            {
-                case LUA_TNUMBER:
-                case LUA_TBOOLEAN:
-                case LUA_TSTRING:
-                    break;
-
-                case LUA_TTABLE:
-                    /* A Lua table can either be mapped to a D-Bus dictionary,
-                     * structure, or array. Since the criteria for a D-Bus dictionary
-                     * is the loosest representation and if it can be represented as
-                     * a D-Bus dictionary then a sufficient mapping exists. It
-                     * would be redundant too verify that it can be mapped to
-                     * other types.
-                     */
-                    if ( !l2dbus_dbusIsTableDictionary(L, -1)  )
-                    {
-                        isStruct= L2DBUS_FALSE;
-                    }
-                    break;
-
-                case LUA_TUSERDATA:
-                    metaTypeId = l2dbus_getMetaTypeId(L, -1);
-
-                    /* Make sure it's l2dbus userdata */
-                    if ( NULL == l2dbus_isUserData(L, -1,
-                        l2dbus_getNameByTypeId(metaTypeId)) )
-                    {
-                        isStruct = L2DBUS_FALSE;
-                    }
-
-                    /* Now make sure it's a type of L2DBUS userdata
-                     * that can be sent over D-Bus
-                     */
-                    if ( !(
-                        (L2DBUS_INT64_TYPE_ID == metaTypeId) ||
-                        (L2DBUS_UINT64_TYPE_ID == metaTypeId) ||
-                        ((L2DBUS_START_DBUS_TYPE_ID < metaTypeId) &&
-                         (L2DBUS_END_DBUS_TYPE_ID > metaTypeId) &&
-                         (L2DBUS_DBUS_INVALID_TYPE_ID != metaTypeId))
-                         ) )
-                    {
-                        isStruct = L2DBUS_FALSE;
-                    }
-                    break;
-
-                default:
-                    isStruct = L2DBUS_FALSE;
-                    break;
-            }
-
-            if ( !isStruct )
-            {
-                /* Pop the key/value pair */
-                lua_pop(L, 2);
-                break;
-            }
-            else
-            {
-                /* Get ready for the next go-around */
-                lua_pop(L, 1);
-            }
-        }
-
-        if ( isStruct && (itemCnt != lua_rawlen(L, tableIdx)) )
-        {
-            /* The number of items we counted
-             * better equal the number the table reports.
-             */
-            isStruct = L2DBUS_FALSE;
-        }
-    }
-
-    return isStruct;
-}
-
-
 /**
  * @brief Called by Lua VM to GC/reclaim the wrappted D-Bus userdata objects.
  *
@@ -2029,8 +1624,8 @@ l2dbus_dbusNewArray
 {
     l2dbus_DbusValue* ud;
     const char* signature;
-    luaL_argcheck(L, l2dbus_dbusIsTableArray(L, 1), 1,
-                "cannot convert argument to D-Bus array");
+    luaL_argcheck(L, 0 != (L2DBUS_SHAPE_ARRAY & l2dbus_shapeOfTable(L, 1)),
+                1, "cannot convert argument to D-Bus array");
     signature = luaL_optstring(L, 2, NULL);
 
     ud = l2dbus_dbusNewUserdata(L, L2DBUS_DBUS_ARRAY_TYPE_ID, signature);
@@ -2092,8 +1687,8 @@ l2dbus_dbusNewDictionary
 {
     l2dbus_DbusValue* ud;
     const char* signature;
-    luaL_argcheck(L, l2dbus_dbusIsTableDictionary(L, 1), 1,
-                "cannot convert argument to D-Bus dictionary");
+    luaL_argcheck(L, 0 != (L2DBUS_SHAPE_DICT & l2dbus_shapeOfTable(L, 1)),
+                1, "cannot convert argument to D-Bus dictionary");
     signature = luaL_optstring(L, 2, NULL);
 
     ud = l2dbus_dbusNewUserdata(L, L2DBUS_DBUS_DICT_ENTRY_TYPE_ID, signature);
@@ -2156,8 +1751,8 @@ l2dbus_dbusNewStructure
 {
     l2dbus_DbusValue* ud;
     const char* signature;
-    luaL_argcheck(L, l2dbus_dbusIsTableStructure(L, 1), 1,
-                "cannot convert argument to D-Bus structure");
+    luaL_argcheck(L, 0 != (L2DBUS_SHAPE_STRUCT & l2dbus_shapeOfTable(L, 1)),
+                1, "cannot convert argument to D-Bus structure");
     signature = luaL_optstring(L, 2, NULL);
 
     ud = l2dbus_dbusNewUserdata(L, L2DBUS_DBUS_STRUCT_TYPE_ID, signature);
@@ -2241,7 +1836,7 @@ l2dbus_dbusNewVariant
              * would be redundant too verify that it can be mapped to
              * other types.
              */
-            if ( !l2dbus_dbusIsTableDictionary(L, 1)  )
+            if ( 0 == (L2DBUS_SHAPE_DICT & l2dbus_shapeOfTable(L, 1)) )
             {
                 isValid= L2DBUS_FALSE;
             }
@@ -2251,8 +1846,7 @@ l2dbus_dbusNewVariant
             metaTypeId = l2dbus_getMetaTypeId(L, 1);
 
             /* Make sure it's l2dbus userdata */
-            if ( NULL == l2dbus_isUserData(L, 1,
-                l2dbus_getNameByTypeId(metaTypeId)) )
+            if ( NULL == l2dbus_isUserData(L, 1, metaTypeId) )
             {
                 isValid = L2DBUS_FALSE;
             }
@@ -2486,6 +2080,7 @@ l2dbus_transcodeMapLuaToDbusType
 {
     int dbusType = DBUS_TYPE_INVALID;
     l2dbus_TypeId metaTypeId;
+    unsigned shape;
 
     switch ( lua_type(L, idx) )
     {
@@ -2503,15 +2098,16 @@ l2dbus_transcodeMapLuaToDbusType
 
         case LUA_TTABLE:
             /* Check from the most restrictive to the least */
-            if ( l2dbus_dbusIsTableArray(L, idx) )
+            shape = l2dbus_shapeOfTable(L, idx);
+            if ( 0 != (L2DBUS_SHAPE_ARRAY & shape) )
             {
                 dbusType = DBUS_TYPE_ARRAY;
             }
-            else if ( l2dbus_dbusIsTableStructure(L, idx) )
+            else if ( 0 != (L2DBUS_SHAPE_STRUCT & shape) )
             {
                 dbusType = DBUS_TYPE_STRUCT;
             }
-            else if ( l2dbus_dbusIsTableDictionary(L, idx) )
+            else if ( 0 != (L2DBUS_SHAPE_DICT & shape) )
             {
                 dbusType = DBUS_TYPE_DICT_ENTRY;
             }
@@ -2527,6 +2123,14 @@ l2dbus_transcodeMapLuaToDbusType
             {
                 dbusType = DBUS_TYPE_UINT64;
             }
+            else if ( L2DBUS_RAW_VARIANT_TYPE_ID == metaTypeId )
+            {
+                dbusType = DBUS_TYPE_VARIANT;
+            }
+            else if ( L2DBUS_BUFFER_TYPE_ID == metaTypeId )
+            {
+                dbusType = DBUS_TYPE_ARRAY;
+            }
             else if ( !l2dbus_dbusQueryDbusTypeId(L, idx, &dbusType) )
             {
                 dbusType = DBUS_TYPE_INVALID;
@@ -2542,18 +2146,104 @@ l2dbus_transcodeMapLuaToDbusType
 
 
 /**
- * @brief A "shim" function that allows a Lua protected call to be made.
- *
- * This shim function wraps the l2dbus_transcodeMarshallAsType() function so
- * that it can recursively called via a Lua pcall. Any Lua errors can be
- * "caught" before being propagated to the user application. On entry to the
- * function the Lua stack must hold the argument to marshall as well as
- * lightuserdata for the message and signature iterators.
+ * @brief Writes the complete type at the signature iterator into a buffer.
  *
- * @param [in] L    The Lua number to represent as a D-Bus type.
+ * @param [in]      sigIt   The signature iterator positioned at the type.
+ * @param [in,out]  buf     The buffer receiving the type codes.
+ * @param [in]      pos     The position in the buffer to write the type.
+ * @return The position in the buffer following the written type.
  */
-static int
-l2dbus_transcodeMarshallAsTypeShim
+static size_t
+l2dbus_transcodeWriteSignature
+    (
+    DBusSignatureIter*  sigIt,
+    char*               buf,
+    size_t              pos
+    )
+{
+    DBusSignatureIter sigSubIt;
+    int dbusType = dbus_signature_iter_get_current_type(sigIt);
+
+    if ( pos < DBUS_MAXIMUM_SIGNATURE_LENGTH )
+    {
+        switch ( dbusType )
+        {
+            case DBUS_TYPE_ARRAY:
+                buf[pos++] = DBUS_TYPE_ARRAY;
+                dbus_signature_iter_recurse(sigIt, &sigSubIt);
+                pos = l2dbus_transcodeWriteSignature(&sigSubIt, buf, pos);
+                break;
+
+            case DBUS_TYPE_STRUCT:
+            case DBUS_TYPE_DICT_ENTRY:
+                buf[pos++] = (DBUS_TYPE_STRUCT == dbusType) ?
+                            DBUS_STRUCT_BEGIN_CHAR : DBUS_DICT_ENTRY_BEGIN_CHAR;
+                dbus_signature_iter_recurse(sigIt, &sigSubIt);
+                do
+                {
+                    pos = l2dbus_transcodeWriteSignature(&sigSubIt, buf, pos);
+                }
+                while ( dbus_signature_iter_next(&sigSubIt) );
+
+                if ( pos < DBUS_MAXIMUM_SIGNATURE_LENGTH )
+                {
+                    buf[pos++] = (DBUS_TYPE_STRUCT == dbusType) ?
+                                DBUS_STRUCT_END_CHAR : DBUS_DICT_ENTRY_END_CHAR;
+                }
+                break;
+
+            default:
+                buf[pos++] = (char)dbusType;
+                break;
+        }
+    }
+
+    return pos;
+}
+
+
+/**
+ * @brief Returns the complete type at the signature iterator as a string.
+ *
+ * Unlike dbus_signature_iter_get_signature() the signature is allocated
+ * from the arena so the caller must release the arena (rather than free
+ * the string) when it's no longer needed.
+ *
+ * @param [in] sigIt    The signature iterator positioned at the type.
+ * @return The signature or NULL if it could not be allocated.
+ */
+static char*
+l2dbus_transcodeArenaSignature
+    (
+    DBusSignatureIter*  sigIt
+    )
+{
+    size_t len;
+    char* signature = l2dbus_arenaAlloc(DBUS_MAXIMUM_SIGNATURE_LENGTH + 1);
+
+    if ( NULL != signature )
+    {
+        len = l2dbus_transcodeWriteSignature(sigIt, signature, 0);
+        signature[len] = '\0';
+    }
+
+    return signature;
+}
+
+
+/**
+ * @brief A "shim" function that allows a Lua protected call to be made.
+ *
+ * This shim function wraps the l2dbus_transcodeMarshallAsType() function so
+ * that it can recursively called via a Lua pcall. Any Lua errors can be
+ * "caught" before being propagated to the user application. On entry to the
+ * function the Lua stack must hold the argument to marshall as well as
+ * lightuserdata for the message and signature iterators.
+ *
+ * @param [in] L    The Lua number to represent as a D-Bus type.
+ */
+static int
+l2dbus_transcodeMarshallAsTypeShim
     (
     lua_State*  L
     )
@@ -2571,28 +2261,282 @@ l2dbus_transcodeMarshallAsTypeShim
 
 
 /**
- * @brief Marshalls a Lua argument into a D-Bus message.
+ * @brief Determines whether arrays of a D-Bus type can be bulk transferred.
  *
- * This function takes an arbitrary Lua argument and encodes/marshalls it
- * into a D-Bus message using the D-Bus signature as a guide for converting
- * the types correctly. Any errors encountered while encoding the argument
- * will result in a Lua error being thrown.
+ * Arrays of fixed-size D-Bus types can be appended to (and read from) a
+ * message in a single operation. Unix file descriptors are fixed-size but
+ * D-Bus does not allow them to be transferred this way.
+ *
+ * @param [in] dbusType The D-Bus type of the array elements.
+ * @return The size of an element in bytes or zero (0) if the type is not
+ * supported for bulk transfers.
+ */
+size_t
+l2dbus_transcodeFixedTypeSize
+    (
+    int dbusType
+    )
+{
+    size_t size = 0;
+
+    switch ( dbusType )
+    {
+        case DBUS_TYPE_BYTE:
+            size = sizeof(uint8_t);
+            break;
+        case DBUS_TYPE_BOOLEAN:
+            size = sizeof(dbus_bool_t);
+            break;
+        case DBUS_TYPE_INT16:
+        case DBUS_TYPE_UINT16:
+            size = sizeof(int16_t);
+            break;
+        case DBUS_TYPE_INT32:
+        case DBUS_TYPE_UINT32:
+            size = sizeof(int32_t);
+            break;
+        case DBUS_TYPE_INT64:
+        case DBUS_TYPE_UINT64:
+            size = sizeof(int64_t);
+            break;
+        case DBUS_TYPE_DOUBLE:
+            size = sizeof(double);
+            break;
+        default:
+            break;
+    }
+
+    return size;
+}
+
+
+/**
+ * @brief Converts a plain Lua value to a fixed-size D-Bus value.
+ *
+ * Unlike l2dbus_transcodeMarshallBasic() this function does not throw a Lua
+ * error. Only plain Lua numbers/booleans (and Int64/Uint64 values for the
+ * 64-bit types) are converted. Anything else must be handled by the generic
+ * marshalling path.
+ *
+ * @param [in]  L           The Lua state.
+ * @param [in]  idx         The Lua stack index of the value.
+ * @param [in]  dbusType    The fixed-size D-Bus type to convert to.
+ * @param [out] value       Location where the converted value is written.
+ * @return Returns true if the value was converted, false otherwise.
+ */
+l2dbus_Bool
+l2dbus_transcodeToFixedValue
+    (
+    lua_State*  L,
+    int         idx,
+    int         dbusType,
+    void*       value
+    )
+{
+    l2dbus_Bool isConverted = L2DBUS_TRUE;
+    l2dbus_Int64* int64Ud;
+    l2dbus_Uint64* uint64Ud;
+
+    if ( DBUS_TYPE_BOOLEAN == dbusType )
+    {
+        if ( lua_isboolean(L, idx) )
+        {
+            *(dbus_bool_t*)value = lua_toboolean(L, idx) ? TRUE : FALSE;
+        }
+        else
+        {
+            isConverted = L2DBUS_FALSE;
+        }
+    }
+    else if ( lua_isnumber(L, idx) )
+    {
+        switch ( dbusType )
+        {
+            case DBUS_TYPE_BYTE:
+                *(uint8_t*)value = (uint8_t)lua_tonumber(L, idx);
+                break;
+            case DBUS_TYPE_INT16:
+                *(int16_t*)value = (int16_t)lua_tonumber(L, idx);
+                break;
+            case DBUS_TYPE_UINT16:
+                *(uint16_t*)value = (uint16_t)lua_tonumber(L, idx);
+                break;
+            case DBUS_TYPE_INT32:
+                *(int32_t*)value = (int32_t)lua_tonumber(L, idx);
+                break;
+            case DBUS_TYPE_UINT32:
+                *(uint32_t*)value = (uint32_t)lua_tonumber(L, idx);
+                break;
+            case DBUS_TYPE_INT64:
+                *(int64_t*)value = (int64_t)lua_tonumber(L, idx);
+                break;
+            case DBUS_TYPE_UINT64:
+                *(uint64_t*)value = (uint64_t)lua_tonumber(L, idx);
+                break;
+            case DBUS_TYPE_DOUBLE:
+                *(double*)value = (double)lua_tonumber(L, idx);
+                break;
+            default:
+                isConverted = L2DBUS_FALSE;
+                break;
+        }
+    }
+    else if ( (DBUS_TYPE_INT64 == dbusType) || (DBUS_TYPE_UINT64 == dbusType) )
+    {
+        if ( (int64Ud = l2dbus_isUserData(L, idx,
+                L2DBUS_INT64_TYPE_ID)) != NULL )
+        {
+            *(int64_t*)value = int64Ud->value;
+        }
+        else if ( (uint64Ud = l2dbus_isUserData(L, idx,
+            L2DBUS_UINT64_TYPE_ID)) != NULL )
+        {
+            *(uint64_t*)value = uint64Ud->value;
+        }
+        else
+        {
+            isConverted = L2DBUS_FALSE;
+        }
+    }
+    else
+    {
+        isConverted = L2DBUS_FALSE;
+    }
+
+    return isConverted;
+}
+
+
+/* Tests whether a byte array can be marshalled straight from the value */
+static l2dbus_Bool
+l2dbus_transcodeIsByteSource
+    (
+    lua_State*  L,
+    int         idx
+    )
+{
+    return (LUA_TSTRING == lua_type(L, idx)) ||
+        (L2DBUS_BUFFER_TYPE_ID == l2dbus_getMetaTypeId(L, idx));
+}
+
+
+/**
+ * @brief Marshalls a Lua array of fixed-size values in a single operation.
+ *
+ * The fast path converts the whole Lua array into a contiguous buffer and
+ * appends that to the message with one call rather than one call per
+ * element. A Lua string may be provided for a byte array ("ay") in which
+ * case the string bytes are appended directly. If any element cannot be
+ * trivially converted nothing is appended and the caller must fall back to
+ * marshalling the array element by element.
  *
  * @param [in] L        The Lua state.
- * @param [in] argIdx   The Lua stack index of the argument.
+ * @param [in] argIdx   The Lua stack index of the array (or string).
+ * @param [in] elemType The fixed-size D-Bus type of the array elements.
+ * @param [in] msgIt    Pointer to the (opened) D-Bus array iterator.
+ * @return Returns true if the array was marshalled, false if the caller
+ * must use the generic marshalling path.
+ */
+static l2dbus_Bool
+l2dbus_transcodeMarshallFixedArray
+    (
+    lua_State*          L,
+    int                 argIdx,
+    int                 elemType,
+    DBusMessageIter*    msgIt
+    )
+{
+    l2dbus_Bool isMarshalled = L2DBUS_FALSE;
+    l2dbus_Bool isAppended = L2DBUS_TRUE;
+    size_t eltSize = l2dbus_transcodeFixedTypeSize(elemType);
+    size_t arrayLen;
+    size_t idx;
+    const char* bytes;
+    char* buf;
+    l2dbus_ArenaMark mark;
+    l2dbus_Buffer* bufUd;
+
+    if ( 0 == eltSize )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    if ( (DBUS_TYPE_BYTE == elemType) && (LUA_TSTRING == lua_type(L, argIdx)) )
+    {
+        bytes = lua_tolstring(L, argIdx, &arrayLen);
+        isAppended = dbus_message_iter_append_fixed_array(msgIt, elemType,
+                                                    &bytes, (int)arrayLen);
+        isMarshalled = L2DBUS_TRUE;
+    }
+    else if ( (DBUS_TYPE_BYTE == elemType) && (NULL != (bufUd =
+        (l2dbus_Buffer*)l2dbus_isUserData(L, argIdx, L2DBUS_BUFFER_TYPE_ID))) )
+    {
+        bytes = (const char*)bufUd->data;
+        isAppended = dbus_message_iter_append_fixed_array(msgIt, elemType,
+                                                    &bytes, (int)bufUd->len);
+        isMarshalled = L2DBUS_TRUE;
+    }
+    else if ( LUA_TTABLE == lua_type(L, argIdx) )
+    {
+        arrayLen = lua_rawlen(L, argIdx);
+        if ( 0 == arrayLen )
+        {
+            isMarshalled = L2DBUS_TRUE;
+        }
+        else
+        {
+            /* The buffer is only needed until it's appended */
+            l2dbus_arenaMark(&mark);
+            buf = l2dbus_arenaAlloc(arrayLen * eltSize);
+            isMarshalled = (NULL != buf);
+            for ( idx = 0; isMarshalled && (idx < arrayLen); ++idx )
+            {
+                lua_rawgeti(L, argIdx, idx + 1);
+                isMarshalled = l2dbus_transcodeToFixedValue(L, -1, elemType,
+                                                        buf + (idx * eltSize));
+                lua_pop(L, 1);
+            }
+
+            if ( isMarshalled )
+            {
+                isAppended = dbus_message_iter_append_fixed_array(msgIt,
+                                        elemType, &buf, (int)arrayLen);
+            }
+            l2dbus_arenaRelease(&mark);
+        }
+    }
+
+    if ( !isAppended )
+    {
+        luaL_error(L, "could not append D-Bus fixed array");
+    }
+
+    return isMarshalled;
+}
+
+
+/**
+ * @brief Marshalls a Lua argument as a basic D-Bus type.
+ *
+ * This function encodes a Lua value as one of the basic (non-container)
+ * D-Bus types. Any Lua D-Bus userdata wrapper must have already been
+ * resolved to its underlying value by the caller. Any errors encountered
+ * while encoding the argument will result in a Lua error being thrown.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] argIdx   The Lua stack index of the (unwrapped) argument.
+ * @param [in] dbusType The basic D-Bus type used to encode the argument.
  * @param [in] msgIt    Pointer to a D-Bus message iterator.
- * @param [in] sigIt    Pointer to a D-Bus signature iterator.
  */
 static void
-l2dbus_transcodeMarshallAsType
+l2dbus_transcodeMarshallBasic
     (
     lua_State*          L,
     int                 argIdx,
-    DBusMessageIter*    msgIt,
-    DBusSignatureIter*  sigIt
+    int                 dbusType,
+    DBusMessageIter*    msgIt
     )
 {
-    int origTop = lua_gettop(L);
     uint8_t uint8Value;
     int16_t int16Value;
     uint16_t uint16Value;
@@ -2604,23 +2548,6 @@ l2dbus_transcodeMarshallAsType
     const char* strValue;
     l2dbus_Int64* int64Ud;
     l2dbus_Uint64* uint64Ud;
-    DBusSignatureIter sigSubIt;
-    DBusMessageIter msgSubIt;
-    cdbus_StringBuffer* sigBuf = NULL;
-    char* signature;
-    const char* cachedSig = NULL;
-    size_t  arrayLen;
-    size_t  idx;
-    argIdx = lua_absindex(L, argIdx);
-    int dbusType = dbus_signature_iter_get_current_type(sigIt);
-
-    /* If this is a D-Bus wrapper class then ... */
-    if ( LUA_TUSERDATA == lua_type(L, argIdx) )
-    {
-        cachedSig = l2dbus_dbusGetCachedSignature(L, argIdx);
-        l2dbus_transcodeGetValue(L, argIdx);
-        argIdx = lua_absindex(L, -1);
-    }
 
     switch ( dbusType )
     {
@@ -2630,12 +2557,12 @@ l2dbus_transcodeMarshallAsType
                 uint8Value = (uint8_t)lua_tonumber(L, argIdx);
             }
             else if ( (int64Ud = l2dbus_isUserData(L, argIdx,
-                    L2DBUS_DBUS_INT64_MTBL_NAME)) != NULL )
+                    L2DBUS_DBUS_INT64_TYPE_ID)) != NULL )
             {
                 uint8Value = (uint8_t)int64Ud->value;
             }
             else if ( (uint64Ud = l2dbus_isUserData(L, argIdx,
-                L2DBUS_DBUS_UINT64_MTBL_NAME)) != NULL )
+                L2DBUS_DBUS_UINT64_TYPE_ID)) != NULL )
             {
                 uint8Value = (uint8_t)uint64Ud->value;
             }
@@ -2656,12 +2583,12 @@ l2dbus_transcodeMarshallAsType
                 int32Value = (int32_t)lua_toboolean(L, argIdx);
             }
             else if ( (int64Ud = l2dbus_isUserData(L, argIdx,
-                    L2DBUS_DBUS_INT64_MTBL_NAME)) != NULL )
+                    L2DBUS_DBUS_INT64_TYPE_ID)) != NULL )
             {
                 int32Value = (int32_t)int64Ud->value;
             }
             else if ( (uint64Ud = l2dbus_isUserData(L, argIdx,
-                L2DBUS_DBUS_UINT64_MTBL_NAME)) != NULL )
+                L2DBUS_DBUS_UINT64_TYPE_ID)) != NULL )
             {
                 int32Value = (int32_t)uint64Ud->value;
             }
@@ -2682,12 +2609,12 @@ l2dbus_transcodeMarshallAsType
                 int16Value = (int16_t)lua_tonumber(L, argIdx);
             }
             else if ( (int64Ud = l2dbus_isUserData(L, argIdx,
-                    L2DBUS_DBUS_INT64_MTBL_NAME)) != NULL )
+                    L2DBUS_DBUS_INT64_TYPE_ID)) != NULL )
             {
                 int16Value = (int16_t)int64Ud->value;
             }
             else if ( (uint64Ud = l2dbus_isUserData(L, argIdx,
-                L2DBUS_DBUS_UINT64_MTBL_NAME)) != NULL )
+                L2DBUS_DBUS_UINT64_TYPE_ID)) != NULL )
             {
                 int16Value = (int16_t)uint64Ud->value;
             }
@@ -2708,12 +2635,12 @@ l2dbus_transcodeMarshallAsType
                 uint16Value = (uint16_t)lua_tonumber(L, argIdx);
             }
             else if ( (int64Ud = l2dbus_isUserData(L, argIdx,
-                    L2DBUS_DBUS_INT64_MTBL_NAME)) != NULL )
+                    L2DBUS_DBUS_INT64_TYPE_ID)) != NULL )
             {
                 uint16Value = (uint16_t)int64Ud->value;
             }
             else if ( (uint64Ud = l2dbus_isUserData(L, argIdx,
-                L2DBUS_DBUS_UINT64_MTBL_NAME)) != NULL )
+                L2DBUS_DBUS_UINT64_TYPE_ID)) != NULL )
             {
                 uint16Value = (uint16_t)uint64Ud->value;
             }
@@ -2734,12 +2661,12 @@ l2dbus_transcodeMarshallAsType
                 int32Value = (int32_t)lua_tonumber(L, argIdx);
             }
             else if ( (int64Ud = l2dbus_isUserData(L, argIdx,
-                    L2DBUS_DBUS_INT64_MTBL_NAME)) != NULL )
+                    L2DBUS_DBUS_INT64_TYPE_ID)) != NULL )
             {
                 int32Value = (int32_t)int64Ud->value;
             }
             else if ( (uint64Ud = l2dbus_isUserData(L, argIdx,
-                L2DBUS_DBUS_UINT64_MTBL_NAME)) != NULL )
+                L2DBUS_DBUS_UINT64_TYPE_ID)) != NULL )
             {
                 int32Value = (int32_t)uint64Ud->value;
             }
@@ -2760,12 +2687,12 @@ l2dbus_transcodeMarshallAsType
                 uint32Value = (uint32_t)lua_tonumber(L, argIdx);
             }
             else if ( (int64Ud = l2dbus_isUserData(L, argIdx,
-                    L2DBUS_DBUS_INT64_MTBL_NAME)) != NULL )
+                    L2DBUS_DBUS_INT64_TYPE_ID)) != NULL )
             {
                 uint32Value = (uint32_t)int64Ud->value;
             }
             else if ( (uint64Ud = l2dbus_isUserData(L, argIdx,
-                L2DBUS_DBUS_UINT64_MTBL_NAME)) != NULL )
+                L2DBUS_DBUS_UINT64_TYPE_ID)) != NULL )
             {
                 uint32Value = (uint32_t)uint64Ud->value;
             }
@@ -2787,12 +2714,12 @@ l2dbus_transcodeMarshallAsType
                 int64Value = (int64_t)lua_tonumber(L, argIdx);
             }
             else if ( (int64Ud = l2dbus_isUserData(L, argIdx,
-                    L2DBUS_INT64_MTBL_NAME)) != NULL )
+                    L2DBUS_INT64_TYPE_ID)) != NULL )
             {
                 int64Value = int64Ud->value;
             }
             else if ( (uint64Ud = l2dbus_isUserData(L, argIdx,
-                L2DBUS_UINT64_MTBL_NAME)) != NULL )
+                L2DBUS_UINT64_TYPE_ID)) != NULL )
             {
                 int64Value = (int64_t)uint64Ud->value;
             }
@@ -2813,12 +2740,12 @@ l2dbus_transcodeMarshallAsType
                 uint64Value = (uint64_t)lua_tonumber(L, argIdx);
             }
             else if ( (int64Ud = l2dbus_isUserData(L, argIdx,
-                    L2DBUS_INT64_MTBL_NAME)) != NULL )
+                    L2DBUS_INT64_TYPE_ID)) != NULL )
             {
                 uint64Value = (uint64_t)int64Ud->value;
             }
             else if ( (uint64Ud = l2dbus_isUserData(L, argIdx,
-                L2DBUS_UINT64_MTBL_NAME)) != NULL )
+                L2DBUS_UINT64_TYPE_ID)) != NULL )
             {
                 uint64Value = uint64Ud->value;
             }
@@ -2840,12 +2767,12 @@ l2dbus_transcodeMarshallAsType
                 doubleValue = (double)lua_tonumber(L, argIdx);
             }
             else if ( (int64Ud = l2dbus_isUserData(L, argIdx,
-                    L2DBUS_DBUS_INT64_MTBL_NAME)) != NULL )
+                    L2DBUS_DBUS_INT64_TYPE_ID)) != NULL )
             {
                 doubleValue = (double)int64Ud->value;
             }
             else if ( (uint64Ud = l2dbus_isUserData(L, argIdx,
-                L2DBUS_DBUS_UINT64_MTBL_NAME)) != NULL )
+                L2DBUS_DBUS_UINT64_TYPE_ID)) != NULL )
             {
                 doubleValue = (double)uint64Ud->value;
             }
@@ -2885,35 +2812,142 @@ l2dbus_transcodeMarshallAsType
             }
             break;
 
-        case DBUS_TYPE_ARRAY:
-            luaL_checktype(L, argIdx, LUA_TTABLE);
-            dbus_signature_iter_recurse(sigIt, &sigSubIt);
-            signature = dbus_signature_iter_get_signature(&sigSubIt);
-            if ( !dbus_message_iter_open_container(msgIt, dbusType, signature,
-                &msgSubIt) )
+        case DBUS_TYPE_UNIX_FD:
+            if ( lua_isnumber(L, argIdx) )
             {
-                dbus_free(signature);
-                luaL_error(L, "could not open D-Bus container for array");
+                int32Value = (int32_t)lua_tonumber(L, argIdx);
             }
-            dbus_free(signature);
-
-            if ( DBUS_TYPE_DICT_ENTRY ==
-                dbus_signature_iter_get_current_type(&sigSubIt) )
+            else if ( (int64Ud = l2dbus_isUserData(L, argIdx,
+                    L2DBUS_DBUS_INT64_TYPE_ID)) != NULL )
             {
-                l2dbus_transcodeMarshallAsType(L, argIdx, &msgSubIt, &sigSubIt);
+                int32Value = (int32_t)int64Ud->value;
+            }
+            else if ( (uint64Ud = l2dbus_isUserData(L, argIdx,
+                L2DBUS_DBUS_UINT64_TYPE_ID)) != NULL )
+            {
+                int32Value = (int32_t)uint64Ud->value;
             }
             else
             {
-                arrayLen = lua_rawlen(L, argIdx);
-                for ( idx = 1;
-                    (idx <= arrayLen) &&
-                    (DBUS_TYPE_INVALID !=
-                        dbus_signature_iter_get_current_type(&sigSubIt));
-                    ++idx )
-                {
-                    lua_rawgeti(L, argIdx, idx);
-                    l2dbus_transcodeMarshallAsType(L, -1, &msgSubIt, &sigSubIt);
-                    /* It's not necessary to iterate to the next type in
+                luaL_error(L, "cannot convert %s to a DBUS_TYPE_UNIX_FD",
+                    lua_typename(L, lua_type(L, argIdx)));
+            }
+            if ( !dbus_message_iter_append_basic(msgIt, dbusType, &int32Value) )
+            {
+                luaL_error(L, "could not append DBUS_TYPE_UNIX_FD");
+            }
+            break;
+
+        default:
+            luaL_error(L, "cannot convert signature");
+            break;
+    }
+}
+
+
+/**
+ * @brief Marshalls a Lua argument into a D-Bus message.
+ *
+ * This function takes an arbitrary Lua argument and encodes/marshalls it
+ * into a D-Bus message using the D-Bus signature as a guide for converting
+ * the types correctly. Any errors encountered while encoding the argument
+ * will result in a Lua error being thrown.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] argIdx   The Lua stack index of the argument.
+ * @param [in] msgIt    Pointer to a D-Bus message iterator.
+ * @param [in] sigIt    Pointer to a D-Bus signature iterator.
+ */
+static void
+l2dbus_transcodeMarshallAsType
+    (
+    lua_State*          L,
+    int                 argIdx,
+    DBusMessageIter*    msgIt,
+    DBusSignatureIter*  sigIt
+    )
+{
+    int origTop = lua_gettop(L);
+    DBusSignatureIter sigSubIt;
+    DBusMessageIter msgSubIt;
+    cdbus_StringBuffer* sigBuf = NULL;
+    char* signature;
+    const char* cachedSig = NULL;
+    size_t  arrayLen;
+    size_t  idx;
+    int elemType;
+    l2dbus_RawVariant* rawUd;
+    l2dbus_ArenaMark mark;
+    argIdx = lua_absindex(L, argIdx);
+    int dbusType = dbus_signature_iter_get_current_type(sigIt);
+
+    /* If this is a raw variant then ... */
+    if ( (LUA_TUSERDATA == lua_type(L, argIdx)) &&
+        (NULL != (rawUd = (l2dbus_RawVariant*)l2dbus_isUserData(L, argIdx,
+                                            L2DBUS_RAW_VARIANT_TYPE_ID))) )
+    {
+        /* Copy the serialized variant when a variant is expected */
+        if ( DBUS_TYPE_VARIANT == dbusType )
+        {
+            if ( !l2dbus_rawVariantAppend(rawUd, msgIt) )
+            {
+                luaL_error(L, "could not append raw variant");
+            }
+            return;
+        }
+
+        /* Otherwise marshal the decoded value */
+        l2dbus_rawVariantPushValue(L, rawUd);
+        argIdx = lua_absindex(L, -1);
+    }
+    /* Else if this is a D-Bus wrapper class then ... */
+    else if ( LUA_TUSERDATA == lua_type(L, argIdx) )
+    {
+        cachedSig = l2dbus_dbusGetCachedSignature(L, argIdx);
+        l2dbus_transcodeGetValue(L, argIdx);
+        argIdx = lua_absindex(L, -1);
+    }
+
+    switch ( dbusType )
+    {
+        case DBUS_TYPE_ARRAY:
+            dbus_signature_iter_recurse(sigIt, &sigSubIt);
+            elemType = dbus_signature_iter_get_current_type(&sigSubIt);
+            /* Byte arrays may be provided as Lua strings or Buffers */
+            if ( (DBUS_TYPE_BYTE != elemType) ||
+                !l2dbus_transcodeIsByteSource(L, argIdx) )
+            {
+                luaL_checktype(L, argIdx, LUA_TTABLE);
+            }
+            /* The element signature is only needed to open the array */
+            l2dbus_arenaMark(&mark);
+            signature = l2dbus_transcodeArenaSignature(&sigSubIt);
+            if ( (NULL == signature) ||
+                !dbus_message_iter_open_container(msgIt, dbusType, signature,
+                &msgSubIt) )
+            {
+                l2dbus_arenaRelease(&mark);
+                luaL_error(L, "could not open D-Bus container for array");
+            }
+            l2dbus_arenaRelease(&mark);
+
+            if ( DBUS_TYPE_DICT_ENTRY == elemType )
+            {
+                l2dbus_transcodeMarshallAsType(L, argIdx, &msgSubIt, &sigSubIt);
+            }
+            else if ( !l2dbus_transcodeMarshallFixedArray(L, argIdx, elemType,
+                        &msgSubIt) )
+            {
+                arrayLen = lua_rawlen(L, argIdx);
+                for ( idx = 1;
+                    (idx <= arrayLen) &&
+                    (DBUS_TYPE_INVALID !=
+                        dbus_signature_iter_get_current_type(&sigSubIt));
+                    ++idx )
+                {
+                    lua_rawgeti(L, argIdx, idx);
+                    l2dbus_transcodeMarshallAsType(L, -1, &msgSubIt, &sigSubIt);
+                    /* It's not necessary to iterate to the next type in
                      * the signature because in D-Bus *all* the values of
                      * an array must be the same time (e.g. homogeneous
                      * typed arrays).
@@ -3006,14 +3040,18 @@ l2dbus_transcodeMarshallAsType
              * occurs we need a chance to free up the signature before
              * propagating the error on up to Lua.
              */
+            l2dbus_arenaMark(&mark);
             lua_pushcfunction(L, l2dbus_transcodeMarshallAsTypeShim);
             lua_pushvalue(L, argIdx);
             lua_pushlightuserdata(L, &msgSubIt);
             lua_pushlightuserdata(L, &sigSubIt);
             if ( 0 != lua_pcall(L, 3, 0, 0) )
             {
-                /* Free the signature buffer before the error long jump */
+                /* Free the signature buffer (and any transient arena
+                 * allocations) before the error long jump
+                 */
                 cdbus_stringBufferUnref(sigBuf);
+                l2dbus_arenaRelease(&mark);
 
                 /* Propagate the Lua error */
                 lua_error(L);
@@ -3065,152 +3103,524 @@ l2dbus_transcodeMarshallAsType
             }
             break;
 
-        case DBUS_TYPE_UNIX_FD:
-            if ( lua_isnumber(L, argIdx) )
+        default:
+            l2dbus_transcodeMarshallBasic(L, argIdx, dbusType, msgIt);
+            break;
+    }
+
+    lua_settop(L, origTop);
+}
+
+
+/**
+ * @brief Marshalls a Lua argument into a D-Bus message using a compiled plan.
+ *
+ * This function performs the same conversion as
+ * l2dbus_transcodeMarshallAsType() but is driven by a pre-validated,
+ * flattened plan rather than re-parsing the D-Bus signature. Variants are
+ * dynamically typed so their contents are still handled by the signature
+ * driven path. Any errors encountered while encoding the argument will
+ * result in a Lua error being thrown.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] argIdx   The Lua stack index of the argument.
+ * @param [in] msgIt    Pointer to a D-Bus message iterator.
+ * @param [in] plan     The compiled signature plan.
+ * @param [in] opIdx    The index of the plan operation to execute.
+ * @return The index of the plan operation following the encoded type.
+ */
+static int
+l2dbus_transcodeMarshallByPlan
+    (
+    lua_State*              L,
+    int                     argIdx,
+    DBusMessageIter*        msgIt,
+    const l2dbus_SigPlan*   plan,
+    int                     opIdx
+    )
+{
+    int origTop = lua_gettop(L);
+    const l2dbus_SigPlanOp* op = &plan->ops[opIdx];
+    DBusSignatureIter sigIt;
+    DBusMessageIter msgSubIt;
+    DBusMessageIter msgEntryIt;
+    size_t  arrayLen;
+    size_t  idx;
+    int subIdx;
+    argIdx = lua_absindex(L, argIdx);
+
+    if ( DBUS_TYPE_VARIANT == op->dbusType )
+    {
+        dbus_signature_iter_init(&sigIt, DBUS_TYPE_VARIANT_AS_STRING);
+        l2dbus_transcodeMarshallAsType(L, argIdx, msgIt, &sigIt);
+        return op->next;
+    }
+
+    /* If this is a D-Bus wrapper class then ... */
+    if ( LUA_TUSERDATA == lua_type(L, argIdx) )
+    {
+        l2dbus_transcodeGetValue(L, argIdx);
+        argIdx = lua_absindex(L, -1);
+    }
+
+    switch ( op->dbusType )
+    {
+        case DBUS_TYPE_ARRAY:
+            subIdx = opIdx + 1;
+            /* Byte arrays may be provided as Lua strings or Buffers */
+            if ( (DBUS_TYPE_BYTE != plan->ops[subIdx].dbusType) ||
+                !l2dbus_transcodeIsByteSource(L, argIdx) )
             {
-                int32Value = (int32_t)lua_tonumber(L, argIdx);
+                luaL_checktype(L, argIdx, LUA_TTABLE);
             }
-            else if ( (int64Ud = l2dbus_isUserData(L, argIdx,
-                    L2DBUS_DBUS_INT64_MTBL_NAME)) != NULL )
+            if ( !dbus_message_iter_open_container(msgIt, op->dbusType,
+                op->subSig, &msgSubIt) )
             {
-                int32Value = (int32_t)int64Ud->value;
+                luaL_error(L, "could not open D-Bus container for array");
             }
-            else if ( (uint64Ud = l2dbus_isUserData(L, argIdx,
-                L2DBUS_DBUS_UINT64_MTBL_NAME)) != NULL )
+
+            if ( DBUS_TYPE_DICT_ENTRY == plan->ops[subIdx].dbusType )
             {
-                int32Value = (int32_t)uint64Ud->value;
+                lua_pushnil(L);
+                while ( lua_next(L, argIdx) )
+                {
+                    if ( !dbus_message_iter_open_container(&msgSubIt,
+                        DBUS_TYPE_DICT_ENTRY, NULL, &msgEntryIt) )
+                    {
+                        luaL_error(L,
+                            "could not open D-Bus container for dictionary");
+                    }
+
+                    /* Encode the key and then the value that follows it */
+                    l2dbus_transcodeMarshallByPlan(L, -1, &msgEntryIt, plan,
+                        l2dbus_transcodeMarshallByPlan(L, -2, &msgEntryIt,
+                                                        plan, subIdx + 1));
+
+                    if ( !dbus_message_iter_close_container(&msgSubIt,
+                        &msgEntryIt) )
+                    {
+                        luaL_error(L,
+                            "could not close D-Bus container for dictionary");
+                    }
+
+                    /* Pop off the value for the next go-around */
+                    lua_pop(L, 1);
+                }
             }
-            else
+            else if ( !l2dbus_transcodeMarshallFixedArray(L, argIdx,
+                        plan->ops[subIdx].dbusType, &msgSubIt) )
             {
-                luaL_error(L, "cannot convert %s to a DBUS_TYPE_UNIX_FD",
-                    lua_typename(L, lua_type(L, argIdx)));
+                arrayLen = lua_rawlen(L, argIdx);
+                for ( idx = 1; idx <= arrayLen; ++idx )
+                {
+                    lua_rawgeti(L, argIdx, idx);
+                    l2dbus_transcodeMarshallByPlan(L, -1, &msgSubIt, plan,
+                                                    subIdx);
+                    lua_pop(L, 1);
+                }
             }
-            if ( !dbus_message_iter_append_basic(msgIt, dbusType, &int32Value) )
+
+            if ( !dbus_message_iter_close_container(msgIt, &msgSubIt) )
             {
-                luaL_error(L, "could not append DBUS_TYPE_UNIX_FD");
+                luaL_error(L, "could not close D-Bus container for array");
+            }
+            break;
+
+        case DBUS_TYPE_STRUCT:
+            luaL_checktype(L, argIdx, LUA_TTABLE);
+            if ( !dbus_message_iter_open_container(msgIt, op->dbusType, NULL,
+                &msgSubIt) )
+            {
+                luaL_error(L, "could not open D-Bus container for structure");
+            }
+
+            arrayLen = lua_rawlen(L, argIdx);
+            subIdx = opIdx + 1;
+            for ( idx = 1; (idx <= arrayLen) && (subIdx < op->next); ++idx )
+            {
+                lua_rawgeti(L, argIdx, idx);
+                subIdx = l2dbus_transcodeMarshallByPlan(L, -1, &msgSubIt,
+                                                        plan, subIdx);
+                lua_pop(L, 1);
+            }
+
+            if ( !dbus_message_iter_close_container(msgIt, &msgSubIt) )
+            {
+                luaL_error(L, "could not close D-Bus container for structure");
             }
             break;
 
         default:
-            luaL_error(L, "cannot convert signature");
+            l2dbus_transcodeMarshallBasic(L, argIdx, op->dbusType, msgIt);
             break;
     }
 
     lua_settop(L, origTop);
+
+    return op->next;
 }
 
 
 /**
- * @brief Unmarshalls the D-Bus message parameters into a Lua argument array.
+ * @brief Unmarshalls an array of fixed-size D-Bus values in one operation.
  *
- * This function takes a D-Bus message and decodes/unmarshalls the parameters
- * into their corresponding Lua argument types that are appended to an array.
- * If an error is encountered unmarshalling the parameters then a Lua error
- * is thrown.
+ * The array contents are read directly from the message and the resulting
+ * Lua table is pre-sized to hold all the elements. Optionally a byte array
+ * can be converted directly to a Lua string or to a Buffer referring to the
+ * message. The resulting value is left on the top of the Lua stack.
  *
  * @param [in] L        The Lua state.
- * @param [in] iter     Pointer to a D-Bus message iterator.
- * @param [in] tableIdx The Lua stack index of the returned Lua table/array.
- * @param [in] arrIdx   The current index into the Lua table/array.
+ * @param [in] msg      The message being unmarshalled.
+ * @param [in] iter     Pointer to the D-Bus iterator for the array contents.
+ * @param [in] elemType The fixed-size D-Bus type of the array elements.
+ * @param [in] opts     Options controlling the conversion (may be NULL).
  */
 static void
-l2dbus_transcodeUnmarshall
+l2dbus_transcodeUnmarshallFixedArray
     (
-    lua_State*          L,
-    DBusMessageIter*    iter,
-    int                 tableIdx,
-    int*                arrIdx
+    lua_State*                  L,
+    DBusMessage*                msg,
+    DBusMessageIter*            iter,
+    int                         elemType,
+    const l2dbus_TranscodeOpts* opts
     )
 {
-    uint8_t uint8Value;
-    int16_t int16Value;
-    uint16_t uint16Value;
-    int32_t int32Value;
-    uint32_t uint32Value;
-    l2dbus_Int64* int64Ud;
-    l2dbus_Uint64* uint64Ud;
-    double doubleValue;
-    const char* strValue;
-    DBusMessageIter subIter;
-    int subIdx;
-    l2dbus_Bool skipArrayAdd = L2DBUS_FALSE;
-    tableIdx = lua_absindex(L, tableIdx);
-    int dbusType = dbus_message_iter_get_arg_type(iter);
+    const void* data = NULL;
+    int nElts = 0;
+    int idx;
+    l2dbus_Bool int64AsNumber = (NULL != opts) && opts->int64AsNumber;
 
-    if ( DBUS_TYPE_INVALID != dbusType )
+    dbus_message_iter_get_fixed_array(iter, &data, &nElts);
+
+    if ( (DBUS_TYPE_BYTE == elemType) && (NULL != opts) &&
+        opts->byteArrayAsBuffer )
     {
-        switch ( dbusType )
+        l2dbus_bufferNewFromMessage(L, msg, data, nElts);
+        return;
+    }
+
+    if ( (DBUS_TYPE_BYTE == elemType) && (NULL != opts) &&
+        opts->byteArrayAsString )
+    {
+        lua_pushlstring(L, (const char*)data, nElts);
+        return;
+    }
+
+    lua_createtable(L, nElts, 0);
+    for ( idx = 0; idx < nElts; ++idx )
+    {
+        switch ( elemType )
         {
             case DBUS_TYPE_BYTE:
-                dbus_message_iter_get_basic(iter, &uint8Value);
-                lua_pushnumber(L, uint8Value);
+                lua_pushnumber(L, ((const uint8_t*)data)[idx]);
                 break;
-
             case DBUS_TYPE_BOOLEAN:
-                dbus_message_iter_get_basic(iter, &int32Value);
-                lua_pushboolean(L, int32Value);
+                lua_pushboolean(L, ((const dbus_bool_t*)data)[idx]);
                 break;
-
             case DBUS_TYPE_INT16:
-                dbus_message_iter_get_basic(iter, &int16Value);
-                lua_pushnumber(L, int16Value);
+                lua_pushnumber(L, ((const int16_t*)data)[idx]);
                 break;
-
             case DBUS_TYPE_UINT16:
-                dbus_message_iter_get_basic(iter, &uint16Value);
-                lua_pushnumber(L, uint16Value);
+                lua_pushnumber(L, ((const uint16_t*)data)[idx]);
                 break;
-
             case DBUS_TYPE_INT32:
-                dbus_message_iter_get_basic(iter, &int32Value);
-                lua_pushnumber(L, int32Value);
+                lua_pushnumber(L, ((const int32_t*)data)[idx]);
                 break;
-
             case DBUS_TYPE_UINT32:
-                dbus_message_iter_get_basic(iter, &uint32Value);
-                lua_pushnumber(L, uint32Value);
+                lua_pushnumber(L, ((const uint32_t*)data)[idx]);
                 break;
-
             case DBUS_TYPE_INT64:
-                int64Ud = l2dbus_objectNew(L, sizeof(*int64Ud),
-                                            L2DBUS_INT64_TYPE_ID);
-                dbus_message_iter_get_basic(iter, &int64Ud->value);
+                l2dbus_int64Push(L, ((const int64_t*)data)[idx],
+                                int64AsNumber);
                 break;
-
             case DBUS_TYPE_UINT64:
-                uint64Ud = l2dbus_objectNew(L, sizeof(*uint64Ud),
-                                            L2DBUS_UINT64_TYPE_ID);
-                dbus_message_iter_get_basic(iter, &uint64Ud->value);
+                l2dbus_uint64Push(L, ((const uint64_t*)data)[idx],
+                                int64AsNumber);
                 break;
-
             case DBUS_TYPE_DOUBLE:
-                dbus_message_iter_get_basic(iter, &doubleValue);
-                lua_pushnumber(L, doubleValue);
+                lua_pushnumber(L, ((const double*)data)[idx]);
                 break;
-
-            case DBUS_TYPE_STRING:
-                dbus_message_iter_get_basic(iter, &strValue);
-                lua_pushstring(L, strValue);
+            default:
+                luaL_error(L, "unsupported D-Bus fixed array type (%d)",
+                            elemType);
                 break;
+        }
+        lua_rawseti(L, -2, idx + 1);
+    }
+}
 
-            case DBUS_TYPE_OBJECT_PATH:
-                dbus_message_iter_get_basic(iter, &strValue);
-                lua_pushstring(L, strValue);
-                break;
 
-            case DBUS_TYPE_SIGNATURE:
-                dbus_message_iter_get_basic(iter, &strValue);
-                lua_pushstring(L, strValue);
-                break;
+/*
+ * The number of (direct-mapped) entries in the dictionary key cache
+ * used while unmarshalling a single message. Must be a power of two.
+ */
+#define L2DBUS_KEY_CACHE_SIZE   (64)
 
-            case DBUS_TYPE_ARRAY:
-                lua_newtable(L);
-                subIdx = 1;
-                dbus_message_iter_recurse(iter, &subIter);
+typedef struct l2dbus_KeyCacheEntry
+{
+    unsigned    hash;
+    size_t      len;
+    const char* str;
+} l2dbus_KeyCacheEntry;
+
+/* State shared by all levels of a (recursive) unmarshall operation */
+typedef struct l2dbus_UnmarshallCtx
+{
+    const l2dbus_TranscodeOpts* opts;
+    /* The message being unmarshalled */
+    DBusMessage*                msg;
+    /* Stack index of the table anchoring interned keys (or zero) */
+    int                         keyTblIdx;
+    l2dbus_KeyCacheEntry        keys[L2DBUS_KEY_CACHE_SIZE];
+} l2dbus_UnmarshallCtx;
+
+
+/**
+ * @brief Initializes the context for an unmarshall operation.
+ *
+ * If key interning is requested a table used to anchor the interned keys
+ * is pushed on the Lua stack.
+ *
+ * @param [in]  L       The Lua state.
+ * @param [out] ctx     The context to initialize.
+ * @param [in]  msg     The message being unmarshalled.
+ * @param [in]  opts    Options controlling the conversion (may be NULL).
+ */
+static void
+l2dbus_transcodeUnmarshallCtxInit
+    (
+    lua_State*                  L,
+    l2dbus_UnmarshallCtx*       ctx,
+    DBusMessage*                msg,
+    const l2dbus_TranscodeOpts* opts
+    )
+{
+    ctx->opts = opts;
+    ctx->msg = msg;
+    ctx->keyTblIdx = 0;
+    if ( (NULL != opts) && opts->internKeys )
+    {
+        memset(ctx->keys, 0, sizeof(ctx->keys));
+        lua_createtable(L, L2DBUS_KEY_CACHE_SIZE, 0);
+        ctx->keyTblIdx = lua_gettop(L);
+    }
+}
+
+
+/**
+ * @brief Pushes a dictionary key string, re-using a previous copy if possible.
+ *
+ * Dictionary keys are frequently repeated within a message (e.g. property
+ * names in nested a{sa{sv}} dictionaries). When key interning is enabled the
+ * first Lua string created for a key is anchored and re-used for later
+ * occurrences of the same key rather than creating a new string each time.
+ *
+ * @param [in] L    The Lua state.
+ * @param [in] ctx  The unmarshall context.
+ * @param [in] str  The key string (owned by the D-Bus message).
+ */
+static void
+l2dbus_transcodePushKeyString
+    (
+    lua_State*              L,
+    l2dbus_UnmarshallCtx*   ctx,
+    const char*             str
+    )
+{
+    unsigned hash = 2166136261U;
+    size_t len = 0;
+    l2dbus_KeyCacheEntry* entry;
+    unsigned slot;
+
+    if ( 0 == ctx->keyTblIdx )
+    {
+        lua_pushstring(L, str);
+        return;
+    }
+
+    while ( '\0' != str[len] )
+    {
+        hash ^= (unsigned char)str[len++];
+        hash *= 16777619U;
+    }
+
+    slot = hash & (L2DBUS_KEY_CACHE_SIZE - 1);
+    entry = &ctx->keys[slot];
+    if ( (NULL != entry->str) && (entry->hash == hash) &&
+        (entry->len == len) && (0 == memcmp(entry->str, str, len)) )
+    {
+        lua_rawgeti(L, ctx->keyTblIdx, slot + 1);
+    }
+    else
+    {
+        lua_pushlstring(L, str, len);
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, ctx->keyTblIdx, slot + 1);
+        entry->hash = hash;
+        entry->len = len;
+        entry->str = str;
+    }
+}
+
+
+/**
+ * @brief Counts the number of entries in a D-Bus dictionary.
+ *
+ * @param [in] iter     Iterator positioned at the first dictionary entry.
+ * @return The number of dictionary entries.
+ */
+static int
+l2dbus_transcodeCountEntries
+    (
+    const DBusMessageIter*  iter
+    )
+{
+    DBusMessageIter countIter = *iter;
+    int nEntries = 0;
+
+    while ( DBUS_TYPE_INVALID != dbus_message_iter_get_arg_type(&countIter) )
+    {
+        ++nEntries;
+        dbus_message_iter_next(&countIter);
+    }
+
+    return nEntries;
+}
+
+
+/**
+ * @brief Unmarshalls the D-Bus message parameters into a Lua argument array.
+ *
+ * This function takes a D-Bus message and decodes/unmarshalls the parameters
+ * into their corresponding Lua argument types that are appended to an array.
+ * If no array index is provided the decoded value is left on the top of the
+ * Lua stack instead. If an error is encountered unmarshalling the parameters
+ * then a Lua error is thrown.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] iter     Pointer to a D-Bus message iterator.
+ * @param [in] tableIdx The Lua stack index of the returned Lua table/array.
+ * @param [in] arrIdx   The current index into the Lua table/array or NULL
+ * if the value should be left on the top of the Lua stack.
+ * @param [in] ctx      The context of the unmarshall operation.
+ */
+static void
+l2dbus_transcodeUnmarshall
+    (
+    lua_State*              L,
+    DBusMessageIter*        iter,
+    int                     tableIdx,
+    int*                    arrIdx,
+    l2dbus_UnmarshallCtx*   ctx
+    )
+{
+    uint8_t uint8Value;
+    int16_t int16Value;
+    uint16_t uint16Value;
+    int32_t int32Value;
+    uint32_t uint32Value;
+    dbus_int64_t int64Value;
+    dbus_uint64_t uint64Value;
+    double doubleValue;
+    const char* strValue;
+    DBusMessageIter subIter;
+    int subIdx;
+    int elemType;
+    l2dbus_Bool skipArrayAdd = L2DBUS_FALSE;
+    tableIdx = lua_absindex(L, tableIdx);
+    int dbusType = dbus_message_iter_get_arg_type(iter);
+
+    if ( DBUS_TYPE_INVALID != dbusType )
+    {
+        switch ( dbusType )
+        {
+            case DBUS_TYPE_BYTE:
+                dbus_message_iter_get_basic(iter, &uint8Value);
+                lua_pushnumber(L, uint8Value);
+                break;
+
+            case DBUS_TYPE_BOOLEAN:
+                dbus_message_iter_get_basic(iter, &int32Value);
+                lua_pushboolean(L, int32Value);
+                break;
+
+            case DBUS_TYPE_INT16:
+                dbus_message_iter_get_basic(iter, &int16Value);
+                lua_pushnumber(L, int16Value);
+                break;
+
+            case DBUS_TYPE_UINT16:
+                dbus_message_iter_get_basic(iter, &uint16Value);
+                lua_pushnumber(L, uint16Value);
+                break;
+
+            case DBUS_TYPE_INT32:
+                dbus_message_iter_get_basic(iter, &int32Value);
+                lua_pushnumber(L, int32Value);
+                break;
+
+            case DBUS_TYPE_UINT32:
+                dbus_message_iter_get_basic(iter, &uint32Value);
+                lua_pushnumber(L, uint32Value);
+                break;
+
+            case DBUS_TYPE_INT64:
+                dbus_message_iter_get_basic(iter, &int64Value);
+                l2dbus_int64Push(L, int64Value, (NULL != ctx->opts) &&
+                                                ctx->opts->int64AsNumber);
+                break;
+
+            case DBUS_TYPE_UINT64:
+                dbus_message_iter_get_basic(iter, &uint64Value);
+                l2dbus_uint64Push(L, uint64Value, (NULL != ctx->opts) &&
+                                                ctx->opts->int64AsNumber);
+                break;
+
+            case DBUS_TYPE_DOUBLE:
+                dbus_message_iter_get_basic(iter, &doubleValue);
+                lua_pushnumber(L, doubleValue);
+                break;
+
+            case DBUS_TYPE_STRING:
+                dbus_message_iter_get_basic(iter, &strValue);
+                lua_pushstring(L, strValue);
+                break;
+
+            case DBUS_TYPE_OBJECT_PATH:
+                dbus_message_iter_get_basic(iter, &strValue);
+                lua_pushstring(L, strValue);
+                break;
+
+            case DBUS_TYPE_SIGNATURE:
+                dbus_message_iter_get_basic(iter, &strValue);
+                lua_pushstring(L, strValue);
+                break;
+
+            case DBUS_TYPE_ARRAY:
+                dbus_message_iter_recurse(iter, &subIter);
+                elemType = dbus_message_iter_get_element_type(iter);
+                if ( 0 != l2dbus_transcodeFixedTypeSize(elemType) )
+                {
+                    l2dbus_transcodeUnmarshallFixedArray(L, ctx->msg, &subIter,
+                                                        elemType, ctx->opts);
+                    break;
+                }
+
+                /* Dictionaries only populate the hash part of the table */
+                if ( DBUS_TYPE_DICT_ENTRY == elemType )
+                {
+                    lua_createtable(L, 0,
+                                    l2dbus_transcodeCountEntries(&subIter));
+                }
+                else
+                {
+                    lua_newtable(L);
+                }
+                subIdx = 1;
                 while ( DBUS_TYPE_INVALID !=
                     dbus_message_iter_get_arg_type(&subIter) )
                 {
-                    l2dbus_transcodeUnmarshall(L, &subIter, -1, &subIdx);
+                    l2dbus_transcodeUnmarshall(L, &subIter, -1, &subIdx, ctx);
                     dbus_message_iter_next(&subIter);
                 }
                 break;
@@ -3222,45 +3632,57 @@ l2dbus_transcodeUnmarshall
                 while ( DBUS_TYPE_INVALID !=
                     dbus_message_iter_get_arg_type(&subIter) )
                 {
-                    l2dbus_transcodeUnmarshall(L, &subIter, -1, &subIdx);
+                    l2dbus_transcodeUnmarshall(L, &subIter, -1, &subIdx, ctx);
                     dbus_message_iter_next(&subIter);
                 }
                 break;
 
             case DBUS_TYPE_VARIANT:
-                dbus_message_iter_recurse(iter, &subIter);
-                l2dbus_transcodeUnmarshall(L, &subIter, tableIdx, arrIdx);
-                skipArrayAdd = L2DBUS_TRUE;
+                if ( (NULL != ctx->opts) && ctx->opts->rawVariants )
+                {
+                    l2dbus_rawVariantNew(L, ctx->msg, iter);
+                }
+                else
+                {
+                    dbus_message_iter_recurse(iter, &subIter);
+                    l2dbus_transcodeUnmarshall(L, &subIter, tableIdx, arrIdx,
+                                                ctx);
+                    skipArrayAdd = L2DBUS_TRUE;
+                }
                 break;
 
             case DBUS_TYPE_DICT_ENTRY:
                 dbus_message_iter_recurse(iter, &subIter);
-                /* Create a temporary array to hold the key at
-                 * index 1 and the value at index 2
-                 */
-                lua_createtable(L, 2, 0);
-                subIdx = 1;
-                /* Demarshall they key */
-                l2dbus_transcodeUnmarshall(L, &subIter, -1, &subIdx);
+                /* Demarshall the key directly onto the stack */
+                switch ( dbus_message_iter_get_arg_type(&subIter) )
+                {
+                    case DBUS_TYPE_STRING:
+                    case DBUS_TYPE_OBJECT_PATH:
+                    case DBUS_TYPE_SIGNATURE:
+                        dbus_message_iter_get_basic(&subIter, &strValue);
+                        l2dbus_transcodePushKeyString(L, ctx, strValue);
+                        break;
+
+                    default:
+                        l2dbus_transcodeUnmarshall(L, &subIter, tableIdx,
+                                                    NULL, ctx);
+                        break;
+                }
                 if ( !dbus_message_iter_next(&subIter) )
                 {
                     luaL_error(L,
                         "missing value in D-Bus dictionary signature");
                 }
-                /* Demarshall the value */
-                l2dbus_transcodeUnmarshall(L, &subIter, -1, &subIdx);
-                /* Push the key which is store in index 1 */
-                lua_rawgeti(L, -1, 1);
-                /* Push the value stored at index 2*/
-                lua_rawgeti(L, -2, 2);
+                /* Demarshall the value directly onto the stack */
+                l2dbus_transcodeUnmarshall(L, &subIter, tableIdx, NULL, ctx);
                 lua_settable(L, tableIdx);
-                /* Remove the temporary table */
-                lua_pop(L, 1);
                 skipArrayAdd = L2DBUS_TRUE;
                 break;
 
             case DBUS_TYPE_UNIX_FD:
+                /* D-Bus returns a duplicate which belongs to the message */
                 dbus_message_iter_get_basic(iter, &int32Value);
+                l2dbus_messageHoldUnixFd(ctx->msg, int32Value);
                 lua_pushnumber(L, int32Value);
                 break;
 
@@ -3268,10 +3690,18 @@ l2dbus_transcodeUnmarshall
                 L2DBUS_TRACE((L2DBUS_TRC_WARN,
                         "Unsupported D-Bus type to unmarshall (%d)", dbusType));
                 skipArrayAdd = L2DBUS_TRUE;
+                /* A value is always expected when unmarshalling directly */
+                if ( NULL == arrIdx )
+                {
+                    lua_pushnil(L);
+                }
                 break;
         }
 
-        if ( !skipArrayAdd )
+        /* If the value is being added to the array rather than left
+         * on the top of the stack then ...
+         */
+        if ( !skipArrayAdd && (NULL != arrIdx) )
         {
             lua_rawseti(L, tableIdx, *arrIdx);
             *arrIdx += 1;
@@ -3306,11 +3736,7 @@ l2dbus_transcodeLuaArgsToDbusBySignature
     const char*     signature
     )
 {
-    DBusMessageIter msgIt;
-    DBusSignatureIter sigIt;
-    int argLast;
-    argIdx = lua_absindex(L, argIdx);
-    argLast = argIdx + nArgs;
+    l2dbus_SigPlan* plan;
 
     if ( NULL == msg )
     {
@@ -3322,28 +3748,83 @@ l2dbus_transcodeLuaArgsToDbusBySignature
         luaL_error(L, "no signature provided");
     }
 
-    if ( !dbus_signature_validate(signature, NULL) )
+    /* Pre-validated plans for frequently used signatures are cached */
+    plan = l2dbus_sigPlanLookup(signature);
+    if ( NULL == plan )
+    {
+        luaL_error(L, "invalid D-Bus message signature (%s)", signature);
+    }
+
+    l2dbus_transcodeLuaArgsToDbusByPlan(L, msg, argIdx, nArgs, plan);
+}
+
+
+/**
+ * @brief Appends Lua arguments to a D-Bus message using a compiled plan.
+ *
+ * This function takes arguments on the Lua stack and marshalls them into
+ * the D-Bus message guided by a precompiled signature plan. If an error is
+ * encountered then this function will throw a Lua error.
+ *
+ * @param [in] L            The Lua state.
+ * @param [in] msg          The message the arguments will be appended to.
+ * @param [in] argIdx       The Lua stack index where the arguments start.
+ * @param [in] nArgs        The number of arguments on the Lua stack to
+ * marshall.
+ * @param [in] plan         The compiled plan used to encode the arguments.
+ */
+void
+l2dbus_transcodeLuaArgsToDbusByPlan
+    (
+    lua_State*                      L,
+    DBusMessage*                    msg,
+    int                             argIdx,
+    int                             nArgs,
+    const struct l2dbus_SigPlan*    plan
+    )
+{
+    DBusMessageIter msgIt;
+    int argLast;
+    int opIdx = 0;
+    double startTime = l2dbus_statsStart();
+    argIdx = lua_absindex(L, argIdx);
+    argLast = argIdx + nArgs;
+
+    if ( NULL == msg )
+    {
+        luaL_error(L, "no D-Bus message provided");
+    }
+
+    if ( NULL == plan )
     {
-        luaL_error(L, "invalid D-Bus message signature (*s)", signature);
+        luaL_error(L, "no signature provided");
     }
 
     if ( nArgs > 0 )
     {
+        if ( 0 == plan->nOps )
+        {
+            luaL_error(L, "argument/signature mismatch");
+        }
+
         dbus_message_iter_init_append(msg, &msgIt);
-        dbus_signature_iter_init(&sigIt, signature);
 
         do
         {
-            l2dbus_transcodeMarshallAsType(L, argIdx, &msgIt, &sigIt);
+            opIdx = l2dbus_transcodeMarshallByPlan(L, argIdx, &msgIt, plan,
+                                                    opIdx);
             ++argIdx;
         }
-        while ( dbus_signature_iter_next(&sigIt) && (argIdx < argLast) );
+        while ( (opIdx < plan->nOps) && (argIdx < argLast) );
 
         if ( argIdx != argLast )
         {
             luaL_error(L, "argument/signature mismatch");
         }
     }
+
+    l2dbus_statsCountArgs(L2DBUS_TRUE, (unsigned)nArgs);
+    l2dbus_statsRecord(L2DBUS_STATS_HIST_MARSHALL, startTime);
 }
 
 
@@ -3375,17 +3856,23 @@ l2dbus_transcodeLuaArgsToDbus
     DBusSignatureIter sigIt;
     int idx;
     cdbus_StringBuffer* sigBuf = NULL;
+    l2dbus_ArenaMark mark;
+    double startTime = l2dbus_statsStart();
 
     if ( NULL == msg )
     {
         luaL_error(L, "no D-Bus message provided");
     }
 
+    l2dbus_arenaMark(&mark);
     sigBuf = cdbus_stringBufferNew(L2DBUS_DEFAULT_SIGNATURE_LENGTH);
     dbus_message_iter_init_append(msg, &msgIt);
     /* Get the absolute index */
     argIdx = lua_absindex(L, argIdx);
 
+    /* The shape of every table is inferred once for all the arguments */
+    l2dbus_shapeBegin();
+
     for ( idx = 0; idx < nArgs; ++idx )
     {
         lua_pushvalue(L, argIdx + idx);
@@ -3394,6 +3881,7 @@ l2dbus_transcodeLuaArgsToDbus
             !dbus_signature_validate(cdbus_stringBufferRaw(sigBuf), NULL))
         {
             cdbus_stringBufferUnref(sigBuf);
+            l2dbus_shapeEnd();
             luaL_error(L, "cannot convert arg #%d to D-Bus type", argIdx + idx);
         }
         else
@@ -3412,8 +3900,12 @@ l2dbus_transcodeLuaArgsToDbus
             lua_pushlightuserdata(L, &sigIt);
             if ( 0 != lua_pcall(L, 3, 0, 0) )
             {
-                /* Free the signature buffer before the error long jump */
+                /* Free the signature buffer (and any transient arena
+                 * allocations) before the error long jump
+                 */
                 cdbus_stringBufferUnref(sigBuf);
+                l2dbus_arenaRelease(&mark);
+                l2dbus_shapeEnd();
 
                 /* Propagate the Lua error */
                 lua_error(L);
@@ -3424,6 +3916,10 @@ l2dbus_transcodeLuaArgsToDbus
     }
 
     cdbus_stringBufferUnref(sigBuf);
+    l2dbus_shapeEnd();
+
+    l2dbus_statsCountArgs(L2DBUS_TRUE, (unsigned)nArgs);
+    l2dbus_statsRecord(L2DBUS_STATS_HIST_MARSHALL, startTime);
 }
 
 
@@ -3437,17 +3933,21 @@ l2dbus_transcodeLuaArgsToDbus
  *
  * @param [in] L            The Lua state.
  * @param [in] msg          The message containing the D-Bus arguments.
+ * @param [in] opts         Options controlling the conversion (may be NULL).
  */
 int
 l2dbus_transcodeDbusArgsToLuaArray
     (
-    lua_State*      L,
-    DBusMessage*    msg
+    lua_State*                  L,
+    DBusMessage*                msg,
+    const l2dbus_TranscodeOpts* opts
     )
 {
     DBusMessageIter iter;
     int tableIdx;
     int arrIdx = 1;
+    l2dbus_UnmarshallCtx ctx;
+    double startTime = l2dbus_statsStart();
 
     if ( NULL == msg )
     {
@@ -3455,20 +3955,70 @@ l2dbus_transcodeDbusArgsToLuaArray
     }
     else
     {
+        l2dbus_transcodeUnmarshallCtxInit(L, &ctx, msg, opts);
         lua_newtable(L);
         tableIdx = lua_gettop(L);
         dbus_message_iter_init(msg, &iter);
         while ( dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_INVALID )
         {
-            l2dbus_transcodeUnmarshall(L, &iter, tableIdx, &arrIdx);
+            l2dbus_transcodeUnmarshall(L, &iter, tableIdx, &arrIdx, &ctx);
             dbus_message_iter_next(&iter);
         }
+
+        /* Discard the table anchoring any interned keys */
+        if ( 0 != ctx.keyTblIdx )
+        {
+            lua_remove(L, ctx.keyTblIdx);
+        }
+
+        l2dbus_statsCountArgs(L2DBUS_FALSE, (unsigned)(arrIdx - 1));
+        l2dbus_statsRecord(L2DBUS_STATS_HIST_UNMARSHALL, startTime);
     }
 
     return 1;
 }
 
 
+/**
+ * @brief Converts the D-Bus value at an iterator position to a Lua value.
+ *
+ * The decoded value is left on the top of the Lua stack. If an error is
+ * encountered then this function will throw a Lua error.
+ *
+ * @param [in] L            The Lua state.
+ * @param [in] msg          The message the iterator belongs to.
+ * @param [in] iter         Iterator positioned at the value to decode.
+ * @param [in] opts         Options controlling the conversion (may be NULL).
+ */
+void
+l2dbus_transcodeDbusIterToLua
+    (
+    lua_State*                  L,
+    DBusMessage*                msg,
+    DBusMessageIter*            iter,
+    const l2dbus_TranscodeOpts* opts
+    )
+{
+    l2dbus_UnmarshallCtx ctx;
+
+    l2dbus_transcodeUnmarshallCtxInit(L, &ctx, msg, opts);
+    if ( DBUS_TYPE_INVALID == dbus_message_iter_get_arg_type(iter) )
+    {
+        lua_pushnil(L);
+    }
+    else
+    {
+        l2dbus_transcodeUnmarshall(L, iter, -1, NULL, &ctx);
+    }
+
+    /* Discard the table anchoring any interned keys */
+    if ( 0 != ctx.keyTblIdx )
+    {
+        lua_remove(L, ctx.keyTblIdx);
+    }
+}
+
+
 /**
  * @brief Converts D-Bus message arguments to equivalent Lua arguments and
  * leaves them on the Lua stack.
@@ -3479,19 +4029,21 @@ l2dbus_transcodeDbusArgsToLuaArray
  *
  * @param [in] L            The Lua state.
  * @param [in] msg          The message containing the D-Bus arguments.
+ * @param [in] opts         Options controlling the conversion (may be NULL).
  */
 int
 l2dbus_transcodeDbusArgsToLua
     (
-    lua_State*      L,
-    DBusMessage*    msg
+    lua_State*                  L,
+    DBusMessage*                msg,
+    const l2dbus_TranscodeOpts* opts
     )
 {
     size_t  arrLen = 0;
     size_t  idx;
     int tableIdx;
 
-    l2dbus_transcodeDbusArgsToLuaArray(L, msg);
+    l2dbus_transcodeDbusArgsToLuaArray(L, msg, opts);
     if ( LUA_TTABLE == lua_type(L, -1) )
     {
         tableIdx = lua_absindex(L, -1);
@@ -3513,6 +4065,1335 @@ l2dbus_transcodeDbusArgsToLua
 }
 
 
+/*
+ * JSON <-> D-Bus transcoding.
+ *
+ * A JSON document is converted straight into D-Bus arguments (and D-Bus
+ * arguments straight into JSON text) without creating intermediate Lua
+ * values. Arguments are represented by a JSON array holding one element
+ * per complete type of the message signature. Structures map to JSON
+ * arrays, dictionaries to JSON objects (non-string keys are quoted) and
+ * variants to the bare JSON value. The type of a variant decoded from JSON
+ * is inferred: strings become "s", booleans "b", integers "i" (or "x"/"t"
+ * if they don't fit), other numbers "d", arrays "av" and objects "a{sv}".
+ */
+
+/* Variants decoded from JSON can nest arbitrarily so limit their depth */
+#define L2DBUS_JSON_MAX_DEPTH       (64)
+#define L2DBUS_JSON_MAX_NUMBER_LEN  (64)
+
+typedef struct l2dbus_JsonReader
+{
+    const char*     start;
+    const char*     cur;
+    const char*     end;
+    unsigned        depth;
+    /* The first error encountered (a static string) */
+    const char*     errMsg;
+} l2dbus_JsonReader;
+
+
+static l2dbus_Bool
+l2dbus_jsonFail
+    (
+    l2dbus_JsonReader*  rd,
+    const char*         errMsg
+    )
+{
+    if ( NULL == rd->errMsg )
+    {
+        rd->errMsg = errMsg;
+    }
+    return L2DBUS_FALSE;
+}
+
+
+static void
+l2dbus_jsonSkipSpace
+    (
+    l2dbus_JsonReader*  rd
+    )
+{
+    while ( (rd->cur < rd->end) && ((' ' == *rd->cur) || ('\t' == *rd->cur) ||
+            ('\n' == *rd->cur) || ('\r' == *rd->cur)) )
+    {
+        ++rd->cur;
+    }
+}
+
+
+/* Skips leading white space and returns the next character (or zero) */
+static char
+l2dbus_jsonPeek
+    (
+    l2dbus_JsonReader*  rd
+    )
+{
+    l2dbus_jsonSkipSpace(rd);
+    return (rd->cur < rd->end) ? *rd->cur : '\0';
+}
+
+
+static l2dbus_Bool
+l2dbus_jsonExpect
+    (
+    l2dbus_JsonReader*  rd,
+    char                ch,
+    const char*         errMsg
+    )
+{
+    if ( ch != l2dbus_jsonPeek(rd) )
+    {
+        return l2dbus_jsonFail(rd, errMsg);
+    }
+    ++rd->cur;
+    return L2DBUS_TRUE;
+}
+
+
+/*
+ * Consumes the separator between the elements of a JSON array or object.
+ * Returns true if another element follows and false (without an error)
+ * once the closing character has been consumed.
+ */
+static l2dbus_Bool
+l2dbus_jsonNextElement
+    (
+    l2dbus_JsonReader*  rd,
+    char                closeCh
+    )
+{
+    char ch = l2dbus_jsonPeek(rd);
+
+    if ( ',' == ch )
+    {
+        ++rd->cur;
+        if ( closeCh == l2dbus_jsonPeek(rd) )
+        {
+            return l2dbus_jsonFail(rd, "trailing comma");
+        }
+        return L2DBUS_TRUE;
+    }
+    else if ( closeCh == ch )
+    {
+        ++rd->cur;
+    }
+    else
+    {
+        l2dbus_jsonFail(rd, (']' == closeCh) ? "expected ',' or ']'" :
+                                                "expected ',' or '}'");
+    }
+
+    return L2DBUS_FALSE;
+}
+
+
+static l2dbus_Bool
+l2dbus_jsonLiteral
+    (
+    l2dbus_JsonReader*  rd,
+    const char*         literal
+    )
+{
+    size_t len = strlen(literal);
+
+    l2dbus_jsonSkipSpace(rd);
+    if ( ((size_t)(rd->end - rd->cur) < len) ||
+        (0 != memcmp(rd->cur, literal, len)) )
+    {
+        return L2DBUS_FALSE;
+    }
+    rd->cur += len;
+    return L2DBUS_TRUE;
+}
+
+
+static int
+l2dbus_jsonHexDigit
+    (
+    char    ch
+    )
+{
+    if ( (ch >= '0') && (ch <= '9') )
+    {
+        return ch - '0';
+    }
+    else if ( (ch >= 'a') && (ch <= 'f') )
+    {
+        return ch - 'a' + 10;
+    }
+    else if ( (ch >= 'A') && (ch <= 'F') )
+    {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+
+static l2dbus_Bool
+l2dbus_jsonReadHex4
+    (
+    l2dbus_JsonReader*  rd,
+    unsigned*           codePoint
+    )
+{
+    int idx;
+    int digit;
+
+    *codePoint = 0;
+    for ( idx = 0; idx < 4; ++idx )
+    {
+        if ( (rd->cur >= rd->end) ||
+            ((digit = l2dbus_jsonHexDigit(*rd->cur)) < 0) )
+        {
+            return l2dbus_jsonFail(rd, "invalid \\u escape");
+        }
+        *codePoint = (*codePoint << 4) | (unsigned)digit;
+        ++rd->cur;
+    }
+    return L2DBUS_TRUE;
+}
+
+
+/*
+ * Decodes a JSON string into a NUL terminated (UTF-8) string allocated from
+ * the arena. The decoded string is never longer than its JSON encoding.
+ */
+static l2dbus_Bool
+l2dbus_jsonReadString
+    (
+    l2dbus_JsonReader*  rd,
+    char**              str,
+    size_t*             strLen
+    )
+{
+    char* out;
+    size_t len = 0;
+    unsigned cp;
+    unsigned low;
+    char ch;
+
+    if ( !l2dbus_jsonExpect(rd, '"', "expected a string") )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    out = (char*)l2dbus_arenaAlloc((size_t)(rd->end - rd->cur) + 1);
+    if ( NULL == out )
+    {
+        return l2dbus_jsonFail(rd, "out of memory");
+    }
+
+    for ( ;; )
+    {
+        if ( rd->cur >= rd->end )
+        {
+            return l2dbus_jsonFail(rd, "unterminated string");
+        }
+
+        ch = *rd->cur++;
+        if ( '"' == ch )
+        {
+            break;
+        }
+        else if ( (unsigned char)ch < 0x20 )
+        {
+            return l2dbus_jsonFail(rd, "control character in string");
+        }
+        else if ( '\\' != ch )
+        {
+            out[len++] = ch;
+            continue;
+        }
+
+        if ( rd->cur >= rd->end )
+        {
+            return l2dbus_jsonFail(rd, "unterminated string");
+        }
+
+        ch = *rd->cur++;
+        switch ( ch )
+        {
+            case '"':
+            case '\\':
+            case '/':
+                out[len++] = ch;
+                break;
+            case 'b':
+                out[len++] = '\b';
+                break;
+            case 'f':
+                out[len++] = '\f';
+                break;
+            case 'n':
+                out[len++] = '\n';
+                break;
+            case 'r':
+                out[len++] = '\r';
+                break;
+            case 't':
+                out[len++] = '\t';
+                break;
+            case 'u':
+                if ( !l2dbus_jsonReadHex4(rd, &cp) )
+                {
+                    return L2DBUS_FALSE;
+                }
+
+                /* Combine a surrogate pair */
+                if ( (cp >= 0xD800) && (cp <= 0xDBFF) )
+                {
+                    if ( ((rd->end - rd->cur) < 2) || ('\\' != rd->cur[0]) ||
+                        ('u' != rd->cur[1]) )
+                    {
+                        return l2dbus_jsonFail(rd, "unpaired surrogate");
+                    }
+                    rd->cur += 2;
+                    if ( !l2dbus_jsonReadHex4(rd, &low) )
+                    {
+                        return L2DBUS_FALSE;
+                    }
+                    if ( (low < 0xDC00) || (low > 0xDFFF) )
+                    {
+                        return l2dbus_jsonFail(rd, "unpaired surrogate");
+                    }
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                else if ( (cp >= 0xDC00) && (cp <= 0xDFFF) )
+                {
+                    return l2dbus_jsonFail(rd, "unpaired surrogate");
+                }
+
+                /* D-Bus strings cannot hold a NUL character */
+                if ( 0 == cp )
+                {
+                    return l2dbus_jsonFail(rd, "NUL character in string");
+                }
+
+                /* An escape (6 or 12 characters) is never shorter than
+                 * its UTF-8 encoding (at most 3 or 4 bytes).
+                 */
+                if ( cp < 0x80 )
+                {
+                    out[len++] = (char)cp;
+                }
+                else if ( cp < 0x800 )
+                {
+                    out[len++] = (char)(0xC0 | (cp >> 6));
+                    out[len++] = (char)(0x80 | (cp & 0x3F));
+                }
+                else if ( cp < 0x10000 )
+                {
+                    out[len++] = (char)(0xE0 | (cp >> 12));
+                    out[len++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+                    out[len++] = (char)(0x80 | (cp & 0x3F));
+                }
+                else
+                {
+                    out[len++] = (char)(0xF0 | (cp >> 18));
+                    out[len++] = (char)(0x80 | ((cp >> 12) & 0x3F));
+                    out[len++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+                    out[len++] = (char)(0x80 | (cp & 0x3F));
+                }
+                break;
+            default:
+                return l2dbus_jsonFail(rd, "invalid escape in string");
+        }
+    }
+
+    out[len] = '\0';
+    *str = out;
+    if ( NULL != strLen )
+    {
+        *strLen = len;
+    }
+    return L2DBUS_TRUE;
+}
+
+
+/*
+ * Copies the next JSON number into a NUL terminated buffer. The integral
+ * flag is set if the number has neither a fraction nor an exponent.
+ */
+static l2dbus_Bool
+l2dbus_jsonReadNumber
+    (
+    l2dbus_JsonReader*  rd,
+    char*               buf,
+    l2dbus_Bool*        integral
+    )
+{
+    const char* begin;
+    size_t len;
+
+    l2dbus_jsonSkipSpace(rd);
+    begin = rd->cur;
+    *integral = L2DBUS_TRUE;
+
+    if ( (rd->cur < rd->end) && ('-' == *rd->cur) )
+    {
+        ++rd->cur;
+    }
+    if ( (rd->cur >= rd->end) || !isdigit((unsigned char)*rd->cur) )
+    {
+        return l2dbus_jsonFail(rd, "expected a number");
+    }
+    if ( '0' == *rd->cur )
+    {
+        ++rd->cur;
+    }
+    else
+    {
+        while ( (rd->cur < rd->end) && isdigit((unsigned char)*rd->cur) )
+        {
+            ++rd->cur;
+        }
+    }
+    if ( (rd->cur < rd->end) && ('.' == *rd->cur) )
+    {
+        *integral = L2DBUS_FALSE;
+        ++rd->cur;
+        if ( (rd->cur >= rd->end) || !isdigit((unsigned char)*rd->cur) )
+        {
+            return l2dbus_jsonFail(rd, "invalid number");
+        }
+        while ( (rd->cur < rd->end) && isdigit((unsigned char)*rd->cur) )
+        {
+            ++rd->cur;
+        }
+    }
+    if ( (rd->cur < rd->end) && (('e' == *rd->cur) || ('E' == *rd->cur)) )
+    {
+        *integral = L2DBUS_FALSE;
+        ++rd->cur;
+        if ( (rd->cur < rd->end) && (('+' == *rd->cur) || ('-' == *rd->cur)) )
+        {
+            ++rd->cur;
+        }
+        if ( (rd->cur >= rd->end) || !isdigit((unsigned char)*rd->cur) )
+        {
+            return l2dbus_jsonFail(rd, "invalid number");
+        }
+        while ( (rd->cur < rd->end) && isdigit((unsigned char)*rd->cur) )
+        {
+            ++rd->cur;
+        }
+    }
+
+    len = (size_t)(rd->cur - begin);
+    if ( len >= L2DBUS_JSON_MAX_NUMBER_LEN )
+    {
+        return l2dbus_jsonFail(rd, "number is too long");
+    }
+    memcpy(buf, begin, len);
+    buf[len] = '\0';
+    return L2DBUS_TRUE;
+}
+
+
+/*
+ * Appends the number (as text) to the message as the given basic D-Bus
+ * type. Integer types accept any integral number in range.
+ */
+static l2dbus_Bool
+l2dbus_jsonAppendNumber
+    (
+    l2dbus_JsonReader*  rd,
+    DBusMessageIter*    msgIt,
+    int                 dbusType,
+    const char*         text
+    )
+{
+    union
+    {
+        unsigned char   byte;
+        dbus_int16_t    i16;
+        dbus_uint16_t   u16;
+        dbus_int32_t    i32;
+        dbus_uint32_t   u32;
+        dbus_int64_t    i64;
+        dbus_uint64_t   u64;
+        double          dbl;
+    } value;
+    char* endPtr;
+    long long sval = 0;
+    unsigned long long uval = 0;
+    double dval;
+    l2dbus_Bool isUnsigned = (DBUS_TYPE_BYTE == dbusType) ||
+                             (DBUS_TYPE_UINT16 == dbusType) ||
+                             (DBUS_TYPE_UINT32 == dbusType) ||
+                             (DBUS_TYPE_UINT64 == dbusType);
+    l2dbus_Bool inRange;
+
+    if ( DBUS_TYPE_DOUBLE == dbusType )
+    {
+        errno = 0;
+        value.dbl = strtod(text, &endPtr);
+        if ( ('\0' == *text) || ('\0' != *endPtr) || (ERANGE == errno) )
+        {
+            return l2dbus_jsonFail(rd, "invalid double");
+        }
+    }
+    else
+    {
+        errno = 0;
+        if ( isUnsigned )
+        {
+            uval = strtoull(text, &endPtr, 10);
+            inRange = ('-' != *text) && (ERANGE != errno);
+        }
+        else
+        {
+            sval = strtoll(text, &endPtr, 10);
+            inRange = (ERANGE != errno);
+        }
+
+        /* Integral numbers may still be written with a fraction/exponent */
+        if ( ('\0' == *text) || ('\0' != *endPtr) )
+        {
+            errno = 0;
+            dval = strtod(text, &endPtr);
+            if ( ('\0' == *text) || ('\0' != *endPtr) || (ERANGE == errno) ||
+                (dval != floor(dval)) )
+            {
+                return l2dbus_jsonFail(rd, "expected an integer");
+            }
+            if ( isUnsigned )
+            {
+                inRange = (dval >= 0.0) && (dval < 18446744073709551616.0);
+                uval = inRange ? (unsigned long long)dval : 0;
+            }
+            else
+            {
+                inRange = (dval >= -9223372036854775808.0) &&
+                          (dval < 9223372036854775808.0);
+                sval = inRange ? (long long)dval : 0;
+            }
+        }
+
+        switch ( dbusType )
+        {
+            case DBUS_TYPE_BYTE:
+                inRange = inRange && (uval <= UCHAR_MAX);
+                value.byte = (unsigned char)uval;
+                break;
+            case DBUS_TYPE_INT16:
+                inRange = inRange && (sval >= -32768) && (sval <= 32767);
+                value.i16 = (dbus_int16_t)sval;
+                break;
+            case DBUS_TYPE_UINT16:
+                inRange = inRange && (uval <= 65535U);
+                value.u16 = (dbus_uint16_t)uval;
+                break;
+            case DBUS_TYPE_INT32:
+                inRange = inRange && (sval >= INT_MIN) && (sval <= INT_MAX);
+                value.i32 = (dbus_int32_t)sval;
+                break;
+            case DBUS_TYPE_UINT32:
+                inRange = inRange && (uval <= 0xFFFFFFFFULL);
+                value.u32 = (dbus_uint32_t)uval;
+                break;
+            case DBUS_TYPE_INT64:
+                value.i64 = (dbus_int64_t)sval;
+                break;
+            default:
+                value.u64 = (dbus_uint64_t)uval;
+                break;
+        }
+
+        if ( !inRange )
+        {
+            return l2dbus_jsonFail(rd, "integer out of range");
+        }
+    }
+
+    if ( !dbus_message_iter_append_basic(msgIt, dbusType, &value) )
+    {
+        return l2dbus_jsonFail(rd, "could not append number");
+    }
+    return L2DBUS_TRUE;
+}
+
+
+/* Appends a decoded string (or dictionary key) as a basic D-Bus type */
+static l2dbus_Bool
+l2dbus_jsonAppendText
+    (
+    l2dbus_JsonReader*  rd,
+    DBusMessageIter*    msgIt,
+    int                 dbusType,
+    const char*         text
+    )
+{
+    dbus_bool_t boolVal;
+
+    switch ( dbusType )
+    {
+        case DBUS_TYPE_STRING:
+            if ( !l2dbus_validateUtf8(text) )
+            {
+                return l2dbus_jsonFail(rd, "string is not valid UTF-8");
+            }
+            break;
+        case DBUS_TYPE_OBJECT_PATH:
+            if ( !l2dbus_validatePath(text) )
+            {
+                return l2dbus_jsonFail(rd, "invalid object path");
+            }
+            break;
+        case DBUS_TYPE_SIGNATURE:
+            if ( !dbus_signature_validate(text, NULL) )
+            {
+                return l2dbus_jsonFail(rd, "invalid signature");
+            }
+            break;
+        case DBUS_TYPE_BOOLEAN:
+            /* Only as a dictionary key */
+            if ( 0 == strcmp(text, "true") )
+            {
+                boolVal = TRUE;
+            }
+            else if ( 0 == strcmp(text, "false") )
+            {
+                boolVal = FALSE;
+            }
+            else
+            {
+                return l2dbus_jsonFail(rd, "expected a boolean key");
+            }
+            if ( !dbus_message_iter_append_basic(msgIt, dbusType, &boolVal) )
+            {
+                return l2dbus_jsonFail(rd, "could not append boolean");
+            }
+            return L2DBUS_TRUE;
+        case DBUS_TYPE_UNIX_FD:
+            return l2dbus_jsonFail(rd, "unix fds cannot be sent from JSON");
+        default:
+            /* Numeric dictionary keys */
+            return l2dbus_jsonAppendNumber(rd, msgIt, dbusType, text);
+    }
+
+    if ( !dbus_message_iter_append_basic(msgIt, dbusType, &text) )
+    {
+        return l2dbus_jsonFail(rd, "could not append string");
+    }
+    return L2DBUS_TRUE;
+}
+
+
+/* Infers the D-Bus type of the next JSON value (for a variant) */
+static const char*
+l2dbus_jsonInferSignature
+    (
+    l2dbus_JsonReader*  rd
+    )
+{
+    char numBuf[L2DBUS_JSON_MAX_NUMBER_LEN];
+    const char* save;
+    char* endPtr;
+    l2dbus_Bool integral;
+    long long sval;
+
+    switch ( l2dbus_jsonPeek(rd) )
+    {
+        case '"':
+            return DBUS_TYPE_STRING_AS_STRING;
+        case 't':
+        case 'f':
+            return DBUS_TYPE_BOOLEAN_AS_STRING;
+        case '[':
+            return DBUS_TYPE_ARRAY_AS_STRING DBUS_TYPE_VARIANT_AS_STRING;
+        case '{':
+            return DBUS_TYPE_ARRAY_AS_STRING
+                    DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+                    DBUS_TYPE_STRING_AS_STRING DBUS_TYPE_VARIANT_AS_STRING
+                    DBUS_DICT_ENTRY_END_CHAR_AS_STRING;
+        case 'n':
+            l2dbus_jsonFail(rd, "null has no D-Bus equivalent");
+            return NULL;
+        default:
+            /* Look ahead at the number without consuming it */
+            save = rd->cur;
+            if ( !l2dbus_jsonReadNumber(rd, numBuf, &integral) )
+            {
+                return NULL;
+            }
+            rd->cur = save;
+            if ( integral )
+            {
+                errno = 0;
+                sval = strtoll(numBuf, &endPtr, 10);
+                if ( ERANGE != errno )
+                {
+                    return ((sval >= INT_MIN) && (sval <= INT_MAX)) ?
+                            DBUS_TYPE_INT32_AS_STRING :
+                            DBUS_TYPE_INT64_AS_STRING;
+                }
+                else if ( '-' != numBuf[0] )
+                {
+                    errno = 0;
+                    (void)strtoull(numBuf, &endPtr, 10);
+                    if ( ERANGE != errno )
+                    {
+                        return DBUS_TYPE_UINT64_AS_STRING;
+                    }
+                }
+            }
+            return DBUS_TYPE_DOUBLE_AS_STRING;
+    }
+}
+
+
+static l2dbus_Bool
+l2dbus_jsonMarshall
+    (
+    l2dbus_JsonReader*  rd,
+    DBusMessageIter*    msgIt,
+    DBusSignatureIter*  sigIt
+    );
+
+
+/* Opens a container, marshalls its content and closes (or abandons) it */
+static l2dbus_Bool
+l2dbus_jsonMarshallContainer
+    (
+    l2dbus_JsonReader*  rd,
+    DBusMessageIter*    msgIt,
+    DBusSignatureIter*  sigIt,
+    int                 dbusType
+    )
+{
+    DBusSignatureIter sigSubIt;
+    DBusSignatureIter elemSigIt;
+    DBusSignatureIter keySigIt;
+    DBusMessageIter msgSubIt;
+    DBusMessageIter msgEntryIt;
+    l2dbus_ArenaMark mark;
+    const char* contained = NULL;
+    char* key;
+    char* bytes;
+    size_t nBytes;
+    int elemType = DBUS_TYPE_INVALID;
+    l2dbus_Bool ok = L2DBUS_TRUE;
+    l2dbus_Bool more;
+
+    l2dbus_arenaMark(&mark);
+    if ( DBUS_TYPE_VARIANT == dbusType )
+    {
+        contained = l2dbus_jsonInferSignature(rd);
+        if ( NULL == contained )
+        {
+            return L2DBUS_FALSE;
+        }
+        dbus_signature_iter_init(&sigSubIt, contained);
+    }
+    else
+    {
+        dbus_signature_iter_recurse(sigIt, &sigSubIt);
+        if ( DBUS_TYPE_ARRAY == dbusType )
+        {
+            elemType = dbus_signature_iter_get_current_type(&sigSubIt);
+            contained = l2dbus_transcodeArenaSignature(&sigSubIt);
+            if ( NULL == contained )
+            {
+                return l2dbus_jsonFail(rd, "out of memory");
+            }
+        }
+    }
+
+    /* A byte array may be given as a string */
+    if ( (DBUS_TYPE_BYTE == elemType) && ('"' == l2dbus_jsonPeek(rd)) )
+    {
+        ok = l2dbus_jsonReadString(rd, &bytes, &nBytes) &&
+            dbus_message_iter_open_container(msgIt, dbusType, contained,
+                                            &msgSubIt);
+        if ( ok )
+        {
+            ok = dbus_message_iter_append_fixed_array(&msgSubIt,
+                                            DBUS_TYPE_BYTE, &bytes,
+                                            (int)nBytes) ?
+                                            L2DBUS_TRUE : L2DBUS_FALSE;
+            if ( !ok )
+            {
+                l2dbus_jsonFail(rd, "could not append byte array");
+                dbus_message_iter_abandon_container(msgIt, &msgSubIt);
+            }
+            else if ( !dbus_message_iter_close_container(msgIt, &msgSubIt) )
+            {
+                ok = l2dbus_jsonFail(rd, "could not close array");
+            }
+        }
+        l2dbus_arenaRelease(&mark);
+        return ok ? L2DBUS_TRUE : l2dbus_jsonFail(rd, "invalid byte array");
+    }
+
+    if ( DBUS_TYPE_ARRAY == dbusType )
+    {
+        ok = l2dbus_jsonExpect(rd, (DBUS_TYPE_DICT_ENTRY == elemType) ?
+                    '{' : '[', (DBUS_TYPE_DICT_ENTRY == elemType) ?
+                    "expected an object" : "expected an array");
+    }
+    else if ( DBUS_TYPE_STRUCT == dbusType )
+    {
+        ok = l2dbus_jsonExpect(rd, '[', "expected an array for a structure");
+    }
+
+    if ( !ok || !dbus_message_iter_open_container(msgIt, dbusType,
+                (DBUS_TYPE_STRUCT == dbusType) ? NULL : contained,
+                &msgSubIt) )
+    {
+        l2dbus_arenaRelease(&mark);
+        return l2dbus_jsonFail(rd, "could not open D-Bus container");
+    }
+    /* The element signature is only needed to open the container */
+    l2dbus_arenaRelease(&mark);
+
+    if ( ++rd->depth > L2DBUS_JSON_MAX_DEPTH )
+    {
+        ok = l2dbus_jsonFail(rd, "JSON document is nested too deeply");
+    }
+    else if ( DBUS_TYPE_VARIANT == dbusType )
+    {
+        ok = l2dbus_jsonMarshall(rd, &msgSubIt, &sigSubIt);
+    }
+    else if ( DBUS_TYPE_STRUCT == dbusType )
+    {
+        do
+        {
+            ok = l2dbus_jsonMarshall(rd, &msgSubIt, &sigSubIt);
+            more = dbus_signature_iter_next(&sigSubIt);
+            if ( ok && more )
+            {
+                ok = l2dbus_jsonExpect(rd, ',',
+                                "too few structure fields");
+            }
+        }
+        while ( ok && more );
+        ok = ok && l2dbus_jsonExpect(rd, ']', "too many structure fields");
+    }
+    else if ( DBUS_TYPE_DICT_ENTRY == elemType )
+    {
+        dbus_signature_iter_recurse(&sigSubIt, &keySigIt);
+        more = ('}' != l2dbus_jsonPeek(rd));
+        if ( !more )
+        {
+            ++rd->cur;
+        }
+        while ( ok && more )
+        {
+            l2dbus_arenaMark(&mark);
+            elemSigIt = keySigIt;
+            ok = l2dbus_jsonReadString(rd, &key, NULL) &&
+                l2dbus_jsonExpect(rd, ':', "expected ':'");
+            if ( ok && !dbus_message_iter_open_container(&msgSubIt,
+                                DBUS_TYPE_DICT_ENTRY, NULL, &msgEntryIt) )
+            {
+                ok = l2dbus_jsonFail(rd, "could not open dictionary entry");
+            }
+            else if ( ok )
+            {
+                ok = l2dbus_jsonAppendText(rd, &msgEntryIt,
+                            dbus_signature_iter_get_current_type(&elemSigIt),
+                            key);
+                l2dbus_arenaRelease(&mark);
+                dbus_signature_iter_next(&elemSigIt);
+                ok = ok && l2dbus_jsonMarshall(rd, &msgEntryIt, &elemSigIt);
+                if ( !ok )
+                {
+                    dbus_message_iter_abandon_container(&msgSubIt,
+                                                        &msgEntryIt);
+                }
+                else if ( !dbus_message_iter_close_container(&msgSubIt,
+                                                            &msgEntryIt) )
+                {
+                    ok = l2dbus_jsonFail(rd, "could not close dictionary entry");
+                }
+            }
+            l2dbus_arenaRelease(&mark);
+            more = ok && l2dbus_jsonNextElement(rd, '}');
+        }
+    }
+    else
+    {
+        more = (']' != l2dbus_jsonPeek(rd));
+        if ( !more )
+        {
+            ++rd->cur;
+        }
+        while ( ok && more )
+        {
+            elemSigIt = sigSubIt;
+            ok = l2dbus_jsonMarshall(rd, &msgSubIt, &elemSigIt);
+            more = ok && l2dbus_jsonNextElement(rd, ']');
+        }
+    }
+    --rd->depth;
+    ok = ok && (NULL == rd->errMsg);
+
+    if ( !ok )
+    {
+        dbus_message_iter_abandon_container(msgIt, &msgSubIt);
+    }
+    else if ( !dbus_message_iter_close_container(msgIt, &msgSubIt) )
+    {
+        ok = l2dbus_jsonFail(rd, "could not close D-Bus container");
+    }
+
+    return ok;
+}
+
+
+/* Marshalls the next JSON value as the complete type at the signature */
+static l2dbus_Bool
+l2dbus_jsonMarshall
+    (
+    l2dbus_JsonReader*  rd,
+    DBusMessageIter*    msgIt,
+    DBusSignatureIter*  sigIt
+    )
+{
+    char numBuf[L2DBUS_JSON_MAX_NUMBER_LEN];
+    l2dbus_ArenaMark mark;
+    l2dbus_Bool integral;
+    l2dbus_Bool ok;
+    dbus_bool_t boolVal;
+    char* str;
+    int dbusType = dbus_signature_iter_get_current_type(sigIt);
+
+    switch ( dbusType )
+    {
+        case DBUS_TYPE_BYTE:
+        case DBUS_TYPE_INT16:
+        case DBUS_TYPE_UINT16:
+        case DBUS_TYPE_INT32:
+        case DBUS_TYPE_UINT32:
+        case DBUS_TYPE_INT64:
+        case DBUS_TYPE_UINT64:
+        case DBUS_TYPE_DOUBLE:
+            return l2dbus_jsonReadNumber(rd, numBuf, &integral) &&
+                l2dbus_jsonAppendNumber(rd, msgIt, dbusType, numBuf);
+
+        case DBUS_TYPE_BOOLEAN:
+            if ( l2dbus_jsonLiteral(rd, "true") )
+            {
+                boolVal = TRUE;
+            }
+            else if ( l2dbus_jsonLiteral(rd, "false") )
+            {
+                boolVal = FALSE;
+            }
+            else
+            {
+                return l2dbus_jsonFail(rd, "expected a boolean");
+            }
+            if ( !dbus_message_iter_append_basic(msgIt, dbusType, &boolVal) )
+            {
+                return l2dbus_jsonFail(rd, "could not append boolean");
+            }
+            return L2DBUS_TRUE;
+
+        case DBUS_TYPE_STRING:
+        case DBUS_TYPE_OBJECT_PATH:
+        case DBUS_TYPE_SIGNATURE:
+            l2dbus_arenaMark(&mark);
+            ok = l2dbus_jsonReadString(rd, &str, NULL) &&
+                l2dbus_jsonAppendText(rd, msgIt, dbusType, str);
+            l2dbus_arenaRelease(&mark);
+            return ok;
+
+        case DBUS_TYPE_ARRAY:
+        case DBUS_TYPE_STRUCT:
+        case DBUS_TYPE_VARIANT:
+            return l2dbus_jsonMarshallContainer(rd, msgIt, sigIt, dbusType);
+
+        case DBUS_TYPE_UNIX_FD:
+            return l2dbus_jsonFail(rd, "unix fds cannot be sent from JSON");
+
+        default:
+            return l2dbus_jsonFail(rd, "unsupported D-Bus type");
+    }
+}
+
+
+/**
+ * @brief Appends the arguments described by a JSON document to a message.
+ *
+ * The document must be a JSON array with one element for each complete
+ * type in the signature. The JSON is converted directly to D-Bus without
+ * creating any Lua values. If an error is encountered then this function
+ * throws a Lua error which includes the offset of the error in the
+ * document. No arguments are appended after the first error but the
+ * arguments preceding it remain in the message.
+ *
+ * @param [in] L            The Lua state.
+ * @param [in] msg          The message the arguments will be appended to.
+ * @param [in] signature    The signature of the arguments.
+ * @param [in] json         The JSON document.
+ * @param [in] jsonLen      The length of the JSON document.
+ */
+void
+l2dbus_transcodeJsonToDbus
+    (
+    lua_State*      L,
+    DBusMessage*    msg,
+    const char*     signature,
+    const char*     json,
+    size_t          jsonLen
+    )
+{
+    l2dbus_JsonReader rd;
+    DBusMessageIter msgIt;
+    DBusSignatureIter sigIt;
+    unsigned nArgs = 0;
+    l2dbus_Bool ok;
+    l2dbus_Bool more;
+    double startTime = l2dbus_statsStart();
+
+    if ( NULL == msg )
+    {
+        luaL_error(L, "no D-Bus message provided");
+    }
+
+    if ( (NULL == signature) || !dbus_signature_validate(signature, NULL) )
+    {
+        luaL_error(L, "invalid D-Bus message signature (%s)",
+                    (NULL == signature) ? "none" : signature);
+    }
+
+    memset(&rd, 0, sizeof(rd));
+    rd.start = json;
+    rd.cur = json;
+    rd.end = json + jsonLen;
+
+    dbus_message_iter_init_append(msg, &msgIt);
+    ok = l2dbus_jsonExpect(&rd, '[', "expected an array of arguments");
+    if ( ok && ('\0' == *signature) )
+    {
+        ok = l2dbus_jsonExpect(&rd, ']', "too many arguments");
+    }
+    else if ( ok )
+    {
+        dbus_signature_iter_init(&sigIt, signature);
+        do
+        {
+            ok = l2dbus_jsonMarshall(&rd, &msgIt, &sigIt);
+            ++nArgs;
+            more = dbus_signature_iter_next(&sigIt);
+            if ( ok && more )
+            {
+                ok = l2dbus_jsonExpect(&rd, ',', "too few arguments");
+            }
+        }
+        while ( ok && more );
+        ok = ok && l2dbus_jsonExpect(&rd, ']', "too many arguments");
+    }
+
+    if ( ok && ('\0' != l2dbus_jsonPeek(&rd)) )
+    {
+        ok = l2dbus_jsonFail(&rd, "unexpected data after the arguments");
+    }
+
+    if ( !ok )
+    {
+        luaL_error(L, "invalid JSON arguments at offset %d: %s",
+                    (int)(rd.cur - rd.start),
+                    (NULL != rd.errMsg) ? rd.errMsg : "unknown error");
+    }
+
+    l2dbus_statsCountArgs(L2DBUS_TRUE, nArgs);
+    l2dbus_statsRecord(L2DBUS_STATS_HIST_MARSHALL, startTime);
+}
+
+
+static void
+l2dbus_jsonAddString
+    (
+    luaL_Buffer*    buf,
+    const char*     str
+    )
+{
+    char esc[8];
+    unsigned char ch;
+
+    luaL_addchar(buf, '"');
+    while ( '\0' != (ch = (unsigned char)*str++) )
+    {
+        if ( ('"' == ch) || ('\\' == ch) )
+        {
+            luaL_addchar(buf, '\\');
+            luaL_addchar(buf, (char)ch);
+        }
+        else if ( '\n' == ch )
+        {
+            luaL_addstring(buf, "\\n");
+        }
+        else if ( '\t' == ch )
+        {
+            luaL_addstring(buf, "\\t");
+        }
+        else if ( '\r' == ch )
+        {
+            luaL_addstring(buf, "\\r");
+        }
+        else if ( ch < 0x20 )
+        {
+            snprintf(esc, sizeof(esc), "\\u%04x", ch);
+            luaL_addstring(buf, esc);
+        }
+        else
+        {
+            luaL_addchar(buf, (char)ch);
+        }
+    }
+    luaL_addchar(buf, '"');
+}
+
+
+/* Writes a basic D-Bus value (quoted if it's a dictionary key) as JSON */
+static void
+l2dbus_jsonAddBasic
+    (
+    lua_State*          L,
+    luaL_Buffer*        buf,
+    DBusMessageIter*    msgIt,
+    int                 dbusType,
+    l2dbus_Bool         asKey
+    )
+{
+    union
+    {
+        unsigned char   byte;
+        dbus_bool_t     boolean;
+        dbus_int16_t    i16;
+        dbus_uint16_t   u16;
+        dbus_int32_t    i32;
+        dbus_uint32_t   u32;
+        dbus_int64_t    i64;
+        dbus_uint64_t   u64;
+        double          dbl;
+        const char*     str;
+    } value;
+    char text[40];
+
+    dbus_message_iter_get_basic(msgIt, &value);
+    switch ( dbusType )
+    {
+        case DBUS_TYPE_STRING:
+        case DBUS_TYPE_OBJECT_PATH:
+        case DBUS_TYPE_SIGNATURE:
+            l2dbus_jsonAddString(buf, value.str);
+            return;
+        case DBUS_TYPE_BOOLEAN:
+            strcpy(text, value.boolean ? "true" : "false");
+            break;
+        case DBUS_TYPE_BYTE:
+            snprintf(text, sizeof(text), "%u", (unsigned)value.byte);
+            break;
+        case DBUS_TYPE_INT16:
+            snprintf(text, sizeof(text), "%d", (int)value.i16);
+            break;
+        case DBUS_TYPE_UINT16:
+            snprintf(text, sizeof(text), "%u", (unsigned)value.u16);
+            break;
+        case DBUS_TYPE_INT32:
+            snprintf(text, sizeof(text), "%ld", (long)value.i32);
+            break;
+        case DBUS_TYPE_UINT32:
+            snprintf(text, sizeof(text), "%lu", (unsigned long)value.u32);
+            break;
+        case DBUS_TYPE_INT64:
+            snprintf(text, sizeof(text), "%lld", (long long)value.i64);
+            break;
+        case DBUS_TYPE_UINT64:
+            snprintf(text, sizeof(text), "%llu",
+                    (unsigned long long)value.u64);
+            break;
+        case DBUS_TYPE_DOUBLE:
+            /* JSON has no representation for NaN or infinity */
+            if ( (value.dbl != value.dbl) || ((value.dbl - value.dbl) != 0.0) )
+            {
+                strcpy(text, "null");
+            }
+            else
+            {
+                snprintf(text, sizeof(text), "%.17g", value.dbl);
+            }
+            break;
+        default:
+            luaL_error(L, "cannot represent D-Bus type '%c' in JSON",
+                        (char)dbusType);
+            return;
+    }
+
+    if ( asKey )
+    {
+        luaL_addchar(buf, '"');
+        luaL_addstring(buf, text);
+        luaL_addchar(buf, '"');
+    }
+    else
+    {
+        luaL_addstring(buf, text);
+    }
+}
+
+
+static void
+l2dbus_jsonUnmarshall
+    (
+    lua_State*          L,
+    luaL_Buffer*        buf,
+    DBusMessageIter*    msgIt
+    )
+{
+    DBusMessageIter msgSubIt;
+    DBusMessageIter msgEntryIt;
+    const unsigned char* bytes;
+    char text[8];
+    int nBytes;
+    int idx;
+    int dbusType = dbus_message_iter_get_arg_type(msgIt);
+    int elemType;
+    l2dbus_Bool first = L2DBUS_TRUE;
+
+    switch ( dbusType )
+    {
+        case DBUS_TYPE_ARRAY:
+            elemType = dbus_message_iter_get_element_type(msgIt);
+            dbus_message_iter_recurse(msgIt, &msgSubIt);
+            if ( DBUS_TYPE_DICT_ENTRY == elemType )
+            {
+                luaL_addchar(buf, '{');
+                while ( DBUS_TYPE_INVALID !=
+                        dbus_message_iter_get_arg_type(&msgSubIt) )
+                {
+                    if ( !first )
+                    {
+                        luaL_addchar(buf, ',');
+                    }
+                    first = L2DBUS_FALSE;
+                    dbus_message_iter_recurse(&msgSubIt, &msgEntryIt);
+                    l2dbus_jsonAddBasic(L, buf, &msgEntryIt,
+                            dbus_message_iter_get_arg_type(&msgEntryIt),
+                            L2DBUS_TRUE);
+                    luaL_addchar(buf, ':');
+                    dbus_message_iter_next(&msgEntryIt);
+                    l2dbus_jsonUnmarshall(L, buf, &msgEntryIt);
+                    dbus_message_iter_next(&msgSubIt);
+                }
+                luaL_addchar(buf, '}');
+            }
+            else if ( DBUS_TYPE_BYTE == elemType )
+            {
+                luaL_addchar(buf, '[');
+                dbus_message_iter_get_fixed_array(&msgSubIt, &bytes, &nBytes);
+                for ( idx = 0; idx < nBytes; ++idx )
+                {
+                    snprintf(text, sizeof(text), (0 == idx) ? "%u" : ",%u",
+                            (unsigned)bytes[idx]);
+                    luaL_addstring(buf, text);
+                }
+                luaL_addchar(buf, ']');
+            }
+            else
+            {
+                luaL_addchar(buf, '[');
+                while ( DBUS_TYPE_INVALID !=
+                        dbus_message_iter_get_arg_type(&msgSubIt) )
+                {
+                    if ( !first )
+                    {
+                        luaL_addchar(buf, ',');
+                    }
+                    first = L2DBUS_FALSE;
+                    l2dbus_jsonUnmarshall(L, buf, &msgSubIt);
+                    dbus_message_iter_next(&msgSubIt);
+                }
+                luaL_addchar(buf, ']');
+            }
+            break;
+
+        case DBUS_TYPE_STRUCT:
+            luaL_addchar(buf, '[');
+            dbus_message_iter_recurse(msgIt, &msgSubIt);
+            while ( DBUS_TYPE_INVALID !=
+                    dbus_message_iter_get_arg_type(&msgSubIt) )
+            {
+                if ( !first )
+                {
+                    luaL_addchar(buf, ',');
+                }
+                first = L2DBUS_FALSE;
+                l2dbus_jsonUnmarshall(L, buf, &msgSubIt);
+                dbus_message_iter_next(&msgSubIt);
+            }
+            luaL_addchar(buf, ']');
+            break;
+
+        case DBUS_TYPE_VARIANT:
+            dbus_message_iter_recurse(msgIt, &msgSubIt);
+            l2dbus_jsonUnmarshall(L, buf, &msgSubIt);
+            break;
+
+        default:
+            l2dbus_jsonAddBasic(L, buf, msgIt, dbusType, L2DBUS_FALSE);
+            break;
+    }
+}
+
+
+/**
+ * @brief Converts the D-Bus message arguments to a JSON document.
+ *
+ * The document is a JSON array holding one element for each argument and
+ * is left on the top of the Lua stack as a string. No other Lua values are
+ * created. If an argument cannot be represented in JSON (e.g. a unix fd)
+ * then a Lua error is thrown.
+ *
+ * @param [in] L            The Lua state.
+ * @param [in] msg          The message containing the D-Bus arguments.
+ * @return The number of values pushed on the Lua stack (1).
+ */
+int
+l2dbus_transcodeDbusArgsToJson
+    (
+    lua_State*      L,
+    DBusMessage*    msg
+    )
+{
+    DBusMessageIter msgIt;
+    luaL_Buffer buf;
+    unsigned nArgs = 0;
+    double startTime = l2dbus_statsStart();
+
+    if ( NULL == msg )
+    {
+        luaL_error(L, "D-Bus message is missing");
+    }
+
+    luaL_buffinit(L, &buf);
+    luaL_addchar(&buf, '[');
+    dbus_message_iter_init(msg, &msgIt);
+    while ( DBUS_TYPE_INVALID != dbus_message_iter_get_arg_type(&msgIt) )
+    {
+        if ( 0 != nArgs )
+        {
+            luaL_addchar(&buf, ',');
+        }
+        l2dbus_jsonUnmarshall(L, &buf, &msgIt);
+        dbus_message_iter_next(&msgIt);
+        ++nArgs;
+    }
+    luaL_addchar(&buf, ']');
+    luaL_pushresult(&buf);
+
+    l2dbus_statsCountArgs(L2DBUS_FALSE, nArgs);
+    l2dbus_statsRecord(L2DBUS_STATS_HIST_UNMARSHALL, startTime);
+
+    return 1;
+}
+
+
 /**
  * @brief Creates a metatable for a D-Bus type wrapper class.
  */
@@ -27,7 +27,14 @@
 #ifndef L2DBUS_TRANSCODE_H_
 #define L2DBUS_TRANSCODE_H_
 #include "lua.h"
+#include "l2dbus_types.h"
 
+/* The initial size of the buffers holding computed signatures */
+#define L2DBUS_DEFAULT_SIGNATURE_LENGTH (32)
+
+/* Forward declarations */
+struct l2dbus_SigPlan;
+struct cdbus_StringBuffer;
 
 typedef struct l2dbus_DbusValue
 {
@@ -35,11 +42,44 @@ typedef struct l2dbus_DbusValue
     char* signature;
 } l2dbus_DbusValue;
 
+/* Options that control how D-Bus arguments are converted to Lua */
+typedef struct l2dbus_TranscodeOpts
+{
+    /* Decode byte arrays ("ay") as Lua strings rather than tables */
+    l2dbus_Bool byteArrayAsString;
+    /* Decode byte arrays ("ay") as l2dbus.Buffer values referring to the message */
+    l2dbus_Bool byteArrayAsBuffer;
+    /* Re-use a single Lua string for repeated dictionary keys */
+    l2dbus_Bool internKeys;
+    /* Decode 64-bit integers as Lua numbers when that is lossless */
+    l2dbus_Bool int64AsNumber;
+    /* Decode variants as (lazily decoded) l2dbus.RawVariant handles */
+    l2dbus_Bool rawVariants;
+} l2dbus_TranscodeOpts;
+
 void l2dbus_transcodeLuaArgsToDbusBySignature(lua_State* L, DBusMessage* msg, int argIdx,
                                              int nArgs, const char* signature);
+void l2dbus_transcodeLuaArgsToDbusByPlan(lua_State* L, DBusMessage* msg, int argIdx,
+                                        int nArgs, const struct l2dbus_SigPlan* plan);
 void l2dbus_transcodeLuaArgsToDbus(lua_State* L, DBusMessage* msg, int argIdx, int nArgs);
-int l2dbus_transcodeDbusArgsToLuaArray(lua_State* L, DBusMessage* msg);
-int l2dbus_transcodeDbusArgsToLua(lua_State* L, DBusMessage* msg);
+int l2dbus_transcodeDbusArgsToLuaArray(lua_State* L, DBusMessage* msg,
+                                        const l2dbus_TranscodeOpts* opts);
+int l2dbus_transcodeDbusArgsToLua(lua_State* L, DBusMessage* msg,
+                                    const l2dbus_TranscodeOpts* opts);
+void l2dbus_transcodeDbusIterToLua(lua_State* L, DBusMessage* msg,
+                                    DBusMessageIter* iter,
+                                    const l2dbus_TranscodeOpts* opts);
+void l2dbus_transcodeJsonToDbus(lua_State* L, DBusMessage* msg,
+                                const char* signature, const char* json,
+                                size_t jsonLen);
+int l2dbus_transcodeDbusArgsToJson(lua_State* L, DBusMessage* msg);
+l2dbus_Bool l2dbus_dbusQueryDbusTypeId(lua_State* L, int idx, int* typeId);
+l2dbus_Bool l2dbus_dbusComputeSignature(lua_State* L, int argIdx,
+                                        struct cdbus_StringBuffer* sigBuf,
+                                        int level);
+size_t l2dbus_transcodeFixedTypeSize(int dbusType);
+l2dbus_Bool l2dbus_transcodeToFixedValue(lua_State* L, int idx, int dbusType,
+                                        void* value);
 int l2dbus_openTranscode(lua_State* L);
 
 #endif /* Guard for L2DBUS_TRANSCODE_H_ */
@@ -41,6 +41,17 @@ const char L2DBUS_SERVICE_OBJECT_MTBL_NAME[] = L2DBUS_MAKE_METANAME("service_obj
 const char L2DBUS_INTERFACE_MTBL_NAME[] = L2DBUS_MAKE_METANAME("interface");
 const char L2DBUS_INT64_MTBL_NAME[] = L2DBUS_MAKE_METANAME("int64");
 const char L2DBUS_UINT64_MTBL_NAME[] = L2DBUS_MAKE_METANAME("uint64");
+const char L2DBUS_SIGNATURE_PLAN_MTBL_NAME[] = L2DBUS_MAKE_METANAME("signature_plan");
+const char L2DBUS_CALL_TEMPLATE_MTBL_NAME[] = L2DBUS_MAKE_METANAME("call_template");
+const char L2DBUS_OBJECT_MANAGER_MTBL_NAME[] = L2DBUS_MAKE_METANAME("object_manager");
+const char L2DBUS_RAW_VARIANT_MTBL_NAME[] = L2DBUS_MAKE_METANAME("raw_variant");
+const char L2DBUS_ARG_CURSOR_MTBL_NAME[] = L2DBUS_MAKE_METANAME("arg_cursor");
+const char L2DBUS_TIMER_WHEEL_MTBL_NAME[] = L2DBUS_MAKE_METANAME("timer_wheel");
+const char L2DBUS_CHANNEL_MTBL_NAME[] = L2DBUS_MAKE_METANAME("channel");
+const char L2DBUS_CONTEXT_MTBL_NAME[] = L2DBUS_MAKE_METANAME("context");
+const char L2DBUS_SERVER_MTBL_NAME[] = L2DBUS_MAKE_METANAME("server");
+const char L2DBUS_SHARED_MEMORY_MTBL_NAME[] = L2DBUS_MAKE_METANAME("shared_memory");
+const char L2DBUS_BUFFER_MTBL_NAME[] = L2DBUS_MAKE_METANAME("buffer");
 
 const char L2DBUS_DBUS_START_MTBL_NAME[] = "";
 const char L2DBUS_DBUS_INVALID_MTBL_NAME[] = L2DBUS_MAKE_METANAME("dbus.invalid");
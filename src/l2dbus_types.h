@@ -58,6 +58,17 @@ X(L2DBUS_SERVICE_OBJECT_TYPE_ID, L2DBUS_SERVICE_OBJECT_MTBL_NAME) \
 X(L2DBUS_INTERFACE_TYPE_ID, L2DBUS_INTERFACE_MTBL_NAME) \
 X(L2DBUS_INT64_TYPE_ID, L2DBUS_INT64_MTBL_NAME) \
 X(L2DBUS_UINT64_TYPE_ID, L2DBUS_UINT64_MTBL_NAME) \
+X(L2DBUS_SIGNATURE_PLAN_TYPE_ID, L2DBUS_SIGNATURE_PLAN_MTBL_NAME) \
+X(L2DBUS_CALL_TEMPLATE_TYPE_ID, L2DBUS_CALL_TEMPLATE_MTBL_NAME) \
+X(L2DBUS_OBJECT_MANAGER_TYPE_ID, L2DBUS_OBJECT_MANAGER_MTBL_NAME) \
+X(L2DBUS_RAW_VARIANT_TYPE_ID, L2DBUS_RAW_VARIANT_MTBL_NAME) \
+X(L2DBUS_ARG_CURSOR_TYPE_ID, L2DBUS_ARG_CURSOR_MTBL_NAME) \
+X(L2DBUS_TIMER_WHEEL_TYPE_ID, L2DBUS_TIMER_WHEEL_MTBL_NAME) \
+X(L2DBUS_CHANNEL_TYPE_ID, L2DBUS_CHANNEL_MTBL_NAME) \
+X(L2DBUS_CONTEXT_TYPE_ID, L2DBUS_CONTEXT_MTBL_NAME) \
+X(L2DBUS_SERVER_TYPE_ID, L2DBUS_SERVER_MTBL_NAME) \
+X(L2DBUS_SHARED_MEMORY_TYPE_ID, L2DBUS_SHARED_MEMORY_MTBL_NAME) \
+X(L2DBUS_BUFFER_TYPE_ID, L2DBUS_BUFFER_MTBL_NAME) \
 \
 X(L2DBUS_START_DBUS_TYPE_ID, L2DBUS_DBUS_START_MTBL_NAME) \
 X(L2DBUS_DBUS_INVALID_TYPE_ID, L2DBUS_DBUS_INVALID_MTBL_NAME) \
@@ -74,6 +74,17 @@
 
 
 
+#if defined(LUA_MAXINTEGER) && (LUA_MAXINTEGER >= INT64_MAX)
+/* Lua integers hold any Uint64 up to INT64_MAX */
+#define L2DBUS_UINT64_IS_LOSSLESS(v) ((v) <= (uint64_t)INT64_MAX)
+#define L2DBUS_UINT64_PUSH(L, v)     lua_pushinteger(L, (lua_Integer)(v))
+#else
+/* A Lua double represents integers up to 2^53 exactly */
+#define L2DBUS_UINT64_IS_LOSSLESS(v) ((v) <= (((uint64_t)1) << 53))
+#define L2DBUS_UINT64_PUSH(L, v)     lua_pushnumber(L, (lua_Number)(v))
+#endif
+
+
 static uint64_t
 l2dbus_uint64Cast
     (
@@ -118,7 +129,7 @@ l2dbus_uint64Cast
 
         case LUA_TUSERDATA:
             uint64Ud = (l2dbus_Uint64*)l2dbus_isUserData(L, numIdx,
-                                    L2DBUS_UINT64_MTBL_NAME);
+                                    L2DBUS_UINT64_TYPE_ID);
             if ( NULL != uint64Ud )
             {
                 value = uint64Ud->value;
@@ -126,7 +137,7 @@ l2dbus_uint64Cast
             else
             {
                 int64Ud = (l2dbus_Int64*)l2dbus_isUserData(L, numIdx,
-                                            L2DBUS_INT64_MTBL_NAME);
+                                            L2DBUS_INT64_TYPE_ID);
                 if ( NULL != int64Ud )
                 {
                     value = (uint64_t)int64Ud->value;
@@ -177,6 +188,40 @@ l2dbus_uint64Create
 }
 
 
+/**
+ * @brief Pushes a Uint64 value on the Lua stack.
+ *
+ * If a native Lua number is requested and can represent the value without
+ * any loss of precision then a Lua number (an integer on Lua 5.3+) is
+ * pushed otherwise a Uint64 userdata is created.
+ *
+ * @param [in] L        The Lua state.
+ * @param [in] value    The value to push.
+ * @param [in] asNumber Set to L2DBUS_TRUE to push a Lua number when the
+ * conversion is lossless.
+ */
+void
+l2dbus_uint64Push
+    (
+    lua_State*  L,
+    uint64_t    value,
+    l2dbus_Bool asNumber
+    )
+{
+    l2dbus_Uint64* ud;
+
+    if ( asNumber && L2DBUS_UINT64_IS_LOSSLESS(value) )
+    {
+        L2DBUS_UINT64_PUSH(L, value);
+    }
+    else
+    {
+        ud = l2dbus_objectNew(L, sizeof(*ud), L2DBUS_UINT64_TYPE_ID);
+        ud->value = value;
+    }
+}
+
+
 /**
  @function new
 
@@ -434,8 +479,8 @@ l2dbus_uint64ToString
     lua_State*  L
     )
 {
-    l2dbus_Uint64* ud = (l2dbus_Uint64*)luaL_checkudata(L, 1,
-                        l2dbus_getNameByTypeId(L2DBUS_UINT64_TYPE_ID));
+    l2dbus_Uint64* ud = (l2dbus_Uint64*)l2dbus_checkUserData(L, 1,
+                        L2DBUS_UINT64_TYPE_ID);
     int base = 10;
     int nArgs = lua_gettop(L);
     char fmt[16];
@@ -504,14 +549,99 @@ l2dbus_uint64Dispose
     )
 {
     /* Nothing to explicitly free */
-    l2dbus_Uint64* ud = (l2dbus_Uint64*)luaL_checkudata(L, -1,
-                        l2dbus_getNameByTypeId(L2DBUS_UINT64_TYPE_ID));
+    l2dbus_Uint64* ud = (l2dbus_Uint64*)l2dbus_checkUserData(L, -1,
+                        L2DBUS_UINT64_TYPE_ID);
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: Uint64 (userdata=%p)", ud));
     return 0;
 }
 
 
+/**
+ @function addAssign
+ @within l2dbus.Uint64
+
+ Adds a value to the Uint64 in place.
+
+ Unlike the arithmetic operators this does not allocate a new Uint64 which
+ makes it suitable for accumulating (e.g. counters) in a loop.
+
+ @tparam userdata acc The Uint64 to modify.
+ @tparam number|userdata value The value to add.
+ @treturn userdata The modified Uint64 (*acc*).
+ */
+static int
+l2dbus_uint64AddAssign
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Uint64* ud = (l2dbus_Uint64*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_UINT64_TYPE_ID);
+    uint64_t v = l2dbus_uint64Cast(L, 2, L2DUS_INVALID_STACK_INDEX);
+
+    ud->value += v;
+    lua_settop(L, 1);
+    return 1;
+}
+
+
+/**
+ @function subAssign
+ @within l2dbus.Uint64
+
+ Subtracts a value from the Uint64 in place.
+
+ See @{addAssign}.
+
+ @tparam userdata acc The Uint64 to modify.
+ @tparam number|userdata value The value to subtract.
+ @treturn userdata The modified Uint64 (*acc*).
+ */
+static int
+l2dbus_uint64SubAssign
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Uint64* ud = (l2dbus_Uint64*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_UINT64_TYPE_ID);
+    uint64_t v = l2dbus_uint64Cast(L, 2, L2DUS_INVALID_STACK_INDEX);
+
+    ud->value -= v;
+    lua_settop(L, 1);
+    return 1;
+}
+
+
+/**
+ @function mulAssign
+ @within l2dbus.Uint64
+
+ Multiplies the Uint64 by a value in place.
+
+ See @{addAssign}.
+
+ @tparam userdata acc The Uint64 to modify.
+ @tparam number|userdata value The value to multiply by.
+ @treturn userdata The modified Uint64 (*acc*).
+ */
+static int
+l2dbus_uint64MulAssign
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Uint64* ud = (l2dbus_Uint64*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_UINT64_TYPE_ID);
+    uint64_t v = l2dbus_uint64Cast(L, 2, L2DUS_INVALID_STACK_INDEX);
+
+    ud->value *= v;
+    lua_settop(L, 1);
+    return 1;
+}
+
+
 /*
  * Define the methods of the Uint64 class
  */
@@ -530,6 +660,9 @@ static const luaL_Reg l2dbus_uint64MetaTable[] = {
     {"__tostring", l2dbus_uint64ToString},
     {"toString", l2dbus_uint64ToString},
     {"toNumber", l2dbus_uint64ToNumber},
+    {"addAssign", l2dbus_uint64AddAssign},
+    {"subAssign", l2dbus_uint64SubAssign},
+    {"mulAssign", l2dbus_uint64MulAssign},
     {"__concat", l2dbus_uint64Concat},
     {"__gc", l2dbus_uint64Dispose},
     {NULL, NULL},
@@ -29,6 +29,7 @@
 
 #include <stdint.h>
 #include "lua.h"
+#include "l2dbus_types.h"
 
 extern const char L2DBUS_UINT64_MTBL_NAME[];
 
@@ -38,6 +39,7 @@ typedef struct l2dbus_Uint64
 } l2dbus_Uint64;
 
 int l2dbus_uint64Create(lua_State* L, int idx, int base);
+void l2dbus_uint64Push(lua_State* L, uint64_t value, l2dbus_Bool asNumber);
 void l2dbus_openUint64(lua_State* L);
 
 #endif /* Guard for L2DBUS_UINT64_H_ */
@@ -31,6 +31,8 @@
  *===========================================================================
  */
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 #include "l2dbus_util.h"
 #include "lauxlib.h"
 #include "l2dbus_debug.h"
@@ -38,35 +40,6 @@
 #include "l2dbus_defs.h"
 
 
-void*
-l2dbus_isUserData
-    (
-    lua_State*  L,
-    int         udIdx,
-    const char* typeName
-    )
-{
-    /* Is value a userdata? */
-    void *p = lua_touserdata(L, udIdx);
-    if ( NULL != p )
-    {
-        /* Does it have a metatable? */
-        if ( lua_getmetatable(L, udIdx) && (NULL != typeName) )
-        {
-            lua_getfield(L, LUA_REGISTRYINDEX, typeName);
-            /* Does it have the correct mt? */
-            if ( !lua_rawequal(L, -1, -2) )
-            {
-                p = NULL;
-            }
-            lua_pop(L, 2);
-            return p;
-        }
-    }
-    return NULL;
-}
-
-
 void
 l2dbus_cdbusError
     (
@@ -256,3 +229,160 @@ l2dbus_checkString
     return lua_tostring(L, nArg);
 }
 
+
+
+/**
+ * @brief Copies the current D-Bus value of one message iterator to another.
+ *
+ * Arrays of fixed-size types are copied as a single block. The source
+ * iterator is not advanced.
+ *
+ * @param [in] srcIt An iterator positioned on the value to copy.
+ * @param [in] dstIt An iterator to append the value to.
+ * @return L2DBUS_TRUE if the value was copied or L2DBUS_FALSE if
+ * memory could not be allocated.
+ */
+l2dbus_Bool
+l2dbus_copyMessageValue
+    (
+    DBusMessageIter*    srcIt,
+    DBusMessageIter*    dstIt
+    )
+{
+    union
+    {
+        dbus_uint64_t   u64;
+        double          dbl;
+        const char*     str;
+        int             fd;
+    } basic;
+    DBusMessageIter srcSubIt;
+    DBusMessageIter dstSubIt;
+    const void* fixed;
+    char* signature;
+    int dbusType = dbus_message_iter_get_arg_type(srcIt);
+    int elemType;
+    int nElems;
+    l2dbus_Bool isOk = L2DBUS_TRUE;
+
+    if ( DBUS_TYPE_INVALID == dbusType )
+    {
+        /* Nothing to copy */
+    }
+    else if ( dbus_type_is_basic(dbusType) )
+    {
+        dbus_message_iter_get_basic(srcIt, &basic);
+        isOk = dbus_message_iter_append_basic(dstIt, dbusType, &basic);
+
+        /* Reading a Unix fd returns a duplicate that the destination
+         * message has duplicated again.
+         */
+        if ( (DBUS_TYPE_UNIX_FD == dbusType) && (0 <= basic.fd) )
+        {
+            close(basic.fd);
+        }
+    }
+    else
+    {
+        dbus_message_iter_recurse(srcIt, &srcSubIt);
+        elemType = (DBUS_TYPE_ARRAY == dbusType) ?
+                    dbus_message_iter_get_element_type(srcIt) :
+                    DBUS_TYPE_INVALID;
+
+        /* Arrays need the element signature, variants the signature of
+         * the contained value and structures/dict entries none at all.
+         */
+        signature = NULL;
+        if ( DBUS_TYPE_ARRAY == dbusType )
+        {
+            signature = dbus_message_iter_get_signature(srcIt);
+        }
+        else if ( DBUS_TYPE_VARIANT == dbusType )
+        {
+            signature = dbus_message_iter_get_signature(&srcSubIt);
+        }
+
+        isOk = dbus_message_iter_open_container(dstIt, dbusType,
+                    ((NULL != signature) && (DBUS_TYPE_ARRAY == dbusType)) ?
+                    signature + 1 : signature, &dstSubIt);
+        if ( isOk )
+        {
+            if ( dbus_type_is_fixed(elemType) &&
+                (DBUS_TYPE_UNIX_FD != elemType) )
+            {
+                dbus_message_iter_get_fixed_array(&srcSubIt, &fixed, &nElems);
+                isOk = dbus_message_iter_append_fixed_array(&dstSubIt,
+                                                elemType, &fixed, nElems);
+            }
+            else
+            {
+                isOk = l2dbus_copyMessageIter(&srcSubIt, &dstSubIt);
+            }
+
+            if ( !dbus_message_iter_close_container(dstIt, &dstSubIt) )
+            {
+                isOk = L2DBUS_FALSE;
+            }
+        }
+
+        if ( NULL != signature )
+        {
+            dbus_free(signature);
+        }
+    }
+
+    return isOk;
+}
+
+
+/**
+ * @brief Copies D-Bus values from one message iterator to another.
+ *
+ * Copies every remaining value of the source (read) iterator to the
+ * destination (append) iterator using @ref l2dbus_copyMessageValue.
+ *
+ * @param [in] srcIt An iterator positioned on the first value to copy.
+ * @param [in] dstIt An iterator to append the values to.
+ * @return L2DBUS_TRUE if the values were copied or L2DBUS_FALSE if
+ * memory could not be allocated.
+ */
+l2dbus_Bool
+l2dbus_copyMessageIter
+    (
+    DBusMessageIter*    srcIt,
+    DBusMessageIter*    dstIt
+    )
+{
+    l2dbus_Bool isOk = L2DBUS_TRUE;
+
+    while ( isOk &&
+        (DBUS_TYPE_INVALID != dbus_message_iter_get_arg_type(srcIt)) )
+    {
+        isOk = l2dbus_copyMessageValue(srcIt, dstIt);
+        dbus_message_iter_next(srcIt);
+    }
+
+    return isOk;
+}
+
+
+/**
+ * @brief Returns the time elapsed since an arbitrary, fixed point in the past.
+ *
+ * The clock is monotonic so it's unaffected by changes to the system time
+ * which makes it suitable for measuring intervals.
+ *
+ * @return The monotonic time in seconds (with a sub-second fraction).
+ */
+double
+l2dbus_monotonicTime(void)
+{
+    struct timespec now;
+
+    if ( 0 != clock_gettime(CLOCK_MONOTONIC, &now) )
+    {
+        return 0.0;
+    }
+
+    return (double)now.tv_sec + ((double)now.tv_nsec / 1.0e9);
+}
@@ -37,7 +37,6 @@
 #include "lauxlib.h"
 #include "l2dbus_types.h"
 
-void* l2dbus_isUserData(lua_State* L, int udIdx, const char *typeName);
 void l2dbus_cdbusError(lua_State* L, cdbus_HResult rc, const char* msg);
 int l2dbus_createMetatable(lua_State* L, l2dbus_TypeId typeId, const luaL_Reg* funcs);
 l2dbus_Bool l2dbus_isValidIndex(lua_State* L, int idx);
@@ -46,5 +45,8 @@ const char* l2dbus_getTypeName(lua_State* L, int idx);
 void l2dbus_getGlobalField(lua_State* L, const char* name);
 l2dbus_Bool l2dbus_isString(lua_State* L, int nArg);
 const char* l2dbus_checkString(lua_State* L, int nArg);
+l2dbus_Bool l2dbus_copyMessageValue(DBusMessageIter* srcIt, DBusMessageIter* dstIt);
+l2dbus_Bool l2dbus_copyMessageIter(DBusMessageIter* srcIt, DBusMessageIter* dstIt);
+double l2dbus_monotonicTime(void);
 
 #endif /* Guard for L2DBUS_UTIL_H_ */
@@ -45,6 +45,8 @@
 #include "l2dbus_trace.h"
 #include "l2dbus_debug.h"
 #include "l2dbus_types.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_stats.h"
 #include "lualib.h"
 
 /**
@@ -227,7 +229,21 @@ l2dbus_watchHandler
 {
     lua_State* L = l2dbus_callbackGetThread();
     const char* errMsg = "";
-    l2dbus_Watch* ud = l2dbus_objectRegistryGet(L, user);
+    l2dbus_Watch* ud = (l2dbus_Watch*)user;
+    double cbStart;
+    int status;
+
+    /* Batched events are queued without entering Lua at all. The pointer
+     * is valid since a collected watch releases its CDBUS watch (and so
+     * its handler) and is removed from the batch.
+     */
+    if ( (NULL != ud) && (L2DBUS_WATCH_DELIVER_BATCH == ud->delivery) &&
+        l2dbus_dispatcherQueueWatch(ud->dispUd, ud, rcvEvents) )
+    {
+        return CDBUS_TRUE;
+    }
+
+    ud = l2dbus_objectRegistryGet(L, user);
 
     /* Nil or the Watch userdata is sitting at the top of the
      * stack at this point.
@@ -247,10 +263,20 @@ l2dbus_watchHandler
         /* Push function and user value on the stack and execute the callback */
         lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.funcRef);
         lua_pushvalue(L, -2 /* Watch ud */);
-        l2dbus_watchMakeEvTable(L, rcvEvents);
+        if ( L2DBUS_WATCH_DELIVER_TABLE == ud->delivery )
+        {
+            l2dbus_watchMakeEvTable(L, rcvEvents);
+        }
+        else
+        {
+            lua_pushinteger(L, rcvEvents);
+        }
         lua_rawgeti(L, LUA_REGISTRYINDEX, ud->cbCtx.userRef);
 
-        if ( 0 != lua_pcall(L, 3 /* nArgs */, 0, 0) )
+        cbStart = l2dbus_statsCallbackStart(L, 3 /* nArgs */);
+        status = lua_pcall(L, 3 /* nArgs */, 0, 0);
+        l2dbus_statsCallback(L2DBUS_STATS_CB_WATCH, cbStart, status);
+        if ( 0 != status )
         {
             if ( lua_isstring(L, -1) )
             {
@@ -263,6 +289,9 @@ l2dbus_watchHandler
     /* Clean up the thread stack */
     lua_settop(L, 0);
 
+    /* Reclaim any transient allocations made while servicing the callback */
+    l2dbus_arenaReset();
+
     /* The return value is unused by CDBUS */
     return CDBUS_TRUE;
 }
@@ -290,6 +319,11 @@ l2dbus_watchHandler
  <li>*userToken*    - A value specified by the client when the watch is created.</li>
  </ul>
 
+ To avoid creating an event table for every event the delivery mode of
+ the watch can be changed with @{setDeliveryMode} so the handler receives
+ the event bitmask as a number instead, or so the events of many watches
+ are delivered in batches.
+
  The handler does not have to return anything but should exit quickly to
  minimize interruptions to the @{l2dbus.Dispatcher|Dispatcher} main loop.
 
@@ -337,8 +371,8 @@ l2dbus_newWatch
     }
 
 
-    dispUd = (l2dbus_Dispatcher*)luaL_checkudata(L, 1,
-                                L2DBUS_DISPATCHER_MTBL_NAME);
+    dispUd = (l2dbus_Dispatcher*)l2dbus_checkUserData(L, 1,
+                                L2DBUS_DISPATCHER_TYPE_ID);
 
     /* Parse the file/descriptor */
     if ( (LUA_TUSERDATA == lua_type(L, 2)) &&
@@ -383,6 +417,9 @@ l2dbus_newWatch
         l2dbus_callbackInit(&watchUd->cbCtx);
         watchUd->dispUdRef = LUA_NOREF;
         watchUd->watchUdRef = LUA_NOREF;
+        watchUd->dispUd = dispUd;
+        watchUd->delivery = L2DBUS_WATCH_DELIVER_TABLE;
+        watchUd->batchSlot = -1;
 
         l2dbus_callbackRef(L, 4 /* func */, userIdx, &watchUd->cbCtx);
         watchUd->watch = cdbus_watchNew(dispUd->disp, fd, events,
@@ -424,8 +461,8 @@ l2dbus_watchDispose
     lua_State*  L
     )
 {
-    l2dbus_Watch* ud = (l2dbus_Watch*)luaL_checkudata(L, -1,
-                                        L2DBUS_WATCH_MTBL_NAME);
+    l2dbus_Watch* ud = (l2dbus_Watch*)l2dbus_checkUserData(L, -1,
+                                        L2DBUS_WATCH_TYPE_ID);
 
     L2DBUS_TRACE((L2DBUS_TRC_TRACE, "GC: watch (userdata=%p)", ud));
 
@@ -435,6 +472,9 @@ l2dbus_watchDispose
         cdbus_watchUnref(ud->watch);
     }
 
+    /* Forget any event still waiting to be batched */
+    l2dbus_dispatcherPurgeWatch(ud->dispUd, ud);
+
     /* Drop the weak reference to the userdata */
     l2dbus_objectRegistryRemove(L, ud);
 
@@ -468,8 +508,8 @@ l2dbus_watchGetDescriptor
     lua_State*  L
     )
 {
-    l2dbus_Watch* ud = (l2dbus_Watch*)luaL_checkudata(L, 1,
-                                        L2DBUS_WATCH_MTBL_NAME);
+    l2dbus_Watch* ud = (l2dbus_Watch*)l2dbus_checkUserData(L, 1,
+                                        L2DBUS_WATCH_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -496,8 +536,8 @@ l2dbus_watchEvents
     lua_State*  L
     )
 {
-    l2dbus_Watch* ud = (l2dbus_Watch*)luaL_checkudata(L, 1,
-                                                    L2DBUS_WATCH_MTBL_NAME);
+    l2dbus_Watch* ud = (l2dbus_Watch*)l2dbus_checkUserData(L, 1,
+                                                    L2DBUS_WATCH_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -529,8 +569,8 @@ l2dbus_watchSetEvents
 {
     cdbus_UInt32 events;
     cdbus_HResult rc;
-    l2dbus_Watch* ud = (l2dbus_Watch*)luaL_checkudata(L, 1,
-                                                    L2DBUS_WATCH_MTBL_NAME);
+    l2dbus_Watch* ud = (l2dbus_Watch*)l2dbus_checkUserData(L, 1,
+                                                    L2DBUS_WATCH_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -563,8 +603,8 @@ l2dbus_watchIsEnabled
     lua_State*  L
     )
 {
-    l2dbus_Watch* ud = (l2dbus_Watch*)luaL_checkudata(L, 1,
-                                                L2DBUS_WATCH_MTBL_NAME);
+    l2dbus_Watch* ud = (l2dbus_Watch*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_WATCH_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -594,8 +634,8 @@ l2dbus_watchSetEnable
     cdbus_HResult rc;
     int enable;
 
-    l2dbus_Watch* ud = (l2dbus_Watch*)luaL_checkudata(L, 1,
-                                                    L2DBUS_WATCH_MTBL_NAME);
+    l2dbus_Watch* ud = (l2dbus_Watch*)l2dbus_checkUserData(L, 1,
+                                                    L2DBUS_WATCH_TYPE_ID);
     luaL_checktype(L, 2, LUA_TBOOLEAN);
 
     /* Make sure the module is initialized */
@@ -641,8 +681,8 @@ l2dbus_watchData
     lua_State*  L
     )
 {
-    l2dbus_Watch* ud = (l2dbus_Watch*)luaL_checkudata(L, 1,
-                                                L2DBUS_WATCH_MTBL_NAME);
+    l2dbus_Watch* ud = (l2dbus_Watch*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_WATCH_TYPE_ID);
 
     /* Make sure the module is initialized */
     l2dbus_checkModuleInitialized(L);
@@ -667,8 +707,8 @@ l2dbus_watchSetData
     lua_State*  L
     )
 {
-    l2dbus_Watch* ud = (l2dbus_Watch*)luaL_checkudata(L, 1,
-                                                L2DBUS_WATCH_MTBL_NAME);
+    l2dbus_Watch* ud = (l2dbus_Watch*)l2dbus_checkUserData(L, 1,
+                                                L2DBUS_WATCH_TYPE_ID);
     /* Any value is acceptable - but it should be specified */
     luaL_checkany(L, 2);
 
@@ -687,6 +727,84 @@ l2dbus_watchSetData
 }
 
 
+/**
+ @function setDeliveryMode
+ @within Watch
+
+ Sets how signaled events are delivered.
+
+ The supported modes are:
+
+ <ul>
+ <li>@{DELIVER_TABLE} - (The default) The handler is passed an
+ @{EventTable}.</li>
+ <li>@{DELIVER_MASK} - The handler is passed the event bitmask as a
+ number, e.g. onWatch(watch, evMask, userToken). No table is created per
+ event.</li>
+ <li>@{DELIVER_BATCH} - Events are collected and delivered once per main
+ loop iteration to the handler set with
+ @{l2dbus.Dispatcher.setWatchBatchHandler|setWatchBatchHandler}. If the
+ dispatcher has no batch handler this is the same as @{DELIVER_MASK}.</li>
+ </ul>
+
+ @tparam userdata watch The watch instance.
+ @tparam number mode The delivery mode.
+ */
+static int
+l2dbus_watchSetDeliveryMode
+    (
+    lua_State*  L
+    )
+{
+    lua_Integer mode;
+    l2dbus_Watch* ud = (l2dbus_Watch*)l2dbus_checkUserData(L, 1,
+                                                    L2DBUS_WATCH_TYPE_ID);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    mode = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, (L2DBUS_WATCH_DELIVER_TABLE <= mode) &&
+                    (L2DBUS_WATCH_DELIVER_BATCH >= mode), 2,
+                    "unknown delivery mode");
+
+    if ( L2DBUS_WATCH_DELIVER_BATCH != mode )
+    {
+        l2dbus_dispatcherPurgeWatch(ud->dispUd, ud);
+    }
+    ud->delivery = (l2dbus_WatchDelivery)mode;
+
+    return 0;
+}
+
+
+/**
+ @function getDeliveryMode
+ @within Watch
+
+ Returns how signaled events are delivered.
+
+ @tparam userdata watch The watch instance.
+ @treturn number The delivery mode (see @{setDeliveryMode}).
+ */
+static int
+l2dbus_watchGetDeliveryMode
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_Watch* ud = (l2dbus_Watch*)l2dbus_checkUserData(L, 1,
+                                                    L2DBUS_WATCH_TYPE_ID);
+
+    /* Make sure the module is initialized */
+    l2dbus_checkModuleInitialized(L);
+
+    lua_pushinteger(L, ud->delivery);
+
+    return 1;
+}
+
+
 /*
  * Define the methods of the Watch class
  */
@@ -698,6 +816,8 @@ static const luaL_Reg l2dbus_watchMetaTable[] = {
     {"setEvents", l2dbus_watchSetEvents},
     {"data", l2dbus_watchData},
     {"setData", l2dbus_watchSetData},
+    {"setDeliveryMode", l2dbus_watchSetDeliveryMode},
+    {"getDeliveryMode", l2dbus_watchGetDeliveryMode},
     {"__gc", l2dbus_watchDispose},
     {NULL, NULL},
 };
@@ -754,6 +874,30 @@ l2dbus_openWatch
     lua_pushstring(L, "HANGUP");
     lua_pushinteger(L, DBUS_WATCH_HANGUP);
     lua_rawset(L, -3);
+
+/**
+ @constant DELIVER_TABLE
+ The delivery mode passing an @{EventTable} to the handler.
+ */
+    lua_pushstring(L, "DELIVER_TABLE");
+    lua_pushinteger(L, L2DBUS_WATCH_DELIVER_TABLE);
+    lua_rawset(L, -3);
+
+/**
+ @constant DELIVER_MASK
+ The delivery mode passing the event bitmask (a number) to the handler.
+ */
+    lua_pushstring(L, "DELIVER_MASK");
+    lua_pushinteger(L, L2DBUS_WATCH_DELIVER_MASK);
+    lua_rawset(L, -3);
+
+/**
+ @constant DELIVER_BATCH
+ The delivery mode batching events for the dispatcher's batch handler.
+ */
+    lua_pushstring(L, "DELIVER_BATCH");
+    lua_pushinteger(L, L2DBUS_WATCH_DELIVER_BATCH);
+    lua_rawset(L, -3);
 }
 
 
@@ -39,13 +39,26 @@
 
 /* Forward declarations */
 struct cdbus_Watch;
+struct l2dbus_Dispatcher;
+
+/* How signaled events are passed to the Lua handler */
+typedef enum
+{
+    L2DBUS_WATCH_DELIVER_TABLE,
+    L2DBUS_WATCH_DELIVER_MASK,
+    L2DBUS_WATCH_DELIVER_BATCH
+} l2dbus_WatchDelivery;
 
 typedef struct l2dbus_Watch
 {
-    struct cdbus_Watch* watch;
-    int                 dispUdRef;
-    int                 watchUdRef;
-    l2dbus_CallbackCtx  cbCtx;
+    struct cdbus_Watch*         watch;
+    int                         dispUdRef;
+    int                         watchUdRef;
+    l2dbus_CallbackCtx          cbCtx;
+    struct l2dbus_Dispatcher*   dispUd;
+    l2dbus_WatchDelivery        delivery;
+    /* Index of the pending event in the dispatcher batch (or -1) */
+    int                         batchSlot;
 } l2dbus_Watch;
 
 int l2dbus_newWatch(lua_State* L);
@@ -0,0 +1,590 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_watchdog.c
+ * @author         Glenn Schmottlach
+ * @brief          Implementation of the watchdog of slow Lua callbacks.
+ *===========================================================================
+ */
+#include <stdio.h>
+#include <string.h>
+#include "lauxlib.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_watchdog.h"
+#include "l2dbus_context.h"
+#include "l2dbus_util.h"
+#include "l2dbus_trace.h"
+#include "l2dbus_alloc.h"
+
+/* The initial number of slots of the handler table */
+#define L2DBUS_WATCHDOG_INITIAL_SLOTS   (64U)
+
+/* The longest handler name (including the terminator) */
+#define L2DBUS_WATCHDOG_MAX_NAME        (128)
+
+
+static unsigned
+l2dbus_watchdogHash
+    (
+    const char* name
+    )
+{
+    unsigned hash = 2166136261U;
+
+    while ( '\0' != *name )
+    {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+
+/**
+ * @brief Doubles the size of the handler table.
+ *
+ * @param [in] wd   The watchdog.
+ * @return L2DBUS_FALSE if the table could not be grown.
+ */
+static l2dbus_Bool
+l2dbus_watchdogGrow
+    (
+    l2dbus_Watchdog*    wd
+    )
+{
+    unsigned nSlots = (0U == wd->nSlots) ? L2DBUS_WATCHDOG_INITIAL_SLOTS :
+                                            wd->nSlots * 2U;
+    l2dbus_WatchdogHandler** handlers;
+    unsigned idx;
+    unsigned slot;
+
+    handlers = (l2dbus_WatchdogHandler**)l2dbus_calloc(nSlots,
+                                                    sizeof(*handlers));
+    if ( NULL == handlers )
+    {
+        return L2DBUS_FALSE;
+    }
+
+    for ( idx = 0; idx < wd->nSlots; ++idx )
+    {
+        if ( NULL != wd->handlers[idx] )
+        {
+            slot = wd->handlers[idx]->hash & (nSlots - 1U);
+            while ( NULL != handlers[slot] )
+            {
+                slot = (slot + 1U) & (nSlots - 1U);
+            }
+            handlers[slot] = wd->handlers[idx];
+        }
+    }
+
+    l2dbus_free(wd->handlers);
+    wd->handlers = handlers;
+    wd->nSlots = nSlots;
+
+    return L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Finds (or adds) the accounting of a handler.
+ *
+ * @param [in] wd   The watchdog.
+ * @param [in] name The name of the handler.
+ * @return The handler or NULL if it could not be added.
+ */
+static l2dbus_WatchdogHandler*
+l2dbus_watchdogFind
+    (
+    l2dbus_Watchdog*    wd,
+    const char*         name
+    )
+{
+    unsigned hash = l2dbus_watchdogHash(name);
+    l2dbus_WatchdogHandler* handler;
+    unsigned slot;
+
+    if ( ((wd->nHandlers + 1U) * 4U > wd->nSlots * 3U) &&
+        !l2dbus_watchdogGrow(wd) )
+    {
+        return NULL;
+    }
+
+    slot = hash & (wd->nSlots - 1U);
+    while ( NULL != (handler = wd->handlers[slot]) )
+    {
+        if ( (handler->hash == hash) && (0 == strcmp(handler->name, name)) )
+        {
+            return handler;
+        }
+        slot = (slot + 1U) & (wd->nSlots - 1U);
+    }
+
+    handler = (l2dbus_WatchdogHandler*)l2dbus_calloc(1, sizeof(*handler));
+    if ( NULL != handler )
+    {
+        handler->name = l2dbus_strDup(name);
+        if ( NULL == handler->name )
+        {
+            l2dbus_free(handler);
+            return NULL;
+        }
+        handler->hash = hash;
+        wd->handlers[slot] = handler;
+        wd->nHandlers++;
+    }
+
+    return handler;
+}
+
+
+/**
+ * @brief Records where a handler is while it's over its budget.
+ *
+ * @param [in] L        The thread running the handler.
+ * @param [in] handler  The handler.
+ */
+static void
+l2dbus_watchdogSample
+    (
+    lua_State*              L,
+    l2dbus_WatchdogHandler* handler
+    )
+{
+    char buf[L2DBUS_WATCHDOG_MAX_TRACEBACK];
+    size_t len = 0;
+    int level;
+    int n;
+    lua_Debug ar;
+
+    buf[0] = '\0';
+    for ( level = 0; lua_getstack(L, level, &ar); ++level )
+    {
+        if ( !lua_getinfo(L, "Sln", &ar) )
+        {
+            break;
+        }
+
+        n = snprintf(buf + len, sizeof(buf) - len, "%s%s:%d: in %s",
+                    (0 == level) ? "" : "\n", ar.short_src, ar.currentline,
+                    (NULL != ar.name) ? ar.name : "?");
+        if ( (n < 0) || ((size_t)n >= sizeof(buf) - len) )
+        {
+            /* Keep what fits */
+            break;
+        }
+        len += (size_t)n;
+    }
+
+    l2dbus_free(handler->traceback);
+    handler->traceback = l2dbus_strDup(buf);
+
+    L2DBUS_TRACE((L2DBUS_TRC_WARN, "Slow callback (%s):\n%s", handler->name,
+                buf));
+}
+
+
+/**
+ * @brief Checks the running callback against its budget.
+ *
+ * Installed as a count hook on the thread running the callbacks. Any
+ * hook the application had installed on the thread is called first.
+ *
+ * @param [in] L    The thread running the callback.
+ * @param [in] ar   The debug information of the hook event.
+ */
+static void
+l2dbus_watchdogHook
+    (
+    lua_State*  L,
+    lua_Debug*  ar
+    )
+{
+    l2dbus_Context* ctx = l2dbus_contextCurrent();
+    l2dbus_Watchdog* wd;
+    l2dbus_WatchdogFrame* frame;
+    double elapsed;
+
+    if ( NULL == ctx )
+    {
+        return;
+    }
+
+    wd = &ctx->watchdog;
+    /* Only count events can be ours alone: the others fire because the
+     * previous hook asked for them.
+     */
+    if ( (NULL != wd->prevHook) && ((LUA_HOOKCOUNT != ar->event) ||
+        (0 != (wd->prevMask & LUA_MASKCOUNT))) )
+    {
+        wd->prevHook(L, ar);
+    }
+
+    if ( (LUA_HOOKCOUNT != ar->event) || (0U == wd->depth) ||
+        (wd->depth > L2DBUS_WATCHDOG_MAX_DEPTH) )
+    {
+        return;
+    }
+
+    frame = &wd->frames[wd->depth - 1U];
+    if ( NULL == frame->handler )
+    {
+        return;
+    }
+
+    elapsed = l2dbus_monotonicTime() - frame->start;
+    if ( !frame->sampled && (elapsed > wd->budgetSecs) )
+    {
+        frame->sampled = L2DBUS_TRUE;
+        l2dbus_watchdogSample(L, frame->handler);
+    }
+
+    /* Keep raising the error in case the handler catches it */
+    if ( (0.0 < wd->abortSecs) && (elapsed > wd->abortSecs) )
+    {
+        frame->aborted = L2DBUS_TRUE;
+        luaL_error(L, "callback (%s) aborted after %f seconds",
+                    frame->handler->name, elapsed);
+    }
+}
+
+
+/**
+ * @brief Starts watching callbacks.
+ *
+ * @param [in] wd               The watchdog.
+ * @param [in] hookThread       The thread that runs the callbacks.
+ * @param [in] budgetSecs       The latency budget of a callback.
+ * @param [in] abortSecs        Callbacks running longer are aborted (zero
+ * if they are never aborted).
+ * @param [in] sampleInterval   VM instructions between two samples. If
+ * the application already has a count hook on the thread its count is kept
+ * instead.
+ */
+void
+l2dbus_watchdogEnable
+    (
+    l2dbus_Watchdog*    wd,
+    lua_State*          hookThread,
+    double              budgetSecs,
+    double              abortSecs,
+    int                 sampleInterval
+    )
+{
+    l2dbus_watchdogDisable(wd);
+
+    wd->budgetSecs = budgetSecs;
+    wd->abortSecs = abortSecs;
+    wd->sampleInterval = sampleInterval;
+    wd->hookThread = hookThread;
+    if ( NULL != hookThread )
+    {
+        /* Chain to (and later restore) any hook the application installed */
+        wd->prevHook = lua_gethook(hookThread);
+        wd->prevMask = lua_gethookmask(hookThread);
+        wd->prevCount = lua_gethookcount(hookThread);
+        if ( NULL == wd->prevHook )
+        {
+            wd->prevMask = 0;
+        }
+        else if ( 0 != (wd->prevMask & LUA_MASKCOUNT) )
+        {
+            sampleInterval = wd->prevCount;
+        }
+        lua_sethook(hookThread, l2dbus_watchdogHook,
+                    wd->prevMask | LUA_MASKCOUNT, sampleInterval);
+    }
+    wd->enabled = L2DBUS_TRUE;
+}
+
+
+/**
+ * @brief Stops watching callbacks.
+ *
+ * Callbacks that are running when the watchdog is disabled are still
+ * accounted when they return.
+ *
+ * @param [in] wd   The watchdog.
+ */
+void
+l2dbus_watchdogDisable
+    (
+    l2dbus_Watchdog*    wd
+    )
+{
+    if ( NULL != wd->hookThread )
+    {
+        /* Leave the hook alone if the application has replaced it since */
+        if ( l2dbus_watchdogHook == lua_gethook(wd->hookThread) )
+        {
+            lua_sethook(wd->hookThread, wd->prevHook, wd->prevMask,
+                        wd->prevCount);
+        }
+        wd->hookThread = NULL;
+        wd->prevHook = NULL;
+        wd->prevMask = 0;
+        wd->prevCount = 0;
+    }
+    wd->enabled = L2DBUS_FALSE;
+}
+
+
+/**
+ * @brief Called before a Lua callback is called.
+ *
+ * @param [in] wd       The watchdog.
+ * @param [in] L        The thread that calls the callback.
+ * @param [in] funcIdx  The stack index of the callback function.
+ */
+void
+l2dbus_watchdogEnter
+    (
+    l2dbus_Watchdog*    wd,
+    lua_State*          L,
+    int                 funcIdx
+    )
+{
+    l2dbus_WatchdogFrame* frame;
+    char name[L2DBUS_WATCHDOG_MAX_NAME];
+    lua_Debug ar;
+
+    /* Nested callbacks are tracked until the outermost one returns */
+    if ( !wd->enabled && (0U == wd->depth) )
+    {
+        return;
+    }
+
+    if ( wd->depth < L2DBUS_WATCHDOG_MAX_DEPTH )
+    {
+        frame = &wd->frames[wd->depth];
+        frame->handler = NULL;
+        frame->sampled = L2DBUS_FALSE;
+        frame->aborted = L2DBUS_FALSE;
+        if ( wd->enabled )
+        {
+            funcIdx = lua_absindex(L, funcIdx);
+            if ( LUA_TFUNCTION != lua_type(L, funcIdx) )
+            {
+                snprintf(name, sizeof(name), "(%s)",
+                        luaL_typename(L, funcIdx));
+            }
+            else
+            {
+                lua_pushvalue(L, funcIdx);
+                (void)lua_getinfo(L, ">S", &ar);
+                if ( 0 == strcmp(ar.what, "C") )
+                {
+                    snprintf(name, sizeof(name), "[C]:%p",
+                            lua_topointer(L, funcIdx));
+                }
+                else
+                {
+                    snprintf(name, sizeof(name), "%s:%d", ar.short_src,
+                            ar.linedefined);
+                }
+            }
+            frame->handler = l2dbus_watchdogFind(wd, name);
+        }
+        frame->start = l2dbus_monotonicTime();
+    }
+    wd->depth++;
+}
+
+
+/**
+ * @brief Called after a Lua callback has returned.
+ *
+ * @param [in] wd   The watchdog.
+ */
+void
+l2dbus_watchdogLeave
+    (
+    l2dbus_Watchdog*    wd
+    )
+{
+    l2dbus_WatchdogFrame* frame;
+    l2dbus_WatchdogHandler* handler;
+    double elapsed;
+
+    if ( 0U == wd->depth )
+    {
+        return;
+    }
+
+    wd->depth--;
+    if ( wd->depth >= L2DBUS_WATCHDOG_MAX_DEPTH )
+    {
+        return;
+    }
+
+    frame = &wd->frames[wd->depth];
+    handler = frame->handler;
+    if ( NULL == handler )
+    {
+        return;
+    }
+
+    elapsed = l2dbus_monotonicTime() - frame->start;
+    handler->count++;
+    handler->totalSecs += elapsed;
+    if ( elapsed > handler->maxSecs )
+    {
+        handler->maxSecs = elapsed;
+    }
+
+    if ( elapsed > wd->budgetSecs )
+    {
+        handler->nOverBudget++;
+        if ( !frame->sampled )
+        {
+            /* The time was spent outside the Lua VM (e.g. a blocking call) */
+            L2DBUS_TRACE((L2DBUS_TRC_WARN,
+                "Slow callback (%s) took %f seconds without being sampled",
+                handler->name, elapsed));
+        }
+    }
+
+    if ( frame->aborted )
+    {
+        handler->nAborted++;
+    }
+}
+
+
+/**
+ * @brief Resets the accounting of all handlers.
+ *
+ * The handlers are kept since running callbacks may refer to them.
+ *
+ * @param [in] wd   The watchdog.
+ */
+void
+l2dbus_watchdogReset
+    (
+    l2dbus_Watchdog*    wd
+    )
+{
+    l2dbus_WatchdogHandler* handler;
+    unsigned idx;
+
+    for ( idx = 0; idx < wd->nSlots; ++idx )
+    {
+        handler = wd->handlers[idx];
+        if ( NULL != handler )
+        {
+            handler->count = 0;
+            handler->totalSecs = 0.0;
+            handler->maxSecs = 0.0;
+            handler->nOverBudget = 0;
+            handler->nAborted = 0;
+            l2dbus_free(handler->traceback);
+            handler->traceback = NULL;
+        }
+    }
+}
+
+
+/**
+ * @brief Pushes an array of the handlers called since the last reset.
+ *
+ * @param [in] L    The Lua state.
+ * @param [in] wd   The watchdog.
+ */
+void
+l2dbus_watchdogPushHandlers
+    (
+    lua_State*              L,
+    const l2dbus_Watchdog*  wd
+    )
+{
+    const l2dbus_WatchdogHandler* handler;
+    unsigned idx;
+    int arrIdx = 1;
+
+    lua_createtable(L, (int)wd->nHandlers, 0);
+    for ( idx = 0; idx < wd->nSlots; ++idx )
+    {
+        handler = wd->handlers[idx];
+        if ( (NULL == handler) || (0 == handler->count) )
+        {
+            continue;
+        }
+
+        lua_createtable(L, 0, 7);
+        lua_pushstring(L, handler->name);
+        lua_setfield(L, -2, "name");
+        lua_pushnumber(L, (lua_Number)handler->count);
+        lua_setfield(L, -2, "count");
+        lua_pushnumber(L, handler->totalSecs);
+        lua_setfield(L, -2, "time");
+        lua_pushnumber(L, handler->maxSecs);
+        lua_setfield(L, -2, "max");
+        lua_pushnumber(L, (lua_Number)handler->nOverBudget);
+        lua_setfield(L, -2, "overBudget");
+        lua_pushnumber(L, (lua_Number)handler->nAborted);
+        lua_setfield(L, -2, "aborted");
+        if ( NULL != handler->traceback )
+        {
+            lua_pushstring(L, handler->traceback);
+            lua_setfield(L, -2, "traceback");
+        }
+        lua_rawseti(L, -2, arrIdx++);
+    }
+}
+
+
+/**
+ * @brief Frees the handlers of a watchdog.
+ *
+ * @param [in] wd   The watchdog.
+ */
+void
+l2dbus_watchdogFree
+    (
+    l2dbus_Watchdog*    wd
+    )
+{
+    unsigned idx;
+
+    for ( idx = 0; idx < wd->nSlots; ++idx )
+    {
+        if ( NULL != wd->handlers[idx] )
+        {
+            l2dbus_free(wd->handlers[idx]->name);
+            l2dbus_free(wd->handlers[idx]->traceback);
+            l2dbus_free(wd->handlers[idx]);
+        }
+    }
+    l2dbus_free(wd->handlers);
+    wd->handlers = NULL;
+    wd->nHandlers = 0;
+    wd->nSlots = 0;
+    wd->enabled = L2DBUS_FALSE;
+    wd->hookThread = NULL;
+}
@@ -0,0 +1,107 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_watchdog.h
+ * @author         Glenn Schmottlach
+ * @brief          Definition of the watchdog of slow Lua callbacks.
+ *===========================================================================
+ */
+#ifndef L2DBUS_WATCHDOG_H_
+#define L2DBUS_WATCHDOG_H_
+
+#include "lua.h"
+#include "l2dbus_types.h"
+
+/* Callbacks nested deeper than this are not timed by the watchdog */
+#define L2DBUS_WATCHDOG_MAX_DEPTH           (8)
+
+/* The default number of VM instructions between two samples */
+#define L2DBUS_WATCHDOG_SAMPLE_INTERVAL     (1000)
+
+/* The longest traceback kept for a slow handler (including the terminator) */
+#define L2DBUS_WATCHDOG_MAX_TRACEBACK       (1024)
+
+/*
+ * The time spent in a single handler. Handlers are identified by where
+ * their function is defined so every closure created by the same code
+ * is accounted together.
+ */
+typedef struct l2dbus_WatchdogHandler
+{
+    char*                   name;
+    unsigned                hash;
+    unsigned long long      count;
+    double                  totalSecs;
+    double                  maxSecs;
+    unsigned long long      nOverBudget;
+    unsigned long long      nAborted;
+    /* Where the handler was when it was last caught over its budget */
+    char*                   traceback;
+} l2dbus_WatchdogHandler;
+
+/* A callback that is running */
+typedef struct l2dbus_WatchdogFrame
+{
+    /* NULL if the callback is not being watched */
+    l2dbus_WatchdogHandler* handler;
+    double                  start;
+    l2dbus_Bool             sampled;
+    l2dbus_Bool             aborted;
+} l2dbus_WatchdogFrame;
+
+typedef struct l2dbus_Watchdog
+{
+    l2dbus_Bool             enabled;
+    double                  budgetSecs;
+    /* Callbacks running longer than this are aborted (zero if never) */
+    double                  abortSecs;
+    int                     sampleInterval;
+    /* The thread the sampling hook is installed on */
+    lua_State*              hookThread;
+    /* The hook the application had installed (chained and restored) */
+    lua_Hook                prevHook;
+    int                     prevMask;
+    int                     prevCount;
+    l2dbus_WatchdogFrame    frames[L2DBUS_WATCHDOG_MAX_DEPTH];
+    unsigned                depth;
+    /* Open addressed hash table of the handlers seen so far */
+    l2dbus_WatchdogHandler** handlers;
+    unsigned                nHandlers;
+    unsigned                nSlots;
+} l2dbus_Watchdog;
+
+void l2dbus_watchdogEnable(l2dbus_Watchdog* wd, lua_State* hookThread,
+                        double budgetSecs, double abortSecs, int sampleInterval);
+void l2dbus_watchdogDisable(l2dbus_Watchdog* wd);
+void l2dbus_watchdogEnter(l2dbus_Watchdog* wd, lua_State* L, int funcIdx);
+void l2dbus_watchdogLeave(l2dbus_Watchdog* wd);
+void l2dbus_watchdogReset(l2dbus_Watchdog* wd);
+void l2dbus_watchdogPushHandlers(lua_State* L, const l2dbus_Watchdog* wd);
+void l2dbus_watchdogFree(l2dbus_Watchdog* wd);
+
+#endif /* Guard for L2DBUS_WATCHDOG_H_ */
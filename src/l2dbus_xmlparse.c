@@ -0,0 +1,627 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_xmlparse.c
+ * @author         Glenn Schmottlach
+ * @brief          Native parser for D-Bus introspection XML.
+ *===========================================================================
+ */
+#include <string.h>
+#include <ctype.h>
+#include "l2dbus_compat.h"
+#include "l2dbus_types.h"
+#include "l2dbus_xmlparse.h"
+#include "lauxlib.h"
+
+#define L2DBUS_XML_MAX_DEPTH    (64)
+#define L2DBUS_XML_MAX_ATTRS    (16)
+
+typedef enum
+{
+    L2DBUS_XML_ELEM_ROOT,
+    L2DBUS_XML_ELEM_INTERFACE,
+    L2DBUS_XML_ELEM_METHOD,
+    L2DBUS_XML_ELEM_SIGNAL,
+    L2DBUS_XML_ELEM_OTHER
+} l2dbus_XmlElemKind;
+
+typedef struct l2dbus_XmlSpan
+{
+    const char* ptr;
+    size_t      len;
+} l2dbus_XmlSpan;
+
+typedef struct l2dbus_XmlAttr
+{
+    l2dbus_XmlSpan  name;
+    l2dbus_XmlSpan  value;
+} l2dbus_XmlAttr;
+
+typedef struct l2dbus_XmlElem
+{
+    l2dbus_XmlSpan      tag;
+    l2dbus_XmlElemKind  kind;
+    /* Lua stack index of the table being filled for this element */
+    int                 tblIdx;
+} l2dbus_XmlElem;
+
+typedef struct l2dbus_XmlParser
+{
+    lua_State*      L;
+    const char*     base;
+    const char*     cur;
+    const char*     end;
+    int             resultIdx;
+    int             depth;
+    l2dbus_XmlElem  stack[L2DBUS_XML_MAX_DEPTH];
+    int             nAttrs;
+    l2dbus_XmlAttr  attrs[L2DBUS_XML_MAX_ATTRS];
+} l2dbus_XmlParser;
+
+
+static int
+l2dbus_xmlSpanEquals
+    (
+    const l2dbus_XmlSpan*   span,
+    const char*             str
+    )
+{
+    size_t len = strlen(str);
+    return (span->len == len) && (0 == memcmp(span->ptr, str, len));
+}
+
+
+static int
+l2dbus_xmlIsNameChar
+    (
+    char    c
+    )
+{
+    return isalnum((unsigned char)c) || (c == '_') || (c == '-') ||
+            (c == ':') || (c == '.');
+}
+
+
+static void
+l2dbus_xmlSkipSpace
+    (
+    l2dbus_XmlParser*   p
+    )
+{
+    while ( (p->cur < p->end) && isspace((unsigned char)*p->cur) )
+    {
+        ++p->cur;
+    }
+}
+
+
+/* Advances the cursor past the next occurrence of 'term' */
+static void
+l2dbus_xmlSkipPast
+    (
+    l2dbus_XmlParser*   p,
+    const char*         term
+    )
+{
+    size_t termLen = strlen(term);
+
+    while ( (size_t)(p->end - p->cur) >= termLen )
+    {
+        if ( 0 == memcmp(p->cur, term, termLen) )
+        {
+            p->cur += termLen;
+            return;
+        }
+        ++p->cur;
+    }
+    luaL_error(p->L, "introspection XML: unterminated markup (expected '%s')",
+                term);
+}
+
+
+static void
+l2dbus_xmlParseName
+    (
+    l2dbus_XmlParser*   p,
+    l2dbus_XmlSpan*     name
+    )
+{
+    name->ptr = p->cur;
+    while ( (p->cur < p->end) && l2dbus_xmlIsNameChar(*p->cur) )
+    {
+        ++p->cur;
+    }
+    name->len = (size_t)(p->cur - name->ptr);
+    if ( 0 == name->len )
+    {
+        luaL_error(p->L, "introspection XML: expected a name at offset %d",
+                    (int)(p->cur - p->base));
+    }
+}
+
+
+/* Parses the attributes of a start tag and returns non-zero if the tag
+ * is an empty element tag (e.g. <arg/>).
+ */
+static int
+l2dbus_xmlParseAttrs
+    (
+    l2dbus_XmlParser*   p
+    )
+{
+    l2dbus_XmlAttr attr;
+    char quote;
+
+    p->nAttrs = 0;
+    for ( ;; )
+    {
+        l2dbus_xmlSkipSpace(p);
+        if ( p->cur >= p->end )
+        {
+            luaL_error(p->L, "introspection XML: unterminated start tag");
+        }
+        else if ( '>' == *p->cur )
+        {
+            ++p->cur;
+            return 0;
+        }
+        else if ( ('/' == *p->cur) && (p->cur + 1 < p->end) &&
+                ('>' == p->cur[1]) )
+        {
+            p->cur += 2;
+            return 1;
+        }
+
+        l2dbus_xmlParseName(p, &attr.name);
+        l2dbus_xmlSkipSpace(p);
+        if ( (p->cur >= p->end) || ('=' != *p->cur) )
+        {
+            luaL_error(p->L, "introspection XML: expected '=' after attribute");
+        }
+        ++p->cur;
+        l2dbus_xmlSkipSpace(p);
+        if ( (p->cur >= p->end) || (('"' != *p->cur) && ('\'' != *p->cur)) )
+        {
+            luaL_error(p->L, "introspection XML: expected a quoted attribute value");
+        }
+        quote = *p->cur++;
+        attr.value.ptr = p->cur;
+        while ( (p->cur < p->end) && (quote != *p->cur) )
+        {
+            ++p->cur;
+        }
+        if ( p->cur >= p->end )
+        {
+            luaL_error(p->L, "introspection XML: unterminated attribute value");
+        }
+        attr.value.len = (size_t)(p->cur - attr.value.ptr);
+        ++p->cur;
+
+        /* Any attributes beyond those we have room for are not used by
+         * D-Bus introspection data so they can be safely ignored.
+         */
+        if ( p->nAttrs < L2DBUS_XML_MAX_ATTRS )
+        {
+            p->attrs[p->nAttrs++] = attr;
+        }
+    }
+}
+
+
+/* Pushes the (unescaped) value of the named attribute or nil if the
+ * attribute is not present. Returns the Lua type of the pushed value.
+ */
+static int
+l2dbus_xmlPushAttr
+    (
+    l2dbus_XmlParser*   p,
+    const char*         name
+    )
+{
+    const l2dbus_XmlSpan* value = NULL;
+    const char* s;
+    const char* e;
+    const char* semi;
+    luaL_Buffer b;
+    unsigned long code;
+    int idx;
+
+    for ( idx = 0; idx < p->nAttrs; ++idx )
+    {
+        if ( l2dbus_xmlSpanEquals(&p->attrs[idx].name, name) )
+        {
+            value = &p->attrs[idx].value;
+            break;
+        }
+    }
+
+    if ( NULL == value )
+    {
+        lua_pushnil(p->L);
+        return LUA_TNIL;
+    }
+
+    /* The common case where there are no entities to replace */
+    if ( NULL == memchr(value->ptr, '&', value->len) )
+    {
+        lua_pushlstring(p->L, value->ptr, value->len);
+        return LUA_TSTRING;
+    }
+
+    luaL_buffinit(p->L, &b);
+    s = value->ptr;
+    e = value->ptr + value->len;
+    while ( s < e )
+    {
+        semi = ('&' == *s) ? memchr(s, ';', (size_t)(e - s)) : NULL;
+        if ( NULL == semi )
+        {
+            luaL_addchar(&b, *s++);
+            continue;
+        }
+
+        if ( (semi - s == 3) && (0 == memcmp(s, "&lt", 3)) )
+        {
+            luaL_addchar(&b, '<');
+        }
+        else if ( (semi - s == 3) && (0 == memcmp(s, "&gt", 3)) )
+        {
+            luaL_addchar(&b, '>');
+        }
+        else if ( (semi - s == 4) && (0 == memcmp(s, "&amp", 4)) )
+        {
+            luaL_addchar(&b, '&');
+        }
+        else if ( (semi - s == 5) && (0 == memcmp(s, "&quot", 5)) )
+        {
+            luaL_addchar(&b, '"');
+        }
+        else if ( (semi - s == 5) && (0 == memcmp(s, "&apos", 5)) )
+        {
+            luaL_addchar(&b, '\'');
+        }
+        else if ( (semi - s > 2) && ('#' == s[1]) )
+        {
+            /* Numeric character reference (only ASCII is meaningful in
+             * D-Bus names and signatures)
+             */
+            code = ('x' == s[2]) ? strtoul(s + 3, NULL, 16) :
+                                    strtoul(s + 2, NULL, 10);
+            luaL_addchar(&b, (code < 0x80) ? (char)code : '?');
+        }
+        else
+        {
+            /* Not an entity we know so copy it verbatim */
+            luaL_addlstring(&b, s, (size_t)(semi - s + 1));
+        }
+        s = semi + 1;
+    }
+    luaL_pushresult(&b);
+    return LUA_TSTRING;
+}
+
+
+static int
+l2dbus_xmlPushRequiredAttr
+    (
+    l2dbus_XmlParser*   p,
+    const l2dbus_XmlSpan* tag,
+    const char*         name
+    )
+{
+    if ( LUA_TNIL == l2dbus_xmlPushAttr(p, name) )
+    {
+        luaL_error(p->L, "introspection XML: <%.*s> is missing the '%s' attribute",
+                    (int)tag->len, tag->ptr, name);
+    }
+    return lua_gettop(p->L);
+}
+
+
+static void
+l2dbus_xmlAddArg
+    (
+    l2dbus_XmlParser*   p,
+    l2dbus_XmlElem*     member
+    )
+{
+    lua_State* L = p->L;
+
+    lua_createtable(L, 0, 3);
+    l2dbus_xmlPushAttr(p, "name");
+    lua_setfield(L, -2, "name");
+    l2dbus_xmlPushAttr(p, "type");
+    lua_setfield(L, -2, "sig");
+    if ( L2DBUS_XML_ELEM_SIGNAL == member->kind )
+    {
+        lua_pushliteral(L, "out");
+    }
+    else
+    {
+        l2dbus_xmlPushAttr(p, "direction");
+    }
+    lua_setfield(L, -2, "dir");
+    lua_rawseti(L, member->tblIdx, (int)lua_rawlen(L, member->tblIdx) + 1);
+}
+
+
+static void
+l2dbus_xmlAddProperty
+    (
+    l2dbus_XmlParser*   p,
+    l2dbus_XmlElem*     intf,
+    const l2dbus_XmlSpan* tag
+    )
+{
+    lua_State* L = p->L;
+    const char* access;
+
+    lua_getfield(L, intf->tblIdx, "properties");
+    l2dbus_xmlPushRequiredAttr(p, tag, "name");
+    lua_createtable(L, 0, 2);
+    l2dbus_xmlPushAttr(p, "type");
+    lua_setfield(L, -2, "sig");
+    l2dbus_xmlPushAttr(p, "access");
+    access = lua_tostring(L, -1);
+    if ( (NULL != access) && (0 == strcmp(access, "read")) )
+    {
+        lua_pushliteral(L, "r");
+    }
+    else if ( (NULL != access) && (0 == strcmp(access, "write")) )
+    {
+        lua_pushliteral(L, "w");
+    }
+    else
+    {
+        lua_pushliteral(L, "rw");
+    }
+    lua_remove(L, -2);
+    lua_setfield(L, -2, "access");
+    lua_settable(L, -3);
+    lua_pop(L, 1);
+}
+
+
+static void
+l2dbus_xmlOpenElement
+    (
+    l2dbus_XmlParser*   p,
+    const l2dbus_XmlSpan* tag
+    )
+{
+    lua_State* L = p->L;
+    l2dbus_XmlElem* parent = (p->depth > 0) ? &p->stack[p->depth - 1] : NULL;
+    l2dbus_XmlElem* elem;
+
+    if ( p->depth >= L2DBUS_XML_MAX_DEPTH )
+    {
+        luaL_error(L, "introspection XML: elements nested too deeply");
+    }
+
+    elem = &p->stack[p->depth++];
+    elem->tag = *tag;
+    elem->kind = L2DBUS_XML_ELEM_OTHER;
+    elem->tblIdx = 0;
+
+    if ( NULL == parent )
+    {
+        elem->kind = L2DBUS_XML_ELEM_ROOT;
+    }
+    else if ( L2DBUS_XML_ELEM_ROOT == parent->kind )
+    {
+        /* Interfaces of child nodes are not part of this object */
+        if ( l2dbus_xmlSpanEquals(tag, "interface") )
+        {
+            elem->kind = L2DBUS_XML_ELEM_INTERFACE;
+            l2dbus_xmlPushRequiredAttr(p, tag, "name");
+            lua_createtable(L, 0, 4);
+            elem->tblIdx = lua_gettop(L);
+            lua_pushvalue(L, -2);
+            lua_setfield(L, -2, "interface");
+            lua_newtable(L);
+            lua_setfield(L, -2, "methods");
+            lua_newtable(L);
+            lua_setfield(L, -2, "signals");
+            lua_newtable(L);
+            lua_setfield(L, -2, "properties");
+        }
+    }
+    else if ( L2DBUS_XML_ELEM_INTERFACE == parent->kind )
+    {
+        if ( l2dbus_xmlSpanEquals(tag, "method") ||
+            l2dbus_xmlSpanEquals(tag, "signal") )
+        {
+            elem->kind = ('m' == tag->ptr[0]) ? L2DBUS_XML_ELEM_METHOD :
+                                                L2DBUS_XML_ELEM_SIGNAL;
+            l2dbus_xmlPushRequiredAttr(p, tag, "name");
+            lua_newtable(L);
+            elem->tblIdx = lua_gettop(L);
+        }
+        else if ( l2dbus_xmlSpanEquals(tag, "property") )
+        {
+            l2dbus_xmlAddProperty(p, parent, tag);
+        }
+    }
+    else if ( (L2DBUS_XML_ELEM_METHOD == parent->kind) ||
+            (L2DBUS_XML_ELEM_SIGNAL == parent->kind) )
+    {
+        if ( l2dbus_xmlSpanEquals(tag, "arg") )
+        {
+            l2dbus_xmlAddArg(p, parent);
+        }
+    }
+}
+
+
+static void
+l2dbus_xmlCloseElement
+    (
+    l2dbus_XmlParser*   p,
+    const l2dbus_XmlSpan* tag
+    )
+{
+    lua_State* L = p->L;
+    l2dbus_XmlElem* elem;
+
+    if ( 0 == p->depth )
+    {
+        luaL_error(L, "introspection XML: nothing to close with %.*s",
+                    (int)tag->len, tag->ptr);
+    }
+
+    elem = &p->stack[p->depth - 1];
+    if ( (elem->tag.len != tag->len) ||
+        (0 != memcmp(elem->tag.ptr, tag->ptr, tag->len)) )
+    {
+        luaL_error(L, "introspection XML: trying to close %.*s with %.*s",
+                    (int)elem->tag.len, elem->tag.ptr, (int)tag->len, tag->ptr);
+    }
+
+    switch ( elem->kind )
+    {
+        case L2DBUS_XML_ELEM_INTERFACE:
+            /* Stack: ..., name, interface table */
+            lua_settable(L, p->resultIdx);
+            break;
+
+        case L2DBUS_XML_ELEM_METHOD:
+        case L2DBUS_XML_ELEM_SIGNAL:
+            /* Stack: ..., name, args table */
+            lua_getfield(L, p->stack[p->depth - 2].tblIdx,
+                    (L2DBUS_XML_ELEM_METHOD == elem->kind) ? "methods" : "signals");
+            lua_insert(L, -3);
+            lua_settable(L, -3);
+            lua_pop(L, 1);
+            break;
+
+        default:
+            break;
+    }
+    --p->depth;
+}
+
+
+/**
+ * @brief Parses D-Bus introspection XML into a Lua introspection table.
+ *
+ * The parser is a single pass over the XML string that builds the same
+ * table layout as ProxyController:parseXml() (see the documentation for
+ * ProxyController:bindNoIntrospect) without an intermediate document
+ * tree. Only the interfaces of the root node are included. A Lua error
+ * is raised if the XML is malformed.
+ *
+ * @param [in] L Lua state
+ * @param [in] xml The introspection XML.
+ * @param [in] len The length of the XML in bytes.
+ *
+ * On return the introspection table is on the top of the stack.
+ */
+void
+l2dbus_xmlParseIntrospection
+    (
+    lua_State*  L,
+    const char* xml,
+    size_t      len
+    )
+{
+    l2dbus_XmlParser p;
+    l2dbus_XmlSpan tag;
+    l2dbus_Bool seenRoot = L2DBUS_FALSE;
+
+    p.L = L;
+    p.base = xml;
+    p.cur = xml;
+    p.end = xml + len;
+    p.depth = 0;
+    p.nAttrs = 0;
+
+    lua_newtable(L);
+    p.resultIdx = lua_gettop(L);
+
+    while ( p.cur < p.end )
+    {
+        /* Character data is not used by introspection XML */
+        p.cur = memchr(p.cur, '<', (size_t)(p.end - p.cur));
+        if ( NULL == p.cur )
+        {
+            break;
+        }
+
+        if ( (p.end - p.cur >= 4) && (0 == memcmp(p.cur, "<!--", 4)) )
+        {
+            l2dbus_xmlSkipPast(&p, "-->");
+        }
+        else if ( (p.end - p.cur >= 2) && ('?' == p.cur[1]) )
+        {
+            l2dbus_xmlSkipPast(&p, "?>");
+        }
+        else if ( (p.end - p.cur >= 2) && ('!' == p.cur[1]) )
+        {
+            /* <!DOCTYPE ...> */
+            l2dbus_xmlSkipPast(&p, ">");
+        }
+        else if ( (p.end - p.cur >= 2) && ('/' == p.cur[1]) )
+        {
+            p.cur += 2;
+            l2dbus_xmlParseName(&p, &tag);
+            l2dbus_xmlSkipPast(&p, ">");
+            l2dbus_xmlCloseElement(&p, &tag);
+        }
+        else
+        {
+            ++p.cur;
+            l2dbus_xmlParseName(&p, &tag);
+            if ( (0 == p.depth) && seenRoot )
+            {
+                luaL_error(L, "introspection XML: more than one root element");
+            }
+            seenRoot = L2DBUS_TRUE;
+
+            /* The attributes must be parsed before the element is opened
+             * since they are referenced when the element is created.
+             */
+            if ( l2dbus_xmlParseAttrs(&p) )
+            {
+                l2dbus_xmlOpenElement(&p, &tag);
+                l2dbus_xmlCloseElement(&p, &tag);
+            }
+            else
+            {
+                l2dbus_xmlOpenElement(&p, &tag);
+            }
+        }
+    }
+
+    if ( p.depth > 0 )
+    {
+        luaL_error(L, "introspection XML: unclosed element <%.*s>",
+                    (int)p.stack[p.depth - 1].tag.len,
+                    p.stack[p.depth - 1].tag.ptr);
+    }
+
+    lua_settop(L, p.resultIdx);
+}
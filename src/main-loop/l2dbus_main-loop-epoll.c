@@ -0,0 +1,1678 @@
+/*===========================================================================
+ * 
+ * Project         l2dbus
+ *
+ * Released under the MIT License (MIT)
+ * Copyright (c) 2013 XS-Embedded LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN
+ * NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *===========================================================================
+ *===========================================================================
+ * @file           l2dbus_main-loop-epoll.c
+ * @author         Glenn Schmottlach
+ * @brief          The epoll based main-loop module for L2DBUS.
+ *===========================================================================
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include "lua.h"
+#include "dbus/dbus.h"
+#include "queue.h"
+#include "l2dbus_main-loop.h"
+#include "cdbus/cdbus.h"
+#include "cdbus/mainloop.h"
+#include "l2dbus_compat.h"
+#include "l2dbus_types.h"
+#include "l2dbus_util.h"
+#include "l2dbus_alloc.h"
+#include "l2dbus_module.h"
+
+
+/**
+The L2DBUS epoll main loop implementation.
+
+This module provides a dependency-free main-loop built directly on the Linux
+epoll(7), timerfd(2) and eventfd(2) interfaces. Every watch descriptor is held
+in a single epoll set, all timers share one timerfd that is armed to the
+earliest expiry of a binary heap, and cross-thread wake-ups are delivered
+through a single eventfd. A steady-state iteration costs one epoll_wait(2)
+and, only when the earliest timer changes, one timerfd_settime(2).
+
+ @module l2dbus-epoll
+ */
+
+#define L2DBUS_MAIN_LOOP_EPOLL_MAJOR_VER       (1)
+#define L2DBUS_MAIN_LOOP_EPOLL_MINOR_VER       (0)
+#define L2DBUS_MAIN_LOOP_EPOLL_RELEASE_VER     (0)
+#define L2DBUS_MAIN_LOOP_EPOLL_COPYRIGHT       "(c) Copyright 2013 XS-Embedded LLC"
+#define L2DBUS_MAIN_LOOP_EPOLL_AUTHOR          "Glenn Schmottlach"
+
+/* Maximum number of events harvested by a single epoll_wait() call */
+#define L2DBUS_EPOLL_MAX_EVENTS                 (32)
+
+/* Number of buckets in the descriptor hash (must be a power of two) */
+#define L2DBUS_EPOLL_FD_BUCKETS                 (32)
+
+/* Initial capacity of the timer heap */
+#define L2DBUS_EPOLL_HEAP_INIT_SIZE             (16)
+
+#define L2DBUS_EPOLL_NSEC_PER_MSEC              (1000000ULL)
+#define L2DBUS_EPOLL_NSEC_PER_SEC               (1000000000ULL)
+
+
+typedef struct l2dbus_EpollLoop l2dbus_EpollLoop;
+typedef struct l2dbus_EpollFd l2dbus_EpollFd;
+
+/*
+ * A single cdbus watch. D-Bus routinely creates separate read and write
+ * watches for the same socket so watches hang off a shared descriptor entry.
+ */
+typedef struct l2dbus_EpollWatch
+{
+    l2dbus_EpollLoop*               loop;
+    l2dbus_EpollFd*                 fdEntry;
+    cdbus_UInt32                    flags;
+    cdbus_Bool                      enabled;
+    cdbus_Bool                      isDead;
+    cdbus_MainLoopWatchCbFunc       cbFunc;
+    void*                           data;
+    LIST_ENTRY(l2dbus_EpollWatch)   fdLink;
+    LIST_ENTRY(l2dbus_EpollWatch)   deadLink;
+} l2dbus_EpollWatch;
+
+/*
+ * One entry per descriptor registered with the epoll set. The epoll event
+ * carries the descriptor itself (not a pointer) so an entry dropped while a
+ * batch of events is being dispatched is simply not found.
+ */
+struct l2dbus_EpollFd
+{
+    cdbus_Descriptor                fd;
+    cdbus_UInt32                    armedEvents;
+    cdbus_Bool                      isRegistered;
+    LIST_HEAD(l2dbus_EpollWatchHead,
+        l2dbus_EpollWatch)          watches;
+    LIST_ENTRY(l2dbus_EpollFd)      hashLink;
+};
+
+typedef struct l2dbus_EpollTimer
+{
+    l2dbus_EpollLoop*               loop;
+    cdbus_Int32                     interval;
+    cdbus_Bool                      repeat;
+    cdbus_Bool                      enabled;
+    cdbus_Bool                      isDead;
+    unsigned long long              expiry;
+    unsigned long                   runGen;
+    int                             heapIdx;
+    cdbus_MainLoopTimerCbFunc       cbFunc;
+    void*                           data;
+    LIST_ENTRY(l2dbus_EpollTimer)   deadLink;
+} l2dbus_EpollTimer;
+
+typedef struct l2dbus_EpollAsync
+{
+    l2dbus_EpollLoop*               loop;
+    volatile int                    pending;
+    cdbus_Bool                      isDead;
+    cdbus_MainLoopAsyncCbFunc       cbFunc;
+    void*                           data;
+    LIST_ENTRY(l2dbus_EpollAsync)   link;
+} l2dbus_EpollAsync;
+
+/*
+ * The epoll main loop. The cdbus main loop interface **MUST** be declared
+ * first so the loop can be handed to CDBUS as a cdbus_MainLoop.
+ */
+struct l2dbus_EpollLoop
+{
+    struct cdbus_MainLoop           super;
+
+    int                             epollFd;
+    int                             timerFd;
+    int                             wakeFd;
+    cdbus_Bool                      edgeTriggered;
+    cdbus_Bool                      quit;
+    volatile int                    wakePending;
+    int                             dispatchDepth;
+
+    LIST_HEAD(l2dbus_EpollFdHead,
+        l2dbus_EpollFd)             fdBuckets[L2DBUS_EPOLL_FD_BUCKETS];
+
+    l2dbus_EpollTimer**             heap;
+    int                             heapSize;
+    int                             heapCapacity;
+    unsigned long long              armedExpiry;
+    unsigned long                   runGen;
+
+    LIST_HEAD(l2dbus_EpollAsyncHead,
+        l2dbus_EpollAsync)          asyncs;
+
+    /* Objects destroyed while events were being dispatched */
+    LIST_HEAD(l2dbus_EpollDeadWatchHead,
+        l2dbus_EpollWatch)          deadWatches;
+    LIST_HEAD(l2dbus_EpollDeadTimerHead,
+        l2dbus_EpollTimer)          deadTimers;
+};
+
+/*
+ * Extension of the base l2dbus_MainLoopUserData type
+ */
+typedef struct l2dbus_MainLoopEpollUserData
+{
+    /* Must always be declared first */
+    struct cdbus_MainLoop* loop;
+} l2dbus_MainLoopEpollUserData;
+
+
+static cdbus_HResult
+l2dbus_epollMakeError
+    (
+    cdbus_UInt32    errCode
+    )
+{
+    return CDBUS_MAKE_HRESULT(CDBUS_SEV_FAILURE, CDBUS_FAC_CDBUS, errCode);
+}
+
+
+static unsigned long long
+l2dbus_epollNow(void)
+{
+    struct timespec ts;
+
+    /* Served from the vDSO so this does not cost a system call */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((unsigned long long)ts.tv_sec * L2DBUS_EPOLL_NSEC_PER_SEC) +
+            (unsigned long long)ts.tv_nsec;
+}
+
+
+/*
+ * Descriptor management
+ */
+
+static l2dbus_EpollFd*
+l2dbus_epollFdFind
+    (
+    l2dbus_EpollLoop*   loop,
+    cdbus_Descriptor    fd
+    )
+{
+    l2dbus_EpollFd* entry;
+
+    LIST_FOREACH(entry, &loop->fdBuckets[fd & (L2DBUS_EPOLL_FD_BUCKETS - 1)],
+                hashLink)
+    {
+        if ( entry->fd == fd )
+        {
+            break;
+        }
+    }
+
+    return entry;
+}
+
+
+static cdbus_UInt32
+l2dbus_epollFdWantedEvents
+    (
+    l2dbus_EpollFd* entry
+    )
+{
+    l2dbus_EpollWatch* watch;
+    cdbus_UInt32 events = 0U;
+
+    LIST_FOREACH(watch, &entry->watches, fdLink)
+    {
+        if ( !watch->isDead && watch->enabled )
+        {
+            if ( watch->flags & DBUS_WATCH_READABLE )
+            {
+                events |= EPOLLIN;
+            }
+            if ( watch->flags & DBUS_WATCH_WRITABLE )
+            {
+                events |= EPOLLOUT;
+            }
+        }
+    }
+
+    return events;
+}
+
+
+/*
+ * Brings the epoll registration of a descriptor in line with the enabled
+ * watches attached to it. Nothing is issued to the kernel if the wanted
+ * event mask has not changed.
+ */
+static cdbus_HResult
+l2dbus_epollFdUpdate
+    (
+    l2dbus_EpollLoop*   loop,
+    l2dbus_EpollFd*     entry
+    )
+{
+    struct epoll_event ev;
+    cdbus_UInt32 wanted = l2dbus_epollFdWantedEvents(entry);
+    int rc = 0;
+
+    if ( 0U == wanted )
+    {
+        if ( entry->isRegistered )
+        {
+            /* The descriptor may already be closed so ignore failures */
+            (void)epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, entry->fd, &ev);
+            entry->isRegistered = CDBUS_FALSE;
+        }
+        entry->armedEvents = 0U;
+    }
+    else if ( !entry->isRegistered || (wanted != entry->armedEvents) )
+    {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = wanted;
+        if ( loop->edgeTriggered )
+        {
+            ev.events |= EPOLLET;
+        }
+        ev.data.fd = entry->fd;
+
+        if ( entry->isRegistered )
+        {
+            rc = epoll_ctl(loop->epollFd, EPOLL_CTL_MOD, entry->fd, &ev);
+            /* The kernel drops closed descriptors from the set on its own
+             * so a recycled descriptor number has to be added again.
+             */
+            if ( (0 != rc) && (ENOENT == errno) )
+            {
+                rc = epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, entry->fd, &ev);
+            }
+        }
+        else
+        {
+            rc = epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, entry->fd, &ev);
+            if ( (0 != rc) && (EEXIST == errno) )
+            {
+                rc = epoll_ctl(loop->epollFd, EPOLL_CTL_MOD, entry->fd, &ev);
+            }
+        }
+
+        if ( 0 == rc )
+        {
+            entry->isRegistered = CDBUS_TRUE;
+            entry->armedEvents = wanted;
+        }
+    }
+
+    return (0 == rc) ? CDBUS_RESULT_SUCCESS :
+                        l2dbus_epollMakeError(CDBUS_EC_INTERNAL);
+}
+
+
+static void
+l2dbus_epollFdRelease
+    (
+    l2dbus_EpollLoop*   loop,
+    l2dbus_EpollFd*     entry
+    )
+{
+    if ( LIST_EMPTY(&entry->watches) )
+    {
+        (void)l2dbus_epollFdUpdate(loop, entry);
+        LIST_REMOVE(entry, hashLink);
+        l2dbus_free(entry);
+    }
+}
+
+
+static void
+l2dbus_epollWatchFree
+    (
+    l2dbus_EpollWatch*  watch
+    )
+{
+    l2dbus_EpollFd* entry = watch->fdEntry;
+
+    LIST_REMOVE(watch, fdLink);
+    l2dbus_epollFdRelease(watch->loop, entry);
+    l2dbus_free(watch);
+}
+
+
+/*
+ * Timer heap (min-heap ordered by absolute expiry)
+ */
+
+static void
+l2dbus_epollHeapSet
+    (
+    l2dbus_EpollLoop*   loop,
+    int                 idx,
+    l2dbus_EpollTimer*  timer
+    )
+{
+    loop->heap[idx] = timer;
+    timer->heapIdx = idx;
+}
+
+
+static void
+l2dbus_epollHeapSiftUp
+    (
+    l2dbus_EpollLoop*   loop,
+    int                 idx
+    )
+{
+    l2dbus_EpollTimer* timer = loop->heap[idx];
+    int parent;
+
+    while ( idx > 0 )
+    {
+        parent = (idx - 1) / 2;
+        if ( loop->heap[parent]->expiry <= timer->expiry )
+        {
+            break;
+        }
+        l2dbus_epollHeapSet(loop, idx, loop->heap[parent]);
+        idx = parent;
+    }
+    l2dbus_epollHeapSet(loop, idx, timer);
+}
+
+
+static void
+l2dbus_epollHeapSiftDown
+    (
+    l2dbus_EpollLoop*   loop,
+    int                 idx
+    )
+{
+    l2dbus_EpollTimer* timer = loop->heap[idx];
+    int child;
+
+    for ( child = (2 * idx) + 1; child < loop->heapSize;
+        child = (2 * idx) + 1 )
+    {
+        if ( ((child + 1) < loop->heapSize) &&
+            (loop->heap[child + 1]->expiry < loop->heap[child]->expiry) )
+        {
+            child++;
+        }
+        if ( timer->expiry <= loop->heap[child]->expiry )
+        {
+            break;
+        }
+        l2dbus_epollHeapSet(loop, idx, loop->heap[child]);
+        idx = child;
+    }
+    l2dbus_epollHeapSet(loop, idx, timer);
+}
+
+
+static cdbus_Bool
+l2dbus_epollHeapInsert
+    (
+    l2dbus_EpollLoop*   loop,
+    l2dbus_EpollTimer*  timer
+    )
+{
+    l2dbus_EpollTimer** heap;
+    int capacity;
+
+    if ( loop->heapSize == loop->heapCapacity )
+    {
+        capacity = (0 == loop->heapCapacity) ? L2DBUS_EPOLL_HEAP_INIT_SIZE :
+                                            (2 * loop->heapCapacity);
+        heap = (l2dbus_EpollTimer**)l2dbus_realloc(loop->heap,
+                                            capacity * sizeof(*heap));
+        if ( NULL == heap )
+        {
+            return CDBUS_FALSE;
+        }
+        loop->heap = heap;
+        loop->heapCapacity = capacity;
+    }
+
+    l2dbus_epollHeapSet(loop, loop->heapSize, timer);
+    loop->heapSize++;
+    l2dbus_epollHeapSiftUp(loop, timer->heapIdx);
+
+    return CDBUS_TRUE;
+}
+
+
+static void
+l2dbus_epollHeapRemove
+    (
+    l2dbus_EpollLoop*   loop,
+    l2dbus_EpollTimer*  timer
+    )
+{
+    int idx = timer->heapIdx;
+    l2dbus_EpollTimer* last;
+
+    if ( idx >= 0 )
+    {
+        loop->heapSize--;
+        last = loop->heap[loop->heapSize];
+        if ( last != timer )
+        {
+            l2dbus_epollHeapSet(loop, idx, last);
+            if ( (idx > 0) &&
+                (loop->heap[(idx - 1) / 2]->expiry > last->expiry) )
+            {
+                l2dbus_epollHeapSiftUp(loop, idx);
+            }
+            else
+            {
+                l2dbus_epollHeapSiftDown(loop, idx);
+            }
+        }
+        timer->heapIdx = -1;
+    }
+}
+
+
+static cdbus_HResult
+l2dbus_epollTimerSchedule
+    (
+    l2dbus_EpollTimer*  timer,
+    unsigned long long  now
+    )
+{
+    l2dbus_epollHeapRemove(timer->loop, timer);
+    timer->expiry = now + ((unsigned long long)timer->interval *
+                            L2DBUS_EPOLL_NSEC_PER_MSEC);
+    if ( !l2dbus_epollHeapInsert(timer->loop, timer) )
+    {
+        timer->enabled = CDBUS_FALSE;
+        return l2dbus_epollMakeError(CDBUS_EC_ALLOC_FAILURE);
+    }
+    timer->enabled = CDBUS_TRUE;
+
+    return CDBUS_RESULT_SUCCESS;
+}
+
+
+/*
+ * Arms the shared timerfd for the earliest timer. Returns the timeout that
+ * should be passed to epoll_wait(): zero if a timer is already due and
+ * otherwise the caller supplied (blocking) timeout.
+ */
+static int
+l2dbus_epollArmTimer
+    (
+    l2dbus_EpollLoop*   loop,
+    int                 waitMsec
+    )
+{
+    struct itimerspec spec;
+    unsigned long long expiry;
+
+    if ( (0 == waitMsec) || (0 == loop->heapSize) )
+    {
+        return waitMsec;
+    }
+
+    expiry = loop->heap[0]->expiry;
+    if ( expiry <= l2dbus_epollNow() )
+    {
+        return 0;
+    }
+
+    if ( expiry != loop->armedExpiry )
+    {
+        memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec = (time_t)(expiry / L2DBUS_EPOLL_NSEC_PER_SEC);
+        spec.it_value.tv_nsec = (long)(expiry % L2DBUS_EPOLL_NSEC_PER_SEC);
+        if ( 0 == timerfd_settime(loop->timerFd, TFD_TIMER_ABSTIME,
+                                &spec, NULL) )
+        {
+            loop->armedExpiry = expiry;
+        }
+    }
+
+    return waitMsec;
+}
+
+
+static void
+l2dbus_epollRunTimers
+    (
+    l2dbus_EpollLoop*   loop
+    )
+{
+    l2dbus_EpollTimer* timer;
+    unsigned long long now;
+
+    if ( 0 == loop->heapSize )
+    {
+        return;
+    }
+
+    now = l2dbus_epollNow();
+
+    /* A generation stamp keeps zero-interval repeating timers from
+     * starving the loop by firing more than once per pass.
+     */
+    loop->runGen++;
+    while ( (loop->heapSize > 0) && (loop->heap[0]->expiry <= now) &&
+            (loop->heap[0]->runGen != loop->runGen) )
+    {
+        timer = loop->heap[0];
+        timer->runGen = loop->runGen;
+        if ( timer->repeat )
+        {
+            (void)l2dbus_epollTimerSchedule(timer, now);
+        }
+        else
+        {
+            l2dbus_epollHeapRemove(loop, timer);
+            timer->enabled = CDBUS_FALSE;
+        }
+
+        if ( NULL != timer->cbFunc )
+        {
+            (void)timer->cbFunc((cdbus_MainLoopTimer*)timer, timer->data);
+        }
+    }
+}
+
+
+/*
+ * Event dispatch
+ */
+
+static void
+l2dbus_epollDispatchFd
+    (
+    l2dbus_EpollLoop*   loop,
+    cdbus_Descriptor    fd,
+    cdbus_UInt32        events
+    )
+{
+    l2dbus_EpollFd* entry = l2dbus_epollFdFind(loop, fd);
+    l2dbus_EpollWatch* watch;
+    cdbus_UInt32 rcvFlags = 0U;
+    cdbus_UInt32 flags;
+
+    if ( NULL == entry )
+    {
+        return;
+    }
+
+    if ( events & EPOLLIN )
+    {
+        rcvFlags |= DBUS_WATCH_READABLE;
+    }
+    if ( events & EPOLLOUT )
+    {
+        rcvFlags |= DBUS_WATCH_WRITABLE;
+    }
+    if ( events & EPOLLERR )
+    {
+        rcvFlags |= DBUS_WATCH_ERROR;
+    }
+    if ( events & EPOLLHUP )
+    {
+        rcvFlags |= DBUS_WATCH_HANGUP;
+    }
+
+    /* Watches destroyed by a callback stay linked until the sweep */
+    LIST_FOREACH(watch, &entry->watches, fdLink)
+    {
+        if ( !watch->isDead && watch->enabled && (NULL != watch->cbFunc) )
+        {
+            /* Errors and hang-ups are always reported */
+            flags = rcvFlags & (watch->flags |
+                                DBUS_WATCH_ERROR | DBUS_WATCH_HANGUP);
+            if ( 0U != flags )
+            {
+                (void)watch->cbFunc((cdbus_MainLoopWatch*)watch, flags,
+                                    watch->data);
+            }
+        }
+    }
+}
+
+
+static void
+l2dbus_epollRunAsyncs
+    (
+    l2dbus_EpollLoop*   loop
+    )
+{
+    l2dbus_EpollAsync* async;
+    l2dbus_EpollAsync* next;
+    eventfd_t counter;
+
+    (void)eventfd_read(loop->wakeFd, &counter);
+    __sync_lock_release(&loop->wakePending);
+
+    for ( async = LIST_FIRST(&loop->asyncs); NULL != async; async = next )
+    {
+        next = LIST_NEXT(async, link);
+        if ( !async->isDead && __sync_lock_test_and_set(&async->pending, 0) &&
+            (NULL != async->cbFunc) )
+        {
+            async->cbFunc((cdbus_MainLoopAsync*)async, async->data);
+        }
+    }
+}
+
+
+static void
+l2dbus_epollSweep
+    (
+    l2dbus_EpollLoop*   loop
+    )
+{
+    l2dbus_EpollWatch* watch;
+    l2dbus_EpollTimer* timer;
+    l2dbus_EpollAsync* async;
+    l2dbus_EpollAsync* next;
+
+    while ( !LIST_EMPTY(&loop->deadWatches) )
+    {
+        watch = LIST_FIRST(&loop->deadWatches);
+        LIST_REMOVE(watch, deadLink);
+        l2dbus_epollWatchFree(watch);
+    }
+
+    while ( !LIST_EMPTY(&loop->deadTimers) )
+    {
+        timer = LIST_FIRST(&loop->deadTimers);
+        LIST_REMOVE(timer, deadLink);
+        l2dbus_free(timer);
+    }
+
+    for ( async = LIST_FIRST(&loop->asyncs); NULL != async; async = next )
+    {
+        next = LIST_NEXT(async, link);
+        if ( async->isDead )
+        {
+            LIST_REMOVE(async, link);
+            l2dbus_free(async);
+        }
+    }
+}
+
+
+static void
+l2dbus_epollPoll
+    (
+    l2dbus_EpollLoop*   loop,
+    cdbus_Bool          block
+    )
+{
+    struct epoll_event events[L2DBUS_EPOLL_MAX_EVENTS];
+    unsigned long long expirations;
+    int nEvents;
+    int idx;
+
+    nEvents = epoll_wait(loop->epollFd, events, L2DBUS_EPOLL_MAX_EVENTS,
+                        l2dbus_epollArmTimer(loop, block ? -1 : 0));
+    if ( nEvents < 0 )
+    {
+        /* EINTR and friends: just run whatever timers are due */
+        nEvents = 0;
+    }
+
+    loop->dispatchDepth++;
+    for ( idx = 0; idx < nEvents; ++idx )
+    {
+        if ( events[idx].data.fd == loop->timerFd )
+        {
+            /* The timer heap is consulted below regardless */
+            (void)read(loop->timerFd, &expirations, sizeof(expirations));
+            loop->armedExpiry = 0ULL;
+        }
+        else if ( events[idx].data.fd == loop->wakeFd )
+        {
+            l2dbus_epollRunAsyncs(loop);
+        }
+        else
+        {
+            l2dbus_epollDispatchFd(loop, events[idx].data.fd,
+                                events[idx].events);
+        }
+    }
+    l2dbus_epollRunTimers(loop);
+    loop->dispatchDepth--;
+
+    if ( 0 == loop->dispatchDepth )
+    {
+        l2dbus_epollSweep(loop);
+    }
+}
+
+
+/*
+ * cdbus_MainLoop interface: loop
+ */
+
+static void
+l2dbus_epollLoopUnref
+    (
+    cdbus_MainLoop* mainLoop
+    )
+{
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)mainLoop;
+    l2dbus_EpollFd* entry;
+    l2dbus_EpollWatch* watch;
+    l2dbus_EpollAsync* async;
+    int idx;
+
+    if ( NULL == loop )
+    {
+        return;
+    }
+
+    l2dbus_epollSweep(loop);
+
+    for ( idx = 0; idx < L2DBUS_EPOLL_FD_BUCKETS; ++idx )
+    {
+        while ( !LIST_EMPTY(&loop->fdBuckets[idx]) )
+        {
+            entry = LIST_FIRST(&loop->fdBuckets[idx]);
+            while ( !LIST_EMPTY(&entry->watches) )
+            {
+                watch = LIST_FIRST(&entry->watches);
+                LIST_REMOVE(watch, fdLink);
+                l2dbus_free(watch);
+            }
+            LIST_REMOVE(entry, hashLink);
+            l2dbus_free(entry);
+        }
+    }
+
+    for ( idx = 0; idx < loop->heapSize; ++idx )
+    {
+        l2dbus_free(loop->heap[idx]);
+    }
+    l2dbus_free(loop->heap);
+
+    while ( !LIST_EMPTY(&loop->asyncs) )
+    {
+        async = LIST_FIRST(&loop->asyncs);
+        LIST_REMOVE(async, link);
+        l2dbus_free(async);
+    }
+
+    if ( loop->wakeFd >= 0 )
+    {
+        close(loop->wakeFd);
+    }
+    if ( loop->timerFd >= 0 )
+    {
+        close(loop->timerFd);
+    }
+    if ( loop->epollFd >= 0 )
+    {
+        close(loop->epollFd);
+    }
+    l2dbus_free(loop);
+}
+
+
+static void
+l2dbus_epollLoopIterate
+    (
+    cdbus_MainLoop*     mainLoop,
+    cdbus_RunOption     option
+    )
+{
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)mainLoop;
+
+    if ( NULL != loop->super.loopPre )
+    {
+        loop->super.loopPre(mainLoop);
+    }
+
+    loop->quit = CDBUS_FALSE;
+    do
+    {
+        l2dbus_epollPoll(loop, CDBUS_RUN_NO_WAIT != option);
+    }
+    while ( (CDBUS_RUN_WAIT == option) && !loop->quit );
+    loop->quit = CDBUS_FALSE;
+
+    if ( NULL != loop->super.loopPost )
+    {
+        loop->super.loopPost(mainLoop);
+    }
+}
+
+
+static void
+l2dbus_epollLoopQuit
+    (
+    cdbus_MainLoop* mainLoop
+    )
+{
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)mainLoop;
+
+    loop->quit = CDBUS_TRUE;
+
+    /* Kick a blocked epoll_wait() so the quit is noticed */
+    if ( !__sync_lock_test_and_set(&loop->wakePending, 1) )
+    {
+        (void)eventfd_write(loop->wakeFd, 1);
+    }
+}
+
+
+/*
+ * cdbus_MainLoop interface: watches
+ */
+
+static cdbus_MainLoopWatch*
+l2dbus_epollWatchNew
+    (
+    cdbus_MainLoop*             mainLoop,
+    cdbus_Descriptor            fd,
+    cdbus_UInt32                flags,
+    cdbus_MainLoopWatchCbFunc   f,
+    void*                       data
+    )
+{
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)mainLoop;
+    l2dbus_EpollWatch* watch;
+    l2dbus_EpollFd* entry;
+
+    if ( (NULL == loop) || (fd < 0) )
+    {
+        return NULL;
+    }
+
+    entry = l2dbus_epollFdFind(loop, fd);
+    if ( NULL == entry )
+    {
+        entry = (l2dbus_EpollFd*)l2dbus_calloc(1, sizeof(*entry));
+        if ( NULL == entry )
+        {
+            return NULL;
+        }
+        entry->fd = fd;
+        LIST_INIT(&entry->watches);
+        LIST_INSERT_HEAD(&loop->fdBuckets[fd & (L2DBUS_EPOLL_FD_BUCKETS - 1)],
+                        entry, hashLink);
+    }
+
+    watch = (l2dbus_EpollWatch*)l2dbus_calloc(1, sizeof(*watch));
+    if ( NULL == watch )
+    {
+        l2dbus_epollFdRelease(loop, entry);
+        return NULL;
+    }
+
+    /* Watches start out disabled just like the other main loops */
+    watch->loop = loop;
+    watch->fdEntry = entry;
+    watch->flags = flags;
+    watch->enabled = CDBUS_FALSE;
+    watch->cbFunc = f;
+    watch->data = data;
+    LIST_INSERT_HEAD(&entry->watches, watch, fdLink);
+
+    return (cdbus_MainLoopWatch*)watch;
+}
+
+
+static void
+l2dbus_epollWatchDestroy
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w
+    )
+{
+    l2dbus_EpollWatch* watch = (l2dbus_EpollWatch*)w;
+
+    if ( (NULL == watch) || watch->isDead )
+    {
+        return;
+    }
+
+    watch->isDead = CDBUS_TRUE;
+    if ( watch->loop->dispatchDepth > 0 )
+    {
+        /* Stop listening right away (the descriptor may be closed next)
+         * but keep the memory until the current dispatch unwinds.
+         */
+        (void)l2dbus_epollFdUpdate(watch->loop, watch->fdEntry);
+        LIST_INSERT_HEAD(&watch->loop->deadWatches, watch, deadLink);
+    }
+    else
+    {
+        l2dbus_epollWatchFree(watch);
+    }
+}
+
+
+static cdbus_Descriptor
+l2dbus_epollWatchGetDescriptor
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w
+    )
+{
+    l2dbus_EpollWatch* watch = (l2dbus_EpollWatch*)w;
+
+    return (NULL != watch) ? watch->fdEntry->fd : -1;
+}
+
+
+static cdbus_Bool
+l2dbus_epollWatchIsEnabled
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w
+    )
+{
+    l2dbus_EpollWatch* watch = (l2dbus_EpollWatch*)w;
+
+    return (NULL != watch) && !watch->isDead && watch->enabled;
+}
+
+
+static cdbus_HResult
+l2dbus_epollWatchEnable
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w,
+    cdbus_Bool              option
+    )
+{
+    l2dbus_EpollWatch* watch = (l2dbus_EpollWatch*)w;
+
+    if ( (NULL == watch) || watch->isDead )
+    {
+        return l2dbus_epollMakeError(CDBUS_EC_INVALID_PARAMETER);
+    }
+
+    watch->enabled = option ? CDBUS_TRUE : CDBUS_FALSE;
+
+    return l2dbus_epollFdUpdate(watch->loop, watch->fdEntry);
+}
+
+
+static cdbus_UInt32
+l2dbus_epollWatchGetFlags
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w
+    )
+{
+    l2dbus_EpollWatch* watch = (l2dbus_EpollWatch*)w;
+
+    return (NULL != watch) ? watch->flags : 0U;
+}
+
+
+static cdbus_HResult
+l2dbus_epollWatchSetFlags
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w,
+    cdbus_UInt32            flags
+    )
+{
+    l2dbus_EpollWatch* watch = (l2dbus_EpollWatch*)w;
+
+    if ( (NULL == watch) || watch->isDead )
+    {
+        return l2dbus_epollMakeError(CDBUS_EC_INVALID_PARAMETER);
+    }
+
+    watch->flags = flags;
+
+    return l2dbus_epollFdUpdate(watch->loop, watch->fdEntry);
+}
+
+
+static void*
+l2dbus_epollWatchGetData
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w
+    )
+{
+    l2dbus_EpollWatch* watch = (l2dbus_EpollWatch*)w;
+
+    return (NULL != watch) ? watch->data : NULL;
+}
+
+
+static void
+l2dbus_epollWatchSetData
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w,
+    void*                   data
+    )
+{
+    l2dbus_EpollWatch* watch = (l2dbus_EpollWatch*)w;
+
+    if ( NULL != watch )
+    {
+        watch->data = data;
+    }
+}
+
+
+/*
+ * cdbus_MainLoop interface: timers
+ */
+
+static cdbus_MainLoopTimer*
+l2dbus_epollTimerNew
+    (
+    cdbus_MainLoop*             mainLoop,
+    cdbus_Int32                 msecInterval,
+    cdbus_Bool                  repeat,
+    cdbus_MainLoopTimerCbFunc   f,
+    void*                       data
+    )
+{
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)mainLoop;
+    l2dbus_EpollTimer* timer;
+
+    if ( NULL == loop )
+    {
+        return NULL;
+    }
+
+    timer = (l2dbus_EpollTimer*)l2dbus_calloc(1, sizeof(*timer));
+    if ( NULL != timer )
+    {
+        /* Timers start out disabled just like the other main loops */
+        timer->loop = loop;
+        timer->interval = (msecInterval < 0) ? 0 : msecInterval;
+        timer->repeat = repeat;
+        timer->enabled = CDBUS_FALSE;
+        timer->heapIdx = -1;
+        timer->cbFunc = f;
+        timer->data = data;
+    }
+
+    return (cdbus_MainLoopTimer*)timer;
+}
+
+
+static void
+l2dbus_epollTimerDestroy
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    if ( (NULL == timer) || timer->isDead )
+    {
+        return;
+    }
+
+    timer->isDead = CDBUS_TRUE;
+    timer->enabled = CDBUS_FALSE;
+    l2dbus_epollHeapRemove(timer->loop, timer);
+
+    if ( timer->loop->dispatchDepth > 0 )
+    {
+        LIST_INSERT_HEAD(&timer->loop->deadTimers, timer, deadLink);
+    }
+    else
+    {
+        l2dbus_free(timer);
+    }
+}
+
+
+static cdbus_Bool
+l2dbus_epollTimerIsEnabled
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    return (NULL != timer) && !timer->isDead && timer->enabled;
+}
+
+
+static cdbus_HResult
+l2dbus_epollTimerEnable
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t,
+    cdbus_Bool              option
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    if ( (NULL == timer) || timer->isDead )
+    {
+        return l2dbus_epollMakeError(CDBUS_EC_INVALID_PARAMETER);
+    }
+
+    if ( option )
+    {
+        /* (Re)enabling always restarts the interval */
+        return l2dbus_epollTimerSchedule(timer, l2dbus_epollNow());
+    }
+
+    l2dbus_epollHeapRemove(timer->loop, timer);
+    timer->enabled = CDBUS_FALSE;
+
+    return CDBUS_RESULT_SUCCESS;
+}
+
+
+static cdbus_Int32
+l2dbus_epollTimerGetInterval
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    return (NULL != timer) ? timer->interval : 0;
+}
+
+
+static cdbus_HResult
+l2dbus_epollTimerSetInterval
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t,
+    cdbus_Int32             msecInterval
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    if ( (NULL == timer) || timer->isDead || (msecInterval < 0) )
+    {
+        return l2dbus_epollMakeError(CDBUS_EC_INVALID_PARAMETER);
+    }
+
+    timer->interval = msecInterval;
+    if ( timer->enabled )
+    {
+        return l2dbus_epollTimerSchedule(timer, l2dbus_epollNow());
+    }
+
+    return CDBUS_RESULT_SUCCESS;
+}
+
+
+static cdbus_Bool
+l2dbus_epollTimerGetRepeat
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    return (NULL != timer) ? timer->repeat : CDBUS_FALSE;
+}
+
+
+static void
+l2dbus_epollTimerSetRepeat
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t,
+    cdbus_Bool              repeat
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    if ( NULL != timer )
+    {
+        timer->repeat = repeat;
+    }
+}
+
+
+static void*
+l2dbus_epollTimerGetData
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    return (NULL != timer) ? timer->data : NULL;
+}
+
+
+static void
+l2dbus_epollTimerSetData
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t,
+    void*                   data
+    )
+{
+    l2dbus_EpollTimer* timer = (l2dbus_EpollTimer*)t;
+
+    if ( NULL != timer )
+    {
+        timer->data = data;
+    }
+}
+
+
+/*
+ * cdbus_MainLoop interface: asynchronous (cross-thread) wake-ups
+ */
+
+static cdbus_MainLoopAsync*
+l2dbus_epollAsyncNew
+    (
+    cdbus_MainLoop*             mainLoop,
+    cdbus_MainLoopAsyncCbFunc   f,
+    void*                       data
+    )
+{
+    l2dbus_EpollLoop* loop = (l2dbus_EpollLoop*)mainLoop;
+    l2dbus_EpollAsync* async;
+
+    if ( NULL == loop )
+    {
+        return NULL;
+    }
+
+    async = (l2dbus_EpollAsync*)l2dbus_calloc(1, sizeof(*async));
+    if ( NULL != async )
+    {
+        async->loop = loop;
+        async->cbFunc = f;
+        async->data = data;
+        LIST_INSERT_HEAD(&loop->asyncs, async, link);
+    }
+
+    return (cdbus_MainLoopAsync*)async;
+}
+
+
+static void
+l2dbus_epollAsyncDestroy
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopAsync*    a
+    )
+{
+    l2dbus_EpollAsync* async = (l2dbus_EpollAsync*)a;
+
+    if ( (NULL == async) || async->isDead )
+    {
+        return;
+    }
+
+    async->isDead = CDBUS_TRUE;
+    if ( 0 == async->loop->dispatchDepth )
+    {
+        LIST_REMOVE(async, link);
+        l2dbus_free(async);
+    }
+}
+
+
+static void
+l2dbus_epollAsyncSend
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopAsync*    a
+    )
+{
+    l2dbus_EpollAsync* async = (l2dbus_EpollAsync*)a;
+    l2dbus_EpollLoop* loop;
+
+    if ( NULL == async )
+    {
+        return;
+    }
+
+    loop = async->loop;
+    (void)__sync_lock_test_and_set(&async->pending, 1);
+
+    /* Coalesce concurrent sends into a single eventfd write */
+    if ( !__sync_lock_test_and_set(&loop->wakePending, 1) )
+    {
+        (void)eventfd_write(loop->wakeFd, 1);
+    }
+}
+
+
+static void*
+l2dbus_epollAsyncGetData
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopAsync*    a
+    )
+{
+    l2dbus_EpollAsync* async = (l2dbus_EpollAsync*)a;
+
+    return (NULL != async) ? async->data : NULL;
+}
+
+
+static void
+l2dbus_epollAsyncSetData
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopAsync*    a,
+    void*                   data
+    )
+{
+    l2dbus_EpollAsync* async = (l2dbus_EpollAsync*)a;
+
+    if ( NULL != async )
+    {
+        async->data = data;
+    }
+}
+
+
+static cdbus_Bool
+l2dbus_epollAddInternalFd
+    (
+    l2dbus_EpollLoop*   loop,
+    int                 fd
+    )
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+
+    return 0 == epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+
+static cdbus_MainLoop*
+l2dbus_epollLoopNew
+    (
+    cdbus_Bool  edgeTriggered
+    )
+{
+    l2dbus_EpollLoop* loop;
+    int idx;
+
+    loop = (l2dbus_EpollLoop*)l2dbus_calloc(1, sizeof(*loop));
+    if ( NULL == loop )
+    {
+        return NULL;
+    }
+
+    loop->edgeTriggered = edgeTriggered;
+    loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    loop->timerFd = timerfd_create(CLOCK_MONOTONIC,
+                                    TFD_NONBLOCK | TFD_CLOEXEC);
+    loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    for ( idx = 0; idx < L2DBUS_EPOLL_FD_BUCKETS; ++idx )
+    {
+        LIST_INIT(&loop->fdBuckets[idx]);
+    }
+    LIST_INIT(&loop->asyncs);
+    LIST_INIT(&loop->deadWatches);
+    LIST_INIT(&loop->deadTimers);
+
+    loop->super.loopUnref = l2dbus_epollLoopUnref;
+    loop->super.loopIterate = l2dbus_epollLoopIterate;
+    loop->super.loopQuit = l2dbus_epollLoopQuit;
+    loop->super.watchNew = l2dbus_epollWatchNew;
+    loop->super.watchDestroy = l2dbus_epollWatchDestroy;
+    loop->super.watchGetDescriptor = l2dbus_epollWatchGetDescriptor;
+    loop->super.watchIsEnabled = l2dbus_epollWatchIsEnabled;
+    loop->super.watchEnable = l2dbus_epollWatchEnable;
+    loop->super.watchGetFlags = l2dbus_epollWatchGetFlags;
+    loop->super.watchSetFlags = l2dbus_epollWatchSetFlags;
+    loop->super.watchGetData = l2dbus_epollWatchGetData;
+    loop->super.watchSetData = l2dbus_epollWatchSetData;
+    loop->super.timerNew = l2dbus_epollTimerNew;
+    loop->super.timerDestroy = l2dbus_epollTimerDestroy;
+    loop->super.timerIsEnabled = l2dbus_epollTimerIsEnabled;
+    loop->super.timerEnable = l2dbus_epollTimerEnable;
+    loop->super.timerGetInterval = l2dbus_epollTimerGetInterval;
+    loop->super.timerSetInterval = l2dbus_epollTimerSetInterval;
+    loop->super.timerGetRepeat = l2dbus_epollTimerGetRepeat;
+    loop->super.timerSetRepeat = l2dbus_epollTimerSetRepeat;
+    loop->super.timerGetData = l2dbus_epollTimerGetData;
+    loop->super.timerSetData = l2dbus_epollTimerSetData;
+    loop->super.asyncNew = l2dbus_epollAsyncNew;
+    loop->super.asyncDestroy = l2dbus_epollAsyncDestroy;
+    loop->super.asyncSend = l2dbus_epollAsyncSend;
+    loop->super.asyncGetData = l2dbus_epollAsyncGetData;
+    loop->super.asyncSetData = l2dbus_epollAsyncSetData;
+
+    if ( (loop->epollFd < 0) || (loop->timerFd < 0) || (loop->wakeFd < 0) ||
+        !l2dbus_epollAddInternalFd(loop, loop->timerFd) ||
+        !l2dbus_epollAddInternalFd(loop, loop->wakeFd) )
+    {
+        l2dbus_epollLoopUnref(&loop->super);
+        loop = NULL;
+    }
+
+    return (NULL != loop) ? &loop->super : NULL;
+}
+
+
+/**
+ epoll main loop module version table.
+
+ A table containing version information for the epoll-based main loop module.
+
+ @table mainLoopEpollVersionInfo
+ @field mainLoopEpollMajor The epoll main loop major version.
+ @field mainLoopEpollMinor The epoll main loop minor version.
+ @field mainLoopEpollRelease The epoll main loop release version.
+ @field copyright The L2DBUS epoll main loop module copyright information.
+ @field author The L2DBUS epoll main loop author information.
+ */
+
+/**
+ @function getVersion
+
+ Returns version information about the L2DBUS epoll module.
+
+ This function returns a table containing useful version
+ information related to the module itself.
+
+ @treturn table @{mainLoopEpollVersionInfo}
+*/
+static int
+l2dbus_mainLoopGetVersion
+    (
+    lua_State*  L
+    )
+{
+    lua_newtable(L);
+    lua_pushinteger(L, L2DBUS_MAIN_LOOP_EPOLL_MAJOR_VER);
+    lua_setfield(L, -2, "mainLoopEpollMajor");
+    lua_pushinteger(L, L2DBUS_MAIN_LOOP_EPOLL_MINOR_VER);
+    lua_setfield(L, -2, "mainLoopEpollMinor");
+    lua_pushinteger(L, L2DBUS_MAIN_LOOP_EPOLL_RELEASE_VER);
+    lua_setfield(L, -2, "mainLoopEpollRelease");
+
+    lua_pushliteral(L, L2DBUS_MAIN_LOOP_EPOLL_COPYRIGHT);
+    lua_setfield(L, -2, "copyright");
+    lua_pushliteral(L, L2DBUS_MAIN_LOOP_EPOLL_AUTHOR);
+    lua_setfield(L, -2, "author");
+
+    return 1;
+}
+
+
+/**
+ * @brief Called by Lua VM to GC/reclaim the Main Loop userdata.
+ *
+ * This method is called by the Lua VM to reclaim the Main Loop
+ * userdata.
+ *
+ * @return nil
+ *
+ */
+static int
+l2dbus_mainLoopDispose
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_MainLoopEpollUserData* ud = (l2dbus_MainLoopEpollUserData*)
+        luaL_checkudata(L, -1, L2DBUS_MAIN_LOOP_MTBL_NAME);
+
+    /* Free the underlying epoll main loop */
+    l2dbus_epollLoopUnref(ud->loop);
+    ud->loop = NULL;
+
+    return 0;
+}
+
+
+/**
+ @function MainLoop.new
+
+ Creates a new L2DBUS epoll-based main loop.
+
+ Constructs a new main loop that owns its own epoll set, timerfd and eventfd.
+ All of them are released when the main loop is collected by the Lua garbage
+ collector.
+
+ By default descriptors are registered *level-triggered*. The libdbus socket
+ transport stops reading after a bounded number of bytes per watch
+ notification without waiting for *EAGAIN* so with edge-triggered
+ notification any data left in the socket would not be reported again until
+ more arrives. Only request edge-triggered watches when every watch handler
+ drains its descriptor.
+
+ @tparam ?table|nil options Optional table of loop options. The only
+ recognized field is *edgeTriggered* (boolean, default **false**) which
+ registers watch descriptors with EPOLLET.
+ @treturn userdata MainLoop userdata object
+ */
+static int
+l2dbus_mainLoopNew
+    (
+    lua_State*  L
+    )
+{
+    l2dbus_MainLoopEpollUserData* loopUd;
+    cdbus_Bool edgeTriggered = CDBUS_FALSE;
+    int optType = lua_type(L, 1);
+
+    if ( LUA_TTABLE == optType )
+    {
+        lua_getfield(L, 1, "edgeTriggered");
+        edgeTriggered = lua_toboolean(L, -1) ? CDBUS_TRUE : CDBUS_FALSE;
+        lua_pop(L, 1);
+    }
+    else if ( (LUA_TNONE != optType) && (LUA_TNIL != optType) )
+    {
+        luaL_argcheck(L, 0, 1, "unexpected main loop options");
+    }
+
+    loopUd = (l2dbus_MainLoopEpollUserData*)lua_newuserdata(L, sizeof(*loopUd));
+    if ( NULL == loopUd )
+    {
+        luaL_error(L, "Failed to create main loop userdata!");
+    }
+    else
+    {
+        loopUd->loop = NULL;
+
+        /* Assign the main loop meta-table */
+        luaL_getmetatable(L, L2DBUS_MAIN_LOOP_MTBL_NAME);
+        lua_setmetatable(L, -2);
+
+        loopUd->loop = l2dbus_epollLoopNew(edgeTriggered);
+        if ( NULL == loopUd->loop )
+        {
+            luaL_error(L, "Failed to allocate epoll main loop!");
+        }
+    }
+
+    return 1;
+}
+
+
+/* Meta-table for epoll Main Loop type */
+static const luaL_Reg l2dbus_mainLoopEpollMetaTable[] =
+{
+    {"__gc", l2dbus_mainLoopDispose},
+    {NULL, NULL},
+};
+
+
+/* Module top-level functions */
+static const luaL_Reg l2dbus_mainLoopModuleTable[] =
+{
+    {"getVersion", l2dbus_mainLoopGetVersion},
+    {NULL, NULL},
+};
+
+
+/* Main loop top-level functions */
+static const luaL_Reg l2dbus_mainLoopLoopTable[] =
+{
+    {"new", l2dbus_mainLoopNew},
+    {NULL, NULL},
+};
+
+
+int
+luaopen_l2dbus_epoll
+    (
+    lua_State* L
+    )
+{
+    luaL_checkversion(L);
+
+    /* Create a Main Loop meta-table and pop off the meta-table */
+    lua_pop(L, l2dbus_createMetatable(L, L2DBUS_MAIN_LOOP_TYPE_ID,
+        l2dbus_mainLoopEpollMetaTable));
+
+    luaL_newlib(L, l2dbus_mainLoopModuleTable);
+    luaL_newlib(L, l2dbus_mainLoopLoopTable);
+
+    /* Assign main loop table to the top-level module table */
+    lua_setfield(L, -2, "MainLoop");
+
+    /*
+     * Keep the module's shared library loaded until the program exits
+     * (see luaopen_l2dbus_glib for the Lua 5.2.0 finalizer bug this works
+     * around).
+     */
+    l2dbus_moduleRef(L, "l2dbus_epoll");
+
+    return 1;
+}
@@ -79,12 +79,17 @@ typedef struct l2dbus_MainLoopEvUserData
     /* Old libev loop user data */
     void* oldLoopUserData;
 
+    /* The Lua thread used to run the libev callbacks of this loop */
+    lua_State* thread;
+    int threadRef;
+
 } l2dbus_MainLoopEvUserData;
 
 
-/* The Lua thread used to run all libev callbacks */
-static lua_State*  gLuaLibevThread = NULL;
-static int gLuaLibevThreadRef = LUA_NOREF;
+/* The address of this variable is the registry key of the Lua thread used
+ * to run all libev callbacks. Each Lua state has its own thread.
+ */
+static const char gLuaLibevThreadKey = 0;
 
 
 static void
@@ -93,11 +98,15 @@ l2dbus_mainLoopThreadInit
     lua_State*   L
     )
 {
-    if ( NULL == gLuaLibevThread )
+    lua_pushlightuserdata(L, (void*)&gLuaLibevThreadKey);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    if ( LUA_TTHREAD != lua_type(L, -1) )
     {
-        gLuaLibevThread = lua_newthread(L);
-        gLuaLibevThreadRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        lua_pushlightuserdata(L, (void*)&gLuaLibevThreadKey);
+        lua_newthread(L);
+        lua_rawset(L, LUA_REGISTRYINDEX);
     }
+    lua_pop(L, 1);
 }
 
 
@@ -124,9 +133,9 @@ l2dbus_mainLoopThreadFree
     lua_State*  L
     )
 {
-    luaL_unref(L, LUA_REGISTRYINDEX, gLuaLibevThreadRef);
-    gLuaLibevThread = NULL;
-    gLuaLibevThreadRef = LUA_NOREF;
+    lua_pushlightuserdata(L, (void*)&gLuaLibevThreadKey);
+    lua_pushnil(L);
+    lua_rawset(L, LUA_REGISTRYINDEX);
 
     return 0;
 }
@@ -244,6 +253,10 @@ l2dbus_mainLoopDispose
     /* If this was a Lua libev object then unreference it */
     luaL_unref(L, LUA_REGISTRYINDEX, ud->loopRef);
 
+    /* Release the Lua thread used to run the libev callbacks */
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->threadRef);
+    ud->thread = NULL;
+
     return 0;
 }
 
@@ -254,17 +267,17 @@ l2dbus_mainLoopPreLoop
     )
 {
     cdbus_MainLoopEv* mainLoopEv = (cdbus_MainLoopEv*)loop;
-    l2dbus_MainLoopEvUserData* loopUd;
+    l2dbus_MainLoopEvUserData* loopUd = (NULL != mainLoopEv) ?
+                        (l2dbus_MainLoopEvUserData*)mainLoopEv->userData : NULL;
 
-    if ( (NULL != mainLoopEv) && (NULL != gLuaLibevThread) )
+    if ( (NULL != loopUd) && (NULL != loopUd->thread) )
     {
-        loopUd = mainLoopEv->userData;
 #if EV_MULTIPLICITY
         loopUd->oldLoopUserData = ev_userdata(mainLoopEv->loop);
-        ev_set_userdata(mainLoopEv->loop, gLuaLibevThread);
+        ev_set_userdata(mainLoopEv->loop, loopUd->thread);
 #else
         loopUd->oldLoopUserData = ev_userdata();
-        ev_set_userdata(gLuaLibevThread);
+        ev_set_userdata(loopUd->thread);
 #endif
 
     }
@@ -278,11 +291,11 @@ l2dbus_mainLoopPostLoop
     )
 {
     cdbus_MainLoopEv* mainLoopEv = (cdbus_MainLoopEv*)loop;
-    l2dbus_MainLoopEvUserData* loopUd;
+    l2dbus_MainLoopEvUserData* loopUd = (NULL != mainLoopEv) ?
+                        (l2dbus_MainLoopEvUserData*)mainLoopEv->userData : NULL;
 
-    if ( (NULL != mainLoopEv) && (NULL != gLuaLibevThread) )
+    if ( (NULL != loopUd) && (NULL != loopUd->thread) )
     {
-        loopUd = mainLoopEv->userData;
 #if EV_MULTIPLICITY
         ev_set_userdata(mainLoopEv->loop, loopUd->oldLoopUserData);
 #else
@@ -340,13 +353,19 @@ l2dbus_mainLoopNew
 {
     struct ev_loop* evLoop = NULL;
     l2dbus_MainLoopEvUserData* loopUd;
+    lua_State* thread;
 
     /* Check to see if a Lua libev loop userdata was passed
      * in for use as the main loop.
      */
     int loopType = lua_type(L, 1);
 
-    if ( NULL == gLuaLibevThread )
+    lua_pushlightuserdata(L, (void*)&gLuaLibevThreadKey);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    thread = lua_tothread(L, -1);
+    lua_pop(L, 1);
+
+    if ( NULL == thread )
     {
         luaL_error(L, "Module failed to initialized or was shut down");
     }
@@ -386,6 +405,12 @@ l2dbus_mainLoopNew
         loopUd->loopRef = LUA_NOREF;
         loopUd->oldLoopUserData = NULL;
 
+        /* Hold on to the thread so it outlives a module shutdown */
+        loopUd->thread = thread;
+        lua_pushlightuserdata(L, (void*)&gLuaLibevThreadKey);
+        lua_rawget(L, LUA_REGISTRYINDEX);
+        loopUd->threadRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
         /* Assign the main loop meta-table */
         luaL_getmetatable(L, L2DBUS_MAIN_LOOP_MTBL_NAME);
         lua_setmetatable(L, -2);
@@ -33,12 +33,16 @@
 #include <stdlib.h>
 #include "lua.h"
 #include "glib.h"
+#include "dbus/dbus.h"
+#include "queue.h"
 #include "l2dbus_main-loop.h"
 #include "cdbus/cdbus.h"
+#include "cdbus/mainloop.h"
 #include "cdbus/main-loop-glib.h"
 #include "l2dbus_compat.h"
 #include "l2dbus_types.h"
 #include "l2dbus_util.h"
+#include "l2dbus_alloc.h"
 #include "l2dbus_module.h"
 
 
@@ -47,23 +51,1161 @@ The L2DBUS Glib main loop implementation.
 
 This module provides the main-loop abstraction around the Glib library.
 
+By default every watch and timeout is a GSource of its own. A *batched*
+main loop instead multiplexes all of them through a single GSource so an
+iteration of the Glib loop costs one prepare/check/dispatch cycle no matter
+how many watches and timeouts exist. A batched loop can also be attached to
+a GMainContext other than the default one (e.g. the thread-default context
+of a worker thread).
+
  @module l2dbus-glib
  */
 
-#define L2DBUS_MAIN_LOOP_GLIB_MAJOR_VER       (1)
-#define L2DBUS_MAIN_LOOP_GLIB_MINOR_VER       (0)
-#define L2DBUS_MAIN_LOOP_GLIB_RELEASE_VER     (0)
-#define L2DBUS_MAIN_LOOP_GLIB_COPYRIGHT       "(c) Copyright 2013 XS-Embedded LLC"
-#define L2DBUS_MAIN_LOOP_GLIB_AUTHOR          "Glenn Schmottlach"
+#define L2DBUS_MAIN_LOOP_GLIB_MAJOR_VER       (1)
+#define L2DBUS_MAIN_LOOP_GLIB_MINOR_VER       (0)
+#define L2DBUS_MAIN_LOOP_GLIB_RELEASE_VER     (0)
+#define L2DBUS_MAIN_LOOP_GLIB_COPYRIGHT       "(c) Copyright 2013 XS-Embedded LLC"
+#define L2DBUS_MAIN_LOOP_GLIB_AUTHOR          "Glenn Schmottlach"
+
+/*
+ * Extension of the base l2dbus_MainLoopUserData type
+ */
+typedef struct l2dbus_MainLoopGlibUserData
+{
+    /* Must always be declared first */
+    struct cdbus_MainLoop* loop;
+
+    /* The loop is a batched (single GSource) loop */
+    cdbus_Bool batched;
+} l2dbus_MainLoopGlibUserData;
+
+
+typedef struct l2dbus_GlibLoop l2dbus_GlibLoop;
+
+typedef struct l2dbus_GlibWatch
+{
+    l2dbus_GlibLoop*                loop;
+    GPollFD                         pollFd;
+    cdbus_UInt32                    flags;
+    cdbus_Bool                      enabled;
+    cdbus_Bool                      isPolled;
+    cdbus_Bool                      isDead;
+    cdbus_MainLoopWatchCbFunc       cbFunc;
+    void*                           data;
+    LIST_ENTRY(l2dbus_GlibWatch)    link;
+    LIST_ENTRY(l2dbus_GlibWatch)    deadLink;
+} l2dbus_GlibWatch;
+
+typedef struct l2dbus_GlibTimer
+{
+    l2dbus_GlibLoop*                loop;
+    cdbus_Int32                     interval;
+    cdbus_Bool                      repeat;
+    cdbus_Bool                      enabled;
+    cdbus_Bool                      isDead;
+    gint64                          expiry;
+    unsigned long                   runGen;
+    cdbus_MainLoopTimerCbFunc       cbFunc;
+    void*                           data;
+    TAILQ_ENTRY(l2dbus_GlibTimer)   link;
+    LIST_ENTRY(l2dbus_GlibTimer)    deadLink;
+} l2dbus_GlibTimer;
+
+typedef struct l2dbus_GlibAsync
+{
+    l2dbus_GlibLoop*                loop;
+    volatile gint                   pending;
+    cdbus_Bool                      isDead;
+    cdbus_MainLoopAsyncCbFunc       cbFunc;
+    void*                           data;
+    LIST_ENTRY(l2dbus_GlibAsync)    link;
+} l2dbus_GlibAsync;
+
+/*
+ * The single GSource of a batched loop. The GSource **MUST** be declared
+ * first since Glib allocates and hands back the whole structure.
+ */
+typedef struct l2dbus_GlibSource
+{
+    GSource                         source;
+    l2dbus_GlibLoop*                loop;
+} l2dbus_GlibSource;
+
+/*
+ * The batched Glib main loop. The cdbus main loop interface **MUST** be
+ * declared first so the loop can be handed to CDBUS as a cdbus_MainLoop.
+ */
+struct l2dbus_GlibLoop
+{
+    struct cdbus_MainLoop           super;
+
+    GMainContext*                   context;
+    GMainLoop*                      mainLoop;
+    l2dbus_GlibSource*              source;
+    volatile gint                   asyncPending;
+    int                             dispatchDepth;
+    unsigned long                   runGen;
+
+    LIST_HEAD(l2dbus_GlibWatchHead,
+        l2dbus_GlibWatch)           watches;
+    /* The enabled timers ordered by expiry (earliest first) */
+    TAILQ_HEAD(l2dbus_GlibTimerHead,
+        l2dbus_GlibTimer)           timers;
+    LIST_HEAD(l2dbus_GlibAsyncHead,
+        l2dbus_GlibAsync)           asyncs;
+
+    /* Objects destroyed while events were being dispatched */
+    LIST_HEAD(l2dbus_GlibDeadWatchHead,
+        l2dbus_GlibWatch)           deadWatches;
+    LIST_HEAD(l2dbus_GlibDeadTimerHead,
+        l2dbus_GlibTimer)           deadTimers;
+};
+
+
+static cdbus_HResult
+l2dbus_glibMakeError
+    (
+    cdbus_UInt32    errCode
+    )
+{
+    return CDBUS_MAKE_HRESULT(CDBUS_SEV_FAILURE, CDBUS_FAC_CDBUS, errCode);
+}
+
+
+/*
+ * Adds or removes the poll record of a watch so Glib only polls the
+ * descriptors of enabled watches.
+ */
+static void
+l2dbus_glibWatchUpdate
+    (
+    l2dbus_GlibWatch*   watch
+    )
+{
+    gushort events = 0;
+
+    if ( !watch->isDead && watch->enabled )
+    {
+        if ( watch->flags & DBUS_WATCH_READABLE )
+        {
+            events |= G_IO_IN;
+        }
+        if ( watch->flags & DBUS_WATCH_WRITABLE )
+        {
+            events |= G_IO_OUT;
+        }
+    }
+
+    if ( 0 == events )
+    {
+        if ( watch->isPolled )
+        {
+            g_source_remove_poll(&watch->loop->source->source, &watch->pollFd);
+            watch->isPolled = CDBUS_FALSE;
+        }
+        watch->pollFd.revents = 0;
+    }
+    else
+    {
+        /* Glib reads the poll record on every iteration */
+        watch->pollFd.events = events | G_IO_ERR | G_IO_HUP;
+        if ( !watch->isPolled )
+        {
+            g_source_add_poll(&watch->loop->source->source, &watch->pollFd);
+            watch->isPolled = CDBUS_TRUE;
+        }
+    }
+}
+
+
+static void
+l2dbus_glibWatchFree
+    (
+    l2dbus_GlibWatch*   watch
+    )
+{
+    LIST_REMOVE(watch, link);
+    l2dbus_free(watch);
+}
+
+
+static void
+l2dbus_glibTimerDisarm
+    (
+    l2dbus_GlibTimer*   timer
+    )
+{
+    if ( timer->enabled )
+    {
+        TAILQ_REMOVE(&timer->loop->timers, timer, link);
+        timer->enabled = CDBUS_FALSE;
+    }
+}
+
+
+/*
+ * (Re)arms a timer to expire one interval from now. The armed timers are
+ * kept sorted so the source only ever looks at the earliest one.
+ */
+static void
+l2dbus_glibTimerSchedule
+    (
+    l2dbus_GlibTimer*   timer,
+    gint64              now
+    )
+{
+    l2dbus_GlibTimer* next;
+
+    l2dbus_glibTimerDisarm(timer);
+    timer->expiry = now + ((gint64)timer->interval * 1000);
+
+    TAILQ_FOREACH(next, &timer->loop->timers, link)
+    {
+        if ( next->expiry > timer->expiry )
+        {
+            break;
+        }
+    }
+
+    if ( NULL != next )
+    {
+        TAILQ_INSERT_BEFORE(next, timer, link);
+    }
+    else
+    {
+        TAILQ_INSERT_TAIL(&timer->loop->timers, timer, link);
+    }
+    timer->enabled = CDBUS_TRUE;
+}
+
+
+static void
+l2dbus_glibRunWatches
+    (
+    l2dbus_GlibLoop*    loop
+    )
+{
+    l2dbus_GlibWatch* watch;
+    cdbus_UInt32 rcvFlags;
+    gushort revents;
+
+    /* Watches destroyed by a callback stay linked until the sweep */
+    LIST_FOREACH(watch, &loop->watches, link)
+    {
+        revents = watch->pollFd.revents;
+        watch->pollFd.revents = 0;
+        if ( (0 == revents) || watch->isDead || !watch->enabled ||
+            (NULL == watch->cbFunc) )
+        {
+            continue;
+        }
+
+        rcvFlags = 0U;
+        if ( revents & G_IO_IN )
+        {
+            rcvFlags |= DBUS_WATCH_READABLE;
+        }
+        if ( revents & G_IO_OUT )
+        {
+            rcvFlags |= DBUS_WATCH_WRITABLE;
+        }
+        if ( revents & G_IO_ERR )
+        {
+            rcvFlags |= DBUS_WATCH_ERROR;
+        }
+        if ( revents & G_IO_HUP )
+        {
+            rcvFlags |= DBUS_WATCH_HANGUP;
+        }
+
+        /* Errors and hang-ups are always reported */
+        rcvFlags &= watch->flags | DBUS_WATCH_ERROR | DBUS_WATCH_HANGUP;
+        if ( 0U != rcvFlags )
+        {
+            (void)watch->cbFunc((cdbus_MainLoopWatch*)watch, rcvFlags,
+                                watch->data);
+        }
+    }
+}
+
+
+static void
+l2dbus_glibRunTimers
+    (
+    l2dbus_GlibLoop*    loop
+    )
+{
+    l2dbus_GlibTimer* timer;
+    gint64 now = g_get_monotonic_time();
+
+    /* A generation stamp keeps zero-interval repeating timers from
+     * starving the loop by firing more than once per pass.
+     */
+    loop->runGen++;
+    while ( (NULL != (timer = TAILQ_FIRST(&loop->timers))) &&
+            (timer->expiry <= now) && (timer->runGen != loop->runGen) )
+    {
+        timer->runGen = loop->runGen;
+        if ( timer->repeat )
+        {
+            l2dbus_glibTimerSchedule(timer, now);
+        }
+        else
+        {
+            l2dbus_glibTimerDisarm(timer);
+        }
+
+        if ( NULL != timer->cbFunc )
+        {
+            (void)timer->cbFunc((cdbus_MainLoopTimer*)timer, timer->data);
+        }
+    }
+}
+
+
+static void
+l2dbus_glibRunAsyncs
+    (
+    l2dbus_GlibLoop*    loop
+    )
+{
+    l2dbus_GlibAsync* async;
+
+    if ( g_atomic_int_compare_and_exchange(&loop->asyncPending, 1, 0) )
+    {
+        LIST_FOREACH(async, &loop->asyncs, link)
+        {
+            if ( !async->isDead &&
+                g_atomic_int_compare_and_exchange(&async->pending, 1, 0) &&
+                (NULL != async->cbFunc) )
+            {
+                async->cbFunc((cdbus_MainLoopAsync*)async, async->data);
+            }
+        }
+    }
+}
+
+
+static void
+l2dbus_glibSweep
+    (
+    l2dbus_GlibLoop*    loop
+    )
+{
+    l2dbus_GlibWatch* watch;
+    l2dbus_GlibTimer* timer;
+    l2dbus_GlibAsync* async;
+    l2dbus_GlibAsync* next;
+
+    while ( !LIST_EMPTY(&loop->deadWatches) )
+    {
+        watch = LIST_FIRST(&loop->deadWatches);
+        LIST_REMOVE(watch, deadLink);
+        l2dbus_glibWatchFree(watch);
+    }
+
+    while ( !LIST_EMPTY(&loop->deadTimers) )
+    {
+        timer = LIST_FIRST(&loop->deadTimers);
+        LIST_REMOVE(timer, deadLink);
+        l2dbus_free(timer);
+    }
+
+    for ( async = LIST_FIRST(&loop->asyncs); NULL != async; async = next )
+    {
+        next = LIST_NEXT(async, link);
+        if ( async->isDead )
+        {
+            LIST_REMOVE(async, link);
+            l2dbus_free(async);
+        }
+    }
+}
+
+
+/*
+ * GSource interface of the batched loop
+ */
+
+static gboolean
+l2dbus_glibSourcePrepare
+    (
+    GSource*    source,
+    gint*       timeout
+    )
+{
+    l2dbus_GlibLoop* loop = ((l2dbus_GlibSource*)source)->loop;
+    l2dbus_GlibTimer* timer = TAILQ_FIRST(&loop->timers);
+    gint64 now;
+
+    if ( g_atomic_int_get(&loop->asyncPending) )
+    {
+        *timeout = 0;
+        return TRUE;
+    }
+
+    if ( NULL == timer )
+    {
+        *timeout = -1;
+        return FALSE;
+    }
+
+    now = g_source_get_time(source);
+    if ( timer->expiry <= now )
+    {
+        *timeout = 0;
+        return TRUE;
+    }
+
+    /* Round up so the timer is due when the poll returns */
+    *timeout = (gint)MIN((timer->expiry - now + 999) / 1000, G_MAXINT);
+    return FALSE;
+}
+
+
+static gboolean
+l2dbus_glibSourceCheck
+    (
+    GSource*    source
+    )
+{
+    l2dbus_GlibLoop* loop = ((l2dbus_GlibSource*)source)->loop;
+    l2dbus_GlibTimer* timer = TAILQ_FIRST(&loop->timers);
+    l2dbus_GlibWatch* watch;
+
+    if ( g_atomic_int_get(&loop->asyncPending) ||
+        ((NULL != timer) && (timer->expiry <= g_source_get_time(source))) )
+    {
+        return TRUE;
+    }
+
+    LIST_FOREACH(watch, &loop->watches, link)
+    {
+        if ( watch->isPolled && (0 != watch->pollFd.revents) )
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+static gboolean
+l2dbus_glibSourceDispatch
+    (
+    GSource*    source,
+    GSourceFunc callback,
+    gpointer    userData
+    )
+{
+    l2dbus_GlibLoop* loop = ((l2dbus_GlibSource*)source)->loop;
+
+    /* Everything that is ready is handled in this one dispatch */
+    loop->dispatchDepth++;
+    l2dbus_glibRunWatches(loop);
+    l2dbus_glibRunTimers(loop);
+    l2dbus_glibRunAsyncs(loop);
+    loop->dispatchDepth--;
+
+    if ( 0 == loop->dispatchDepth )
+    {
+        l2dbus_glibSweep(loop);
+    }
+
+    return TRUE;
+}
+
+
+static GSourceFuncs gL2dbusGlibSourceFuncs =
+{
+    l2dbus_glibSourcePrepare,
+    l2dbus_glibSourceCheck,
+    l2dbus_glibSourceDispatch,
+    NULL,
+    NULL,
+    NULL
+};
+
+
+/*
+ * cdbus_MainLoop interface: loop
+ */
+
+static void
+l2dbus_glibLoopUnref
+    (
+    cdbus_MainLoop* mainLoop
+    )
+{
+    l2dbus_GlibLoop* loop = (l2dbus_GlibLoop*)mainLoop;
+    l2dbus_GlibWatch* watch;
+    l2dbus_GlibTimer* timer;
+    l2dbus_GlibAsync* async;
+
+    if ( NULL == loop )
+    {
+        return;
+    }
+
+    l2dbus_glibSweep(loop);
+
+    /* Destroying the source also drops all of its poll records */
+    if ( NULL != loop->source )
+    {
+        g_source_destroy(&loop->source->source);
+        g_source_unref(&loop->source->source);
+    }
+
+    while ( !LIST_EMPTY(&loop->watches) )
+    {
+        watch = LIST_FIRST(&loop->watches);
+        l2dbus_glibWatchFree(watch);
+    }
+
+    /* Only armed timers are linked to the loop */
+    while ( NULL != (timer = TAILQ_FIRST(&loop->timers)) )
+    {
+        TAILQ_REMOVE(&loop->timers, timer, link);
+        l2dbus_free(timer);
+    }
+
+    while ( !LIST_EMPTY(&loop->asyncs) )
+    {
+        async = LIST_FIRST(&loop->asyncs);
+        LIST_REMOVE(async, link);
+        l2dbus_free(async);
+    }
+
+    if ( NULL != loop->mainLoop )
+    {
+        g_main_loop_unref(loop->mainLoop);
+    }
+    if ( NULL != loop->context )
+    {
+        g_main_context_unref(loop->context);
+    }
+    l2dbus_free(loop);
+}
+
+
+static void
+l2dbus_glibLoopIterate
+    (
+    cdbus_MainLoop*     mainLoop,
+    cdbus_RunOption     option
+    )
+{
+    l2dbus_GlibLoop* loop = (l2dbus_GlibLoop*)mainLoop;
+
+    if ( NULL != loop->super.loopPre )
+    {
+        loop->super.loopPre(mainLoop);
+    }
+
+    if ( CDBUS_RUN_WAIT == option )
+    {
+        g_main_loop_run(loop->mainLoop);
+    }
+    else
+    {
+        (void)g_main_context_iteration(loop->context,
+                                    CDBUS_RUN_NO_WAIT != option);
+    }
+
+    if ( NULL != loop->super.loopPost )
+    {
+        loop->super.loopPost(mainLoop);
+    }
+}
+
+
+static void
+l2dbus_glibLoopQuit
+    (
+    cdbus_MainLoop* mainLoop
+    )
+{
+    l2dbus_GlibLoop* loop = (l2dbus_GlibLoop*)mainLoop;
+
+    /* Also wakes up the context if it's blocked in another thread */
+    g_main_loop_quit(loop->mainLoop);
+}
+
+
+/*
+ * cdbus_MainLoop interface: watches
+ */
+
+static cdbus_MainLoopWatch*
+l2dbus_glibWatchNew
+    (
+    cdbus_MainLoop*             mainLoop,
+    cdbus_Descriptor            fd,
+    cdbus_UInt32                flags,
+    cdbus_MainLoopWatchCbFunc   f,
+    void*                       data
+    )
+{
+    l2dbus_GlibLoop* loop = (l2dbus_GlibLoop*)mainLoop;
+    l2dbus_GlibWatch* watch;
+
+    if ( (NULL == loop) || (fd < 0) )
+    {
+        return NULL;
+    }
+
+    watch = (l2dbus_GlibWatch*)l2dbus_calloc(1, sizeof(*watch));
+    if ( NULL != watch )
+    {
+        /* Watches start out disabled just like the other main loops */
+        watch->loop = loop;
+        watch->pollFd.fd = fd;
+        watch->flags = flags;
+        watch->enabled = CDBUS_FALSE;
+        watch->cbFunc = f;
+        watch->data = data;
+        LIST_INSERT_HEAD(&loop->watches, watch, link);
+    }
+
+    return (cdbus_MainLoopWatch*)watch;
+}
+
+
+static void
+l2dbus_glibWatchDestroy
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w
+    )
+{
+    l2dbus_GlibWatch* watch = (l2dbus_GlibWatch*)w;
+
+    if ( (NULL == watch) || watch->isDead )
+    {
+        return;
+    }
+
+    /* Stop polling right away (the descriptor may be closed next) */
+    watch->isDead = CDBUS_TRUE;
+    l2dbus_glibWatchUpdate(watch);
+
+    if ( watch->loop->dispatchDepth > 0 )
+    {
+        LIST_INSERT_HEAD(&watch->loop->deadWatches, watch, deadLink);
+    }
+    else
+    {
+        l2dbus_glibWatchFree(watch);
+    }
+}
+
+
+static cdbus_Descriptor
+l2dbus_glibWatchGetDescriptor
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w
+    )
+{
+    l2dbus_GlibWatch* watch = (l2dbus_GlibWatch*)w;
+
+    return (NULL != watch) ? watch->pollFd.fd : -1;
+}
+
+
+static cdbus_Bool
+l2dbus_glibWatchIsEnabled
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w
+    )
+{
+    l2dbus_GlibWatch* watch = (l2dbus_GlibWatch*)w;
+
+    return (NULL != watch) && !watch->isDead && watch->enabled;
+}
+
+
+static cdbus_HResult
+l2dbus_glibWatchEnable
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w,
+    cdbus_Bool              option
+    )
+{
+    l2dbus_GlibWatch* watch = (l2dbus_GlibWatch*)w;
+
+    if ( (NULL == watch) || watch->isDead )
+    {
+        return l2dbus_glibMakeError(CDBUS_EC_INVALID_PARAMETER);
+    }
+
+    watch->enabled = option ? CDBUS_TRUE : CDBUS_FALSE;
+    l2dbus_glibWatchUpdate(watch);
+
+    return CDBUS_RESULT_SUCCESS;
+}
+
+
+static cdbus_UInt32
+l2dbus_glibWatchGetFlags
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w
+    )
+{
+    l2dbus_GlibWatch* watch = (l2dbus_GlibWatch*)w;
+
+    return (NULL != watch) ? watch->flags : 0U;
+}
+
+
+static cdbus_HResult
+l2dbus_glibWatchSetFlags
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w,
+    cdbus_UInt32            flags
+    )
+{
+    l2dbus_GlibWatch* watch = (l2dbus_GlibWatch*)w;
+
+    if ( (NULL == watch) || watch->isDead )
+    {
+        return l2dbus_glibMakeError(CDBUS_EC_INVALID_PARAMETER);
+    }
+
+    watch->flags = flags;
+    l2dbus_glibWatchUpdate(watch);
+
+    return CDBUS_RESULT_SUCCESS;
+}
+
+
+static void*
+l2dbus_glibWatchGetData
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w
+    )
+{
+    l2dbus_GlibWatch* watch = (l2dbus_GlibWatch*)w;
+
+    return (NULL != watch) ? watch->data : NULL;
+}
+
+
+static void
+l2dbus_glibWatchSetData
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopWatch*    w,
+    void*                   data
+    )
+{
+    l2dbus_GlibWatch* watch = (l2dbus_GlibWatch*)w;
+
+    if ( NULL != watch )
+    {
+        watch->data = data;
+    }
+}
+
+
+/*
+ * cdbus_MainLoop interface: timers
+ */
+
+static cdbus_MainLoopTimer*
+l2dbus_glibTimerNew
+    (
+    cdbus_MainLoop*             mainLoop,
+    cdbus_Int32                 msecInterval,
+    cdbus_Bool                  repeat,
+    cdbus_MainLoopTimerCbFunc   f,
+    void*                       data
+    )
+{
+    l2dbus_GlibLoop* loop = (l2dbus_GlibLoop*)mainLoop;
+    l2dbus_GlibTimer* timer;
+
+    if ( NULL == loop )
+    {
+        return NULL;
+    }
+
+    timer = (l2dbus_GlibTimer*)l2dbus_calloc(1, sizeof(*timer));
+    if ( NULL != timer )
+    {
+        /* Timers start out disabled just like the other main loops */
+        timer->loop = loop;
+        timer->interval = (msecInterval < 0) ? 0 : msecInterval;
+        timer->repeat = repeat;
+        timer->enabled = CDBUS_FALSE;
+        timer->cbFunc = f;
+        timer->data = data;
+    }
+
+    return (cdbus_MainLoopTimer*)timer;
+}
+
+
+static void
+l2dbus_glibTimerDestroy
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t
+    )
+{
+    l2dbus_GlibTimer* timer = (l2dbus_GlibTimer*)t;
+
+    if ( (NULL == timer) || timer->isDead )
+    {
+        return;
+    }
+
+    timer->isDead = CDBUS_TRUE;
+    l2dbus_glibTimerDisarm(timer);
+
+    if ( timer->loop->dispatchDepth > 0 )
+    {
+        LIST_INSERT_HEAD(&timer->loop->deadTimers, timer, deadLink);
+    }
+    else
+    {
+        l2dbus_free(timer);
+    }
+}
+
+
+static cdbus_Bool
+l2dbus_glibTimerIsEnabled
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t
+    )
+{
+    l2dbus_GlibTimer* timer = (l2dbus_GlibTimer*)t;
+
+    return (NULL != timer) && !timer->isDead && timer->enabled;
+}
+
+
+static cdbus_HResult
+l2dbus_glibTimerEnable
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t,
+    cdbus_Bool              option
+    )
+{
+    l2dbus_GlibTimer* timer = (l2dbus_GlibTimer*)t;
+
+    if ( (NULL == timer) || timer->isDead )
+    {
+        return l2dbus_glibMakeError(CDBUS_EC_INVALID_PARAMETER);
+    }
+
+    if ( option )
+    {
+        /* (Re)enabling always restarts the interval */
+        l2dbus_glibTimerSchedule(timer, g_get_monotonic_time());
+    }
+    else
+    {
+        l2dbus_glibTimerDisarm(timer);
+    }
+
+    return CDBUS_RESULT_SUCCESS;
+}
+
+
+static cdbus_Int32
+l2dbus_glibTimerGetInterval
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t
+    )
+{
+    l2dbus_GlibTimer* timer = (l2dbus_GlibTimer*)t;
+
+    return (NULL != timer) ? timer->interval : 0;
+}
+
+
+static cdbus_HResult
+l2dbus_glibTimerSetInterval
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t,
+    cdbus_Int32             msecInterval
+    )
+{
+    l2dbus_GlibTimer* timer = (l2dbus_GlibTimer*)t;
+
+    if ( (NULL == timer) || timer->isDead || (msecInterval < 0) )
+    {
+        return l2dbus_glibMakeError(CDBUS_EC_INVALID_PARAMETER);
+    }
+
+    timer->interval = msecInterval;
+    if ( timer->enabled )
+    {
+        l2dbus_glibTimerSchedule(timer, g_get_monotonic_time());
+    }
+
+    return CDBUS_RESULT_SUCCESS;
+}
+
+
+static cdbus_Bool
+l2dbus_glibTimerGetRepeat
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t
+    )
+{
+    l2dbus_GlibTimer* timer = (l2dbus_GlibTimer*)t;
+
+    return (NULL != timer) ? timer->repeat : CDBUS_FALSE;
+}
+
+
+static void
+l2dbus_glibTimerSetRepeat
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t,
+    cdbus_Bool              repeat
+    )
+{
+    l2dbus_GlibTimer* timer = (l2dbus_GlibTimer*)t;
+
+    if ( NULL != timer )
+    {
+        timer->repeat = repeat;
+    }
+}
+
+
+static void*
+l2dbus_glibTimerGetData
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t
+    )
+{
+    l2dbus_GlibTimer* timer = (l2dbus_GlibTimer*)t;
+
+    return (NULL != timer) ? timer->data : NULL;
+}
+
+
+static void
+l2dbus_glibTimerSetData
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopTimer*    t,
+    void*                   data
+    )
+{
+    l2dbus_GlibTimer* timer = (l2dbus_GlibTimer*)t;
+
+    if ( NULL != timer )
+    {
+        timer->data = data;
+    }
+}
+
 
 /*
- * Extension of the base l2dbus_MainLoopUserData type
+ * cdbus_MainLoop interface: asynchronous (cross-thread) wake-ups
  */
-typedef struct l2dbus_MainLoopGlibUserData
+
+static cdbus_MainLoopAsync*
+l2dbus_glibAsyncNew
+    (
+    cdbus_MainLoop*             mainLoop,
+    cdbus_MainLoopAsyncCbFunc   f,
+    void*                       data
+    )
 {
-    /* Must always be declared first */
-    struct cdbus_MainLoop* loop;
-} l2dbus_MainLoopGlibUserData;
+    l2dbus_GlibLoop* loop = (l2dbus_GlibLoop*)mainLoop;
+    l2dbus_GlibAsync* async;
+
+    if ( NULL == loop )
+    {
+        return NULL;
+    }
+
+    async = (l2dbus_GlibAsync*)l2dbus_calloc(1, sizeof(*async));
+    if ( NULL != async )
+    {
+        async->loop = loop;
+        async->cbFunc = f;
+        async->data = data;
+        LIST_INSERT_HEAD(&loop->asyncs, async, link);
+    }
+
+    return (cdbus_MainLoopAsync*)async;
+}
+
+
+static void
+l2dbus_glibAsyncDestroy
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopAsync*    a
+    )
+{
+    l2dbus_GlibAsync* async = (l2dbus_GlibAsync*)a;
+
+    if ( (NULL == async) || async->isDead )
+    {
+        return;
+    }
+
+    async->isDead = CDBUS_TRUE;
+    if ( 0 == async->loop->dispatchDepth )
+    {
+        LIST_REMOVE(async, link);
+        l2dbus_free(async);
+    }
+}
+
+
+static void
+l2dbus_glibAsyncSend
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopAsync*    a
+    )
+{
+    l2dbus_GlibAsync* async = (l2dbus_GlibAsync*)a;
+    l2dbus_GlibLoop* loop;
+
+    if ( NULL == async )
+    {
+        return;
+    }
+
+    loop = async->loop;
+    g_atomic_int_set(&async->pending, 1);
+
+    /* Coalesce concurrent sends into a single wake-up */
+    if ( g_atomic_int_compare_and_exchange(&loop->asyncPending, 0, 1) )
+    {
+        g_main_context_wakeup(loop->context);
+    }
+}
+
+
+static void*
+l2dbus_glibAsyncGetData
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopAsync*    a
+    )
+{
+    l2dbus_GlibAsync* async = (l2dbus_GlibAsync*)a;
+
+    return (NULL != async) ? async->data : NULL;
+}
+
+
+static void
+l2dbus_glibAsyncSetData
+    (
+    cdbus_MainLoop*         mainLoop,
+    cdbus_MainLoopAsync*    a,
+    void*                   data
+    )
+{
+    l2dbus_GlibAsync* async = (l2dbus_GlibAsync*)a;
+
+    if ( NULL != async )
+    {
+        async->data = data;
+    }
+}
+
+
+/*
+ * Creates a batched loop. It runs the given Glib main loop or, if there
+ * isn't one, a loop of its own on the given (or default) context.
+ */
+static cdbus_MainLoop*
+l2dbus_glibLoopNew
+    (
+    GMainLoop*      glibLoop,
+    GMainContext*   context,
+    gint            priority
+    )
+{
+    l2dbus_GlibLoop* loop;
+
+    loop = (l2dbus_GlibLoop*)l2dbus_calloc(1, sizeof(*loop));
+    if ( NULL == loop )
+    {
+        return NULL;
+    }
+
+    if ( NULL != glibLoop )
+    {
+        loop->mainLoop = g_main_loop_ref(glibLoop);
+        loop->context = g_main_context_ref(g_main_loop_get_context(glibLoop));
+    }
+    else
+    {
+        loop->context = g_main_context_ref((NULL != context) ? context :
+                                            g_main_context_default());
+        loop->mainLoop = g_main_loop_new(loop->context, FALSE);
+    }
+
+    LIST_INIT(&loop->watches);
+    TAILQ_INIT(&loop->timers);
+    LIST_INIT(&loop->asyncs);
+    LIST_INIT(&loop->deadWatches);
+    LIST_INIT(&loop->deadTimers);
+
+    loop->super.loopUnref = l2dbus_glibLoopUnref;
+    loop->super.loopIterate = l2dbus_glibLoopIterate;
+    loop->super.loopQuit = l2dbus_glibLoopQuit;
+    loop->super.watchNew = l2dbus_glibWatchNew;
+    loop->super.watchDestroy = l2dbus_glibWatchDestroy;
+    loop->super.watchGetDescriptor = l2dbus_glibWatchGetDescriptor;
+    loop->super.watchIsEnabled = l2dbus_glibWatchIsEnabled;
+    loop->super.watchEnable = l2dbus_glibWatchEnable;
+    loop->super.watchGetFlags = l2dbus_glibWatchGetFlags;
+    loop->super.watchSetFlags = l2dbus_glibWatchSetFlags;
+    loop->super.watchGetData = l2dbus_glibWatchGetData;
+    loop->super.watchSetData = l2dbus_glibWatchSetData;
+    loop->super.timerNew = l2dbus_glibTimerNew;
+    loop->super.timerDestroy = l2dbus_glibTimerDestroy;
+    loop->super.timerIsEnabled = l2dbus_glibTimerIsEnabled;
+    loop->super.timerEnable = l2dbus_glibTimerEnable;
+    loop->super.timerGetInterval = l2dbus_glibTimerGetInterval;
+    loop->super.timerSetInterval = l2dbus_glibTimerSetInterval;
+    loop->super.timerGetRepeat = l2dbus_glibTimerGetRepeat;
+    loop->super.timerSetRepeat = l2dbus_glibTimerSetRepeat;
+    loop->super.timerGetData = l2dbus_glibTimerGetData;
+    loop->super.timerSetData = l2dbus_glibTimerSetData;
+    loop->super.asyncNew = l2dbus_glibAsyncNew;
+    loop->super.asyncDestroy = l2dbus_glibAsyncDestroy;
+    loop->super.asyncSend = l2dbus_glibAsyncSend;
+    loop->super.asyncGetData = l2dbus_glibAsyncGetData;
+    loop->super.asyncSetData = l2dbus_glibAsyncSetData;
+
+    loop->source = (l2dbus_GlibSource*)g_source_new(&gL2dbusGlibSourceFuncs,
+                                                sizeof(l2dbus_GlibSource));
+    loop->source->loop = loop;
+    g_source_set_priority(&loop->source->source, priority);
+    (void)g_source_attach(&loop->source->source, loop->context);
+
+    return &loop->super;
+}
 
 
 
@@ -151,8 +1293,16 @@ l2dbus_mainLoopDispose
     l2dbus_MainLoopGlibUserData* ud = (l2dbus_MainLoopGlibUserData*)
         luaL_checkudata(L, -1, L2DBUS_MAIN_LOOP_MTBL_NAME);
 
-    /* Free the  underlying libev main loop */
-    CDBUS_MAIN_LOOP_GLIB_UNREF(ud->loop);
+    /* Free the underlying Glib main loop */
+    if ( ud->batched )
+    {
+        l2dbus_glibLoopUnref(ud->loop);
+    }
+    else
+    {
+        CDBUS_MAIN_LOOP_GLIB_UNREF(ud->loop);
+    }
+    ud->loop = NULL;
 
     return 0;
 }
@@ -173,12 +1323,28 @@ l2dbus_mainLoopDispose
  during program operation so it is not prematurely collected by the Lua
  garbage collector.
 
+ The optional table of options selects a *batched* main loop. A batched loop
+ attaches a single GSource (at the given priority) that multiplexes every
+ watch, timeout and wake-up of L2DBUS. Without a Glib main loop argument it
+ runs a loop of its own on the chosen GMainContext. To do the D-Bus work on a
+ worker thread, create the loop on that thread with *threadDefault* (after
+ the thread has pushed its context with g_main_context_push_thread_default)
+ and run the dispatcher on that thread.
+
  See <a href="https://developer.gnome.org/glib/2.36/glib-The-Main-Event-Loop.html">Glib documentation</a> for
  additional information on the underlying main loop library.
 
  @tparam ?lightuserdata|nil loop Optional *raw* Glib main loop pointer passed
  as a lightuserdata. If nil is specified instead then the default Glib main
  loop will be used. This is generally the recommended approach.
+ @tparam ?table|nil options Optional table of loop options (it may also be
+ passed as the first argument). The recognized fields are:
+ *batched* (boolean, default **false**) to multiplex everything through one
+ GSource, *priority* (number, default @{PRIORITY_DEFAULT}) the priority of
+ that GSource, *context* (lightuserdata) a *raw* GMainContext pointer to
+ attach to and *threadDefault* (boolean) to attach to the thread-default
+ GMainContext of the calling thread. The *priority*, *context* and
+ *threadDefault* options require a batched loop.
  @treturn userdata MainLoop userdata object
  */
 static int
@@ -188,6 +1354,11 @@ l2dbus_mainLoopNew
     )
 {
     GMainLoop* glibLoop = NULL;
+    GMainContext* context = NULL;
+    cdbus_Bool batched = CDBUS_FALSE;
+    cdbus_Bool hasBatchOpt = CDBUS_FALSE;
+    gint priority = G_PRIORITY_DEFAULT;
+    int optIdx = 2;
     l2dbus_MainLoopGlibUserData* loopUd;
 
     /* Check to see if a Lua libev loop userdata was passed
@@ -195,6 +1366,13 @@ l2dbus_mainLoopNew
      */
     int loopType = lua_type(L, 1);
 
+    if ( LUA_TTABLE == loopType )
+    {
+        /* Only options were given */
+        optIdx = 1;
+        loopType = LUA_TNIL;
+    }
+
     if ( LUA_TLIGHTUSERDATA == loopType )
     {
         /* We'll assume (big assumption) that this raw pointer is
@@ -212,6 +1390,53 @@ l2dbus_mainLoopNew
         luaL_argcheck(L, 0, 1, "unexpected main loop type");
     }
 
+    if ( LUA_TTABLE == lua_type(L, optIdx) )
+    {
+        lua_getfield(L, optIdx, "batched");
+        batched = lua_toboolean(L, -1) ? CDBUS_TRUE : CDBUS_FALSE;
+        lua_pop(L, 1);
+
+        lua_getfield(L, optIdx, "priority");
+        if ( !lua_isnil(L, -1) )
+        {
+            luaL_argcheck(L, LUA_TNUMBER == lua_type(L, -1), optIdx,
+                        "priority must be a number");
+            priority = (gint)lua_tointeger(L, -1);
+            hasBatchOpt = CDBUS_TRUE;
+        }
+        lua_pop(L, 1);
+
+        lua_getfield(L, optIdx, "context");
+        if ( !lua_isnil(L, -1) )
+        {
+            luaL_argcheck(L, LUA_TLIGHTUSERDATA == lua_type(L, -1), optIdx,
+                        "context must be a lightuserdata");
+            context = (GMainContext*)lua_touserdata(L, -1);
+            hasBatchOpt = CDBUS_TRUE;
+        }
+        lua_pop(L, 1);
+
+        lua_getfield(L, optIdx, "threadDefault");
+        if ( lua_toboolean(L, -1) )
+        {
+            luaL_argcheck(L, NULL == context, optIdx,
+                        "context and threadDefault are exclusive");
+            /* The default context if the thread hasn't pushed one */
+            context = g_main_context_get_thread_default();
+            hasBatchOpt = CDBUS_TRUE;
+        }
+        lua_pop(L, 1);
+
+        luaL_argcheck(L, batched || !hasBatchOpt, optIdx,
+                    "option requires a batched main loop");
+        luaL_argcheck(L, (NULL == glibLoop) || (NULL == context), optIdx,
+                    "a context cannot be combined with a Glib main loop");
+    }
+    else if ( !lua_isnoneornil(L, optIdx) )
+    {
+        luaL_argcheck(L, 0, optIdx, "unexpected main loop options");
+    }
+
     loopUd = (l2dbus_MainLoopGlibUserData*)lua_newuserdata(L, sizeof(*loopUd));
     if ( NULL == loopUd )
     {
@@ -219,11 +1444,22 @@ l2dbus_mainLoopNew
     }
     else
     {
+        loopUd->loop = NULL;
+        loopUd->batched = batched;
+
         /* Assign the main loop meta-table */
         luaL_getmetatable(L, L2DBUS_MAIN_LOOP_MTBL_NAME);
         lua_setmetatable(L, -2);
 
-        loopUd->loop = CDBUS_MAIN_LOOP_GLIB_NEW(glibLoop, CDBUS_FALSE, NULL);
+        if ( batched )
+        {
+            loopUd->loop = l2dbus_glibLoopNew(glibLoop, context, priority);
+        }
+        else
+        {
+            loopUd->loop = CDBUS_MAIN_LOOP_GLIB_NEW(glibLoop, CDBUS_FALSE, NULL);
+        }
+
         if ( NULL == loopUd->loop )
         {
             luaL_error(L, "Failed to allocate Glib main loop!");
@@ -288,6 +1524,41 @@ luaopen_l2dbus_glib
     /* Assign main loop table to the top-level module table */
     lua_setfield(L, -2, "MainLoop");
 
+/**
+ @constant PRIORITY_HIGH
+ The G_PRIORITY_HIGH GSource priority for the *priority* option of @{MainLoop.new}.
+ */
+    lua_pushinteger(L, G_PRIORITY_HIGH);
+    lua_setfield(L, -2, "PRIORITY_HIGH");
+
+/**
+ @constant PRIORITY_DEFAULT
+ The G_PRIORITY_DEFAULT GSource priority (the default of a batched loop).
+ */
+    lua_pushinteger(L, G_PRIORITY_DEFAULT);
+    lua_setfield(L, -2, "PRIORITY_DEFAULT");
+
+/**
+ @constant PRIORITY_HIGH_IDLE
+ The G_PRIORITY_HIGH_IDLE GSource priority.
+ */
+    lua_pushinteger(L, G_PRIORITY_HIGH_IDLE);
+    lua_setfield(L, -2, "PRIORITY_HIGH_IDLE");
+
+/**
+ @constant PRIORITY_DEFAULT_IDLE
+ The G_PRIORITY_DEFAULT_IDLE GSource priority.
+ */
+    lua_pushinteger(L, G_PRIORITY_DEFAULT_IDLE);
+    lua_setfield(L, -2, "PRIORITY_DEFAULT_IDLE");
+
+/**
+ @constant PRIORITY_LOW
+ The G_PRIORITY_LOW GSource priority.
+ */
+    lua_pushinteger(L, G_PRIORITY_LOW);
+    lua_setfield(L, -2, "PRIORITY_LOW");
+
     /*
      * ** KLUDGE **
      * Lua has a bug (fixed version 5.2.1) where finalizers may call functions
@@ -20,6 +20,10 @@ local helpText = [[
   --bus [busName]       -- Bus name
   -g                    -- force garbage collection call after each reply (rx/tx)
                            May impact overall performance.  Default is off.
+  --livelimit [count]   -- Bound the number of live D-Bus messages by taking
+                           incremental GC steps once more than [count]
+                           messages are alive (a cheaper alternative to -g).
+                           Default is no limit.
   --maxrxsize [size]	-- Sets the maximum total number of bytes that can
   						   be used for all messages received on the connection.
   						   The default value is 63 MBytes (66060288 bytes).
@@ -159,6 +163,7 @@ local g_timestamp           = false             -- -t option
 local g_verbose             = 0                 -- -v option
 local g_waitOnExit          = false             -- -w option
 local g_maxRxSize			= 66060288			-- --connsize option
+local g_liveLimit           = 0                 -- --livelimit option
 
 
 local g_dbusBus             = nil   -- dbus object
@@ -668,6 +673,7 @@ local function ParseArgs()
     local longOpt  = {--name           hasArg   short/retOpt
                       {"bus",          true,    nil },
                       {"maxrxsize",    true,    nil },
+                      {"livelimit",    true,    nil },
                       {"setpause",     true,    nil },
           }
 
@@ -681,6 +687,15 @@ local function ParseArgs()
 
             g_dbusBusName = optval
 
+        elseif opt == "livelimit" then
+
+            g_liveLimit = tonumber(optval)
+            if g_liveLimit == nil or g_liveLimit < 0 then
+                print("ERROR: Invalid live limit (option --livelimit): ", optval)
+                os.exit(1)
+            end
+            l2dbus.Message.setLiveLimit(g_liveLimit)
+
 		elseif opt == "maxrxsize" then
 			print("Value: " .. tonumber(optval))
 			g_maxRxSize = tonumber(optval)
@@ -798,6 +813,7 @@ local function ParseArgs()
         print("Running as Server:                  ", g_serverMode)
         print("Verbose:                            ", g_verbose)
         print("Garbage Collect After Reply:        ", g_forceGC)
+        print("Live Message Limit:                 ", g_liveLimit)
         print("Timestamp Performance:              ", g_timestamp, (g_timestamp==true) and "(in "..g_timeUnits..")" or "")
         if sPid then
             print("PID Filename:                       ", sPid)
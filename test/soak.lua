@@ -0,0 +1,509 @@
+#!/usr/bin/env lua
+------------------------------------------------------------------------------
+-- l2dbus Soak Test
+--
+------------------------------------------------------------------------------
+
+local helpText = [[
+
+  This tool runs a service and a client in one process. They exchange a
+  steady mix of traffic for hours:
+
+  - method calls whose replies come back through PendingCalls;
+  - method calls whose replies come back through a reply route;
+  - signals that the client receives through a match.
+
+  While the traffic runs, the tool samples the memory the process uses at a
+  fixed interval. It fits a trend line to each metric once the warm-up is
+  over. A metric that keeps growing faster than the threshold is flagged.
+  Slow leaks, such as wrapped messages or PendingCalls that are never
+  released, are caught this way.
+
+  The sampled metrics are:
+  rss         -- Resident set size of the process (/proc/self/status).
+  heap        -- Lua heap (collectgarbage "count") after a full collection.
+  registry    -- Live objects in the l2dbus object registry.
+  outgoing    -- Bytes waiting in the outgoing queues of both connections.
+
+  The heap allocated between two samples (before the collection) is
+  reported as well, as a measure of GC pressure.
+
+  Command line arguments:
+
+  --address [address]   -- D-Bus address of the bus to use. Default is the
+                           session bus.
+  --csv [file]          -- Write every sample to [file] as CSV.
+  -d [seconds]          -- Run for [seconds]. Default is 3600 seconds.
+  --glib                -- Use the GLib main loop. Default is libev.
+  -h                    -- This help.
+  -i [seconds]          -- Sample every [seconds]. Default is 10 seconds.
+  --payload [bytes]     -- Size of the string payload of each call.
+                           Default is 256 bytes.
+  --rate [calls/sec]    -- Method calls per second. Default is 200.
+  --threshold [%/hour]  -- Flag a metric that grows by more than this
+                           percentage of its mean per hour. Default is 5.
+  -v                    -- Verbosity. Print every sample.
+  --warmup [seconds]    -- Ignore the samples of the first [seconds] when
+                           fitting the trends. Default is 60 seconds.
+
+  The exit status is zero when no metric was flagged and one otherwise,
+  so the tool can gate a release.
+
+  Example:
+  # Soak for four hours at 1000 calls per second
+  lua soak.lua -d 14400 --rate 1000 --csv soak.csv
+
+]]
+------------------------------------------------------------------------------
+
+---------------
+-- Requires
+---------------
+local pretty    = require "pl.pretty"
+local utils     = require "utils.commonUtils"  -- args parsing
+local l2dbus    = require "l2dbus"
+
+---------------
+-- Const
+---------------
+
+local APP_VER               = "1.0.0"
+local SOAK_BUS_NAME         = "org.l2dbus.Soak"
+local SOAK_OBJECT           = "/org/l2dbus/Soak"
+local SOAK_INTERFACE        = "org.l2dbus.Soak"
+local SOAK_METHODS          =
+{
+    {
+    name = "Echo",
+    args =
+        {
+            {name = "payload", sig="s", dir="in"},
+            {name = "seq", sig="u", dir="in"},
+            {name = "payload", sig="s", dir="out"}
+        }
+    },
+}
+-- The traffic tick (msec)
+local TICK_MSEC             = 10
+-- The most calls waiting for a reply before the client backs off
+local MAX_OUTSTANDING       = 200
+-- Trends of metrics with a smaller mean are measured against these floors
+-- so the noise around zero isn't flagged
+local TREND_FLOOR           = { rss = 1024, heap = 64, registry = 16,
+                                outgoing = 65536 }
+
+---------------
+-- Globals
+---------------
+
+local g_address             = nil       -- --address option
+local g_csvFile             = nil       -- --csv option
+local g_duration            = 3600      -- -d option
+local g_useGlib             = false     -- --glib option
+local g_interval            = 10        -- -i option
+local g_payloadSize         = 256       -- --payload option
+local g_rate                = 200       -- --rate option
+local g_threshold           = 5         -- --threshold option
+local g_verbose             = 0         -- -v option
+local g_warmup              = 60        -- --warmup option
+
+local g_disp                = nil
+local g_svcConn             = nil
+local g_cliConn             = nil
+
+
+----------------------------------------------------------------
+--- ReadRss
+---
+--- Returns the resident set size of the process (in KB)
+----------------------------------------------------------------
+local function ReadRss()
+    local fp = io.open("/proc/self/status", "r")
+    local rss = 0
+    if fp then
+        local status = fp:read("*a")
+        fp:close()
+        rss = tonumber(status:match("VmRSS:%s*(%d+)")) or 0
+    end
+    return rss
+end
+
+
+----------------------------------------------------------------
+--- Trend
+---
+--- Fits a least squares line to the (t, value) samples and returns
+--- its slope (per second) and the mean of the values
+----------------------------------------------------------------
+local function Trend( samples, key )
+    local n = #samples
+    local sumT, sumV, sumTT, sumTV = 0, 0, 0, 0
+    for i = 1, n do
+        local t, v = samples[i].t, samples[i][key]
+        sumT = sumT + t
+        sumV = sumV + v
+        sumTT = sumTT + t * t
+        sumTV = sumTV + t * v
+    end
+    local denom = n * sumTT - sumT * sumT
+    if (n < 2) or (denom == 0) then
+        return 0, (n > 0) and (sumV / n) or 0
+    end
+    return (n * sumTV - sumT * sumV) / denom, sumV / n
+end
+
+
+----------------------------------------------------------------
+--- OpenConnections
+---
+--- Opens the (private) service and client connections
+----------------------------------------------------------------
+local function OpenConnections()
+    local mainLoop
+    if g_useGlib then
+        mainLoop = require("l2dbus_glib").MainLoop.new()
+    else
+        mainLoop = require("l2dbus_ev").MainLoop.new()
+    end
+
+    g_disp = l2dbus.Dispatcher.new(mainLoop)
+    assert( nil ~= g_disp )
+
+    local function open()
+        local conn
+        if g_address then
+            conn = l2dbus.Connection.open(g_disp, g_address, true)
+        else
+            conn = l2dbus.Connection.openStandard(g_disp,
+                                                l2dbus.Dbus.BUS_SESSION, true)
+        end
+        assert( nil ~= conn )
+        return conn
+    end
+
+    g_svcConn = open()
+    g_cliConn = open()
+end
+
+
+----------------------------------------------------------------
+--- StartService
+---
+--- Registers the echo service and calls onReady once it owns its name
+----------------------------------------------------------------
+local function StartService( onReady )
+    local function onRequest( intf, conn, msg )
+        if msg:getMember() ~= "Echo" then
+            return l2dbus.Dbus.HANDLER_RESULT_NOT_YET_HANDLED
+        end
+        local args = msg:getArgs()
+        local payload, seq = args[1], args[2]
+        local reply = l2dbus.Message.newMethodReturn(msg)
+        reply:addArgsBySignature("s", payload)
+        conn:send(reply)
+
+        -- Every fourth call also emits a signal
+        if seq % 4 == 0 then
+            local sig = l2dbus.Message.newSignal(SOAK_OBJECT, SOAK_INTERFACE,
+                                                "Tick")
+            sig:addArgsBySignature("u", seq)
+            conn:send(sig)
+        end
+        return l2dbus.Dbus.HANDLER_RESULT_HANDLED
+    end
+
+    local svcObj = l2dbus.ServiceObject.new(SOAK_OBJECT)
+    local intf = l2dbus.Interface.new(SOAK_INTERFACE, onRequest)
+    intf:registerMethods(SOAK_METHODS)
+    svcObj:addInterface(intf)
+    assert( g_svcConn:registerServiceObject(svcObj) )
+
+    assert( g_svcConn:requestName(SOAK_BUS_NAME,
+        l2dbus.Dbus.NAME_FLAG_DO_NOT_QUEUE, function( conn, name, result, errName )
+            if result ~= l2dbus.Dbus.REQUEST_NAME_REPLY_PRIMARY_OWNER then
+                print("ERROR: Failed to own " .. name .. ": " ..
+                      tostring(result or errName))
+                g_disp:stop()
+            else
+                onReady()
+            end
+        end) )
+
+    return svcObj
+end
+
+
+----------------------------------------------------------------
+--- Soak
+---
+--- Drives the traffic and samples the metrics until the duration
+--- expires. Returns true if no metric was flagged.
+----------------------------------------------------------------
+local function Soak()
+    local stats = { calls = 0, replies = 0, errors = 0, sendErr = 0,
+                    signals = 0 }
+    local samples = {}
+    local nOutstanding = 0
+    local seq = 0
+    local credit = 0
+    local lastTick
+    local startTime
+    local lastHeap = collectgarbage("count")
+    local payload = string.rep("x", g_payloadSize)
+    local csv = g_csvFile and assert(io.open(g_csvFile, "w"))
+
+    if csv then
+        csv:write("t,rss,heap,allocated,registry,outgoing\n")
+    end
+
+    local function onReply( reply )
+        nOutstanding = nOutstanding - 1
+        if (reply == nil) or (reply:getType() == l2dbus.Message.ERROR) then
+            stats.errors = stats.errors + 1
+        else
+            stats.replies = stats.replies + 1
+        end
+    end
+
+    local route = g_cliConn:addReplyHandler(function( conn, serial, reply )
+        onReply(reply)
+    end)
+
+    local function onNotify( pending )
+        onReply(pending:stealReply())
+    end
+
+    local tickMatch = g_cliConn:registerMatch({
+            msgType = l2dbus.Dbus.MESSAGE_TYPE_SIGNAL, path = SOAK_OBJECT,
+            interface = SOAK_INTERFACE, member = "Tick"},
+        function( match, msg )
+            stats.signals = stats.signals + 1
+        end)
+
+    -- Alternates the replies between PendingCalls and the reply route
+    local function sendOne()
+        local msg = l2dbus.Message.newMethodCall({destination=SOAK_BUS_NAME,
+                    path=SOAK_OBJECT, interface=SOAK_INTERFACE, method="Echo"})
+        seq = seq + 1
+        msg:addArgsBySignature("su", payload, seq)
+        local ok
+        if seq % 2 == 0 then
+            local pending
+            ok, pending = g_cliConn:sendWithReply(msg)
+            if ok then
+                pending:setNotify(onNotify)
+            end
+        else
+            ok = g_cliConn:sendRouted(msg, route)
+        end
+        if ok then
+            nOutstanding = nOutstanding + 1
+            stats.calls = stats.calls + 1
+        else
+            stats.sendErr = stats.sendErr + 1
+        end
+    end
+
+    local tick = l2dbus.Timeout.new(g_disp, TICK_MSEC, true, function( tm )
+        local now = l2dbus.monotonicTime()
+        credit = credit + (now - lastTick) * g_rate
+        lastTick = now
+        while (credit >= 1) and (nOutstanding < MAX_OUTSTANDING) do
+            sendOne()
+            credit = credit - 1
+        end
+        -- Don't build up a burst while backing off
+        credit = math.min(credit, g_rate * TICK_MSEC / 1000)
+    end)
+
+    local function takeSample()
+        local allocated = collectgarbage("count") - lastHeap
+        collectgarbage("collect")
+        local sample = {
+            t = l2dbus.monotonicTime() - startTime,
+            rss = ReadRss(),
+            heap = collectgarbage("count"),
+            allocated = math.max(allocated, 0),
+            registry = l2dbus.Stats.snapshot().registry.objects,
+            outgoing = g_svcConn:getOutgoingSize() + g_cliConn:getOutgoingSize()
+        }
+        lastHeap = sample.heap
+        samples[#samples + 1] = sample
+        if csv then
+            csv:write(string.format("%.3f,%d,%.1f,%.1f,%d,%d\n", sample.t,
+                      sample.rss, sample.heap, sample.allocated,
+                      sample.registry, sample.outgoing))
+            csv:flush()
+        end
+        if g_verbose > 0 then
+            print(string.format("%8.0fs rss=%dKB heap=%.0fKB allocated=%.0fKB " ..
+                "registry=%d outgoing=%d calls=%d", sample.t, sample.rss,
+                sample.heap, sample.allocated, sample.registry,
+                sample.outgoing, stats.calls))
+        end
+    end
+
+    local sampler = l2dbus.Timeout.new(g_disp, g_interval * 1000, true,
+                                        function() takeSample() end)
+    local stopper = l2dbus.Timeout.new(g_disp, g_duration * 1000, false,
+                                        function() g_disp:stop() end)
+
+    local svcObj = StartService(function()
+        print(string.format("Soaking for %d seconds at %d calls/sec",
+                            g_duration, g_rate))
+        startTime = l2dbus.monotonicTime()
+        lastTick = startTime
+        takeSample()
+        tick:setEnable(true)
+        sampler:setEnable(true)
+        stopper:setEnable(true)
+    end)
+
+    g_disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    tick:setEnable(false)
+    sampler:setEnable(false)
+    if startTime then
+        takeSample()
+    end
+    if csv then
+        csv:close()
+    end
+
+    g_cliConn:unregisterMatch(tickMatch)
+    g_cliConn:removeReplyHandler(route)
+    g_svcConn:unregisterServiceObject(svcObj)
+    g_svcConn:releaseName(SOAK_BUS_NAME)
+
+    if startTime == nil then
+        return false
+    end
+
+    -- Fit the trends to the samples taken after the warm-up
+    local steady = {}
+    for _, sample in ipairs(samples) do
+        if sample.t >= g_warmup then
+            steady[#steady + 1] = sample
+        end
+    end
+
+    local trends = {}
+    local flagged = {}
+    for key, floor in pairs(TREND_FLOOR) do
+        local slope, mean = Trend(steady, key)
+        local perHour = slope * 3600 / math.max(mean, floor) * 100
+        trends[key] = { mean = mean, slopePerHour = slope * 3600,
+                        growthPctPerHour = perHour }
+        if (#steady >= 3) and (perHour > g_threshold) then
+            flagged[#flagged + 1] = key
+        end
+    end
+
+    local _, meanAllocated = Trend(steady, "allocated")
+    stats.elapsedSec = samples[#samples].t
+    stats.samples = #samples
+    stats.gcPressureKBPerSec = meanAllocated / g_interval
+
+    print("STATS:")
+    print(string.rep("=", 40))
+    pretty.dump(stats)
+    print("TRENDS:")
+    print(string.rep("=", 40))
+    pretty.dump(trends)
+
+    if #steady < 3 then
+        print("Too few samples after the warm-up to fit trends")
+    end
+    table.sort(flagged)
+    for _, key in ipairs(flagged) do
+        print(string.format("FLAGGED: %s grows %.1f%% per hour (threshold %.1f%%)",
+                            key, trends[key].growthPctPerHour, g_threshold))
+    end
+    print("Soak: " .. ((#flagged == 0) and "PASS" or "FAIL"))
+
+    return #flagged == 0
+end
+
+
+----------------------------------------------------------------
+--- ParseArgs
+---
+--- Parse command line arguments
+----------------------------------------------------------------
+local function ParseArgs()
+
+    local bHelp    = false
+    local lArgs    = utils.deepcopy(arg)
+    local longOpt  = {--name           hasArg   short/retOpt
+                      {"address",      true,    nil },
+                      {"csv",          true,    nil },
+                      {"glib",         false,   nil },
+                      {"payload",      true,    nil },
+                      {"rate",         true,    nil },
+                      {"threshold",    true,    nil },
+                      {"warmup",       true,    nil },
+          }
+
+    local function number( opt, optval, minVal )
+        local val = tonumber(optval)
+        if (val == nil) or (val < minVal) then
+            print("ERROR: Invalid value (option " .. opt .. "): ", optval)
+            os.exit(1)
+        end
+        return val
+    end
+
+    for opt, optval in utils.getopt(lArgs, 'd:hi:v', longOpt) do
+
+        if opt == "address" then
+            g_address = optval
+        elseif opt == "csv" then
+            g_csvFile = optval
+        elseif opt == "glib" then
+            g_useGlib = true
+        elseif opt == "payload" then
+            g_payloadSize = number(opt, optval, 0)
+        elseif opt == "rate" then
+            g_rate = number(opt, optval, 1)
+        elseif opt == "threshold" then
+            g_threshold = number(opt, optval, 0)
+        elseif opt == "warmup" then
+            g_warmup = number(opt, optval, 0)
+        elseif opt == "d" then
+            g_duration = number(opt, optval, 1)
+        elseif opt == "h" then
+            bHelp = true
+        elseif opt == "i" then
+            g_interval = number(opt, optval, 1)
+        elseif opt == "v" then
+            g_verbose = g_verbose + 1
+        end
+
+    end -- arg loop
+
+    if bHelp == true then
+        print()
+        print(arg[0], string.format("%s",APP_VER))
+        print(helpText)
+        os.exit(1)
+    end
+
+end -- ParseArgs
+
+
+local function main()
+    l2dbus.Trace.setFlags(l2dbus.Trace.ERROR, l2dbus.Trace.WARN)
+    ParseArgs()
+    OpenConnections()
+
+    local passed = Soak()
+
+    g_svcConn = nil
+    g_cliConn = nil
+    g_disp = nil
+    return passed
+end
+
+
+local passed = main()
+l2dbus.shutdown()
+os.exit(passed and 0 or 1)
@@ -36,7 +36,9 @@ local gOptions =
 		txSize = 64,
 		numThreads = 1,
 		verbose = 1,
-		replyDelay = 0
+		replyDelay = 0,
+		await = false,
+		window = 0
 		}
 
 local function log(level, fmt, ...)
@@ -100,6 +102,8 @@ local function usage()
 	print("\nOptions:")
 	print("\t--block                Make calls to service blocking. Defaults")
 	print("\t                       to non-blocking calls.")
+	print("\t--await                Non-blocking calls yield the calling")
+	print("\t                       thread until the reply arrives.")
 	print("\t--bus [name]           The bus name to use. By default")
 	print("\t                       the D-Bus Session bus is used.")
 	print("\t-c [num]               The number of times for each thread to send")
@@ -118,6 +122,8 @@ local function usage()
 	print("\t--threads [num]        The number of coroutine based threads")
 	print("\t                       to concurrently send messages. Default=1.")
 	print("\t-v                     Turns on verbose output")
+	print("\t--window [num]         The maximum number of calls in flight.")
+	print("\t                       Default=0 (unlimited).")
 end
 
 
@@ -125,7 +131,7 @@ local function executeCall(proxy, count)
 	local callSuccess = false
 	local msg
 	
-	if gOptions.nonBlocking then
+	if gOptions.nonBlocking and not gOptions.await then
 		local result, pending, errMsg = proxy.m.Test(count, gPayload)
 		if not result then
 			log(1,  "Test %d failed to execute: %s - %s", count, pending, errMsg)			
@@ -229,6 +235,7 @@ local function runTest(conn, id)
 	
 	proxyCtrl:setProxyNoReplyNeeded(gOptions.noWait == true)
 	proxyCtrl:setBlockingMode(gOptions.nonBlocking == false)
+	proxyCtrl:setAwaitMode(gOptions.await)
 	
 	local proxy = proxyCtrl:getProxy(L2DBUS_STRESS_TEST_SVC_INTERFACE)
 	local result
@@ -301,6 +308,8 @@ local function main()
 	for flag, value in pairs(flags) do
 		if flag == "block" then
 			gOptions.nonBlocking = false
+		elseif flag == "await" then
+			gOptions.await = true
 		elseif flag == "bus" then
 			gOptions.bus = value
 		elseif flag == "c" then
@@ -330,6 +339,8 @@ local function main()
 			gOptions.numThreads = tonumber(value)
 		elseif flag == "v" then
 			gOptions.verbose = tonumber(value)
+		elseif flag == "window" then
+			gOptions.window = tonumber(value)
 		end
 	end
 	
@@ -358,6 +369,10 @@ local function main()
 	
 	assert( nil ~= conn )
 
+	if gOptions.window > 0 then
+		ProxyController.setRequestWindow(conn, gOptions.window)
+	end
+
 	if gOptions.verbose > 2 then
 		print(string.format("Connection: max message size: %d (bytes)",
 				conn:getMaxMessageSize()))
@@ -385,6 +400,12 @@ local function main()
 	
 	-- Returns when command to quit
 	gDispatcher:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+
+	local stats = ProxyController.getRequestWindowStats(conn)
+	if stats then
+		print("Request window:")
+		pretty.dump(stats)
+	end
 end
 
 print("Hit Return to continue")
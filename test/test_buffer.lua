@@ -0,0 +1,51 @@
+#!/usr/bin/env lua
+
+--
+-- Marshalls a Buffer as a byte array and decodes the byte array back
+-- into a Buffer that refers to the bytes of the message.
+--
+local l2dbus = require("l2dbus")
+
+
+local function main()
+	local buf = l2dbus.Buffer.new(16)
+	buf:set(0, "u", 0xdeadbeef, ">")
+	buf:set(4, "q", 513, "<")
+	buf:set(8, "d", 3.5)
+	print("Big-endian bytes: " ..
+		((buf:toString(0, 4) == "\222\173\190\239") and "PASS" or "FAIL"))
+	print("Little-endian read: " .. ((buf:get(4, "q", "<") == 513) and "PASS" or "FAIL"))
+	print("Double read: " .. ((buf:get(8, "d") == 3.5) and "PASS" or "FAIL"))
+
+	-- A slice shares the bytes of the Buffer
+	local slice = buf:slice(4, 2)
+	slice:set(0, "y", 7)
+	print("Slice shares bytes: " .. ((buf:get(4, "y") == 7) and "PASS" or "FAIL"))
+	print("Slice length: " .. ((#slice == 2) and "PASS" or "FAIL"))
+
+	local msg = l2dbus.Message.newSignal("/org/l2dbus/buffer/Test",
+										"org.l2dbus.buffer.Test", "Data")
+	msg:addArgs(buf)
+	print("Buffer signature: " .. ((msg:getSignature() == "ay") and "PASS" or "FAIL"))
+	msg:addArgsBySignature("ay", buf:slice(0, 4))
+
+	-- Decoding refers to the message once it's been serialized
+	msg:setSerial(1)
+	local whole, head = msg:getArgs({byteArrayAsBuffer = true})
+	print("Decoded read-only: " .. (whole:isReadOnly() and "PASS" or "FAIL"))
+	print("Decoded bytes: " ..
+		((whole:toString() == buf:toString()) and "PASS" or "FAIL"))
+	print("Decoded uint32: " ..
+		((head:get(0, "u", ">") == 0xdeadbeef) and "PASS" or "FAIL"))
+	print("Write refused: " ..
+		(pcall(whole.set, whole, 0, "y", 1) and "FAIL" or "PASS"))
+
+	-- The decoded Buffer keeps the message alive
+	msg = nil
+	collectgarbage()
+	print("Outlives message: " .. ((#whole == 16) and "PASS" or "FAIL"))
+end
+
+
+main()
+l2dbus.shutdown()
@@ -0,0 +1,97 @@
+#!/usr/bin/env lua
+
+--
+-- Generates a typed proxy and service stub for a small interface, serves
+-- the interface on the session bus and calls it through the generated
+-- proxy on the same connection.
+--
+local l2dbus = require("l2dbus")
+local codegen = require("l2dbus.codegen")
+local service = require("l2dbus.service")
+local proxyCtrl = require("l2dbus.proxyctrl")
+
+local TEST_BUS_NAME = "org.l2dbus.codegen.Test"
+local TEST_OBJ_PATH = "/org/l2dbus/codegen/Test"
+local TEST_INTF = "org.l2dbus.codegen.Calc"
+
+local TEST_XML = [[
+<node>
+  <interface name="org.l2dbus.codegen.Calc">
+    <method name="Add">
+      <arg name="a" type="i" direction="in"/>
+      <arg name="b" type="i" direction="in"/>
+      <arg name="sum" type="i" direction="out"/>
+    </method>
+    <method name="Describe">
+      <arg name="end" type="a{sv}" direction="in"/>
+      <arg type="s" direction="out"/>
+    </method>
+    <signal name="Computed">
+      <arg name="sum" type="i"/>
+    </signal>
+  </interface>
+</node>
+]]
+
+
+local function main()
+	print(codegen.generate(TEST_XML))
+
+	local gen = codegen.load(TEST_XML)
+	local calc = gen[TEST_INTF]
+	assert( calc ~= nil )
+
+	local disp = l2dbus.Dispatcher.new(require("l2dbus_ev").MainLoop.new())
+	assert( nil ~= disp )
+	local conn = l2dbus.Connection.openStandard(disp, l2dbus.Dbus.BUS_SESSION)
+	assert( nil ~= conn )
+
+	local msg = l2dbus.Message.newMethodCall({destination=l2dbus.Dbus.SERVICE_DBUS,
+				path=l2dbus.Dbus.PATH_DBUS, interface=l2dbus.Dbus.INTERFACE_DBUS,
+				method="RequestName"})
+	msg:addArgsBySignature("su", TEST_BUS_NAME, l2dbus.Dbus.NAME_FLAG_DO_NOT_QUEUE)
+	local reply = conn:sendWithReplyAndBlock(msg)
+	msg:dispose()
+	assert( reply:takeArgs() == l2dbus.Dbus.REQUEST_NAME_REPLY_PRIMARY_OWNER )
+
+	-- The generated stub registers the interface and its handlers
+	local svc = service.new(TEST_OBJ_PATH, true)
+	local emitter = calc.newEmitter(svc, conn)
+	assert( calc.register(svc, {
+		Add = function(ctx, a, b)
+			emitter.Computed(a + b)
+			ctx:reply(a + b)
+		end,
+		Describe = function(ctx, dict)
+			ctx:reply("name=" .. tostring(dict.name))
+		end
+		}) )
+	assert( svc:attach(conn) )
+
+	-- Calls made through the generated proxy do not block
+	local ctrl = proxyCtrl.new(conn, TEST_BUS_NAME, TEST_OBJ_PATH)
+	ctrl:setBlockingMode(false)
+	local proxy = calc.newProxy(ctrl)
+
+	local status, pending = proxy.Add(2, 40)
+	assert( status )
+	pending:setNotify(function(p)
+		local sum = p:stealReply():takeArgs()
+		print("Generated Add: " .. ((sum == 42) and "PASS" or "FAIL"))
+
+		local status, pending = proxy.Describe({name = "calc"})
+		assert( status )
+		pending:setNotify(function(p)
+			local desc = p:stealReply():takeArgs()
+			print("Generated Describe: " .. ((desc == "name=calc") and "PASS" or "FAIL"))
+			disp:stop()
+		end)
+	end)
+
+	disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+	svc:detach(conn)
+end
+
+
+main()
+l2dbus.shutdown()
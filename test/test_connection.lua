@@ -49,6 +49,161 @@ local function execute(disp, conn)
 		end
 	end
 
+	-- Emit a burst of signals in one batch (two of them coalesce)
+	local batch = {
+		{path="/org/l2dbus/Test", interface="org.l2dbus.Test", member="Tick",
+			signature="u", args={1}},
+		{path="/org/l2dbus/Test", interface="org.l2dbus.Test", member="Level",
+			signature="d", args={0.5}},
+		{path="/org/l2dbus/Test", interface="org.l2dbus.Test", member="Tick",
+			signature="u", args={2}},
+		{path="invalid path", interface="org.l2dbus.Test", member="Tick"},
+		l2dbus.Message.newSignal("/org/l2dbus/Test", "org.l2dbus.Test", "Done")
+	}
+	local nQueued, results = conn:sendBatch(batch, {coalesce=true})
+	print("Batch queued " .. nQueued .. " signals: " .. pretty.write(results))
+
+	-- A corked connection holds the signals until it is uncorked
+	conn:cork({maxMessages=10})
+	for i = 1, 3 do
+		local tick = l2dbus.Message.newSignal("/org/l2dbus/Test", "org.l2dbus.Test", "Tick")
+		tick:addArgsBySignature("u", i)
+		assert( conn:send(tick) )
+	end
+	local corked, nHeld = conn:isCorked()
+	print("Corked holds 3 signals: " .. ((corked and (nHeld == 3)) and "PASS" or "FAIL"))
+	print("Uncork sends 3 signals: " .. ((conn:uncork() == 3) and "PASS" or "FAIL"))
+	print("Uncorked: " .. ((not conn:isCorked()) and "PASS" or "FAIL"))
+
+	-- Superseded signals of a conflating match reach the handler once
+	local nLevels, lastLevel = 0, nil
+	local levelMatch = conn:registerMatch({msgType=l2dbus.Dbus.MESSAGE_TYPE_SIGNAL,
+			path="/org/l2dbus/Test", interface="org.l2dbus.Test", member="Level",
+			conflate={path=true, member=true}},
+		function(match, msg)
+			nLevels = nLevels + 1
+			lastLevel = msg:getArgs()[1]
+		end)
+	for i = 1, 3 do
+		local level = l2dbus.Message.newSignal("/org/l2dbus/Test", "org.l2dbus.Test", "Level")
+		level:addArgsBySignature("d", i / 4)
+		assert( conn:send(level) )
+	end
+	conn:flush()
+	local settle = l2dbus.Timeout.new(disp, 250, false, function(tm, co)
+		coroutine.resume(co)
+	end, coroutine.running())
+	settle:setEnable(true)
+	coroutine.yield()
+	print("Conflated signals: " .. (((nLevels == 1) and (lastLevel == 0.75) and
+		(conn:getStats().conflated == 2)) and "PASS" or "FAIL"))
+	assert( conn:unregisterMatch(levelMatch) )
+
+	-- Arguments decoded by the dispatcher's helper thread follow the user token
+	local decodedMatch = conn:registerMatch({msgType=l2dbus.Dbus.MESSAGE_TYPE_SIGNAL,
+			path="/org/l2dbus/Test", interface="org.l2dbus.Test", member="Decoded",
+			predecode=true},
+		function(match, msg, co, props, pair, bytes)
+			coroutine.resume(co, props, pair, bytes)
+		end, coroutine.running())
+	local decoded = l2dbus.Message.newSignal("/org/l2dbus/Test", "org.l2dbus.Test", "Decoded")
+	decoded:addArgsBySignature("a{sv}(su)ay", {name="l2dbus", level=0.5}, {"id", 7}, {1, 2, 3})
+	assert( conn:send(decoded) )
+	conn:flush()
+	local props, pair, bytes = coroutine.yield()
+	print("Predecoded arguments: " .. (((props.name == "l2dbus") and (props.level == 0.5) and
+		(pair[1] == "id") and (pair[2] == 7) and (#bytes == 3) and (bytes[3] == 3))
+		and "PASS" or "FAIL"))
+	assert( conn:unregisterMatch(decodedMatch) )
+	print("Predecode with conflate: " .. ((not pcall(conn.registerMatch, conn,
+		{member="Decoded", predecode=true, conflate={}}, function() end)) and "PASS" or "FAIL"))
+
+	-- A borrowed message that was retained and then disposed of is never
+	-- lent out again (the handler still holds on to the wrapper)
+	local kept
+	local borrowMatch = conn:registerMatch({msgType=l2dbus.Dbus.MESSAGE_TYPE_SIGNAL,
+			path="/org/l2dbus/Test", interface="org.l2dbus.Test", member="Borrowed",
+			borrowMessage=true},
+		function(match, msg, co)
+			if kept == nil then
+				kept = msg:retain()
+				kept:dispose()
+			else
+				coroutine.resume(co, rawequal(msg, kept), msg:getArgs())
+			end
+		end, coroutine.running())
+	for i = 1, 2 do
+		local borrowed = l2dbus.Message.newSignal("/org/l2dbus/Test", "org.l2dbus.Test", "Borrowed")
+		borrowed:addArgsBySignature("u", i)
+		assert( conn:send(borrowed) )
+	end
+	conn:flush()
+	local reused, secondArg = coroutine.yield()
+	print("Retained then disposed borrowed message: " .. (((not reused) and
+		(secondArg == 2) and (not pcall(kept.getArgs, kept))) and "PASS" or "FAIL"))
+	assert( conn:unregisterMatch(borrowMatch) )
+
+	-- Replies routed by serial number to a single handler
+	local route = conn:addReplyHandler(function(c, serial, reply, co)
+		coroutine.resume(co, serial, reply)
+	end, coroutine.running())
+	local getId = l2dbus.Message.newMethodCall({destination=l2dbus.Dbus.SERVICE_DBUS,
+				path=l2dbus.Dbus.PATH_DBUS, interface=l2dbus.Dbus.INTERFACE_DBUS,
+				method="GetId"})
+	local sent, serial = conn:sendRouted(getId, route, 1000)
+	assert( sent )
+	local replySerial, routedReply = coroutine.yield()
+	print("Routed reply: " .. (((replySerial == serial) and
+		(routedReply:getType() == l2dbus.Message.METHOD_RETURN)) and "PASS" or "FAIL"))
+	print("Cancel answered request: " .. ((not conn:cancelRouted(serial)) and "PASS" or "FAIL"))
+	assert( conn:removeReplyHandler(route) )
+
+	-- One handler serving every object path beneath a prefix
+	local devices = "/org/l2dbus/Test/devices"
+	local registered = conn:registerSubtree(devices, function(c, path, req)
+			return l2dbus.ServiceObject.new(path)
+		end, function(c, path)
+			return (path == devices) and {"dev0", "dev1"} or {}
+		end)
+	print("Register subtree: " .. (registered and "PASS" or "FAIL"))
+	print("Register subtree twice: " .. ((not conn:registerSubtree(devices,
+		function() end)) and "PASS" or "FAIL"))
+	print("Unregister subtree: " .. (conn:unregisterSubtree(devices) and "PASS" or "FAIL"))
+	print("Unregister subtree twice: " .. ((not conn:unregisterSubtree(devices))
+		and "PASS" or "FAIL"))
+
+	-- Names are requested without blocking and recorded for a reconnect
+	conn:enableRestore(true, {autoReconnect=false})
+	local testName = "org.l2dbus.Test.Reconnect"
+	assert( conn:requestName(testName, l2dbus.Dbus.NAME_FLAG_DO_NOT_QUEUE,
+		function(c, name, result, errName, co)
+			coroutine.resume(co, name, result)
+		end, coroutine.running()) )
+	local grantedName, nameResult = coroutine.yield()
+	print("Request name: " .. (((grantedName == testName) and
+		(nameResult == l2dbus.Dbus.REQUEST_NAME_REPLY_PRIMARY_OWNER)) and "PASS" or "FAIL"))
+	print("Reconnect connected shared connection: " .. ((not conn:reconnect()) and "PASS" or "FAIL"))
+	assert( conn:releaseName(testName) )
+	conn:enableRestore(false)
+
+	-- Runtime metrics for this connection and the whole Lua state
+	print("Connection stats: " .. pretty.write(conn:getStats()))
+	local stats = l2dbus.Stats.snapshot()
+	print("Messages: " .. pretty.write(stats.messages))
+	print("Pending call RTT: " .. pretty.write(stats.latency.pendingCallRtt))
+	l2dbus.Stats.reset()
+
+	-- Sampled binary records of the messages sent/received so far
+	local records = l2dbus.TraceRing.dump(true)
+	local tickHash = l2dbus.TraceRing.hash("Tick")
+	for _, rec in ipairs(records) do
+		print(string.format("%.6f %s conn=%d type=%d serial=%d%s", rec.time,
+			(rec.direction == l2dbus.TraceRing.SENT) and "->" or "<-",
+			rec.connection, rec.type, rec.serial,
+			(rec.member == tickHash) and " (Tick)" or ""))
+	end
+	print("Trace ring: " .. pretty.write(l2dbus.TraceRing.getInfo()))
+
 	print("Exiting out of mainloop")
 	disp:stop()
 end
@@ -64,6 +219,7 @@ local function main()
 		mainLoop = require("l2dbus_ev").MainLoop.new()
 	end
 	
+    l2dbus.TraceRing.enable(256)
     local disp = l2dbus.Dispatcher.new(mainLoop)
     assert( nil ~= disp )
     local conn = l2dbus.Connection.openStandard(disp, l2dbus.Dbus.BUS_SESSION)
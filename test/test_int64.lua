@@ -47,6 +47,24 @@ local function main()
     print("#b = " .. #b)
     print("a:toNumber = " .. a:toNumber())
 
+    -- In-place accumulation re-uses the same userdata
+    local acc = l2dbus.Int64.new(0)
+    for i = 1, 10 do
+        acc:addAssign(i)
+    end
+    acc:mulAssign(2):subAssign(a)
+    print("acc = " .. acc .. ((acc == l2dbus.Int64.new(106)) and " PASS" or " FAIL"))
+
+    -- 64-bit values decode as Lua numbers when lossless (a Uint64 above
+    -- INT64_MAX isn't on any Lua version)
+    local msg = l2dbus.Message.newSignal("/org/acme", "org.acme.Intf", "Sig")
+    msg:addArgsBySignature("xtat", 42, l2dbus.Uint64.new("18446744073709551615"),
+                           {1, 2, 3})
+    local v1, v2, v3 = msg:getArgs({int64AsNumber = true})
+    print("int64AsNumber: " .. (((type(v1) == "number") and (v1 == 42) and
+        (type(v2) == "userdata") and (type(v3[3]) == "number")) and
+        "PASS" or "FAIL"))
+
 end
 
 
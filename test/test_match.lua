@@ -50,6 +50,17 @@ local function main()
 	
     local disp = l2dbus.Dispatcher.new(mainLoop)
     assert( nil ~= disp )
+
+    -- Optionally bound the work each connection does per main loop iteration
+    local budgeted = (arg[1] == "--budget") or (arg[2] == "--budget")
+    if budgeted then
+        disp:setDispatchBudget(8, 2000)
+        local maxMsgs, maxUsec, nDeferred = disp:getDispatchBudget()
+        assert( (maxMsgs == 8) and (maxUsec == 2000) and (nDeferred == 0) )
+        assert( disp:getStarvationLimit() == 16 )
+        disp:setStarvationLimit(4)
+        assert( disp:getStarvationLimit() == 4 )
+    end
     local conn = l2dbus.Connection.openStandard(disp, l2dbus.Dbus.BUS_SESSION)
     assert( nil ~= conn )
 
@@ -66,17 +77,94 @@ local function main()
 	local hnd = {}
 	hnd[1] = conn:registerMatch(callFilter, onFilterMatch)
 
+    local nameFilter = {msgType=l2dbus.Dbus.MESSAGE_TYPE_SIGNAL,
+    					member="NameOwnerChanged",
+    					borrowMessage=true}
+	hnd[2] = conn:registerMatch(nameFilter, function(match, msg, ud)
+		print("Borrowed message: " .. tostring(msg:isBorrowed()))
+		onFilterMatch(match, msg, ud)
+		end)
+
+    if budgeted then
+    	-- Bulk traffic waits behind method calls and higher priority signals
+    	local bulkFilter = {msgType=l2dbus.Dbus.MESSAGE_TYPE_SIGNAL,
+    					member="PropertiesChanged",
+    					priority="bulk"}
+		hnd[#hnd + 1] = conn:registerMatch(bulkFilter, onFilterMatch)
+
+		-- A burst larger than the budget is partly deferred but stays in order
+		local nBurst, nReceived, inOrder, maxDeferred = 20, 0, true, 0
+		hnd[#hnd + 1] = conn:registerMatch({msgType=l2dbus.Dbus.MESSAGE_TYPE_SIGNAL,
+				path="/org/l2dbus/Test", interface="org.l2dbus.Test", member="Burst"},
+			function(match, msg)
+				nReceived = nReceived + 1
+				inOrder = inOrder and (msg:getArgs() == nReceived)
+				maxDeferred = math.max(maxDeferred, select(3, disp:getDispatchBudget()))
+				if nReceived == nBurst then
+					print("Dispatch budget deferred burst: " .. (((maxDeferred > 0) and
+						inOrder) and "PASS" or "FAIL"))
+				end
+			end)
+		for i = 1,nBurst do
+			local burst = l2dbus.Message.newSignal("/org/l2dbus/Test", "org.l2dbus.Test", "Burst")
+			burst:addArgsBySignature("u", i)
+			assert( conn:send(burst) )
+		end
+		conn:flush()
+	end
+	local ok = pcall(conn.registerMatch, conn, {priority="urgent"}, onFilterMatch)
+	print("Unknown match priority rejected: " .. ((not ok) and "PASS" or "FAIL"))
+
+    -- Only names gaining an owner ever enter Lua: filtered in C
+    local ownerFilter = {msgType=l2dbus.Dbus.MESSAGE_TYPE_SIGNAL,
+    					member="NameOwnerChanged",
+    					clientFilter={signature="sss",
+    								args={{index=1, value=""}}}
+    					}
+	hnd[#hnd + 1] = conn:registerMatch(ownerFilter, function(match, msg, ud)
+		local name, old, new = msg:getArgs()
+		assert( old == "" )
+		print("Name acquired: " .. tostring(name) .. " by " .. tostring(new))
+		end)
+
+    -- Shared signal routes: several subscribers, one bus-side match rule
+    local sigRule = {member="NameOwnerChanged",
+    				interface=l2dbus.Dbus.INTERFACE_DBUS,
+    				decodeArgs=true}
+    local subs = {}
+    for i = 1,3 do
+    	subs[i] = conn:subscribeSignal(sigRule, function(sub, msg, idx, name, old, new)
+    		print("Subscriber " .. idx .. ": " .. tostring(name) ..
+    			" '" .. tostring(old) .. "' -> '" .. tostring(new) .. "'")
+    		-- The first subscriber only wants a single notification
+    		if (idx == 1) and subs[1] then
+    			assert( conn:unsubscribeSignal(sub) )
+    			subs[1] = nil
+    		end
+    		end, i)
+    end
+    local nRoutes, nSubs = conn:getSignalRouterStats()
+    assert( (nRoutes == 1) and (nSubs == 3) )
+
     local timeout = l2dbus.Timeout.new(disp, 10000, false, onTimeout, disp)
     timeout:setEnable(true)
 
     print("Starting main loop -- Open Unity App Menu to Exit")
     disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    print("Deferred matches at exit: " .. tostring(select(3, disp:getDispatchBudget())))
 
     -- Free all resources
     for i = 1,#hnd do
     	conn:unregisterMatch(hnd[i])
     	hnd[i] = nil
     end
+    for i = 1,3 do
+    	if subs[i] then
+    		assert( conn:unsubscribeSignal(subs[i]) )
+    		subs[i] = nil
+    	end
+    end
+    assert( 0 == conn:getSignalRouterStats() )
     conn = nil
     disp = nil
 end
@@ -226,6 +226,58 @@ local function main()
 		print("FAIL: " .. val)
 	end
 
+	dbusMsg = l2dbus.Message.newSignal("/com/acme", "com.acme", "sigName")
+	dbusMsg:addArgsBySignature("s", "body")
+	local clone = dbusMsg:clone()
+	print("Clone keeps body: " .. ((clone:getArgs() == "body") and "PASS" or "FAIL"))
+	clone = dbusMsg:clone(true)
+	if (clone:getSignature() == "") and (clone:getMember() == "sigName") and
+		(clone:getObjectPath() == "/com/acme") then
+		print("PASS - clone without body")
+	else
+		print("FAIL - clone without body")
+	end
+
+	local template = l2dbus.Message.newTemplate(dbusMsg, "si")
+	local stamped = template:newMessage("foo", 7)
+	local s, i = stamped:getArgs()
+	if (stamped:getInterface() == "com.acme") and (s == "foo") and (i == 7) then
+		print("PASS - message from template")
+	else
+		print("FAIL - message from template")
+	end
+	res,val = pcall(template.newMessage, template, "foo")
+	if res == false then
+		print("PASS - template argument mis-match")
+	else
+		print("FAIL: template accepted too few arguments")
+	end
+
+	-- Nested (and shared) tables are inferred without a signature
+	local point = {1, 2}
+	dbusMsg = l2dbus.Message.newSignal("/com/acme", "com.acme", "sigName")
+	dbusMsg:addArgs({point, point}, {1, "one"}, {name = "acme", pos = point})
+	print("Inferred signature: " .. dbusMsg:getSignature() ..
+		((dbusMsg:getSignature() == "aai(is)a{sv}") and " PASS" or " FAIL"))
+	local cycle = {}
+	cycle.self = cycle
+	res,val = pcall(dbusMsg.addArgs, dbusMsg, cycle)
+	if res == false then
+		print("PASS - attempt to marshall a table containing itself")
+	else
+		print("FAIL: marshalled a table containing itself")
+	end
+
+	local config = {retries = 3, hosts = {"a", "b"}}
+	print("Cached shape: " ..
+		((l2dbus.Message.cacheShape(config) == "a{sv}") and "PASS" or "FAIL"))
+	dbusMsg = l2dbus.Message.newSignal("/com/acme", "com.acme", "sigName")
+	dbusMsg:addArgs(config)
+	local decoded = dbusMsg:getArgs()
+	print("Cached shape marshalled: " ..
+		((decoded.hosts[2] == "b") and "PASS" or "FAIL"))
+	l2dbus.Message.cacheShape(config, false)
+
 
 	dbusMsg = l2dbus.Message.new(l2dbus.Message.METHOD_CALL)
 	print("Current => GetNoReply: " .. (dbusMsg:getNoReply() and "yes" or "no"))
@@ -300,6 +352,15 @@ local function main()
 	dbusMsg:setSerial(666)
 	print("Current serial # should be 666 = > " .. tostring(dbusMsg:getSerial()))
 
+	local header = {sender="stale"}
+	dbusMsg = l2dbus.Message.newMethodCall({path="/com/acme", interface="com.acme",
+				method="foo"})
+	assert( dbusMsg:getHeader(header) == header )
+	print("Header fields: " .. (((header.path == "/com/acme") and
+		(header.interface == "com.acme") and (header.member == "foo") and
+		(header.type == l2dbus.Message.METHOD_CALL) and
+		(header.sender == nil)) and "PASS" or "FAIL"))
+
 	print("=======================================")
 	print("   Testing Marshalling/Unmarshalling   ")
 	print("=======================================")
@@ -346,6 +407,184 @@ local function main()
 	print("The signature of packed-by-parts msg: " .. dbusMsg:getSignature())
 	dumpMsg(dbusMsg)
 
+	local plan = l2dbus.Message.compileSignature("a{sa(xi)}")
+	print("Precompiled signature: " .. plan:signature())
+	testMsgSetArgsBySig(plan, {one={{64, 32}}, two={{128, 64}}})
+	testMsgSetArgsBySig(l2dbus.Message.compileSignature("ya(ss)v"), 7,
+					{{"bob", "tom"}, {"mike", "ernie"}}, {a=1})
+	testMsgSetArgsBySig("ayadai", {1, 2, 255}, {1.5, -2.25}, {-1, 0, 1})
+	testMsgSetArgsBySig("axab", {l2dbus.Int64.new(-5), 6}, {true, false})
+	dbusMsg = l2dbus.Message.new(l2dbus.Message.METHOD_CALL)
+	dbusMsg:addArgsBySignature("ay", "raw\0bytes")
+	local blob = dbusMsg:getArgs({byteArrayAsString=true})
+	print("Byte array as string: " .. ((blob == "raw\0bytes") and "PASS" or "FAIL"))
+	print("Byte array as table: " .. pretty.write(dbusMsg:getArgs()))
+	dbusMsg = l2dbus.Message.new(l2dbus.Message.METHOD_CALL)
+	dbusMsg:addArgsBySignature("a{sa{sv}}", {obj1={Name="a", Size=1},
+						obj2={Name="b", Size=2}})
+	local dict = dbusMsg:getArgs({internKeys=true})
+	print("Interned dictionary keys: " ..
+		(((dict.obj2.Name == "b") and (dict.obj1.Size == 1)) and "PASS" or "FAIL"))
+	print("Dictionary decode: " .. pretty.write(dbusMsg:getArgs()))
+	dbusMsg = l2dbus.Message.newSignal("/com/acme", "com.acme", "sigName")
+	dbusMsg:addArgs("one", 2, {3, 4})
+	local wire = dbusMsg:marshallToString()
+	local framed = "junk" .. wire .. wire
+	local needed = l2dbus.Message.unmarshallBytesNeeded(framed, 5)
+	print("Bytes needed: " .. needed .. " (" .. ((needed == #wire) and "PASS" or "FAIL") .. ")")
+	print("Partial header needs more: " ..
+		((l2dbus.Message.unmarshallBytesNeeded(wire:sub(1, 8)) == 0) and "PASS" or "FAIL"))
+	local copyMsg = l2dbus.Message.unmarshallFromString(framed, 5 + needed, needed)
+	print("Unmarshalled from slice: " .. pretty.write(copyMsg:getArgsAsArray()))
+	copyMsg = l2dbus.Message.unmarshallToMessage(dbusMsg:marshallToArray())
+	print("Array round-trip: " .. ((copyMsg:marshallToString() == wire) and "PASS" or "FAIL"))
+
+	local tmpl = l2dbus.Message.newCallTemplate("org.acme.Service", "/org/acme",
+										"org.acme.Intf", "DoIt", "sa{sv}")
+	print("Call template signature: " .. tmpl:signature())
+	dbusMsg = tmpl:newCall("first", {a=1})
+	dumpMsg(dbusMsg)
+	dbusMsg = tmpl:newCall("second", {b="two"})
+	dumpMsg(dbusMsg)
+	res, val = pcall(tmpl.newCall, tmpl, "too few")
+	print(((res == false) and "PASS" or "FAIL") .. " - call template argument count")
+
+	local introXml = [[<?xml version="1.0"?>
+<!DOCTYPE node PUBLIC "-//freedesktop//DTD D-BUS Object Introspection 1.0//EN"
+ "http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd">
+<node>
+  <!-- A comment -->
+  <interface name="org.acme.Intf">
+    <method name="DoIt">
+      <arg name="in1" type="s" direction="in"/>
+      <annotation name="org.acme.Note" value="&lt;ignored&gt;"/>
+      <arg name="out1" type="a{sv}" direction="out"/>
+    </method>
+    <signal name="Changed"><arg name="value" type="i"/></signal>
+    <property name="Mode" type="s" access="read"/>
+  </interface>
+  <node name="child"/>
+</node>]]
+	local intro = l2dbus.Introspection.parseXml(introXml)
+	local intf = intro["org.acme.Intf"]
+	print("Parsed introspection XML: " ..
+		(((intf ~= nil) and (#intf.methods.DoIt == 2) and
+		(intf.methods.DoIt[2].sig == "a{sv}") and
+		(intf.signals.Changed[1].dir == "out") and
+		(intf.properties.Mode.access == "r") and
+		(intro.child == nil)) and "PASS" or "FAIL"))
+	res, val = pcall(l2dbus.Introspection.parseXml, "<node><interface name='x'></node>")
+	print(((res == false) and "PASS" or "FAIL") .. " - mismatched introspection XML")
+
+	res, val = pcall(l2dbus.Message.compileSignature, "a{vs}")
+	if res == false then
+		print("PASS - attempt to compile invalid signature")
+	else
+		print("FAIL: " .. tostring(val))
+	end
+
+	local rawMsg = l2dbus.Message.newSignal("/org/acme", "org.acme.Intf", "Sig")
+	rawMsg:addArgsBySignature("a{sv}", {count = l2dbus.DbusTypes.Uint16.new(7),
+									name = "acme"})
+	local rawProps = rawMsg:getArgs({rawVariants = true})
+	local fwdMsg = l2dbus.Message.newSignal("/org/acme", "org.acme.Intf", "Fwd")
+	fwdMsg:addArgsBySignature("a{sv}", rawProps)
+	local fwdProps = fwdMsg:getArgs({rawVariants = true})
+	print("Raw variants: " .. (((rawProps.count:signature() == "q") and
+		(rawProps.count:value() == 7) and
+		(fwdProps.count:signature() == "q") and
+		(fwdProps.name:value() == "acme")) and "PASS" or "FAIL"))
+
+	-- Forwarding a raw variant holding a Unix fd mustn't leak a descriptor
+	local hasPosix, posix = pcall(require, "posix")
+	if hasPosix then
+		local fd = posix.open("/dev/null", posix.O_RDONLY)
+		local fdMsg = l2dbus.Message.newSignal("/org/acme", "org.acme.Intf", "Sig")
+		fdMsg:addArgsBySignature("a{sv}", {fd = l2dbus.DbusTypes.UnixFd.new(fd)})
+		local fdProps = fdMsg:getArgs({rawVariants = true})
+		for i = 1, 100 do
+			local fwdFdMsg = l2dbus.Message.newSignal("/org/acme", "org.acme.Intf", "Fwd")
+			fwdFdMsg:addArgsBySignature("a{sv}", fdProps)
+		end
+		fdMsg, fdProps = nil, nil
+		collectgarbage("collect")
+		posix.close(fd)
+		local probe = posix.open("/dev/null", posix.O_RDONLY)
+		posix.close(probe)
+		print("Raw variant Unix fd: " .. ((probe == fd) and "PASS" or "FAIL"))
+	end
+
+	local curMsg = l2dbus.Message.newSignal("/org/acme", "org.acme.Intf", "Sig")
+	curMsg:addArgsBySignature("sa(ii)u", "hdr", {{1, 2}, {3, 4}}, 9)
+	local cursor = curMsg:iterArgs()
+	local first = cursor:next()
+	local arrSig = cursor:peekSignature()
+	local sub = cursor:recurse()
+	local elemType = sub:peekType()
+	local elem = sub:decode()
+	sub:skip()
+	local second = sub:next()
+	cursor:skip()
+	local last = cursor:next()
+	print("Argument cursor: " .. (((first == "hdr") and (arrSig == "a(ii)") and
+		(elemType == "r") and (elem[1] == 1) and (second[2] == 4) and
+		(last == 9) and cursor:atEnd() and (cursor:next() == nil)) and
+		"PASS" or "FAIL"))
+
+	local nestMsg = l2dbus.Message.newSignal("/org/acme", "org.acme.Intf", "Sig")
+	nestMsg:addArgsBySignature("aa{s(iad)}", {{a = {1, {0.5, 2.5}}}, {b = {2, {}}}})
+	nestMsg:addArgsBySignature("aas", {{"x", "y"}, {}})
+	local nested, strs = nestMsg:getArgs()
+	print("Nested array signatures: " .. (((nestMsg:getSignature() == "aa{s(iad)}aas") and
+		(nested[1].a[2][2] == 2.5) and (nested[2].b[1] == 2) and
+		(strs[1][2] == "y")) and "PASS" or "FAIL"))
+
+	-- takeArgs decodes and releases the D-Bus message right away
+	local liveBefore = l2dbus.Message.getLiveStats().live
+	local takeMsg = l2dbus.Message.newSignal("/org/acme", "org.acme.Intf", "Sig")
+	takeMsg:addArgsBySignature("us", 7, "seven")
+	local n, str = takeMsg:takeArgs()
+	print("Take args: " .. (((n == 7) and (str == "seven") and
+		(not pcall(takeMsg.getArgs, takeMsg)) and
+		(l2dbus.Message.getLiveStats().live == liveBefore)) and "PASS" or "FAIL"))
+	print("Live messages: " .. pretty.write(l2dbus.Message.getLiveStats()))
+
+	-- JSON is transcoded straight to/from D-Bus arguments
+	local jsonMsg = l2dbus.Message.newSignal("/org/acme", "org.acme.Intf", "Sig")
+	local jsonArgs = '[7,"caf\\u00e9",[1.5,-2],{"1":true},[["x",{"k":[1,"v"]}]],"AB"]'
+	jsonMsg:addArgsFromJson("usada{ub}a(sa{sv})ay", jsonArgs)
+	local json = jsonMsg:getArgsAsJson()
+	print("JSON args: " .. json)
+	print("JSON round trip: " .. (((json ==
+		'[7,"caf\195\169",[1.5,-2],{"1":true},[["x",{"k":[1,"v"]}]],[65,66]]') and
+		(not pcall(jsonMsg.addArgsFromJson, jsonMsg, "y", "[256]")) and
+		(not pcall(jsonMsg.addArgsFromJson, jsonMsg, "v", "[null]"))) and
+		"PASS" or "FAIL"))
+	jsonMsg:dispose()
+
+	local validate = require("l2dbus.validate")
+	print("Native validators: " ..
+		((validate.isValidUtf8("caf\195\169") and
+		(not validate.isValidUtf8("\237\160\128")) and
+		validate.isValidBusName(":1.42") and
+		validate.isValidBusName(" org.acme.Service ") and
+		(not validate.isValidBusName("org.1acme")) and
+		validate.isValidObjectPath("/org/acme") and
+		(not validate.isValidObjectPath("/org//acme")) and
+		validate.isValidMember("DoIt") and
+		(not validate.isValidMember("1DoIt")) and
+		validate.isValidInterface("org.acme.Intf") and
+		(not validate.isValidInterface("org..acme"))) and "PASS" or "FAIL"))
+
+	-- Methods only accept objects of their own type
+	local typeMsg = l2dbus.Message.newSignal("/org/acme", "org.acme.Intf", "Sig")
+	local ok, err = pcall(typeMsg.getMember, l2dbus.Int64.new(1))
+	print("Type checked self: " .. (((not ok) and
+		(tostring(err):find("expected") ~= nil) and
+		(typeMsg.getMember(typeMsg) == "Sig") and
+		(not pcall(typeMsg.getMember, {}))) and "PASS" or "FAIL"))
+	typeMsg:dispose()
+
 	dbusMsg = nil
 
 end
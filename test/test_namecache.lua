@@ -0,0 +1,60 @@
+#!/usr/bin/env lua
+
+--
+-- Watches a well-known name with the MsgBusController name-owner cache
+-- while a second connection acquires and then releases it.
+--
+local l2dbus = require("l2dbus")
+local msgBusCtrl = require("l2dbus.msgbusctrl")
+
+local TEST_BUS_NAME = "org.l2dbus.namecache.Test"
+
+
+local function main()
+	local disp = l2dbus.Dispatcher.new(require("l2dbus_ev").MainLoop.new())
+	assert( nil ~= disp )
+	local conn = l2dbus.Connection.openStandard(disp, l2dbus.Dbus.BUS_SESSION)
+	assert( nil ~= conn )
+	local owner = l2dbus.Connection.openStandard(disp, l2dbus.Dbus.BUS_SESSION, true)
+	assert( nil ~= owner )
+
+	local ctrl = msgBusCtrl.new(conn)
+	ctrl:bind(false)
+	ctrl:setBlockingMode(true)
+	assert( ctrl:setNameCaching(true) )
+	print("Bus daemon owner: " .. tostring(ctrl:getNameOwner(l2dbus.Dbus.SERVICE_DBUS)))
+	print("Name initially unowned: " ..
+			((ctrl:nameHasOwner(TEST_BUS_NAME) == false) and "PASS" or "FAIL"))
+
+	local ownerCtrl = msgBusCtrl.new(owner)
+	ownerCtrl:bind(false)
+	ownerCtrl:setBlockingMode(true)
+
+	local hnd = ctrl:watchName(TEST_BUS_NAME,
+		function(name, uniqueName)
+			print("Appeared: " .. name .. " owned by " .. uniqueName)
+			print("Cached owner: " ..
+				((ctrl:getNameOwner(name) == uniqueName) and "PASS" or "FAIL"))
+			ownerCtrl:getProxy().m.ReleaseName(TEST_BUS_NAME)
+		end,
+		function(name, uniqueName)
+			print("Vanished: " .. name .. " owned by " .. uniqueName)
+			print("Name unowned again: " ..
+				((not ctrl:nameHasOwner(name)) and "PASS" or "FAIL"))
+			disp:stop()
+		end)
+	assert( hnd ~= nil )
+
+	ownerCtrl:getProxy().m.RequestName(TEST_BUS_NAME,
+										l2dbus.Dbus.NAME_FLAG_DO_NOT_QUEUE)
+	disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+
+	assert( ctrl:unwatchName(hnd) )
+	ctrl:setNameCaching(false)
+	ctrl:unbind()
+	ownerCtrl:unbind()
+end
+
+
+main()
+l2dbus.shutdown()
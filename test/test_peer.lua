@@ -0,0 +1,77 @@
+#!/usr/bin/env lua
+
+--
+-- Publishes a peer Server on the session bus, opens a direct connection
+-- to it and calls a service on the accepted connection through a
+-- ProxyController without going through the bus daemon.
+--
+local l2dbus = require("l2dbus")
+local peer = require("l2dbus.peer")
+local codegen = require("l2dbus.codegen")
+local service = require("l2dbus.service")
+local proxyCtrl = require("l2dbus.proxyctrl")
+
+local TEST_BUS_NAME = "org.l2dbus.peer.Test"
+local TEST_OBJ_PATH = "/org/l2dbus/peer/Test"
+local TEST_INTF = "org.l2dbus.peer.Echo"
+
+local TEST_XML = [[
+<node>
+  <interface name="org.l2dbus.peer.Echo">
+    <method name="Echo">
+      <arg name="text" type="s" direction="in"/>
+      <arg type="s" direction="out"/>
+    </method>
+  </interface>
+</node>
+]]
+
+
+local function main()
+	local echo = codegen.load(TEST_XML)[TEST_INTF]
+	local disp = l2dbus.Dispatcher.new(require("l2dbus_ev").MainLoop.new())
+	assert( nil ~= disp )
+	local conn = l2dbus.Connection.openStandard(disp, l2dbus.Dbus.BUS_SESSION)
+	assert( nil ~= conn )
+	print("Bus connection is not a peer: " .. (conn:isPeer() and "FAIL" or "PASS"))
+
+	-- The same service is offered on every accepted peer connection
+	local svc = service.new(TEST_OBJ_PATH, true)
+	assert( echo.register(svc, {
+		Echo = function(ctx, text)
+			ctx:reply(text)
+		end
+		}) )
+
+	local listener = peer.listen(disp, conn, TEST_OBJ_PATH,
+		function(peerConn, listener)
+			print("Accepted peer connection: " ..
+				(peerConn:isPeer() and "PASS" or "FAIL"))
+			assert( svc:attach(peerConn) )
+		end)
+	print("Listening on " .. listener:getAddress())
+
+	local client = l2dbus.Connection.openPeer(disp, listener:getAddress())
+	print("Client is a peer: " .. (client:isPeer() and "PASS" or "FAIL"))
+
+	local ctrl = proxyCtrl.new(client, TEST_BUS_NAME, TEST_OBJ_PATH)
+	ctrl:setBlockingMode(false)
+	local proxy = echo.newProxy(ctrl)
+	local status, pending = proxy.Echo("direct")
+	assert( status )
+	pending:setNotify(function(p)
+		local text = p:stealReply():takeArgs()
+		print("Peer Echo: " .. ((text == "direct") and "PASS" or "FAIL"))
+		disp:stop()
+	end)
+
+	disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+	for _, peerConn in ipairs(listener:getConnections()) do
+		svc:detach(peerConn)
+	end
+	listener:close()
+end
+
+
+main()
+l2dbus.shutdown()
@@ -16,7 +16,13 @@ local gProxy
 local APP_VER = "1.0.1"
 
 local function executeMenuAction(func, ...)
-	local bOk, status, result = pcall(func, ...)
+	local bOk, status, result
+	-- Awaiting calls yield so they can't be made across a pcall (Lua 5.1)
+	if gProxyCtrl:getAwaitMode() then
+		bOk, status, result = true, func(...)
+	else
+		bOk, status, result = pcall(func, ...)
+	end
 
 	if bOk == false then
         print( "Error: ", status )
@@ -24,7 +30,8 @@ local function executeMenuAction(func, ...)
     end
 
 	if status then
-		if not gProxyCtrl:getBlockingMode() then
+		if not gProxyCtrl:getBlockingMode() and
+			not gProxyCtrl:getAwaitMode() then
 			if "userdata" == type(result) then
 				local reply, errName, errMsg = gProxyCtrl:waitForReply(result)
 				if not reply then
@@ -184,6 +191,21 @@ local function menuToggleBlockingMode()
 end
 
 
+local function menuToggleAwaitMode()
+	print("==== NetworkManager Toggle Proxy Await Mode ====")
+	io.stdout:write("Enter (e)nable/(d)isable: ")
+	local state = gPrompter:getLine()
+	state = state:sub(1,1)
+	local enable = true
+	if (state == "d") or (state == "f") or (state == "n") then
+		enable = false
+	end
+	gProxyCtrl:setAwaitMode(enable)
+	print("Await mode: " .. ((gProxyCtrl:getAwaitMode() == enable) and
+		"PASS" or "FAIL"))
+end
+
+
 local function menuEnableSignals()
 	print("==== NetworkManager Enable/Disable Signals ====")
 	io.stdout:write("Enter (e)nable/(d)isable: ")
@@ -228,6 +250,7 @@ local function menuMain()
         print()
         print("a.   Return array of active connections")
         print("b.   Toggle blocking mode (on/off)")
+        print("c.   Toggle await (coroutine) mode (on/off)")
         print("d.   Returns list of all devices")
         print("f.   Find device by interface")
         print("i.   Dump the introspection data")
@@ -249,6 +272,8 @@ local function menuMain()
         	menuActiveConnections()
         elseif cmd == 'b' then
         	menuToggleBlockingMode()
+        elseif cmd == 'c' then
+        	menuToggleAwaitMode()
         elseif cmd == 'd' then
         	menuListDevices()
         elseif cmd == 'f' then
@@ -275,6 +300,27 @@ end
 
 
 
+-- A property read back after a set mustn't be served from a stale cache
+-- (the service needn't emit PropertiesChanged for it)
+local function testCachedSet()
+	local intfCache = gProxyCtrl.propCache["org.freedesktop.NetworkManager"]
+	local blocking = gProxyCtrl:getBlockingMode()
+	gProxyCtrl:setBlockingMode(true)
+	local status, enabled = gProxy.p.get.WirelessEnabled()
+	assert(status and (intfCache.WirelessEnabled == enabled))
+	intfCache.WirelessEnabled = "stale"
+	if gProxy.p.set.WirelessEnabled(enabled) then
+		status, enabled = gProxy.p.get.WirelessEnabled()
+		print("Read back cached property after set: " ..
+			((status and (enabled ~= "stale")) and "PASS" or "FAIL"))
+	else
+		print("Read back cached property after set: SKIPPED (set not permitted)")
+	end
+	intfCache.WirelessEnabled = nil
+	gProxyCtrl:setBlockingMode(blocking)
+end
+
+
 local function setup()
 	l2dbus.Trace.setFlags(l2dbus.Trace.ERROR, l2dbus.Trace.WARN)
 	--l2dbus.Trace.setFlags(l2dbus.Trace.ALL)
@@ -285,8 +331,19 @@ local function setup()
 
 	gProxyCtrl = ProxyController.new(conn, "org.freedesktop.NetworkManager",
 											"/org/freedesktop/NetworkManager")
+	-- Optionally serve property reads from the PropertiesChanged-driven cache
+	if arg[1] == "--cache" then
+		gProxyCtrl:setPropertyCaching(true)
+		assert(gProxyCtrl:getPropertyCaching())
+		gProxyCtrl:setPropertyChangedHandler(function(intf, changed, invalidated)
+			print("Properties changed on " .. intf)
+			end)
+	end
 	assert(gProxyCtrl:bind())
 	gProxy = gProxyCtrl:getProxy("org.freedesktop.NetworkManager")
+	if gProxyCtrl:getPropertyCaching() then
+		testCachedSet()
+	end
 end
 
 
@@ -305,6 +362,7 @@ local function main()
     gMainLoop:loop()
 
     gProxyCtrl:disconnectAllSignals()
+    gProxyCtrl:setPropertyCaching(false)
     gPrompter:restoreTtyState()
     gPrompter = nil
     gProxy = nil
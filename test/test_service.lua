@@ -211,6 +211,25 @@ local function main()
 	acsInf:registerMethods(AUDIO_CAPTURE_METHODS)
 	acsInf:registerSignals(AUDIO_CAPTURE_SIGNALS)
 	acsInf:registerProperties(AUDIO_CAPTURE_PROPS)
+
+	-- A second interface with the same properties shares their strings
+	local pool = l2dbus.Stats.snapshot().stringPool
+	local twinInf = l2dbus.Interface.new(AUDIO_CAPTURE_INTERFACE_NAME)
+	twinInf:registerProperties(AUDIO_CAPTURE_PROPS)
+	local twinPool = l2dbus.Stats.snapshot().stringPool
+	print("Interned property strings: " .. (((twinPool.strings == pool.strings) and
+		(twinPool.shared > pool.shared)) and "PASS" or "FAIL"))
+	twinInf:clearProperties()
+	twinInf = nil
+
+	-- Get/GetAll of the properties are answered natively from the store
+	acsInf:enablePropertyStore(true)
+	acsInf:setProperty("isActive", false)
+	assert( acsInf:getProperty("isActive") == false )
+	acsInf:setPropertyHandler("peakLevel", function(intf, name, token)
+		return math.random()
+	end)
+	assert( not pcall(acsInf.setProperty, acsInf, "unknownProp", 1) )
 	local introspectIf = l2dbus.Introspection.new()
 
 	svcObj:addInterface(acsInf)
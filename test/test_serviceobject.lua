@@ -366,9 +366,37 @@ local function main()
     -- Bind the service object to the connection
     gService:attach(conn)
 
+    -- The introspection XML is cached until an interface changes
+    local xml1 = gService.objInst:introspect(conn, L2DBUS_TEST_OBJECT)
+    local xml2 = gService.objInst:introspect(conn, L2DBUS_TEST_OBJECT)
+    assert( (xml1 ~= nil) and (xml1 == xml2) )
+    assert( xml1:find(L2DBUS_TEST_INTERFACE_NAME, 1, true) )
+
+    -- Manage a child object natively via org.freedesktop.DBus.ObjectManager
+    local objMgr = l2dbus.ObjectManager.new(L2DBUS_TEST_OBJECT)
+    assert( gService.objInst:addInterface(objMgr:interface()) )
+    objMgr:setConnection(conn)
+    objMgr:addObject(L2DBUS_TEST_OBJECT .. "/Child",
+                    {[L2DBUS_TEST_INTERFACE_NAME] = {rProp = 1, name = "child"}})
+    assert( objMgr:count() == 1 )
+    local managed = objMgr:getManagedObjects()
+    assert( managed[L2DBUS_TEST_OBJECT .. "/Child"]
+                    [L2DBUS_TEST_INTERFACE_NAME].name == "child" )
+    assert( not pcall(objMgr.addObject, objMgr, "/elsewhere", {}) )
+
+    -- Property changes are coalesced into one PropertiesChanged signal
+    gService:setPropertyCoalescing(gDispatcher, {interval = 10, maxSize = 4096})
+    gService:queuePropertyChange(conn, L2DBUS_TEST_INTERFACE_NAME, "rProp", 1)
+    gService:queuePropertyChange(conn, L2DBUS_TEST_INTERFACE_NAME, "rProp", 2)
+    gService:invalidateProperty(conn, L2DBUS_TEST_INTERFACE_NAME, "rwProp")
+    assert( gService:flushPropertyChanges() == 1 )
+    assert( gService:flushPropertyChanges() == 0 )
+
     print("Starting main loop")
     gDispatcher:run(l2dbus.Dispatcher.DISPATCH_WAIT)
 
+    assert( objMgr:removeObject(L2DBUS_TEST_OBJECT .. "/Child") )
+    assert( objMgr:count() == 0 )
     gService:detach(conn)
     dbusProxyCtrl:setBlockingMode(true)
     dbusProxyCtrl:disconnectAllSignals()
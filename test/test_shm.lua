@@ -0,0 +1,48 @@
+#!/usr/bin/env lua
+
+--
+-- Passes a large payload by reference: the payload is written to a sealed
+-- SharedMemory region and only its Unix fd, offset and length are
+-- marshalled into the message. The receiving side maps the region
+-- read-only.
+--
+local l2dbus = require("l2dbus")
+
+local PAYLOAD_SIZE = 4 * 1024 * 1024
+
+
+local function main()
+	local payload = string.rep("0123456789abcdef", PAYLOAD_SIZE / 16)
+	local shm = l2dbus.SharedMemory.fromString(payload, "test_shm")
+	assert( shm:isReadOnly() )
+	print("Region size: " .. ((#shm == PAYLOAD_SIZE) and "PASS" or "FAIL"))
+
+	local msg = l2dbus.Message.newSignal("/org/l2dbus/shm/Test",
+										"org.l2dbus.shm.Test", "Frame")
+	msg:addArgsBySignature(l2dbus.SharedMemory.PAYLOAD_SIGNATURE,
+							shm:getPayload())
+	print("Message carries an fd: " .. (msg:containsUnixFds() and "PASS" or "FAIL"))
+
+	-- D-Bus holds its own duplicate of the fd once it's added
+	shm:close()
+
+	local ref = msg:getArgs()
+	local mapped = l2dbus.SharedMemory.map(ref)
+	print("Mapped read-only: " .. (mapped:isReadOnly() and "PASS" or "FAIL"))
+	print("Payload intact: " .. ((mapped:read() == payload) and "PASS" or "FAIL"))
+	print("Partial read: " .. ((mapped:read(16, 4) == "0123") and "PASS" or "FAIL"))
+
+	-- A region can be mapped from any offset within it
+	local tail = l2dbus.SharedMemory.map(ref[1], PAYLOAD_SIZE - 6, 6)
+	print("Unaligned map: " .. ((tail:read() == "abcdef") and "PASS" or "FAIL"))
+	print("Write refused: " .. (pcall(tail.write, tail, 0, "x") and "FAIL" or "PASS"))
+
+	-- The fd decoded from the message is closed along with the message
+	mapped:close()
+	tail:close()
+	msg:dispose()
+end
+
+
+main()
+l2dbus.shutdown()
@@ -16,17 +16,101 @@ local function onTimeout(tmout, func)
     end
 end
 
+local function testTimerWheel()
+    local wheel = l2dbus.TimerWheel.new(gDisp, 10, function(wheel, tokens, tag)
+        print("Batch expiry (" .. tag .. "): " .. table.concat(tokens, ","))
+        end, "wheel")
+    local startTime = l2dbus.monotonicTime()
+    local fired = {}
+    local ids = {}
+    for i = 1, 10000 do
+        ids[i] = wheel:schedule(50 + (i % 100), nil, i)
+    end
+    for i = 1, 10000 do
+        assert(wheel:cancel(ids[i]))
+    end
+    assert(not wheel:cancel(ids[1]))
+    assert(wheel:count() == 0)
+    wheel:schedule(30, nil, "a")
+    wheel:schedule(30, nil, "b")
+    local late = wheel:schedule(10, function(w, token)
+        fired[#fired + 1] = token
+        end, "late")
+    assert(wheel:reschedule(late, 60))
+    wheel:schedule(100, function(w, token)
+        local elapsed = (l2dbus.monotonicTime() - startTime) * 1000
+        print("Timer wheel: " .. (((#fired == 1) and (fired[1] == "late") and
+            (elapsed >= 100) and (w:count() == 0)) and "PASS" or "FAIL"))
+        end, "last")
+    return wheel
+end
+
+local function testRegistryChurn()
+    -- Timeouts created and collected one after another leave tombstones
+    -- in the object registry, which mustn't make its hash table keep growing
+    local before = l2dbus.Stats.snapshot().registry
+    for i = 1, 20000 do
+        l2dbus.Timeout.new(gDisp, 1000, false, function() end)
+        if (i % 50) == 0 then
+            collectgarbage("collect")
+        end
+    end
+    collectgarbage("collect")
+    local after = l2dbus.Stats.snapshot().registry
+    print("Registry churn: " .. (((after.objects == before.objects) and
+        (after.buckets <= math.max(before.buckets, 256))) and "PASS" or "FAIL"))
+end
+
+local function testWatchdog()
+    l2dbus.Stats.setCallbackBudget(0.01, {abortAfter=0.05})
+    local slow = l2dbus.Timeout.new(gDisp, 10, false, function(tm)
+        local deadline = l2dbus.monotonicTime() + 1
+        while l2dbus.monotonicTime() < deadline do end
+        end)
+    local check = l2dbus.Timeout.new(gDisp, 100, false, function(tm)
+        local spinner
+        for _, handler in ipairs(l2dbus.Stats.snapshot().handlers) do
+            if (handler.aborted > 0) and handler.name:find("test_timeout.lua", 1, true) then
+                spinner = handler
+            end
+        end
+        l2dbus.Stats.setCallbackBudget(nil)
+        print("Watchdog aborted slow handler: " .. (((spinner ~= nil) and
+            (spinner.max < 1) and (spinner.traceback ~= nil)) and "PASS" or "FAIL"))
+        print("Watchdog disabled: " .. ((l2dbus.Stats.getCallbackBudget() == nil)
+            and "PASS" or "FAIL"))
+        end)
+    slow:setEnable(true)
+    check:setEnable(true)
+    return slow, check
+end
+
 local function main()
     pretty.dump(l2dbus)
 
 	local mainLoop
 	if (arg[1] == "--glib") or (arg[1] == "-g") then
 		mainLoop = require("l2dbus_glib").MainLoop.new()
+	elseif arg[1] == "--glib-batched" then
+		local glib = require("l2dbus_glib")
+		mainLoop = glib.MainLoop.new({batched=true, priority=glib.PRIORITY_HIGH_IDLE,
+			threadDefault=true})
+		print("Reject unbatched options: " .. ((not pcall(glib.MainLoop.new,
+			{priority=glib.PRIORITY_LOW})) and "PASS" or "FAIL"))
+	elseif (arg[1] == "--epoll") or (arg[1] == "-e") then
+		mainLoop = require("l2dbus_epoll").MainLoop.new()
 	else
 		mainLoop = require("l2dbus_ev").MainLoop.new()
 	end
 	
     gDisp = l2dbus.Dispatcher.new(mainLoop)
+    local wheel = testTimerWheel()
+    testRegistryChurn()
+    -- The watchdog's spinning handler changes the timing of the other tests
+    local slow, check
+    if (arg[1] == "--watchdog") or (arg[2] == "--watchdog") then
+        slow, check = testWatchdog()
+    end
 
     local timeout = l2dbus.Timeout.new(gDisp, 1000, false, onTimeout, function(str) print(str) end)
     print("The initialized interval is: " .. timeout:interval())
@@ -54,6 +138,7 @@ local function main()
     gDisp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
 
     -- Free all resources
+    wheel = nil
     timeout = nil
     gDisp = nil
 end
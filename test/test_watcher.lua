@@ -17,7 +17,11 @@ local function watchHandler(w, events, user)
     print("WatchHandler called!")
     print("Watch: " .. tostring(w))
     print("Events:")
-    pretty.dump(events)
+    if type(events) == "number" then
+        print("evMask=" .. events)
+    else
+        pretty.dump(events)
+    end
     print("User Data:" .. tostring(user))
     local result = posix.read(gReadFd, 1024)
     print("FIFO data: " .. tostring(result))
@@ -99,6 +103,20 @@ local function main()
     watch:setData("This is a test")
     print("Watch user data now: " .. watch:data())
 
+    -- Optionally deliver events as an integer mask (--mask) or in batches
+    -- (--batch, one Lua call per loop iteration) instead of an EventTable
+    if (arg[1] == "--batch") or (arg[2] == "--batch") then
+        gDisp:setWatchBatchHandler(function(watches, masks, count, user)
+            for i = 1,count do
+                watchHandler(watches[i], masks[i], user)
+            end
+        end, "batch")
+        watch:setDeliveryMode(l2dbus.Watch.DELIVER_BATCH)
+    elseif (arg[1] == "--mask") or (arg[2] == "--mask") then
+        watch:setDeliveryMode(l2dbus.Watch.DELIVER_MASK)
+    end
+    print("Watch delivery mode: " .. watch:getDeliveryMode())
+
     print("The watch is: " .. ((true == watch:isEnabled()) and "enabled" or "disabled"))
     print("Enabling the watch...")
     watch:setEnable(true)
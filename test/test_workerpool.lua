@@ -0,0 +1,79 @@
+#!/usr/bin/env lua
+
+--
+-- Runs as the gateway when started without arguments. The gateway matches
+-- signals on the session bus and fans them out to a pool of workers which
+-- run this same script (with the name of their Channel as the first
+-- argument) in their own Lua state and thread.
+--
+local l2dbus = require("l2dbus")
+local workerpool = require("l2dbus.workerpool")
+
+local NUM_WORKERS = 4
+
+
+local function newMainLoop(useGlib)
+	if useGlib then
+		return require("l2dbus_glib").MainLoop.new()
+	else
+		return require("l2dbus_ev").MainLoop.new()
+	end
+end
+
+
+local function runWorker(chanName, idx, useGlib)
+	local disp = l2dbus.Dispatcher.new(newMainLoop(useGlib))
+	assert( nil ~= disp )
+	local nHandled = 0
+
+	workerpool.attach(disp, chanName, function(msg)
+		nHandled = nHandled + 1
+		print("Worker " .. idx .. ": " .. tostring(msg:getMember()) ..
+				" serial=" .. tostring(msg:getSerial()))
+		end, nil, function()
+		print("Worker " .. idx .. " stopping after " .. nHandled .. " messages")
+		end)
+
+	disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+end
+
+
+local function runGateway(useGlib)
+	local disp = l2dbus.Dispatcher.new(newMainLoop(useGlib))
+	assert( nil ~= disp )
+	local conn = l2dbus.Connection.openStandard(disp, l2dbus.Dbus.BUS_SESSION)
+	assert( nil ~= conn )
+
+	local pool = workerpool.new(NUM_WORKERS, arg[0],
+								{ args = { useGlib and "--glib" or "--ev" } })
+	assert( pool:getWorkerCount() == NUM_WORKERS )
+
+	local hnd = conn:registerMatch({msgType=l2dbus.Dbus.MESSAGE_TYPE_SIGNAL},
+		function(match, msg)
+			if not pool:dispatch(msg) then
+				print("All workers are busy - dropped " .. tostring(msg:getMember()))
+			end
+		end)
+
+	local timeout = l2dbus.Timeout.new(disp, 10000, false, function()
+		local stats = pool:getStats()
+		print("Rejected messages: " .. stats.rejected)
+		assert( pool:stop() )
+		disp:stop()
+		end)
+	timeout:setEnable(true)
+
+	print("Fanning out session bus signals to " .. NUM_WORKERS ..
+			" workers for 10 seconds")
+	disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+	conn:unregisterMatch(hnd)
+end
+
+
+if (arg[1] ~= nil) and (arg[1]:match("^l2dbus%.workerpool%.")) then
+	runWorker(arg[1], arg[2], arg[3] == "--glib")
+else
+	runGateway((arg[1] == "--glib") or (arg[1] == "-g"))
+end
+
+l2dbus.shutdown()
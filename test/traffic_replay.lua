@@ -0,0 +1,477 @@
+#!/usr/bin/env lua
+------------------------------------------------------------------------------
+-- l2dbus Traffic Capture and Replay
+--
+------------------------------------------------------------------------------
+
+local helpText = [[
+
+  This tool records real D-Bus traffic into a compact capture file and
+  replays it later as a load generator. Unlike ping_stress.lua the load
+  has the same mix of signals, method calls and payloads as the bus it
+  was captured on.
+
+  Usage:
+  Capture with "-C [file]" and replay the file with "-R [file]".
+
+  Command line arguments:
+
+  Common Args:
+  --address [address]   -- D-Bus address of the bus to capture from or
+                           replay to. Default is the session bus.
+  --glib                -- Use the GLib main loop. Default is libev.
+  --peer                -- The address is a peer (not a bus). Replay only.
+  -h                    -- This help.
+  -v                    -- Verbosity
+
+  Capture Args:
+  -C [file]             -- Capture to [file].
+  -c [count]            -- Stop after capturing [count] messages.
+                           Default is infinite.
+  -d [seconds]          -- Stop after [seconds]. Default is 10 seconds.
+  --member [name]       -- Only capture messages with this member name.
+  --interface [name]    -- Only capture messages with this interface.
+
+  Replay Args:
+  -R [file]             -- Replay [file].
+  --all                 -- Replay method returns and errors as well.
+                           By default only method calls and signals are
+                           replayed.
+  --speed [factor]      -- Replay at [factor] times the captured speed
+                           (1 is real time). Zero sends as fast as
+                           possible. Default is 1.
+  --rate [msgs/sec]     -- Replay open-loop at a fixed rate regardless of
+                           the captured timing. Overrides --speed.
+  --loops [count]       -- Replay the capture [count] times. Default is 1.
+  --timeout [msec]      -- How long to wait for each reply. Default is
+                           5000 msec.
+
+  Method calls are re-sent to their captured destination. Calls captured
+  against a unique name (e.g. ":1.42") fail on another bus and are
+  counted as errors.
+
+  The capture file starts with the line "L2DBUS-CAPTURE 1". Each record
+  is a line with the capture time (in seconds) and the size of the
+  message followed by the marshalled message itself.
+
+  Example:
+  # Capture 30 seconds of traffic from the session bus
+  lua traffic_replay.lua -C session.cap -d 30
+
+  # Replay it at ten times the captured speed
+  lua traffic_replay.lua -R session.cap --speed 10
+
+  # Replay it open-loop at 5000 messages per second against a peer
+  lua traffic_replay.lua -R session.cap --rate 5000 --peer \
+      --address unix:path=/tmp/peer
+
+]]
+------------------------------------------------------------------------------
+
+---------------
+-- Requires
+---------------
+local pretty    = require "pl.pretty"
+local utils     = require "utils.commonUtils"  -- args parsing
+local l2dbus    = require "l2dbus"
+
+---------------
+-- Const
+---------------
+
+local APP_VER               = "1.0.0"
+local CAPTURE_MAGIC         = "L2DBUS-CAPTURE 1"
+-- The scheduler tick (msec) and the most messages sent per tick
+local TICK_MSEC             = 1
+local MAX_PER_TICK          = 1000
+
+---------------
+-- Globals
+---------------
+
+local g_address             = nil       -- --address option
+local g_useGlib             = false     -- --glib option
+local g_peer                = false     -- --peer option
+local g_verbose             = 0         -- -v option
+local g_captureFile         = nil       -- -C option
+local g_maxCount            = 0         -- -c option (0 is infinite)
+local g_duration            = 10        -- -d option
+local g_member              = nil       -- --member option
+local g_interface           = nil       -- --interface option
+local g_replayFile          = nil       -- -R option
+local g_replayAll           = false     -- --all option
+local g_speed               = 1         -- --speed option
+local g_rate                = nil       -- --rate option
+local g_loops               = 1         -- --loops option
+local g_replyTimeout        = 5000      -- --timeout option
+
+local g_disp                = nil
+local g_conn                = nil
+
+
+----------------------------------------------------------------
+--- Percentile
+---
+--- Returns the p'th percentile of a sorted array of samples
+----------------------------------------------------------------
+local function Percentile( samples, p )
+    if #samples == 0 then
+        return 0
+    end
+    local idx = math.ceil(p / 100 * #samples)
+    return samples[math.max(idx, 1)]
+end
+
+
+----------------------------------------------------------------
+--- OpenConnection
+---
+--- Opens the connection to capture from or replay to
+----------------------------------------------------------------
+local function OpenConnection()
+    local mainLoop
+    if g_useGlib then
+        mainLoop = require("l2dbus_glib").MainLoop.new()
+    else
+        mainLoop = require("l2dbus_ev").MainLoop.new()
+    end
+
+    g_disp = l2dbus.Dispatcher.new(mainLoop)
+    assert( nil ~= g_disp )
+    if g_peer then
+        g_conn = l2dbus.Connection.openPeer(g_disp, g_address)
+    elseif g_address then
+        g_conn = l2dbus.Connection.open(g_disp, g_address, true)
+    else
+        g_conn = l2dbus.Connection.openStandard(g_disp, l2dbus.Dbus.BUS_SESSION)
+    end
+    assert( nil ~= g_conn )
+end
+
+
+----------------------------------------------------------------
+--- Capture
+---
+--- Records the traffic seen on the bus into the capture file
+----------------------------------------------------------------
+local function Capture()
+    local fp = assert(io.open(g_captureFile, "wb"))
+    local nCaptured = 0
+    local nBytes = 0
+    local startTime = l2dbus.monotonicTime()
+
+    fp:write(CAPTURE_MAGIC, "\n")
+
+    local function onMessage( match, msg )
+        local bytes = msg:marshallToString()
+        fp:write(string.format("%.6f %d\n", l2dbus.monotonicTime() - startTime,
+                                #bytes), bytes)
+        nCaptured = nCaptured + 1
+        nBytes = nBytes + #bytes
+        if g_verbose > 1 then
+            print(string.format("%s %s %s", l2dbus.Message.msgTypeToString(
+                msg:getType()), tostring(msg:getInterface()),
+                tostring(msg:getMember())))
+        end
+        if (g_maxCount > 0) and (nCaptured >= g_maxCount) then
+            g_disp:stop()
+        end
+    end
+
+    -- Eavesdrop on every kind of message (borrowed since they're only
+    -- marshalled)
+    local hnd = {}
+    for _, msgType in ipairs({l2dbus.Dbus.MESSAGE_TYPE_METHOD_CALL,
+                            l2dbus.Dbus.MESSAGE_TYPE_METHOD_RETURN,
+                            l2dbus.Dbus.MESSAGE_TYPE_ERROR,
+                            l2dbus.Dbus.MESSAGE_TYPE_SIGNAL}) do
+        hnd[#hnd + 1] = g_conn:registerMatch({msgType=msgType, eavesdrop=true,
+                                member=g_member, interface=g_interface,
+                                borrowMessage=true}, onMessage)
+    end
+
+    local timeout = l2dbus.Timeout.new(g_disp, g_duration * 1000, false,
+                                    function() g_disp:stop() end)
+    timeout:setEnable(true)
+
+    print("Capturing to " .. g_captureFile)
+    g_disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+
+    for i = 1, #hnd do
+        g_conn:unregisterMatch(hnd[i])
+    end
+    fp:close()
+
+    print(string.format("Captured %d messages (%d bytes) in %.3f seconds",
+                        nCaptured, nBytes, l2dbus.monotonicTime() - startTime))
+end
+
+
+----------------------------------------------------------------
+--- LoadCapture
+---
+--- Reads the capture file into an array of { time, msg } records
+----------------------------------------------------------------
+local function LoadCapture()
+    local fp = assert(io.open(g_replayFile, "rb"))
+    local records = {}
+    local nSkipped = 0
+
+    if fp:read("*l") ~= CAPTURE_MAGIC then
+        error("not a capture file: " .. g_replayFile)
+    end
+
+    while true do
+        local line = fp:read("*l")
+        if line == nil then
+            break
+        end
+        local t, size = line:match("^(%S+) (%d+)$")
+        local bytes = size and fp:read(tonumber(size))
+        if (bytes == nil) or (#bytes ~= tonumber(size)) then
+            error("truncated capture file: " .. g_replayFile)
+        end
+
+        local msg = l2dbus.Message.unmarshallFromString(bytes)
+        local msgType = msg:getType()
+        if g_replayAll or (msgType == l2dbus.Message.METHOD_CALL) or
+            (msgType == l2dbus.Message.SIGNAL) then
+            records[#records + 1] = { time = tonumber(t), msg = msg }
+        else
+            nSkipped = nSkipped + 1
+        end
+    end
+    fp:close()
+
+    if g_verbose > 0 then
+        print(string.format("Loaded %d messages (skipped %d replies)",
+                            #records, nSkipped))
+    end
+    return records
+end
+
+
+----------------------------------------------------------------
+--- Replay
+---
+--- Re-sends the captured messages and reports the throughput and
+--- the latency of the method calls
+----------------------------------------------------------------
+local function Replay()
+    local records = LoadCapture()
+    local total = #records * g_loops
+    local stats = { sent = 0, sendErr = 0, calls = 0, replies = 0,
+                    errors = 0, signals = 0 }
+    local latencies = {}
+    local sentAt = {}
+    local nOutstanding = 0
+    local nextIdx = 1
+    local startTime
+
+    if total == 0 then
+        print("Nothing to replay")
+        return
+    end
+
+    local function done()
+        return (nextIdx > total) and (nOutstanding == 0)
+    end
+
+    local route = g_conn:addReplyHandler(function( conn, serial, reply )
+        local t0 = sentAt[serial]
+        if t0 then
+            sentAt[serial] = nil
+            nOutstanding = nOutstanding - 1
+            latencies[#latencies + 1] = l2dbus.monotonicTime() - t0
+            if reply:getType() == l2dbus.Message.ERROR then
+                stats.errors = stats.errors + 1
+            else
+                stats.replies = stats.replies + 1
+            end
+        end
+        if done() then
+            g_disp:stop()
+        end
+    end)
+
+    -- Returns when (relative to the start) the n'th message is due
+    local span = records[#records].time - records[1].time
+    local function dueTime( n )
+        if g_rate then
+            return (n - 1) / g_rate
+        elseif g_speed == 0 then
+            return 0
+        end
+        local loop = math.floor((n - 1) / #records)
+        local rec = records[((n - 1) % #records) + 1]
+        return (loop * span + rec.time - records[1].time) / g_speed
+    end
+
+    local function sendOne( n )
+        -- A copy has no serial so every send gets a fresh one
+        local msg = records[((n - 1) % #records) + 1].msg:clone()
+        local msgType = msg:getType()
+        if (msgType == l2dbus.Message.METHOD_CALL) and not msg:getNoReply() then
+            local ok, serial = g_conn:sendRouted(msg, route, g_replyTimeout)
+            if ok then
+                sentAt[serial] = l2dbus.monotonicTime()
+                nOutstanding = nOutstanding + 1
+                stats.calls = stats.calls + 1
+            else
+                stats.sendErr = stats.sendErr + 1
+            end
+        elseif g_conn:send(msg) then
+            if msgType == l2dbus.Message.SIGNAL then
+                stats.signals = stats.signals + 1
+            end
+        else
+            stats.sendErr = stats.sendErr + 1
+        end
+        stats.sent = stats.sent + 1
+    end
+
+    local tick = l2dbus.Timeout.new(g_disp, TICK_MSEC, true, function( tm )
+        local now = l2dbus.monotonicTime() - startTime
+        local nSent = 0
+        while (nextIdx <= total) and (nSent < MAX_PER_TICK) and
+            (dueTime(nextIdx) <= now) do
+            sendOne(nextIdx)
+            nextIdx = nextIdx + 1
+            nSent = nSent + 1
+        end
+        if nextIdx > total then
+            tm:setEnable(false)
+            if done() then
+                g_disp:stop()
+            end
+        end
+    end)
+
+    print(string.format("Replaying %d messages from %s", total, g_replayFile))
+    startTime = l2dbus.monotonicTime()
+    tick:setEnable(true)
+    g_disp:run(l2dbus.Dispatcher.DISPATCH_WAIT)
+    local elapsed = l2dbus.monotonicTime() - startTime
+    g_conn:removeReplyHandler(route)
+
+    table.sort(latencies)
+    stats.elapsedSec = elapsed
+    stats.msgsPerSec = (elapsed > 0) and (stats.sent / elapsed) or 0
+    stats.latencyMsec = {
+        p50 = Percentile(latencies, 50) * 1000,
+        p90 = Percentile(latencies, 90) * 1000,
+        p99 = Percentile(latencies, 99) * 1000,
+        p999 = Percentile(latencies, 99.9) * 1000,
+        max = (latencies[#latencies] or 0) * 1000
+    }
+
+    print("STATS:")
+    print(string.rep("=", 40))
+    pretty.dump(stats)
+end
+
+
+----------------------------------------------------------------
+--- ParseArgs
+---
+--- Parse command line arguments
+----------------------------------------------------------------
+local function ParseArgs()
+
+    local bHelp    = false
+    local lArgs    = utils.deepcopy(arg)
+    local longOpt  = {--name           hasArg   short/retOpt
+                      {"address",      true,    nil },
+                      {"all",          false,   nil },
+                      {"glib",         false,   nil },
+                      {"interface",    true,    nil },
+                      {"loops",        true,    nil },
+                      {"member",       true,    nil },
+                      {"peer",         false,   nil },
+                      {"rate",         true,    nil },
+                      {"speed",        true,    nil },
+                      {"timeout",      true,    nil },
+          }
+
+    local function number( opt, optval, minVal )
+        local val = tonumber(optval)
+        if (val == nil) or (val < minVal) then
+            print("ERROR: Invalid value (option " .. opt .. "): ", optval)
+            os.exit(1)
+        end
+        return val
+    end
+
+    for opt, optval in utils.getopt(lArgs, 'C:c:d:hR:v', longOpt) do
+
+        if opt == "address" then
+            g_address = optval
+        elseif opt == "all" then
+            g_replayAll = true
+        elseif opt == "glib" then
+            g_useGlib = true
+        elseif opt == "interface" then
+            g_interface = optval
+        elseif opt == "loops" then
+            g_loops = number(opt, optval, 1)
+        elseif opt == "member" then
+            g_member = optval
+        elseif opt == "peer" then
+            g_peer = true
+        elseif opt == "rate" then
+            g_rate = number(opt, optval, 1)
+        elseif opt == "speed" then
+            g_speed = number(opt, optval, 0)
+        elseif opt == "timeout" then
+            g_replyTimeout = number(opt, optval, 1)
+        elseif opt == "C" then
+            g_captureFile = optval
+        elseif opt == "c" then
+            g_maxCount = number(opt, optval, 1)
+        elseif opt == "d" then
+            g_duration = number(opt, optval, 1)
+        elseif opt == "h" then
+            bHelp = true
+        elseif opt == "R" then
+            g_replayFile = optval
+        elseif opt == "v" then
+            g_verbose = g_verbose + 1
+        end
+
+    end -- arg loop
+
+    if (g_captureFile == nil) == (g_replayFile == nil) then
+        bHelp = true
+    elseif g_peer and (g_captureFile or (g_address == nil)) then
+        print("ERROR: --peer needs an --address and only applies to replay")
+        os.exit(1)
+    end
+
+    if bHelp == true then
+        print()
+        print(arg[0], string.format("%s",APP_VER))
+        print(helpText)
+        os.exit(1)
+    end
+
+end -- ParseArgs
+
+
+local function main()
+    l2dbus.Trace.setFlags(l2dbus.Trace.ERROR, l2dbus.Trace.WARN)
+    ParseArgs()
+    OpenConnection()
+
+    if g_captureFile then
+        Capture()
+    else
+        Replay()
+    end
+
+    g_conn = nil
+    g_disp = nil
+end
+
+
+main()
+l2dbus.shutdown()